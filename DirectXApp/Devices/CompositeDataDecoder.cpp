@@ -0,0 +1,244 @@
+#include "CompositeDataDecoder.h"
+
+namespace
+{
+    //out[i] = c0 * x[i] + c1 * y[i] + c2 * z[i] + b for every sample. The loop is written four samples at a time
+    //because compilers that won't vectorize a loop with an unknown trip count (GCC at -O2 for one) will still turn
+    //four independent statements into a single vector operation. Each group of four is read before any of it is
+    //written so that holds even though out isn't known to be separate from x, y and z. The last few samples get
+    //picked up one at a time.
+    void transformAxis(float* out, const float* x, const float* y, const float* z, float c0, float c1, float c2, float b, int samples)
+    {
+        int i = 0;
+        for (; i + 4 <= samples; i += 4)
+        {
+            const float x0 = x[i], x1 = x[i + 1], x2 = x[i + 2], x3 = x[i + 3];
+            const float y0 = y[i], y1 = y[i + 1], y2 = y[i + 2], y3 = y[i + 3];
+            const float z0 = z[i], z1 = z[i + 1], z2 = z[i + 2], z3 = z[i + 3];
+            out[i] = c0 * x0 + c1 * y0 + c2 * z0 + b;
+            out[i + 1] = c0 * x1 + c1 * y1 + c2 * z1 + b;
+            out[i + 2] = c0 * x2 + c1 * y2 + c2 * z2 + b;
+            out[i + 3] = c0 * x3 + c1 * y3 + c2 * z3 + b;
+        }
+        for (; i < samples; i++) out[i] = c0 * x[i] + c1 * y[i] + c2 * z[i] + b;
+    }
+
+    //Same idea as transformAxis(), the int16 readings and the floats can't overlap so there's nothing to read first
+    void readingsToFloat(float* out, const int16_t* readings, int samples)
+    {
+        int i = 0;
+        for (; i + 4 <= samples; i += 4)
+        {
+            out[i] = (float)readings[i];
+            out[i + 1] = (float)readings[i + 1];
+            out[i + 2] = (float)readings[i + 2];
+            out[i + 3] = (float)readings[i + 3];
+        }
+        for (; i < samples; i++) out[i] = (float)readings[i];
+    }
+}
+
+CompositeDataDecoder::CompositeDataDecoder()
+{
+    //Default to identity tables so that decoding before any sensor information
+    //is available just converts the LSB readings directly to floats
+    for (int sensor = 0; sensor < COMPOSITE_SENSORS; sensor++)
+    {
+        for (int row = 0; row < COMPOSITE_AXES; row++)
+        {
+            for (int column = 0; column < COMPOSITE_AXES; column++)
+            {
+                m_tables[sensor].raw[row][column] = (row == column) ? 1.0f : 0.0f;
+                m_tables[sensor].calibrated[row][column] = (row == column) ? 1.0f : 0.0f;
+            }
+            m_tables[sensor].bias[row] = 0.0f;
+        }
+    }
+}
+
+void CompositeDataDecoder::setSensorTable(int sensor, float conversion_rate, const int* axis_swap, const int* axis_polarity, const float* offset, const float** gain)
+{
+    //Builds the combined conversion + axis swap + calibration matrices for a single sensor. The original
+    //decoding did the following for each axis reading:
+    //  raw[axis_swap[axis]] = reading[axis] * conversion_rate * axis_polarity[axis]
+    //  calibrated[row] = sum_over_column(gain[row][column] * (raw[column] - offset[column]))
+    //which can be rewritten as calibrated = (gain * R) * reading - gain * offset, where R is the signed
+    //permutation matrix scaled by the conversion rate.
+    SensorDecodeTable& table = m_tables[sensor];
+
+    for (int row = 0; row < COMPOSITE_AXES; row++)
+    {
+        for (int column = 0; column < COMPOSITE_AXES; column++) table.raw[row][column] = 0.0f;
+    }
+    for (int axis = 0; axis < COMPOSITE_AXES; axis++) table.raw[axis_swap[axis]][axis] = conversion_rate * axis_polarity[axis];
+
+    for (int row = 0; row < COMPOSITE_AXES; row++)
+    {
+        table.bias[row] = 0.0f;
+        for (int column = 0; column < COMPOSITE_AXES; column++)
+        {
+            table.calibrated[row][column] = gain[row][0] * table.raw[0][column] + gain[row][1] * table.raw[1][column] + gain[row][2] * table.raw[2][column];
+            table.bias[row] -= gain[row][column] * offset[column];
+        }
+    }
+}
+
+int CompositeDataDecoder::readHeader(const uint8_t* buffer, size_t length, uint32_t& timer_ticks)
+{
+    CompositePacketHeader header;
+    int samples = readHeader(buffer, length, header);
+    timer_ticks = header.timer_ticks;
+    return samples;
+}
+
+int CompositeDataDecoder::readHeader(const uint8_t* buffer, size_t length, CompositePacketHeader& header)
+{
+    //Reads the time stamp, sample count, sequence number and dropped packet count from the front of the notification.
+    //The sample count is clamped to the number of complete samples actually present in the buffer so that a malformed
+    //notification can never cause a read past the end of it.
+    if (buffer == nullptr || length < COMPOSITE_HEADER_SIZE)
+    {
+        header.timer_ticks = 0;
+        header.samples = 0;
+        header.sequence = 0;
+        header.dropped_packets = 0;
+        header.packed = false;
+        header.fused = false;
+        header.linear_acceleration = false;
+        return 0;
+    }
+
+    header.timer_ticks = (uint32_t)buffer[0] | ((uint32_t)buffer[1] << 8) | ((uint32_t)buffer[2] << 16) | ((uint32_t)buffer[3] << 24);
+    header.sequence = (uint16_t)(buffer[5] | (buffer[6] << 8));
+    header.dropped_packets = (uint16_t)(buffer[7] | (buffer[8] << 8));
+
+    //Packed samples don't have a fixed size so they get checked when they're unpacked instead. Fused samples
+    //come with or without the linear acceleration, the size of the notification says which one it is.
+    int samples = buffer[4] & SAMPLE_PACKING_COUNT_MASK;
+    size_t payload = length - COMPOSITE_HEADER_SIZE;
+    header.packed = (buffer[4] & SAMPLE_PACKING_PACKED_FLAG) != 0;
+    header.fused = (buffer[4] & SAMPLE_PACKING_FUSED_FLAG) != 0;
+    header.linear_acceleration = header.fused && samples > 0 && payload >= (size_t)samples * (SAMPLE_PACKING_QUATERNION_SIZE + SAMPLE_PACKING_LINEAR_SIZE);
+
+    int samples_in_buffer = (int)(payload / COMPOSITE_SAMPLE_SIZE);
+    if (header.packed) samples_in_buffer = COMPOSITE_MAX_SAMPLES;
+    else if (header.fused) samples_in_buffer = (int)(payload / (SAMPLE_PACKING_QUATERNION_SIZE + (header.linear_acceleration ? SAMPLE_PACKING_LINEAR_SIZE : 0)));
+    if (samples > samples_in_buffer) samples = samples_in_buffer;
+    header.samples = samples;
+
+    return samples;
+}
+
+int CompositeDataDecoder::readSamples(const uint8_t* buffer, size_t length, CompositePacketHeader const& header, int16_t* readings, uint16_t stride)
+{
+    //Unpacks the int16 readings of every sample in the notification (raw or packed) into one row per sensor
+    //axis, the reading for sample i of channel c goes to readings[c * stride + i]. Returns the number of samples
+    //unpacked, or 0 if the notification is malformed (or holds fused samples, which don't have any readings).
+    if (header.samples <= 0 || header.fused || length < COMPOSITE_HEADER_SIZE) return 0;
+
+    size_t payload = length - COMPOSITE_HEADER_SIZE;
+    if (payload > 0xFFFF) payload = 0xFFFF;
+    int samples = sample_packing_decode(buffer + COMPOSITE_HEADER_SIZE, (uint16_t)payload, (uint8_t)header.samples, header.packed, readings, stride);
+    return (samples > 0) ? samples : 0;
+}
+
+int CompositeDataDecoder::decode(const uint8_t* buffer, size_t length, uint32_t& timer_ticks, CompositeDecodeOutput const& output, int max_samples) const
+{
+    //Decodes an entire notification and returns the number of samples that were written to the output arrays.
+    CompositePacketHeader header;
+    readHeader(buffer, length, header);
+    timer_ticks = header.timer_ticks;
+    if (header.fused) return decodeFused(buffer, length, header, output, max_samples);
+
+    //First, de-interleave (or unpack) the readings into one contiguous array per sensor axis.
+    //Assembling the int16 from individual bytes keeps this independent of the endianness of
+    //the host. Packed samples all depend on each other so every one gets unpacked, even if
+    //fewer than that are asked for.
+    int16_t readings[COMPOSITE_SENSORS * COMPOSITE_AXES][COMPOSITE_MAX_SAMPLES];
+    int samples = readSamples(buffer, length, header, readings[0], COMPOSITE_MAX_SAMPLES);
+    if (samples > max_samples) samples = max_samples;
+    if (samples <= 0) return 0;
+
+    return convertReadings(readings[0], COMPOSITE_MAX_SAMPLES, samples, output);
+}
+
+int CompositeDataDecoder::convertReadings(const int16_t* readings, size_t stride, int samples, CompositeDecodeOutput const& output) const
+{
+    //Runs readings that have already been unpacked (one row per sensor axis, the reading for sample i of channel c
+    //at readings[c * stride + i]) through the decode tables. Longer runs of samples than a single notification holds,
+    //like a burst window, get converted a notification's worth at a time so the working arrays can stay on the stack.
+    for (int start = 0; start < samples; start += COMPOSITE_MAX_SAMPLES)
+    {
+        const int block = (samples - start < COMPOSITE_MAX_SAMPLES) ? samples - start : COMPOSITE_MAX_SAMPLES;
+
+        float lsb[COMPOSITE_SENSORS * COMPOSITE_AXES][COMPOSITE_MAX_SAMPLES];
+        for (int channel = 0; channel < COMPOSITE_SENSORS * COMPOSITE_AXES; channel++) readingsToFloat(lsb[channel], readings + channel * stride + start, block);
+
+        //With the data laid out as structure of arrays, every output axis is just a 3 term
+        //dot product across the sample arrays, see transformAxis()
+        for (int sensor = 0; sensor < COMPOSITE_SENSORS; sensor++)
+        {
+            SensorDecodeTable const& table = m_tables[sensor];
+            const float* x = lsb[sensor * COMPOSITE_AXES + 0];
+            const float* y = lsb[sensor * COMPOSITE_AXES + 1];
+            const float* z = lsb[sensor * COMPOSITE_AXES + 2];
+
+            for (int axis = 0; axis < COMPOSITE_AXES; axis++)
+            {
+                if (output.raw[sensor][axis] != nullptr)
+                    transformAxis(output.raw[sensor][axis] + start, x, y, z, table.raw[axis][0], table.raw[axis][1], table.raw[axis][2], 0.0f, block);
+
+                if (output.calibrated[sensor][axis] != nullptr)
+                    transformAxis(output.calibrated[sensor][axis] + start, x, y, z, table.calibrated[axis][0], table.calibrated[axis][1], table.calibrated[axis][2], table.bias[axis], block);
+            }
+        }
+    }
+
+    return (samples > 0) ? samples : 0;
+}
+
+int CompositeDataDecoder::decodeFused(const uint8_t* buffer, size_t length, CompositePacketHeader const& header, CompositeDecodeOutput const& output, int max_samples)
+{
+    //Fused samples only hold the orientation worked out by the Personal Caddie and maybe the linear acceleration.
+    //The readings themselves never get sent so the sensor outputs are cleared, other than the accelerometer when
+    //the linear acceleration is there. Adding gravity (from the orientation) back to it gives the calibrated
+    //accelerometer reading, which is what most of the app looks at.
+    if (header.samples <= 0) return 0;
+
+    size_t payload = length - COMPOSITE_HEADER_SIZE;
+    if (payload > 0xFFFF) payload = 0xFFFF;
+
+    float quaternions[4 * COMPOSITE_MAX_SAMPLES], linear[COMPOSITE_AXES * COMPOSITE_MAX_SAMPLES];
+    bool has_linear = false;
+    int samples = sample_packing_decode_fused(buffer + COMPOSITE_HEADER_SIZE, (uint16_t)payload, (uint8_t)header.samples, quaternions, linear, &has_linear);
+    if (samples > max_samples) samples = max_samples;
+    if (samples <= 0) return 0;
+
+    for (int component = 0; component < 4; component++)
+    {
+        float* quaternion = output.quaternion[component];
+        if (quaternion == nullptr) continue;
+        for (int i = 0; i < samples; i++) quaternion[i] = quaternions[4 * i + component];
+    }
+
+    for (int i = 0; i < samples; i++)
+    {
+        const float* q = quaternions + 4 * i;
+        const float gravity[COMPOSITE_AXES] = { 2 * (q[1] * q[3] - q[0] * q[2]), 2 * (q[2] * q[3] + q[0] * q[1]), q[0] * q[0] - q[1] * q[1] - q[2] * q[2] + q[3] * q[3] };
+
+        for (int axis = 0; axis < COMPOSITE_AXES; axis++)
+        {
+            float linear_acceleration = has_linear ? COMPOSITE_GRAVITY * linear[COMPOSITE_AXES * i + axis] : 0.0f;
+            if (output.linear[axis] != nullptr) output.linear[axis][i] = linear_acceleration;
+
+            for (int sensor = 0; sensor < COMPOSITE_SENSORS; sensor++)
+            {
+                float value = (sensor == 0 && has_linear) ? linear_acceleration + COMPOSITE_GRAVITY * gravity[axis] : 0.0f;
+                if (output.raw[sensor][axis] != nullptr) output.raw[sensor][axis][i] = value;
+                if (output.calibrated[sensor][axis] != nullptr) output.calibrated[sensor][axis][i] = value;
+            }
+        }
+    }
+
+    return samples;
+}
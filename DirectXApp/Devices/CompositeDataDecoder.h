@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include "../../Firmware/nRF52840_Drivers/sample_packing.h"
+
+//Layout of the composite data characteristic sent by the Personal Caddie. Each notification starts with a 4 byte
+//little endian time stamp (in 16 MHz timer ticks) followed by a single byte holding the number of valid samples,
+//a 2 byte sequence number (goes up by one for every data set the Personal Caddie reads, including ones it couldn't
+//send) and a 2 byte count of the data sets it has had to drop so far. After the header come the samples themselves,
+//each one being 9 little endian int16 readings in the order [acc_x, acc_y, acc_z, gyr_x, gyr_y, gyr_z, mag_x, mag_y, mag_z].
+//If the high bit of the sample count is set the samples are packed instead, and if the next bit is set they're
+//orientations from the AHRS on the Personal Caddie instead of readings, see sample_packing.h in the firmware.
+#define COMPOSITE_HEADER_SIZE          9 //matches DATA_CHARACTERISTIC_HEADER_SIZE in ble_sensor_service.h
+#define COMPOSITE_SAMPLE_SIZE          18
+#define COMPOSITE_MAX_SAMPLES          39 //matches MAX_SENSOR_SAMPLES in PersonalCaddie.h
+#define COMPOSITE_SENSORS              3
+#define COMPOSITE_AXES                 3
+#define COMPOSITE_GRAVITY              9.80665f //matches GRAVITY in constants.h
+
+//Everything held in the header of a single notification
+struct CompositePacketHeader
+{
+	uint32_t timer_ticks;
+	int samples; //clamped to the number of complete samples in the notification
+	bool packed; //samples are delta + bit packed instead of raw int16 readings
+	bool fused; //samples are quaternions from the AHRS on the Personal Caddie instead of readings
+	bool linear_acceleration; //each fused quaternion is followed by the linear acceleration
+	uint16_t sequence;
+	uint16_t dropped_packets;
+};
+
+/*
+* The conversion from LSB to real units, the swapping and inverting of axes and the offset/gain calibration are
+* all linear operations so they can be folded together into a single 3x3 matrix and bias vector for each sensor.
+* The "raw" matrix only applies the conversion rate and the axis swap/polarity (this is what gets stored in the
+* RAW_* data types), the "calibrated" matrix and bias additionally apply the calibration numbers.
+*/
+struct SensorDecodeTable
+{
+	float raw[COMPOSITE_AXES][COMPOSITE_AXES];
+	float calibrated[COMPOSITE_AXES][COMPOSITE_AXES];
+	float bias[COMPOSITE_AXES];
+};
+
+//Destination arrays for a decode. Each pointer must point to an array large enough to hold
+//every sample in the notification. Any pointer can be left as nullptr to skip that output.
+//The quaternion (w, x, y, z) and linear acceleration (m/s^2) outputs are only written
+//when the samples in the notification are fused.
+struct CompositeDecodeOutput
+{
+	float* raw[COMPOSITE_SENSORS][COMPOSITE_AXES] = {};
+	float* calibrated[COMPOSITE_SENSORS][COMPOSITE_AXES] = {};
+	float* quaternion[4] = {};
+	float* linear[COMPOSITE_AXES] = {};
+};
+
+/*
+* Platform neutral decoder for the composite data characteristic. This class doesn't depend on WinRT so it
+* works directly on the bytes of a notification and can be used anywhere a raw byte buffer is available.
+* All of the work that used to be spread across DataReader::ReadInt16(), getConversionRate() and a second
+* calibration pass through getDataPoint()/setDataPoint() happens here in a single pass over the data.
+*/
+class CompositeDataDecoder
+{
+public:
+	CompositeDataDecoder();
+
+	void setSensorTable(int sensor, float conversion_rate, const int* axis_swap, const int* axis_polarity, const float* offset, const float** gain);
+	SensorDecodeTable const& getSensorTable(int sensor) const { return m_tables[sensor]; }
+
+	static int readHeader(const uint8_t* buffer, size_t length, uint32_t& timer_ticks);
+	static int readHeader(const uint8_t* buffer, size_t length, CompositePacketHeader& header);
+	static int readSamples(const uint8_t* buffer, size_t length, CompositePacketHeader const& header, int16_t* readings, uint16_t stride);
+	int decode(const uint8_t* buffer, size_t length, uint32_t& timer_ticks, CompositeDecodeOutput const& output, int max_samples = COMPOSITE_MAX_SAMPLES) const;
+	int convertReadings(const int16_t* readings, size_t stride, int samples, CompositeDecodeOutput const& output) const;
+
+private:
+	static int decodeFused(const uint8_t* buffer, size_t length, CompositePacketHeader const& header, CompositeDecodeOutput const& output, int max_samples);
+
+	SensorDecodeTable m_tables[COMPOSITE_SENSORS];
+};
@@ -0,0 +1,317 @@
+#include "DeviceClock.h"
+
+#include <cmath>
+
+void ClockLineFit::reset(double forgetting_factor)
+{
+    forgetting = forgetting_factor;
+    x0 = y0 = 0.0;
+    weight = sum_x = sum_y = sum_xx = sum_xy = 0.0;
+    points = 0;
+}
+
+void ClockLineFit::add(double x, double y)
+{
+    if (points == 0)
+    {
+        x0 = x;
+        y0 = y;
+    }
+    x -= x0;
+    y -= y0;
+
+    weight = forgetting * weight + 1.0;
+    sum_x = forgetting * sum_x + x;
+    sum_y = forgetting * sum_y + y;
+    sum_xx = forgetting * sum_xx + x * x;
+    sum_xy = forgetting * sum_xy + x * y;
+    points++;
+}
+
+bool ClockLineFit::valid() const
+{
+    //A line needs at least two points that aren't on top of each other
+    return points >= 2 && (weight * sum_xx - sum_x * sum_x) > 0.0;
+}
+
+double ClockLineFit::slope() const
+{
+    return (weight * sum_xy - sum_x * sum_y) / (weight * sum_xx - sum_x * sum_x);
+}
+
+double ClockLineFit::at(double x) const
+{
+    //The fitted line always goes through the weighted mean of the points
+    double mean_x = sum_x / weight, mean_y = sum_y / weight;
+    return y0 + mean_y + slope() * ((x - x0) - mean_x);
+}
+
+void ClockLowerEnvelope::reset()
+{
+    hull.clear();
+    sum_x = sum_y = last_x = 0.0;
+    points = 0;
+}
+
+void ClockLowerEnvelope::add(double x, double y)
+{
+    //Andrew's monotone chain, any vertex the new point makes a left turn (or a straight line) with gets dropped
+    Point point = { x, y };
+    while (hull.size() >= 2)
+    {
+        Point const& a = hull[hull.size() - 2];
+        Point const& b = hull.back();
+        if ((b.x - a.x) * (point.y - a.y) - (b.y - a.y) * (point.x - a.x) > 0.0) break;
+        hull.pop_back();
+    }
+    if (!hull.empty() && hull.back().x >= x)
+    {
+        //Two points at the same x, only the lower one matters
+        if (hull.back().y <= y) return;
+        hull.pop_back();
+    }
+    hull.push_back(point);
+    sum_x += x;
+    sum_y += y;
+    last_x = x;
+    points++;
+}
+
+size_t ClockLowerEnvelope::edge() const
+{
+    //Index of the first vertex of the hull edge over the mean x
+    double mean_x = sum_x / points;
+    size_t i = 0;
+    while (i + 2 < hull.size() && hull[i + 1].x < mean_x) i++;
+    return i;
+}
+
+double ClockLowerEnvelope::slope() const
+{
+    size_t i = edge();
+    return (hull[i + 1].y - hull[i].y) / (hull[i + 1].x - hull[i].x);
+}
+
+double ClockLowerEnvelope::at(double x) const
+{
+    size_t i = edge();
+    return hull[i].y + slope() * (x - hull[i].x);
+}
+
+double ClockLowerEnvelope::slopeUncertainty() const
+{
+    //Every point is on or above the line, and how far above they are on average (which is the mean y minus the line
+    //at the mean x) is how far the line could be moved at either end. Spread over the points that's how much the
+    //slope could be off.
+    if (!valid() || span() <= 0.0) return INFINITY;
+    double mean_x = sum_x / points, mean_y = sum_y / points;
+    return (mean_y - at(mean_x)) / span();
+}
+
+double ClockLowerEnvelope::lowest() const
+{
+    double y = hull.empty() ? 0.0 : hull[0].y;
+    for (Point const& point : hull) if (point.y < y) y = point.y;
+    return y;
+}
+
+void DeviceClock::reset()
+{
+    //Starts a completely new timeline, the next packet gets time 0
+    m_nominalTicksPerSample = 0.0;
+
+    m_unwrapStarted = false;
+    m_lastTimerTicks = 0;
+    m_lastTick = 0;
+
+    m_streamStarted = false;
+    m_originTick = 0;
+    m_originSample = 0;
+    m_originTime = 0.0;
+    m_lastPacketTick = 0;
+    m_lastPacketSample = 0;
+    m_periodFit.reset(DEVICE_CLOCK_PERIOD_FORGETTING);
+
+    m_windowStart = 0.0;
+    m_windowMinimum = 0.0;
+    m_windowDeviceTime = 0.0;
+    m_offsetFit.reset();
+    m_rejectedWindows = 0;
+    m_rejectedInARow = 0;
+}
+
+void DeviceClock::setNominalOdr(double odr)
+{
+    //The ODR the sensors are set to. This is used until enough packets have come in to measure the real
+    //one, and as a sanity check on the measurement after that.
+    double ticks_per_sample = (odr > 0.0) ? DEVICE_CLOCK_FREQUENCY / odr : 0.0;
+    if (ticks_per_sample != m_nominalTicksPerSample && m_streamStarted) startStream(m_lastPacketTick, m_lastPacketSample);
+    m_nominalTicksPerSample = ticks_per_sample;
+}
+
+uint64_t DeviceClock::unwrap(uint32_t timer_ticks)
+{
+    //Each new tick count is assumed to be less than half of the 32-bit range (about 134 seconds) away from the
+    //last one, which lets the counter wrap around any number of times. Packets come in many times a second so
+    //this is never an issue.
+    if (!m_unwrapStarted)
+    {
+        m_unwrapStarted = true;
+        m_lastTick = timer_ticks;
+    }
+    else m_lastTick += (int64_t)(int32_t)(timer_ticks - m_lastTimerTicks);
+
+    m_lastTimerTicks = timer_ticks;
+    return m_lastTick;
+}
+
+void DeviceClock::startStream(uint64_t first_tick, uint64_t first_sample)
+{
+    //Called for the first packet and any time the tick count or sample numbers stop making sense (the Personal
+    //Caddie restarted its data clock, or the ODR changed). Times keep counting up from where they were so they
+    //never go backwards.
+    double next_time = 0.0;
+    if (m_streamStarted)
+    {
+        double period = ticksPerSample();
+        next_time = m_originTime + (sampleTick(m_lastPacketSample) - (double)m_originTick) / DEVICE_CLOCK_FREQUENCY;
+        next_time += (double)(first_sample - m_lastPacketSample) * period / DEVICE_CLOCK_FREQUENCY;
+    }
+
+    m_streamStarted = true;
+    m_originTick = first_tick;
+    m_originSample = first_sample;
+    m_originTime = next_time;
+    m_lastPacketTick = first_tick;
+    m_lastPacketSample = first_sample;
+    m_periodFit.reset(DEVICE_CLOCK_PERIOD_FORGETTING);
+    m_periodFit.add(0.0, 0.0);
+}
+
+void DeviceClock::addPacket(uint64_t first_tick, uint64_t first_sample, int samples, double arrival_time)
+{
+    //Adds the (unwrapped) time stamp of a packet along with the sample number of its first sample (which counts
+    //any samples that were lost) and the time, on the clock of this computer, that the packet arrived.
+    if (!m_streamStarted || first_tick < m_lastPacketTick || first_sample < m_lastPacketSample) startStream(first_tick, first_sample);
+
+    m_periodFit.add((double)(first_sample - m_originSample), (double)(first_tick - m_originTick));
+    m_lastPacketTick = first_tick;
+    m_lastPacketSample = first_sample;
+
+    //The packet gets sent right after its last sample is read so that's the time to compare against the arrival time
+    double device_time = m_originTime + (sampleTick(first_sample + (samples > 0 ? samples - 1 : 0)) - (double)m_originTick) / DEVICE_CLOCK_FREQUENCY;
+    double difference = arrival_time - device_time;
+
+    if (m_offsetFit.points == 0 && m_windowStart == 0.0)
+    {
+        m_windowStart = arrival_time;
+        m_windowMinimum = difference;
+        m_windowDeviceTime = device_time;
+    }
+    else if (arrival_time - m_windowStart >= DEVICE_CLOCK_SYNC_WINDOW)
+    {
+        endSyncWindow();
+        m_windowStart = arrival_time;
+        m_windowMinimum = difference;
+        m_windowDeviceTime = device_time;
+    }
+    else if (difference < m_windowMinimum)
+    {
+        m_windowMinimum = difference;
+        m_windowDeviceTime = device_time;
+    }
+}
+
+void DeviceClock::endSyncWindow()
+{
+    //Adds the minimum of the window that just ended to the drift fit, unless getting to it from the first minimum in
+    //the fit would take more drift than a crystal has. Packets that waited in a queue on the Personal Caddie (or
+    //anywhere else) arrive late by however long they waited, so a window where every packet waited gives a minimum
+    //that's too large. When several windows in a row get rejected it's the link that changed, so the fit starts over
+    //from the current window.
+    if (m_offsetFit.points > 0)
+    {
+        ClockLowerEnvelope::Point const& first = m_offsetFit.hull.front();
+        double elapsed = m_windowDeviceTime - first.x;
+        if (elapsed <= 0.0 || std::fabs(m_windowMinimum - first.y) > DEVICE_CLOCK_MAX_DRIFT_PPM * 1.0e-6 * elapsed)
+        {
+            m_rejectedWindows++;
+            if (++m_rejectedInARow < DEVICE_CLOCK_REJECTED_RESTART) return;
+            m_offsetFit.reset();
+        }
+    }
+    m_rejectedInARow = 0;
+    m_offsetFit.add(m_windowDeviceTime, m_windowMinimum);
+}
+
+bool DeviceClock::measuredTicksPerSample(double& ticks_per_sample) const
+{
+    //The slope of the tick vs. sample number line, as long as it's close to what the ODR says it should be
+    if (!m_periodFit.valid()) return false;
+
+    ticks_per_sample = m_periodFit.slope();
+    return m_nominalTicksPerSample <= 0.0 || std::fabs(ticks_per_sample - m_nominalTicksPerSample) <= DEVICE_CLOCK_MAX_PERIOD_ERROR * m_nominalTicksPerSample;
+}
+
+double DeviceClock::ticksPerSample() const
+{
+    double ticks_per_sample;
+    if (measuredTicksPerSample(ticks_per_sample)) return ticks_per_sample;
+    return (m_nominalTicksPerSample > 0.0) ? m_nominalTicksPerSample : DEVICE_CLOCK_FREQUENCY;
+}
+
+double DeviceClock::sampleTick(uint64_t sample) const
+{
+    //Device tick (as a double, since it's fractional) that the given sample was read at. Once the sample period
+    //has been measured this comes from the fitted line, which also smooths out any jitter in when the Personal
+    //Caddie stamped its packets. Before that the last packet time stamp and nominal ODR are used.
+    double ticks_per_sample;
+    if (measuredTicksPerSample(ticks_per_sample)) return (double)m_originTick + m_periodFit.at((double)sample - (double)m_originSample);
+    return (double)m_lastPacketTick + ((double)sample - (double)m_lastPacketSample) * ticksPerSample();
+}
+
+void DeviceClock::sampleTimes(uint64_t first_sample, int samples, double* times) const
+{
+    //Fills times with the time (in seconds on the device timeline) of each sample in a packet
+    double first_tick = sampleTick(first_sample);
+    double period = ticksPerSample();
+    for (int i = 0; i < samples; i++) times[i] = m_originTime + (first_tick + i * period - (double)m_originTick) / DEVICE_CLOCK_FREQUENCY;
+}
+
+double DeviceClock::tickTime(uint32_t timer_ticks) const
+{
+    //Time (in seconds on the device timeline) of a time stamp that didn't come with a packet of the live stream, like
+    //the start of a burst window. It gets unwrapped against the newest packet without changing anything, so it's
+    //fine for it to be a little before (or after) that packet.
+    double tick = (double)m_lastTick + (double)(int32_t)(timer_ticks - m_lastTimerTicks);
+    return m_originTime + (tick - (double)m_originTick) / DEVICE_CLOCK_FREQUENCY;
+}
+
+bool DeviceClock::driftKnown() const
+{
+    //The drift only gets used once enough windows are in the fit, they pin it down well enough and it's something a
+    //crystal could do
+    if (m_offsetFit.points < DEVICE_CLOCK_DRIFT_WINDOWS || !m_offsetFit.valid()) return false;
+    if (m_offsetFit.slopeUncertainty() > DEVICE_CLOCK_DRIFT_RESOLUTION * 1.0e-6) return false;
+    return std::fabs(m_offsetFit.slope()) <= DEVICE_CLOCK_MAX_DRIFT_PPM * 1.0e-6;
+}
+
+double DeviceClock::offset() const
+{
+    if (driftKnown()) return m_offsetFit.at(0.0);
+    return (m_offsetFit.points > 0) ? m_offsetFit.lowest() : m_windowMinimum;
+}
+
+double DeviceClock::hostTime(double device_time) const
+{
+    //Converts a time on the device timeline into the matching time on the clock of this computer
+    if (driftKnown()) return device_time + m_offsetFit.at(device_time);
+    return device_time + offset();
+}
+
+double DeviceClock::deviceTime(double host_time) const
+{
+    //The inverse of hostTime(). The drift is only a few parts per million so a single correction is plenty.
+    double device_time = host_time - offset();
+    return host_time - (hostTime(device_time) - device_time);
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//The data clock on the Personal Caddie runs at 16 MHz and its 32-bit counter wraps around about every 268 seconds
+#define DEVICE_CLOCK_FREQUENCY          16000000.0
+#define DEVICE_CLOCK_SYNC_WINDOW        1.0   //seconds of packets that get looked at to find a single offset measurement
+#define DEVICE_CLOCK_PERIOD_FORGETTING  0.999 //how quickly old packets stop mattering to the sample period estimate
+#define DEVICE_CLOCK_MAX_DRIFT_PPM      500.0 //crystals are well within this, an offset measurement that needs more than this was held up by the link
+#define DEVICE_CLOCK_DRIFT_WINDOWS      120   //sync windows that have to be in the drift fit before the drift gets used
+#define DEVICE_CLOCK_DRIFT_RESOLUTION   10.0  //ppm, the drift isn't used until the fit is at least this sure of it
+#define DEVICE_CLOCK_REJECTED_RESTART   5     //offset measurements rejected in a row before the drift fit starts over
+#define DEVICE_CLOCK_MAX_PERIOD_ERROR   0.05  //the measured sample period can't be more than 5% away from what the ODR says it should be
+
+//Weighted least squares fit of a straight line that's updated one point at a time. Older points are
+//slowly forgotten so the fit can follow slow changes (like a sensor warming up). Points are stored
+//relative to the first one so large x and y values don't cost any precision.
+struct ClockLineFit
+{
+	double forgetting = 1.0;
+	double x0 = 0.0, y0 = 0.0;
+	double weight = 0.0, sum_x = 0.0, sum_y = 0.0, sum_xx = 0.0, sum_xy = 0.0;
+	int points = 0;
+
+	void reset(double forgetting_factor);
+	void add(double x, double y);
+	bool valid() const;
+	double slope() const;
+	double at(double x) const;
+};
+
+//The lower convex hull of points that are added in order of x, for fitting a line to points that can only ever be too
+//high. Of all the lines that stay under every point, the one that touches the hull over the mean x of the points is
+//the closest to them (it minimizes the total distance), so that's the fitted line.
+struct ClockLowerEnvelope
+{
+	struct Point { double x, y; };
+
+	std::vector<Point> hull;
+	double sum_x = 0.0, sum_y = 0.0;
+	double last_x = 0.0;
+	int points = 0;
+
+	void reset();
+	void add(double x, double y);
+	bool valid() const { return hull.size() >= 2; }
+	double slope() const;
+	double at(double x) const;
+	double lowest() const;
+	double span() const { return hull.empty() ? 0.0 : last_x - hull[0].x; }
+	double slopeUncertainty() const;
+
+private:
+	size_t edge() const;
+};
+
+/*
+* Keeps track of time on the Personal Caddie. The 32-bit tick count in each notification gets unwrapped onto a 64-bit
+* timeline so long practice sessions don't wrap around, and everything is kept in doubles so sub-millisecond precision
+* isn't lost as the session goes on.
+*
+* Two things get estimated as packets come in:
+*   - The real time between samples. The sensor has its own oscillator so its ODR is never exactly what it's set to,
+*     fitting a line through the time stamp and sample number of every packet measures it. This is what gives each
+*     sample its own time stamp (instead of extrapolating from the first sample with the nominal ODR).
+*   - The offset and drift between the Personal Caddie's clock and the clock of this computer. A packet can only arrive
+*     after it was sent, so the smallest (arrival time - device time) seen in each sync window is the best measure of
+*     the offset. Queues on the way only ever make a minimum larger, so the line fitted to them is the lower envelope
+*     and its slope is the drift. A minimum that's further from the first one in the fit than a crystal could drift in
+*     that time is left out, and if that keeps happening the link itself has changed (a queue that filled up and stayed
+*     full) and the fit starts over. The drift isn't used until DEVICE_CLOCK_DRIFT_WINDOWS minimums are in the fit and
+*     they're spread over long enough to pin it down to DEVICE_CLOCK_DRIFT_RESOLUTION, until then the offset is just
+*     the smallest one. How long that takes depends on the link, minimums that sit well above the line (a busy queue,
+*     or a connection interval that only lets packets through at certain times) take a lot longer.
+*/
+class DeviceClock
+{
+public:
+	DeviceClock() { reset(); }
+
+	void reset();
+	void setNominalOdr(double odr);
+
+	uint64_t unwrap(uint32_t timer_ticks);
+	void addPacket(uint64_t first_tick, uint64_t first_sample, int samples, double arrival_time);
+	void sampleTimes(uint64_t first_sample, int samples, double* times) const;
+	double tickTime(uint32_t timer_ticks) const;
+
+	double ticksPerSample() const;
+	double odr() const { return DEVICE_CLOCK_FREQUENCY / ticksPerSample(); }
+	double hostTime(double device_time) const;
+	double deviceTime(double host_time) const;
+	double offset() const; //host time minus device time at device time 0
+	bool driftKnown() const;
+	double driftPpm() const { return driftKnown() ? 1000000.0 * m_offsetFit.slope() : 0.0; }
+	double driftUncertaintyPpm() const { return 1000000.0 * m_offsetFit.slopeUncertainty(); }
+	int syncWindows() const { return m_offsetFit.points; }
+	int rejectedSyncWindows() const { return m_rejectedWindows; }
+
+private:
+	bool measuredTicksPerSample(double& ticks_per_sample) const;
+	double sampleTick(uint64_t sample) const;
+	void startStream(uint64_t first_tick, uint64_t first_sample);
+	void endSyncWindow();
+
+	double m_nominalTicksPerSample;
+
+	bool m_unwrapStarted;
+	uint32_t m_lastTimerTicks;
+	uint64_t m_lastTick;
+
+	bool m_streamStarted;
+	uint64_t m_originTick; //device tick of the first packet in the current stream of data
+	uint64_t m_originSample;
+	double m_originTime; //time (in seconds) given to the first sample of the current stream
+	uint64_t m_lastPacketTick;
+	uint64_t m_lastPacketSample;
+	ClockLineFit m_periodFit; //device tick vs. sample number
+
+	double m_windowStart; //host time the current sync window started
+	double m_windowMinimum; //smallest (arrival time - device time) in the current sync window
+	double m_windowDeviceTime; //device time of the packet that gave the minimum
+	ClockLowerEnvelope m_offsetFit; //(host time - device time) vs. device time
+	int m_rejectedWindows;
+	int m_rejectedInARow;
+};
@@ -0,0 +1,271 @@
+#include "DeviceSession.h"
+#include "../../Firmware/MEMs_Drivers/sensor_settings.h"
+
+#include <sstream>
+
+#define AVAILABLE_SENSORS_ADDRESS_LENGTH 20 //the sensor addresses at the start of the available sensors characteristic, newer firmware adds more after them
+
+uint16_t gattAttributeUuid(GattAttribute attribute)
+{
+    switch (attribute)
+    {
+    case GattAttribute::Settings: return SETTINGS_CHARACTERISTIC_UUID;
+    case GattAttribute::AvailableSensors: return AVAILABLE_SENSORS_CHARACTERISTIC_UUID;
+    case GattAttribute::SmallData: return SMALL_DATA_CHARACTERISTIC_UUID;
+    case GattAttribute::MediumData: return MEDIUM_DATA_CHARACTERISTIC_UUID;
+    case GattAttribute::LargeData: return LARGE_DATA_CHARACTERISTIC_UUID;
+    case GattAttribute::BurstData: return BURST_DATA_CHARACTERISTIC_UUID;
+    case GattAttribute::Error: return ERROR_CHARACTERISTIC_UUID;
+    default: return 0;
+    }
+}
+
+uint16_t gattAttributeServiceUuid(GattAttribute attribute)
+{
+    return (attribute == GattAttribute::Error) ? PERSONAL_CADDIE_SERVICE_UUID : SENSOR_SERVICE_UUID;
+}
+
+bool gattAttributeRequired(GattAttribute attribute)
+{
+    return attribute != GattAttribute::BurstData;
+}
+
+bool GattHandleMap::complete() const
+{
+    for (int i = 0; i < GATT_ATTRIBUTE_COUNT; i++)
+    {
+        if (handles[i] == 0 && gattAttributeRequired(static_cast<GattAttribute>(i))) return false;
+    }
+    return true;
+}
+
+bool GattHandleMap::operator==(GattHandleMap const& other) const
+{
+    for (int i = 0; i < GATT_ATTRIBUTE_COUNT; i++)
+    {
+        if (handles[i] != other.handles[i]) return false;
+    }
+    return true;
+}
+
+bool GattHandleCache::find(uint64_t address, GattHandleMap& map) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto entry = m_maps.find(address);
+    if (entry == m_maps.end()) return false;
+
+    map = entry->second;
+    return true;
+}
+
+void GattHandleCache::store(uint64_t address, GattHandleMap const& map)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_maps[address] = map;
+}
+
+void GattHandleCache::forget(uint64_t address)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_maps.erase(address);
+}
+
+size_t GattHandleCache::size() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_maps.size();
+}
+
+std::string GattHandleCache::serialize() const
+{
+    //One device per line, its address followed by the handle of each characteristic in GattAttribute order
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::ostringstream text;
+    for (auto const& entry : m_maps)
+    {
+        text << entry.first;
+        for (int i = 0; i < GATT_ATTRIBUTE_COUNT; i++) text << ' ' << entry.second.handles[i];
+        text << '\n';
+    }
+    return text.str();
+}
+
+bool GattHandleCache::deserialize(std::string const& text)
+{
+    //A line with the wrong number of handles was written by a version of the app with a different set of
+    //characteristics, those devices just get their GATT table walked again
+    std::map<uint64_t, GattHandleMap> maps;
+    std::istringstream lines(text);
+    std::string line;
+    bool all_read = true;
+    while (std::getline(lines, line))
+    {
+        if (line.empty()) continue;
+
+        std::istringstream fields(line);
+        uint64_t address;
+        GattHandleMap map;
+        bool ok = static_cast<bool>(fields >> address);
+        for (int i = 0; ok && i < GATT_ATTRIBUTE_COUNT; i++) ok = static_cast<bool>(fields >> map.handles[i]);
+
+        std::string extra;
+        if (ok && !(fields >> extra) && map.complete()) maps[address] = map;
+        else all_read = false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_maps = maps;
+    return all_read;
+}
+
+void DeviceSession::start(StartupCompletion done)
+{
+    //Only one startup can run at a time, the transport gets reused for the whole connection
+    GattHandleMap map;
+    bool cached;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_running) return;
+
+        m_running = true;
+        m_done = done;
+        m_startup = SessionStartup();
+        cached = m_cache.find(m_transport.address(), map);
+        m_fromCache = cached;
+    }
+
+    if (!cached)
+    {
+        discover();
+        return;
+    }
+
+    //Binding to a cached map doesn't go over the air so it doesn't count as a stage
+    m_transport.bind(map, [this, map](bool success)
+        {
+            if (success) startup(map);
+            else
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_fromCache = false;
+                    m_startup.cacheWasStale = true;
+                }
+                m_cache.forget(m_transport.address());
+                discover();
+            }
+        });
+}
+
+bool DeviceSession::running() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_running;
+}
+
+void DeviceSession::discover()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_startup.stages++;
+    }
+
+    m_transport.discover([this](bool success, GattHandleMap const& map)
+        {
+            if (!success) finish(false, "Couldn't read the GATT table of the Personal Caddie");
+            else if (!map.complete()) finish(false, "The Personal Caddie is missing one of its characteristics");
+            else
+            {
+                m_cache.store(m_transport.address(), map);
+                startup(map);
+            }
+        });
+}
+
+void DeviceSession::startup(GattHandleMap const& map)
+{
+    //Every operation gets counted before any of them start since their callbacks can come in right away
+    bool burst = (map[GattAttribute::BurstData] != 0);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_startup.map = map;
+        m_startup.stages++;
+        m_remaining = burst ? 7 : 6;
+        m_failed = false;
+        m_error.clear();
+    }
+
+    m_transport.read(GattAttribute::Settings, [this](bool success, std::vector<uint8_t> const& value)
+        {
+            success = success && value.size() >= SENSOR_SETTINGS_LENGTH;
+            if (success)
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_startup.settings = value;
+            }
+            operationDone(success, "read the settings characteristic");
+        });
+    m_transport.read(GattAttribute::AvailableSensors, [this](bool success, std::vector<uint8_t> const& value)
+        {
+            success = success && value.size() >= AVAILABLE_SENSORS_ADDRESS_LENGTH;
+            if (success)
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_startup.availableSensors = value;
+            }
+            operationDone(success, "read the available sensors characteristic");
+        });
+    m_transport.writeCccd(GattAttribute::Error, true, [this](bool success) { operationDone(success, "enable error notifications"); });
+    m_transport.writeCccd(GattAttribute::SmallData, false, [this](bool success) { operationDone(success, "disable small data notifications"); });
+    m_transport.writeCccd(GattAttribute::MediumData, false, [this](bool success) { operationDone(success, "disable medium data notifications"); });
+    m_transport.writeCccd(GattAttribute::LargeData, false, [this](bool success) { operationDone(success, "disable large data notifications"); });
+    if (burst) m_transport.writeCccd(GattAttribute::BurstData, false, [this](bool success) { operationDone(success, "disable burst data notifications"); });
+}
+
+void DeviceSession::operationDone(bool success, const char* operation)
+{
+    bool retry = false;
+    std::string error;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!success && !m_failed)
+        {
+            m_failed = true;
+            m_error = std::string("Couldn't ") + operation;
+        }
+        if (--m_remaining > 0) return;
+
+        //Everything has come back. If something failed with a cached map, the map is the likely culprit.
+        if (m_failed && m_fromCache)
+        {
+            retry = true;
+            m_fromCache = false;
+            m_startup.cacheWasStale = true;
+        }
+        else if (!m_failed) m_startup.usedCache = m_fromCache;
+        error = m_error;
+    }
+
+    if (retry)
+    {
+        m_cache.forget(m_transport.address());
+        discover();
+    }
+    else finish(error.empty(), error);
+}
+
+void DeviceSession::finish(bool success, std::string const& error)
+{
+    SessionStartup startup;
+    StartupCompletion done;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_startup.success = success;
+        m_startup.error = error;
+        startup = m_startup;
+        done = m_done;
+        m_running = false;
+    }
+
+    if (done) done(startup);
+}
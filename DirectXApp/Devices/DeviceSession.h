@@ -0,0 +1,149 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+//Service and characteristic values are the same across Personal Caddie devices so define them here
+#define PERSONAL_CADDIE_SERVICE_UUID           0xBF40
+#define ERROR_CHARACTERISTIC_UUID              0xBF41
+#define SENSOR_SERVICE_UUID                    0xBF34
+#define SETTINGS_CHARACTERISTIC_UUID           0xBF35
+#define SMALL_DATA_CHARACTERISTIC_UUID         0xBF36
+#define MEDIUM_DATA_CHARACTERISTIC_UUID        0xBF37
+#define LARGE_DATA_CHARACTERISTIC_UUID         0xBF38
+#define AVAILABLE_SENSORS_CHARACTERISTIC_UUID  0xBF39
+#define BURST_DATA_CHARACTERISTIC_UUID         0xBF3A
+
+//The characteristics the app uses. The burst data characteristic is the only one older firmware doesn't have.
+enum class GattAttribute
+{
+	Settings,
+	AvailableSensors,
+	SmallData,
+	MediumData,
+	LargeData,
+	BurstData,
+	Error,
+	END
+};
+#define GATT_ATTRIBUTE_COUNT static_cast<int>(GattAttribute::END)
+
+uint16_t gattAttributeUuid(GattAttribute attribute); //the 16-bit short UUID
+uint16_t gattAttributeServiceUuid(GattAttribute attribute);
+bool gattAttributeRequired(GattAttribute attribute);
+
+//Where each characteristic ended up in the GATT table of a device, as the attribute handle of its value. A handle of 0
+//means the device doesn't have that characteristic.
+struct GattHandleMap
+{
+	uint16_t handles[GATT_ATTRIBUTE_COUNT] = {};
+
+	uint16_t& operator[](GattAttribute attribute) { return handles[static_cast<int>(attribute)]; }
+	uint16_t operator[](GattAttribute attribute) const { return handles[static_cast<int>(attribute)]; }
+	bool complete() const; //every required characteristic was found
+	bool operator==(GattHandleMap const& other) const;
+	bool operator!=(GattHandleMap const& other) const { return !(*this == other); }
+};
+
+/*
+* Remembers the handle map of every Personal Caddie that's been connected to, keyed by its Bluetooth address. The GATT
+* table only changes when new firmware gets flashed, so after the first connection to a device its characteristics can
+* be used without walking its GATT table again. The maps are saved as a line of text each so they can go into a file
+* in the app's local folder.
+*/
+class GattHandleCache
+{
+public:
+	bool find(uint64_t address, GattHandleMap& map) const;
+	void store(uint64_t address, GattHandleMap const& map);
+	void forget(uint64_t address);
+	size_t size() const;
+
+	std::string serialize() const;
+	bool deserialize(std::string const& text); //replaces whatever is in the cache, lines that don't make sense are skipped
+
+private:
+	mutable std::mutex m_mutex; //sessions finish on whatever thread the transport calls back on
+	std::map<uint64_t, GattHandleMap> m_maps;
+};
+
+/*
+* The link to a Personal Caddie, without anything about how it's implemented. The app uses the Windows Bluetooth LE
+* API (see WinRTTransport.h) and the Replay Tool uses an in process fake with a simulated BLE link (see
+* FakeTransport.h). Every operation completes by calling its callback, which can happen on any thread and can happen
+* before the method returns. Any number of operations can be waiting to complete at once, it's up to the transport
+* to get them onto the link as quickly as it can.
+*/
+class DeviceTransport
+{
+public:
+	typedef std::function<void(bool success)> Completion;
+	typedef std::function<void(bool success, std::vector<uint8_t> const& value)> ReadCompletion;
+	typedef std::function<void(bool success, GattHandleMap const& map)> DiscoveryCompletion;
+
+	virtual ~DeviceTransport() {}
+
+	virtual uint64_t address() const = 0;
+	virtual void discover(DiscoveryCompletion done) = 0; //walks the GATT table of the device over the air
+	virtual void bind(GattHandleMap const& map, Completion done) = 0; //uses the handle map from an earlier connection instead, without asking the device
+	virtual void read(GattAttribute attribute, ReadCompletion done) = 0;
+	virtual void write(GattAttribute attribute, std::vector<uint8_t> const& value, Completion done) = 0;
+	virtual void writeCccd(GattAttribute attribute, bool notify, Completion done) = 0;
+};
+
+//Everything the app needs from the Personal Caddie before it can say it's connected
+struct SessionStartup
+{
+	bool success = false;
+	bool usedCache = false; //the handle map came from the cache and held up
+	bool cacheWasStale = false; //there was a cached map but the device didn't match it, so its GATT table got walked after all
+	std::vector<uint8_t> settings; //the settings characteristic
+	std::vector<uint8_t> availableSensors; //the available sensors characteristic
+	GattHandleMap map;
+	int stages = 0; //times the session had to wait on the link before it could carry on
+	std::string error; //what went wrong when success is false
+};
+
+/*
+* Gets a connection to a Personal Caddie to the point where the app can use it, with as little waiting on the link as
+* possible. If the handle cache has a map for the device it gets used, otherwise the GATT table is walked and the map
+* that comes out of it is cached for next time. Then everything the startup needs is asked for at once: the settings
+* and available sensors characteristics get read, notifications get turned on for the error characteristic and off for
+* the data characteristics (they only get turned on when data is wanted). None of these depend on each other so
+* there's no reason to wait for one before starting the next, which lets the transport fill every connection event.
+*
+* A cached map can be out of date if the Personal Caddie got new firmware, which shows up as one of the startup
+* operations failing. When that happens the map is thrown away and the startup runs again after walking the GATT table.
+*/
+class DeviceSession
+{
+public:
+	typedef std::function<void(SessionStartup const& startup)> StartupCompletion;
+
+	DeviceSession(DeviceTransport& transport, GattHandleCache& cache) : m_transport(transport), m_cache(cache) {}
+
+	void start(StartupCompletion done);
+	bool running() const;
+
+private:
+	void discover();
+	void startup(GattHandleMap const& map);
+	void operationDone(bool success, const char* operation);
+	void finish(bool success, std::string const& error);
+
+	DeviceTransport& m_transport;
+	GattHandleCache& m_cache;
+	StartupCompletion m_done;
+
+	mutable std::mutex m_mutex;
+	bool m_running = false;
+	bool m_fromCache = false;
+	int m_remaining = 0; //startup operations that haven't completed yet
+	bool m_failed = false;
+	std::string m_error;
+	SessionStartup m_startup;
+};
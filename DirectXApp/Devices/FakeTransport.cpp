@@ -0,0 +1,192 @@
+#include "FakeTransport.h"
+#include "../../Firmware/MEMs_Drivers/sensor_settings.h"
+#include "../../Firmware/nRF52840_Drivers/boot_cache.h"
+
+#include <algorithm>
+#include <cmath>
+
+FakeDevice FakeDevice::personalCaddie(uint64_t address, bool burstCharacteristic)
+{
+    //Laid out the way the SoftDevice builds the GATT table of the firmware: the generic access and generic attribute
+    //services come first, then the sensor service and then the Personal Caddie service. Characteristics that notify
+    //take three handles (declaration, value and CCCD), the rest take two.
+    FakeDevice device;
+    device.address = address;
+
+    uint16_t handle = 0x000C; //the sensor service declaration
+    device.map[GattAttribute::Settings] = handle + 2;
+    handle += 2;
+    device.map[GattAttribute::SmallData] = handle + 2;
+    handle += 3;
+    device.map[GattAttribute::MediumData] = handle + 2;
+    handle += 3;
+    device.map[GattAttribute::LargeData] = handle + 2;
+    handle += 3;
+    device.map[GattAttribute::AvailableSensors] = handle + 2;
+    handle += 2;
+    if (burstCharacteristic)
+    {
+        device.map[GattAttribute::BurstData] = handle + 2;
+        handle += 3;
+    }
+    handle += 1; //the Personal Caddie service declaration
+    device.map[GattAttribute::Error] = handle + 2;
+
+    //A BMI270 and BMM150 on the internal bus with the default settings, followed by the boot timing
+    device.settings.assign(SENSOR_SETTINGS_LENGTH, 0);
+    device.settings[0] = 1; //sensor model
+    device.availableSensors.assign(BOOT_TIMING_OFFSET + BOOT_TIMING_SIZE, 0);
+    device.availableSensors[0] = 0x68;
+    device.availableSensors[1] = 0x68;
+    device.availableSensors[2] = 0x10;
+    return device;
+}
+
+FakeTransport::FakeTransport(FakeDevice& device, FakeLinkSettings const& link) : m_device(device), m_link(link)
+{
+    m_start = std::chrono::steady_clock::now();
+    m_thread = std::thread(&FakeTransport::run, this);
+}
+
+FakeTransport::~FakeTransport()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    m_thread.join();
+}
+
+double FakeTransport::now() const
+{
+    //Callbacks see the time their response arrived instead of the clock, so a request made in response to another one
+    //lands where it would on a real link no matter how late the thread woke up
+    if (std::this_thread::get_id() == m_thread.get_id()) return m_deliveryTime;
+
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - m_start;
+    return elapsed.count() * m_link.speedup;
+}
+
+int FakeTransport::requests() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_requests;
+}
+
+void FakeTransport::discover(DiscoveryCompletion done)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    double arrival = schedule(m_link.discoveryRequests);
+    GattHandleMap map = m_device.map;
+    deliver(arrival, [this, map, done]()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_map = map;
+                m_bound = true;
+            }
+            done(true, map);
+        });
+}
+
+void FakeTransport::bind(GattHandleMap const& map, Completion done)
+{
+    //Nothing goes over the link, the map just gets trusted until a request through it fails
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_map = map;
+        m_bound = true;
+    }
+    done(true);
+}
+
+void FakeTransport::read(GattAttribute attribute, ReadCompletion done)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    uint16_t handle;
+    bool success = resolve(attribute, handle);
+    std::vector<uint8_t> value;
+    if (success && attribute == GattAttribute::Settings) value = m_device.settings;
+    else if (success && attribute == GattAttribute::AvailableSensors) value = m_device.availableSensors;
+
+    deliver(schedule(1), [success, value, done]() { done(success, value); });
+}
+
+void FakeTransport::write(GattAttribute attribute, std::vector<uint8_t> const& value, Completion done)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    uint16_t handle;
+    bool success = resolve(attribute, handle) && attribute == GattAttribute::Settings; //the settings are the only thing that can be written
+    if (success) m_device.settings = value;
+
+    deliver(schedule(1), [success, done]() { done(success); });
+}
+
+void FakeTransport::writeCccd(GattAttribute attribute, bool notify, Completion done)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    uint16_t handle;
+    bool success = resolve(attribute, handle) && attribute != GattAttribute::Settings && attribute != GattAttribute::AvailableSensors;
+    if (success) m_device.notifying[static_cast<int>(attribute)] = notify;
+
+    deliver(schedule(1), [success, done]() { done(success); });
+}
+
+double FakeTransport::schedule(int requests)
+{
+    //Called with the lock held. Each request goes out at the first connection event after it's ready and the link is
+    //free, and the link stays busy until its response comes back.
+    double ready = std::max(now() + m_link.hostDelay, m_linkFree);
+    for (int i = 0; i < requests; i++)
+    {
+        double sent = std::ceil(ready / m_link.connectionInterval - 1e-9) * m_link.connectionInterval;
+        ready = sent + m_link.responseEvents * m_link.connectionInterval;
+    }
+
+    m_linkFree = ready;
+    m_requests += requests;
+    return ready;
+}
+
+bool FakeTransport::resolve(GattAttribute attribute, uint16_t& handle) const
+{
+    //A handle from an old GATT table either doesn't exist any more or belongs to something else now, in both cases
+    //the request fails
+    if (!m_bound) return false;
+
+    handle = m_map[attribute];
+    return handle != 0 && m_device.map[attribute] == handle;
+}
+
+void FakeTransport::deliver(double time, std::function<void()> callback)
+{
+    m_deliveries.push({ time, m_order++, callback });
+    m_wake.notify_all();
+}
+
+void FakeTransport::run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_stop)
+    {
+        if (m_deliveries.empty())
+        {
+            m_wake.wait(lock);
+            continue;
+        }
+
+        //Sleep until the earliest response is due, something earlier can get queued in the meantime
+        double time = m_deliveries.top().time;
+        auto due = m_start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double, std::milli>(time / m_link.speedup));
+        if (m_wake.wait_until(lock, due) != std::cv_status::timeout) continue;
+
+        Delivery delivery = m_deliveries.top();
+        m_deliveries.pop();
+        m_deliveryTime = delivery.time;
+
+        lock.unlock();
+        delivery.callback();
+        lock.lock();
+    }
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "DeviceSession.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <queue>
+#include <thread>
+
+//A simulated link to a Personal Caddie
+struct FakeLinkSettings
+{
+	double connectionInterval = 30.0; //ms between connection events
+	int responseEvents = 1; //connection events between a request going out and its response coming back
+	double hostDelay = 1.0; //ms between the app asking for something and the request being ready to go out
+	int discoveryRequests = 12; //ATT requests it takes to walk the GATT table (services, characteristics and CCCDs)
+	double speedup = 1.0; //runs the link this many times faster than real time, times reported by the transport stay in link time
+};
+
+//The GATT server on the simulated Personal Caddie. Changing the handle map between connections is what new firmware
+//with a different GATT table looks like to the app.
+struct FakeDevice
+{
+	uint64_t address = 0;
+	GattHandleMap map; //the value handle of each characteristic, the CCCD is the handle after it
+	std::vector<uint8_t> settings;
+	std::vector<uint8_t> availableSensors;
+	bool notifying[GATT_ATTRIBUTE_COUNT] = {};
+
+	static FakeDevice personalCaddie(uint64_t address, bool burstCharacteristic = true); //the GATT table the current firmware has
+};
+
+/*
+* A DeviceTransport with nothing on the other end but a FakeDevice, used to time how long it takes to get connected
+* without needing a Personal Caddie or Windows (see Replay_Tool/session_benchmark.cpp). The link follows the rules of
+* the BLE Attribute Protocol: requests only go out at connection events, only one request can be waiting on a response
+* at a time and the rest queue up behind it. A request that's already queued goes out in the same connection event the
+* response to the one in front of it comes back in, but a request that's only made once that response gets to the app
+* has to wait for the next connection event. Callbacks run on a thread of the transport's own.
+*/
+class FakeTransport : public DeviceTransport
+{
+public:
+	FakeTransport(FakeDevice& device, FakeLinkSettings const& link);
+	~FakeTransport();
+
+	uint64_t address() const override { return m_device.address; }
+	void discover(DiscoveryCompletion done) override;
+	void bind(GattHandleMap const& map, Completion done) override;
+	void read(GattAttribute attribute, ReadCompletion done) override;
+	void write(GattAttribute attribute, std::vector<uint8_t> const& value, Completion done) override;
+	void writeCccd(GattAttribute attribute, bool notify, Completion done) override;
+
+	double now() const; //ms of link time since the transport was created
+	int requests() const; //ATT requests sent so far
+
+private:
+	struct Delivery
+	{
+		double time; //link time the response gets to the app
+		uint64_t order; //keeps deliveries at the same time in the order they were asked for
+		std::function<void()> callback;
+
+		bool operator>(Delivery const& other) const { return (time != other.time) ? (time > other.time) : (order > other.order); }
+	};
+
+	double schedule(int requests); //reserves the link for a number of back to back requests, returns when the last response arrives
+	bool resolve(GattAttribute attribute, uint16_t& handle) const; //false if the bound map doesn't point at the attribute on the device
+	void deliver(double time, std::function<void()> callback);
+	void run();
+
+	FakeDevice& m_device;
+	FakeLinkSettings m_link;
+	std::chrono::steady_clock::time_point m_start;
+
+	mutable std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::priority_queue<Delivery, std::vector<Delivery>, std::greater<Delivery> > m_deliveries;
+	uint64_t m_order = 0;
+	double m_linkFree = 0.0; //link time the last queued request gets its response
+	double m_deliveryTime = 0.0; //link time of the callback currently running on the transport's thread
+	int m_requests = 0;
+	bool m_bound = false;
+	GattHandleMap m_map; //what the app thinks the GATT table looks like
+	bool m_stop = false;
+	std::thread m_thread;
+};
@@ -0,0 +1,119 @@
+#include "PacketReassembler.h"
+
+#include <cmath>
+
+void PacketReassembler::reset()
+{
+    //Gets called whenever a new stream of data is started. The Personal Caddie starts its sequence numbers
+    //and dropped packet count over from 0 at the same time.
+    resetStats();
+    m_ticksPerSample = 0.0;
+
+    m_started = false;
+    m_lastSequence = 0;
+    m_lastDroppedPackets = 0;
+    m_lastTimerTicks = 0;
+    m_lastTick = 0;
+    m_nextSample = 0;
+    m_lastSamples = 0;
+
+    m_lastArrivalTime = 0.0;
+}
+
+bool PacketReassembler::findLostPackets(CompositePacketHeader const& header, ReassembledPacket& packet)
+{
+    //Fills in the lost packet and sample counts for a packet that comes after the last one. Returns false if the
+    //packet doesn't fit after the last one, which happens when the Personal Caddie starts a new stream of data
+    //without the reassembler being told about it.
+    packet.lost_packets = (uint32_t)(uint16_t)(header.sequence - m_lastSequence) - 1;
+    packet.first_tick = m_lastTick + (uint32_t)(header.timer_ticks - m_lastTimerTicks);
+    packet.lost_samples = 0;
+    if (packet.lost_packets == 0) return true;
+
+    //The samples in the missing packets are the ones between the end of the last packet and the start of
+    //this one. If the ODR isn't known assume the missing packets were the same size as this one.
+    if (m_ticksPerSample > 0.0)
+    {
+        double expected_tick = (double)m_lastTick + m_lastSamples * m_ticksPerSample;
+        double missing = std::round(((double)packet.first_tick - expected_tick) / m_ticksPerSample);
+
+        //Every missing packet had at least one sample in it, if there isn't enough time for that then the
+        //sequence numbers must have started over
+        if (missing < (double)packet.lost_packets) return false;
+        packet.lost_samples = (uint32_t)missing;
+    }
+    else packet.lost_samples = packet.lost_packets * header.samples;
+
+    return true;
+}
+
+bool PacketReassembler::addPacket(CompositePacketHeader const& header, double arrival_time, ReassembledPacket& packet)
+{
+    //Works out where the given notification belongs in the stream and updates the link statistics. The arrival
+    //time is the time (in seconds, on any clock) that the notification was received by this computer. Returns
+    //false if the notification should be ignored because it's a duplicate or came in after a newer one.
+    bool new_stream = !m_started;
+    if (m_started)
+    {
+        //Sequence numbers are only 16 bits so look at the difference between them. Anything that goes back a
+        //little bit is something we've already moved past, anything that goes back further than that (or skips
+        //ahead more than the time stamps allow) is the start of a new stream.
+        int16_t sequence_difference = (int16_t)(uint16_t)(header.sequence - m_lastSequence);
+        if (sequence_difference <= 0 && sequence_difference > -PACKET_REORDER_WINDOW)
+        {
+            m_stats.packets_out_of_order++;
+            return false;
+        }
+
+        if (sequence_difference <= 0 || !findLostPackets(header, packet))
+        {
+            m_stats.stream_restarts++;
+            new_stream = true;
+        }
+        else if (packet.lost_packets > 0)
+        {
+            uint16_t dropped_by_device = (uint16_t)(header.dropped_packets - m_lastDroppedPackets);
+            m_stats.packets_dropped_by_device += (dropped_by_device < packet.lost_packets) ? dropped_by_device : packet.lost_packets;
+
+            m_stats.packets_lost += packet.lost_packets;
+            m_stats.samples_lost += packet.lost_samples;
+            m_stats.loss_bursts++;
+            if (packet.lost_packets > m_stats.longest_burst) m_stats.longest_burst = packet.lost_packets;
+        }
+    }
+
+    if (new_stream)
+    {
+        //Nothing to compare the packet against so it marks the start of the stream. Sample numbers keep going
+        //up from where they were so they never repeat.
+        packet.lost_packets = 0;
+        packet.lost_samples = 0;
+        packet.first_tick = header.timer_ticks;
+    }
+
+    packet.first_sample = m_nextSample + packet.lost_samples;
+    packet.samples = header.samples;
+
+    m_started = true;
+    m_lastSequence = header.sequence;
+    m_lastDroppedPackets = header.dropped_packets;
+    m_lastTimerTicks = header.timer_ticks;
+    m_lastTick = packet.first_tick;
+    m_lastSamples = header.samples;
+    m_nextSample = packet.first_sample + header.samples;
+
+    m_stats.packets_received++;
+    m_stats.samples_received += header.samples;
+
+    //Notifications sent during the same connection event all show up at nearly the same time, so a long enough
+    //gap between two of them means a new connection event has started
+    if (m_eventNotifications == 0 || arrival_time - m_lastArrivalTime > LINK_EVENT_GAP_SECONDS)
+    {
+        m_stats.connection_events++;
+        m_eventNotifications = 0;
+    }
+    if (++m_eventNotifications > m_stats.max_notifications_per_event) m_stats.max_notifications_per_event = m_eventNotifications;
+    m_lastArrivalTime = arrival_time;
+
+    return true;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+
+#include "CompositeDataDecoder.h"
+
+//Notifications that show up less than this far apart (in seconds) are counted as being part of the same connection
+//event. The shortest connection interval allowed by BLE is 7.5 milliseconds so this leaves plenty of room for jitter.
+#define LINK_EVENT_GAP_SECONDS 0.0025
+
+//A packet with a sequence number this far behind the newest one is treated as a late arrival, anything further back
+//than this means the Personal Caddie has started its sequence numbers over
+#define PACKET_REORDER_WINDOW  16
+
+//Running totals describing how well data is making it across the BLE link
+struct LinkQualityStats
+{
+	uint64_t packets_received = 0;
+	uint64_t packets_lost = 0; //gaps in the sequence numbers
+	uint64_t packets_dropped_by_device = 0; //the part of packets_lost that the Personal Caddie couldn't add to its notification queue
+	uint64_t packets_out_of_order = 0; //duplicates or packets older than one already received, these get ignored
+	uint64_t stream_restarts = 0; //times the sequence numbers started over without reset() being called
+	uint64_t samples_received = 0;
+	uint64_t samples_lost = 0;
+
+	uint64_t loss_bursts = 0; //number of separate runs of lost packets
+	uint32_t longest_burst = 0; //in packets
+
+	uint64_t connection_events = 0; //groups of notifications that arrived together
+	uint32_t max_notifications_per_event = 0;
+
+	double lossRate() const { return (packets_received + packets_lost > 0) ? (double)packets_lost / (packets_received + packets_lost) : 0.0; }
+	double sampleLossRate() const { return (samples_received + samples_lost > 0) ? (double)samples_lost / (samples_received + samples_lost) : 0.0; }
+	double averageBurstLength() const { return (loss_bursts > 0) ? (double)packets_lost / loss_bursts : 0.0; }
+	double notificationsPerEvent() const { return (connection_events > 0) ? (double)packets_received / connection_events : 0.0; }
+};
+
+//Where a single notification fits into the stream of data coming from the Personal Caddie
+struct ReassembledPacket
+{
+	uint64_t first_sample; //index of the first sample in the notification, counting every sample that was lost before it
+	uint64_t first_tick; //time stamp of the first sample unwrapped to 64 bits (16 MHz timer ticks)
+	int samples;
+	uint32_t lost_packets; //packets that went missing right before this one
+	uint32_t lost_samples; //samples that went missing right before this one
+};
+
+/*
+* Puts the composite data notifications back together into a single continuous stream of samples. Every notification
+* carries a sequence number that goes up by one for each data set the Personal Caddie reads (whether it manages to send
+* it or not), along with a running count of the data sets it had to drop. This lets the reassembler know exactly how
+* many packets never arrived and whose fault that was, instead of guessing from the time stamps. The number of samples
+* in the missing packets comes from the gap in (integer) timer ticks so it doesn't depend on float rounding either.
+*
+* The statistics are updated with every notification so they can be looked at while data is still coming in, which
+* makes it possible to tune the sensor ODR and connection interval from measurements.
+*/
+class PacketReassembler
+{
+public:
+	PacketReassembler() { reset(); }
+
+	void reset();
+	void setTicksPerSample(double ticks_per_sample) { m_ticksPerSample = ticks_per_sample; }
+
+	bool addPacket(CompositePacketHeader const& header, double arrival_time, ReassembledPacket& packet);
+	uint64_t nextSample() const { return m_nextSample; }
+
+	LinkQualityStats const& stats() const { return m_stats; }
+	void resetStats() { m_stats = LinkQualityStats(); m_eventNotifications = 0; }
+
+private:
+	bool findLostPackets(CompositePacketHeader const& header, ReassembledPacket& packet);
+
+	LinkQualityStats m_stats;
+	double m_ticksPerSample; //16 MHz divided by the sensor ODR, 0 if it isn't known yet
+
+	bool m_started;
+	uint16_t m_lastSequence;
+	uint16_t m_lastDroppedPackets;
+	uint32_t m_lastTimerTicks;
+	uint64_t m_lastTick;
+	uint64_t m_nextSample;
+	int m_lastSamples;
+
+	double m_lastArrivalTime;
+	uint32_t m_eventNotifications; //notifications seen so far in the current connection event
+};
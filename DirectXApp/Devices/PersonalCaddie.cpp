@@ -4,10 +4,14 @@
 #include "Modes/ModeScreen.h"
 #include "../Math/quaternion_functions.h"
 #include "../Math/sensor_fusion.h"
+#include "../Math/madgwick_batch.h"
+#include "../../Firmware/nRF52840_Drivers/device_fusion.h"
 
 #include <iostream>
 #include <fstream>
 #include <functional>
+#include <chrono>
+#include <algorithm>
 
 using namespace winrt;
 using namespace Windows::Foundation;
@@ -25,7 +29,8 @@ PersonalCaddie::PersonalCaddie(std::function<void(PersonalCaddieEventType, void*
 
     //After creating the BLE device, attempt to connect to the most recently paired
     //device. The 64-bit address of the most recently paired device is saved to a 
-    //local text file
+    //local text file, as are the GATT handles of every device that's been connected to
+    loadGattCache();
     automaticallyConnect();
 
     //Set the IMU and characteristic pointers to null, we need to connect to a physical 
@@ -54,6 +59,16 @@ PersonalCaddie::PersonalCaddie(std::function<void(PersonalCaddieEventType, void*
         orientation_quaternions.push_back(m_heading_offset);
     }
 
+    //Size the vectors inside of every batch in the sample batch queue up front so that
+    //the BLE thread never has to allocate memory when passing data to the render thread
+    m_sampleBatches.initializeSlots([this](SampleBatch& batch)
+        {
+            batch.sensorData = this->sensor_data;
+            batch.quaternions = this->orientation_quaternions;
+        });
+
+    this->m_sessionFile = std::make_unique<SessionFileWriter>();
+
     //Calculated data types should be turned off to start
     m_linearAcc = false;
     m_velocity = false;
@@ -116,6 +131,45 @@ void PersonalCaddie::updateMostRecentDeviceAddress(uint64_t address)
         });
 }
 
+void PersonalCaddie::loadGattCache()
+{
+    //Reads the handle maps saved by earlier connections. If the file isn't there yet, or doesn't finish loading before
+    //the connection is made, the session just walks the GATT table of the device like it would for a new one.
+    winrt::Windows::Storage::StorageFolder localFolder = winrt::Windows::Storage::ApplicationData::Current().LocalCacheFolder();
+    auto getCacheFile = localFolder.GetFileAsync(L"PersonalCaddieGattCache.txt");
+
+    getCacheFile.Completed([this](
+        IAsyncOperation<winrt::Windows::Storage::StorageFile> const& sender,
+        AsyncStatus const asyncStatus)
+        {
+            if (asyncStatus != AsyncStatus::Completed) return; //the file gets created after the first connection
+
+            auto readCache = winrt::Windows::Storage::FileIO::ReadTextAsync(sender.get());
+            readCache.Completed([this](
+                IAsyncOperation<winrt::hstring> const& sender,
+                AsyncStatus const asyncStatus)
+                {
+                    if (asyncStatus != AsyncStatus::Completed) return;
+                    if (!m_gattCache.deserialize(winrt::to_string(sender.get()))) OutputDebugString(L"Some of the saved GATT handles couldn't be read, those devices will be discovered again.\n");
+                });
+        });
+}
+
+void PersonalCaddie::saveGattCache()
+{
+    //Called whenever a GATT table had to be walked, which means there's a new or updated handle map to save
+    std::wstring text = winrt::to_hstring(m_gattCache.serialize()).c_str();
+    winrt::Windows::Storage::StorageFolder localFolder = winrt::Windows::Storage::ApplicationData::Current().LocalCacheFolder();
+    auto createCacheFile = localFolder.CreateFileAsync(L"PersonalCaddieGattCache.txt", winrt::Windows::Storage::CreationCollisionOption::ReplaceExisting);
+
+    createCacheFile.Completed([text](
+        IAsyncOperation<winrt::Windows::Storage::StorageFile> const& sender,
+        AsyncStatus const asyncStatus)
+        {
+            if (asyncStatus == AsyncStatus::Completed) winrt::Windows::Storage::FileIO::WriteTextAsync(sender.get(), text);
+        });
+}
+
 void PersonalCaddie::connectToDevice(uint64_t deviceAddress)
 {
     //This method gets called when we attempt to connect to a device found with the device watcher.
@@ -133,10 +187,13 @@ void PersonalCaddie::disconnectFromDevice()
         //TODO: Should put in a line here to make sure that none of the charcteristics
         //are currently set to notify
 
-        //sever the connection to all services and set the m_services field
-        //to null
-        for (int i = 0; i < m_services.Size(); i++) m_services.GetAt(i).Close();
-        m_services = nullptr;
+        //sever the connection to all services
+        if (m_transport != nullptr) m_transport->close();
+        if (m_gattSession != nullptr)
+        {
+            m_gattSession.Close();
+            m_gattSession = nullptr;
+        }
         
         //set all the characteristics to null as well
         m_error_characteristic = nullptr;
@@ -144,6 +201,7 @@ void PersonalCaddie::disconnectFromDevice()
         m_small_data_characteristic = nullptr;
         m_medium_data_characteristic = nullptr;
         m_large_data_characteristic = nullptr;
+        m_burst_data_characteristic = nullptr;
         m_available_sensors_characteristic = nullptr;
 
         p_ble->terminateConnection();
@@ -160,10 +218,9 @@ void PersonalCaddie::BLEDeviceHandler(BLEState state)
     //from the BLE Device, and then we need to use data obtained from these characteristics to create an instance of the 
     //IMU class.
 
-    //Get the Gatt Characteristics from the BLE Device. To do this we first need to get a list of all of the services from 
-    //the device and then get the characteristics from each. Use the BluetoothCacheMode::Uncached flag so that we get the 
-    //services from the physical device and not from what's saved in the PC's cache memory. This ensures that we are physically 
-    //connecting to a device.
+    //Getting the characteristics, reading the settings off of the device and setting up notifications is all done by
+    //the DeviceSession (see DeviceSession.h). It only walks the GATT table the first time it sees a device, after that
+    //the handles saved in the GATT cache get used, and everything it needs from the device is asked for at once.
     switch (state)
     {
     case BLEState::DeviceFound:
@@ -171,37 +228,27 @@ void PersonalCaddie::BLEDeviceHandler(BLEState state)
         std::wstring message = L"Found a Personal Caddie device, attempting to connect...\n";
         event_handler(PersonalCaddieEventType::BLE_ALERT, (void*)&message);
 
-        //TODO: This line causes the program to crash if I recently ran the program and closed it without
-        //disconnecting from the Personal Caddie first. I think it may have something to do with the PC not
-        //properly getting rid of the resources, so the next time I start the program the old resources are 
-        //maybe still in memory but outdated, so I'm able to access them even though I shouldn't be? This 
-        //crash is definitely annoying and I should address it.
-        auto get_services = this->p_ble->getBLEDevice()->GetGattServicesAsync(BluetoothCacheMode::Uncached);
-
-        //TODO: The above method doesn't appear to be running asynchronously. If it was then we should be able
-        //to proceed directly to the break statement below, however, that doesn't happen. The debugger gets
-        //stuck on the above line until the service object is created. Why would this be the case? Other Async
-        //methods don't work this way.
-        get_services.Completed([this](
-            IAsyncOperation<winrt::Windows::Devices::Bluetooth::GenericAttributeProfile::GattDeviceServicesResult> const& sender,
+        //Windows doesn't connect to a BLE device until something needs it. This used to be done by reading the whole
+        //GATT table with BluetoothCacheMode::Uncached, which took a dozen round trips before the connected block of
+        //this handler could even start. Asking a GATT session to maintain the connection connects without reading
+        //anything, the session decides what actually needs to be read once the connection is up.
+        auto get_session = GattSession::FromDeviceIdAsync(this->p_ble->getBLEDevice()->BluetoothDeviceId());
+        get_session.Completed([this](
+            IAsyncOperation<GattSession> const& sender,
             AsyncStatus const asyncStatus)
             {
-                if (asyncStatus != AsyncStatus::Error)
+                if (asyncStatus != AsyncStatus::Completed)
                 {
-                    //Save the returned GattServices object
-                    m_services = sender.GetResults().Services();
-
-                    if (m_services.Size() == 0)
-                    {
-                        std::wstring failure_message = L"Couldn't connect to the Personal Caddie. Go to the settings menu to manually connect.\n";
-                        event_handler(PersonalCaddieEventType::BLE_ALERT, (void*)&failure_message);
-                        return;
-                    }
+                    std::wstring failure_message = L"Couldn't connect to the Personal Caddie. Go to the settings menu to manually connect.\n";
+                    event_handler(PersonalCaddieEventType::BLE_ALERT, (void*)&failure_message);
+                    return;
                 }
+
+                m_gattSession = sender.GetResults();
+                m_gattSession.MaintainConnection(true);
             });
 
-        //Successfully reading the Gatt services should initiate a connection with the ble device. If it does then 
-        //the connectec block of this handler will execute.
+        //Once the connection is made the connected block of this handler will execute.
         break;
     }
     case BLEState::DeviceNotFound:
@@ -219,54 +266,13 @@ void PersonalCaddie::BLEDeviceHandler(BLEState state)
     }
     case BLEState::Connected:
     {
-        //We've initiated a connection to a new Personal Caddie device. Read the device to get some settings
-        //off of it and use these to create an instance of th IMU class.
+        //We've initiated a connection to a new Personal Caddie device. Start a session to read some settings off of it,
+        //which get used to create an instance of the IMU class when the session finishes. Nothing here waits on the
+        //link, so this returns right away.
         this->ble_device_connected = true;
         current_power_mode = PersonalCaddiePowerMode::CONNECTED_MODE;
 
-        std::wstring message;
-
-        //The Windows Bluetooth API is a little weird in that there's not a set way of knowing when the actual
-        //connection to a device will happen. It can either be the moment the BLEDevice is created, it can be
-        //after doing a complete read of the GATT table, or it could be neither of these and a manual connection
-        //must be forced with a different method. We need to anticipate connections from any of these possibilities
-        //to make sure there are no errors.
-
-        if (m_services.as<winrt::Windows::Foundation::IUnknown>() == NULL)
-        {
-            //If we make it here it means we connected before reading the GATT table so the m_services
-            //object is null. The services are normally populated in another thread so just re-read 
-            //them in this thread
-            m_services = this->p_ble->getBLEDevice()->GetGattServicesAsync(BluetoothCacheMode::Uncached).get().Services();
-        }
-        if (m_services.Size() == 0)
-        {
-            message = L"Couldn't connect to the Personal Caddie. Go to the settings menu to manually connect.\n";
-            event_handler(PersonalCaddieEventType::BLE_ALERT, (void*)&message);
-            return;
-        }
-
-        for (int i = 0; i < m_services.Size(); i++)
-        {
-            auto gattService = m_services.GetAt(i);
-            uint16_t short_uuid = (gattService.Uuid().Data1 & 0xFFFF);
-
-            switch (short_uuid)
-            {
-            case SENSOR_SERVICE_UUID:
-                getDataCharacteristics(gattService);
-                break;
-            case PERSONAL_CADDIE_SERVICE_UUID:
-                getErrorCharacteristic(gattService);
-                break;
-            default:
-                break;
-            }
-        }
-
-        //After confirming the device is here and reading the gatt table, make sure that all data notifications
-        //are enabled. Notifications should be enabled for the duration of the connection.
-        disableDataNotifications(); //TODO: Not getting data when enabling off the bat, why is this the case?
+        if (m_session != nullptr && m_session->running()) break; //the connection dropped and came back while the last session was still starting
 
         //Check to see if this device is currently paired with the computer. If it isn't, pair it for quicker
         //connection times in the future. Also, update the address of the last connect device in the file inside
@@ -275,42 +281,10 @@ void PersonalCaddie::BLEDeviceHandler(BLEState state)
         if (pairingInformation.IsPaired() == false && pairingInformation.CanPair() == true) pairingInformation.PairAsync(); //asynchronously attempt to pair to the device
         updateMostRecentDeviceAddress(p_ble->getBLEDevice()->BluetoothAddress());
 
-        //Read the sensor settings characteristic to get some basic information about the sensors attached to
-        //the Personal Caddie
-        uint8_t sensor_settings_array[SENSOR_SETTINGS_LENGTH] = { 0 };
-        try
-        {
-            auto sensor_settings_buffer = m_settings_characteristic.ReadValueAsync(Bluetooth::BluetoothCacheMode::Uncached).get().Value(); //use unchached to read value from the device
-            auto sensor_settings = Windows::Storage::Streams::DataReader::FromBuffer(sensor_settings_buffer);
-            sensor_settings.ByteOrder(Windows::Storage::Streams::ByteOrder::LittleEndian); //the nRF52840 uses little endian so we match it here
-
-            for (int i = 0; i < SENSOR_SETTINGS_LENGTH; i++) sensor_settings_array[i] = sensor_settings.ReadByte();
-
-            //After getting the current sensor settings, read the list of available sensors from the available sensors characteristic
-            auto available_sensors_buffer = m_available_sensors_characteristic.ReadValueAsync(Bluetooth::BluetoothCacheMode::Uncached).get().Value(); //use unchached to read value from the device
-            auto available_sensors = Windows::Storage::Streams::DataReader::FromBuffer(available_sensors_buffer);
-            available_sensors.ByteOrder(Windows::Storage::Streams::ByteOrder::LittleEndian); //the nRF52840 uses little endian so we match it here
-
-            //There are a maximum of 20 sensors that can be attached to the personal caddie
-            for (int i = 0; i < 20; i++) m_availableSensors.push_back(available_sensors.ReadByte());
-        }
-        catch (...)
-        {
-            OutputDebugString(L"something went wrong when reading characteristics\n");
-        }
-
-        //Use the data read from the settings characteristic to create a new IMU instance
-        this->p_imu = std::make_unique<IMU>(sensor_settings_array);
-        auto rates = this->p_imu->getSensorConversionRates();
-        auto odrs = this->p_imu->getSensorODRs();
-
-        sampleFreq = this->p_imu->getMaxODR(); //Set the sample frequency to be equal to the largest of the sensor ODRs
-
-        //Once the IMU has been initialized, load heading offset data for the Personal Caddie
-        getHeadingOffsetFromTextFile();
-
-        message = L"Successfully connected to the Personal Caddie\n";
-        event_handler(PersonalCaddieEventType::CONNECTION_EVENT, (void*)&message);
+        m_session = nullptr;
+        m_transport = std::make_unique<WinRTTransport>(*p_ble->getBLEDevice());
+        m_session = std::make_unique<DeviceSession>(*m_transport, m_gattCache);
+        m_session->start([this](SessionStartup const& startup) { sessionStarted(startup); });
 
         break;
     }
@@ -328,114 +302,122 @@ void PersonalCaddie::BLEDeviceHandler(BLEState state)
     }
 }
 
-void PersonalCaddie::getDataCharacteristics(Bluetooth::GenericAttributeProfile::GattDeviceService& data_service)
+void PersonalCaddie::sessionStarted(SessionStartup const& startup)
 {
-    //std::cout << "Found the Sensor Data service, extracting characteristic information now." << std::endl;
-    auto data_characteristics = data_service.GetCharacteristicsAsync().get().Characteristics();
-
-    for (int i = 0; i < data_characteristics.Size(); i++)
+    //Called on a thread pool thread once the session has everything it needs from the Personal Caddie
+    std::wstring message;
+    if (!startup.success)
     {
-        uint16_t short_uuid = (data_characteristics.GetAt(i).Uuid().Data1 & 0xFFFF);
-        bool setup_notifcations = true;
-        //OutputDebugString(L"Found characteristic: \n");
+        OutputDebugString((std::wstring(L"Couldn't start a session with the Personal Caddie: ") + winrt::to_hstring(startup.error).c_str() + L"\n").c_str());
+        message = L"Couldn't connect to the Personal Caddie. Go to the settings menu to manually connect.\n";
+        event_handler(PersonalCaddieEventType::BLE_ALERT, (void*)&message);
+        return;
+    }
 
-        switch (short_uuid)
-        {
-        case SMALL_DATA_CHARACTERISTIC_UUID:
-            this->m_small_data_characteristic = data_characteristics.GetAt(i);
-            break;
-        case MEDIUM_DATA_CHARACTERISTIC_UUID:
-            this->m_medium_data_characteristic = data_characteristics.GetAt(i);
-            break;
-        case LARGE_DATA_CHARACTERISTIC_UUID:
-            this->m_large_data_characteristic = data_characteristics.GetAt(i);
-            break;
-        case SETTINGS_CHARACTERISTIC_UUID:
-            this->m_settings_characteristic = data_characteristics.GetAt(i);
-            setup_notifcations = false; //the settings characteristic doesn't have notification capability
-            break;
-        case AVAILABLE_SENSORS_CHARACTERISTIC_UUID:
-            this->m_available_sensors_characteristic = data_characteristics.GetAt(i);
-            setup_notifcations = false; //the available sensors characteristic doesn't have notification capability
-            break;
-        }
+    //The GATT table was walked (either for a new device or because new firmware moved things around), so there's a
+    //new handle map to save for next time
+    if (!startup.usedCache) saveGattCache();
+    if (startup.cacheWasStale) OutputDebugString(L"The saved GATT handles for this Personal Caddie were out of date, they've been updated.\n");
+
+    attachCharacteristics();
+
+    //The session made sure data notifications are off, let the mode screen know
+    message = L"Off";
+    event_handler(PersonalCaddieEventType::NOTIFICATIONS_TOGGLE, (void*)&message);
+    sensor_data_updated[ACC_SENSOR] = false;
+    sensor_data_updated[GYR_SENSOR] = false;
+    sensor_data_updated[MAG_SENSOR] = false;
+
+    //The settings characteristic has some basic information about the sensors attached to the Personal Caddie, the
+    //session has already checked it's long enough
+    uint8_t sensor_settings_array[SENSOR_SETTINGS_LENGTH] = { 0 };
+    for (int i = 0; i < SENSOR_SETTINGS_LENGTH; i++) sensor_settings_array[i] = startup.settings[i];
+
+    //There are a maximum of 20 sensors that can be attached to the personal caddie. A characteristic that's shorter
+    //than that is kept as it is and doesn't have any boot timing.
+    size_t sensor_bytes = (startup.availableSensors.size() < BOOT_TIMING_OFFSET) ? startup.availableSensors.size() : BOOT_TIMING_OFFSET;
+    m_availableSensors.assign(startup.availableSensors.begin(), startup.availableSensors.begin() + sensor_bytes);
+
+    //Newer firmware adds the boot timing after the sensor addresses, older firmware leaves it all zeros
+    m_bootTiming = {};
+    if (startup.availableSensors.size() >= BOOT_TIMING_OFFSET + BOOT_TIMING_SIZE)
+    {
+        boot_timing_decode(startup.availableSensors.data() + BOOT_TIMING_OFFSET, &m_bootTiming);
 
-        if (setup_notifcations)
-        {
-            //set the notification event handler for data characteristics (but don't enable notifications yet)
-            data_characteristics.GetAt(i).ValueChanged(Windows::Foundation::TypedEventHandler<GattCharacteristic, GattValueChangedEventArgs>(
-                [this](GattCharacteristic car, GattValueChangedEventArgs args)
-                {
-                    compositeDataCharacteristicEventHandler(car, args); //handler defined elsewhere to prevent multiple identical code blocks being needed here
-                }));
-        }
+        std::wstring timing = L"Personal Caddie boot to first sample: " + std::to_wstring(boot_timing_total_us(&m_bootTiming)) + L" us (sensors ready " +
+            std::to_wstring(m_bootTiming.sensors_ready_us) + L" us, configuring " + std::to_wstring(m_bootTiming.configure_us) + L" us, first sample " +
+            std::to_wstring(m_bootTiming.first_sample_us) + L" us)\n";
+        OutputDebugString(timing.c_str());
     }
-}
-
-void PersonalCaddie::getErrorCharacteristic(Bluetooth::GenericAttributeProfile::GattDeviceService& pc_service)
-{
-    //The error characteristic is a way to forward nRF errors from the BLE device to the app. The characteristic itself is small,
-    //only 4 bytes long, so it can only hold a single error at a time. We write to its CCCD handle so we will automatically get
-    //notified of new errors as they come in.
-    auto pc_characteristics = pc_service.GetCharacteristicsAsync().get().Characteristics();
 
-    //For now there's just the error characteristic, use a for loop here though in case more
-    //characteristics are added in the future.
-    for (int i = 0; i < pc_characteristics.Size(); i++)
-    {
-        uint16_t short_uuid = (pc_characteristics.GetAt(i).Uuid().Data1 & 0xFFFF);
-        bool setup_notifcations = true;
+    std::wstring handles = std::wstring(L"GATT handles ") + (startup.usedCache ? L"from the cache" : L"discovered") + L", connected after " +
+        std::to_wstring(startup.stages) + L" round trips\n";
+    OutputDebugString(handles.c_str());
 
-        switch (short_uuid)
-        {
-        case ERROR_CHARACTERISTIC_UUID:
-        {
-            this->m_error_characteristic = pc_characteristics.GetAt(i);
+    //Use the data read from the settings characteristic to create a new IMU instance
+    this->p_imu = std::make_unique<IMU>(sensor_settings_array);
 
-            //set up a handler for when new errors come in
-            m_error_characteristic.ValueChanged(Windows::Foundation::TypedEventHandler<GattCharacteristic, GattValueChangedEventArgs>(
-                [this](GattCharacteristic car, GattValueChangedEventArgs args)
-                {
-                    //For now, the only thing we do is create an alert that pops up on the screen, telling us what the error is
-                    auto read_buffer = Windows::Storage::Streams::DataReader::FromBuffer(args.CharacteristicValue());
-                    read_buffer.ByteOrder(Windows::Storage::Streams::ByteOrder::LittleEndian); //the nRF52840 uses little endian so we match it here
+    //The last byte of the settings characteristic says how samples are encoded in the data characteristic. Ask
+    //for packed samples if they aren't being used already, they let more samples fit into each notification. This
+    //waits for the IMU since the fused encodings need its calibration numbers.
+    if (sensor_settings_array[DATA_ENCODING] != m_dataEncoding) setDataEncoding(m_dataEncoding);
 
-                    //Read all 4 bytes of the error code
-                    uint32_t error_code = read_buffer.ReadUInt32();
+    sampleFreq = this->p_imu->getMaxODR(); //Set the sample frequency to be equal to the largest of the sensor ODRs
 
-                    std::wstring message = L"Personal Caddie Error: " + std::to_wstring(error_code) + L"\n";
-                    event_handler(PersonalCaddieEventType::PC_ERROR, (void*)&message);
-                }));
+    //Once the IMU has been initialized, load heading offset data for the Personal Caddie
+    getHeadingOffsetFromTextFile();
 
-            //also, make sure to set the CCCD descriptor to notify if it isn't already
-            auto cccdRead = m_error_characteristic.ReadClientCharacteristicConfigurationDescriptorAsync();
+    message = L"Successfully connected to the Personal Caddie\n";
+    event_handler(PersonalCaddieEventType::CONNECTION_EVENT, (void*)&message);
+}
 
-            cccdRead.Completed([this](
-                IAsyncOperation<GattReadClientCharacteristicConfigurationDescriptorResult> const& sender,
-                AsyncStatus const status)
-                {
-                    auto cccd_value = sender.get().ClientCharacteristicConfigurationDescriptor();
-                    if (cccd_value == Bluetooth::GenericAttributeProfile::GattClientCharacteristicConfigurationDescriptorValue::None)
-                    {
-                        //the data characteristics are currently set to notify so turn off notifications. There are three characteristic descriptors to write
-                        //so nest the asynchronous calls to make sure all calls actually get processed.
-                        auto cccdAccWriteOn = m_error_characteristic.WriteClientCharacteristicConfigurationDescriptorAsync(GattClientCharacteristicConfigurationDescriptorValue::Notify);
-                        cccdAccWriteOn.Completed([this](IAsyncOperation<GattCommunicationStatus> const& sender, AsyncStatus const status)
-                            {
-                                if (status != AsyncStatus::Completed)
-                                {
-                                    std::wstring message = L"An error occured when trying to enable error notifications.\n";
-                                    event_handler(PersonalCaddieEventType::BLE_ALERT, (void*)&message);
-                                    return;
-                                }
-                            });
-                    }
-                });
+void PersonalCaddie::attachCharacteristics()
+{
+    //Takes the characteristics the session found from the transport and sets up the handlers for their notifications.
+    //The session has already written every CCCD: notifications are on for the error characteristic and off for the
+    //data characteristics until data is asked for.
+    this->m_settings_characteristic = m_transport->characteristic(GattAttribute::Settings);
+    this->m_available_sensors_characteristic = m_transport->characteristic(GattAttribute::AvailableSensors);
+    this->m_small_data_characteristic = m_transport->characteristic(GattAttribute::SmallData);
+    this->m_medium_data_characteristic = m_transport->characteristic(GattAttribute::MediumData);
+    this->m_large_data_characteristic = m_transport->characteristic(GattAttribute::LargeData);
+    this->m_burst_data_characteristic = m_transport->characteristic(GattAttribute::BurstData); //nullptr with firmware that can't capture bursts
+    this->m_error_characteristic = m_transport->characteristic(GattAttribute::Error);
+
+    //set the notification event handler for data characteristics (but don't enable notifications yet)
+    for (auto data_characteristic : { m_small_data_characteristic, m_medium_data_characteristic, m_large_data_characteristic })
+    {
+        data_characteristic.ValueChanged(Windows::Foundation::TypedEventHandler<GattCharacteristic, GattValueChangedEventArgs>(
+            [this](GattCharacteristic car, GattValueChangedEventArgs args)
+            {
+                compositeDataCharacteristicEventHandler(car, args); //handler defined elsewhere to prevent multiple identical code blocks being needed here
+            }));
+    }
 
-            break;
-        }
-        }
+    if (m_burst_data_characteristic != nullptr)
+    {
+        m_burst_data_characteristic.ValueChanged(Windows::Foundation::TypedEventHandler<GattCharacteristic, GattValueChangedEventArgs>(
+            [this](GattCharacteristic car, GattValueChangedEventArgs args)
+            {
+                burstDataCharacteristicEventHandler(car, args);
+            }));
     }
+
+    //The error characteristic is a way to forward nRF errors from the BLE device to the app. The characteristic itself is small,
+    //only 4 bytes long, so it can only hold a single error at a time.
+    m_error_characteristic.ValueChanged(Windows::Foundation::TypedEventHandler<GattCharacteristic, GattValueChangedEventArgs>(
+        [this](GattCharacteristic car, GattValueChangedEventArgs args)
+        {
+            //For now, the only thing we do is create an alert that pops up on the screen, telling us what the error is
+            auto read_buffer = Windows::Storage::Streams::DataReader::FromBuffer(args.CharacteristicValue());
+            read_buffer.ByteOrder(Windows::Storage::Streams::ByteOrder::LittleEndian); //the nRF52840 uses little endian so we match it here
+
+            //Read all 4 bytes of the error code
+            uint32_t error_code = read_buffer.ReadUInt32();
+
+            std::wstring message = L"Personal Caddie Error: " + std::to_wstring(error_code) + L"\n";
+            event_handler(PersonalCaddieEventType::PC_ERROR, (void*)&message);
+        }));
 }
 
 void PersonalCaddie::compositeDataCharacteristicEventHandler(Bluetooth::GenericAttributeProfile::GattCharacteristic& car, Bluetooth::GenericAttributeProfile::GattValueChangedEventArgs& args)
@@ -445,72 +427,204 @@ void PersonalCaddie::compositeDataCharacteristicEventHandler(Bluetooth::GenericA
     //releveant code for it. Since the data layout in the composite characteristic is inherantly different I figured it was best
     //to create a completely separate method.
 
-    //First get calibration and axis data for each sensor from the IMU class
-    std::pair<const float*, const float**> acc_calibration_data = this->p_imu->getAccelerometerCalibrationNumbers();
-    std::pair<const float*, const float**> gyr_calibration_data = this->p_imu->getGyroscopeCalibrationNumbers();
-    std::pair<const float*, const float**> mag_calibration_data = this->p_imu->getMagnetometerCalibrationNumbers();
-
-    std::pair<const int*, const int*> acc_axis_orientation_data = this->p_imu->getAccelerometerAxisOrientations();
-    std::pair<const int*, const int*> gyr_axis_orientation_data = this->p_imu->getGyroscopeAxisOrientations();
-    std::pair<const int*, const int*> mag_axis_orientation_data = this->p_imu->getMagnetometerAxisOrientations();
-
-    //Then read the physical data from the notification PDU
-    auto read_buffer = Windows::Storage::Streams::DataReader::FromBuffer(args.CharacteristicValue());
-    read_buffer.ByteOrder(Windows::Storage::Streams::ByteOrder::LittleEndian); //the nRF52840 uses little endian so we match it here
-
-    //The first four bytes of the characteristic contain a timestamp for when the first set of data in the 
-    //set was recorded. This is useful for keeping track of any delays the occur between transmissions and
-    //notice lost data packets
-    uint32_t timer_ticks = read_buffer.ReadUInt32();
-    m_first_data_time_stamp = convertTicksToSeconds(timer_ticks);
-
-    //Depending on the current sensor ODR we may receive more or less sensor samples in each notification. Since the characteristic
-    //size can't change we use the 5th byte to let us know the number of relevant samples to read. Read this byte and update the
-    //number_of_samples variable to reflect this amount.
-    number_of_samples = read_buffer.ReadByte();
-
-    //Finally read the appropriate number of sensor samples from the buffer. A single reading of the sensor is comprised of 6 bytes, 2 each 
-    //for each axes and the sensor data order goes acc, gyr then mag, which means the data in the read_buffer looks like so:
-    //[Acc_x_l_0, Acc_x_h_0, Acc_y_l_0, Acc_y_h_0, Acc_z_l_0, Acc_z_h_0, Gyr_x_l_0, Gyr_x_h_0, Gyr_y_l_0, Gyr_y_h_0, ...]. Since the 
-    //data is little endian the least significant byte comes before the most significant.
-    for (int i = 0; i < number_of_samples; i++)
+    //All of the actual decoding (LSB conversion, axis swapping and calibration) is handled by the platform neutral
+    //CompositeDataDecoder class in a single pass. Calibration numbers and axis orientations can be changed at any
+    //time by the calibration modes so the decode tables get rebuilt from the IMU class for each notification. This
+    //is only a handful of 3x3 matrix operations so it's negligible compared to decoding the samples themselves.
+    loadDecodeTables(m_compositeDecoder);
+
+    //The raw data gets written directly into the sensor_data vectors
+    const DataType raw_types[3] = { DataType::RAW_ACCELERATION, DataType::RAW_ROTATION, DataType::RAW_MAGNETIC };
+    const DataType calibrated_types[3] = { DataType::ACCELERATION, DataType::ROTATION, DataType::MAGNETIC };
+    CompositeDecodeOutput decode_output;
+    for (int sensor = ACC_SENSOR; sensor <= MAG_SENSOR; sensor++)
     {
-        //Read acc data first
         for (int axis = X; axis <= Z; axis++)
         {
-            int16_t axis_reading = read_buffer.ReadInt16();
-            //int actual_axis = acc_axis_orientation_data.first[axis];
-            this->sensor_data[static_cast<int>(DataType::RAW_ACCELERATION)][acc_axis_orientation_data.first[axis]][i] = axis_reading * this->p_imu->getConversionRate(ACC_SENSOR) * acc_axis_orientation_data.second[axis]; //Apply appropriate conversion from LSB to the current unit
+            decode_output.raw[sensor][axis] = this->sensor_data[static_cast<int>(raw_types[sensor])][axis].data();
+            decode_output.calibrated[sensor][axis] = this->sensor_data[static_cast<int>(calibrated_types[sensor])][axis].data();
         }
+    }
 
-        //Read gyr data second
-        for (int axis = X; axis <= Z; axis++)
+    //When the Personal Caddie runs the AHRS itself the orientation and linear acceleration come straight from the notification
+    float fused_quaternions[4][MAX_SENSOR_SAMPLES];
+    for (int component = 0; component < 4; component++) decode_output.quaternion[component] = fused_quaternions[component];
+    for (int axis = X; axis <= Z; axis++) decode_output.linear[axis] = this->sensor_data[static_cast<int>(DataType::LINEAR_ACCELERATION)][axis].data();
+
+    //The first four bytes of the characteristic contain a timestamp for when the first set of data in the 
+    //set was recorded, the 5th byte holds the number of valid samples in the characteristic and the next
+    //four bytes hold the sequence number and dropped packet count. See CompositeDataDecoder.h for the full layout.
+    auto characteristic_value = args.CharacteristicValue();
+    m_sessionFile->append(characteristic_value.data(), characteristic_value.Length()); //does nothing unless a session is being recorded
+
+    //Before decoding anything, use the sequence number to figure out where this data set fits in. Notifications
+    //that are duplicates or arrive late (which shouldn't happen with BLE, but costs nothing to check) are ignored.
+    CompositePacketHeader header;
+    if (CompositeDataDecoder::readHeader(characteristic_value.data(), characteristic_value.Length(), header) <= 0) return;
+    if (m_resetPacketReassembler.exchange(false))
+    {
+        //The clock starts the new stream at time 0, so pretend the last sample processed came one sample
+        //period before that. Otherwise the first Madgwick update would see time go backwards. The session
+        //store keeps one timeline for the whole session, so it shifts the new stream to carry on after the last.
+        //Any bursts still waiting from the last stream get placed with the old clock before it starts over.
+        mergeSwingBursts();
+        m_packetReassembler.reset();
+        m_deviceClock.reset();
+        FusionAlignmentReset(&m_alignment);
+        m_sessionData.startSegment();
+        m_last_processed_data_time_stamp = -1.0 / this->p_imu->getMaxODR();
+    }
+    m_deviceClock.setNominalOdr(this->p_imu->getMaxODR());
+    m_packetReassembler.setTicksPerSample(m_deviceClock.ticksPerSample());
+
+    double arrival_time = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    if (!m_packetReassembler.addPacket(header, arrival_time, m_lastPacket)) return;
+
+    //A notification without any samples in it (or one that's malformed) is dropped here, before it can move the
+    //clock fit or put an empty batch on the timeline
+    uint32_t timer_ticks = 0;
+    int decoded_samples = m_compositeDecoder.decode(characteristic_value.data(), characteristic_value.Length(), timer_ticks, decode_output, MAX_SENSOR_SAMPLES);
+    if (decoded_samples <= 0) return;
+    number_of_samples = decoded_samples;
+
+    //The 32-bit time stamp wraps around every 268 seconds so it gets unwrapped before the clock looks at it. Each
+    //sample then gets its own time stamp from the measured sample period instead of the ODR the sensors were set to.
+    m_deviceClock.addPacket(m_deviceClock.unwrap(header.timer_ticks), m_lastPacket.first_sample, number_of_samples, arrival_time);
+    m_deviceClock.sampleTimes(m_lastPacket.first_sample, number_of_samples, m_sampleTimes);
+    m_first_data_time_stamp = m_sampleTimes[0];
+
+    m_deviceFusion = header.fused;
+    if (m_deviceFusion)
+    {
+        for (int i = 0; i < number_of_samples; i++) orientation_quaternions[i] = glm::quat(fused_quaternions[0][i], fused_quaternions[1][i], fused_quaternions[2][i], fused_quaternions[3][i]);
+    }
+
+    //All three sensors are updated at once so we can go ahead and update the rest of the data types
+    sensor_data_updated[ACC_SENSOR] = true;
+    sensor_data_updated[GYR_SENSOR] = true;
+    sensor_data_updated[MAG_SENSOR] = true;
+    dataUpdate();
+
+    //Any bursts that have come in since the last notification can be placed on the timeline now that the clock is up to date
+    mergeSwingBursts();
+}
+
+void PersonalCaddie::burstDataCharacteristicEventHandler(Bluetooth::GenericAttributeProfile::GattCharacteristic& car, Bluetooth::GenericAttributeProfile::GattValueChangedEventArgs& args)
+{
+    //The burst data characteristic carries the full rate window of samples the Personal Caddie catches around each
+    //swing (see burst_capture.h in the firmware). Its notifications trickle in between the ones for the live stream
+    //and get put back together here, once a whole window has arrived the assembler hands it to queueRawBurst().
+    if (m_resetBurstAssembler.exchange(false)) m_burstAssembler.reset();
+
+    auto characteristic_value = args.CharacteristicValue();
+    m_burstAssembler.addPacket(characteristic_value.data(), characteristic_value.Length());
+}
+
+void PersonalCaddie::queueRawBurst(RawBurst const& burst)
+{
+    //Called from the burst data thread. The window is copied into a slot that was allocated up front, if the live
+    //stream thread has fallen so far behind that both slots are still full the burst gets dropped.
+    RawBurst* slot = m_rawBursts.beginPush();
+    if (slot == nullptr)
+    {
+        OutputDebugString(L"Dropped a swing burst, the last ones haven't been processed yet.\n");
+        return;
+    }
+
+    slot->header = burst.header;
+    slot->receivedSamples = burst.receivedSamples;
+    std::copy(burst.readings.begin(), burst.readings.end(), slot->readings.begin());
+    std::copy(burst.received.begin(), burst.received.end(), slot->received.begin());
+    m_rawBursts.endPush();
+}
+
+void PersonalCaddie::mergeSwingBursts()
+{
+    //Turns any bursts waiting in the queue into real units and puts them on the same timeline as the session data. The
+    //burst header holds the time stamp of its first sample in timer ticks, which the device clock turns into a time
+    //that lines up with the samples of the live stream. The session store shifts each stream onto one timeline for the
+    //whole session, so the burst gets the same shift. Since the burst samples were read at a constant ODR the rest
+    //of the time stamps are just the sample period apart. The decode tables were loaded for the live notification
+    //that was just processed so the same ones get used here.
+    while (RawBurst* raw = m_rawBursts.front())
+    {
+        SwingBurst* burst = m_swingBursts.beginWrite();
+
+        CompositeDecodeOutput output;
+        for (int sensor = ACC_SENSOR; sensor <= MAG_SENSOR; sensor++)
         {
-            int16_t axis_reading = read_buffer.ReadInt16();
-            //int actual_axis = gyr_axis_orientation_data.first[axis];
-            this->sensor_data[static_cast<int>(DataType::RAW_ROTATION)][gyr_axis_orientation_data.first[axis]][i] = axis_reading * this->p_imu->getConversionRate(GYR_SENSOR) * gyr_axis_orientation_data.second[axis]; //Apply appropriate conversion from LSB to the current unit
+            for (int axis = X; axis <= Z; axis++) output.calibrated[sensor][axis] = burst->channels[sensor * COMPOSITE_AXES + axis].data();
         }
+        int samples = m_compositeDecoder.convertReadings(raw->readings.data(), BURST_CAPTURE_MAX_SAMPLES, raw->header.window_samples, output);
+
+        double start_time = m_sessionData.sessionTime(m_deviceClock.tickTime(raw->header.window_ticks));
+        double sample_period = raw->header.ticks_per_sample / DEVICE_CLOCK_FREQUENCY;
+        for (int i = 0; i < samples; i++) burst->times[i] = start_time + i * sample_period;
+
+        burst->samples = samples;
+        burst->triggerSample = raw->header.trigger_index;
+        burst->missingSamples = raw->missingSamples();
+        burst->odr = (raw->header.ticks_per_sample > 0.0) ? static_cast<float>(DEVICE_CLOCK_FREQUENCY / raw->header.ticks_per_sample) : 0.0f;
+        burst->firstSessionSample = (samples > 0) ? m_sessionData.findSample(start_time) : 0;
+
+        m_swingBursts.endWrite();
+        m_rawBursts.pop();
+    }
+}
+
+bool PersonalCaddie::startSessionFile(std::wstring const& name)
+{
+    //Starts saving every composite characteristic notification to a binary session file in the local folder of the app.
+    //The data is saved exactly as it comes in from the Personal Caddie, so the header needs to hold everything that's
+    //required to turn it back into real units later on: the IMU settings, conversion rates, axis orientations and
+    //calibration numbers as they are at the start of the recording.
+    if (p_imu == nullptr || m_sessionFile->isOpen()) return false;
+
+    SessionFileHeader header;
+    initializeSessionFileHeader(header);
+    header.odr = p_imu->getMaxODR();
+
+    //The IMU class only holds the 10 bytes of settings for each sensor so bytes 0 and 31 are filled in here
+    auto sensor_settings = p_imu->getSensorSettings();
+    header.imu_settings[0] = static_cast<uint8_t>(current_power_mode);
+    for (int sensor = ACC_SENSOR; sensor <= MAG_SENSOR; sensor++)
+    {
+        for (int i = 0; i < 10; i++) header.imu_settings[1 + 10 * sensor + i] = sensor_settings[sensor][i];
+    }
+
+    for (int sensor = ACC_SENSOR; sensor <= MAG_SENSOR; sensor++)
+    {
+        std::pair<const float*, const float**> calibration_data = getSensorCalibrationNumbers(static_cast<sensor_type_t>(sensor));
+        std::pair<const int*, const int*> axis_orientation_data = getSensorAxisCalibrationNumbers(static_cast<sensor_type_t>(sensor));
 
-        //Read mag data third
+        header.conversion_rates[sensor] = p_imu->getConversionRate(static_cast<sensor_type_t>(sensor));
         for (int axis = X; axis <= Z; axis++)
         {
-            int16_t axis_reading = read_buffer.ReadInt16();
-            //int actual_axis = mag_axis_orientation_data.first[axis];
-            this->sensor_data[static_cast<int>(DataType::RAW_MAGNETIC)][mag_axis_orientation_data.first[axis]][i] = axis_reading * this->p_imu->getConversionRate(MAG_SENSOR) * mag_axis_orientation_data.second[axis]; //Apply appropriate conversion from LSB to the current unit
+            header.axis_swap[sensor][axis] = axis_orientation_data.first[axis];
+            header.axis_polarity[sensor][axis] = axis_orientation_data.second[axis];
+            header.calibration_offsets[sensor][axis] = calibration_data.first[axis];
+            for (int column = X; column <= Z; column++) header.calibration_gains[sensor][axis][column] = calibration_data.second[axis][column];
         }
     }
 
-    //once the raw data has been read update it with the appropriate calibration numbers for each sensor
-    updateRawDataWithCalibrationNumbers(DataType::RAW_ACCELERATION, DataType::ACCELERATION, ACC_SENSOR, acc_calibration_data.first, acc_calibration_data.second);
-    updateRawDataWithCalibrationNumbers(DataType::RAW_ROTATION, DataType::ROTATION, GYR_SENSOR, gyr_calibration_data.first, gyr_calibration_data.second);
-    updateRawDataWithCalibrationNumbers(DataType::RAW_MAGNETIC, DataType::MAGNETIC, MAG_SENSOR, mag_calibration_data.first, mag_calibration_data.second);
+    std::wstring file_location = std::wstring(winrt::Windows::Storage::ApplicationData::Current().LocalFolder().Path()) + L"\\" + name + L".pcs";
+    if (!m_sessionFile->open(file_location.c_str(), header))
+    {
+        OutputDebugString((L"Couldn't create session file " + file_location + L"\n").c_str());
+        return false;
+    }
+
+    return true;
 }
 
-float PersonalCaddie::convertTicksToSeconds(uint32_t timer_ticks)
+void PersonalCaddie::stopSessionFile()
 {
-    //Looks at the current clock ticks stored in the data characteristics and converts it to seconds. The clock
-    //on board the Personal Caddie device uses a frequency of 16 MHz so each tick represents 62.5 ns.
-    return (float)timer_ticks / 16000000.0f;
+    //Safe to call from any thread, any notification that's in the middle of being saved gets finished first
+    m_sessionFile->close();
+    if (m_sessionFile->droppedChunks() > 0)
+    {
+        OutputDebugString((L"Session file dropped " + std::to_wstring(m_sessionFile->droppedChunks()) + L" chunks of data\n").c_str());
+    }
 }
 
 void PersonalCaddie::getHeadingOffsetFromTextFile()
@@ -632,24 +746,6 @@ void PersonalCaddie::convertTextToHeadingOffset(winrt::hstring calInfo)
     m_heading_yaw_offset = asin(m_heading_offset.z * 2.0f);
 }
 
-void PersonalCaddie::updateRawDataWithCalibrationNumbers(DataType rdt, DataType dt, sensor_type_t sensor_type, const float* offset_cal, const float** gain_cal)
-{
-    for (int i = 0; i < number_of_samples; i++)
-    {
-        float r_x = getDataPoint(rdt, X, i), r_y = getDataPoint(rdt, Y, i), r_z = getDataPoint(rdt, Z, i);
-
-        setDataPoint(dt, X, i, (gain_cal[0][0] * (r_x - offset_cal[0])) + (gain_cal[0][1] * (r_y - offset_cal[1])) + (gain_cal[0][2] * (r_z - offset_cal[2])));
-        setDataPoint(dt, Y, i, (gain_cal[1][0] * (r_x - offset_cal[0])) + (gain_cal[1][1] * (r_y - offset_cal[1])) + (gain_cal[1][2] * (r_z - offset_cal[2])));
-        setDataPoint(dt, Z, i, (gain_cal[2][0] * (r_x - offset_cal[0])) + (gain_cal[2][1] * (r_y - offset_cal[1])) + (gain_cal[2][2] * (r_z - offset_cal[2])));
-    }
-
-    //since data is read separately we need to set the data updated variable to true for the current sensor
-    sensor_data_updated[sensor_type] = true;
-
-    //See if all three basic data types (acc, gyr and mag) have been updated. If so, update the rest of the data types
-    if (sensor_data_updated[0] && sensor_data_updated[1] && sensor_data_updated[2]) dataUpdate();
-}
-
 std::pair<const float*, const float**> PersonalCaddie::getSensorCalibrationNumbers(sensor_type_t sensor)
 {
     if (sensor == ACC_SENSOR) return this->p_imu->getAccelerometerCalibrationNumbers();
@@ -669,6 +765,7 @@ std::pair<const int*, const int*> PersonalCaddie::getSensorAxisCalibrationNumber
 void PersonalCaddie::updateSensorCalibrationNumbers(sensor_type_t sensor, std::pair<float*, float**> cal_numbers)
 {
     this->p_imu->setCalibrationNumbers(sensor, cal_numbers);
+    if (fusedEncoding()) sendFusionTables(); //the AHRS on the Personal Caddie calibrates its own readings
     std::wstring message = L"Updated Calibration Info";
     event_handler(PersonalCaddieEventType::IMU_ALERT, (void*)&message);
 }
@@ -676,6 +773,7 @@ void PersonalCaddie::updateSensorCalibrationNumbers(sensor_type_t sensor, std::p
 void PersonalCaddie::updateSensorAxisOrientations(sensor_type_t sensor, std::pair<int*, int*> cal_numbers)
 {
     this->p_imu->setAxesOrientations(sensor, cal_numbers);
+    if (fusedEncoding()) sendFusionTables();
     std::wstring message = L"Updated Axis Orientation Info";
     event_handler(PersonalCaddieEventType::IMU_ALERT, (void*)&message);
 }
@@ -766,6 +864,7 @@ void PersonalCaddie::enableDataNotifications()
                                         }
                                         else
                                         {
+                                            setBurstNotifications(true);
                                             std::wstring message = L"On";
                                             //event_handler(PersonalCaddieEventType::BLE_ALERT, (void*)&message);
                                             event_handler(PersonalCaddieEventType::NOTIFICATIONS_TOGGLE, (void*)&message);
@@ -836,6 +935,7 @@ void PersonalCaddie::disableDataNotifications()
                                         }
                                         else
                                         {
+                                            setBurstNotifications(false);
                                             std::wstring message = L"Off";
                                             //event_handler(PersonalCaddieEventType::BLE_ALERT, (void*)&message);
                                             event_handler(PersonalCaddieEventType::NOTIFICATIONS_TOGGLE, (void*)&message);
@@ -853,6 +953,24 @@ void PersonalCaddie::disableDataNotifications()
         });
 }
 
+void PersonalCaddie::setBurstNotifications(bool on)
+{
+    //Bursts are only sent while the live stream is on, so burst notifications get turned on and off along with it.
+    //Older firmware doesn't have the burst data characteristic at all in which case there's nothing to do.
+    if (m_burst_data_characteristic == nullptr) return;
+
+    auto cccd_value = on ? GattClientCharacteristicConfigurationDescriptorValue::Notify : GattClientCharacteristicConfigurationDescriptorValue::None;
+    auto cccdBurstWrite = m_burst_data_characteristic.WriteClientCharacteristicConfigurationDescriptorAsync(cccd_value);
+    cccdBurstWrite.Completed([this, on](IAsyncOperation<GattCommunicationStatus> const& sender, AsyncStatus const status)
+        {
+            if (!cccdWriteHandler(sender, status))
+            {
+                std::wstring message = on ? L"An error occured when trying to enable burst data notifications.\n" : L"An error occured when trying to disable burst data notifications.\n";
+                event_handler(PersonalCaddieEventType::BLE_ALERT, (void*)&message);
+            }
+        });
+}
+
 bool PersonalCaddie::cccdWriteHandler(IAsyncOperation<GattCommunicationStatus> const& sender, AsyncStatus const status)
 {
     //A method for handling asynchronous writes to Client Characteristic Configuration Descriptor
@@ -895,6 +1013,15 @@ void PersonalCaddie::changePowerMode(PersonalCaddiePowerMode mode)
 
     if (mode == current_power_mode) return; //no need to change into the same mode we're currently in
 
+    //Going into sensor active mode starts a new stream of data, the Personal Caddie starts its sequence numbers
+    //over so the packet reassembler needs to as well
+    if (mode == PersonalCaddiePowerMode::SENSOR_ACTIVE_MODE)
+    {
+        m_resetPacketReassembler.store(true);
+        m_resetBurstAssembler.store(true);
+        m_alignAttitude.store(true);
+    }
+
     winrt::Windows::Storage::Streams::DataWriter writer;
     writer.ByteOrder(winrt::Windows::Storage::Streams::ByteOrder::LittleEndian);
     writer.WriteByte(static_cast<uint8_t>(mode));
@@ -934,16 +1061,134 @@ void PersonalCaddie::changePowerMode(PersonalCaddiePowerMode mode)
     );
 }
 
+void PersonalCaddie::setDataEncoding(uint8_t encoding)
+{
+    //Asks the Personal Caddie to encode the samples in its data characteristic a certain way (see sample_packing.h).
+    //Writing a 6 followed by the encoding to the settings characteristic does this. The Personal Caddie writes the
+    //encoding it actually ends up using back into byte 31 of the settings characteristic, older firmware just keeps
+    //sending raw samples. Each notification says how its samples are encoded so nothing else needs to change here.
+    //The fused encodings need calibration tables for the AHRS on the Personal Caddie, which go out first.
+    m_dataEncoding = encoding;
+    if (fusedEncoding()) sendFusionTables();
+
+    winrt::Windows::Storage::Streams::DataWriter writer;
+    writer.ByteOrder(winrt::Windows::Storage::Streams::ByteOrder::LittleEndian);
+    writer.WriteByte(6);
+    writer.WriteByte(encoding);
+
+    auto writeOperation = this->m_settings_characteristic.WriteValueAsync(writer.DetachBuffer());
+
+    writeOperation.Completed([encoding](IAsyncOperation<GattCommunicationStatus> const& sender, AsyncStatus const asyncStatus)
+        {
+            if (asyncStatus != AsyncStatus::Completed || sender.get() != Bluetooth::GenericAttributeProfile::GattCommunicationStatus::Success)
+            {
+                OutputDebugString(L"Couldn't set the sample encoding of the Personal Caddie, data will be sent raw.\n");
+            }
+            else OutputDebugString((L"Asked the Personal Caddie for sample encoding " + std::to_wstring(encoding) + L"\n").c_str());
+        }
+    );
+}
+
+void PersonalCaddie::setBurstCapture(bool enable, float threshold_dps, float pre_trigger_seconds, float post_trigger_seconds)
+{
+    //Turns swing burst capture on the Personal Caddie on or off. Writing an 8 to the settings characteristic followed by
+    //the on/off byte, the gyroscope threshold in LSB and the length of the window on either side of the trigger in
+    //milliseconds does this (see burst_capture.h in the firmware). Since the threshold is compared against raw readings
+    //it's converted with the current gyroscope conversion rate. The new settings take effect the next time the sensors
+    //are put into active mode.
+    if (p_imu == nullptr) return;
+
+    float dps_per_lsb = this->p_imu->getConversionRate(GYR_SENSOR);
+    float threshold = (dps_per_lsb > 0.0f) ? threshold_dps / dps_per_lsb : 0.0f;
+    uint16_t threshold_lsb = static_cast<uint16_t>(std::clamp(threshold, 1.0f, 32767.0f));
+    uint16_t pre_ms = static_cast<uint16_t>(std::clamp(pre_trigger_seconds * 1000.0f, 0.0f, 65535.0f));
+    uint16_t post_ms = static_cast<uint16_t>(std::clamp(post_trigger_seconds * 1000.0f, 0.0f, 65535.0f));
+
+    winrt::Windows::Storage::Streams::DataWriter writer;
+    writer.ByteOrder(winrt::Windows::Storage::Streams::ByteOrder::LittleEndian);
+    writer.WriteByte(BURST_CAPTURE_COMMAND);
+    writer.WriteByte(enable ? 1 : 0);
+    writer.WriteUInt16(threshold_lsb);
+    writer.WriteUInt16(pre_ms);
+    writer.WriteUInt16(post_ms);
+
+    auto writeOperation = this->m_settings_characteristic.WriteValueAsync(writer.DetachBuffer());
+
+    writeOperation.Completed([enable](IAsyncOperation<GattCommunicationStatus> const& sender, AsyncStatus const asyncStatus)
+        {
+            if (asyncStatus != AsyncStatus::Completed || sender.get() != Bluetooth::GenericAttributeProfile::GattCommunicationStatus::Success)
+            {
+                OutputDebugString(L"Couldn't change the burst capture settings of the Personal Caddie.\n");
+            }
+            else OutputDebugString(enable ? L"Burst capture turned on.\n" : L"Burst capture turned off.\n");
+        }
+    );
+}
+
+void PersonalCaddie::loadDecodeTables(CompositeDataDecoder& decoder)
+{
+    //Folds the conversion rate, axis orientations and calibration numbers of each sensor into the tables of the decoder
+    for (int sensor = ACC_SENSOR; sensor <= MAG_SENSOR; sensor++)
+    {
+        std::pair<const float*, const float**> calibration_data = getSensorCalibrationNumbers(static_cast<sensor_type_t>(sensor));
+        std::pair<const int*, const int*> axis_orientation_data = getSensorAxisCalibrationNumbers(static_cast<sensor_type_t>(sensor));
+        decoder.setSensorTable(sensor, this->p_imu->getConversionRate(static_cast<sensor_type_t>(sensor)), axis_orientation_data.first,
+            axis_orientation_data.second, calibration_data.first, calibration_data.second);
+    }
+}
+
+void PersonalCaddie::sendFusionTables()
+{
+    //The AHRS on the Personal Caddie needs to calibrate readings the exact same way they get calibrated here, so it gets
+    //sent the calibrated decode table of each sensor (see device_fusion.h in the firmware for the layout). Each table is
+    //12 floats which is too many for a single write to the settings characteristic, so they go out 6 at a time. This
+    //uses its own decoder since the one for notifications belongs to the BLE thread.
+    if (p_imu == nullptr) return;
+
+    CompositeDataDecoder decoder;
+    loadDecodeTables(decoder);
+
+    for (int sensor = ACC_SENSOR; sensor <= MAG_SENSOR; sensor++)
+    {
+        SensorDecodeTable const& table = decoder.getSensorTable(sensor);
+        float values[DEVICE_FUSION_TABLE_VALUES];
+        for (int row = 0; row < COMPOSITE_AXES; row++)
+        {
+            for (int column = 0; column < COMPOSITE_AXES; column++) values[COMPOSITE_AXES * row + column] = table.calibrated[row][column];
+            values[COMPOSITE_AXES * COMPOSITE_AXES + row] = table.bias[row];
+        }
+
+        for (int part = 0; part < DEVICE_FUSION_TABLE_PARTS; part++)
+        {
+            winrt::Windows::Storage::Streams::DataWriter writer;
+            writer.ByteOrder(winrt::Windows::Storage::Streams::ByteOrder::LittleEndian);
+            writer.WriteByte(DEVICE_FUSION_COMMAND);
+            writer.WriteByte(static_cast<uint8_t>(sensor));
+            writer.WriteByte(static_cast<uint8_t>(part));
+            for (int i = 0; i < DEVICE_FUSION_PART_VALUES; i++) writer.WriteSingle(values[part * DEVICE_FUSION_PART_VALUES + i]);
+
+            auto writeOperation = this->m_settings_characteristic.WriteValueAsync(writer.DetachBuffer());
+            writeOperation.Completed([](IAsyncOperation<GattCommunicationStatus> const& sender, AsyncStatus const asyncStatus)
+                {
+                    if (asyncStatus != AsyncStatus::Completed || sender.get() != Bluetooth::GenericAttributeProfile::GattCommunicationStatus::Success)
+                    {
+                        OutputDebugString(L"Couldn't send a fusion table to the Personal Caddie, it will keep sending raw or packed samples.\n");
+                    }
+                }
+            );
+        }
+    }
+}
+
 void PersonalCaddie::updateIMUSettings(uint8_t* newSettings)
 {
     //After updating the settings for the IMU in the IMU Settings mode, this method can be 
     //called to apply these new settings to the IMU on the Personal Caddie.
 
     //The IMU Settings doesn't change byte 0 or 31, so we make sure that those are set to the current
-    //Personal Caddie settings. Currently byte 31 represents the FIFO of the IMU which isn't
-    //actually being used so its value doesn't matter too too much for now.
+    //Personal Caddie settings. Byte 31 holds the sample encoding used by the data characteristic.
     newSettings[0] = 3; //In order to update the IMU settings, we need to go into power mode 3. This will be reset to connected mode after data transfer
-    newSettings[31] = 0;
+    newSettings[DATA_ENCODING] = m_dataEncoding;
 
     //We have the capability to change to different sensors from the sensor settings menu. Check the current
     //sensor settings vs. the new settings array to see if a new sensor needs to be initialized.
@@ -986,6 +1231,9 @@ void PersonalCaddie::updateIMUSettings(uint8_t* newSettings)
                 if (current_settings[GYR_START + SENSOR_MODEL] != newSettings[GYR_START + SENSOR_MODEL]) p_imu->initializeNewSensor(GYR_SENSOR, newSettings);
                 if (current_settings[MAG_START + SENSOR_MODEL] != newSettings[MAG_START + SENSOR_MODEL]) p_imu->initializeNewSensor(MAG_SENSOR, newSettings);
 
+                //New full scale ranges change the conversion rates that the AHRS on the Personal Caddie uses
+                if (fusedEncoding()) sendFusionTables();
+
                 std::wstring message = L"IMU Settings successfully updated. ";
                 event_handler(PersonalCaddieEventType::IMU_ALERT, (void*)&message);
             }
@@ -1038,7 +1286,7 @@ int PersonalCaddie::getCurrentSample()
 float PersonalCaddie::getCurrentTime()
 {
     //returns the timestamp for the first sample in the data vectors
-    return m_first_data_time_stamp;
+    return (float)m_first_data_time_stamp;
 }
 
 void PersonalCaddie::setSampleFrequency(float freq)
@@ -1080,12 +1328,21 @@ void PersonalCaddie::dataUpdate()
         //The most recent data has been read from the BLE device and had calibration data applied to it. We can 
         //now calculate any interpreted data, such as position quaternion, euler angles, linear acceleration, etc.
 
-        updateMadgwick(); //update orientation quaternion
-        if (m_linearAcc) updateLinearAcceleration(); //calculate the linear acceleration if we need it
+        //With fused samples the Personal Caddie already did this part. Its AHRS sees every sample, even the ones in data
+        //sets that get lost on the way here, so there's no need for the filter to catch up after missed packets either.
+        //The Personal Caddie seeds its own AHRS from the first samples of every stream, so there's nothing to align here.
+        if (m_deviceFusion && m_alignAttitude.exchange(false)) m_attitudeAligned = true;
+        if (!m_deviceFusion)
+        {
+            updateMadgwick(); //update orientation quaternion
+            if (m_linearAcc) updateLinearAcceleration(); //calculate the linear acceleration if we need it
+        }
         //updatePosition(); //use newly calculated orientation to get linear acceleration, and then integrate that to get velocity, and again for position
         if (m_eulerAngles) updateEulerAngles(); //use newly calculated orientation quaternion to get Euler Angles of sensor (used in training modes)
 
-        m_last_processed_data_time_stamp = m_first_data_time_stamp + 1.0f / this->p_imu->getMaxODR() * (number_of_samples - 1);
+        m_last_processed_data_time_stamp = m_sampleTimes[number_of_samples - 1];
+
+        appendToSessionData(); //save everything that was just calculated before the next data set overwrites it
 
         //set the current sample to 0 so the graphics module starts rendering the new data. It's possible that not 
         //all data from the last set will actually have been rendered but this is ok since each piece of data is on 
@@ -1098,7 +1355,9 @@ void PersonalCaddie::dataUpdate()
         sensor_data_updated[GYR_SENSOR] = false;
         sensor_data_updated[MAG_SENSOR] = false;
 
-        //Let the ModeScreen class know that the next batch of data is ready for use.
+        //Hand a copy of the processed data over to the render thread and then let the ModeScreen
+        //class know that the next batch of data is ready for use.
+        pushSampleBatch();
         event_handler(PersonalCaddieEventType::DATA_READY, nullptr);
     }
     else
@@ -1114,81 +1373,174 @@ void PersonalCaddie::dataUpdate()
     }
 }
 
+void PersonalCaddie::appendToSessionData()
+{
+    //Copies the current data set into the session data store. Each data type axis is already held in its
+    //own contiguous vector so it gets passed in directly, as do the time stamps. Only the quaternions need
+    //to be laid out as separate arrays first.
+    const float* channels[SESSION_CHANNELS];
+    for (int dt = 0; dt < static_cast<int>(DataType::END); dt++)
+    {
+        for (int axis = X; axis <= Z; axis++) channels[sessionChannel(dt, axis)] = this->sensor_data[dt][axis].data();
+    }
+
+    float quaternion_components[4][MAX_SENSOR_SAMPLES];
+    for (int i = 0; i < number_of_samples; i++)
+    {
+        quaternion_components[0][i] = orientation_quaternions[i].w;
+        quaternion_components[1][i] = orientation_quaternions[i].x;
+        quaternion_components[2][i] = orientation_quaternions[i].y;
+        quaternion_components[3][i] = orientation_quaternions[i].z;
+    }
+    for (int component = 0; component < 4; component++) channels[SESSION_QUATERNION_CHANNEL + component] = quaternion_components[component];
+
+    m_latestSessionSample = m_sessionData.append(channels, m_sampleTimes, number_of_samples);
+}
+
+void PersonalCaddie::pushSampleBatch()
+{
+    //Copies the current data set into the next free slot of the sample batch queue. If the render thread has
+    //fallen so far behind that the queue is full the data set is dropped (the queue keeps count of these overruns)
+    //rather than making the BLE thread wait.
+    SampleBatch* batch = m_sampleBatches.beginPush();
+    if (batch == nullptr) return;
+
+    for (int dt = 0; dt < static_cast<int>(DataType::END); dt++)
+    {
+        for (int axis = X; axis <= Z; axis++)
+        {
+            std::copy(this->sensor_data[dt][axis].begin(), this->sensor_data[dt][axis].begin() + number_of_samples, batch->sensorData[dt][axis].begin());
+        }
+    }
+    std::copy(orientation_quaternions.begin(), orientation_quaternions.begin() + number_of_samples, batch->quaternions.begin());
+
+    batch->numberOfSamples = number_of_samples;
+    batch->timeStamp = (float)m_first_data_time_stamp;
+    batch->sensorODR = (float)m_deviceClock.odr();
+    batch->hostTime = m_deviceClock.hostTime(m_first_data_time_stamp);
+    batch->firstSessionSample = m_latestSessionSample;
+    batch->attitudeAligned = m_attitudeAligned;
+    m_attitudeAligned = false;
+
+    m_sampleBatches.endPush();
+}
+
 //Internal Updating Functions
 void PersonalCaddie::updateMadgwick()
 {
-    for (int i = 0; i < number_of_samples; i++)
+    if (number_of_samples <= 0) return;
+
+    const float* acc_x = this->sensor_data[static_cast<int>(DataType::ACCELERATION)][X].data(), * acc_y = this->sensor_data[static_cast<int>(DataType::ACCELERATION)][Y].data(), * acc_z = this->sensor_data[static_cast<int>(DataType::ACCELERATION)][Z].data();
+    const float* gyr_x = this->sensor_data[static_cast<int>(DataType::ROTATION)][X].data(), * gyr_y = this->sensor_data[static_cast<int>(DataType::ROTATION)][Y].data(), * gyr_z = this->sensor_data[static_cast<int>(DataType::ROTATION)][Z].data();
+    const float* mag_x = this->sensor_data[static_cast<int>(DataType::MAGNETIC)][X].data(), * mag_y = this->sensor_data[static_cast<int>(DataType::MAGNETIC)][Y].data(), * mag_z = this->sensor_data[static_cast<int>(DataType::MAGNETIC)][Z].data();
+
+    //The first rotation quaternion of the new data set must build from the last rotation quaternion of the previous set. It's possible that we've
+    //missed data packets, so the first quaternion shouldn't use the sensor ODR, but the time difference of the first piece of data in this set to
+    //the last piece of data in the previous set. The inverse of this time delay will give us an approximate ODR.
+    //
+    //Due to potential congestion/interference in BLE traffic it's possible that we will miss packets of data. The Personal Caddie 
+    //operates in notify mode, so missed data packets won't be resent. When this happens a degree of error will form between the 
+    //calculated orientation quaternion and its real world equivalent. The more packets of data that are missed, the worse this 
+    //error will become. To quickly get back to the correct orientation we can dynamically increase the gain of the filter (which 
+    //will bias orientation results towards the accelerometer and magnetometer) for the current data set. Once this data set has
+    //been processed we put the filter gain back to what it was. The packet reassembler knows exactly how many packets went missing
+    //from the sequence numbers in the notifications.
+    int data_sets_missed = (int)m_lastPacket.lost_packets;
+
+    if (data_sets_missed > 0)
     {
-        int cs = current_sample; //this is only here because it became annoying to keep writing out current_sample
-        
-        float acc_x = getDataPoint(DataType::ACCELERATION, X, cs), acc_y = getDataPoint(DataType::ACCELERATION, Y, cs), acc_z = getDataPoint(DataType::ACCELERATION, Z, cs);
-        float gyr_x = getDataPoint(DataType::ROTATION, X, cs), gyr_y = getDataPoint(DataType::ROTATION, Y, cs), gyr_z = getDataPoint(DataType::ROTATION, Z, cs);
-        float mag_x = getDataPoint(DataType::MAGNETIC, X, cs), mag_y = getDataPoint(DataType::MAGNETIC, Y, cs), mag_z = getDataPoint(DataType::MAGNETIC, Z, cs);
-        
-        //the first rotation quaternion of the new data set must build from the last rotation quaternion of the previous set. The rest can build off of
-        //earlier samples from the current set. It's possible that we've missed data packets, so the first quaternion shouldn't use the sensor ODR,
-        //but the time difference of the first piece of data in this set to the last piece of data in the previous set. The inverse of this time 
-        //delay will give us an approximate ODR.
-        if (i == 0)
+        LinkQualityStats const& link = m_packetReassembler.stats();
+        std::wstring missedPackets = L"Missed " + std::to_wstring(data_sets_missed) + L" packets (" + std::to_wstring(m_lastPacket.lost_samples) + L" samples) of data. Time stamp = " +
+            std::to_wstring(m_first_data_time_stamp) + L", loss rate = " + std::to_wstring(100.0 * link.lossRate()) + L"%, " + std::to_wstring(link.packets_dropped_by_device) +
+            L" of " + std::to_wstring(link.packets_lost) + L" lost packets dropped by the Personal Caddie\n";
+        OutputDebugString(&missedPackets[0]);
+
+        if (m_adjusted_data_sets_remaining == 0)
         {
-            //Due to potential congestion/interference in BLE traffic it's possible that we will miss packets of data. The Personal Caddie 
-            //operates in notify mode, so missed data packets won't be resent. When this happens a degree of error will form between the 
-            //calculated orientation quaternion and its real world equivalent. The more packets of data that are missed, the worse this 
-            //error will become. To quickly get back to the correct orientation we can dynamically increase the gain of the filter (which 
-            //will bias orientation results towards the accelerometer and magnetometer) for the current data set. Once this data set has
-            //been processed we put the filter gain back to what it was.
-            int data_sets_missed = (m_first_data_time_stamp - m_last_processed_data_time_stamp) * this->p_imu->getMaxODR() / number_of_samples;
-
-            if (data_sets_missed > 0)
-            {
-                std::wstring missedPackets = L"Missed " + std::to_wstring(data_sets_missed) + L" packets of data. Time stamp = " + std::to_wstring(m_first_data_time_stamp) + L"\n";
-                OutputDebugString(&missedPackets[0]);
+            //this is the first missed data set encountered. Set the beta gain and
+            //number of data sets to keep it increased for accordingly
+            original_beta = beta; //save a copy of the current gain amount to reapply when adjustments are complete
+        }
+        //beta += 2.5f; //minor increase
+        //m_adjusted_data_sets_remaining = data_sets_missed;
 
-                if (m_adjusted_data_sets_remaining == 0)
-                {
-                    //this is the first missed data set encountered. Set the beta gain and
-                    //number of data sets to keep it increased for accordingly
-                    original_beta = beta; //save a copy of the current gain amount to reapply when adjustments are complete
-                }
-                //beta += 2.5f; //minor increase
-                //m_adjusted_data_sets_remaining = data_sets_missed;
+        //Uncomment below code to use different beta values
+        if (data_sets_missed < 3)
+        {
+            beta = 0.1f; //minor increase
+            //m_adjusted_data_sets_remaining = 3;
+        }
+        else if (data_sets_missed < 5)
+        {
+            beta = 0.5f; //larger increase
+            //m_adjusted_data_sets_remaining = 3;
+        }
+        else if (data_sets_missed < 7)
+        {
+            beta = 1.0f;
+            //m_adjusted_data_sets_remaining = 3;
+        }
+        else
+        {
+            beta = 2.5f;
+            //m_adjusted_data_sets_remaining = 3;
+        }
+        m_adjusted_data_sets_remaining = 10;
+        //else
+        //{
+        //    //We've missed some more data while currently in the process of recovering
+        //    //from data loss, increase the m_adjusted_data_sets_remaining parameters
+        //    //accordingly.
+
+        //    /*m_adjusted_data_sets_remaining += data_sets_missed;*/
+        //    m_adjusted_data_sets_remaining = 3;
+        //}
+    }
+    
+    //When a new stream starts (or a mode asks for it) the filter doesn't start from wherever it was left and converge on the
+    //real orientation over a few seconds with a huge gain. Gravity and the magnetic field averaged over the data sets coming
+    //in give the orientation straight away (see FusionAlignment.h), and the filter carries on from there with its normal
+    //gain. Small data sets get gathered up until there are ATTITUDE_ALIGNMENT_SAMPLES samples, any fewer than that and the
+    //noise on the magnetometer leaves the heading a few degrees off, which the normal gain takes far longer to pull back
+    //than the old convergence did. If the sensor was moving too much for the average to mean anything it starts over.
+    if (m_alignAttitude.load())
+    {
+        for (int i = 0; i < number_of_samples; i++)
+        {
+            const FusionVector accelerometer = { acc_x[i], acc_y[i], acc_z[i] };
+            const FusionVector magnetometer = { mag_x[i], mag_y[i], mag_z[i] };
+            FusionAlignmentAdd(&m_alignment, accelerometer, magnetometer);
+        }
 
-                //Uncomment below code to use different beta values
-                if (data_sets_missed < 3)
-                {
-                    beta = 0.1f; //minor increase
-                    //m_adjusted_data_sets_remaining = 3;
-                }
-                else if (data_sets_missed < 5)
-                {
-                    beta = 0.5f; //larger increase
-                    //m_adjusted_data_sets_remaining = 3;
-                }
-                else if (data_sets_missed < 7)
-                {
-                    beta = 1.0f;
-                    //m_adjusted_data_sets_remaining = 3;
-                }
-                else
-                {
-                    beta = 2.5f;
-                    //m_adjusted_data_sets_remaining = 3;
-                }
-                m_adjusted_data_sets_remaining = 10;
-                //else
-                //{
-                //    //We've missed some more data while currently in the process of recovering
-                //    //from data loss, increase the m_adjusted_data_sets_remaining parameters
-                //    //accordingly.
-
-                //    /*m_adjusted_data_sets_remaining += data_sets_missed;*/
-                //    m_adjusted_data_sets_remaining = 3;
-                //}
+        if (FusionAlignmentGetSamples(&m_alignment) >= ATTITUDE_ALIGNMENT_SAMPLES)
+        {
+            FusionQuaternion initial;
+            if (FusionAlignmentQuaternion(&m_alignment, FusionConventionNwu, &initial))
+            {
+                orientation_quaternions[number_of_samples - 1] = glm::quat(initial.element.w, initial.element.x, initial.element.y, initial.element.z);
+                m_alignAttitude.store(false);
+                m_attitudeAligned = true;
             }
-            
-            MadgwickAHRSupdate(orientation_quaternions[number_of_samples - 1], orientation_quaternions[i], gyr_x, gyr_y, gyr_z, acc_x, acc_y, acc_z, mag_x, mag_y, mag_z, 1.0f / (m_first_data_time_stamp - m_last_processed_data_time_stamp), beta);
+            FusionAlignmentReset(&m_alignment);
+        }
+    }
+
+    MadgwickAHRSupdate(orientation_quaternions[number_of_samples - 1], orientation_quaternions[0], gyr_x[0], gyr_y[0], gyr_z[0], acc_x[0], acc_y[0], acc_z[0], mag_x[0], mag_y[0], mag_z[0], (float)(1.0 / (m_first_data_time_stamp - m_last_processed_data_time_stamp)), beta);
+
+    //Every other sample in the set is spaced out by the measured sensor ODR so they can all be run through the filter in a
+    //single call. This skips the per-sample function call overhead and keeps the quaternion in registers between samples.
+    if (number_of_samples > 1)
+    {
+        float q[4] = { orientation_quaternions[0].w, orientation_quaternions[0].x, orientation_quaternions[0].y, orientation_quaternions[0].z };
+        float q_out[4 * MAX_SENSOR_SAMPLES];
+        MadgwickBatchInput input = { gyr_x + 1, gyr_y + 1, gyr_z + 1, acc_x + 1, acc_y + 1, acc_z + 1, mag_x + 1, mag_y + 1, mag_z + 1 };
+        MadgwickAHRSupdateBatch(q, input, number_of_samples - 1, (float)m_deviceClock.odr(), beta, q_out);
+
+        for (int i = 1; i < number_of_samples; i++)
+        {
+            const float* sample_q = q_out + 4 * (i - 1);
+            orientation_quaternions[i] = glm::quat(sample_q[0], sample_q[1], sample_q[2], sample_q[3]);
         }
-        else MadgwickAHRSupdate(orientation_quaternions[i - 1], orientation_quaternions[i], gyr_x, gyr_y, gyr_z, acc_x, acc_y, acc_z, mag_x, mag_y, mag_z, this->p_imu->getMaxODR(), beta);
     }
 
     /*std::wstring missedPackets = L"Current Beta: " + std::to_wstring(beta) + L"\n";
@@ -2,24 +2,30 @@
 
 #include <pch.h>
 #include <vector>
+#include <atomic>
 
 #include "IMU.h"
 #include "BLE.h"
+#include "CompositeDataDecoder.h"
+#include "DeviceClock.h"
+#include "DeviceSession.h"
+#include "PacketReassembler.h"
+#include "SessionDataStore.h"
+#include "SessionFile.h"
+#include "SpscQueue.h"
+#include "SwingBurst.h"
+#include "WinRTTransport.h"
+#include "../Math/SensorFusion/FusionAlignment.h"
+#include "../../Firmware/nRF52840_Drivers/boot_cache.h"
 //#include "Modes/mode.h"
 
 using namespace winrt;
 using namespace Windows::Devices;
 
-//Service and characteristic values are the same across Personal Caddie devices so define them here
-#define PERSONAL_CADDIE_SERVICE_UUID           0xBF40
-#define ERROR_CHARACTERISTIC_UUID              0xBF41
-#define SENSOR_SERVICE_UUID                    0xBF34
-#define SETTINGS_CHARACTERISTIC_UUID           0xBF35
-#define SMALL_DATA_CHARACTERISTIC_UUID         0xBF36
-#define MEDIUM_DATA_CHARACTERISTIC_UUID        0xBF37
-#define LARGE_DATA_CHARACTERISTIC_UUID         0xBF38
-#define AVAILABLE_SENSORS_CHARACTERISTIC_UUID  0xBF39
 #define MAX_SENSOR_SAMPLES                     39 //at most we can hold 39 sensor readings in a single characteristic and still send out the notification in a single packet
+#define SAMPLE_BATCH_QUEUE_SIZE                16 //number of processed data sets that can be waiting for the render thread at once
+#define RAW_BURST_QUEUE_SIZE                   2 //finished bursts waiting to be placed on the session timeline, they come in seconds apart
+#define ATTITUDE_ALIGNMENT_SAMPLES             39 //samples of gravity and the magnetic field averaged before they seed the orientation
 
 //enums and structs used by the Personal Caddie class
 enum PersonalCaddiePowerMode
@@ -44,6 +50,7 @@ enum class DataType
 	EULER_ANGLES,
 	END
 };
+static_assert(static_cast<int>(DataType::END) == SESSION_DATA_TYPES, "The session data store needs a set of channels for every DataType");
 
 enum class PersonalCaddieEventType
 {
@@ -60,6 +67,21 @@ enum class PersonalCaddieEventType
 
 enum class TextType;
 
+//A single processed data set as handed from the BLE notification thread to the render thread. The vectors are
+//sized once when the batch queue is created and then reused, so filling a batch never allocates.
+struct SampleBatch
+{
+	std::vector<std::vector<std::vector<float> > > sensorData; //same layout as PersonalCaddie::sensor_data
+	std::vector<glm::quat> quaternions;
+	int numberOfSamples = 0;
+	float timeStamp = 0.0f; //time of the first sample in the batch
+	float sensorODR = 0.0f; //measured from the Personal Caddie's clock, so it's the real spacing between samples and not just the ODR setting
+	double hostTime = 0.0; //time of the first sample in the batch on the steady clock of this computer
+	uint64_t firstSessionSample = 0; //session data store sample number of the first sample in the batch
+	bool attitudeAligned = false; //the orientation was found from gravity and the magnetic field in this batch, so the quaternions can be trusted from here on
+};
+typedef SpscQueue<SampleBatch, SAMPLE_BATCH_QUEUE_SIZE> SampleBatchQueue;
+
 /*
 * This class is a representation of the physical Personal Caddie device. The real device is composed of a 
 * BluetoothLE module (specifically the nRF52840) and an IMU (I've worked with a handful of different sensors
@@ -75,6 +97,8 @@ public:
 	//BLE Related Functions
 	void changePowerMode(PersonalCaddiePowerMode mode);
 	void updateIMUSettings(uint8_t* newSettings);
+	void setDataEncoding(uint8_t encoding);
+	void setBurstCapture(bool enable, float threshold_dps, float pre_trigger_seconds, float post_trigger_seconds);
 
 	void startDataTransfer();
 
@@ -96,18 +120,20 @@ public:
 	void dataUpdate(); //master update function
 	float getDataPoint(DataType dt, Axis a, int sample_number);
 	void setMadgwickBeta(float b);
+	void alignAttitude() { m_alignAttitude.store(true); } //find the orientation from scratch with the next data set instead of waiting for the filter to converge
 	void toggleCalculatedDataType(DataType dt);
 
 	//IMU and Sensor Methods
 	std::vector<uint8_t*> getIMUSettings() { return p_imu->getSensorSettings(); }
 	std::vector<uint8_t> const& getAvailableSensors() { return m_availableSensors; }
+	boot_timing_t const& getBootTiming() { return m_bootTiming; }
 	std::pair<const float*, const float**> getSensorCalibrationNumbers(sensor_type_t sensor);
 	std::pair<const int*, const int*> getSensorAxisCalibrationNumbers(sensor_type_t sensor);
 	void updateSensorCalibrationNumbers(sensor_type_t sensor, std::pair<float*, float**> cal_numbers);
 	void updateSensorAxisOrientations(sensor_type_t sensor, std::pair<int*, int*> cal_numbers);
 	int getNumberOfSamples() { return this->number_of_samples; }
 	float getMaxODR() { return this->p_imu->getMaxODR(); }
-	float getDataTimeStamp() { return this->m_first_data_time_stamp; }
+	float getDataTimeStamp() { return (float)this->m_first_data_time_stamp; }
 	glm::quat getHeadingOffset() { return m_heading_offset; }
 	void setHeadingOffset(glm::quat offset);
 
@@ -125,6 +151,19 @@ public:
 	std::set<DeviceInfoDisplay>* getScannedDevices() { return p_ble->getScannedDevices(); }
 	std::vector<std::vector<std::vector<float> > > const& getSensorData() { return sensor_data; }
 	std::vector<glm::quat> const& getQuaternions() { return orientation_quaternions; }
+	SessionDataStore const& getSessionData() { return m_sessionData; }
+	SampleBatchQueue& getSampleBatchQueue() { return m_sampleBatches; }
+	uint64_t getLatestSessionSample() { return m_latestSessionSample; }
+	LinkQualityStats const& getLinkQuality() { return m_packetReassembler.stats(); }
+	double getMeasuredODR() { return m_deviceClock.odr(); }
+	double getClockDriftPpm() { return m_deviceClock.driftPpm(); }
+	SwingBurstStore const& getSwingBursts() { return m_swingBursts; }
+	BurstStats const& getBurstStats() { return m_burstAssembler.stats(); }
+
+	//Session Recording
+	bool startSessionFile(std::wstring const& name);
+	void stopSessionFile();
+	bool sessionFileOpen() { return m_sessionFile->isOpen(); }
 
 private:
 	std::unique_ptr<BLE> p_ble;
@@ -136,15 +175,20 @@ private:
 	bool cccdWriteHandler(IAsyncOperation<Bluetooth::GenericAttributeProfile::GattCommunicationStatus> const& sender, AsyncStatus const status);
 
 	//BLE Functionality
-	void getDataCharacteristics(Bluetooth::GenericAttributeProfile::GattDeviceService& data_service);
-	void getErrorCharacteristic(Bluetooth::GenericAttributeProfile::GattDeviceService& pc_service);
+	void sessionStarted(SessionStartup const& startup);
+	void attachCharacteristics();
+	void loadGattCache();
+	void saveGattCache();
+	void loadDecodeTables(CompositeDataDecoder& decoder);
+	void sendFusionTables();
+	bool fusedEncoding() const { return m_dataEncoding == SAMPLE_ENCODING_FUSED || m_dataEncoding == SAMPLE_ENCODING_FUSED_LINEAR; }
 	void compositeDataCharacteristicEventHandler(Bluetooth::GenericAttributeProfile::GattCharacteristic& car, Bluetooth::GenericAttributeProfile::GattValueChangedEventArgs& args);
+	void burstDataCharacteristicEventHandler(Bluetooth::GenericAttributeProfile::GattCharacteristic& car, Bluetooth::GenericAttributeProfile::GattValueChangedEventArgs& args);
+	void setBurstNotifications(bool on);
 	void automaticallyConnect();
 
 	//Data Gathering/Manipulation
-	void updateRawDataWithCalibrationNumbers(DataType rdt, DataType dt, sensor_type_t sensor_type, const float* offset_cal, const float** gain_cal);
 	void updateMostRecentDeviceAddress(uint64_t address);
-	float convertTicksToSeconds(uint32_t timer_ticks);
 
 	//Heading Offset Methods
 	void getHeadingOffsetFromTextFile();
@@ -153,22 +197,39 @@ private:
 	void convertTextToHeadingOffset(winrt::hstring calInfo);
 	
 	PersonalCaddiePowerMode current_power_mode;
+	uint8_t m_dataEncoding = SAMPLE_ENCODING_PACKED; //sample encoding asked for in the settings characteristic, the Personal Caddie falls back to raw samples if it doesn't support it
 	bool dataNotificationsOn;
 
 	std::vector<uint8_t> m_availableSensors;
+	boot_timing_t m_bootTiming = {}; //how long the Personal Caddie took to get from power up to its first sample, all zeros for older firmware
+
+	CompositeDataDecoder m_compositeDecoder; //turns the raw bytes of the composite data characteristic into calibrated sensor data
+	PacketReassembler m_packetReassembler; //uses the sequence numbers in each notification to find out exactly what data was lost
+	ReassembledPacket m_lastPacket; //where the current data set fits into the stream of data
+	std::atomic<bool> m_resetPacketReassembler{ true }; //set when a new stream of data is about to start
+	DeviceClock m_deviceClock; //unwraps the 32-bit time stamps and measures the real ODR and clock drift of the Personal Caddie
+	double m_sampleTimes[MAX_SENSOR_SAMPLES] = {}; //time stamp of every sample in the current data set
+	bool m_deviceFusion = false; //the current data set came with orientations from the AHRS on the Personal Caddie
+	std::atomic<bool> m_alignAttitude{ true }; //set when the next data set should seed the orientation instead of building on the last one
+	bool m_attitudeAligned = false; //the current data set seeded the orientation
+	FusionAlignment m_alignment = {}; //gravity and the magnetic field gathered so far for the next alignment
 
 	volatile bool sensor_data_updated[3] = { false, false, false };
 	volatile bool data_available = false;
 	volatile int debug_notifications_received = 0;
 
 	//Gatt Settings and Characteristics obtained from m_ble
-	winrt::Windows::Foundation::Collections::IVectorView<Bluetooth::GenericAttributeProfile::GattDeviceService>  m_services{ nullptr };
+	Bluetooth::GenericAttributeProfile::GattSession m_gattSession{ nullptr }; //keeps the connection open while the session starts up
+	std::unique_ptr<WinRTTransport> m_transport;
+	std::unique_ptr<DeviceSession> m_session; //gets the Personal Caddie from connected to usable without blocking on the link
+	GattHandleCache m_gattCache; //where the characteristics are on every Personal Caddie that's been connected to, saved in the local app folder
 	Bluetooth::GenericAttributeProfile::GattCharacteristic m_error_characteristic{ nullptr };
 	Bluetooth::GenericAttributeProfile::GattCharacteristic m_settings_characteristic{ nullptr };
 	Bluetooth::GenericAttributeProfile::GattCharacteristic m_available_sensors_characteristic{ nullptr };
 	Bluetooth::GenericAttributeProfile::GattCharacteristic m_small_data_characteristic{ nullptr };
 	Bluetooth::GenericAttributeProfile::GattCharacteristic m_medium_data_characteristic{ nullptr };
 	Bluetooth::GenericAttributeProfile::GattCharacteristic m_large_data_characteristic{ nullptr };
+	Bluetooth::GenericAttributeProfile::GattCharacteristic m_burst_data_characteristic{ nullptr }; //stays nullptr with firmware that can't capture bursts
 
 	void updateMadgwick();
 	void updateLinearAcceleration();
@@ -196,6 +257,31 @@ private:
 	//looks in practice: { { {raw_acc_x_1, raw_acc_x_2, ..., raw_acc_x_numberofsamples}, {raw_acc_y_1 ...}, {raw_acc_z_1 ...} }, { {raw_gyr_x_1...} ....}
 	std::vector<std::vector<std::vector<float> > > sensor_data; 
 	std::vector<glm::quat> orientation_quaternions; //this vector holds number_of_samples quaternions, where each quaternion matches the sensor orientation at a point in time
+
+	//Every processed sample (all data types and quaternions) also gets appended to the session data store so that modes can look 
+	//back at an entire session without keeping their own copies of the data.
+	SessionDataStore m_sessionData;
+	uint64_t m_latestSessionSample = 0; //the session sample number of the first sample in the most recent data set
+	void appendToSessionData();
+
+	//Processed data sets are passed to the render thread through this lock-free queue. The BLE thread is the only
+	//producer and the ModeScreen's update loop is the only consumer.
+	SampleBatchQueue m_sampleBatches;
+	void pushSampleBatch();
+
+	//Bursts (the full rate window the Personal Caddie catches around each swing) arrive on their own characteristic and
+	//get put back together on that thread. The device clock and decode tables belong to the live stream's thread though,
+	//so finished bursts are handed over through a small queue and placed on the session timeline from there.
+	BurstAssembler m_burstAssembler{ [this](RawBurst const& burst) { queueRawBurst(burst); } };
+	std::atomic<bool> m_resetBurstAssembler{ true };
+	SpscQueue<RawBurst, RAW_BURST_QUEUE_SIZE> m_rawBursts;
+	SwingBurstStore m_swingBursts;
+	void queueRawBurst(RawBurst const& burst);
+	void mergeSwingBursts();
+
+	//While a session is being recorded, the raw bytes of every composite characteristic notification are also saved to a
+	//binary session file. The writer holds a handful of large chunks so it lives on the heap.
+	std::unique_ptr<SessionFileWriter> m_sessionFile;
 	glm::quat m_heading_offset = { 1, 0, 0, 0 }; //This quaternions represents the rotation necessary to have the computer screen pointing due north. This is used to line up the image with the monitor and not the North direction
 	float m_heading_yaw_offset; //Gives the heading offset about the yaw axis in radians
 
@@ -216,8 +302,8 @@ private:
 	double position_timer = 0, end_timer = 0; //used for tracking start and stop times of accerleation events, to known if the club should actually move or not
 	float time_stamp = 0.0f; //the time in milliseconds from when the program connected to the BLE device, can be reset to 0 when looking at graphs
 	float last_time_stamp = 0.0f; //holds the time of the last measured sample, used to find delta_t for integration purposes
-	float m_first_data_time_stamp = 0.0f; //represents the point in time (from when sensors first start recording data) that the first bit of data in the current set was recorded
-	float m_last_processed_data_time_stamp = 0.0f; //represents the point in time (from when sensors first start recording data) that the last bit of data was processed through the Madgwick filter
+	double m_first_data_time_stamp = 0.0; //represents the point in time (from when sensors first start recording data) that the first bit of data in the current set was recorded
+	double m_last_processed_data_time_stamp = 0.0; //represents the point in time (from when sensors first start recording data) that the last bit of data was processed through the Madgwick filter
 	bool m_filter_adjust = false; //If we miss multiple data packets in a row from the sensor we use this flag to adjust the Madgwick filter gain temporarily to bias data towards acc. and mag. readings
 	int m_adjusted_data_sets_remaining = 0;
 
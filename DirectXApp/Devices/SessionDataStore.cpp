@@ -0,0 +1,195 @@
+#include "SessionDataStore.h"
+
+#include <cstring>
+#include <cstdint>
+
+SessionDataStore::SessionDataStore(size_t memory_budget)
+{
+    //Every sample takes up one float in each channel plus one double for its time stamp. Find the
+    //largest power of 2 number of samples that fits inside of the memory budget. Using a power of
+    //2 means wrapping around the end of the buffer is just a bit mask.
+    const size_t bytes_per_sample = SESSION_CHANNELS * sizeof(float) + sizeof(double);
+    m_capacity = 1;
+    while ((m_capacity << 1) * bytes_per_sample <= memory_budget) m_capacity <<= 1;
+
+    //Each channel starts on its own cache line. Since the capacity is a power of 2 (and larger than a cache
+    //line for any reasonable budget) the stride is normally just the capacity itself.
+    const size_t floats_per_line = SESSION_CACHE_LINE_SIZE / sizeof(float);
+    m_stride = ((m_capacity + floats_per_line - 1) / floats_per_line) * floats_per_line;
+
+    //Allocate everything at once with one extra cache line so the start of the data can be aligned. The time
+    //stamps go after the last channel and take up two channels worth of floats.
+    m_allocation = std::make_unique<float[]>(m_stride * (SESSION_CHANNELS + 2) + floats_per_line);
+    uintptr_t address = reinterpret_cast<uintptr_t>(m_allocation.get());
+    uintptr_t aligned_address = (address + SESSION_CACHE_LINE_SIZE - 1) & ~(uintptr_t)(SESSION_CACHE_LINE_SIZE - 1);
+    p_data = m_allocation.get() + (aligned_address - address) / sizeof(float);
+    p_time = reinterpret_cast<double*>(p_data + SESSION_CHANNELS * m_stride);
+
+    m_segmentPending = true;
+    m_timeOffset = 0.0;
+    m_lastTime = 0.0;
+    m_segmentStart.store(0, std::memory_order_relaxed);
+    m_reserved.store(0, std::memory_order_relaxed);
+    m_written.store(0, std::memory_order_release);
+}
+
+void SessionDataStore::startSegment()
+{
+    //Called by the writer when a new stream of data is about to start. The offset for the new stream's time
+    //stamps can't be worked out until its first data set shows up, so that happens in append().
+    m_segmentPending = true;
+}
+
+uint64_t SessionDataStore::oldestSample() const
+{
+    uint64_t written = m_written.load(std::memory_order_acquire);
+    return (written > m_capacity) ? (written - m_capacity) : 0;
+}
+
+uint64_t SessionDataStore::append(const float* const* channel_data, const double* time_stamps, int samples)
+{
+    //Copies a batch of samples into the store. The channel_data array must hold SESSION_CHANNELS pointers, each
+    //pointing to an array of at least 'samples' floats. A nullptr channel is filled with zeros. Returns the sample
+    //number of the first sample in the batch.
+    uint64_t first_sample = m_written.load(std::memory_order_relaxed);
+    if (samples <= 0) return first_sample;
+
+    if (m_segmentPending)
+    {
+        //The first sample of a new stream goes one sample period after the newest sample already in the store
+        double period = (samples > 1) ? time_stamps[1] - time_stamps[0] : 0.0;
+        if (period < 0.0) period = 0.0;
+        m_timeOffset = (first_sample > 0) ? m_lastTime + period - time_stamps[0] : 0.0;
+        m_segmentStart.store(first_sample, std::memory_order_release);
+        m_segmentPending = false;
+    }
+
+    //A batch larger than the entire store would just overwrite itself, only keep the newest part of it
+    int skipped = 0;
+    if ((size_t)samples > m_capacity)
+    {
+        skipped = samples - (int)m_capacity;
+        samples = (int)m_capacity;
+    }
+
+    //Let readers know which samples are about to be overwritten before touching any of them, see SessionView::intact()
+    m_reserved.store(first_sample + skipped + samples, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    //Figure out if the batch wraps around the end of the buffer, if so it gets copied in two pieces
+    size_t start = (size_t)((first_sample + skipped) & (m_capacity - 1));
+    size_t first_length = m_capacity - start;
+    if (first_length > (size_t)samples) first_length = samples;
+    size_t second_length = samples - first_length;
+
+    for (int channel = 0; channel < SESSION_CHANNELS; channel++)
+    {
+        float* destination = p_data + channel * m_stride;
+        const float* source = channel_data[channel];
+
+        if (source != nullptr)
+        {
+            source += skipped;
+            memcpy(destination + start, source, first_length * sizeof(float));
+            if (second_length > 0) memcpy(destination, source + first_length, second_length * sizeof(float));
+        }
+        else
+        {
+            memset(destination + start, 0, first_length * sizeof(float));
+            if (second_length > 0) memset(destination, 0, second_length * sizeof(float));
+        }
+    }
+
+    //Time stamps are moved onto the session timeline. The device clock can nudge its estimate of the sample
+    //period between data sets, so anything that would land before the newest time stamp gets held at it.
+    for (int i = 0; i < samples; i++)
+    {
+        double time = time_stamps[skipped + i] + m_timeOffset;
+        if (time < m_lastTime) time = m_lastTime;
+        p_time[(start + i) & (m_capacity - 1)] = time;
+        m_lastTime = time;
+    }
+
+    //Only publish the new samples once they've been completely written
+    m_written.store(first_sample + skipped + samples, std::memory_order_release);
+    return first_sample;
+}
+
+SessionView SessionDataStore::view(uint64_t begin, uint64_t end) const
+{
+    //Creates a view of the samples [begin, end), clamped to the samples that are actually in the store
+    uint64_t oldest = oldestSample(), newest = newestSample();
+    if (begin < oldest) begin = oldest;
+    if (end > newest) end = newest;
+    if (begin > end) begin = end;
+
+    return SessionView(this, begin, end);
+}
+
+SessionView SessionDataStore::latest(int samples) const
+{
+    //Creates a view of the most recently written samples
+    uint64_t newest = newestSample();
+    uint64_t begin = (newest > (uint64_t)samples) ? newest - samples : 0;
+    return view(begin, newest);
+}
+
+uint64_t SessionDataStore::findSample(double time_stamp) const
+{
+    //append() keeps the time stamps from ever going backwards so a binary search can be used to find
+    //the first sample recorded at, or after, the given session time.
+    uint64_t low = oldestSample(), high = newestSample();
+    const double* times = timeStart();
+
+    while (low < high)
+    {
+        uint64_t middle = low + (high - low) / 2;
+        if (times[middle & (m_capacity - 1)] < time_stamp) low = middle + 1;
+        else high = middle;
+    }
+
+    return low;
+}
+
+template <typename T>
+SessionSpan<T> SessionDataStore::span(const T* channel_start, uint64_t begin, uint64_t end) const
+{
+    size_t length = (size_t)(end - begin);
+    size_t start = (size_t)(begin & (m_capacity - 1));
+    size_t first_length = m_capacity - start;
+    if (first_length > length) first_length = length;
+
+    return { channel_start + start, first_length, channel_start, length - first_length };
+}
+
+SessionChannelSpan SessionView::channel(int channel) const
+{
+    if (p_store == nullptr) return { nullptr, 0, nullptr, 0 };
+    return p_store->span(p_store->channelStart(channel), m_begin, m_end);
+}
+
+SessionTimeSpan SessionView::timeSpan() const
+{
+    if (p_store == nullptr) return { nullptr, 0, nullptr, 0 };
+    return p_store->span(p_store->timeStart(), m_begin, m_end);
+}
+
+float SessionView::at(int channel, size_t i) const
+{
+    return p_store->channelStart(channel)[(m_begin + i) & (p_store->m_capacity - 1)];
+}
+
+double SessionView::timeAt(size_t i) const
+{
+    return p_store->timeStart()[(m_begin + i) & (p_store->m_capacity - 1)];
+}
+
+bool SessionView::intact() const
+{
+    //Checked after reading through the view. The writer marks the samples it's about to write before it writes
+    //them, so if the first sample of the view could have been part of that (it's a whole capacity behind) some
+    //of what was read may be a mix of old and new data.
+    if (p_store == nullptr) return true;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return m_begin + p_store->m_capacity >= p_store->m_reserved.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <atomic>
+
+//The session data store holds every sample of a data session in one contiguous block of memory. Each channel
+//(a single axis of a single data type) is stored in its own array (structure of arrays) so that anything
+//walking through the data for a single axis, like a graph, touches memory sequentially.
+#define SESSION_DATA_TYPES             10 //matches DataType::END in PersonalCaddie.h
+#define SESSION_AXES                   3
+#define SESSION_QUATERNION_CHANNEL     (SESSION_DATA_TYPES * SESSION_AXES) //w, x, y and z are stored in the four channels starting here
+#define SESSION_CHANNELS               (SESSION_QUATERNION_CHANNEL + 4)
+#define SESSION_CACHE_LINE_SIZE        64
+#define SESSION_DEFAULT_MEMORY_BUDGET  (64 * 1024 * 1024) //64 MB holds a little over 10 minutes of data at 400 Hz
+
+//Returns the channel index for the given data type (cast from the DataType enum) and axis
+inline int sessionChannel(int data_type, int axis) { return data_type * SESSION_AXES + axis; }
+
+//Because the store wraps around, a range of samples for a single channel can be split in
+//two pieces. The first piece always holds the older samples.
+template <typename T>
+struct SessionSpan
+{
+	const T* first;
+	size_t first_length;
+	const T* second;
+	size_t second_length;
+
+	size_t size() const { return first_length + second_length; }
+	T operator[](size_t i) const { return (i < first_length) ? first[i] : second[i - first_length]; }
+};
+
+typedef SessionSpan<float> SessionChannelSpan;
+typedef SessionSpan<double> SessionTimeSpan; //time stamps are kept as doubles so long sessions don't lose precision
+
+class SessionDataStore;
+
+/*
+* A read-only window into the session data store covering the samples [begin, end). Views don't
+* copy any data. A view stays valid until the samples it covers get overwritten, which happens
+* once the store has had more than its capacity worth of samples written after them. Since the
+* writer doesn't wait for readers, anything read through a view should be checked with intact()
+* afterwards. If it returns false the writer got to some of the samples while they were being
+* read and the values can't be trusted.
+*/
+class SessionView
+{
+public:
+	SessionView() : p_store(nullptr), m_begin(0), m_end(0) {}
+	SessionView(const SessionDataStore* store, uint64_t begin, uint64_t end) : p_store(store), m_begin(begin), m_end(end) {}
+
+	uint64_t begin() const { return m_begin; }
+	uint64_t end() const { return m_end; }
+	size_t size() const { return (size_t)(m_end - m_begin); }
+	bool empty() const { return m_end == m_begin; }
+
+	SessionChannelSpan channel(int channel) const;
+	SessionTimeSpan timeSpan() const;
+	float at(int channel, size_t i) const;
+	double timeAt(size_t i) const;
+	bool intact() const;
+
+private:
+	const SessionDataStore* p_store;
+	uint64_t m_begin, m_end;
+};
+
+/*
+* Fixed size, cache aligned ring buffer holding all data for a session. Samples are addressed by their
+* absolute sample number (the first sample ever appended is sample 0) so that modes can remember where a
+* recording started and come back for it later. Memory is allocated once up front, appending data never
+* allocates. The store is written to by a single thread (the BLE notification thread) while
+* any number of threads can read from it.
+*
+* Time stamps form a single timeline for the whole session that never goes backwards, so findSample()
+* can binary search it. Every new stream of data from the Personal Caddie starts its clock over at 0,
+* so the writer calls startSegment() before appending the first data set of a new stream and the store
+* shifts that stream's time stamps to carry on from where the last one left off.
+*/
+class SessionDataStore
+{
+public:
+	SessionDataStore(size_t memory_budget = SESSION_DEFAULT_MEMORY_BUDGET);
+
+	void startSegment();
+	uint64_t append(const float* const* channel_data, const double* time_stamps, int samples);
+	double sessionTime(double stream_time) const { return stream_time + m_timeOffset; } //only meaningful on the writing thread
+
+	size_t capacity() const { return m_capacity; }
+	uint64_t oldestSample() const;
+	uint64_t newestSample() const { return m_written.load(std::memory_order_acquire); } //one past the most recently written sample
+
+	SessionView view(uint64_t begin, uint64_t end) const;
+	SessionView latest(int samples) const;
+	uint64_t findSample(double time_stamp) const;
+	uint64_t segmentStart() const { return m_segmentStart.load(std::memory_order_acquire); } //first sample of the current stream
+
+private:
+	friend class SessionView;
+
+	template <typename T>
+	SessionSpan<T> span(const T* channel_start, uint64_t begin, uint64_t end) const;
+	const float* channelStart(int channel) const { return p_data + channel * m_stride; }
+	const double* timeStart() const { return p_time; }
+
+	std::unique_ptr<float[]> m_allocation;
+	float* p_data; //the first cache aligned float of m_allocation
+	double* p_time; //time stamps, stored after the last channel
+	size_t m_capacity; //number of samples held by each channel, always a power of 2
+	size_t m_stride; //distance in floats between the start of consecutive channels
+	std::atomic<uint64_t> m_reserved; //one past the newest sample that may be partially written, set before the data is touched
+	std::atomic<uint64_t> m_written; //total samples written, published after the data itself is written
+	std::atomic<uint64_t> m_segmentStart;
+
+	bool m_segmentPending; //the next append starts a new segment
+	double m_timeOffset; //added to the time stamps of the current segment
+	double m_lastTime; //newest time stamp in the store
+};
@@ -0,0 +1,489 @@
+#include "SessionFile.h"
+
+#include <chrono>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "CompositeDataDecoder.h"
+
+namespace
+{
+    size_t chunkSize(uint32_t samples, uint32_t packets)
+    {
+        //Chunks are padded out to a multiple of 8 bytes so the next chunk header stays aligned
+        size_t size = sizeof(SessionFileChunkHeader) + packets * sizeof(SessionFilePacket) + SESSION_FILE_CHANNELS * samples * sizeof(int16_t);
+        return (size + 7) & ~(size_t)7;
+    }
+}
+
+void initializeSessionFileHeader(SessionFileHeader& header)
+{
+    memset(&header, 0, sizeof(header));
+    header.magic = SESSION_FILE_MAGIC;
+    header.version = SESSION_FILE_VERSION;
+    header.header_size = sizeof(SessionFileHeader);
+
+    for (int sensor = 0; sensor < SESSION_FILE_SENSORS; sensor++)
+    {
+        header.conversion_rates[sensor] = 1.0f;
+        for (int axis = 0; axis < SESSION_FILE_AXES; axis++)
+        {
+            header.axis_swap[sensor][axis] = axis;
+            header.axis_polarity[sensor][axis] = 1;
+            for (int column = 0; column < SESSION_FILE_AXES; column++) header.calibration_gains[sensor][axis][column] = (axis == column) ? 1.0f : 0.0f;
+        }
+    }
+}
+
+//Session File Writer
+SessionFileWriter::SessionFileWriter() :
+    p_file(nullptr), m_open(false), m_appending(false), p_chunk(nullptr), m_dropping(false), m_samples(0), m_packets(0),
+    m_lastTick(0), m_lastTimerTicks(0), m_droppedChunks(0), m_writerRunning(false), m_chunksWritten(0), m_writeError(false)
+{
+    initializeSessionFileHeader(m_header);
+}
+
+SessionFileWriter::~SessionFileWriter()
+{
+    close();
+}
+
+bool SessionFileWriter::open(const char* file_location, SessionFileHeader const& header)
+{
+    if (isOpen()) return false;
+    return start(fopen(file_location, "wb"), header);
+}
+
+#ifdef _WIN32
+bool SessionFileWriter::open(const wchar_t* file_location, SessionFileHeader const& header)
+{
+    if (isOpen()) return false;
+    return start(_wfopen(file_location, L"wb"), header);
+}
+#endif
+
+bool SessionFileWriter::start(FILE* file, SessionFileHeader const& header)
+{
+    if (file == nullptr) return false;
+
+    //The header gets written right away with the totals set to 0 and then gets
+    //rewritten with the real totals when the file is closed
+    m_header = header;
+    m_header.magic = SESSION_FILE_MAGIC;
+    m_header.version = SESSION_FILE_VERSION;
+    m_header.header_size = sizeof(SessionFileHeader);
+    m_header.samples = m_header.packets = 0;
+    m_header.chunks = m_header.dropped_chunks = 0;
+    if (fwrite(&m_header, sizeof(m_header), 1, file) != 1)
+    {
+        fclose(file);
+        return false;
+    }
+
+    p_file = file;
+    p_chunk = nullptr;
+    m_dropping = false;
+    m_samples = m_packets = 0;
+    m_lastTick = 0;
+    m_lastTimerTicks = 0;
+    m_droppedChunks = 0;
+    m_chunksWritten = 0;
+    m_writeError = false;
+
+    m_writerRunning.store(true, std::memory_order_release);
+    m_writer = std::thread(&SessionFileWriter::writerThread, this);
+
+    m_open.store(true, std::memory_order_seq_cst);
+    return true;
+}
+
+int SessionFileWriter::append(const uint8_t* notification, size_t length)
+{
+    //Let close() know that an append is in progress before checking if the file is still open. Both of these
+    //use sequential consistency so that close() can never miss an append that's about to use the chunk.
+    m_appending.store(true, std::memory_order_seq_cst);
+    if (!m_open.load(std::memory_order_seq_cst))
+    {
+        m_appending.store(false, std::memory_order_release);
+        return 0;
+    }
+
+    CompositePacketHeader notification_header;
+    CompositeDataDecoder::readHeader(notification, length, notification_header);
+    uint32_t timer_ticks = notification_header.timer_ticks;
+    int samples = notification_header.samples;
+
+    //Session files hold sensor readings, notifications with fused samples don't have any so they can't be saved
+    if (samples <= 0 || notification_header.fused)
+    {
+        m_appending.store(false, std::memory_order_release);
+        return 0;
+    }
+
+    //Timer ticks wrap around about every 4.5 minutes, keep a 64-bit version that doesn't
+    uint64_t tick = (m_packets == 0) ? timer_ticks : m_lastTick + (uint32_t)(timer_ticks - m_lastTimerTicks);
+
+    //Start a new chunk if this packet won't fit in the current one. A chunk also never spans more than half of
+    //the range of the 32-bit timer so readers can unwrap the time stamps inside of it without any extra information.
+    if (p_chunk != nullptr && (p_chunk->header.samples + samples > SESSION_FILE_CHUNK_SAMPLES || p_chunk->header.packets >= SESSION_FILE_CHUNK_PACKETS ||
+        tick - p_chunk->header.first_tick >= 0x80000000ull)) finishChunk();
+
+    if (p_chunk == nullptr)
+    {
+        //Chunks are filled in place inside of the queue so nothing has to be copied when they're handed off. If
+        //the queue is full the chunk is built in the overflow slot instead and gets dropped once it's finished.
+        p_chunk = m_queue.beginPush();
+        m_dropping = (p_chunk == nullptr);
+        if (m_dropping) p_chunk = &m_overflow;
+
+        p_chunk->header.magic = SESSION_FILE_CHUNK_MAGIC;
+        p_chunk->header.first_sample = m_samples;
+        p_chunk->header.first_tick = tick;
+        p_chunk->header.samples = 0;
+        p_chunk->header.packets = 0;
+    }
+
+    //De-interleave (or unpack) the readings straight into their columns. Packed notifications always get saved
+    //unpacked so readers of the file never need to know how the data was sent.
+    Chunk& chunk = *p_chunk;
+    const uint32_t first = chunk.header.samples;
+    samples = CompositeDataDecoder::readSamples(notification, length, notification_header, &chunk.channels[0][first], SESSION_FILE_CHUNK_SAMPLES);
+    if (samples <= 0)
+    {
+        m_appending.store(false, std::memory_order_release);
+        return 0;
+    }
+
+    SessionFilePacket& packet = chunk.packets[chunk.header.packets++];
+    packet.timer_ticks = timer_ticks;
+    packet.first_sample = (uint16_t)first;
+    packet.samples = (uint16_t)samples;
+    chunk.header.samples += samples;
+
+    m_samples += samples;
+    m_packets++;
+    m_lastTick = tick;
+    m_lastTimerTicks = timer_ticks;
+
+    m_appending.store(false, std::memory_order_release);
+    return samples;
+}
+
+void SessionFileWriter::finishChunk()
+{
+    if (p_chunk == nullptr) return;
+
+    if (m_dropping) m_droppedChunks++;
+    else
+    {
+        p_chunk->header.chunk_size = (uint32_t)chunkSize(p_chunk->header.samples, p_chunk->header.packets);
+        m_queue.endPush();
+        m_wake.notify_one(); //doesn't need the mutex, the writer thread also wakes up on its own every so often
+    }
+
+    p_chunk = nullptr;
+}
+
+void SessionFileWriter::close()
+{
+    if (!m_open.load(std::memory_order_seq_cst)) return;
+
+    //Stop any new appends from starting and wait for one that might be in progress to finish
+    m_open.store(false, std::memory_order_seq_cst);
+    while (m_appending.load(std::memory_order_seq_cst)) std::this_thread::yield();
+
+    //Hand off whatever is left in the current chunk and let the writer thread empty the queue
+    finishChunk();
+    m_writerRunning.store(false, std::memory_order_release);
+    m_wake.notify_one();
+    if (m_writer.joinable()) m_writer.join();
+
+    //Now that everything is written, go back and fill in the totals in the header
+    m_header.samples = m_samples;
+    m_header.packets = m_packets;
+    m_header.chunks = m_chunksWritten;
+    m_header.dropped_chunks = m_droppedChunks;
+    if (fseek(p_file, 0, SEEK_SET) == 0) fwrite(&m_header, sizeof(m_header), 1, p_file);
+
+    fclose(p_file);
+    p_file = nullptr;
+}
+
+void SessionFileWriter::writerThread()
+{
+    while (true)
+    {
+        while (Chunk* chunk = m_queue.front())
+        {
+            //After a write error the queue still gets emptied so the notification thread doesn't get stuck dropping data
+            if (!m_writeError)
+            {
+                if (writeChunk(*chunk)) m_chunksWritten++;
+                else m_writeError = true;
+            }
+            m_queue.pop();
+        }
+
+        if (!m_writerRunning.load(std::memory_order_acquire) && m_queue.front() == nullptr) break;
+
+        std::unique_lock<std::mutex> lock(m_wakeMutex);
+        m_wake.wait_for(lock, std::chrono::milliseconds(50));
+    }
+}
+
+bool SessionFileWriter::writeChunk(Chunk const& chunk)
+{
+    //Only the parts of the chunk that are actually used get written, so each column is written separately
+    const uint32_t samples = chunk.header.samples, packets = chunk.header.packets;
+    if (fwrite(&chunk.header, sizeof(chunk.header), 1, p_file) != 1) return false;
+    if (fwrite(chunk.packets, sizeof(SessionFilePacket), packets, p_file) != packets) return false;
+    for (int channel = 0; channel < SESSION_FILE_CHANNELS; channel++)
+    {
+        if (fwrite(chunk.channels[channel], sizeof(int16_t), samples, p_file) != samples) return false;
+    }
+
+    const uint8_t padding[8] = {};
+    size_t padding_length = chunk.header.chunk_size - (sizeof(SessionFileChunkHeader) + packets * sizeof(SessionFilePacket) + SESSION_FILE_CHANNELS * samples * sizeof(int16_t));
+    return padding_length == 0 || fwrite(padding, 1, padding_length, p_file) == padding_length;
+}
+
+//Session File Reader
+SessionFileReader::SessionFileReader() :
+    p_data(nullptr), m_size(0), m_samples(0), p_fileHandle(nullptr), p_mappingHandle(nullptr), m_fileDescriptor(-1)
+{
+}
+
+SessionFileReader::~SessionFileReader()
+{
+    close();
+}
+
+#ifdef _WIN32
+bool SessionFileReader::open(const char* file_location)
+{
+    //Windows needs wide strings for file names, treat the name as UTF-8
+    int length = MultiByteToWideChar(CP_UTF8, 0, file_location, -1, nullptr, 0);
+    if (length <= 0) return false;
+    std::vector<wchar_t> wide_location(length);
+    MultiByteToWideChar(CP_UTF8, 0, file_location, -1, wide_location.data(), length);
+    return open(wide_location.data());
+}
+
+bool SessionFileReader::open(const wchar_t* file_location)
+{
+    //The FromApp versions of the mapping functions work for both UWP and desktop apps
+    close();
+
+    HANDLE file = CreateFile2(file_location, GENERIC_READ, FILE_SHARE_READ, OPEN_EXISTING, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    p_fileHandle = file;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart < (LONGLONG)sizeof(SessionFileHeader))
+    {
+        close();
+        return false;
+    }
+    m_size = (size_t)size.QuadPart;
+
+    HANDLE mapping = CreateFileMappingFromApp(file, nullptr, PAGE_READONLY, 0, nullptr);
+    if (mapping == nullptr)
+    {
+        close();
+        return false;
+    }
+    p_mappingHandle = mapping;
+
+    p_data = static_cast<const uint8_t*>(MapViewOfFileFromApp(mapping, FILE_MAP_READ, 0, 0));
+    if (p_data == nullptr || !buildIndex())
+    {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void SessionFileReader::close()
+{
+    if (p_data != nullptr) UnmapViewOfFile(p_data);
+    if (p_mappingHandle != nullptr) CloseHandle(p_mappingHandle);
+    if (p_fileHandle != nullptr) CloseHandle(p_fileHandle);
+
+    p_data = nullptr;
+    p_mappingHandle = p_fileHandle = nullptr;
+    m_size = 0;
+    m_samples = 0;
+    m_chunks.clear();
+}
+#else
+bool SessionFileReader::open(const char* file_location)
+{
+    close();
+
+    m_fileDescriptor = ::open(file_location, O_RDONLY);
+    if (m_fileDescriptor < 0) return false;
+
+    struct stat file_information;
+    if (fstat(m_fileDescriptor, &file_information) != 0 || file_information.st_size < (off_t)sizeof(SessionFileHeader))
+    {
+        close();
+        return false;
+    }
+    m_size = (size_t)file_information.st_size;
+
+    void* mapping = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, m_fileDescriptor, 0);
+    if (mapping == MAP_FAILED)
+    {
+        close();
+        return false;
+    }
+    p_data = static_cast<const uint8_t*>(mapping);
+
+    if (!buildIndex())
+    {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void SessionFileReader::close()
+{
+    if (p_data != nullptr) munmap(const_cast<uint8_t*>(p_data), m_size);
+    if (m_fileDescriptor >= 0) ::close(m_fileDescriptor);
+
+    p_data = nullptr;
+    m_fileDescriptor = -1;
+    m_size = 0;
+    m_samples = 0;
+    m_chunks.clear();
+}
+#endif
+
+bool SessionFileReader::buildIndex()
+{
+    SessionFileHeader const& file_header = header();
+    if (file_header.magic != SESSION_FILE_MAGIC || file_header.version != SESSION_FILE_VERSION || file_header.header_size < sizeof(SessionFileHeader)) return false;
+
+    //Walk the chunk headers. This also works for files that were never closed properly (so the totals in the header
+    //weren't filled in), anything after the last complete chunk is ignored.
+    size_t offset = file_header.header_size;
+    m_samples = 0;
+    while (offset + sizeof(SessionFileChunkHeader) <= m_size)
+    {
+        const SessionFileChunkHeader* chunk_header = reinterpret_cast<const SessionFileChunkHeader*>(p_data + offset);
+        if (chunk_header->magic != SESSION_FILE_CHUNK_MAGIC || chunk_header->samples > SESSION_FILE_CHUNK_SAMPLES || chunk_header->packets > SESSION_FILE_CHUNK_PACKETS) break;
+        if (chunk_header->chunk_size < chunkSize(chunk_header->samples, chunk_header->packets) || offset + chunk_header->chunk_size > m_size) break;
+
+        m_chunks.push_back({ offset, chunk_header->first_sample, chunk_header->first_tick });
+        m_samples = chunk_header->first_sample + chunk_header->samples;
+        offset += chunk_header->chunk_size;
+    }
+
+    return true;
+}
+
+SessionFileChunkView SessionFileReader::chunk(size_t index) const
+{
+    const uint8_t* start = p_data + m_chunks[index].offset;
+    const SessionFileChunkHeader* chunk_header = reinterpret_cast<const SessionFileChunkHeader*>(start);
+
+    SessionFileChunkView view;
+    view.first_sample = chunk_header->first_sample;
+    view.first_tick = chunk_header->first_tick;
+    view.samples = chunk_header->samples;
+    view.packets = chunk_header->packets;
+    view.packet = reinterpret_cast<const SessionFilePacket*>(start + sizeof(SessionFileChunkHeader));
+
+    const int16_t* columns = reinterpret_cast<const int16_t*>(start + sizeof(SessionFileChunkHeader) + view.packets * sizeof(SessionFilePacket));
+    for (int channel = 0; channel < SESSION_FILE_CHANNELS; channel++) view.channel[channel] = columns + channel * view.samples;
+
+    return view;
+}
+
+size_t SessionFileReader::findChunk(uint64_t sample) const
+{
+    //Binary search for the last chunk that starts at or before the sample
+    size_t low = 0, high = m_chunks.size();
+    while (high - low > 1)
+    {
+        size_t middle = low + (high - low) / 2;
+        if (m_chunks[middle].first_sample <= sample) low = middle;
+        else high = middle;
+    }
+    return low;
+}
+
+int16_t SessionFileReader::reading(uint64_t sample, int channel) const
+{
+    if (sample >= m_samples) return 0;
+
+    SessionFileChunkView view = chunk(findChunk(sample));
+    return view.channel[channel][sample - view.first_sample];
+}
+
+uint64_t SessionFileReader::sampleTick(uint64_t sample) const
+{
+    //Only the first sample of each packet has a time stamp. The rest are spaced out by the ODR, just like the
+    //Personal Caddie class does with live data.
+    if (m_chunks.empty()) return 0;
+    if (sample >= m_samples) sample = m_samples - 1;
+
+    SessionFileChunkView view = chunk(findChunk(sample));
+    uint32_t sample_in_chunk = (uint32_t)(sample - view.first_sample);
+
+    uint32_t low = 0, high = view.packets;
+    while (high - low > 1)
+    {
+        uint32_t middle = low + (high - low) / 2;
+        if (view.packet[middle].first_sample <= sample_in_chunk) low = middle;
+        else high = middle;
+    }
+
+    SessionFilePacket const& packet = view.packet[low];
+    uint64_t packet_tick = view.first_tick + (uint32_t)(packet.timer_ticks - view.packet[0].timer_ticks);
+    float odr = header().odr;
+    uint64_t offset = (odr > 0.0f) ? (uint64_t)((sample_in_chunk - packet.first_sample) * (SESSION_FILE_TICK_FREQUENCY / odr) + 0.5) : 0;
+
+    return packet_tick + offset;
+}
+
+uint64_t SessionFileReader::findSample(double time) const
+{
+    //Returns the first sample recorded at or after the given time (in seconds of the Personal Caddie clock). Time stamps
+    //only ever increase so this is a binary search over the chunks and then over the samples inside of the chunk.
+    if (m_chunks.empty()) return 0;
+    if (time <= 0.0) return 0;
+
+    uint64_t tick = (uint64_t)(time * SESSION_FILE_TICK_FREQUENCY + 0.5);
+
+    size_t low_chunk = 0, high_chunk = m_chunks.size();
+    while (high_chunk - low_chunk > 1)
+    {
+        size_t middle = low_chunk + (high_chunk - low_chunk) / 2;
+        if (m_chunks[middle].first_tick <= tick) low_chunk = middle;
+        else high_chunk = middle;
+    }
+
+    uint64_t low = m_chunks[low_chunk].first_sample;
+    uint64_t high = (low_chunk + 1 < m_chunks.size()) ? m_chunks[low_chunk + 1].first_sample + 1 : m_samples;
+    if (high > m_samples) high = m_samples;
+    while (low < high)
+    {
+        uint64_t middle = low + (high - low) / 2;
+        if (sampleTick(middle) < tick) low = middle + 1;
+        else high = middle;
+    }
+
+    return low;
+}
@@ -0,0 +1,209 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "SpscQueue.h"
+
+//Binary session files hold the composite characteristic data exactly as it arrives from the Personal Caddie: the raw
+//int16 sensor readings and the 16 MHz timer ticks of each packet. Nothing gets converted or calibrated before it's
+//saved, instead the header holds everything needed to do that later (the IMU settings array, conversion rates, axis
+//orientations and calibration numbers). The layout of a file is:
+//
+//  SessionFileHeader
+//  chunk 0: SessionFileChunkHeader, SessionFilePacket[packets], int16 acc_x[samples], acc_y[samples], ... mag_z[samples]
+//  chunk 1: ...
+//
+//Inside of each chunk every sensor axis is stored as its own column so a reader that only cares about a single axis
+//(like a graph) only touches the memory for that axis. All numbers are little endian, which is what the nRF52840 and
+//every platform the app runs on use, so the structs below are written and mapped directly.
+#define SESSION_FILE_MAGIC            0x46534350 //"PCSF"
+#define SESSION_FILE_CHUNK_MAGIC      0x4B434350 //"PCCK"
+#define SESSION_FILE_VERSION          1
+#define SESSION_FILE_SETTINGS_LENGTH  32 //matches SENSOR_SETTINGS_LENGTH in sensor_settings.h
+#define SESSION_FILE_SENSORS          3
+#define SESSION_FILE_AXES             3
+#define SESSION_FILE_CHANNELS         (SESSION_FILE_SENSORS * SESSION_FILE_AXES) //same order as the composite characteristic
+#define SESSION_FILE_CHUNK_SAMPLES    4096 //about 10 seconds of data at 400 Hz
+#define SESSION_FILE_CHUNK_PACKETS    512
+#define SESSION_FILE_WRITE_QUEUE_SIZE 8
+#define SESSION_FILE_TICK_FREQUENCY   16000000.0 //the timer on the Personal Caddie runs at 16 MHz
+
+struct SessionFileHeader
+{
+	uint32_t magic;
+	uint16_t version;
+	uint16_t header_size;
+	uint64_t samples; //filled in when the file is closed, if it's 0 the reader counts the chunks instead
+	uint64_t packets;
+	uint32_t chunks;
+	uint32_t dropped_chunks; //chunks that were thrown away because the disk couldn't keep up
+	float odr; //the sample rate of the data in Hz
+
+	uint8_t imu_settings[SESSION_FILE_SETTINGS_LENGTH];
+	float conversion_rates[SESSION_FILE_SENSORS];
+	int32_t axis_swap[SESSION_FILE_SENSORS][SESSION_FILE_AXES];
+	int32_t axis_polarity[SESSION_FILE_SENSORS][SESSION_FILE_AXES];
+	float calibration_offsets[SESSION_FILE_SENSORS][SESSION_FILE_AXES];
+	float calibration_gains[SESSION_FILE_SENSORS][SESSION_FILE_AXES][SESSION_FILE_AXES];
+
+	uint8_t reserved[24];
+};
+static_assert(sizeof(SessionFileHeader) == 320, "The session file header layout must not change");
+
+struct SessionFileChunkHeader
+{
+	uint32_t magic;
+	uint32_t chunk_size; //in bytes, including this header
+	uint64_t first_sample; //sample number of the first sample in the chunk
+	uint64_t first_tick; //time stamp of the first packet in the chunk, unwrapped to 64 bits
+	uint32_t samples;
+	uint32_t packets;
+};
+static_assert(sizeof(SessionFileChunkHeader) == 32, "The session file chunk header layout must not change");
+
+//One entry for each composite characteristic notification
+struct SessionFilePacket
+{
+	uint32_t timer_ticks; //exactly as sent by the Personal Caddie
+	uint16_t first_sample; //relative to the start of the chunk
+	uint16_t samples;
+};
+static_assert(sizeof(SessionFilePacket) == 8, "The session file packet layout must not change");
+
+//Fills in the parts of the header that don't depend on the device, identity calibration
+//numbers and axis orientations are used until they get overwritten.
+void initializeSessionFileHeader(SessionFileHeader& header);
+
+/*
+* Writes a session file from composite characteristic notifications. append() is meant to be called directly from the
+* BLE notification thread so it never waits on the disk. Notifications are de-interleaved straight into a chunk that
+* lives inside of a lock-free queue, and once the chunk is full it gets handed to a background thread that writes it
+* out. If the disk falls so far behind that the queue fills up then chunks get dropped (and counted) rather than
+* holding up the notification thread. append() and close() can safely be called from different threads.
+*/
+class SessionFileWriter
+{
+public:
+	SessionFileWriter();
+	~SessionFileWriter();
+	SessionFileWriter(SessionFileWriter const&) = delete;
+	SessionFileWriter& operator=(SessionFileWriter const&) = delete;
+
+	bool open(const char* file_location, SessionFileHeader const& header);
+#ifdef _WIN32
+	bool open(const wchar_t* file_location, SessionFileHeader const& header);
+#endif
+	int append(const uint8_t* notification, size_t length);
+	void close();
+
+	bool isOpen() const { return m_open.load(std::memory_order_acquire); }
+	uint64_t samples() const { return m_samples; }
+	uint32_t droppedChunks() const { return m_droppedChunks; }
+
+private:
+	struct Chunk
+	{
+		SessionFileChunkHeader header;
+		SessionFilePacket packets[SESSION_FILE_CHUNK_PACKETS];
+		int16_t channels[SESSION_FILE_CHANNELS][SESSION_FILE_CHUNK_SAMPLES];
+	};
+
+	bool start(FILE* file, SessionFileHeader const& header);
+	void finishChunk();
+	void writerThread();
+	bool writeChunk(Chunk const& chunk);
+
+	FILE* p_file;
+	SessionFileHeader m_header;
+	std::atomic<bool> m_open;
+	std::atomic<bool> m_appending; //set while append() is running so close() knows when it's safe to finish
+
+	//Only touched by the notification thread (or by close() once append() can no longer run)
+	Chunk* p_chunk; //the chunk currently being filled, either a queue slot or m_overflow
+	bool m_dropping; //the queue was full when the current chunk was started
+	uint64_t m_samples;
+	uint64_t m_packets;
+	uint64_t m_lastTick;
+	uint32_t m_lastTimerTicks;
+	uint32_t m_droppedChunks;
+
+	//Background writing
+	SpscQueue<Chunk, SESSION_FILE_WRITE_QUEUE_SIZE> m_queue;
+	Chunk m_overflow;
+	std::thread m_writer;
+	std::mutex m_wakeMutex;
+	std::condition_variable m_wake;
+	std::atomic<bool> m_writerRunning;
+	uint32_t m_chunksWritten; //only touched by the writer thread until it's joined
+	bool m_writeError;
+};
+
+//A read-only window into one chunk of a mapped session file. Every pointer points directly into the file mapping.
+struct SessionFileChunkView
+{
+	uint64_t first_sample;
+	uint64_t first_tick;
+	uint32_t samples;
+	uint32_t packets;
+	const SessionFilePacket* packet;
+	const int16_t* channel[SESSION_FILE_CHANNELS];
+};
+
+/*
+* Memory maps a session file for zero-copy reading. Opening a file only reads the header and walks the chunk headers
+* to build a small index, none of the sample data is touched until it's used. Samples can be looked up by number or
+* by time.
+*/
+class SessionFileReader
+{
+public:
+	SessionFileReader();
+	~SessionFileReader();
+	SessionFileReader(SessionFileReader const&) = delete;
+	SessionFileReader& operator=(SessionFileReader const&) = delete;
+
+	bool open(const char* file_location);
+#ifdef _WIN32
+	bool open(const wchar_t* file_location);
+#endif
+	void close();
+
+	bool isOpen() const { return p_data != nullptr; }
+	SessionFileHeader const& header() const { return *reinterpret_cast<const SessionFileHeader*>(p_data); }
+	uint64_t samples() const { return m_samples; }
+	size_t chunks() const { return m_chunks.size(); }
+	SessionFileChunkView chunk(size_t index) const;
+
+	int16_t reading(uint64_t sample, int channel) const;
+	uint64_t sampleTick(uint64_t sample) const;
+	double sampleTime(uint64_t sample) const { return sampleTick(sample) / SESSION_FILE_TICK_FREQUENCY; }
+	uint64_t findSample(double time) const; //returns samples() if time is past the end of the file
+
+private:
+	struct ChunkIndex
+	{
+		size_t offset;
+		uint64_t first_sample;
+		uint64_t first_tick;
+	};
+
+	bool buildIndex();
+	size_t findChunk(uint64_t sample) const;
+
+	const uint8_t* p_data;
+	size_t m_size;
+	uint64_t m_samples;
+	std::vector<ChunkIndex> m_chunks;
+
+	//Platform specific handles for the mapping
+	void* p_fileHandle;
+	void* p_mappingHandle;
+	int m_fileDescriptor;
+};
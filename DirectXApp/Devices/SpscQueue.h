@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+//Keeps the producer and consumer indices on separate cache lines so the two threads don't fight over them
+#define SPSC_CACHE_LINE_SIZE 64
+
+/*
+* A bounded, lock-free, single-producer/single-consumer queue. Exactly one thread may push and exactly one
+* (other) thread may pop. Slots are allocated once when the queue is created and are filled and read in place,
+* so nothing gets copied or allocated when moving data from one thread to the other:
+*
+*   Producer:  T* slot = queue.beginPush(); if (slot) { ...fill slot...; queue.endPush(); }
+*   Consumer:  while (T* slot = queue.front()) { ...read slot...; queue.pop(); }
+*
+* When the queue is full beginPush() returns nullptr and the overrun counter is incremented, the producer never
+* waits on the consumer. Likewise, front() returns nullptr when the queue is empty so the consumer never waits
+* on the producer.
+*/
+template <typename T, size_t Capacity>
+class SpscQueue
+{
+	static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "SpscQueue capacity must be a power of 2");
+
+public:
+	SpscQueue() : m_head(0), m_tail(0), m_overruns(0), m_highWaterMark(0) {}
+	SpscQueue(SpscQueue const&) = delete;
+	SpscQueue& operator=(SpscQueue const&) = delete;
+
+	//Producer methods
+	T* beginPush()
+	{
+		size_t tail = m_tail.load(std::memory_order_relaxed);
+		if (tail - m_head.load(std::memory_order_acquire) >= Capacity)
+		{
+			m_overruns.fetch_add(1, std::memory_order_relaxed);
+			return nullptr;
+		}
+		return &m_slots[tail & (Capacity - 1)];
+	}
+
+	void endPush()
+	{
+		size_t tail = m_tail.load(std::memory_order_relaxed) + 1;
+		m_tail.store(tail, std::memory_order_release); //publishes the contents of the slot to the consumer
+
+		size_t depth = tail - m_head.load(std::memory_order_relaxed);
+		if (depth > m_highWaterMark.load(std::memory_order_relaxed)) m_highWaterMark.store(depth, std::memory_order_relaxed);
+	}
+
+	//Consumer methods
+	T* front()
+	{
+		size_t head = m_head.load(std::memory_order_relaxed);
+		if (head == m_tail.load(std::memory_order_acquire)) return nullptr;
+		return &m_slots[head & (Capacity - 1)];
+	}
+
+	void pop()
+	{
+		m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release); //hands the slot back to the producer
+	}
+
+	//Statistics, these can be read from either thread
+	size_t capacity() const { return Capacity; }
+	size_t size() const { return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire); }
+	uint64_t pushed() const { return m_tail.load(std::memory_order_acquire); }
+	uint64_t popped() const { return m_head.load(std::memory_order_acquire); }
+	uint64_t overruns() const { return m_overruns.load(std::memory_order_relaxed); }
+	size_t highWaterMark() const { return m_highWaterMark.load(std::memory_order_relaxed); }
+
+	//Slots are pre-allocated, this allows them to be set up (i.e. sizing any vectors they hold) before the
+	//queue is used. Must not be called once the producer and consumer are running.
+	template <typename Function>
+	void initializeSlots(Function function) { for (size_t i = 0; i < Capacity; i++) function(m_slots[i]); }
+
+private:
+	alignas(SPSC_CACHE_LINE_SIZE) std::atomic<size_t> m_head; //next slot to be read, only written by the consumer
+	alignas(SPSC_CACHE_LINE_SIZE) std::atomic<size_t> m_tail; //next slot to be written, only written by the producer
+	std::atomic<uint64_t> m_overruns; //number of pushes that were dropped because the queue was full
+	std::atomic<size_t> m_highWaterMark; //the largest number of items that have been in the queue at once
+	alignas(SPSC_CACHE_LINE_SIZE) T m_slots[Capacity];
+};
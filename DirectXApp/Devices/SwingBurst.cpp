@@ -0,0 +1,183 @@
+#include "SwingBurst.h"
+
+#include <algorithm>
+
+static uint16_t readUint16(const uint8_t* buffer)
+{
+    return (uint16_t)(buffer[0] | (buffer[1] << 8));
+}
+
+static uint32_t readUint32(const uint8_t* buffer)
+{
+    return (uint32_t)buffer[0] | ((uint32_t)buffer[1] << 8) | ((uint32_t)buffer[2] << 16) | ((uint32_t)buffer[3] << 24);
+}
+
+void BurstAssembler::reset()
+{
+    //Called whenever a new stream of data starts, anything from the last one is forgotten
+    m_started = false;
+    m_lastFinished = false;
+    m_lastBurst = 0;
+    m_burst.receivedSamples = 0;
+}
+
+void BurstAssembler::flush()
+{
+    //Hands over the burst that's being put together, even if it isn't finished yet
+    finish();
+}
+
+int BurstAssembler::readHeader(const uint8_t* buffer, size_t length, BurstPacketHeader& header)
+{
+    //Reads the header at the front of a burst data notification and returns the number of samples it holds. Just
+    //like CompositeDataDecoder::readHeader() the sample count gets clamped so a malformed notification can never
+    //cause a write past the end of the window (or a read past the end of the notification for raw samples).
+    header = BurstPacketHeader();
+    if (buffer == nullptr || length < BURST_CAPTURE_HEADER_SIZE) return 0;
+
+    header.window_ticks = readUint32(buffer);
+    header.packed = (buffer[4] & SAMPLE_PACKING_PACKED_FLAG) != 0;
+    header.burst = buffer[5];
+    header.first_index = readUint16(buffer + 6);
+    header.window_samples = readUint16(buffer + 8);
+    header.trigger_index = readUint16(buffer + 10);
+    header.ticks_per_sample = readUint32(buffer + 12) / 256.0;
+
+    if (header.window_samples > BURST_CAPTURE_MAX_SAMPLES || header.first_index >= header.window_samples || header.trigger_index >= header.window_samples) return 0;
+
+    int samples = buffer[4] & SAMPLE_PACKING_COUNT_MASK;
+    int samples_in_window = header.window_samples - header.first_index;
+    int samples_in_buffer = header.packed ? SAMPLE_PACKING_MAX_SAMPLES : (int)((length - BURST_CAPTURE_HEADER_SIZE) / COMPOSITE_SAMPLE_SIZE);
+    samples = std::min(samples, std::min(samples_in_window, samples_in_buffer));
+    header.samples = samples;
+
+    return samples;
+}
+
+bool BurstAssembler::addPacket(const uint8_t* buffer, size_t length)
+{
+    //Puts the samples of a single notification into their place in the window. Returns true if a burst was handed
+    //over to the handler, either because this notification finished it or because it's the start of a new burst
+    //and the last one never got finished.
+    BurstPacketHeader header;
+    if (readHeader(buffer, length, header) <= 0)
+    {
+        m_stats.packets_ignored++;
+        return false;
+    }
+
+    bool handed_over = false;
+    if (m_started && (header.burst != m_burst.header.burst || header.window_ticks != m_burst.header.window_ticks))
+    {
+        finish();
+        handed_over = true;
+    }
+
+    if (!m_started)
+    {
+        if (m_lastFinished && header.burst == m_lastBurst)
+        {
+            m_stats.packets_ignored++;
+            return handed_over;
+        }
+
+        m_burst.header = header;
+        m_burst.receivedSamples = 0;
+        std::fill(m_burst.received.begin(), m_burst.received.begin() + header.window_samples, (uint8_t)0);
+        for (int channel = 0; channel < SWING_BURST_CHANNELS; channel++)
+        {
+            auto row = m_burst.readings.begin() + channel * BURST_CAPTURE_MAX_SAMPLES;
+            std::fill(row, row + header.window_samples, (int16_t)0);
+        }
+        m_started = true;
+        m_lastFinished = false;
+    }
+    else if (header.window_samples != m_burst.header.window_samples)
+    {
+        m_stats.packets_ignored++;
+        return handed_over;
+    }
+
+    //The samples are unpacked straight into the window
+    size_t payload = std::min(length - BURST_CAPTURE_HEADER_SIZE, (size_t)0xFFFF);
+    int samples = sample_packing_decode(buffer + BURST_CAPTURE_HEADER_SIZE, (uint16_t)payload, (uint8_t)header.samples, header.packed,
+        m_burst.readings.data() + header.first_index, BURST_CAPTURE_MAX_SAMPLES);
+    if (samples <= 0)
+    {
+        m_stats.packets_ignored++;
+        return handed_over;
+    }
+
+    m_stats.packets_received++;
+    for (int i = header.first_index; i < header.first_index + samples; i++)
+    {
+        if (m_burst.received[i]) continue;
+        m_burst.received[i] = 1;
+        m_burst.receivedSamples++;
+    }
+
+    if (m_burst.receivedSamples < m_burst.header.window_samples) return handed_over;
+
+    finish();
+    return true;
+}
+
+void BurstAssembler::finish()
+{
+    if (!m_started) return;
+
+    int missing = m_burst.missingSamples();
+    if (missing == 0) m_stats.bursts_complete++;
+    else
+    {
+        m_stats.bursts_incomplete++;
+        m_stats.samples_missing += missing;
+    }
+
+    m_started = false;
+    m_lastFinished = true;
+    m_lastBurst = m_burst.header.burst;
+    if (m_handler) m_handler(m_burst);
+}
+
+SwingBurst* SwingBurstStore::beginWrite()
+{
+    //The slot for the next burst, which is the one holding the oldest burst
+    uint64_t written = m_written.load(std::memory_order_relaxed);
+    SwingBurst* burst = &m_slots[written % m_slots.size()];
+    burst->number = written;
+    return burst;
+}
+
+void SwingBurstStore::endWrite()
+{
+    //Only publish the burst once it's been completely written
+    m_written.store(m_written.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+SwingBurst const* SwingBurstStore::burst(uint64_t number) const
+{
+    //Returns nullptr for bursts that haven't come in yet, or whose slot has been (or is about to be) reused
+    uint64_t written = count();
+    if (number >= written || written - number >= m_slots.size()) return nullptr;
+    return &m_slots[number % m_slots.size()];
+}
+
+SwingBurst const* SwingBurstStore::latest() const
+{
+    uint64_t written = count();
+    return (written > 0) ? burst(written - 1) : nullptr;
+}
+
+SwingBurst const* SwingBurstStore::find(double time_stamp) const
+{
+    //Returns the newest burst that covers the given time, or nullptr if there isn't one
+    uint64_t written = count();
+    for (uint64_t number = written; number > 0; number--)
+    {
+        SwingBurst const* swing_burst = burst(number - 1);
+        if (swing_burst == nullptr) break;
+        if (swing_burst->samples > 0 && time_stamp >= swing_burst->startTime() && time_stamp <= swing_burst->endTime()) return swing_burst;
+    }
+    return nullptr;
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <functional>
+#include <vector>
+
+#include "CompositeDataDecoder.h"
+#include "../../Firmware/nRF52840_Drivers/burst_capture.h"
+
+//A burst is a window of samples around a swing that the Personal Caddie captures at the full ODR of its sensors and
+//sends through its own characteristic while the live stream carries on (see burst_capture.h in the firmware for how
+//the window is caught and what each notification holds).
+#define SWING_BURST_CHANNELS           (COMPOSITE_SENSORS * COMPOSITE_AXES)
+#define SWING_BURST_SLOTS              8 //bursts kept around by the swing burst store
+
+//Everything held in the header of a single burst data notification
+struct BurstPacketHeader
+{
+	uint32_t window_ticks; //time stamp of the first sample in the window
+	uint8_t burst; //goes up by one for every burst, wraps around
+	int samples; //in this notification, clamped to what fits in the window
+	bool packed;
+	uint16_t first_index; //where the first sample of this notification goes in the window
+	uint16_t window_samples;
+	uint16_t trigger_index;
+	double ticks_per_sample;
+};
+
+//A burst window put back together from its notifications, but still in LSB. Readings are stored one row per sensor
+//axis, the reading for sample i of channel c is at readings[c * BURST_CAPTURE_MAX_SAMPLES + i].
+struct RawBurst
+{
+	RawBurst() : readings(SWING_BURST_CHANNELS * BURST_CAPTURE_MAX_SAMPLES, 0), received(BURST_CAPTURE_MAX_SAMPLES, 0) {}
+
+	BurstPacketHeader header = {};
+	std::vector<int16_t> readings;
+	std::vector<uint8_t> received; //1 for each sample of the window that made it over
+	int receivedSamples = 0;
+
+	int missingSamples() const { return header.window_samples - receivedSamples; }
+};
+
+//Running totals for the bursts coming from the Personal Caddie
+struct BurstStats
+{
+	uint64_t packets_received = 0;
+	uint64_t packets_ignored = 0; //malformed, duplicates, or from a burst that was already handed over
+	uint64_t bursts_complete = 0;
+	uint64_t bursts_incomplete = 0; //handed over with samples missing, usually because the connection dropped mid burst
+	uint64_t samples_missing = 0;
+};
+
+/*
+* Collects the notifications of the burst data characteristic into whole burst windows. Every notification says where
+* its samples go in the window so they can be put in place as they come in, and a burst is handed to the handler as
+* soon as every sample of its window has arrived. Notifications should never go missing within a connection, but if a
+* new burst starts before the last one was finished (or flush() gets called) the unfinished one is handed over anyway
+* with its missing samples marked. Nothing is allocated once the assembler has been created.
+*/
+class BurstAssembler
+{
+public:
+	BurstAssembler(std::function<void(RawBurst const&)> handler) : m_handler(handler) { reset(); }
+
+	void reset();
+	void flush();
+
+	static int readHeader(const uint8_t* buffer, size_t length, BurstPacketHeader& header);
+	bool addPacket(const uint8_t* buffer, size_t length);
+
+	BurstStats const& stats() const { return m_stats; }
+
+private:
+	void finish();
+
+	std::function<void(RawBurst const&)> m_handler;
+	RawBurst m_burst; //the burst that's currently being put together
+	bool m_started; //m_burst holds at least one notification
+	bool m_lastFinished; //the last burst was handed over, any more of its notifications are ignored
+	uint8_t m_lastBurst;
+	BurstStats m_stats;
+};
+
+//A burst window in real units, placed on the same timeline as the samples of the session data store
+struct SwingBurst
+{
+	SwingBurst() : times(BURST_CAPTURE_MAX_SAMPLES, 0.0)
+	{
+		for (int channel = 0; channel < SWING_BURST_CHANNELS; channel++) channels[channel].assign(BURST_CAPTURE_MAX_SAMPLES, 0.0f);
+	}
+
+	uint64_t number = 0; //counts every burst the store has been given
+	int samples = 0;
+	int triggerSample = 0; //the sample that set off the trigger on the Personal Caddie
+	int missingSamples = 0; //never arrived, their readings are taken as 0 LSB
+	float odr = 0.0f;
+	uint64_t firstSessionSample = 0; //the first sample in the session data store at, or after, the start of the burst
+
+	//Calibrated acceleration, rotation and magnetic readings, the channel for a sensor axis is sensor * 3 + axis
+	std::vector<float> channels[SWING_BURST_CHANNELS];
+	std::vector<double> times; //same time line as the time stamps in the session data store
+
+	float at(int sensor, int axis, int sample) const { return channels[sensor * COMPOSITE_AXES + axis][sample]; }
+	double startTime() const { return samples > 0 ? times[0] : 0.0; }
+	double endTime() const { return samples > 0 ? times[samples - 1] : 0.0; }
+	double triggerTime() const { return samples > 0 ? times[triggerSample] : 0.0; }
+};
+
+/*
+* Holds the most recent bursts of a session. Slots are allocated once up front and get reused oldest first, the same
+* way the session data store wraps around, so a burst being looked at stays valid until SWING_BURST_SLOTS - 1 newer
+* bursts have come in. The store is written to by a single thread (the BLE notification thread that handles the live
+* stream) while any number of threads can read from it.
+*/
+class SwingBurstStore
+{
+public:
+	SwingBurstStore(int slots = SWING_BURST_SLOTS) : m_slots(slots), m_written(0) {}
+
+	void clear() { m_written.store(0, std::memory_order_release); }
+
+	SwingBurst* beginWrite();
+	void endWrite();
+
+	uint64_t count() const { return m_written.load(std::memory_order_acquire); }
+	SwingBurst const* burst(uint64_t number) const;
+	SwingBurst const* latest() const;
+	SwingBurst const* find(double time_stamp) const;
+
+private:
+	std::vector<SwingBurst> m_slots;
+	std::atomic<uint64_t> m_written; //bursts written since the last clear, published after the burst itself is written
+};
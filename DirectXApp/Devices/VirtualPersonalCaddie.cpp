@@ -0,0 +1,410 @@
+#include "VirtualPersonalCaddie.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+
+#include "SessionFile.h"
+
+namespace
+{
+    const float PI = 3.14159265f;
+    const float LSB_PER_UNIT[COMPOSITE_SENSORS] = { VIRTUAL_ACC_LSB_PER_UNIT, VIRTUAL_GYR_LSB_PER_UNIT, VIRTUAL_MAG_LSB_PER_UNIT };
+
+    //The synthetic club sits at address with these angles and swings about the vertical axis
+    const float ADDRESS_ROLL = 90.0f * PI / 180.0f;
+    const float ADDRESS_PITCH = 45.0f * PI / 180.0f;
+    const float EARTH_FIELD[3] = { 22.0f, 0.0f, -42.0f }; //uT, pointing north and down
+
+    //One piece of a synthetic swing where the yaw angle moves from start_yaw to end_yaw along a half cosine,
+    //so the angular velocity starts and ends at 0. The club passes back over the ball half way through the downswing.
+    struct SwingSegment
+    {
+        float duration;
+        float start_yaw, end_yaw;
+    };
+
+    const SwingSegment swing_segments[] = {
+        { 3.0f, 0.0f, 0.0f },   //address
+        { 0.9f, 0.0f, 2.0f },   //backswing
+        { 0.1f, 2.0f, 2.0f },   //transition
+        { 0.25f, 2.0f, -2.0f }, //downswing and impact
+        { 1.0f, -2.0f, 0.0f },  //follow through and back to rest
+        { 1.0f, 0.0f, 0.0f }
+    };
+    const int swing_segment_count = sizeof(swing_segments) / sizeof(SwingSegment);
+
+    int16_t toReading(float value)
+    {
+        //The sensors saturate rather than wrap around
+        long lsb = lrintf(value);
+        return (int16_t)((lsb > 32767) ? 32767 : ((lsb < -32768) ? -32768 : lsb));
+    }
+
+    void writeReadings(const int16_t* readings, uint8_t* sample)
+    {
+        for (int i = 0; i < COMPOSITE_SENSORS * COMPOSITE_AXES; i++)
+        {
+            sample[2 * i] = (uint8_t)((uint16_t)readings[i] & 0xFF);
+            sample[2 * i + 1] = (uint8_t)((uint16_t)readings[i] >> 8);
+        }
+    }
+}
+
+//Synthetic Swing Source
+SyntheticSwingSource::SyntheticSwingSource(float odr, float noise_lsb, uint32_t seed) :
+    m_odr(odr), m_noise(noise_lsb), m_generator(seed), m_distribution(0.0f, 1.0f)
+{
+}
+
+void SyntheticSwingSource::read(uint64_t sample, int16_t* readings)
+{
+    float cycle = 0.0f;
+    for (int segment = 0; segment < swing_segment_count; segment++) cycle += swing_segments[segment].duration;
+
+    //Find where in the swing this sample falls, the whole thing repeats every cycle seconds
+    float time = (float)std::fmod((double)sample / m_odr, (double)cycle);
+    int segment = 0;
+    while (segment < swing_segment_count - 1 && time >= swing_segments[segment].duration) time -= swing_segments[segment++].duration;
+
+    SwingSegment const& s = swing_segments[segment];
+    float fraction = std::min(time / s.duration, 1.0f);
+    float yaw = s.start_yaw + (s.end_yaw - s.start_yaw) * (1.0f - cosf(PI * fraction)) / 2.0f;
+    float yaw_rate = (s.end_yaw - s.start_yaw) * PI / (2.0f * s.duration) * sinf(PI * fraction); //rad/s
+
+    //Rotation matrix from the sensor frame to the earth frame (Z-Y-X Euler angles). The readings are the
+    //earth frame vectors turned into the sensor frame, which is the transpose of this matrix.
+    float cr = cosf(ADDRESS_ROLL), sr = sinf(ADDRESS_ROLL);
+    float cp = cosf(ADDRESS_PITCH), sp = sinf(ADDRESS_PITCH);
+    float cy = cosf(yaw), sy = sinf(yaw);
+    const float r[3][3] = {
+        { cp * cy, sr * sp * cy - cr * sy, cr * sp * cy + sr * sy },
+        { cp * sy, sr * sp * sy + cr * cy, cr * sp * sy - sr * cy },
+        { -sp, sr * cp, cr * cp }
+    };
+
+    const float angular_velocity[3] = { 0.0f, 0.0f, yaw_rate * 180.0f / PI }; //deg/s
+    const float gravity[3] = { 0.0f, 0.0f, COMPOSITE_GRAVITY }; //the accelerometer reads +1 g straight up at rest
+    const float* earth_vectors[COMPOSITE_SENSORS] = { gravity, angular_velocity, EARTH_FIELD };
+
+    for (int sensor = 0; sensor < COMPOSITE_SENSORS; sensor++)
+    {
+        for (int axis = 0; axis < COMPOSITE_AXES; axis++)
+        {
+            const float* v = earth_vectors[sensor];
+            float value = r[0][axis] * v[0] + r[1][axis] * v[1] + r[2][axis] * v[2];
+            readings[COMPOSITE_AXES * sensor + axis] = toReading(value * LSB_PER_UNIT[sensor] + m_noise * m_distribution(m_generator));
+        }
+    }
+}
+
+//Recorded Sample Source
+bool RecordedSampleSource::loadDataSet(const char* file_location)
+{
+    FILE* file = fopen(file_location, "r");
+    if (file == nullptr) return false;
+
+    //The text files hold the gyroscope readings before the accelerometer readings and the magnetometer in gauss
+    const int column_order[COMPOSITE_SENSORS * COMPOSITE_AXES] = { 3, 4, 5, 0, 1, 2, 6, 7, 8 };
+    const float unit_scale[COMPOSITE_SENSORS] = { 1.0f, 1.0f, 100.0f };
+    float first_time = 0.0f, second_time = 0.0f;
+
+    m_readings.clear();
+    char line[512];
+    while (fgets(line, sizeof(line), file) != nullptr)
+    {
+        float values[1 + COMPOSITE_SENSORS * COMPOSITE_AXES];
+        char* position = line;
+        int column = 0;
+        for (; column < 1 + COMPOSITE_SENSORS * COMPOSITE_AXES; column++)
+        {
+            char* end = nullptr;
+            values[column] = strtof(position, &end);
+            if (end == position) break;
+            position = end;
+        }
+        if (column < 1 + COMPOSITE_SENSORS * COMPOSITE_AXES) continue;
+
+        if (m_readings.empty()) first_time = values[0];
+        else if (m_readings.size() == COMPOSITE_SENSORS * COMPOSITE_AXES) second_time = values[0];
+
+        for (int channel = 0; channel < COMPOSITE_SENSORS * COMPOSITE_AXES; channel++)
+        {
+            int sensor = channel / COMPOSITE_AXES;
+            m_readings.push_back(toReading(values[1 + column_order[channel]] * unit_scale[sensor] * LSB_PER_UNIT[sensor]));
+        }
+    }
+    fclose(file);
+
+    m_odr = (second_time > first_time) ? 1.0f / (second_time - first_time) : 0.0f;
+    return !m_readings.empty();
+}
+
+bool RecordedSampleSource::loadSessionFile(const char* file_location)
+{
+    //Session files already hold the int16 readings exactly as the Personal Caddie sent them
+    SessionFileReader reader;
+    if (!reader.open(file_location)) return false;
+
+    m_readings.resize((size_t)reader.samples() * COMPOSITE_SENSORS * COMPOSITE_AXES);
+    for (uint64_t sample = 0; sample < reader.samples(); sample++)
+    {
+        for (int channel = 0; channel < COMPOSITE_SENSORS * COMPOSITE_AXES; channel++) m_readings[(size_t)sample * COMPOSITE_SENSORS * COMPOSITE_AXES + channel] = reader.reading(sample, channel);
+    }
+    m_odr = reader.header().odr;
+
+    return !m_readings.empty();
+}
+
+void RecordedSampleSource::read(uint64_t sample, int16_t* readings)
+{
+    const int16_t* start = &m_readings[(size_t)sample * COMPOSITE_SENSORS * COMPOSITE_AXES];
+    std::copy(start, start + COMPOSITE_SENSORS * COMPOSITE_AXES, readings);
+}
+
+//Virtual Personal Caddie
+VirtualPersonalCaddie::VirtualPersonalCaddie(VirtualDeviceSettings const& settings, std::unique_ptr<VirtualSampleSource> source) :
+    m_settings(settings), p_source(std::move(source)), m_nextSample(0), m_dataSetReady(0.0), m_packetSequence(0), m_droppedPackets(0),
+    m_nextEvent(settings.connectionInterval), m_lastArrival(-std::numeric_limits<double>::infinity()), m_lastReordered(false),
+    m_generator(settings.seed), m_uniform(0.0, 1.0)
+{
+    m_odr = (m_settings.odr > 0.0f) ? m_settings.odr : p_source->odr();
+    if (m_odr <= 0.0f) m_odr = 400.0f;
+
+    //Data sets are never bigger than the firmware would make them for the encoding, see max_data_set_samples() in main.c
+    int max_samples = COMPOSITE_MAX_SAMPLES / 3;
+    if (m_settings.encoding == SAMPLE_ENCODING_PACKED || m_settings.encoding == SAMPLE_ENCODING_FUSED) max_samples = COMPOSITE_MAX_SAMPLES;
+    else if (m_settings.encoding == SAMPLE_ENCODING_FUSED_LINEAR) max_samples = (VIRTUAL_LARGE_CHARACTERISTIC_SIZE - COMPOSITE_HEADER_SIZE) / (SAMPLE_PACKING_QUATERNION_SIZE + SAMPLE_PACKING_LINEAR_SIZE);
+    m_samplesPerPacket = std::max(1, std::min(m_settings.samplesPerPacket, max_samples));
+
+    //Work out when to stop. A source that never runs out needs a duration, so it gets 10 seconds if it wasn't given one.
+    uint64_t source_samples = p_source->samples();
+    double duration = (m_settings.duration > 0.0 || source_samples > 0) ? m_settings.duration : 10.0;
+    m_totalSamples = (duration > 0.0) ? (uint64_t)std::llround(duration * m_odr) : source_samples;
+    if (source_samples > 0 && !m_settings.loop) m_totalSamples = std::min(m_totalSamples, source_samples);
+
+    //The fusion tables default to what the app would send with identity calibration numbers and axis orientations
+    device_fusion_init(&m_fusion);
+    for (int sensor = 0; sensor < COMPOSITE_SENSORS; sensor++)
+    {
+        float values[DEVICE_FUSION_TABLE_VALUES] = {};
+        for (int axis = 0; axis < COMPOSITE_AXES; axis++) values[COMPOSITE_AXES * axis + axis] = defaultConversionRate(sensor);
+        device_fusion_set_table(&m_fusion, (uint8_t)sensor, values);
+    }
+    device_fusion_reset(&m_fusion, m_odr);
+}
+
+void VirtualPersonalCaddie::setFusionTable(int sensor, const float* values)
+{
+    device_fusion_set_table(&m_fusion, (uint8_t)sensor, values);
+}
+
+float VirtualPersonalCaddie::defaultConversionRate(int sensor)
+{
+    return 1.0f / LSB_PER_UNIT[sensor];
+}
+
+bool VirtualPersonalCaddie::nextNotification(VirtualNotification& notification)
+{
+    //Keeps reading data sets until at least two notifications have made it over (so there's something to
+    //swap if this one should come in late), and once the source is done lets the link send whatever's left.
+    while (m_arrived.size() < 2)
+    {
+        if (readDataSet()) continue;
+
+        while (!m_deviceQueue.empty()) runConnectionEvents(m_nextEvent);
+        break;
+    }
+    if (m_arrived.empty()) return false;
+
+    //A notification that gets overtaken is held up until the one after it has arrived, so it comes in second. The
+    //one that overtakes it keeps its own arrival time, nothing can show up before it was sent. The one that just got
+    //pushed back isn't allowed to be overtaken again.
+    if (!m_lastReordered && m_arrived.size() >= 2 && chance(m_settings.reorderRate))
+    {
+        std::swap(m_arrived[0], m_arrived[1]);
+        if (m_arrived[1].arrivalTime < m_arrived[0].arrivalTime) m_arrived[1].arrivalTime = m_arrived[0].arrivalTime;
+        m_stats.notificationsReordered++;
+        m_lastReordered = true;
+    }
+    else m_lastReordered = false;
+
+    notification = m_arrived.front();
+    m_arrived.pop_front();
+
+    m_stats.notificationsDelivered++;
+    m_stats.samplesDelivered += notification.samples;
+    m_stats.bytesDelivered += notification.length;
+    return true;
+}
+
+bool VirtualPersonalCaddie::readDataSet()
+{
+    //Reads the next data set from the source the same way the firmware reads the sensors, one sample after another
+    //into the sample buffer, and sends it with the time stamp of its first sample
+    if (m_totalSamples > 0 && m_nextSample >= m_totalSamples) return false;
+
+    int samples = (int)std::min<uint64_t>(m_samplesPerPacket, m_totalSamples - m_nextSample);
+    uint64_t source_samples = p_source->samples();
+    for (int i = 0; i < samples; i++)
+    {
+        int16_t readings[COMPOSITE_SENSORS * COMPOSITE_AXES];
+        uint64_t sample = m_nextSample + i;
+        p_source->read((source_samples > 0) ? sample % source_samples : sample, readings);
+        writeReadings(readings, m_sampleBuffer + i * COMPOSITE_SAMPLE_SIZE);
+    }
+
+    //The timer is 32 bits so the time stamp wraps around every 268 seconds
+    m_dataSetReady = deviceToHostTime(sampleDeviceTime(m_nextSample + samples - 1));
+    uint32_t first_tick = (uint32_t)(uint64_t)std::llround(sampleDeviceTime(m_nextSample) * VIRTUAL_TICK_FREQUENCY);
+    encodeDataSet(samples, m_nextSample, first_tick);
+
+    m_nextSample += samples;
+    m_stats.samples += samples;
+    m_stats.dataSets++;
+    return true;
+}
+
+void VirtualPersonalCaddie::encodeDataSet(int samples, uint64_t first_sample, uint32_t first_tick)
+{
+    //Follows characteristic_update_and_notify_composite_characteristic() in the firmware. Data sets that get split
+    //across notifications give each one the nominal time stamp of its first sample, like the firmware does.
+    uint32_t ticks_per_sample = (uint32_t)(VIRTUAL_TICK_FREQUENCY / m_odr);
+    const uint16_t capacity = VIRTUAL_LARGE_CHARACTERISTIC_SIZE - COMPOSITE_HEADER_SIZE;
+    uint8_t sent = 0;
+
+    if (m_settings.encoding == SAMPLE_ENCODING_PACKED)
+    {
+        while (sent < samples)
+        {
+            uint16_t length = 0;
+            bool packed = false;
+            uint8_t count = sample_packing_encode(m_sampleBuffer + sent * COMPOSITE_SAMPLE_SIZE, (uint8_t)(samples - sent), m_settings.encoding,
+                m_largeCharacteristic + COMPOSITE_HEADER_SIZE, capacity, &length, &packed);
+            if (count == 0) break;
+
+            notify(m_largeCharacteristic, COMPOSITE_HEADER_SIZE + length, first_tick + sent * ticks_per_sample, packed ? (count | SAMPLE_PACKING_PACKED_FLAG) : count, first_sample + sent, count);
+            sent += count;
+        }
+    }
+    else if (m_settings.encoding == SAMPLE_ENCODING_FUSED || m_settings.encoding == SAMPLE_ENCODING_FUSED_LINEAR)
+    {
+        float* linear_acceleration = (m_settings.encoding == SAMPLE_ENCODING_FUSED_LINEAR) ? m_fusedLinearAcceleration : nullptr;
+        device_fusion_update(&m_fusion, m_sampleBuffer, (uint8_t)samples, m_fusedQuaternions, linear_acceleration);
+
+        while (sent < samples)
+        {
+            uint16_t length = 0;
+            uint8_t count = sample_packing_encode_fused(m_fusedQuaternions + 4 * sent, (linear_acceleration != nullptr) ? linear_acceleration + COMPOSITE_AXES * sent : nullptr,
+                (uint8_t)(samples - sent), m_largeCharacteristic + COMPOSITE_HEADER_SIZE, capacity, &length);
+            if (count == 0) break;
+
+            notify(m_largeCharacteristic, COMPOSITE_HEADER_SIZE + length, first_tick + sent * ticks_per_sample, count | SAMPLE_PACKING_FUSED_FLAG, first_sample + sent, count);
+            sent += count;
+        }
+    }
+    else
+    {
+        //Raw samples go out in the smallest characteristic that holds a full data set, and the whole characteristic gets sent
+        uint8_t* characteristic = m_largeCharacteristic;
+        uint16_t size = VIRTUAL_LARGE_CHARACTERISTIC_SIZE;
+        if (m_samplesPerPacket < 5)
+        {
+            characteristic = m_smallCharacteristic;
+            size = VIRTUAL_SMALL_CHARACTERISTIC_SIZE;
+        }
+        else if (m_samplesPerPacket < 9)
+        {
+            characteristic = m_mediumCharacteristic;
+            size = VIRTUAL_MEDIUM_CHARACTERISTIC_SIZE;
+        }
+
+        std::copy(m_sampleBuffer, m_sampleBuffer + samples * COMPOSITE_SAMPLE_SIZE, characteristic + COMPOSITE_HEADER_SIZE);
+        notify(characteristic, size, first_tick, (uint8_t)samples, first_sample, samples);
+    }
+}
+
+void VirtualPersonalCaddie::notify(const uint8_t* characteristic, uint16_t length, uint32_t time_stamp, uint8_t sample_count, uint64_t first_sample, int samples)
+{
+    //Same header as composite_characteristic_notify() in the firmware, the sequence number goes up whether
+    //the notification makes it into the queue or not
+    QueuedNotification queued;
+    VirtualNotification& notification = queued.notification;
+    std::copy(characteristic, characteristic + length, notification.data);
+    for (int i = 0; i < 4; i++) notification.data[i] = (uint8_t)(time_stamp >> (8 * i));
+    notification.data[4] = sample_count;
+    notification.data[5] = m_packetSequence & 0xFF;
+    notification.data[6] = (m_packetSequence >> 8) & 0xFF;
+    notification.data[7] = m_droppedPackets & 0xFF;
+    notification.data[8] = (m_droppedPackets >> 8) & 0xFF;
+    notification.length = length;
+    notification.firstSample = first_sample;
+    notification.samples = samples;
+    notification.lastSampleTime = deviceToHostTime(sampleDeviceTime(first_sample + samples - 1));
+    notification.arrivalTime = 0.0;
+    m_packetSequence++;
+    m_stats.notifications++;
+
+    //The data set is ready as soon as its last sample has been read. Anything the link would have sent by
+    //then goes first so the queue is as full as it would really be.
+    queued.readyTime = m_dataSetReady;
+    runConnectionEvents(queued.readyTime);
+
+    bool queue_full = m_settings.connectionInterval > 0.0 && (int)m_deviceQueue.size() >= m_settings.queueSize;
+    if (queue_full || chance(m_settings.dropRate))
+    {
+        m_droppedPackets++;
+        m_stats.notificationsDropped++;
+        return;
+    }
+
+    if (m_settings.connectionInterval <= 0.0)
+    {
+        deliver(notification, queued.readyTime);
+        return;
+    }
+
+    m_deviceQueue.push_back(queued);
+    m_stats.maxQueueDepth = std::max(m_stats.maxQueueDepth, (uint32_t)m_deviceQueue.size());
+}
+
+void VirtualPersonalCaddie::runConnectionEvents(double until)
+{
+    //Sends queued notifications in every connection event up to the given time
+    if (m_settings.connectionInterval <= 0.0) return;
+
+    while (m_nextEvent <= until)
+    {
+        if (m_deviceQueue.empty())
+        {
+            //Nothing to send, skip straight to the last event before the given time
+            m_nextEvent += std::floor((until - m_nextEvent) / m_settings.connectionInterval) * m_settings.connectionInterval;
+        }
+
+        int sent = 0;
+        while (sent < m_settings.notificationsPerEvent && !m_deviceQueue.empty() && m_deviceQueue.front().readyTime <= m_nextEvent)
+        {
+            deliver(m_deviceQueue.front().notification, m_nextEvent);
+            m_deviceQueue.pop_front();
+            sent++;
+        }
+        m_nextEvent += m_settings.connectionInterval;
+    }
+}
+
+void VirtualPersonalCaddie::deliver(VirtualNotification& notification, double send_time)
+{
+    //Jitter can hold a notification up but never lets it get ahead of the one sent before it
+    if (chance(m_settings.lossRate))
+    {
+        m_stats.notificationsLost++;
+        return;
+    }
+
+    double jitter = (m_settings.jitter > 0.0) ? m_settings.jitter * m_uniform(m_generator) : 0.0;
+    notification.arrivalTime = std::max(m_lastArrival, send_time + m_settings.latency + jitter);
+    m_lastArrival = notification.arrivalTime;
+    m_arrived.push_back(notification);
+}
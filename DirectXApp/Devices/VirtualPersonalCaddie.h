@@ -0,0 +1,200 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "CompositeDataDecoder.h"
+#include "../../Firmware/nRF52840_Drivers/device_fusion.h"
+
+//Sizes of the three composite data characteristics, these match ble_sensor_service.h in the firmware. Raw samples
+//always go out as the full characteristic (whatever is past the last valid sample is left over from earlier data sets).
+#define VIRTUAL_SMALL_CHARACTERISTIC_SIZE   (COMPOSITE_HEADER_SIZE + 4 * COMPOSITE_SAMPLE_SIZE)
+#define VIRTUAL_MEDIUM_CHARACTERISTIC_SIZE  (COMPOSITE_HEADER_SIZE + 8 * COMPOSITE_SAMPLE_SIZE)
+#define VIRTUAL_LARGE_CHARACTERISTIC_SIZE   (COMPOSITE_HEADER_SIZE + COMPOSITE_MAX_SAMPLES / 3 * COMPOSITE_SAMPLE_SIZE)
+#define VIRTUAL_TICK_FREQUENCY              16000000.0 //the data timer on the Personal Caddie
+
+//LSB per unit of each sensor with the default Personal Caddie settings (BMI270 at +/- 4 g and +/- 2000 deg/s, BMM150)
+#define VIRTUAL_ACC_LSB_PER_UNIT            (8192.0f / COMPOSITE_GRAVITY) //m/s^2
+#define VIRTUAL_GYR_LSB_PER_UNIT            16.384f //deg/s
+#define VIRTUAL_MAG_LSB_PER_UNIT            (1.0f / 0.3f) //uT
+
+//Where the samples of a virtual Personal Caddie come from. Readings are the int16s the sensors would put out, in
+//the same order as a composite characteristic sample (acc x, y, z, gyr x, y, z, mag x, y, z).
+class VirtualSampleSource
+{
+public:
+	virtual ~VirtualSampleSource() {}
+
+	virtual uint64_t samples() const = 0; //0 for sources that never run out
+	virtual float odr() const = 0; //the rate the data was recorded at, 0 if it doesn't matter
+	virtual void read(uint64_t sample, int16_t* readings) = 0;
+};
+
+/*
+* Makes up a practice session on the fly: the club sits at address, gets swung back and through (a rotation about the
+* vertical axis that tops out around 1500 deg/s on the way down) and then rests before the next swing. The gyroscope
+* reads the rotation, the accelerometer reads gravity and the magnetometer reads the earth's field, all turned into
+* the frame of the sensor, plus some white noise. It never runs out.
+*/
+class SyntheticSwingSource : public VirtualSampleSource
+{
+public:
+	SyntheticSwingSource(float odr, float noise_lsb = 2.0f, uint32_t seed = 1);
+
+	uint64_t samples() const override { return 0; }
+	float odr() const override { return m_odr; }
+	void read(uint64_t sample, int16_t* readings) override;
+
+private:
+	float m_odr;
+	float m_noise;
+	std::mt19937 m_generator;
+	std::normal_distribution<float> m_distribution;
+};
+
+//Readings from a recording, either a text data set (the layout of the files in Console_Application/Resources/Data_Sets)
+//or a binary session file recorded by the app. Text data sets are turned into int16s with the default sensor settings.
+class RecordedSampleSource : public VirtualSampleSource
+{
+public:
+	bool loadDataSet(const char* file_location);
+	bool loadSessionFile(const char* file_location);
+
+	uint64_t samples() const override { return m_readings.size() / COMPOSITE_SENSORS / COMPOSITE_AXES; }
+	float odr() const override { return m_odr; }
+	void read(uint64_t sample, int16_t* readings) override;
+
+private:
+	std::vector<int16_t> m_readings; //every reading of a sample next to each other
+	float m_odr = 0.0f;
+};
+
+//How the virtual Personal Caddie and the link between it and this computer behave. Times are in seconds.
+struct VirtualDeviceSettings
+{
+	float odr = 400.0f; //0 uses the rate of the source
+	int samplesPerPacket = 13; //samples in each data set, gets capped at what the encoding can fit
+	uint8_t encoding = SAMPLE_ENCODING_RAW; //sample_encoding_t
+	double duration = 10.0; //seconds of data to send, 0 sends the whole source once
+	bool loop = true; //start the source over when it runs out (until duration is reached)
+
+	double odrErrorPpm = 0.0; //how far the sensor's oscillator is from the ODR it's set to
+	double clockDriftPpm = 0.0; //how much faster the clock of the Personal Caddie runs than the clock of this computer
+	double clockOffset = 0.0; //time on this computer when the Personal Caddie clock reads 0
+
+	double connectionInterval = 0.0; //0 sends every notification as soon as its data set is ready
+	int notificationsPerEvent = 6; //most notifications that go out in a single connection event
+	int queueSize = 8; //notifications the Personal Caddie can have waiting before it has to drop data sets
+	double latency = 0.0005; //from the end of a connection event to the notification reaching the app
+	double jitter = 0.0; //extra random delay (0 to jitter) on each notification, never changes their order
+	double lossRate = 0.0; //chance a notification leaves the Personal Caddie but never arrives
+	double dropRate = 0.0; //chance the Personal Caddie can't queue a notification for no reason the link model knows about
+	double reorderRate = 0.0; //chance a notification shows up after the one sent after it
+	uint32_t seed = 1;
+};
+
+//A single notification as it arrives at this computer
+struct VirtualNotification
+{
+	uint8_t data[VIRTUAL_LARGE_CHARACTERISTIC_SIZE];
+	uint16_t length;
+	double arrivalTime; //time on this computer it arrives
+	double lastSampleTime; //time on this computer the last sample in it was measured
+	uint64_t firstSample; //counting every sample the source has put out
+	int samples;
+};
+
+//What the virtual Personal Caddie knows about everything it has sent, to check the app's own accounting against
+struct VirtualDeviceStats
+{
+	uint64_t samples = 0; //read from the source
+	uint64_t dataSets = 0;
+	uint64_t notifications = 0; //given a sequence number
+	uint64_t notificationsDropped = 0; //by the Personal Caddie, these show up in the dropped count of the header
+	uint64_t notificationsLost = 0; //on the way over
+	uint64_t notificationsReordered = 0;
+	uint64_t notificationsDelivered = 0;
+	uint64_t samplesDelivered = 0;
+	uint64_t bytesDelivered = 0;
+	uint32_t maxQueueDepth = 0;
+};
+
+/*
+* A stand-in for the Personal Caddie that builds its composite data notifications in software. The header (time
+* stamp, sample count, sequence number and dropped count) and the samples are put together exactly the way the
+* firmware does it, using the same sample_packing and device_fusion code for the packed and fused encodings, so
+* whatever the app does with a real notification it can do with these. Nothing is sent anywhere, the caller pulls
+* notifications out in the order they'd arrive (along with when they'd arrive) and hands them to whatever it wants
+* to test.
+*
+* The link is modelled as a connection event every connectionInterval seconds. Each data set is queued on the
+* Personal Caddie when its last sample is read, and each event sends up to notificationsPerEvent of the queued
+* notifications. If the queue is full when a data set is ready it gets dropped, just like when sd_ble_gatts_hvx()
+* returns NRF_ERROR_RESOURCES. Random loss, drops and reordering can be added on top of that. With a connection
+* interval of 0 the link never holds anything up, which is how rates the real radio can't reach yet get tested.
+*/
+class VirtualPersonalCaddie
+{
+public:
+	VirtualPersonalCaddie(VirtualDeviceSettings const& settings, std::unique_ptr<VirtualSampleSource> source);
+
+	void setFusionTable(int sensor, const float* values); //the same 12 floats the app sends with DEVICE_FUSION_COMMAND
+	static float defaultConversionRate(int sensor); //real units per LSB with the default sensor settings
+
+	bool nextNotification(VirtualNotification& notification);
+
+	VirtualDeviceSettings const& settings() const { return m_settings; }
+	VirtualDeviceStats const& stats() const { return m_stats; }
+	float odr() const { return m_odr; }
+	int samplesPerPacket() const { return m_samplesPerPacket; }
+
+private:
+	struct QueuedNotification
+	{
+		VirtualNotification notification;
+		double readyTime;
+	};
+
+	bool readDataSet();
+	void encodeDataSet(int samples, uint64_t first_sample, uint32_t first_tick);
+	void notify(const uint8_t* characteristic, uint16_t length, uint32_t time_stamp, uint8_t sample_count, uint64_t first_sample, int samples);
+	void runConnectionEvents(double until);
+	void deliver(VirtualNotification& notification, double send_time);
+	double deviceToHostTime(double device_time) const { return m_settings.clockOffset + device_time * (1.0 + m_settings.clockDriftPpm * 1.0e-6); }
+	double sampleDeviceTime(uint64_t sample) const { return sample / (m_odr * (1.0 + m_settings.odrErrorPpm * 1.0e-6)); }
+	bool chance(double probability) { return probability > 0.0 && m_uniform(m_generator) < probability; }
+
+	VirtualDeviceSettings m_settings;
+	std::unique_ptr<VirtualSampleSource> p_source;
+	float m_odr;
+	int m_samplesPerPacket;
+	uint64_t m_totalSamples; //samples to send before stopping, 0 for no limit
+
+	//Firmware state
+	uint64_t m_nextSample;
+	double m_dataSetReady; //time on this computer the last sample of the current data set was read
+	uint16_t m_packetSequence;
+	uint16_t m_droppedPackets;
+	uint8_t m_sampleBuffer[COMPOSITE_MAX_SAMPLES * COMPOSITE_SAMPLE_SIZE];
+	uint8_t m_smallCharacteristic[VIRTUAL_SMALL_CHARACTERISTIC_SIZE] = {};
+	uint8_t m_mediumCharacteristic[VIRTUAL_MEDIUM_CHARACTERISTIC_SIZE] = {};
+	uint8_t m_largeCharacteristic[VIRTUAL_LARGE_CHARACTERISTIC_SIZE] = {};
+	device_fusion_t m_fusion;
+	float m_fusedQuaternions[4 * COMPOSITE_MAX_SAMPLES];
+	float m_fusedLinearAcceleration[COMPOSITE_AXES * COMPOSITE_MAX_SAMPLES];
+
+	//Link state
+	std::deque<QueuedNotification> m_deviceQueue; //waiting for a connection event
+	std::deque<VirtualNotification> m_arrived; //in the order they reach this computer
+	double m_nextEvent;
+	double m_lastArrival;
+	bool m_lastReordered;
+
+	std::mt19937 m_generator;
+	std::uniform_real_distribution<double> m_uniform;
+	VirtualDeviceStats m_stats;
+};
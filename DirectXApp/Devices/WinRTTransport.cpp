@@ -0,0 +1,183 @@
+#include "pch.h"
+
+#include "WinRTTransport.h"
+
+using namespace winrt;
+using namespace Windows::Foundation;
+using namespace Windows::Devices;
+using namespace Bluetooth::GenericAttributeProfile;
+
+WinRTTransport::WinRTTransport(Bluetooth::BluetoothLEDevice const& device) : m_device(device)
+{
+    m_characteristics.assign(GATT_ATTRIBUTE_COUNT, nullptr);
+}
+
+void WinRTTransport::discover(DiscoveryCompletion done)
+{
+    findCharacteristics(Bluetooth::BluetoothCacheMode::Uncached, done);
+}
+
+void WinRTTransport::bind(GattHandleMap const& map, Completion done)
+{
+    findCharacteristics(Bluetooth::BluetoothCacheMode::Cached, [map, done](bool success, GattHandleMap const& found)
+        {
+            done(success && found == map);
+        });
+}
+
+void WinRTTransport::findCharacteristics(Bluetooth::BluetoothCacheMode mode, DiscoveryCompletion done)
+{
+    //The characteristics of both services are asked for at the same time, whichever comes back last finishes the search
+    struct Search
+    {
+        std::mutex mutex;
+        int pending = 0;
+        bool success = true;
+        GattHandleMap map;
+        std::vector<GattDeviceService> services;
+        std::vector<GattCharacteristic> characteristics;
+    };
+
+    auto getServices = m_device.GetGattServicesAsync(mode);
+    getServices.Completed([this, mode, done](IAsyncOperation<GattDeviceServicesResult> const& sender, AsyncStatus const asyncStatus)
+        {
+            if (asyncStatus != AsyncStatus::Completed || sender.GetResults().Status() != GattCommunicationStatus::Success)
+            {
+                done(false, GattHandleMap());
+                return;
+            }
+
+            auto search = std::make_shared<Search>();
+            search->characteristics.assign(GATT_ATTRIBUTE_COUNT, nullptr);
+            auto services = sender.GetResults().Services();
+            for (uint32_t i = 0; i < services.Size(); i++)
+            {
+                uint16_t short_uuid = (services.GetAt(i).Uuid().Data1 & 0xFFFF);
+                if (short_uuid == SENSOR_SERVICE_UUID || short_uuid == PERSONAL_CADDIE_SERVICE_UUID) search->services.push_back(services.GetAt(i));
+            }
+
+            if (search->services.empty())
+            {
+                done(false, GattHandleMap());
+                return;
+            }
+
+            search->pending = static_cast<int>(search->services.size());
+            for (auto& service : search->services)
+            {
+                auto getCharacteristics = service.GetCharacteristicsAsync(mode);
+                getCharacteristics.Completed([this, search, done](IAsyncOperation<GattCharacteristicsResult> const& sender, AsyncStatus const asyncStatus)
+                    {
+                        GattHandleMap map;
+                        bool success;
+                        {
+                            std::lock_guard<std::mutex> lock(search->mutex);
+                            if (asyncStatus == AsyncStatus::Completed && sender.GetResults().Status() == GattCommunicationStatus::Success)
+                            {
+                                auto characteristics = sender.GetResults().Characteristics();
+                                for (uint32_t i = 0; i < characteristics.Size(); i++)
+                                {
+                                    uint16_t short_uuid = (characteristics.GetAt(i).Uuid().Data1 & 0xFFFF);
+                                    for (int attribute = 0; attribute < GATT_ATTRIBUTE_COUNT; attribute++)
+                                    {
+                                        if (gattAttributeUuid(static_cast<GattAttribute>(attribute)) != short_uuid) continue;
+                                        search->characteristics[attribute] = characteristics.GetAt(i);
+                                        search->map.handles[attribute] = characteristics.GetAt(i).AttributeHandle();
+                                    }
+                                }
+                            }
+                            else search->success = false;
+
+                            if (--search->pending > 0) return;
+                            map = search->map;
+                            success = search->success;
+                        }
+
+                        {
+                            std::lock_guard<std::mutex> lock(m_mutex);
+                            m_services = search->services;
+                            m_characteristics = search->characteristics;
+                        }
+                        done(success, map);
+                    });
+            }
+        });
+}
+
+void WinRTTransport::read(GattAttribute attribute, ReadCompletion done)
+{
+    auto gattCharacteristic = characteristic(attribute);
+    if (gattCharacteristic == nullptr)
+    {
+        done(false, std::vector<uint8_t>());
+        return;
+    }
+
+    //Use uncached reads so the value comes from the device and not from what Windows saw last time
+    auto readOperation = gattCharacteristic.ReadValueAsync(Bluetooth::BluetoothCacheMode::Uncached);
+    readOperation.Completed([done](IAsyncOperation<GattReadResult> const& sender, AsyncStatus const asyncStatus)
+        {
+            std::vector<uint8_t> value;
+            if (asyncStatus != AsyncStatus::Completed || sender.GetResults().Status() != GattCommunicationStatus::Success)
+            {
+                done(false, value);
+                return;
+            }
+
+            auto buffer = sender.GetResults().Value();
+            value.assign(buffer.data(), buffer.data() + buffer.Length());
+            done(true, value);
+        });
+}
+
+void WinRTTransport::write(GattAttribute attribute, std::vector<uint8_t> const& value, Completion done)
+{
+    auto gattCharacteristic = characteristic(attribute);
+    if (gattCharacteristic == nullptr)
+    {
+        done(false);
+        return;
+    }
+
+    winrt::Windows::Storage::Streams::DataWriter writer;
+    writer.WriteBytes(value);
+
+    auto writeOperation = gattCharacteristic.WriteValueAsync(writer.DetachBuffer());
+    writeOperation.Completed([done](IAsyncOperation<GattCommunicationStatus> const& sender, AsyncStatus const asyncStatus)
+        {
+            done(asyncStatus == AsyncStatus::Completed && sender.GetResults() == GattCommunicationStatus::Success);
+        });
+}
+
+void WinRTTransport::writeCccd(GattAttribute attribute, bool notify, Completion done)
+{
+    //The CCCD gets written whether or not it's already set the way it should be. Reading it first to find out takes
+    //just as long as writing it.
+    auto gattCharacteristic = characteristic(attribute);
+    if (gattCharacteristic == nullptr)
+    {
+        done(false);
+        return;
+    }
+
+    auto cccd_value = notify ? GattClientCharacteristicConfigurationDescriptorValue::Notify : GattClientCharacteristicConfigurationDescriptorValue::None;
+    auto cccdWrite = gattCharacteristic.WriteClientCharacteristicConfigurationDescriptorAsync(cccd_value);
+    cccdWrite.Completed([done](IAsyncOperation<GattCommunicationStatus> const& sender, AsyncStatus const asyncStatus)
+        {
+            done(asyncStatus == AsyncStatus::Completed && sender.GetResults() == GattCommunicationStatus::Success);
+        });
+}
+
+GattCharacteristic WinRTTransport::characteristic(GattAttribute attribute)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_characteristics[static_cast<int>(attribute)];
+}
+
+void WinRTTransport::close()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& service : m_services) service.Close();
+    m_services.clear();
+    m_characteristics.assign(GATT_ATTRIBUTE_COUNT, nullptr);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <pch.h>
+#include <memory>
+
+#include "DeviceSession.h"
+
+/*
+* The DeviceTransport the app uses, on top of the Windows Bluetooth LE API. Everything is done with Completed handlers
+* so nothing waits on the link while holding up the thread that called it, and Windows queues up however many
+* operations are waiting so they go out back to back.
+*
+* Walking the GATT table uses BluetoothCacheMode::Uncached so what comes back is what the device really has. Binding
+* to a cached handle map asks Windows for the GATT table with BluetoothCacheMode::Cached instead, which comes from its
+* own copy of the table without touching the link, and then checks that the characteristics are where the map says.
+* If Windows doesn't have a copy, or its copy doesn't match the map, the bind fails and the session walks the table.
+*/
+class WinRTTransport : public DeviceTransport
+{
+public:
+	WinRTTransport(winrt::Windows::Devices::Bluetooth::BluetoothLEDevice const& device);
+
+	uint64_t address() const override { return m_device.BluetoothAddress(); }
+	void discover(DiscoveryCompletion done) override;
+	void bind(GattHandleMap const& map, Completion done) override;
+	void read(GattAttribute attribute, ReadCompletion done) override;
+	void write(GattAttribute attribute, std::vector<uint8_t> const& value, Completion done) override;
+	void writeCccd(GattAttribute attribute, bool notify, Completion done) override;
+
+	winrt::Windows::Devices::Bluetooth::GenericAttributeProfile::GattCharacteristic characteristic(GattAttribute attribute); //nullptr if the device doesn't have it
+	void close(); //lets go of the services so Windows can drop the connection
+
+private:
+	void findCharacteristics(winrt::Windows::Devices::Bluetooth::BluetoothCacheMode mode, DiscoveryCompletion done);
+
+	winrt::Windows::Devices::Bluetooth::BluetoothLEDevice m_device{ nullptr };
+
+	std::mutex m_mutex; //the Completed handlers run on the thread pool
+	std::vector<winrt::Windows::Devices::Bluetooth::GenericAttributeProfile::GattDeviceService> m_services;
+	std::vector<winrt::Windows::Devices::Bluetooth::GenericAttributeProfile::GattCharacteristic> m_characteristics;
+};
@@ -0,0 +1,304 @@
+#include "SwingAnalytics.h"
+
+#include <cmath>
+
+#include "../Devices/CompositeDataDecoder.h"
+#include "../Math/madgwick_batch.h"
+
+const char* SwingMetricsTable::columnName(SwingMetric metric)
+{
+	switch (metric)
+	{
+	case SwingMetric::SESSION: return "session";
+	case SwingMetric::SWING: return "swing";
+	case SwingMetric::ADDRESS_TIME: return "address_time_s";
+	case SwingMetric::IMPACT_TIME: return "impact_time_s";
+	case SwingMetric::BACKSWING_DURATION: return "backswing_s";
+	case SwingMetric::TRANSITION_DURATION: return "transition_s";
+	case SwingMetric::DOWNSWING_DURATION: return "downswing_s";
+	case SwingMetric::FOLLOW_THROUGH_DURATION: return "follow_through_s";
+	case SwingMetric::TEMPO: return "tempo";
+	case SwingMetric::PEAK_PITCH_RATE: return "peak_pitch_rate_dps";
+	case SwingMetric::PEAK_YAW_RATE: return "peak_yaw_rate_dps";
+	case SwingMetric::PEAK_ANGULAR_SPEED: return "peak_angular_speed_dps";
+	case SwingMetric::IMPACT_ANGULAR_SPEED: return "impact_angular_speed_dps";
+	case SwingMetric::CLUB_HEAD_SPEED: return "club_head_speed_mps";
+	case SwingMetric::BACKSWING_PLANE: return "backswing_plane_deg";
+	case SwingMetric::DOWNSWING_PLANE: return "downswing_plane_deg";
+	default: return "unknown";
+	}
+}
+
+void SwingMetricsTable::clear()
+{
+	for (int column = 0; column < Columns; column++) m_columns[column].clear();
+}
+
+void SwingMetricsTable::reserve(size_t rows)
+{
+	for (int column = 0; column < Columns; column++) m_columns[column].reserve(rows);
+}
+
+void SwingMetricsTable::addRow(const float* values)
+{
+	for (int column = 0; column < Columns; column++) m_columns[column].push_back(values[column]);
+}
+
+void SwingMetricsTable::append(SwingMetricsTable const& table)
+{
+	for (int column = 0; column < Columns; column++) m_columns[column].insert(m_columns[column].end(), table.m_columns[column].begin(), table.m_columns[column].end());
+}
+
+bool SwingMetricsTable::writeCsv(FILE* file) const
+{
+	//One line for the column names and then one line for each swing
+	for (int column = 0; column < Columns; column++) fprintf(file, (column == 0) ? "%s" : ",%s", columnName(static_cast<SwingMetric>(column)));
+	fprintf(file, "\n");
+
+	for (size_t row = 0; row < rows(); row++)
+	{
+		fprintf(file, "%.0f,%.0f", m_columns[0][row], m_columns[1][row]);
+		for (int column = 2; column < Columns; column++) fprintf(file, ",%.6g", m_columns[column][row]);
+		fprintf(file, "\n");
+	}
+	return ferror(file) == 0;
+}
+
+bool SwingMetricsTable::writeColumns(FILE* file) const
+{
+	//The binary version of the table keeps the column layout. After a 4 byte column count and an 8 byte row count
+	//comes each column in turn: a 32 byte zero padded name followed by the little endian floats for every row.
+	uint32_t columns = Columns;
+	uint64_t row_count = rows();
+	if (fwrite(&columns, sizeof(columns), 1, file) != 1 || fwrite(&row_count, sizeof(row_count), 1, file) != 1) return false;
+
+	for (int column = 0; column < Columns; column++)
+	{
+		char name[32] = {};
+		snprintf(name, sizeof(name), "%s", columnName(static_cast<SwingMetric>(column)));
+		if (fwrite(name, sizeof(name), 1, file) != 1) return false;
+		if (row_count > 0 && fwrite(m_columns[column].data(), sizeof(float), row_count, file) != row_count) return false;
+	}
+	return true;
+}
+
+SwingAnalyzer::SwingAnalyzer(SwingAnalyticsSettings const& settings) :
+	m_settings(settings)
+{
+	for (int channel = 0; channel < SESSION_FILE_CHANNELS; channel++) m_channels[channel].resize(SESSION_FILE_CHUNK_SAMPLES);
+	m_quaternions.resize(4 * SESSION_FILE_CHUNK_SAMPLES);
+	m_times.resize(SESSION_FILE_CHUNK_SAMPLES);
+}
+
+void SwingAnalyzer::calibrateChunk(SessionFileChunkView const& view)
+{
+	//The conversion rate, axis swap and calibration numbers for each sensor were folded into a single matrix
+	//and bias when the session was opened, so every calibrated reading is three multiplies and an add. The
+	//int16 columns of the file get read straight out of the mapping.
+	for (int sensor = 0; sensor < SESSION_FILE_SENSORS; sensor++)
+	{
+		const int16_t* x = view.channel[sensor * SESSION_FILE_AXES], * y = view.channel[sensor * SESSION_FILE_AXES + 1], * z = view.channel[sensor * SESSION_FILE_AXES + 2];
+		for (int row = 0; row < SESSION_FILE_AXES; row++)
+		{
+			const float* m = m_tables[sensor][row];
+			float* out = m_channels[sensor * SESSION_FILE_AXES + row].data();
+			for (uint32_t i = 0; i < view.samples; i++) out[i] = m[0] * x[i] + m[1] * y[i] + m[2] * z[i] + m[3];
+		}
+	}
+}
+
+void SwingAnalyzer::startSwing(double address_time)
+{
+	m_swing.started = true;
+	for (int phase = 0; phase <= static_cast<int>(SwingPhase::END); phase++) m_swing.phaseTime[phase] = -1.0;
+	m_swing.phaseTime[static_cast<int>(SwingPhase::ADDRESS)] = address_time;
+	m_swing.peakPitchRate = m_swing.peakYawRate = m_swing.peakAngularSpeed = 0.0f;
+	m_swing.backswingNormal = m_swing.downswingNormal = { 0.0f, 0.0f, 0.0f };
+	m_swing.impact = SwingImpact();
+}
+
+void SwingAnalyzer::addSwingSample(SwingPhase phase, Vec3 const& club_vector, float gx, float gy, float gz)
+{
+	//The peak rates cover the whole swing, from the start of the backswing until the end of the follow through,
+	//while the speed of the club head only looks at the part of the swing heading into the ball
+	if (fabsf(gy) > m_swing.peakPitchRate) m_swing.peakPitchRate = fabsf(gy);
+	if (fabsf(gz) > m_swing.peakYawRate) m_swing.peakYawRate = fabsf(gz);
+	if (phase == SwingPhase::DOWNSWING || phase == SwingPhase::IMPACT)
+	{
+		float speed = sqrtf(gx * gx + gy * gy + gz * gz);
+		if (speed > m_swing.peakAngularSpeed) m_swing.peakAngularSpeed = speed;
+	}
+
+	//The plane the club shaft moves in is normal to the cross product of consecutive shaft vectors. Summing the
+	//cross products over a phase weights each sample by how far the club moved, so the pauses don't count for
+	//anything and the plane comes out as the average over the part of the phase where the club was moving.
+	if (phase == SwingPhase::BACKSWING || phase == SwingPhase::TRANSITION) m_swing.backswingNormal = m_swing.backswingNormal + Cross(m_previousClubVector, club_vector);
+	else if (phase == SwingPhase::DOWNSWING || phase == SwingPhase::IMPACT) m_swing.downswingNormal = m_swing.downswingNormal + Cross(m_previousClubVector, club_vector);
+}
+
+void SwingAnalyzer::finishSwing(uint32_t session_index, SwingMetricsTable& table)
+{
+	//Swings only get saved once they've made it to impact, anything short of that was most likely
+	//a waggle or a practice take away
+	m_swing.started = false;
+
+	//Times stay as doubles until they go into the table, only the durations between them are small enough to
+	//be differences of floats
+	const double* times = m_swing.phaseTime;
+	double backswing = times[static_cast<int>(SwingPhase::BACKSWING)], transition = times[static_cast<int>(SwingPhase::TRANSITION)];
+	double downswing = times[static_cast<int>(SwingPhase::DOWNSWING)], impact = times[static_cast<int>(SwingPhase::IMPACT)];
+	double follow_through = times[static_cast<int>(SwingPhase::FOLLOW_THROUGH)], end = times[static_cast<int>(SwingPhase::END)];
+	if (impact < 0.0 || downswing < 0.0 || transition < 0.0)
+	{
+		m_abandonedSwings++;
+		return;
+	}
+	if (m_swing.impact.found) impact = m_swing.impact.time; //the moment the club got back to the ball instead of the sample that got close enough
+
+	auto planeAngle = [](Vec3 const& normal)
+	{
+		//The tilt of a plane from the ground is the angle between its normal and the vertical axis
+		float length = Length(normal);
+		if (length <= 0.0f) return 0.0f;
+		return acosf(fminf(fabsf(normal.z) / length, 1.0f)) / DEGREES_TO_RADIANS;
+	};
+
+	float values[SwingMetricsTable::Columns];
+	values[static_cast<int>(SwingMetric::SESSION)] = (float)session_index;
+	values[static_cast<int>(SwingMetric::SWING)] = (float)m_swingNumber++;
+	values[static_cast<int>(SwingMetric::ADDRESS_TIME)] = (float)times[static_cast<int>(SwingPhase::ADDRESS)];
+	values[static_cast<int>(SwingMetric::IMPACT_TIME)] = (float)impact;
+	values[static_cast<int>(SwingMetric::BACKSWING_DURATION)] = (float)(transition - backswing);
+	values[static_cast<int>(SwingMetric::TRANSITION_DURATION)] = (float)(downswing - transition);
+	values[static_cast<int>(SwingMetric::DOWNSWING_DURATION)] = (float)(impact - downswing);
+	values[static_cast<int>(SwingMetric::FOLLOW_THROUGH_DURATION)] = (follow_through >= 0.0 && end >= 0.0) ? (float)(end - follow_through) : 0.0f;
+	values[static_cast<int>(SwingMetric::TEMPO)] = (impact > downswing) ? (float)((downswing - backswing) / (impact - downswing)) : 0.0f;
+	values[static_cast<int>(SwingMetric::PEAK_PITCH_RATE)] = m_swing.peakPitchRate;
+	values[static_cast<int>(SwingMetric::PEAK_YAW_RATE)] = m_swing.peakYawRate;
+	values[static_cast<int>(SwingMetric::PEAK_ANGULAR_SPEED)] = m_swing.peakAngularSpeed;
+	values[static_cast<int>(SwingMetric::IMPACT_ANGULAR_SPEED)] = m_swing.impact.found ? m_swing.impact.angular_speed / DEGREES_TO_RADIANS : 0.0f;
+	values[static_cast<int>(SwingMetric::CLUB_HEAD_SPEED)] = m_swing.peakAngularSpeed * DEGREES_TO_RADIANS * m_settings.clubRadius;
+	values[static_cast<int>(SwingMetric::BACKSWING_PLANE)] = planeAngle(m_swing.backswingNormal);
+	values[static_cast<int>(SwingMetric::DOWNSWING_PLANE)] = planeAngle(m_swing.downswingNormal);
+	table.addRow(values);
+}
+
+bool SwingAnalyzer::analyze(SessionFileReader const& session, uint32_t session_index, SwingMetricsTable& table, SwingAnalyticsStats* stats)
+{
+	//Runs a whole session through calibration, the Madgwick filter and the swing phase detector. Rows for every
+	//swing found get added to the end of the table. Returns false if there's nothing in the session to analyze.
+	if (!session.isOpen() || session.samples() == 0 || session.chunks() == 0) return false;
+
+	SessionFileHeader const& header = session.header();
+	const float odr = (header.odr > 0.0f) ? header.odr : 400.0f;
+
+	//Fold the conversion rates, axis orientations and calibration numbers saved with the session into a single
+	//matrix and bias for each sensor, the same way the live data gets decoded
+	CompositeDataDecoder decoder;
+	for (int sensor = 0; sensor < SESSION_FILE_SENSORS; sensor++)
+	{
+		const float* gain[SESSION_FILE_AXES] = { header.calibration_gains[sensor][0], header.calibration_gains[sensor][1], header.calibration_gains[sensor][2] };
+		decoder.setSensorTable(sensor, header.conversion_rates[sensor], header.axis_swap[sensor], header.axis_polarity[sensor], header.calibration_offsets[sensor], gain);
+
+		SensorDecodeTable const& decode_table = decoder.getSensorTable(sensor);
+		for (int row = 0; row < SESSION_FILE_AXES; row++)
+		{
+			for (int column = 0; column < SESSION_FILE_AXES; column++) m_tables[sensor][row][column] = decode_table.calibrated[row][column];
+			m_tables[sensor][row][SESSION_FILE_AXES] = decode_table.bias[row];
+		}
+	}
+
+	m_detector.reset();
+	m_swing.started = false;
+	m_addressTime = 0.0;
+	m_swingNumber = 0;
+	m_abandonedSwings = 0;
+	uint32_t first_row = (uint32_t)table.rows();
+
+	float q[4] = { 1.0f, 0.0f, 0.0f, 0.0f };
+	uint64_t first_tick = session.chunk(0).first_tick;
+	uint64_t samples = 0;
+
+	for (size_t chunk = 0; chunk < session.chunks(); chunk++)
+	{
+		SessionFileChunkView view = session.chunk(chunk);
+		if (view.samples == 0) continue;
+		if (view.samples > m_times.size())
+		{
+			//Files written by the app never have chunks bigger than this, but there's nothing stopping another writer
+			for (int channel = 0; channel < SESSION_FILE_CHANNELS; channel++) m_channels[channel].resize(view.samples);
+			m_quaternions.resize(4 * view.samples);
+			m_times.resize(view.samples);
+		}
+
+		calibrateChunk(view);
+
+		//Only the first sample of each packet has a time stamp, the rest are spaced out by the ODR
+		for (uint32_t packet = 0; packet < view.packets; packet++)
+		{
+			SessionFilePacket const& p = view.packet[packet];
+			double packet_time = (view.first_tick - first_tick + (uint32_t)(p.timer_ticks - view.packet[0].timer_ticks)) / SESSION_FILE_TICK_FREQUENCY;
+			uint32_t last = (packet + 1 < view.packets) ? view.packet[packet + 1].first_sample : view.samples;
+			for (uint32_t i = p.first_sample; i < last && i < view.samples; i++) m_times[i] = packet_time + (i - p.first_sample) / odr;
+		}
+
+		MadgwickBatchInput input = { m_channels[3].data(), m_channels[4].data(), m_channels[5].data(), m_channels[0].data(), m_channels[1].data(), m_channels[2].data(),
+			m_channels[6].data(), m_channels[7].data(), m_channels[8].data() };
+
+		if (chunk == 0)
+		{
+			//The filter starts out from the identity quaternion and the normal gain is far too small to pull it around
+			//to the real orientation quickly, so the start of the session is run through a few times with a large gain
+			//first (the same thing the app does with the gain when packets go missing). Since the golfer can't have
+			//addressed the ball yet this doesn't hide any swings.
+			int settle_samples = (int)(m_settings.settleSeconds * odr);
+			if (settle_samples > (int)view.samples) settle_samples = (int)view.samples;
+			for (int pass = 0; pass < 3 && settle_samples > 0; pass++) MadgwickAHRSupdateBatch(q, input, settle_samples, odr, m_settings.settleBeta, nullptr);
+		}
+		MadgwickAHRSupdateBatch(q, input, (int)view.samples, odr, m_settings.beta, m_quaternions.data());
+
+		for (uint32_t i = 0; i < view.samples; i++)
+		{
+			//Work out the Euler angles the same way the Personal Caddie class does and feed the sample to the detector
+			const float* sq = &m_quaternions[4 * i];
+			float w = sq[0], x = sq[1], y = sq[2], z = sq[3];
+			float sin_pitch = 2.0f * (w * y - x * z);
+			if (sin_pitch > 1.0f) sin_pitch = 1.0f;
+			else if (sin_pitch < -1.0f) sin_pitch = -1.0f;
+
+			float gx = m_channels[3][i], gy = m_channels[4][i], gz = m_channels[5][i];
+			SwingSample sample = { m_times[i], { w, x, y, z },
+				{ atan2f(2.0f * (w * x + y * z), 1.0f - 2.0f * (x * x + y * y)), asinf(sin_pitch), atan2f(2.0f * (w * z + x * y), 1.0f - 2.0f * (y * y + z * z)) },
+				gy, gz };
+
+			SwingPhaseEvent event;
+			if (m_detector.addSample(sample, event))
+			{
+				if (event.phase == SwingPhase::ADDRESS) m_addressTime = event.time;
+				else if (event.phase == SwingPhase::BACKSWING)
+				{
+					if (m_swing.started) finishSwing(session_index, table); //the last swing went back to address without a proper end
+					startSwing(m_addressTime);
+				}
+				else if (event.phase == SwingPhase::PRE_ADDRESS && m_swing.started) finishSwing(session_index, table);
+
+				if (m_swing.started) m_swing.phaseTime[static_cast<int>(event.phase)] = event.time;
+				if (m_swing.started && event.phase == SwingPhase::FOLLOW_THROUGH) m_swing.impact = m_detector.impact();
+			}
+
+			if (m_swing.started) addSwingSample(m_detector.phase(), m_detector.clubVector(), gx, gy, gz);
+			m_previousClubVector = m_detector.clubVector();
+		}
+		samples += view.samples;
+	}
+	if (m_swing.started) finishSwing(session_index, table); //the session ended part way through a swing
+
+	if (stats != nullptr)
+	{
+		stats->samples += samples;
+		stats->recordingSeconds += samples / odr;
+		stats->swings += (uint32_t)table.rows() - first_row;
+		stats->abandonedSwings += m_abandonedSwings;
+	}
+	return true;
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "SwingPhaseDetector.h"
+#include "../Devices/SessionFile.h"
+
+/*
+Everything needed to go back over a recorded session and pull out the numbers for
+each swing in it. A session file gets calibrated with the numbers saved in its
+header, run through the Madgwick filter and then through the same SwingPhaseDetector
+the free swing mode uses, one chunk of the file at a time. Every swing that makes it
+to impact becomes a row of the SwingMetricsTable. Like the detector, nothing in here
+depends on Windows so whole libraries of sessions can be analyzed on any platform
+(see Replay_Tool/swing_batch.cpp).
+*/
+
+//Definitions
+#define SWING_ANALYTICS_BETA            0.041f //Madgwick filter gain, the same one the app starts with
+#define SWING_ANALYTICS_SETTLE_BETA     2.5f   //gain used to settle the filter at the start of a session
+#define SWING_ANALYTICS_SETTLE_SECONDS  1.0f   //length of the start of a session used to settle the filter
+#define SWING_ANALYTICS_CLUB_RADIUS     1.6f   //meters from the golfer's shoulders to the club head (arms plus a driver)
+
+//The columns of the metrics table. Durations are in seconds, angular velocities in deg/s,
+//speeds in m/s and angles in degrees.
+enum class SwingMetric
+{
+	SESSION, //index of the session the swing came from
+	SWING, //swing number inside of the session
+	ADDRESS_TIME, //sensor time stamp where the club settled at address
+	IMPACT_TIME, //interpolated between samples when the swing made it to the follow through
+	BACKSWING_DURATION,
+	TRANSITION_DURATION,
+	DOWNSWING_DURATION,
+	FOLLOW_THROUGH_DURATION, //0 if the session ended during the follow through
+	TEMPO, //backswing and transition over downswing
+	PEAK_PITCH_RATE,
+	PEAK_YAW_RATE,
+	PEAK_ANGULAR_SPEED, //largest magnitude of the angular velocity from the start of the downswing until the end of impact
+	IMPACT_ANGULAR_SPEED, //how fast the club was turning at the moment of impact, 0 if the swing never left impact
+	CLUB_HEAD_SPEED, //estimated from the peak angular speed and the club radius
+	BACKSWING_PLANE, //tilt of the plane the club shaft sweeps out from the ground
+	DOWNSWING_PLANE,
+	COUNT
+};
+
+struct SwingAnalyticsSettings
+{
+	float beta = SWING_ANALYTICS_BETA;
+	float settleBeta = SWING_ANALYTICS_SETTLE_BETA;
+	float settleSeconds = SWING_ANALYTICS_SETTLE_SECONDS;
+	float clubRadius = SWING_ANALYTICS_CLUB_RADIUS;
+};
+
+/*
+* Holds swing metrics one column at a time (every column is a plain array of floats) so that
+* a single metric for every swing in a batch can be looked at, summed or written out without
+* touching any of the others. Tables from different sessions can be appended to each other.
+*/
+class SwingMetricsTable
+{
+public:
+	static const int Columns = static_cast<int>(SwingMetric::COUNT);
+	static const char* columnName(SwingMetric metric);
+
+	size_t rows() const { return m_columns[0].size(); }
+	void clear();
+	void reserve(size_t rows);
+
+	void addRow(const float* values); //values holds one float for every column, in column order
+	void append(SwingMetricsTable const& table);
+
+	std::vector<float> const& column(SwingMetric metric) const { return m_columns[static_cast<int>(metric)]; }
+	float at(SwingMetric metric, size_t row) const { return m_columns[static_cast<int>(metric)][row]; }
+
+	bool writeCsv(FILE* file) const;
+	bool writeColumns(FILE* file) const;
+
+private:
+	std::vector<float> m_columns[Columns];
+};
+
+//What happened while a session was being analyzed
+struct SwingAnalyticsStats
+{
+	uint64_t samples = 0;
+	double recordingSeconds = 0.0;
+	uint32_t swings = 0; //swings that made it to impact
+	uint32_t abandonedSwings = 0; //backswings that never made it to impact
+};
+
+/*
+* Analyzes one session at a time. The calibration, fusion and detection for a session all
+* happen a chunk of the file at a time using buffers that are allocated once and then reused,
+* so an analyzer only ever touches a few hundred kilobytes of memory no matter how long the
+* session is. Analyzers don't share anything, so a batch can be split across threads by giving
+* each thread its own.
+*/
+class SwingAnalyzer
+{
+public:
+	SwingAnalyzer(SwingAnalyticsSettings const& settings = SwingAnalyticsSettings());
+
+	bool analyze(SessionFileReader const& session, uint32_t session_index, SwingMetricsTable& table, SwingAnalyticsStats* stats = nullptr);
+
+private:
+	//The numbers gathered for the swing that's currently in progress
+	struct SwingInProgress
+	{
+		bool started;
+		double phaseTime[static_cast<int>(SwingPhase::END) + 1]; //time each phase started at, -1 if it hasn't
+		float peakPitchRate, peakYawRate, peakAngularSpeed;
+		Vec3 backswingNormal, downswingNormal; //sum of the cross products of consecutive club shaft vectors
+		SwingImpact impact;
+	};
+
+	void calibrateChunk(SessionFileChunkView const& view);
+	void startSwing(double address_time);
+	void finishSwing(uint32_t session_index, SwingMetricsTable& table);
+	void addSwingSample(SwingPhase phase, Vec3 const& club_vector, float gx, float gy, float gz);
+
+	SwingAnalyticsSettings m_settings;
+	float m_tables[SESSION_FILE_SENSORS][SESSION_FILE_AXES][SESSION_FILE_AXES + 1]; //calibration matrix and bias for each sensor
+
+	std::vector<float> m_channels[SESSION_FILE_CHANNELS]; //calibrated readings for the current chunk
+	std::vector<float> m_quaternions;
+	std::vector<double> m_times;
+
+	SwingPhaseDetector m_detector;
+	SwingInProgress m_swing;
+	double m_addressTime;
+	Vec3 m_previousClubVector;
+	uint32_t m_swingNumber;
+	uint32_t m_abandonedSwings;
+};
@@ -0,0 +1,393 @@
+#include "SwingPhaseDetector.h"
+
+#include <cmath>
+
+bool detectAddress(ClubEulerAngles& initial_angles, ClubEulerAngles const& current_angles, double current_time, double& start_time)
+{
+	//For the club to be considered at address the roll and pitch angles of the club need
+	//to stay within a given window. Furthermore, once inside of this window the club must
+	//stay relative still over a set period of time. Times are the sensor time stamps (in
+	//seconds) of the current sample and the sample where the club first became still.
+
+	//First, make sure that the club is in the address window
+	if (current_angles.pitch > ADDRESS_MAX_PITCH_THRESHOLD || current_angles.pitch < ADDRESS_MIN_PITCH_THRESHOLD ||
+		current_angles.roll > ADDRESS_MAX_ROLL_THRESHOLD || current_angles.roll < ADDRESS_MIN_ROLL_THRESHOLD)
+	{
+		//Since the club isn't in the necessary window, reset the given address start time,
+		//update the club's initial angles and return false
+		start_time = current_time;
+		initial_angles = current_angles;
+		return false;
+	}
+
+	//If the club is within the address window, see if it's moved beyond the allowed threshold
+	//(i.e. during a club waggle or something similar). If so, reset the swing start_time and
+	//return false.
+	float roll_delta = current_angles.roll - initial_angles.roll;
+	float pitch_delta = current_angles.pitch - initial_angles.pitch;
+	float yaw_delta = current_angles.yaw - initial_angles.yaw;
+
+	if ((roll_delta > ADDRESS_ANGLE_THRESHOLD || roll_delta < -ADDRESS_ANGLE_THRESHOLD) || (pitch_delta > ADDRESS_ANGLE_THRESHOLD || pitch_delta < -ADDRESS_ANGLE_THRESHOLD) ||
+		(yaw_delta > ADDRESS_ANGLE_THRESHOLD || yaw_delta < -ADDRESS_ANGLE_THRESHOLD))
+	{
+		//Although the club is within the proper window, it's moved too much to be considered
+		//at address. Update the start_time, the club's initial angles and return false
+		start_time = current_time;
+		initial_angles = current_angles;
+		return false;
+	}
+
+	//If the club is within the address window and is relatively stationary to when the swing
+	//first started, see if it's been stationary for the necessary time period to be considered
+	//at address. No need to update the initial start time or club angles as they're currently good.
+	return (current_time - start_time) * 1000.0 >= ADDRESS_TIME_THRESHOLD_MS;
+}
+
+bool detectBackswing(ClubEulerAngles const& initial_angles, ClubEulerAngles const& current_angles)
+{
+	//For backswing detection all we do is wait for the club to tilt backwards from the ball
+	//by a set amount. The angle for this is the same as the angles the club had to stay inside
+	//of before it was considered at address. As the name implies, the "backswing" must be in
+	//the direction away from the target, so they only Euler Angle we check here it the pitch
+	//angle.
+
+	//TODO: This currently only makes sense for a righty golfer. At some point in the future
+	//I should add a lefty option (but this is obviously quite a ways off). I should also
+	//add some way to detect a club waggle vs. an actual swing, but again, this will be further
+	//off into the future.
+	if (current_angles.yaw >= (initial_angles.yaw + ADDRESS_ANGLE_THRESHOLD))
+	{
+		return true;
+	}
+	return false;
+}
+
+bool detectTransition(float previous_pitch, float current_pitch, float previous_yaw, float current_yaw, float delta_t)
+{
+	//The transition phase of the golf swing is a little more abstract than other phases. It's called
+	//the transition because it's where the club "transitions" from moving backwards to moving forwards.
+	//Transitions can be short and abrupt, long and smooth, or anywhere in between. Regardless of
+	//what the move looks like in real world though, it can be characterized with data by looking
+	//at the angular velocity rates along the pitch and yaw axes. The angular rate along both of these
+	//axes will spike upwards at the beginning of the backswing and then return back to 0 once the
+	//top of the backswing is reached. Because of this, we flag the transition phase as starting when
+	//both of these angular rates start to decrease from their maximum values.
+
+	//First calculate the slopes for the rotation rates to see how quickly they're changing
+	float pitch_slope = (current_pitch - previous_pitch) / delta_t;
+	float yaw_slope = (current_yaw - previous_yaw) / delta_t;
+
+	//It's not enough to just look at the slope for the data (as depending on how the axes of the
+	//sensors are set up these can be positive or negative). Any data point that's positive will
+	//need a negative slope to get back to 0, likewise, any data point that's currently negative
+	//will need to have a positive slope to get back to 0. If both sets of data are actively
+	//returning to 0 then we return true to indicate that the transition phase has begun.
+	if ((current_pitch > 0 && pitch_slope > 0) || (current_pitch < 0 && pitch_slope < 0) ||
+		(current_yaw > 0 && yaw_slope > 0) || (current_yaw < 0 && yaw_slope < 0)) return false;
+
+	return true;
+}
+
+
+bool detectDownswing(float previous_pitch, float current_pitch, float previous_yaw, float current_yaw, float delta_t)
+{
+	//The start of the downswing is calculated much in the same way that the start of
+	//transition phase is. The only difference here is that we wait for the angular
+	//velocity data to invert along both axis. So if the rate of change in angular
+	//velocity is negative, this means we wait for the angular velocity to move from a
+	//positive number to a negative number. If the rate of change is positive, we do the
+	//opposite and wait for the angular velocity to flip from negativeto positive
+
+	//Calculate the rate of change (slopes) for the angular velocities
+	float pitch_slope = (current_pitch - previous_pitch) / delta_t;
+	float yaw_slope = (current_yaw - previous_yaw) / delta_t;
+
+	if ((pitch_slope > 0 && current_pitch < 0) || (pitch_slope < 0 && current_pitch > 0) ||
+		(yaw_slope > 0 && current_yaw < 0) || (yaw_slope > 0 && current_yaw < 0)) return false;
+
+	return true;
+}
+
+bool detectSwingEnd(float previous_pitch, float current_pitch, float previous_yaw, float current_yaw, float delta_t)
+{
+	//After hitting the ball the golf club will travel some distance up into the air. On
+	//short swings like a chip it won't be very far while during a full swing it will be
+	//up near the golfer's head. In either scenario though, the club must come back down
+	//to the ground. Transitioning from the follow through to the end of the swing will
+	//exhibit very similar properties in the club's angular velocity to what was seen
+	//when going from the backswing to the transition phase of the swing. In fact, the
+	//properties should be identical (just opposite as the swing is moving forwards now)
+	//so we simply call the existing method.
+	return detectTransition(previous_pitch, current_pitch, previous_yaw, current_yaw, delta_t);
+}
+
+float locateImpact(Quat const& previous, Quat const& current, Vec3 const& ball_location, float& rotation)
+{
+	//Near impact the club turns several degrees between samples, so checking whether each sample is close
+	//enough to the ball limits the timing to the ODR. Instead we interpolate between the two samples with a
+	//slerp, which turns the club at a steady rate about a single axis. That makes the dot product of the club
+	//shaft and the ball location a sinusoid of the angle turned, so the point where the shaft comes closest
+	//to the ball can be solved for directly. Returns how far from previous to current (0 to 1) that point is,
+	//rotation gets the angle in radians the club turned between the two samples.
+	Quat delta = Conjugate(previous) * current;
+	if (delta.w < 0.0f) delta = delta * -1.0f; //q and -q are the same orientation, take the short way around
+
+	float sine = Length(delta.vector());
+	rotation = 2.0f * atan2f(sine, delta.w);
+	if (sine <= 0.0f) return 0.0f; //the club didn't move
+
+	//Work in the club's frame at the previous sample where the shaft points down the x-axis. The slerp turns
+	//it about the axis of delta, and by Rodrigues' formula ball . shaft = a * cos(angle) + b * sin(angle) + c.
+	const Vec3 shaft = { 1.0f, 0.0f, 0.0f };
+	Vec3 axis = delta.vector() * (1.0f / sine);
+	Vec3 ball = Rotate(Conjugate(previous), ball_location);
+	float a = Dot(ball, shaft) - Dot(axis, shaft) * Dot(axis, ball);
+	float b = Dot(ball, Cross(axis, shaft));
+
+	float closest = atan2f(b, a);
+	if (closest >= 0.0f && closest <= rotation) return closest / rotation;
+
+	//The club was still heading towards the ball at the current sample, or was already moving away from it
+	//at the previous one, so whichever of the two is closer wins
+	return (a * cosf(rotation) + b * sinf(rotation) > a) ? 1.0f : 0.0f;
+}
+
+void SwingPhaseDetector::reset()
+{
+	//Forget about any swing in progress, the next sample added starts the search for address
+	//over again and gets sample index 0
+	m_phase = SwingPhase::START;
+	m_samples = 0;
+
+	m_initialAngles = { 0.0f, 0.0f, 0.0f };
+	m_addressStartTime = 0.0;
+	m_addressStartSample = 0;
+	m_ballLocation = m_clubVector = { 0.0f, 0.0f, 0.0f };
+
+	m_previousPitchAverage = m_previousYawAverage = 0.0f;
+	startAverage();
+
+	m_previousQuaternion = Quat::identity();
+	m_previousTime = 0.0;
+	m_previousRate = m_rateBefore = m_rateAt = m_rateAfter = -1.0f;
+	m_closest = m_impact = SwingImpact();
+
+	for (int i = 0; i <= static_cast<int>(SwingPhase::END); i++) m_latency[i] = SwingPhaseLatency();
+}
+
+constexpr Vec3 SwingPhaseDetector::clubShaftVector(Quat const& q)
+{
+	//Rotates a unit vector pointing down the x-axis (the direction of the club shaft) by the given
+	//quaternion. This is the same rotation that Rotate() does, only written out for the x-axis.
+	return { q.w * q.w + q.x * q.x - q.y * q.y - q.z * q.z, 2.0f * (q.x * q.y + q.w * q.z), 2.0f * (q.x * q.z - q.w * q.y) };
+}
+
+void SwingPhaseDetector::startAverage()
+{
+	m_averagePoints = 0;
+	m_currentPitchAverage = m_currentYawAverage = 0.0f;
+}
+
+bool SwingPhaseDetector::addToAverage(SwingSample const& sample)
+{
+	//Adds the sample to the current group of samples being averaged. Returns true when the group is full
+	//and the averages are ready to be compared against the previous group.
+	if (m_averagePoints == 0)
+	{
+		m_averageStartSample = m_samples;
+		m_averageStartTime = sample.time;
+	}
+
+	m_currentPitchAverage += sample.pitch_rate;
+	m_currentYawAverage += sample.yaw_rate;
+	if (++m_averagePoints < TRANSITION_MOVING_AVERAGE_POINTS) return false;
+
+	m_currentPitchAverage /= TRANSITION_MOVING_AVERAGE_POINTS;
+	m_currentYawAverage /= TRANSITION_MOVING_AVERAGE_POINTS;
+	return true;
+}
+
+void SwingPhaseDetector::searchForImpact(SwingSample const& sample)
+{
+	//Finds the point between the last sample and this one where the club shaft comes closest to the ball, and
+	//keeps it if it's the closest point of the downswing so far
+	//Only the gap between the two samples gets narrowed to a float, the time stamps themselves can be far enough into
+	//a session that a float can't tell neighbouring samples apart
+	float delta_t = static_cast<float>(sample.time - m_previousTime);
+	if (delta_t <= 0.0f) return;
+
+	float rotation;
+	float fraction = locateImpact(m_previousQuaternion, sample.quaternion, m_ballLocation, rotation);
+	float distance = Distance(clubShaftVector(Slerp(m_previousQuaternion, sample.quaternion, fraction)), m_ballLocation);
+	float rate = rotation / delta_t;
+
+	if (m_closest.found && m_closest.sample + 2 == m_samples) m_rateAfter = rate; //the gap right after the closest point
+	if (!m_closest.found || distance < m_closest.distance)
+	{
+		m_closest.found = true;
+		m_closest.sample = m_samples - 1;
+		m_closest.fraction = fraction;
+		m_closest.time = m_previousTime + fraction * delta_t;
+		m_closest.distance = distance;
+		m_rateBefore = m_previousRate;
+		m_rateAt = rate;
+		m_rateAfter = -1.0f;
+	}
+	m_previousRate = rate;
+}
+
+void SwingPhaseDetector::finishImpact()
+{
+	//The rate over each gap is an average so it belongs to the middle of the gap. The angular speed at impact
+	//comes from a line between the middle of the closest gap and the middle of the gap next to it on the same
+	//side as impact.
+	m_impact = m_closest;
+	if (!m_impact.found) return;
+
+	float fraction = m_impact.fraction;
+	if (fraction < 0.5f && m_rateBefore >= 0.0f) m_impact.angular_speed = m_rateBefore + (m_rateAt - m_rateBefore) * (fraction + 0.5f);
+	else if (fraction >= 0.5f && m_rateAfter >= 0.0f) m_impact.angular_speed = m_rateAt + (m_rateAfter - m_rateAt) * (fraction - 0.5f);
+	else m_impact.angular_speed = m_rateAt;
+}
+
+void SwingPhaseDetector::enterPhase(SwingPhase phase, uint64_t first_sample, double time, SwingPhaseEvent& event)
+{
+	m_phase = phase;
+
+	event.phase = phase;
+	event.sample = first_sample;
+	event.detected_sample = m_samples;
+	event.time = time;
+
+	SwingPhaseLatency& latency = m_latency[static_cast<int>(phase)];
+	uint64_t samples = m_samples - first_sample;
+	latency.count++;
+	latency.total_samples += samples;
+	if (samples > latency.max_samples) latency.max_samples = samples;
+}
+
+bool SwingPhaseDetector::addSample(SwingSample const& sample, SwingPhaseEvent& event)
+{
+	//Moves the state machine along by a single sample. Returns true (and fills out event) if the
+	//sample caused a new phase of the swing to start.
+	bool phase_changed = false;
+	m_clubVector = clubShaftVector(sample.quaternion);
+
+	switch (m_phase)
+	{
+	case SwingPhase::START:
+	case SwingPhase::END:
+	{
+		//Set the initial euler angles for the club and the start time for the swing,
+		//then start waiting for the golfer to address the ball
+		m_initialAngles = sample.angles;
+		m_addressStartTime = sample.time;
+		m_addressStartSample = m_samples;
+		enterPhase(SwingPhase::PRE_ADDRESS, m_samples, sample.time, event);
+		phase_changed = true;
+		break;
+	}
+	case SwingPhase::PRE_ADDRESS:
+	{
+		//Most golfer's have the tendency to waggle the club a few times before they fully
+		//address the ball, which will happen in this phase. Once the club has been still for
+		//long enough the address phase is considered to have started when the club first
+		//stopped moving.
+		if (detectAddress(m_initialAngles, sample.angles, sample.time, m_addressStartTime))
+		{
+			m_initialAngles = sample.angles; //the initial angles now mark the address angles
+
+			//Save the direction of the club shaft at address. This will help us detect when
+			//we're close to impact with the ball later on.
+			m_ballLocation = m_clubVector;
+
+			enterPhase(SwingPhase::ADDRESS, m_addressStartSample, sample.time, event);
+			phase_changed = true;
+		}
+		else if (m_addressStartTime == sample.time) m_addressStartSample = m_samples; //the club moved so the still period starts over
+		break;
+	}
+	case SwingPhase::ADDRESS:
+	{
+		//In the address phase of the swing all we're really doing is waiting
+		//for the golfer to initiate the swing which is a simple check.
+		if (detectBackswing(m_initialAngles, sample.angles))
+		{
+			m_initialAngles = sample.angles;
+			m_previousPitchAverage = m_previousYawAverage = 0.0f;
+			startAverage();
+			m_impact.found = false;
+
+			enterPhase(SwingPhase::BACKSWING, m_samples, sample.time, event);
+			phase_changed = true;
+		}
+		break;
+	}
+	case SwingPhase::BACKSWING:
+	case SwingPhase::TRANSITION:
+	case SwingPhase::FOLLOW_THROUGH:
+	{
+		//These three phases all end when the averaged angular velocity along the pitch and yaw axes
+		//turns around. When it does, the new phase started at the first sample of the group of samples
+		//where the turn around was seen.
+		if (!addToAverage(sample)) break;
+
+		float delta_t = static_cast<float>(sample.time - m_averageStartTime);
+		if (delta_t <= 0.0f) delta_t = 1.0f; //only the sign of the slopes matter
+
+		if (m_phase == SwingPhase::BACKSWING && detectTransition(m_previousPitchAverage, m_currentPitchAverage, m_previousYawAverage, m_currentYawAverage, delta_t))
+		{
+			enterPhase(SwingPhase::TRANSITION, m_averageStartSample, m_averageStartTime, event);
+			phase_changed = true;
+		}
+		else if (m_phase == SwingPhase::TRANSITION && detectDownswing(m_previousPitchAverage, m_currentPitchAverage, m_previousYawAverage, m_currentYawAverage, delta_t))
+		{
+			m_closest.found = false;
+			m_previousRate = -1.0f;
+
+			enterPhase(SwingPhase::DOWNSWING, m_averageStartSample, m_averageStartTime, event);
+			phase_changed = true;
+		}
+		else if (m_phase == SwingPhase::FOLLOW_THROUGH && detectSwingEnd(m_previousPitchAverage, m_currentPitchAverage, m_previousYawAverage, m_currentYawAverage, delta_t))
+		{
+			enterPhase(SwingPhase::END, m_averageStartSample, m_averageStartTime, event);
+			phase_changed = true;
+		}
+
+		m_previousPitchAverage = m_currentPitchAverage;
+		m_previousYawAverage = m_currentYawAverage;
+		startAverage();
+		break;
+	}
+	case SwingPhase::DOWNSWING:
+	case SwingPhase::IMPACT:
+	{
+		//Impact starts when the club shaft gets close enough to where it was at address and ends
+		//(moving on to the follow through) when it gets far enough away from it again. The exact
+		//moment of impact is found between samples over the whole window.
+		searchForImpact(sample);
+		float total_distance = Distance(m_clubVector, m_ballLocation);
+
+		if (m_phase == SwingPhase::DOWNSWING && total_distance <= IMPACT_DISTANCE_THRESHOLD)
+		{
+			enterPhase(SwingPhase::IMPACT, m_samples, sample.time, event);
+			phase_changed = true;
+		}
+		else if (m_phase == SwingPhase::IMPACT && total_distance > IMPACT_DISTANCE_THRESHOLD)
+		{
+			m_previousPitchAverage = m_previousYawAverage = 0.0f;
+			startAverage();
+			finishImpact();
+
+			enterPhase(SwingPhase::FOLLOW_THROUGH, m_samples, sample.time, event);
+			phase_changed = true;
+		}
+		break;
+	}
+	}
+
+	m_previousQuaternion = sample.quaternion;
+	m_previousTime = sample.time;
+	m_samples++;
+	return phase_changed;
+}
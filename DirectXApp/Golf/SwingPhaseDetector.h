@@ -0,0 +1,159 @@
+#pragma once
+
+#include <cstdint>
+
+#include "../Math/vector_math.h"
+
+/*
+The golf swing can be broken up into a few distinct phases: address, backswing,
+transition, downswing, impact and follow through. The SwingPhaseDetector class
+at the bottom of this file walks through these phases one sample at a time using
+the time stamps that come from the sensor itself. Nothing in here depends on Windows
+(or glm) so recorded sessions can be run through it on any platform.
+*/
+
+//Definitions
+#define DEGREES_TO_RADIANS 0.017453278f //pi / 180
+
+#define ADDRESS_TIME_THRESHOLD_MS 2000.0f
+#define ADDRESS_ANGLE_THRESHOLD (5.0f * DEGREES_TO_RADIANS)
+#define ADDRESS_MAX_PITCH_THRESHOLD (80.0f * DEGREES_TO_RADIANS)
+#define ADDRESS_MIN_PITCH_THRESHOLD (10.0f * DEGREES_TO_RADIANS)
+#define ADDRESS_MAX_ROLL_THRESHOLD (120.0f * DEGREES_TO_RADIANS)
+#define ADDRESS_MIN_ROLL_THRESHOLD (60.0f * DEGREES_TO_RADIANS)
+
+#define TRANSITION_MOVING_AVERAGE_POINTS 5
+#define TRANSITION_INTERCEPT_THRESHOLD 0.5f //Will need to tweak this value accordingly
+
+#define IMPACT_DISTANCE_THRESHOLD 0.175f
+
+//Structs and Enums
+struct ClubEulerAngles
+{
+	float roll;
+	float pitch;
+	float yaw;
+};
+
+enum class SwingPhase
+{
+	START,
+	PRE_ADDRESS,
+	ADDRESS,
+	BACKSWING,
+	TRANSITION,
+	DOWNSWING,
+	IMPACT,
+	FOLLOW_THROUGH,
+	END
+};
+
+bool detectAddress(ClubEulerAngles& initial_angles, ClubEulerAngles const& current_angles, double current_time, double& start_time);
+bool detectBackswing(ClubEulerAngles const& initial_angles, ClubEulerAngles const& current_angles);
+bool detectTransition(float previous_pitch, float current_pitch, float previous_yaw, float current_yaw, float delta_t);
+bool detectDownswing(float previous_pitch, float current_pitch, float previous_yaw, float current_yaw, float delta_t);
+bool detectSwingEnd(float previous_pitch, float current_pitch, float previous_yaw, float current_yaw, float delta_t);
+float locateImpact(Quat const& previous, Quat const& current, Vec3 const& ball_location, float& rotation);
+
+//Everything the detector needs to know about a single fused sample
+struct SwingSample
+{
+	double time; //time stamp from the sensor in seconds, on the same timeline as the session data store
+	Quat quaternion; //orientation with the heading offset already applied
+	ClubEulerAngles angles; //radians
+	float pitch_rate, yaw_rate; //angular velocity about the pitch and yaw axes (gyroscope y and z)
+};
+
+//A phase of the swing that was just entered. The sample is where the data says the phase began,
+//which for phases that need a few samples to be sure of (like address or the transition) comes
+//before the sample that actually triggered the detection.
+struct SwingPhaseEvent
+{
+	SwingPhase phase;
+	uint64_t sample; //index of the first sample in the new phase
+	uint64_t detected_sample; //index of the sample that caused the phase change
+	double time; //sensor time stamp of the first sample in the new phase
+};
+
+//Where the club shaft actually got back to the ball. The samples on either side of it are usually several degrees
+//apart, so the orientation gets interpolated between them to find the moment the shaft came closest to where it
+//was at address.
+struct SwingImpact
+{
+	bool found;
+	uint64_t sample; //index of the last sample before impact
+	float fraction; //how far impact is from that sample to the next one, between 0 and 1
+	double time; //interpolated sensor time stamp of impact in seconds
+	float distance; //distance from the club shaft to the ball location at impact
+	float angular_speed; //how fast the club was rotating at impact in rad/s
+};
+
+//How many samples it takes to detect each phase after it starts
+struct SwingPhaseLatency
+{
+	uint32_t count = 0;
+	uint64_t total_samples = 0;
+	uint64_t max_samples = 0;
+
+	double average() const { return (count > 0) ? (double)total_samples / count : 0.0; }
+};
+
+/*
+* Runs the address -> backswing -> transition -> downswing -> impact -> follow through state machine over
+* every sample coming from the sensor, instead of only the samples that happen to get rendered. All timing
+* comes from the sample time stamps so the result doesn't depend on the frame rate, or on whether the data is
+* live or being replayed. Each sample costs a fixed amount of work and nothing gets allocated, so a recorded
+* session can be run through it far faster than real time.
+*/
+class SwingPhaseDetector
+{
+public:
+	SwingPhaseDetector() { reset(); }
+
+	void reset();
+	bool addSample(SwingSample const& sample, SwingPhaseEvent& event);
+
+	SwingPhase phase() const { return m_phase; }
+	uint64_t samples() const { return m_samples; }
+	Vec3 const& ballLocation() const { return m_ballLocation; } //unit vector along the club shaft at address
+	Vec3 const& clubVector() const { return m_clubVector; } //unit vector along the club shaft for the last sample
+	SwingPhaseLatency const& latency(SwingPhase phase) const { return m_latency[static_cast<int>(phase)]; }
+	SwingImpact const& impact() const { return m_impact; } //impact of the current swing, found once the follow through starts
+
+private:
+	void enterPhase(SwingPhase phase, uint64_t first_sample, double time, SwingPhaseEvent& event);
+	void startAverage();
+	bool addToAverage(SwingSample const& sample);
+	void searchForImpact(SwingSample const& sample);
+	void finishImpact();
+	static constexpr Vec3 clubShaftVector(Quat const& quaternion);
+
+	SwingPhase m_phase;
+	uint64_t m_samples; //total samples seen so far, the next sample gets this index
+
+	ClubEulerAngles m_initialAngles;
+	double m_addressStartTime;
+	uint64_t m_addressStartSample;
+	Vec3 m_ballLocation;
+	Vec3 m_clubVector;
+
+	//The transition, downswing and end of the swing are found by comparing the average pitch and yaw
+	//rates of consecutive groups of TRANSITION_MOVING_AVERAGE_POINTS samples
+	int m_averagePoints;
+	float m_previousPitchAverage, m_currentPitchAverage;
+	float m_previousYawAverage, m_currentYawAverage;
+	double m_averageStartTime;
+	uint64_t m_averageStartSample;
+
+	//Every gap between samples from the start of the downswing until the end of impact gets searched for the point
+	//where the club shaft is closest to the ball. The rotation rates over the gaps on either side of the closest one
+	//let the angular speed be interpolated to the moment of impact as well.
+	Quat m_previousQuaternion;
+	double m_previousTime;
+	float m_previousRate; //rad/s over the gap before the last sample
+	float m_rateBefore, m_rateAt, m_rateAfter; //rad/s over the gaps before, at and after the closest point, -1 if unknown
+	SwingImpact m_closest; //closest point found so far in the current downswing
+	SwingImpact m_impact;
+
+	SwingPhaseLatency m_latency[static_cast<int>(SwingPhase::END) + 1];
+};
@@ -0,0 +1,112 @@
+#include "DecimationPyramid.h"
+
+#include <algorithm>
+
+void DecimationPyramid::clear()
+{
+	m_points.clear();
+	m_levels.clear();
+	m_minimumY = 0.0f;
+	m_maximumY = 0.0f;
+}
+
+void DecimationPyramid::reserve(size_t points)
+{
+	//Every level has half as many buckets as the one below it. Levels that don't exist yet get
+	//created (and allocated) as the data grows.
+	m_points.reserve(points);
+	for (size_t level = 0; level < m_levels.size(); level++) m_levels[level].reserve((points >> (level + 1)) + 1);
+}
+
+void DecimationPyramid::addToBucket(std::vector<Bucket>& level, size_t bucket, DecimationPoint const& minimum, DecimationPoint const& maximum)
+{
+	//Either starts a new bucket or folds the given min and max into the last one. Ties keep the
+	//earlier point so a flat line stays at the start of the bucket.
+	if (bucket == level.size())
+	{
+		level.push_back({ minimum, maximum });
+		return;
+	}
+
+	Bucket& current = level[bucket];
+	if (minimum.y < current.minimum.y) current.minimum = minimum;
+	if (maximum.y > current.maximum.y) current.maximum = maximum;
+}
+
+void DecimationPyramid::append(float x, float y)
+{
+	DecimationPoint point = { x, y };
+	size_t index = m_points.size();
+	m_points.push_back(point);
+
+	if (index == 0) m_minimumY = m_maximumY = y;
+	else
+	{
+		m_minimumY = std::min(m_minimumY, y);
+		m_maximumY = std::max(m_maximumY, y);
+	}
+
+	//The new point lands in the last bucket of every level, which either gets updated or started
+	for (size_t level = 0; level < m_levels.size(); level++) addToBucket(m_levels[level], index >> (level + 1), point, point);
+
+	//Add a new level on top once the highest level has more than one bucket. Its buckets come from
+	//pairs of buckets in the level below.
+	while ((m_levels.empty() && m_points.size() > 2) || (!m_levels.empty() && m_levels.back().size() > 2))
+	{
+		m_levels.emplace_back();
+		std::vector<Bucket>& level = m_levels.back();
+
+		if (m_levels.size() == 1)
+		{
+			for (size_t i = 0; i < m_points.size(); i++) addToBucket(level, i >> 1, m_points[i], m_points[i]);
+		}
+		else
+		{
+			std::vector<Bucket> const& below = m_levels[m_levels.size() - 2];
+			for (size_t i = 0; i < below.size(); i++) addToBucket(level, i >> 1, below[i].minimum, below[i].maximum);
+		}
+	}
+}
+
+size_t DecimationPyramid::query(float x_minimum, float x_maximum, size_t max_points, std::vector<DecimationPoint>& points) const
+{
+	//Fills points with at most max_points points that trace out the data between x_minimum and x_maximum.
+	//One point on either side of the range is included (if there is one) so lines run all the way to the
+	//edges of a graph. Returns the number of points added.
+	points.clear();
+	if (m_points.empty() || x_maximum < x_minimum) return 0;
+	if (max_points < 4) max_points = 4; //the top level has at most 2 buckets, so 4 points can always cover any range
+
+	auto compare_x = [](DecimationPoint const& point, float x) { return point.x < x; };
+	size_t begin = std::lower_bound(m_points.begin(), m_points.end(), x_minimum, compare_x) - m_points.begin();
+	size_t end = std::lower_bound(m_points.begin() + begin, m_points.end(), x_maximum, [](DecimationPoint const& point, float x) { return !(x < point.x); }) - m_points.begin();
+	if (begin > 0) begin--;
+	if (end < m_points.size()) end++;
+	if (end <= begin) return 0;
+
+	if (end - begin <= max_points)
+	{
+		points.insert(points.end(), m_points.begin() + begin, m_points.begin() + end);
+		return points.size();
+	}
+
+	//Find the finest level where the buckets covering the range give no more than max_points points
+	size_t level = 0;
+	for (; level < m_levels.size(); level++)
+	{
+		size_t buckets = ((end - 1) >> (level + 1)) - (begin >> (level + 1)) + 1;
+		if (2 * buckets <= max_points) break;
+	}
+
+	std::vector<Bucket> const& buckets = m_levels[level];
+	size_t last_bucket = (end - 1) >> (level + 1);
+	for (size_t i = begin >> (level + 1); i <= last_bucket; i++)
+	{
+		Bucket const& bucket = buckets[i];
+		bool minimum_first = bucket.minimum.x <= bucket.maximum.x;
+		points.push_back(minimum_first ? bucket.minimum : bucket.maximum);
+		if (bucket.minimum.x != bucket.maximum.x || bucket.minimum.y != bucket.maximum.y) points.push_back(minimum_first ? bucket.maximum : bucket.minimum);
+	}
+
+	return points.size();
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+//A single (x, y) data point. A plain struct is used instead of DirectX::XMFLOAT2 so the pyramid can
+//be built on platforms other than Windows.
+struct DecimationPoint
+{
+	float x, y;
+};
+
+/*
+* The DecimationPyramid holds a single series of graph data (x must never decrease, like time) along
+* with a stack of min/max summaries of it. Level 0 has a bucket for every 2 points, level 1 a bucket
+* for every 4 points, and so on, where each bucket remembers the points with the lowest and highest
+* y-values in it. Points are appended one at a time and every level is kept up to date as they come in
+* (O(log n) work per point), so the pyramid can be queried while data is still being recorded.
+*
+* A query picks the coarsest level that still gives the requested number of points for the x-range
+* being looked at and returns the min and max point of each bucket in x order. Drawing lines through
+* those points keeps every peak and valley of the original data, so a graph never needs to draw more
+* than a line or two per pixel column no matter how much data there is. Zooming in just queries a
+* smaller x-range, which automatically drops down to finer levels (and eventually the raw points).
+*/
+class DecimationPyramid
+{
+public:
+	DecimationPyramid() {}
+
+	void clear();
+	void reserve(size_t points);
+	void append(float x, float y);
+
+	size_t size() const { return m_points.size(); }
+	int levels() const { return (int)m_levels.size(); }
+	DecimationPoint const& point(size_t i) const { return m_points[i]; }
+	float minimumY() const { return m_minimumY; }
+	float maximumY() const { return m_maximumY; }
+
+	size_t query(float x_minimum, float x_maximum, size_t max_points, std::vector<DecimationPoint>& points) const;
+
+private:
+	struct Bucket
+	{
+		DecimationPoint minimum, maximum;
+	};
+
+	void addToBucket(std::vector<Bucket>& level, size_t bucket, DecimationPoint const& minimum, DecimationPoint const& maximum);
+
+	std::vector<DecimationPoint> m_points;
+	std::vector<std::vector<Bucket> > m_levels; //bucket i of level L covers points [i * 2^(L+1), (i + 1) * 2^(L+1))
+	float m_minimumY = 0.0f, m_maximumY = 0.0f;
+};
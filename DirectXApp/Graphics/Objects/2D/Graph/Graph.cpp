@@ -92,24 +92,7 @@ void Graph::addGraphData(std::vector<DirectX::XMFLOAT2> const& dataPoints, UICol
 	auto location = getAbsoluteLocation();
 	auto size = getAbsoluteSize();
 
-	//If there's any existing GraphDataSet child element add this new set to it, otherwise
-	//create a new GraphDataSet child element to add lines and or points to. This allows us to alter entire
-	//data sets without needing to change the properties of each individual line or point.
-	if (dynamic_cast<GraphDataSet*>(p_children.back().get()) == nullptr)
-	{
-		GraphDataSet gds(m_screenSize, location, size, m_minimalDataPoint, m_maximalDataPoint);
-
-		//If we can zoom in on the graph then also add grid lines with labels
-		//which help keep track of the current zoom level
-		if (m_isClickable)
-		{
-			gds.addGridLines(6, 6, m_maximalAbsolutePoint, m_minimalAbsolutePoint);
-			p_children[1]->removeState(UIElementState::Invisible);
-			gds.resize();
-		}
-
-		p_children.push_back(std::make_shared<GraphDataSet>(gds));
-	}
+	addGraphDataSet();
 
 	GraphData newData(m_screenSize, location, size, name);
 
@@ -137,22 +120,133 @@ void Graph::addGraphData(std::vector<DirectX::XMFLOAT2> const& dataPoints, UICol
 		}
 	}
 
-	//Add the new GraphData object to the current GraphDataSet object
-	if (newData.getChildren().size() > 0)
+	addToCurrentDataSet(newData);
+}
+
+void Graph::addGraphData(std::shared_ptr<DecimationPyramid> const& data, UIColor lineColor, std::wstring name)
+{
+	//Adds a line to the graph for a set of data held in a DecimationPyramid. Instead of creating a line
+	//between every pair of points (which for long recordings can be hundreds of thousands of lines) the
+	//pyramid is asked for about two points per pixel column of the graph, which keeps every peak and valley
+	//visible while only creating a few thousand lines. The pyramid is saved with the lines so that zooming
+	//in can ask it for more detail.
+	if (data == nullptr || data->size() < 2) return;
+
+	addGraphDataSet();
+
+	GraphData newData(m_screenSize, getAbsoluteLocation(), getAbsoluteSize(), name, data);
+	addDecimatedLines(newData, *data, lineColor, m_minimalDataPoint, m_maximalDataPoint);
+
+	addToCurrentDataSet(newData);
+}
+
+void Graph::addGraphDataSet()
+{
+	//If there's any existing GraphDataSet child element new data gets added to it, otherwise
+	//create a new GraphDataSet child element to add lines and or points to. This allows us to alter entire
+	//data sets without needing to change the properties of each individual line or point.
+	if (dynamic_cast<GraphDataSet*>(p_children.back().get()) != nullptr) return;
+
+	GraphDataSet gds(m_screenSize, getAbsoluteLocation(), getAbsoluteSize(), m_minimalDataPoint, m_maximalDataPoint);
+
+	//If we can zoom in on the graph then also add grid lines with labels
+	//which help keep track of the current zoom level
+	if (m_isClickable)
+	{
+		gds.addGridLines(6, 6, m_maximalAbsolutePoint, m_minimalAbsolutePoint);
+		p_children[1]->removeState(UIElementState::Invisible);
+		gds.resize();
+	}
+
+	p_children.push_back(std::make_shared<GraphDataSet>(gds));
+}
+
+void Graph::addToCurrentDataSet(GraphData& data)
+{
+	//Add a new GraphData object to the current GraphDataSet object
+	if (data.getChildren().size() == 0) return;
+
+	//Make sure the lines composing the graph data are the appropriate pixel size
+	//before adding to the set
+	data.resize();
+
+	if (!((GraphDataSet*)p_children.back().get())->hasKey() && m_hasKey)
 	{
-		//Make sure the lines composing the graph data are the appropriate pixel size
-		//before adding to the set
-		newData.resize();
+		//If the graph should have a key and doesn't yet add it now
+		auto location = getAbsoluteLocation();
+		auto size = getAbsoluteSize();
+		GraphKey key(m_screenSize, { location.x + 2.0f * size.x / 5.0f, location.y - 2.0f * size.y / 5.0f }, { size.x / 5.0f, size.y / 5.0f });
+		((GraphDataSet*)p_children.back().get())->addKey(key);
+	}
+
+	((GraphDataSet*)p_children.back().get())->addGraphData(data);
+}
 
-		if (!((GraphDataSet*)p_children.back().get())->hasKey() && m_hasKey)
+void Graph::addDecimatedLines(GraphData& graphData, DecimationPyramid const& data, UIColor lineColor, DirectX::XMFLOAT2 minimums, DirectX::XMFLOAT2 maximums)
+{
+	//Creates lines for the part of the data that falls between the given minimum and maximum x-values. The
+	//pyramid never hands back more points than there are pixel columns in the graph (times two, as each column
+	//can have a min and a max), so no matter how much data there is, or how zoomed in the graph is, the
+	//number of lines stays about the same.
+	size_t max_points = 2 * (size_t)getPixelSize().x;
+	data.query(minimums.x, maximums.x, max_points, m_decimatedPoints);
+
+	DirectX::XMFLOAT2 absolutePointOne, absolutePointTwo;
+	for (size_t i = 1; i < m_decimatedPoints.size(); i++)
+	{
+		DirectX::XMFLOAT2 dataPointOne = { m_decimatedPoints[i - 1].x, m_decimatedPoints[i - 1].y };
+		DirectX::XMFLOAT2 dataPointTwo = { m_decimatedPoints[i].x, m_decimatedPoints[i].y };
+		if (!clipLineToGraph(dataPointOne, dataPointTwo, minimums, maximums, absolutePointOne, absolutePointTwo)) continue;
+
+		Line line(m_screenSize, absolutePointOne, absolutePointTwo, lineColor);
+		graphData.addLine(line);
+	}
+}
+
+bool Graph::clipLineToGraph(DirectX::XMFLOAT2 dataPointOne, DirectX::XMFLOAT2 dataPointTwo, DirectX::XMFLOAT2 minimums, DirectX::XMFLOAT2 maximums,
+	DirectX::XMFLOAT2& absolutePointOne, DirectX::XMFLOAT2& absolutePointTwo)
+{
+	//Converts a line between two data points into absolute coordinates for a graph that shows the data
+	//between the given minimums and maximums. If only part of the line is inside the graph it gets trimmed
+	//so that it stops at the edge of the graph. Returns false if no part of the line is inside the graph.
+	DirectX::XMFLOAT2 absoluteDifference = { m_maximalAbsolutePoint.x - m_minimalAbsolutePoint.x, m_maximalAbsolutePoint.y - m_minimalAbsolutePoint.y };
+	DirectX::XMFLOAT2 difference = { maximums.x - minimums.x, maximums.y - minimums.y };
+
+	absolutePointOne = { absoluteDifference.x * ((dataPointOne.x - minimums.x) / difference.x) + m_minimalAbsolutePoint.x, -1 * (absoluteDifference.y * ((dataPointOne.y - minimums.y) / difference.y) - m_maximalAbsolutePoint.y) };
+	absolutePointTwo = { absoluteDifference.x * ((dataPointTwo.x - minimums.x) / difference.x) + m_minimalAbsolutePoint.x, -1 * (absoluteDifference.y * ((dataPointTwo.y - minimums.y) / difference.y) - m_maximalAbsolutePoint.y) };
+
+	//See if the points fall inside the graph boundaries
+	bool first_data_point_in_bounds = ((dataPointOne.x >= minimums.x) && (dataPointOne.x <= maximums.x)) && ((dataPointOne.y >= minimums.y) && (dataPointOne.y <= maximums.y));
+	bool second_data_point_in_bounds = ((dataPointTwo.x >= minimums.x) && (dataPointTwo.x <= maximums.x)) && ((dataPointTwo.y >= minimums.y) && (dataPointTwo.y <= maximums.y));
+
+	if (first_data_point_in_bounds)
+	{
+		//If both data points already fall inside the graph then there's no 
+		//need to change anything.
+		if (!second_data_point_in_bounds)
 		{
-			//If the graph should have a key and doesn't yet add it now
-			GraphKey key(m_screenSize, { location.x + 2.0f * size.x / 5.0f, location.y - 2.0f * size.y / 5.0f }, { size.x / 5.0f, size.y / 5.0f });
-			((GraphDataSet*)p_children.back().get())->addKey(key);
+			//Only the first data point fits inside the graph. Alter the second
+			//point so that it sits on the edge of the graph.
+			calculateGraphEdgeIntercept(absolutePointTwo, absolutePointOne);
+		}
+	}
+	else
+	{
+		if (second_data_point_in_bounds)
+		{
+			//Only the second data point fits inside the graph. Alter the first
+			//point so that it sits on the edge of the graph.
+			calculateGraphEdgeIntercept(absolutePointOne, absolutePointTwo);
+		}
+		else
+		{
+			//Neither of the points of the line fit inside the graph, however, the line
+			//itself may cross over the graph in which case two new points need to be created.
+			return calculateGraphEdgeIntercepts(absolutePointOne, absolutePointTwo);
 		}
-		
-		((GraphDataSet*)p_children.back().get())->addGraphData(newData);
 	}
+
+	return true;
 }
 
 void Graph::addUIElementBeforeData(std::shared_ptr<UIElement> element)
@@ -400,7 +494,6 @@ void Graph::onMouseRelease()
 	//out if the old point should be placed on the zoomed in graph or not
 	auto data_set_children = p_children.back()->getChildren();
 	DirectX::XMFLOAT2 originalDifference = { m_maximalDataPoint.x - m_minimalDataPoint.x, m_maximalDataPoint.y - m_minimalDataPoint.y };
-	DirectX::XMFLOAT2 newDifference = { new_x_data_max - new_x_data_min, new_y_data_max - new_y_data_min };
 
 	//Don't add existing grid lines or their labels to the zoomed in graph as 
 	//new ones were already added above.
@@ -413,7 +506,18 @@ void Graph::onMouseRelease()
 			//don't bother putting it into the zoomed in view
 			if (data->getState() & UIElementState::Invisible) continue;
 
-			GraphData zoomed_in_data(m_screenSize, location, size, data->getName()); //create a new GraphData object
+			GraphData zoomed_in_data(m_screenSize, location, size, data->getName(), data->getSource()); //create a new GraphData object
+
+			if (data->getSource() != nullptr)
+			{
+				//Data from a DecimationPyramid gets queried again for the zoomed in range instead of
+				//being rebuilt from the lines currently on screen. This brings in detail that the
+				//current zoom level didn't have enough pixels to show.
+				addDecimatedLines(zoomed_in_data, *data->getSource(), data->getDataColor(), new_minimal_points, new_maximal_points);
+				if (zoomed_in_data.getChildren().size() > 0) zoomed_in_data_set.addGraphData(zoomed_in_data);
+				continue;
+			}
+
 			auto existing_data = data->getChildren();
 
 			for (int j = 0; j < existing_data.size(); j++)
@@ -435,43 +539,10 @@ void Graph::onMouseRelease()
 															 ((graph_pixel_location.y + graph_pixel_size.y / 2.0f) - dataPointTwoPixelLocation.y)* originalDifference.y / graph_pixel_size.y + m_minimalDataPoint.y };
 
 					//Calculate the absolute locations of the above data points with the new
-					//zoomed in graph boundaries
-					DirectX::XMFLOAT2 newAbsoluteDataPointOne = { absoluteDifference.x * ((dataPointOne.x - new_x_data_min) / newDifference.x) + m_minimalAbsolutePoint.x, -1 * (absoluteDifference.y * ((dataPointOne.y - new_y_data_min) / newDifference.y) - m_maximalAbsolutePoint.y) };
-					DirectX::XMFLOAT2 newAbsoluteDataPointTwo = { absoluteDifference.x * ((dataPointTwo.x - new_x_data_min) / newDifference.x) + m_minimalAbsolutePoint.x, -1 * (absoluteDifference.y * ((dataPointTwo.y - new_y_data_min) / newDifference.y) - m_maximalAbsolutePoint.y) };
-
-					//See if the first point falls inside the new graph boundaries
-					bool first_data_point_in_bounds = ((dataPointOne.x >= new_x_data_min) && (dataPointOne.x <= new_x_data_max)) && ((dataPointOne.y >= new_y_data_min) && (dataPointOne.y <= new_y_data_max));
-					bool second_data_point_in_bounds = ((dataPointTwo.x >= new_x_data_min) && (dataPointTwo.x <= new_x_data_max)) && ((dataPointTwo.y >= new_y_data_min) && (dataPointTwo.y <= new_y_data_max));
-
-					if (first_data_point_in_bounds)
-					{
-						//If both data points already fall inside the graph then there's no 
-						//need to change anything.
-						if (!second_data_point_in_bounds)
-						{
-							//Only the first data point fits inside the new zoomed in graph.
-							//Alter the second point so that it sits on the edge of the graph.
-							calculateGraphEdgeIntercept(newAbsoluteDataPointTwo, newAbsoluteDataPointOne);
-						}
-					}
-					else
-					{
-						if (second_data_point_in_bounds)
-						{
-							//Only the second data point fits inside the new zoomed in graph.
-							//Alter the first point so that it sits on the edge of the graph.
-							calculateGraphEdgeIntercept(newAbsoluteDataPointOne, newAbsoluteDataPointTwo);
-						}
-						else
-						{
-							//Neither of the points of the line fit inside the new zoomed in graph,
-							//however, the line itself may cross over the graph in which case two
-							//new points need to be created. If the line doesn't cross over the viewing
-							//area then skip ahead to the next line, if it does though then change the
-							//locations of both points as necessary.
-							if (!calculateGraphEdgeIntercepts(newAbsoluteDataPointOne, newAbsoluteDataPointTwo)) continue;
-						}
-					}
+					//zoomed in graph boundaries, trimming the line to the edges of the graph if
+					//necessary. If no part of the line is in the viewing area skip to the next line.
+					DirectX::XMFLOAT2 newAbsoluteDataPointOne, newAbsoluteDataPointTwo;
+					if (!clipLineToGraph(dataPointOne, dataPointTwo, new_minimal_points, new_maximal_points, newAbsoluteDataPointOne, newAbsoluteDataPointTwo)) continue;
 
 					Line new_line(m_screenSize, newAbsoluteDataPointOne, newAbsoluteDataPointTwo, line->getLineColor());
 					zoomed_in_data.addLine(new_line);
@@ -4,6 +4,7 @@
 #include "Graphics/Objects/2D/BasicElements/OutlinedBox.h"
 #include "Graphics/Objects/2D/BasicElements/Ellipse.h"
 #include "GraphKey.h"
+#include "DecimationPyramid.h"
 
 //The basic text box consists of two children UI Elements. There's a shadowed
 //box which is meant as the background for text (default color is white) and
@@ -20,6 +21,7 @@ public:
 	Graph() {} //empty default constructor
 
 	void addGraphData(std::vector<DirectX::XMFLOAT2> const& dataPoints, UIColor lineColor, std::wstring name = L"");
+	void addGraphData(std::shared_ptr<DecimationPyramid> const& data, UIColor lineColor, std::wstring name = L"");
 
 	void setAxisMaxAndMins(DirectX::XMFLOAT2 axis_minimums, DirectX::XMFLOAT2 axis_maximums);
 	void addLine(DirectX::XMFLOAT2 point1, DirectX::XMFLOAT2 point2);
@@ -43,6 +45,11 @@ protected:
 	bool calculateGraphEdgeIntercepts(DirectX::XMFLOAT2& intercept_point_one, DirectX::XMFLOAT2& intercept_point_two);
 
 	void addUIElementBeforeData(std::shared_ptr<UIElement> element);
+	void addGraphDataSet();
+	void addToCurrentDataSet(GraphData& data);
+	void addDecimatedLines(GraphData& graphData, DecimationPyramid const& data, UIColor lineColor, DirectX::XMFLOAT2 minimums, DirectX::XMFLOAT2 maximums);
+	bool clipLineToGraph(DirectX::XMFLOAT2 dataPointOne, DirectX::XMFLOAT2 dataPointTwo, DirectX::XMFLOAT2 minimums, DirectX::XMFLOAT2 maximums,
+		DirectX::XMFLOAT2& absolutePointOne, DirectX::XMFLOAT2& absolutePointTwo);
 
 	DirectX::XMFLOAT2 m_minimalAbsolutePoint, m_maximalAbsolutePoint; //these variables hold the absolute locations for the x and y min/maxes in the graph
 	DirectX::XMFLOAT2 m_minimalDataPoint, m_maximalDataPoint; //these variables hold the actual data locations for the x and y min/maxes in the graph
@@ -53,6 +60,7 @@ protected:
 	bool m_zoomBoxActive; //this bool is true if we actively have a zoom box in place
 	DirectX::XMFLOAT2 m_mouseLocation, m_zoomBoxOrigin;
 	int m_currentZoomLevel;
+	std::vector<DecimationPoint> m_decimatedPoints; //reused by addDecimatedLines() so each query doesn't need a new allocation
 
 	DirectX::XMFLOAT2 convertUnitsToAbsolute(DirectX::XMFLOAT2 coordinates);
 };
\ No newline at end of file
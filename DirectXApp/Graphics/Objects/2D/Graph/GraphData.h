@@ -2,6 +2,7 @@
 
 #include "Graphics/Objects/2D/BasicElements/Line.h"
 #include "Graphics/Objects/2D/BasicElements/Ellipse.h"
+#include "DecimationPyramid.h"
 
 //This class represents multiple points of data that are to 
 //be rendered on a graph. These points can be connected by
@@ -10,16 +11,22 @@
 //This class is handy when we want to alter an entire set of data
 //in some way, whether it's making the data invisible, changing 
 //the scale of the data, etc.
+//
+//Line graphs keep a pointer to the DecimationPyramid their lines were made from. When
+//zooming in, new lines get made from the pyramid instead of from the lines being shown,
+//so finer detail shows up the further in you zoom.
 
 class GraphData : public UIElement
 {
 public:
-	GraphData(std::shared_ptr<winrt::Windows::Foundation::Size> windowSize, DirectX::XMFLOAT2 location, DirectX::XMFLOAT2 size, std::wstring name = L"")
+	GraphData(std::shared_ptr<winrt::Windows::Foundation::Size> windowSize, DirectX::XMFLOAT2 location, DirectX::XMFLOAT2 size, std::wstring name = L"",
+		std::shared_ptr<DecimationPyramid> source = nullptr)
 	{ 
 		m_screenSize = windowSize;
 		updateLocationAndSize(location, size);
 
 		m_name = name;
+		p_source = source;
 
 		m_state &= ~UIElementState::Dummy; //elements created without the default constructor have the dummy flag removed
 		m_state |= UIElementState::Idlee; //Graph Data can't be interacted with, setting this flag will skip the update loop for the data set and all children
@@ -39,8 +46,10 @@ public:
 
 	UIColor getDataColor() const { return m_dataColor; }
 	std::wstring getName() const { return m_name; }
+	std::shared_ptr<DecimationPyramid> const& getSource() const { return p_source; }
 
 private:
 	UIColor m_dataColor;
 	std::wstring m_name;
+	std::shared_ptr<DecimationPyramid> p_source; //the full data set for line graphs, nullptr for scatter plots
 };
\ No newline at end of file
@@ -1,5 +1,5 @@
-#include "pch.h"
 #include "FusionAhrs.h"
+#include <float.h> // FLT_MAX
 
 //------------------------------------------------------------------------------
 // Definitions
@@ -51,13 +51,15 @@ void FusionAhrsInitialise(FusionAhrs* const ahrs) {
  * @param ahrs AHRS algorithm structure.
  */
 void FusionAhrsReset(FusionAhrs* const ahrs) {
-    ahrs->quaternion = FUSION_IDENTITY_QUATERNION;
-    ahrs->accelerometer = FUSION_VECTOR_ZERO;
+    const FusionQuaternion identity = FUSION_IDENTITY_QUATERNION; // named constants instead of brace assignment so this also compiles as C
+    const FusionVector zero = FUSION_VECTOR_ZERO;
+    ahrs->quaternion = identity;
+    ahrs->accelerometer = zero;
     ahrs->initialising = true;
     ahrs->rampedGain = INITIAL_GAIN;
     ahrs->angularRateRecovery = false;
-    ahrs->halfAccelerometerFeedback = FUSION_VECTOR_ZERO;
-    ahrs->halfMagnetometerFeedback = FUSION_VECTOR_ZERO;
+    ahrs->halfAccelerometerFeedback = zero;
+    ahrs->halfMagnetometerFeedback = zero;
     ahrs->accelerometerIgnored = false;
     ahrs->accelerationRecoveryTrigger = 0;
     ahrs->accelerationRecoveryTimeout = ahrs->settings.recoveryTriggerPeriod;
@@ -219,25 +221,24 @@ static inline FusionVector HalfGravity(const FusionAhrs* const ahrs) {
     switch (ahrs->settings.convention) {
     case FusionConventionNwu:
     case FusionConventionEnu: {
-        FusionVector halfGravity;
-        halfGravity.axis = {
+        FusionVector halfGravity = {{
                 Q.x * Q.z - Q.w * Q.y,
                 Q.y * Q.z + Q.w * Q.x,
                 Q.w * Q.w - 0.5f + Q.z * Q.z,
-        }; // third column of transposed rotation matrix scaled by 0.5
+        }}; // third column of transposed rotation matrix scaled by 0.5
         return halfGravity;
     }
     case FusionConventionNed: {
-        FusionVector halfGravity;
-        halfGravity.axis = {
+        FusionVector halfGravity = {{
                 Q.w * Q.y - Q.x * Q.z,
                 -1.0f * (Q.y * Q.z + Q.w * Q.x),
                 0.5f - Q.w * Q.w - Q.z * Q.z,
-        }; // third column of transposed rotation matrix scaled by -0.5
+        }}; // third column of transposed rotation matrix scaled by -0.5
         return halfGravity;
     }
     }
-    return FUSION_VECTOR_ZERO; // avoid compiler warning
+    const FusionVector zero = FUSION_VECTOR_ZERO;
+    return zero; // avoid compiler warning
 #undef Q
 }
 
@@ -250,34 +251,32 @@ static inline FusionVector HalfMagnetic(const FusionAhrs* const ahrs) {
 #define Q ahrs->quaternion.element
     switch (ahrs->settings.convention) {
     case FusionConventionNwu: {
-        FusionVector halfMagnetic;
-        halfMagnetic.axis = {
+        FusionVector halfMagnetic = {{
                 Q.x * Q.y + Q.w * Q.z,
                 Q.w * Q.w - 0.5f + Q.y * Q.y,
                 Q.y * Q.z - Q.w * Q.x,
-        }; // second column of transposed rotation matrix scaled by 0.5
+        }}; // second column of transposed rotation matrix scaled by 0.5
         return halfMagnetic;
     }
     case FusionConventionEnu: {
-        FusionVector halfMagnetic;
-        halfMagnetic.axis = {
+        FusionVector halfMagnetic = {{
                 0.5f - Q.w * Q.w - Q.x * Q.x,
                 Q.w * Q.z - Q.x * Q.y,
                 -1.0f * (Q.x * Q.z + Q.w * Q.y),
-        }; // first column of transposed rotation matrix scaled by -0.5
+        }}; // first column of transposed rotation matrix scaled by -0.5
         return halfMagnetic;
     }
     case FusionConventionNed: {
-        FusionVector halfMagnetic;
-        halfMagnetic.axis = {
+        FusionVector halfMagnetic = {{
                 -1.0f * (Q.x * Q.y + Q.w * Q.z),
                 0.5f - Q.w * Q.w - Q.y * Q.y,
                 Q.w * Q.x - Q.y * Q.z,
-        }; // second column of transposed rotation matrix scaled by -0.5
+        }}; // second column of transposed rotation matrix scaled by -0.5
         return halfMagnetic;
     }
     }
-    return FUSION_VECTOR_ZERO; // avoid compiler warning
+    const FusionVector zero = FUSION_VECTOR_ZERO;
+    return zero; // avoid compiler warning
 #undef Q
 }
 
@@ -322,7 +321,8 @@ static inline int Clamp(const int value, const int min, const int max) {
 void FusionAhrsUpdateNoMagnetometer(FusionAhrs* const ahrs, const FusionVector gyroscope, const FusionVector accelerometer, const float deltaTime) {
 
     // Update AHRS algorithm
-    FusionAhrsUpdate(ahrs, gyroscope, accelerometer, FUSION_VECTOR_ZERO, deltaTime);
+    const FusionVector magnetometer = FUSION_VECTOR_ZERO;
+    FusionAhrsUpdate(ahrs, gyroscope, accelerometer, magnetometer, deltaTime);
 
     // Zero heading during initialisation
     if (ahrs->initialising == true) {
@@ -348,12 +348,11 @@ void FusionAhrsUpdateExternalHeading(FusionAhrs* const ahrs, const FusionVector
     // Calculate magnetometer
     const float headingRadians = FusionDegreesToRadians(heading);
     const float sinHeadingRadians = sinf(headingRadians);
-    FusionVector magnetometer;
-    magnetometer.axis = {
+    FusionVector magnetometer = {{
             cosf(headingRadians),
             -1.0f * cosf(roll) * sinHeadingRadians,
             sinHeadingRadians * sinf(roll),
-    };
+    }};
 
     // Update AHRS algorithm
     FusionAhrsUpdate(ahrs, gyroscope, accelerometer, magnetometer, deltaTime);
@@ -378,6 +377,20 @@ void FusionAhrsSetQuaternion(FusionAhrs* const ahrs, const FusionQuaternion quat
     ahrs->quaternion = quaternion;
 }
 
+/**
+ * @brief Starts the algorithm from a known orientation, such as one from
+ * FusionAlignmentQuaternion.  The initialisation period is skipped since its
+ * only purpose is to converge on the orientation from the identity quaternion.
+ * @param ahrs AHRS algorithm structure.
+ * @param quaternion Quaternion describing the sensor relative to the Earth.
+ */
+void FusionAhrsSetInitialQuaternion(FusionAhrs* const ahrs, const FusionQuaternion quaternion) {
+    FusionAhrsReset(ahrs);
+    ahrs->quaternion = quaternion;
+    ahrs->initialising = false;
+    ahrs->rampedGain = ahrs->settings.gain;
+}
+
 /**
  * @brief Returns the linear acceleration measurement equal to the accelerometer
  * measurement with the 1 g of gravity removed.
@@ -388,12 +401,11 @@ FusionVector FusionAhrsGetLinearAcceleration(const FusionAhrs* const ahrs) {
 #define Q ahrs->quaternion.element
 
     // Calculate gravity in the sensor coordinate frame
-    FusionVector gravity;
-    gravity.axis = {
+    FusionVector gravity = {{
             2.0f * (Q.x * Q.z - Q.w * Q.y),
             2.0f * (Q.y * Q.z + Q.w * Q.x),
             2.0f * (Q.w * Q.w - 0.5f + Q.z * Q.z),
-    }; // third column of transposed rotation matrix
+    }}; // third column of transposed rotation matrix
 
     // Remove gravity from accelerometer measurement
     switch (ahrs->settings.convention) {
@@ -405,7 +417,8 @@ FusionVector FusionAhrsGetLinearAcceleration(const FusionAhrs* const ahrs) {
         return FusionVectorAdd(ahrs->accelerometer, gravity);
     }
     }
-    return FUSION_VECTOR_ZERO; // avoid compiler warning
+    const FusionVector zero = FUSION_VECTOR_ZERO;
+    return zero; // avoid compiler warning
 #undef Q
 }
 
@@ -427,12 +440,11 @@ FusionVector FusionAhrsGetEarthAcceleration(const FusionAhrs* const ahrs) {
     const float qxqy = Q.x * Q.y;
     const float qxqz = Q.x * Q.z;
     const float qyqz = Q.y * Q.z;
-    FusionVector accelerometer;
-    accelerometer.axis = {
+    FusionVector accelerometer = {{
             2.0f * ((qwqw - 0.5f + Q.x * Q.x) * A.x + (qxqy - qwqz) * A.y + (qxqz + qwqy) * A.z),
             2.0f * ((qxqy + qwqz) * A.x + (qwqw - 0.5f + Q.y * Q.y) * A.y + (qyqz - qwqx) * A.z),
             2.0f * ((qxqz - qwqy) * A.x + (qyqz + qwqx) * A.y + (qwqw - 0.5f + Q.z * Q.z) * A.z),
-    }; // rotation matrix multiplied with the accelerometer
+    }}; // rotation matrix multiplied with the accelerometer
 
     // Remove gravity from accelerometer measurement
     switch (ahrs->settings.convention) {
@@ -492,13 +504,12 @@ void FusionAhrsSetHeading(FusionAhrs* const ahrs, const float heading) {
 #define Q ahrs->quaternion.element
     const float yaw = atan2f(Q.w * Q.z + Q.x * Q.y, 0.5f - Q.y * Q.y - Q.z * Q.z);
     const float halfYawMinusHeading = 0.5f * (yaw - FusionDegreesToRadians(heading));
-    FusionQuaternion rotation;
-    rotation.element = {
+    FusionQuaternion rotation = {{
             cosf(halfYawMinusHeading),
             0.0f,
             0.0f,
             -1.0f * sinf(halfYawMinusHeading),
-    };
+    }};
     ahrs->quaternion = FusionQuaternionMultiply(rotation, ahrs->quaternion);
 #undef Q
 }
\ No newline at end of file
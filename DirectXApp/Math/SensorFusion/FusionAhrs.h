@@ -63,6 +63,10 @@ typedef struct {
 //------------------------------------------------------------------------------
 // Function declarations
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 void FusionAhrsInitialise(FusionAhrs* const ahrs);
 
 void FusionAhrsReset(FusionAhrs* const ahrs);
@@ -79,6 +83,8 @@ FusionQuaternion FusionAhrsGetQuaternion(const FusionAhrs* const ahrs);
 
 void FusionAhrsSetQuaternion(FusionAhrs* const ahrs, const FusionQuaternion quaternion);
 
+void FusionAhrsSetInitialQuaternion(FusionAhrs* const ahrs, const FusionQuaternion quaternion);
+
 FusionVector FusionAhrsGetLinearAcceleration(const FusionAhrs* const ahrs);
 
 FusionVector FusionAhrsGetEarthAcceleration(const FusionAhrs* const ahrs);
@@ -89,4 +95,8 @@ FusionAhrsFlags FusionAhrsGetFlags(const FusionAhrs* const ahrs);
 
 void FusionAhrsSetHeading(FusionAhrs* const ahrs, const float heading);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif // !FUSION_AHRS_H
\ No newline at end of file
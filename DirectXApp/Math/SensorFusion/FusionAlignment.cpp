@@ -0,0 +1,200 @@
+#include "FusionAlignment.h"
+
+//------------------------------------------------------------------------------
+// Definitions
+
+/**
+ * @brief Smallest ratio of the magnitude of the summed accelerometer
+ * measurements to the sum of their magnitudes.  Measurements that point in
+ * different directions mean the sensor was moving, 0.995 allows them to be
+ * spread out by about 6 degrees.
+ */
+#define MINIMUM_CONSISTENCY (0.995f)
+
+/**
+ * @brief Smallest sine of the angle between gravity and the magnetic field.
+ * The heading can't be found from a magnetic field that's close to vertical.
+ */
+#define MINIMUM_MAGNETIC_ANGLE_SINE (0.1f)
+
+//------------------------------------------------------------------------------
+// Function declarations
+
+static inline FusionQuaternion MatrixToQuaternion(const FusionMatrix matrix);
+
+//------------------------------------------------------------------------------
+// Functions
+
+/**
+ * @brief Resets the initial alignment, forgetting every measurement.
+ * @param alignment Initial alignment structure.
+ */
+void FusionAlignmentReset(FusionAlignment* const alignment) {
+    const FusionVector zero = FUSION_VECTOR_ZERO;
+    alignment->accelerometer = zero;
+    alignment->magnetometer = zero;
+    alignment->accelerometerMagnitude = 0.0f;
+    alignment->samples = 0;
+    alignment->magnetometerSamples = 0;
+}
+
+/**
+ * @brief Adds a measurement to the initial alignment.
+ * @param alignment Initial alignment structure.
+ * @param accelerometer Accelerometer measurement in any units.
+ * @param magnetometer Magnetometer measurement in any units, a measurement of
+ * zero is ignored.
+ */
+void FusionAlignmentAdd(FusionAlignment* const alignment, const FusionVector accelerometer, const FusionVector magnetometer) {
+    FusionAlignmentAddNoMagnetometer(alignment, accelerometer);
+    if (FusionVectorIsZero(magnetometer) == false) {
+        alignment->magnetometer = FusionVectorAdd(alignment->magnetometer, magnetometer);
+        alignment->magnetometerSamples++;
+    }
+}
+
+/**
+ * @brief Adds a measurement without a magnetometer to the initial alignment.
+ * @param alignment Initial alignment structure.
+ * @param accelerometer Accelerometer measurement in any units.
+ */
+void FusionAlignmentAddNoMagnetometer(FusionAlignment* const alignment, const FusionVector accelerometer) {
+    alignment->accelerometer = FusionVectorAdd(alignment->accelerometer, accelerometer);
+    alignment->accelerometerMagnitude += FusionVectorMagnitude(accelerometer);
+    alignment->samples++;
+}
+
+/**
+ * @brief Returns the number of measurements added since the last reset.
+ * @param alignment Initial alignment structure.
+ * @return Number of measurements.
+ */
+unsigned int FusionAlignmentGetSamples(const FusionAlignment* const alignment) {
+    return alignment->samples;
+}
+
+/**
+ * @brief Calculates the orientation from the averaged measurements.  Fails if
+ * there aren't any measurements or if the sensor was moving while they were
+ * taken, in which case more measurements should be added after a reset.
+ * @param alignment Initial alignment structure.
+ * @param convention Earth axes convention.
+ * @param quaternion Quaternion describing the sensor relative to the Earth.
+ * @return True if the orientation could be found.
+ */
+bool FusionAlignmentQuaternion(const FusionAlignment* const alignment, const FusionConvention convention, FusionQuaternion* const quaternion) {
+    if ((alignment->samples == 0) || FusionVectorIsZero(alignment->accelerometer)) {
+        return false;
+    }
+    if (FusionVectorMagnitude(alignment->accelerometer) < MINIMUM_CONSISTENCY * alignment->accelerometerMagnitude) {
+        return false;
+    }
+    *quaternion = FusionAlignmentTriad(convention, alignment->accelerometer, alignment->magnetometer);
+    return true;
+}
+
+/**
+ * @brief Calculates the orientation from a single accelerometer and
+ * magnetometer measurement with the TRIAD method.  Gravity is matched exactly
+ * and the magnetic field is only used for the heading, so the inclination of
+ * the magnetic field doesn't matter.  Without a usable magnetometer
+ * measurement the heading is zero, like FusionAhrsUpdateNoMagnetometer.
+ * @param convention Earth axes convention.
+ * @param accelerometer Accelerometer measurement in any units.
+ * @param magnetometer Magnetometer measurement in any units.
+ * @return Quaternion describing the sensor relative to the Earth.
+ */
+FusionQuaternion FusionAlignmentTriad(const FusionConvention convention, const FusionVector accelerometer, const FusionVector magnetometer) {
+
+    // Earth axes in the sensor frame
+    const FusionVector up = FusionVectorNormalise(accelerometer);
+    FusionVector west = FusionVectorCrossProduct(up, magnetometer);
+    const float minimumWest = MINIMUM_MAGNETIC_ANGLE_SINE * FusionVectorMagnitude(magnetometer);
+    if (FusionVectorIsZero(magnetometer) || (FusionVectorMagnitudeSquared(west) < minimumWest * minimumWest)) {
+        const FusionVector sensorX = {{1.0f, 0.0f, 0.0f}};
+        const FusionVector sensorY = {{0.0f, 1.0f, 0.0f}};
+        west = FusionVectorCrossProduct(up, sensorX); // north is the sensor x axis projected onto the horizontal
+        if (FusionVectorMagnitudeSquared(west) < (MINIMUM_MAGNETIC_ANGLE_SINE * MINIMUM_MAGNETIC_ANGLE_SINE)) {
+            west = FusionVectorCrossProduct(up, sensorY);
+        }
+    }
+    west = FusionVectorNormalise(west);
+    const FusionVector north = FusionVectorCrossProduct(west, up);
+
+    // Each row of the sensor to Earth rotation matrix is an Earth axis
+    FusionVector rows[3];
+    switch (convention) {
+        case FusionConventionNwu:
+            rows[0] = north;
+            rows[1] = west;
+            rows[2] = up;
+            break;
+        case FusionConventionEnu:
+            rows[0] = FusionVectorMultiplyScalar(west, -1.0f);
+            rows[1] = north;
+            rows[2] = up;
+            break;
+        case FusionConventionNed:
+        default:
+            rows[0] = north;
+            rows[1] = FusionVectorMultiplyScalar(west, -1.0f);
+            rows[2] = FusionVectorMultiplyScalar(up, -1.0f);
+            break;
+    }
+
+    FusionMatrix matrix;
+    for (int row = 0; row < 3; row++) {
+        for (int column = 0; column < 3; column++) {
+            matrix.array[row][column] = rows[row].array[column];
+        }
+    }
+    return MatrixToQuaternion(matrix);
+}
+
+//------------------------------------------------------------------------------
+// Functions - Private
+
+/**
+ * @brief Converts a rotation matrix to a quaternion with a positive w, the
+ * inverse of FusionQuaternionToMatrix.  The largest of w, x, y and z is found
+ * first so nothing gets divided by a number close to zero.
+ * @param matrix Rotation matrix.
+ * @return Quaternion.
+ */
+static inline FusionQuaternion MatrixToQuaternion(const FusionMatrix matrix) {
+#define R matrix.element
+    FusionQuaternion quaternion;
+    const float trace = R.xx + R.yy + R.zz;
+    if (trace > 0.0f) {
+        const float s = 0.5f / sqrtf(trace + 1.0f);
+        quaternion.element.w = 0.25f / s;
+        quaternion.element.x = (R.zy - R.yz) * s;
+        quaternion.element.y = (R.xz - R.zx) * s;
+        quaternion.element.z = (R.yx - R.xy) * s;
+    } else if ((R.xx > R.yy) && (R.xx > R.zz)) {
+        const float s = 2.0f * sqrtf(1.0f + R.xx - R.yy - R.zz);
+        quaternion.element.w = (R.zy - R.yz) / s;
+        quaternion.element.x = 0.25f * s;
+        quaternion.element.y = (R.xy + R.yx) / s;
+        quaternion.element.z = (R.xz + R.zx) / s;
+    } else if (R.yy > R.zz) {
+        const float s = 2.0f * sqrtf(1.0f + R.yy - R.xx - R.zz);
+        quaternion.element.w = (R.xz - R.zx) / s;
+        quaternion.element.x = (R.xy + R.yx) / s;
+        quaternion.element.y = 0.25f * s;
+        quaternion.element.z = (R.yz + R.zy) / s;
+    } else {
+        const float s = 2.0f * sqrtf(1.0f + R.zz - R.xx - R.yy);
+        quaternion.element.w = (R.yx - R.xy) / s;
+        quaternion.element.x = (R.xz + R.zx) / s;
+        quaternion.element.y = (R.yz + R.zy) / s;
+        quaternion.element.z = 0.25f * s;
+    }
+    if (quaternion.element.w < 0.0f) {
+        for (int i = 0; i < 4; i++) {
+            quaternion.array[i] = -quaternion.array[i];
+        }
+    }
+    return FusionQuaternionNormalise(quaternion);
+#undef R
+}
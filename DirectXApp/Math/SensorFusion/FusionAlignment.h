@@ -0,0 +1,51 @@
+#ifndef FUSION_ALIGNMENT_H
+#define FUSION_ALIGNMENT_H
+
+//------------------------------------------------------------------------------
+// Includes
+
+#include "FusionConvention.h"
+#include "FusionMath.h"
+
+//------------------------------------------------------------------------------
+// Definitions
+
+/**
+ * @brief Initial alignment structure.  Accumulates accelerometer and
+ * magnetometer measurements taken while the sensor is held still so the
+ * orientation can be found in closed form (TRIAD) instead of waiting for a
+ * filter to converge on it.  Structure members are used internally and must
+ * not be accessed by the application.
+ */
+typedef struct {
+    FusionVector accelerometer;
+    FusionVector magnetometer;
+    float accelerometerMagnitude;
+    unsigned int samples;
+    unsigned int magnetometerSamples;
+} FusionAlignment;
+
+//------------------------------------------------------------------------------
+// Function declarations
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void FusionAlignmentReset(FusionAlignment* const alignment);
+
+void FusionAlignmentAdd(FusionAlignment* const alignment, const FusionVector accelerometer, const FusionVector magnetometer);
+
+void FusionAlignmentAddNoMagnetometer(FusionAlignment* const alignment, const FusionVector accelerometer);
+
+unsigned int FusionAlignmentGetSamples(const FusionAlignment* const alignment);
+
+bool FusionAlignmentQuaternion(const FusionAlignment* const alignment, const FusionConvention convention, FusionQuaternion* const quaternion);
+
+FusionQuaternion FusionAlignmentTriad(const FusionConvention convention, const FusionVector accelerometer, const FusionVector magnetometer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -193,12 +193,11 @@ static inline bool FusionVectorIsZero(const FusionVector vector) {
  * @return Sum of two vectors.
  */
 static inline FusionVector FusionVectorAdd(const FusionVector vectorA, const FusionVector vectorB) {
-    FusionVector result;
-    result.axis = {
+    FusionVector result = {{
             vectorA.axis.x + vectorB.axis.x,
             vectorA.axis.y + vectorB.axis.y,
             vectorA.axis.z + vectorB.axis.z,
-    };
+    }};
     return result;
 }
 
@@ -209,12 +208,11 @@ static inline FusionVector FusionVectorAdd(const FusionVector vectorA, const Fus
  * @return Vector B subtracted from vector A.
  */
 static inline FusionVector FusionVectorSubtract(const FusionVector vectorA, const FusionVector vectorB) {
-    FusionVector result;
-    result.axis = {
+    FusionVector result = {{
             vectorA.axis.x - vectorB.axis.x,
             vectorA.axis.y - vectorB.axis.y,
             vectorA.axis.z - vectorB.axis.z,
-    };
+    }};
     return result;
 }
 
@@ -234,12 +232,11 @@ static inline float FusionVectorSum(const FusionVector vector) {
  * @return Multiplication of a vector by a scalar.
  */
 static inline FusionVector FusionVectorMultiplyScalar(const FusionVector vector, const float scalar) {
-    FusionVector result;
-    result.axis = {
+    FusionVector result = {{
             vector.axis.x * scalar,
             vector.axis.y * scalar,
             vector.axis.z * scalar,
-    };
+    }};
     return result;
 }
 
@@ -250,12 +247,11 @@ static inline FusionVector FusionVectorMultiplyScalar(const FusionVector vector,
  * @return Hadamard product.
  */
 static inline FusionVector FusionVectorHadamardProduct(const FusionVector vectorA, const FusionVector vectorB) {
-    FusionVector result;
-    result.axis = {
+    FusionVector result = {{
             vectorA.axis.x * vectorB.axis.x,
             vectorA.axis.y * vectorB.axis.y,
             vectorA.axis.z * vectorB.axis.z,
-    };
+    }};
     return result;
 }
 
@@ -268,12 +264,11 @@ static inline FusionVector FusionVectorHadamardProduct(const FusionVector vector
 static inline FusionVector FusionVectorCrossProduct(const FusionVector vectorA, const FusionVector vectorB) {
 #define A vectorA.axis
 #define B vectorB.axis
-    FusionVector result;
-    result.axis = {
+    FusionVector result = {{
             A.y * B.z - A.z * B.y,
             A.z * B.x - A.x * B.z,
             A.x * B.y - A.y * B.x,
-    };
+    }};
     return result;
 #undef A
 #undef B
@@ -331,13 +326,12 @@ static inline FusionVector FusionVectorNormalise(const FusionVector vector) {
  * @return Sum of two quaternions.
  */
 static inline FusionQuaternion FusionQuaternionAdd(const FusionQuaternion quaternionA, const FusionQuaternion quaternionB) {
-    FusionQuaternion result;
-    result.element = {
+    FusionQuaternion result = {{
             quaternionA.element.w + quaternionB.element.w,
             quaternionA.element.x + quaternionB.element.x,
             quaternionA.element.y + quaternionB.element.y,
             quaternionA.element.z + quaternionB.element.z,
-    };
+    }};
     return result;
 }
 
@@ -350,13 +344,12 @@ static inline FusionQuaternion FusionQuaternionAdd(const FusionQuaternion quater
 static inline FusionQuaternion FusionQuaternionMultiply(const FusionQuaternion quaternionA, const FusionQuaternion quaternionB) {
 #define A quaternionA.element
 #define B quaternionB.element
-    FusionQuaternion result;
-    result.element = {
+    FusionQuaternion result = {{
             A.w * B.w - A.x * B.x - A.y * B.y - A.z * B.z,
             A.w * B.x + A.x * B.w + A.y * B.z - A.z * B.y,
             A.w * B.y - A.x * B.z + A.y * B.w + A.z * B.x,
             A.w * B.z + A.x * B.y - A.y * B.x + A.z * B.w,
-    };
+    }};
     return result;
 #undef A
 #undef B
@@ -374,13 +367,12 @@ static inline FusionQuaternion FusionQuaternionMultiply(const FusionQuaternion q
 static inline FusionQuaternion FusionQuaternionMultiplyVector(const FusionQuaternion quaternion, const FusionVector vector) {
 #define Q quaternion.element
 #define V vector.axis
-    FusionQuaternion result;
-    result.element = {
+    FusionQuaternion result = {{
             -Q.x * V.x - Q.y * V.y - Q.z * V.z,
             Q.w * V.x + Q.y * V.z - Q.z * V.y,
             Q.w * V.y - Q.x * V.z + Q.z * V.x,
             Q.w * V.z + Q.x * V.y - Q.y * V.x,
-    };
+    }};
     return result;
 #undef Q
 #undef V
@@ -398,13 +390,12 @@ static inline FusionQuaternion FusionQuaternionNormalise(const FusionQuaternion
 #else
     const float magnitudeReciprocal = FusionFastInverseSqrt(Q.w * Q.w + Q.x * Q.x + Q.y * Q.y + Q.z * Q.z);
 #endif
-    FusionQuaternion result;
-    result.element = {
+    FusionQuaternion result = {{
             Q.w * magnitudeReciprocal,
             Q.x * magnitudeReciprocal,
             Q.y * magnitudeReciprocal,
             Q.z * magnitudeReciprocal,
-    };
+    }};
     return result;
 #undef Q
 }
@@ -420,12 +411,11 @@ static inline FusionQuaternion FusionQuaternionNormalise(const FusionQuaternion
  */
 static inline FusionVector FusionMatrixMultiplyVector(const FusionMatrix matrix, const FusionVector vector) {
 #define R matrix.element
-    FusionVector result;
-    result.axis = {
+    FusionVector result = {{
             R.xx * vector.axis.x + R.xy * vector.axis.y + R.xz * vector.axis.z,
             R.yx * vector.axis.x + R.yy * vector.axis.y + R.yz * vector.axis.z,
             R.zx * vector.axis.x + R.zy * vector.axis.y + R.zz * vector.axis.z,
-    };
+    }};
     return result;
 #undef R
 }
@@ -447,18 +437,11 @@ static inline FusionMatrix FusionQuaternionToMatrix(const FusionQuaternion quate
     const float qxqy = Q.x * Q.y;
     const float qxqz = Q.x * Q.z;
     const float qyqz = Q.y * Q.z;
-    FusionMatrix matrix;
-    matrix.element = {
-            2.0f * (qwqw - 0.5f + Q.x * Q.x),
-            2.0f * (qxqy - qwqz),
-            2.0f * (qxqz + qwqy),
-            2.0f * (qxqy + qwqz),
-            2.0f * (qwqw - 0.5f + Q.y * Q.y),
-            2.0f * (qyqz - qwqx),
-            2.0f * (qxqz - qwqy),
-            2.0f * (qyqz + qwqx),
-            2.0f * (qwqw - 0.5f + Q.z * Q.z),
-    };
+    FusionMatrix matrix = {{
+            {2.0f * (qwqw - 0.5f + Q.x * Q.x), 2.0f * (qxqy - qwqz), 2.0f * (qxqz + qwqy)},
+            {2.0f * (qxqy + qwqz), 2.0f * (qwqw - 0.5f + Q.y * Q.y), 2.0f * (qyqz - qwqx)},
+            {2.0f * (qxqz - qwqy), 2.0f * (qyqz + qwqx), 2.0f * (qwqw - 0.5f + Q.z * Q.z)},
+    }};
     return matrix;
 #undef Q
 }
@@ -471,12 +454,11 @@ static inline FusionMatrix FusionQuaternionToMatrix(const FusionQuaternion quate
 static inline FusionEuler FusionQuaternionToEuler(const FusionQuaternion quaternion) {
 #define Q quaternion.element
     const float halfMinusQySquared = 0.5f - Q.y * Q.y; // calculate common terms to avoid repeated operations
-    FusionEuler euler;
-    euler.angle = {
+    FusionEuler euler = {{
             FusionRadiansToDegrees(atan2f(Q.w * Q.x + Q.y * Q.z, halfMinusQySquared - Q.x * Q.x)),
             FusionRadiansToDegrees(FusionAsin(2.0f * (Q.w * Q.y - Q.z * Q.x))),
             FusionRadiansToDegrees(atan2f(Q.w * Q.z + Q.x * Q.y, halfMinusQySquared - Q.z * Q.z)),
-    };
+    }};
     return euler;
 #undef Q
 }
@@ -1,4 +1,3 @@
-#include "pch.h"
 #include "FusionOffset.h"
 
 //------------------------------------------------------------------------------
@@ -31,7 +30,8 @@ void FusionOffsetInitialise(FusionOffset* const offset, const unsigned int sampl
     offset->filterCoefficient = 2.0f * (float)M_PI * CUTOFF_FREQUENCY * (1.0f / (float)sampleRate);
     offset->timeout = TIMEOUT * sampleRate;
     offset->timer = 0;
-    offset->gyroscopeOffset = FUSION_VECTOR_ZERO;
+    const FusionVector zero = FUSION_VECTOR_ZERO;
+    offset->gyroscopeOffset = zero;
 }
 
 /**
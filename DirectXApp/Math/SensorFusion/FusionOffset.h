@@ -23,8 +23,16 @@ typedef struct {
 //------------------------------------------------------------------------------
 // Function declarations
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 void FusionOffsetInitialise(FusionOffset* const offset, const unsigned int sampleRate);
 
 FusionVector FusionOffsetUpdate(FusionOffset* const offset, FusionVector gyroscope);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif
\ No newline at end of file
@@ -1,3 +1,7 @@
 #pragma once
 
-#include <Eigen/Dense.h>
\ No newline at end of file
+#if defined(_WIN32)
+#include <Eigen/Dense.h>
+#else
+#include <Eigen/Dense> //the standard name of the header on other platforms (add -I/usr/include/eigen3 on Linux)
+#endif
\ No newline at end of file
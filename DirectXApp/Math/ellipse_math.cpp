@@ -1,5 +1,4 @@
-#include "pch.h"
-
+#include <cmath>
 #include <iostream>
 #include "ellipse_math.h"
 
@@ -116,7 +115,94 @@ double testEllipseMatrix(double x, double y, double z, std::vector<Eigen::Matrix
 
     return (A * x * x + B * y * y + C * z * z + D * x * y + E * x * z + F * y * z + G * x + H * y + I * z + J);
 }
-void ellipseBestFit(std::vector<float>& x_data, std::vector<float>& y_data, std::vector<float>& z_data, std::vector<std::vector<double> >& RUV, float* mag_off, float* mag_gain)
+void EllipsoidFitter::reset()
+{
+    m_scatter.setZero();
+    m_samples = 0;
+}
+
+void EllipsoidFitter::addSample(float x, float y, float z)
+{
+    //Adds the outer product of the row for this reading to the scatter matrix. Everything is kept in
+    //double precision as the squared terms of a few thousand readings add up quickly.
+    double xd = x, yd = y, zd = z;
+    Eigen::Matrix<double, 10, 1> row;
+    row << xd * xd + yd * yd - 2 * zd * zd, xd * xd - 2 * yd * yd + zd * zd, 4 * xd * yd, 2 * xd * zd, 2 * yd * zd, xd, yd, zd, 1, xd * xd + yd * yd + zd * zd;
+
+    m_scatter.selfadjointView<Eigen::Upper>().rankUpdate(row);
+    m_samples++;
+}
+
+bool EllipsoidFitter::solveEllipsoid(Eigen::Vector3d& center, Eigen::Matrix3d& A, double& r_squared) const
+{
+    //The first 9 rows and columns of the scatter matrix are D^t * D and the last column is D^t * e, so
+    //the least squares solution S = [U, V, M, N, P, Q, R, S, T] to D * S = e comes from the normal equations.
+    //The ellipsoid is then (X - center)^t * A * (X - center) = r_squared where A is built the same way as in
+    //ellipseBestFit() and the center is where the gradient of the quadratic is 0.
+    if (m_samples < 9) return false;
+
+    Eigen::Matrix<double, 10, 10> scatter = m_scatter.selfadjointView<Eigen::Upper>();
+    Eigen::ColPivHouseholderQR<Eigen::Matrix<double, 9, 9> > qr(scatter.topLeftCorner<9, 9>());
+    if (qr.rank() < 9) return false; //the readings don't cover enough directions to pin down an ellipsoid
+    Eigen::Matrix<double, 9, 1> S = qr.solve(scatter.topRightCorner<9, 1>());
+
+    A << 1 - S(0) - S(1), -2 * S(2), -S(3),
+         -2 * S(2), 1 - S(0) + 2 * S(1), -S(4),
+         -S(3), -S(4), 1 + 2 * S(0) - S(1);
+
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> eigensolver(A, Eigen::EigenvaluesOnly);
+    if (eigensolver.eigenvalues().minCoeff() <= 0) return false; //best fit quadratic isn't an ellipsoid
+
+    center = 0.5 * A.ldlt().solve(Eigen::Vector3d(S(5), S(6), S(7)));
+    r_squared = S(8) + center.dot(A * center);
+    return r_squared > 0;
+}
+
+bool EllipsoidFitter::solve(float* mag_off, float* mag_gain) const
+{
+    //Sets the hard iron offsets and the soft iron gain matrix (row major) for the readings added so far.
+    //Like ellipseBestFit() the gain is the square root of the ellipse matrix, which has a trace of 3, so
+    //calibrated readings keep roughly the same magnitude as the raw ones. Returns false (and leaves the
+    //numbers alone) if there isn't enough data for a fit yet.
+    Eigen::Vector3d center;
+    Eigen::Matrix3d A;
+    double r_squared;
+    if (!solveEllipsoid(center, A, r_squared)) return false;
+
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> eigensolver(A);
+    Eigen::Matrix3d W_inverse = eigensolver.operatorSqrt();
+
+    for (int i = 0; i < 3; i++)
+    {
+        mag_off[i] = (float)center(i);
+        for (int j = 0; j < 3; j++) mag_gain[3 * i + j] = (float)W_inverse(i, j);
+    }
+
+    return true;
+}
+
+bool EllipsoidFitter::solve(float* mag_off, Eigen::MatrixXf& b) const
+{
+    //Sets the hard iron offsets and fills b with the parameters used by ellipseGaussNewtonFit()
+    //(a, b, c, M, N, P, T, U, V) for data that's been centered on those offsets. This lets the
+    //algebraic fit be used as the starting point for a Gauss-Newton refinement.
+    Eigen::Vector3d center;
+    Eigen::Matrix3d A;
+    double r_squared;
+    if (!solveEllipsoid(center, A, r_squared)) return false;
+
+    //A = [[(1 - U - V), -2M, -N], [-2M, (1 - U + 2V), -P], [-N, -P, (1 + 2U - V)]]
+    double U = (A(2, 2) - A(0, 0)) / 3.0;
+    double V = (A(1, 1) - A(0, 0)) / 3.0;
+
+    b.resize(9, 1);
+    b << 0, 0, 0, -A(0, 1) / 2.0, -A(0, 2), -A(1, 2), r_squared, U, V;
+    for (int i = 0; i < 3; i++) mag_off[i] = (float)center(i);
+
+    return true;
+}
+
+void ellipseBestFit(std::vector<float>& x_data, std::vector<float>& y_data, std::vector<float>& z_data, float* mag_off, float* mag_gain)
 {
     //This function takes magnetometer data that has been moved by hard iron offsets so that it's centered on origin
 
@@ -126,13 +212,12 @@ void ellipseBestFit(std::vector<float>& x_data, std::vector<float>& y_data, std:
     //S is the initial estimate for best fit ellipse of the form S = [U, V, M, N, P, Q, R, S, T]transpose
     //more info can be found here: https://www.researchgate.net/publication/2239930_An_Algorithm_for_Fitting_an_Ellipsoid_to_Data
 
-    Eigen::MatrixXf D(x_data.size(), 9), UV(x_data.size(), 2); //stores u and v components of data set converted to spherical coordinates
+    Eigen::MatrixXf D(x_data.size(), 9);
     Eigen::VectorXf e(x_data.size());
     float xi, yi, zi;
 
     //Set Matrices
-    //also create a matrix for all points converted to spherical coordinates which will be used later
-    for (int i = 0; i < x_data.size(); i++)
+    for (size_t i = 0; i < x_data.size(); i++)
     {
         //get current x, y, z
         xi = x_data[i];
@@ -150,11 +235,8 @@ void ellipseBestFit(std::vector<float>& x_data, std::vector<float>& y_data, std:
         D(i, 8) = 1;
 
         e(i) = xi * xi + yi * yi + zi * zi; //this is equivalent to r^2, these values will be used to calculate residuals later
-        UV(i, 0) = atan2(yi, xi);
-        UV(i, 1) = atan2(sqrt(xi * xi + yi * yi), zi);
     }
 
-    //Eigen::VectorXf S = D.bdcSvd(Eigen::ComputeThinU | Eigen::ComputeThinV).solve(e);
     Eigen::MatrixXf S = D.bdcSvd(Eigen::ComputeThinU | Eigen::ComputeThinV).solve(e);
 
     //Initial estimate for parameters for Newton-Gaussian algorithm S* = [a, b, c, M, N, P, T, U, V]transpose
@@ -172,59 +254,41 @@ void ellipseBestFit(std::vector<float>& x_data, std::vector<float>& y_data, std:
     S_star(7, 0) = S(0, 0);
     S_star(8, 0) = S(1, 0);
 
-    //std::cout << "Initial estimate for Parameters is\n" << S_star << std::endl;
+    ellipseGaussNewtonFit(x_data, y_data, z_data, S_star);
+    ellipseParametersToCalibration(S_star, mag_off, mag_gain);
+}
+
+void ellipseGaussNewtonFit(std::vector<float>& x_data, std::vector<float>& y_data, std::vector<float>& z_data, Eigen::MatrixXf& b)
+{
+    //Refines the ellipse parameters b = [a, b, c, M, N, P, T, U, V] for data that's roughly centered on origin
+    //by minimizing the distance from each point to the surface of the ellipse
 
-    //Now that original parameters have been set, can start the Newton-Euler algorithm
     //set ending condition
     double error_tolerance = 0.0001;
 
-    //create an array to hold residual values
+    //create arrays to hold residual values and the Jacobian, these get reused on every iteration
     Eigen::MatrixXf res(x_data.size(), 1);
-    std::vector<double> xyz;
+    Eigen::MatrixXf jacobian(x_data.size(), b.size());
     double error, last_error = 100;
 
     //Newton-Euler algorithm
     while (true)
     {
-        //calculate residuals
-        for (int i = 0; i < x_data.size(); i++)
-        {
-            //double r_squared = calculateRSquared(UV(i, 0), UV(i, 1), S_star);
-            //res(i) = r_squared - e(i);
-
-            //xyz = calculateXYZ(UV(i, 0), UV(i, 1), S_star);
-            //std::cout << "Calculated Point is [" << xyz[0] << ", " << xyz[1] << ", " << xyz[2] << "]\n" << std::endl;
-            //res(i) = sqrt((x_data[i] - xyz[0]) * (x_data[i] - xyz[0]) + (y_data[i] - xyz[1]) * (y_data[i] - xyz[1]) + (z_data[i] - xyz[2]) * (z_data[i] - xyz[2])); //residual is distance between the two points in space
-            //res(i, 0) = calculateResidual(x_data[i], y_data[i], z_data[i], xyz[0], xyz[1], xyz[2]);
-
-            //each residual is the squared distance from point [x, y, z] and the nearest location on the ellipsoid
-            res(i, 0) = calculateGeometricDistance(x_data[i], y_data[i], z_data[i], S_star);
-        }
+        //calculate residuals, each residual is the squared distance from point [x, y, z] and the nearest location on the ellipsoid
+        for (size_t i = 0; i < x_data.size(); i++) res(i, 0) = calculateGeometricDistance(x_data[i], y_data[i], z_data[i], b);
 
         //if residuals are low enough then break out of algorithm
         error = residualError(res);
-        if ((last_error - error) / last_error <= error_tolerance) //wait for error to converge on a solution, aka, change in error is less than .01% since last iteration
-        {
-            std::cout << "Best fit ellipsoid has been found! With following parameters b:\n" << std::endl;
-            std::cout << S_star << std::endl << std::endl;
-            std::cout << "Here's a graph of the best fit ellipsoid vs. the original data (close graph to continue):\n" << std::endl;
-            //graphCompare(x_data, y_data, z_data, S_star);
-            break;
-        }
-        else
-        {
-            //std::cout << "Current error difference is " << 100 * (last_error - error) / last_error << " percent." << std::endl;
-            last_error = error;
-        }
-
-        Eigen::MatrixXf jacobian = createJacobian(S_star, UV, x_data, y_data, z_data); //To Do: I think that all data points need to be looked at again to properly make J matrix
-
-        //std::cout << "Jacobian Matrix is:\n" << jacobian << std::endl;
-        updateParameters(S_star, res, jacobian);
+        if ((last_error - error) / last_error <= error_tolerance) break; //wait for error to converge on a solution, aka, change in error is less than .01% since last iteration
+        else last_error = error;
 
-        //std::cout << "Paramaters have been changed to \n" << S_star << std::endl;
+        createJacobian(b, x_data, y_data, z_data, jacobian);
+        updateParameters(b, res, jacobian);
     }
+}
 
+void ellipseParametersToCalibration(Eigen::MatrixXf& b, float* mag_off, float* mag_gain)
+{
     //final ellipse parameters are of the form (a, b, c, M, N, P, T, U, V)
     //a, b and c are the center of the best fit ellipsoid from when data was transfered to origin, therefore, a, b anc c need to be added to mag_offset values
     //T is just a function of Earth's Magnetic field (should be roughly equal to the field strength squared)
@@ -233,36 +297,20 @@ void ellipseBestFit(std::vector<float>& x_data, std::vector<float>& y_data, std:
     //           [-2M, (1 - U + 2V), -P],
     //           [-N, -P, (1 + 2U - V)]]
 
-    *mag_off += S_star(0, 0); *(mag_off + 1) += S_star(1, 0); *(mag_off + 2) += S_star(2, 0); //updated mag_off
+    *mag_off += b(0, 0); *(mag_off + 1) += b(1, 0); *(mag_off + 2) += b(2, 0); //updated mag_off
 
     Eigen::Matrix3f A;
-    A(0, 0) = 1 - S_star(7, 0) - S_star(8, 0); A(0, 1) = -2 * S_star(3, 0); A(0, 2) = -S_star(4, 0);
-    A(1, 0) = -2 * S_star(3, 0); A(1, 1) = 1 - S_star(7, 0) + 2 * S_star(8, 0); A(1, 2) = -S_star(5, 0);
-    A(2, 0) = -S_star(4, 0); A(2, 1) = -S_star(5, 0); A(2, 2) = 1 + 2 * S_star(7, 0) - S_star(8, 0);
-
-    Eigen::EigenSolver<Eigen::Matrix3f> eigensolver(A);
-    auto eValues = eigensolver.eigenvalues();
-    auto eVectors = eigensolver.eigenvectors();
-
-    Eigen::MatrixXf D_prime(3, 3);
-    D_prime(0, 0) = sqrt(eValues(0).real()); D_prime(0, 1) = 0; D_prime(0, 2) = 0;
-    D_prime(1, 0) = 0; D_prime(1, 1) = sqrt(eValues(1).real()); D_prime(1, 2) = 0;
-    D_prime(2, 0) = 0; D_prime(2, 1) = 0;  D_prime(2, 2) = sqrt(eValues(2).real());
-
-    Eigen::MatrixXf eigenVectors(3, 3);
-    eigenVectors(0, 0) = eVectors(0).real(); eigenVectors(0, 1) = eVectors(3).real(); eigenVectors(0, 2) = eVectors(6).real();
-    eigenVectors(1, 0) = eVectors(1).real(); eigenVectors(1, 1) = eVectors(4).real(); eigenVectors(1, 2) = eVectors(7).real();
-    eigenVectors(2, 0) = eVectors(2).real(); eigenVectors(2, 1) = eVectors(5).real(); eigenVectors(2, 2) = eVectors(8).real();
+    A(0, 0) = 1 - b(7, 0) - b(8, 0); A(0, 1) = -2 * b(3, 0); A(0, 2) = -b(4, 0);
+    A(1, 0) = -2 * b(3, 0); A(1, 1) = 1 - b(7, 0) + 2 * b(8, 0); A(1, 2) = -b(5, 0);
+    A(2, 0) = -b(4, 0); A(2, 1) = -b(5, 0); A(2, 2) = 1 + 2 * b(7, 0) - b(8, 0);
 
-    Eigen::MatrixXf W_inverse = eigenVectors * D_prime * eigenVectors.inverse(); //this is the matrix needed for soft-iron calibration purposes!
+    //A is symmetric so its square root can be found from its eigen decomposition
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix3f> eigensolver(A);
+    Eigen::Matrix3f W_inverse = eigensolver.operatorSqrt(); //this is the matrix needed for soft-iron calibration purposes!
 
-    //std::cout << "Ellipse Matrix is: \n" << A << std::endl;
-    /*std::cout << "Matrix Parameters are:\n" << S_star << std::endl;
-    std::cout << "\nSqrt of Matrix is: \n" << W_inverse << std::endl;*/
-
-    for (int i = 0; i < 9; i++)
+    for (int i = 0; i < 3; i++)
     {
-        *(mag_gain + i) = W_inverse(i); //TODO: need to double check that mag_gain is appropriately copied from W_inverse
+        for (int j = 0; j < 3; j++) mag_gain[3 * i + j] = W_inverse(i, j);
     }
 }
 
@@ -271,7 +319,7 @@ void convertCartesianToSpherical(std::vector<float>& x, std::vector<float>& y, s
 {
     //trying to calculate the radius of an ellipsoid in polar coordinates given two angles u and v
     //convert the cartesian coordinates [x, y, z] to the angles u and v which will then be used to calculate an r value later
-    for (int i = 0; i < x.size(); i++)
+    for (size_t i = 0; i < x.size(); i++)
     {
         double u = atan(y[i] / x[i]);
         double v = atan(sqrt(x[i] * x[i] + y[i] * y[i]) / z[i]);
@@ -331,45 +379,29 @@ std::vector<double> calculateXYZ(double u, double v, Eigen::MatrixXf& b)
 
     return {x, y, z};
 }
-Eigen::MatrixXf createJacobian(Eigen::MatrixXf b, Eigen::MatrixXf& uv, std::vector<float>& x, std::vector<float>& y, std::vector<float>& z)
+void createJacobian(Eigen::MatrixXf& b, std::vector<float>& x, std::vector<float>& y, std::vector<float>& z, Eigen::MatrixXf& jc)
 {
-    Eigen::MatrixXf jc(uv.rows(), b.size());
-
-    for (int i = 0; i < x.size(); i++)
+    //Fills in jc (which should already be sized to the number of points x the number of parameters) with
+    //the partial derivatives of each residual with respect to each parameter
+    for (size_t i = 0; i < x.size(); i++)
     {
-        for (int j = 0; j < b.size(); j++)
-        {
-            double heyhey = derivative(uv(i, 0), uv(i, 1), x[i], y[i], z[i], b, j); //most likely can remove uv portion from derivative function
-            //std::cout << "Partial Derivative returned by derivative function = " << heyhey << std::endl << std::endl;
-            jc(i, j) = heyhey;
-        }
+        for (int j = 0; j < b.size(); j++) jc(i, j) = derivative(x[i], y[i], z[i], b, j);
     }
-    return jc;
 }
-double derivative(double u, double v, double x, double y, double z, Eigen::MatrixXf b, int bIndex)
+double derivative(double x, double y, double z, Eigen::MatrixXf& b, int bIndex)
 {
     //gets the derivative of the residual with respect to the parameters
     //x, y and z represent the current point being compared against
     double alpha = .001; //define alpha as some arbitrary small value, test different values to see what works best
+    float original = b(bIndex, 0);
 
-    b(bIndex, 0) += alpha;
-    //double r1 = calculateRSquared(u, v, b);
-    //std::vector<double> xyz1 = calculateXYZ(u, v, b); //change one of the b values slightly and calculate new residual
+    b(bIndex, 0) = original + alpha; //change one of the b values slightly and calculate new residual
     double distance1 = calculateGeometricDistance(x, y, z, b);
 
-    b(bIndex, 0) -= (2 * alpha); //checked b + alpha, now check b - alpha
-    //double r2 = calculateRSquared(u, v, b);
-    //std::vector<double> xyz2 = calculateXYZ(u, v, b);
+    b(bIndex, 0) = original - alpha; //checked b + alpha, now check b - alpha
     double distance2 = calculateGeometricDistance(x, y, z, b);
 
-    //return (r1 - r2) / (2 * alpha);
-    //double yo = (calculateResidual(x, y, z, xyz1[0], xyz1[1], xyz1[2]) - calculateResidual(x, y, z, xyz2[0], xyz2[1], xyz2[2])) / (2 * alpha);
-    //std::cout << "Current magnetic reading is [" << x << ", " << y << ", " << z << "]" << std::endl;
-    //std::cout << "Point 1 is [" << xyz1[0] << ", " << xyz1[1] << ", " << xyz1[2] << "]" << std::endl;
-    //std::cout << "Point 2 is [" << xyz2[0] << ", " << xyz2[1] << ", " << xyz2[2] << "]" << std::endl;
-    //std::cout << "Partial Derivative calculated by derivative function = " << yo << std::endl;
-    //return yo;
-
+    b(bIndex, 0) = original; //put b back the way it was
     return (distance1 - distance2) / (2 * alpha);
 }
 double residualError(Eigen::MatrixXf& res)
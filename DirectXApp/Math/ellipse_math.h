@@ -1,22 +1,51 @@
 #pragma once
 
+#include <cstdint>
 #include <vector>
-#include "glm.h"
 #include "eigen.h"
 
+/*
+* The EllipsoidFitter class fits an ellipsoid to magnetometer readings as they come in. Each reading
+* is turned into the same row used by the linear least squares step of ellipseBestFit():
+* [x^2 + y^2 - 2z^2, x^2 - 2y^2 + z^2, 4xy, 2xz, 2yz, x, y, z, 1 | x^2 + y^2 + z^2]
+* and only the 10x10 scatter matrix of those rows is kept, so memory use doesn't grow with the number
+* of readings and a fit can be solved for at any time. Unlike the linear step of ellipseBestFit() the
+* hard iron offsets come straight out of the fit, so the data doesn't need to be centered first.
+*/
+class EllipsoidFitter
+{
+public:
+	EllipsoidFitter() { reset(); }
+
+	void reset();
+	void addSample(float x, float y, float z);
+	uint64_t samples() const { return m_samples; }
+
+	bool solve(float* mag_off, float* mag_gain) const;
+	bool solve(float* mag_off, Eigen::MatrixXf& b) const;
+
+private:
+	bool solveEllipsoid(Eigen::Vector3d& center, Eigen::Matrix3d& A, double& r_squared) const;
+
+	Eigen::Matrix<double, 10, 10> m_scatter; //only the upper triangle is filled in
+	uint64_t m_samples;
+};
+
 void matrixMultiply(float* m1, int rows1, int columns1, float* m2, int rows2, int columns2, float* prod);
 std::vector<double> getEllipsePoint(float roll, float pitch, float yaw, float xr, float yr, float zr, float x_off, float y_off, float z_off, float u, float v);
 std::vector<Eigen::MatrixXf> getEllipseMatrix(float roll, float pitch, float yaw, float xr, float yr, float zr, float a, float b, float c);
 double testEllipseMatrix(double x, double y, double z, std::vector<Eigen::MatrixXf>& p);
-void ellipseBestFit(std::vector<float>& x_data, std::vector<float>& y_data, std::vector<float>& z_data, std::vector<std::vector<double> >& RUV, float* mag_off, float* mag_gain);
+void ellipseBestFit(std::vector<float>& x_data, std::vector<float>& y_data, std::vector<float>& z_data, float* mag_off, float* mag_gain);
+void ellipseGaussNewtonFit(std::vector<float>& x_data, std::vector<float>& y_data, std::vector<float>& z_data, Eigen::MatrixXf& b);
+void ellipseParametersToCalibration(Eigen::MatrixXf& b, float* mag_off, float* mag_gain);
 
 //Functions Used for Newton_Gauss best fit method
 void convertCartesianToSpherical(std::vector<float>& x, std::vector<float>& y, std::vector<float>& z, Eigen::MatrixXf& ruv_values);
 std::vector<double> convertSphericalToCartesian(std::vector<double>& spherical);
 double calculateRSquared(double u, double v, Eigen::MatrixXf& b);
 std::vector<double> calculateXYZ(double u, double v, Eigen::MatrixXf& b);
-Eigen::MatrixXf createJacobian(Eigen::MatrixXf b, Eigen::MatrixXf& uv, std::vector<float>& x, std::vector<float>& y, std::vector<float>& z);
-double derivative(double u, double v, double x, double y, double z, Eigen::MatrixXf b, int bIndex);
+void createJacobian(Eigen::MatrixXf& b, std::vector<float>& x, std::vector<float>& y, std::vector<float>& z, Eigen::MatrixXf& jc);
+double derivative(double x, double y, double z, Eigen::MatrixXf& b, int bIndex);
 double residualError(Eigen::MatrixXf& res);
 void updateParameters(Eigen::MatrixXf& b, Eigen::MatrixXf& res, Eigen::MatrixXf& J);
 double calculateResidual(double x, double y, double z, double xr, double yr, double zr);
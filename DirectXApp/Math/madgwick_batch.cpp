@@ -0,0 +1,409 @@
+#include "madgwick_batch.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define MADGWICK_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MADGWICK_SSE2
+#endif
+
+namespace
+{
+    //The filter math below is written once as a template and gets instantiated for different "lane" types. A lane
+    //type supplies the value type (a single float or a SIMD register of floats), a mask type for comparisons and
+    //the handful of operations that can't be written with plain arithmetic operators.
+    struct ScalarLanes
+    {
+        typedef float Value;
+        typedef bool Mask;
+        static const int width = 1;
+        static const bool branchless = false; //a single value can just take the branch like the original code
+
+        static Value sqrtValue(Value x) { return std::sqrt(x); }
+        static Value invSqrt(Value x)
+        {
+            //Same fast inverse square root as invSqrt() in sensor_fusion.cpp. The bits are moved with memcpy and
+            //a 32-bit integer so the trick still works where long is 64 bits wide.
+            float halfx = 0.5f * x;
+            int32_t i;
+            memcpy(&i, &x, sizeof(i));
+            i = 0x5f3759df - (i >> 1);
+            memcpy(&x, &i, sizeof(x));
+            return x * (1.5f - (halfx * x * x));
+        }
+        static Mask isZero(Value x, Value y, Value z) { return (x == 0.0f) && (y == 0.0f) && (z == 0.0f); }
+        static Value select(Mask mask, Value a, Value b) { return mask ? a : b; }
+        static bool any(Mask mask) { return mask; }
+    };
+
+#if defined(MADGWICK_AVX2)
+    struct VectorValue
+    {
+        __m256 v;
+        VectorValue() {}
+        VectorValue(__m256 x) : v(x) {}
+        VectorValue(float x) : v(_mm256_set1_ps(x)) {}
+    };
+    inline VectorValue operator+(VectorValue a, VectorValue b) { return _mm256_add_ps(a.v, b.v); }
+    inline VectorValue operator-(VectorValue a, VectorValue b) { return _mm256_sub_ps(a.v, b.v); }
+    inline VectorValue operator*(VectorValue a, VectorValue b) { return _mm256_mul_ps(a.v, b.v); }
+    inline VectorValue operator-(VectorValue a) { return _mm256_xor_ps(a.v, _mm256_set1_ps(-0.0f)); }
+
+    struct VectorLanes
+    {
+        typedef VectorValue Value;
+        typedef __m256 Mask;
+        static const int width = 8;
+        static const bool branchless = true;
+
+        static Value load(const float* x) { return _mm256_loadu_ps(x); }
+        static void store(float* destination, Value x) { _mm256_storeu_ps(destination, x.v); }
+        static Value sqrtValue(Value x) { return _mm256_sqrt_ps(x.v); }
+        static Value invSqrt(Value x)
+        {
+            Value halfx = Value(0.5f) * x;
+            __m256i i = _mm256_sub_epi32(_mm256_set1_epi32(0x5f3759df), _mm256_srai_epi32(_mm256_castps_si256(x.v), 1));
+            Value y = _mm256_castsi256_ps(i);
+            return y * (Value(1.5f) - (halfx * y * y));
+        }
+        static Mask isZero(Value x, Value y, Value z)
+        {
+            __m256 zero = _mm256_setzero_ps();
+            return _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(x.v, zero, _CMP_EQ_OQ), _mm256_cmp_ps(y.v, zero, _CMP_EQ_OQ)), _mm256_cmp_ps(z.v, zero, _CMP_EQ_OQ));
+        }
+        static Value select(Mask mask, Value a, Value b) { return _mm256_blendv_ps(b.v, a.v, mask); }
+        static bool any(Mask mask) { return _mm256_movemask_ps(mask) != 0; }
+    };
+#elif defined(MADGWICK_SSE2)
+    struct VectorValue
+    {
+        __m128 v;
+        VectorValue() {}
+        VectorValue(__m128 x) : v(x) {}
+        VectorValue(float x) : v(_mm_set1_ps(x)) {}
+    };
+    inline VectorValue operator+(VectorValue a, VectorValue b) { return _mm_add_ps(a.v, b.v); }
+    inline VectorValue operator-(VectorValue a, VectorValue b) { return _mm_sub_ps(a.v, b.v); }
+    inline VectorValue operator*(VectorValue a, VectorValue b) { return _mm_mul_ps(a.v, b.v); }
+    inline VectorValue operator-(VectorValue a) { return _mm_xor_ps(a.v, _mm_set1_ps(-0.0f)); }
+
+    struct VectorLanes
+    {
+        typedef VectorValue Value;
+        typedef __m128 Mask;
+        static const int width = 4;
+        static const bool branchless = true;
+
+        static Value load(const float* x) { return _mm_loadu_ps(x); }
+        static void store(float* destination, Value x) { _mm_storeu_ps(destination, x.v); }
+        static Value sqrtValue(Value x) { return _mm_sqrt_ps(x.v); }
+        static Value invSqrt(Value x)
+        {
+            Value halfx = Value(0.5f) * x;
+            __m128i i = _mm_sub_epi32(_mm_set1_epi32(0x5f3759df), _mm_srai_epi32(_mm_castps_si128(x.v), 1));
+            Value y = _mm_castsi128_ps(i);
+            return y * (Value(1.5f) - (halfx * y * y));
+        }
+        static Mask isZero(Value x, Value y, Value z)
+        {
+            __m128 zero = _mm_setzero_ps();
+            return _mm_and_ps(_mm_and_ps(_mm_cmpeq_ps(x.v, zero), _mm_cmpeq_ps(y.v, zero)), _mm_cmpeq_ps(z.v, zero));
+        }
+        static Value select(Mask mask, Value a, Value b) { return _mm_or_ps(_mm_and_ps(mask, a.v), _mm_andnot_ps(mask, b.v)); } //SSE2 has no blend instruction
+        static bool any(Mask mask) { return _mm_movemask_ps(mask) != 0; }
+    };
+#endif
+
+    //Everything that stays the same from one sample to the next
+    template <typename V>
+    struct StepConstants
+    {
+        V degToRad, deltaT, beta, sqrtThreeQuarters;
+    };
+
+    template <typename L>
+    inline void imuFeedback(typename L::Value q0, typename L::Value q1, typename L::Value q2, typename L::Value q3,
+        typename L::Value ax, typename L::Value ay, typename L::Value az, StepConstants<typename L::Value> const& c,
+        typename L::Value& qDot1, typename L::Value& qDot2, typename L::Value& qDot3, typename L::Value& qDot4)
+    {
+        //Accelerometer feedback step of MadgwickAHRSupdateIMU()
+        typedef typename L::Value V;
+
+        V recipNorm = L::invSqrt(ax * ax + ay * ay + az * az);
+        ax = ax * recipNorm;
+        ay = ay * recipNorm;
+        az = az * recipNorm;
+
+        V _2q0 = V(2.0f) * q0, _2q1 = V(2.0f) * q1, _2q2 = V(2.0f) * q2, _2q3 = V(2.0f) * q3;
+        V _4q0 = V(4.0f) * q0, _4q1 = V(4.0f) * q1, _4q2 = V(4.0f) * q2;
+        V _8q1 = V(8.0f) * q1, _8q2 = V(8.0f) * q2;
+        V q0q0 = q0 * q0, q1q1 = q1 * q1, q2q2 = q2 * q2, q3q3 = q3 * q3;
+
+        V s0 = _4q0 * q2q2 + _2q2 * ax + _4q0 * q1q1 - _2q1 * ay;
+        V s1 = _4q1 * q3q3 - _2q3 * ax + V(4.0f) * q0q0 * q1 - _2q0 * ay - _4q1 + _8q1 * q1q1 + _8q1 * q2q2 + _4q1 * az;
+        V s2 = V(4.0f) * q0q0 * q2 + _2q0 * ax + _4q2 * q3q3 - _2q3 * ay - _4q2 + _8q2 * q1q1 + _8q2 * q2q2 + _4q2 * az;
+        V s3 = V(4.0f) * q1q1 * q3 - _2q1 * ax + V(4.0f) * q2q2 * q3 - _2q2 * ay;
+        recipNorm = L::invSqrt(s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3);
+        s0 = s0 * recipNorm;
+        s1 = s1 * recipNorm;
+        s2 = s2 * recipNorm;
+        s3 = s3 * recipNorm;
+
+        qDot1 = qDot1 - c.beta * s0;
+        qDot2 = qDot2 - c.beta * s1;
+        qDot3 = qDot3 - c.beta * s2;
+        qDot4 = qDot4 - c.beta * s3;
+    }
+
+    template <typename L>
+    inline void ahrsFeedback(typename L::Value q0, typename L::Value q1, typename L::Value q2, typename L::Value q3,
+        typename L::Value gx, typename L::Value gy, typename L::Value gz, typename L::Value ax, typename L::Value ay, typename L::Value az,
+        typename L::Value mx, typename L::Value my, typename L::Value mz, StepConstants<typename L::Value> const& c,
+        typename L::Value& qDot1, typename L::Value& qDot2, typename L::Value& qDot3, typename L::Value& qDot4)
+    {
+        //Gradient descent and gyroscope error correction of MadgwickAHRSupdate(), see the comments there for what each part does
+        typedef typename L::Value V;
+
+        V recipNorm = L::invSqrt(ax * ax + ay * ay + az * az);
+        ax = ax * recipNorm;
+        ay = ay * recipNorm;
+        az = az * recipNorm;
+
+        recipNorm = L::invSqrt(mx * mx + my * my + mz * mz);
+        mx = mx * recipNorm;
+        my = my * recipNorm;
+        mz = mz * recipNorm;
+
+        V _2q0mx = V(2.0f) * q0 * mx, _2q0my = V(2.0f) * q0 * my, _2q0mz = V(2.0f) * q0 * mz, _2q1mx = V(2.0f) * q1 * mx;
+        V _2q0 = V(2.0f) * q0, _2q1 = V(2.0f) * q1, _2q2 = V(2.0f) * q2, _2q3 = V(2.0f) * q3;
+        V _2q0q2 = V(2.0f) * q0 * q2, _2q2q3 = V(2.0f) * q2 * q3;
+        V q0q0 = q0 * q0, q0q1 = q0 * q1, q0q2 = q0 * q2, q0q3 = q0 * q3;
+        V q1q1 = q1 * q1, q1q2 = q1 * q2, q1q3 = q1 * q3;
+        V q2q2 = q2 * q2, q2q3 = q2 * q3, q3q3 = q3 * q3;
+
+        V hx = mx * q0q0 - _2q0my * q3 + _2q0mz * q2 + mx * q1q1 + _2q1 * my * q2 + _2q1 * mz * q3 - mx * q2q2 - mx * q3q3;
+        V hy = _2q0mx * q3 + my * q0q0 - _2q0mz * q1 + _2q1mx * q2 - my * q1q1 + my * q2q2 + _2q2 * mz * q3 - my * q3q3;
+        V _2bx = L::sqrtValue(hx * hx + hy * hy);
+        V _2bz = -_2q0mx * q2 + _2q0my * q1 + mz * q0q0 + _2q1mx * q3 - mz * q1q1 + _2q2 * my * q3 - mz * q2q2 + mz * q3q3;
+        V _4bx = V(2.0f) * _2bx;
+        V _4bz = V(2.0f) * _2bz;
+
+        //The objective function terms are shared between all four gradient components
+        V f_ax = V(2.0f) * q1q3 - _2q0q2 - ax;
+        V f_ay = V(2.0f) * q0q1 + _2q2q3 - ay;
+        V f_az = V(1.0f) - V(2.0f) * q1q1 - V(2.0f) * q2q2 - az;
+        V f_mx = _2bx * (V(0.5f) - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx;
+        V f_my = _2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my;
+        V f_mz = _2bx * (q0q2 + q1q3) + _2bz * (V(0.5f) - q1q1 - q2q2) - mz;
+
+        V s0 = -_2q2 * f_ax + _2q1 * f_ay - _2bz * q2 * f_mx + (-_2bx * q3 + _2bz * q1) * f_my + _2bx * q2 * f_mz;
+        V s1 = _2q3 * f_ax + _2q0 * f_ay - V(4.0f) * q1 * f_az + _2bz * q3 * f_mx + (_2bx * q2 + _2bz * q0) * f_my + (_2bx * q3 - _4bz * q1) * f_mz;
+        V s2 = -_2q0 * f_ax + _2q3 * f_ay - V(4.0f) * q2 * f_az + (-_4bx * q2 - _2bz * q0) * f_mx + (_2bx * q1 + _2bz * q3) * f_my + (_2bx * q0 - _4bz * q2) * f_mz;
+        V s3 = _2q1 * f_ax + _2q2 * f_ay + (-_4bx * q3 + _2bz * q1) * f_mx + (-_2bx * q0 + _2bz * q2) * f_my + _2bx * q1 * f_mz;
+        recipNorm = L::invSqrt(s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3);
+        s0 = s0 * recipNorm;
+        s1 = s1 * recipNorm;
+        s2 = s2 * recipNorm;
+        s3 = s3 * recipNorm;
+
+        V gyro_angular_error0 = V(2.0f) * (q0 * s0 + q1 * s1 + q2 * s2 + q3 * s3) * c.deltaT;
+        V zeta = c.sqrtThreeQuarters * gyro_angular_error0;
+
+        V gx_corrected = gx - V(2.0f) * (q0 * s1 - q1 * s0 - q2 * s3 + q3 * s2) * c.deltaT * zeta;
+        V gy_corrected = gy - V(2.0f) * (q0 * s2 + q1 * s3 - q2 * s0 - q3 * s1) * c.deltaT * zeta;
+        V gz_corrected = gz - V(2.0f) * (q0 * s3 - q1 * s2 + q2 * s1 - q3 * s0) * c.deltaT * zeta;
+
+        qDot1 = V(0.5f) * (-q1 * gx_corrected - q2 * gy_corrected - q3 * gz_corrected) - c.beta * s0;
+        qDot2 = V(0.5f) * (q0 * gx_corrected + q2 * gz_corrected - q3 * gy_corrected) - c.beta * s1;
+        qDot3 = V(0.5f) * (q0 * gy_corrected - q1 * gz_corrected + q3 * gx_corrected) - c.beta * s2;
+        qDot4 = V(0.5f) * (q0 * gz_corrected + q1 * gy_corrected - q2 * gx_corrected) - c.beta * s3;
+    }
+
+    template <typename L>
+    inline void madgwickStep(typename L::Value& q0, typename L::Value& q1, typename L::Value& q2, typename L::Value& q3,
+        typename L::Value gx, typename L::Value gy, typename L::Value gz, typename L::Value ax, typename L::Value ay, typename L::Value az,
+        typename L::Value mx, typename L::Value my, typename L::Value mz, StepConstants<typename L::Value> const& c)
+    {
+        //A single update of MadgwickAHRSupdate() for every lane
+        typedef typename L::Value V;
+
+        gx = gx * c.degToRad;
+        gy = gy * c.degToRad;
+        gz = gz * c.degToRad;
+
+        //Rate of change of quaternion from the gyroscope alone, this is what gets used when the accelerometer reading is invalid
+        V qDot1 = V(0.5f) * (-q1 * gx - q2 * gy - q3 * gz);
+        V qDot2 = V(0.5f) * (q0 * gx + q2 * gz - q3 * gy);
+        V qDot3 = V(0.5f) * (q0 * gy - q1 * gz + q3 * gx);
+        V qDot4 = V(0.5f) * (q0 * gz + q1 * gy - q2 * gx);
+
+        typename L::Mask acc_invalid = L::isZero(ax, ay, az);
+        typename L::Mask mag_invalid = L::isZero(mx, my, mz);
+
+        if (L::branchless)
+        {
+            //Different lanes can need different versions of the algorithm so every version gets calculated and
+            //the right one is picked for each lane. Zero readings don't produce any NaNs along the way (the fast
+            //inverse square root of 0 is just a large number) so the unused results are harmless.
+            V imu1 = qDot1, imu2 = qDot2, imu3 = qDot3, imu4 = qDot4;
+            imuFeedback<L>(q0, q1, q2, q3, ax, ay, az, c, imu1, imu2, imu3, imu4);
+
+            V ahrs1, ahrs2, ahrs3, ahrs4;
+            ahrsFeedback<L>(q0, q1, q2, q3, gx, gy, gz, ax, ay, az, mx, my, mz, c, ahrs1, ahrs2, ahrs3, ahrs4);
+
+            qDot1 = L::select(acc_invalid, qDot1, L::select(mag_invalid, imu1, ahrs1));
+            qDot2 = L::select(acc_invalid, qDot2, L::select(mag_invalid, imu2, ahrs2));
+            qDot3 = L::select(acc_invalid, qDot3, L::select(mag_invalid, imu3, ahrs3));
+            qDot4 = L::select(acc_invalid, qDot4, L::select(mag_invalid, imu4, ahrs4));
+        }
+        else
+        {
+            if (!L::any(acc_invalid))
+            {
+                if (L::any(mag_invalid)) imuFeedback<L>(q0, q1, q2, q3, ax, ay, az, c, qDot1, qDot2, qDot3, qDot4);
+                else ahrsFeedback<L>(q0, q1, q2, q3, gx, gy, gz, ax, ay, az, mx, my, mz, c, qDot1, qDot2, qDot3, qDot4);
+            }
+        }
+
+        //Integrate and normalise
+        q0 = q0 + qDot1 * c.deltaT;
+        q1 = q1 + qDot2 * c.deltaT;
+        q2 = q2 + qDot3 * c.deltaT;
+        q3 = q3 + qDot4 * c.deltaT;
+
+        V recipNorm = L::invSqrt(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
+        q0 = q0 * recipNorm;
+        q1 = q1 * recipNorm;
+        q2 = q2 * recipNorm;
+        q3 = q3 * recipNorm;
+    }
+
+    template <typename V>
+    StepConstants<V> makeConstants(float sampleFreq, float beta)
+    {
+        StepConstants<V> c;
+        c.degToRad = V(3.14159f / 180.0f);
+        c.deltaT = V(1.0f / sampleFreq);
+        c.beta = V(beta);
+        c.sqrtThreeQuarters = V((float)std::sqrt(3.0 / 4.0));
+        return c;
+    }
+}
+
+void MadgwickAHRSupdateBatch(float q[4], MadgwickBatchInput const& input, int samples, float sampleFreq, float beta, float* q_out)
+{
+    const StepConstants<float> c = makeConstants<float>(sampleFreq, beta);
+    const bool use_mag = (input.mx != nullptr && input.my != nullptr && input.mz != nullptr);
+    float q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+
+    for (int i = 0; i < samples; i++)
+    {
+        float mx = use_mag ? input.mx[i] : 0.0f, my = use_mag ? input.my[i] : 0.0f, mz = use_mag ? input.mz[i] : 0.0f;
+        madgwickStep<ScalarLanes>(q0, q1, q2, q3, input.gx[i], input.gy[i], input.gz[i], input.ax[i], input.ay[i], input.az[i], mx, my, mz, c);
+
+        if (q_out != nullptr)
+        {
+            q_out[4 * i + 0] = q0;
+            q_out[4 * i + 1] = q1;
+            q_out[4 * i + 2] = q2;
+            q_out[4 * i + 3] = q3;
+        }
+    }
+
+    q[0] = q0;
+    q[1] = q1;
+    q[2] = q2;
+    q[3] = q3;
+}
+
+int madgwickStreamLanes()
+{
+#if defined(MADGWICK_AVX2) || defined(MADGWICK_SSE2)
+    return VectorLanes::width;
+#else
+    return 1;
+#endif
+}
+
+void MadgwickAHRSupdateStreams(float* q, const MadgwickBatchInput* inputs, int streams, int samples, float sampleFreq, float beta, float* const* q_out)
+{
+#if defined(MADGWICK_AVX2) || defined(MADGWICK_SSE2)
+    typedef VectorLanes L;
+    typedef L::Value V;
+    const int W = L::width;
+    const StepConstants<V> c = makeConstants<V>(sampleFreq, beta);
+
+    for (int first_stream = 0; first_stream < streams; first_stream += W)
+    {
+        int lanes = streams - first_stream;
+        if (lanes > W) lanes = W;
+
+        //Lanes past the last stream run on zeros from an identity quaternion and their results get thrown away
+        alignas(32) float quaternion[4][MADGWICK_MAX_STREAM_LANES] = {};
+        for (int lane = 0; lane < W; lane++) quaternion[0][lane] = 1.0f;
+        for (int lane = 0; lane < lanes; lane++)
+        {
+            for (int component = 0; component < 4; component++) quaternion[component][lane] = q[4 * (first_stream + lane) + component];
+        }
+
+        V q0 = L::load(quaternion[0]), q1 = L::load(quaternion[1]), q2 = L::load(quaternion[2]), q3 = L::load(quaternion[3]);
+
+        //Pointers to the sensor arrays of each stream in the same order as the members of MadgwickBatchInput
+        const float* channel_source[9][MADGWICK_MAX_STREAM_LANES] = {};
+        for (int lane = 0; lane < lanes; lane++)
+        {
+            MadgwickBatchInput const& input = inputs[first_stream + lane];
+            const float* sources[9] = { input.gx, input.gy, input.gz, input.ax, input.ay, input.az, input.mx, input.my, input.mz };
+            for (int channel = 0; channel < 9; channel++) channel_source[channel][lane] = sources[channel];
+        }
+
+        alignas(32) float gathered[9][MADGWICK_MAX_STREAM_LANES] = {};
+        alignas(32) float results[4][MADGWICK_MAX_STREAM_LANES];
+        for (int i = 0; i < samples; i++)
+        {
+            //Each stream lives in its own set of arrays so the readings for the current sample get gathered into lanes first
+            for (int channel = 0; channel < 9; channel++)
+            {
+                for (int lane = 0; lane < lanes; lane++) gathered[channel][lane] = (channel_source[channel][lane] != nullptr) ? channel_source[channel][lane][i] : 0.0f;
+            }
+
+            madgwickStep<L>(q0, q1, q2, q3, L::load(gathered[0]), L::load(gathered[1]), L::load(gathered[2]), L::load(gathered[3]), L::load(gathered[4]),
+                L::load(gathered[5]), L::load(gathered[6]), L::load(gathered[7]), L::load(gathered[8]), c);
+
+            if (q_out != nullptr)
+            {
+                L::store(results[0], q0);
+                L::store(results[1], q1);
+                L::store(results[2], q2);
+                L::store(results[3], q3);
+                for (int lane = 0; lane < lanes; lane++)
+                {
+                    float* destination = q_out[first_stream + lane];
+                    if (destination == nullptr) continue;
+                    for (int component = 0; component < 4; component++) destination[4 * i + component] = results[component][lane];
+                }
+            }
+        }
+
+        L::store(quaternion[0], q0);
+        L::store(quaternion[1], q1);
+        L::store(quaternion[2], q2);
+        L::store(quaternion[3], q3);
+        for (int lane = 0; lane < lanes; lane++)
+        {
+            for (int component = 0; component < 4; component++) q[4 * (first_stream + lane) + component] = quaternion[component][lane];
+        }
+    }
+#else
+    //No SIMD support, just run the streams one after the other
+    for (int stream = 0; stream < streams; stream++)
+    {
+        MadgwickAHRSupdateBatch(q + 4 * stream, inputs[stream], samples, sampleFreq, beta, (q_out != nullptr) ? q_out[stream] : nullptr);
+    }
+#endif
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+//Batched versions of MadgwickAHRSupdate() from sensor_fusion.cpp. Instead of being called once for every sample
+//these process an entire packet (or an entire recording) in a single call. The constants that the original
+//function recalculates on every call (the gyroscope unit conversion, 1 / sampleFreq, etc.) get calculated once,
+//and the quaternion is carried from one sample to the next in registers instead of going through glm::quat.
+//
+//Quaternions are passed around as plain float[4] arrays in the order [w, x, y, z] so that this file doesn't
+//depend on glm and can be built on any platform.
+//
+//Both functions follow the exact same math as MadgwickAHRSupdate() (including the gyroscope drift correction
+//term), and use the same fast inverse square root, so results match the scalar function to within
+//MADGWICK_BATCH_TOLERANCE for each quaternion component. The only intentional difference is when the
+//accelerometer reading is all zeros while the magnetometer isn't. The original function leaves the rate of
+//change of the quaternion uninitialized in that case, here it falls back to integrating the gyroscope alone
+//(which is what MadgwickAHRSupdateIMU() does).
+#define MADGWICK_BATCH_TOLERANCE  1.0e-5f
+#define MADGWICK_MAX_STREAM_LANES 8
+
+//Pointers to the separate arrays of sensor data for a single recording. Gyroscope readings are in deg/s just like
+//the ones passed to MadgwickAHRSupdate(). If the magnetometer pointers are nullptr the 6-axis (IMU) algorithm gets used.
+struct MadgwickBatchInput
+{
+	const float* gx, * gy, * gz;
+	const float* ax, * ay, * az;
+	const float* mx, * my, * mz;
+};
+
+//Runs the filter over 'samples' samples of a single recording. On entry q holds the quaternion from before the
+//first sample and on exit it holds the quaternion after the last one. If q_out isn't nullptr it must hold
+//4 * samples floats and gets the quaternion after every sample.
+void MadgwickAHRSupdateBatch(float q[4], MadgwickBatchInput const& input, int samples, float sampleFreq, float beta, float* q_out);
+
+//Runs the filter over several independent recordings at the same time, one recording per SIMD lane (8 lanes with
+//AVX2, 4 lanes with SSE2 and a plain loop over the recordings otherwise). q holds 4 floats per stream, inputs
+//holds one entry per stream and q_out (which can be nullptr, as can any of its entries) holds one output array
+//of 4 * samples floats per stream. Every stream must have at least 'samples' samples recorded at the same rate.
+void MadgwickAHRSupdateStreams(float* q, const MadgwickBatchInput* inputs, int streams, int samples, float sampleFreq, float beta, float* const* q_out);
+
+//The number of streams MadgwickAHRSupdateStreams() works on at once with the instruction set it was compiled for
+int madgwickStreamLanes();
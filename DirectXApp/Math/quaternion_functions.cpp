@@ -5,41 +5,25 @@
 #include <Math/quaternion_functions.h>
 
 //Dot and Cross product functions
-float DotProduct(std::vector<float> vec1, std::vector<float> vec2)
+float DotProduct(Vec3 const& vec1, Vec3 const& vec2)
 {
-    //returns the dot product of two vectors, the vectors need to be the same size
-    if (vec1.size() != vec2.size())
-    {
-        std::cout << "Vectors must be of the same length." << std::endl;
-        return 0;
-    }
-
-    float answer = 0;
-    for (int i = 0; i < vec1.size(); i++) answer += vec1[i] * vec2[i];
-    return answer;
+    return Dot(vec1, vec2);
 }
-std::vector<float> CrossProduct(std::vector<float> vec1, std::vector<float> vec2)
+float DotProduct(glm::quat const& q1, glm::quat const& q2)
 {
-    std::vector<float> answer;
-    if (vec1.size() != vec2.size())
-    {
-        std::cout << "Vectors must be of the same length." << std::endl;
-        return answer;
-    }
-
-    answer.push_back(vec1[1] * vec2[2] - vec1[2] * vec2[1]);
-    answer.push_back(vec1[2] * vec2[0] - vec1[0] * vec2[2]);
-    answer.push_back(vec1[0] * vec2[1] - vec1[1] * vec2[0]);
-    return answer;
+    //treats the quaternions as 4-dimensional vectors
+    return Dot(ToQuat(q1), ToQuat(q2));
+}
+Vec3 CrossProduct(Vec3 const& vec1, Vec3 const& vec2)
+{
+    return Cross(vec1, vec2);
 }
 
 //Normalizing and magnitude functions
-float Magnitude(std::vector<float> vec)
+float Magnitude(Vec3 const& vec)
 {
     //returns the magnitude of vec
-    float answer = 0;
-    for (int i = 0; i < vec.size(); i++) answer += vec[i] * vec[i];
-    return sqrt(answer);
+    return Length(vec);
 }
 void Normalize(glm::quat& q)
 {
@@ -49,48 +33,19 @@ void Normalize(glm::quat& q)
     q.y /= magnitude;
     q.z /= magnitude;
 }
-void Normalize(std::vector<float> &vec)
+void Normalize(Vec3& vec)
 {
     float magnitude = Magnitude(vec);
-    for (int i = 0; i < vec.size(); i++) vec[i] /= magnitude;
+    vec.x /= magnitude;
+    vec.y /= magnitude;
+    vec.z /= magnitude;
 }
 
 //Quaternion Manipulation functions
-void QuatRotate(glm::quat q, std::vector<float>& data)
+void QuatRotate(glm::quat q, Vec3& data)
 {
-    //Takes the float vector data and rotates it according to quaternion q. This method expects
-    //that the input vector has 3 elements.
-
-    double w, x, y, z;
-
-    if (data.size() == 3)
-    {
-        //a 3-diomensional vector is passed
-        w = 0;
-        x = data[0];
-        y = data[1];
-        z = data[2];
-    }
-    else
-    {
-        std::cout << "Need a three dimensional vector." << std::endl;
-        return;
-    }
-
-    glm::quat q_star; q_star.w = q.w; q_star.x = -q.x; q_star.y = -q.y; q_star.z = -q.z;
-
-    double temp[4] = { 0 };
-    temp[0] = q.w * w - q.x * x - q.y * y - q.z * z;
-    temp[1] = q.w * x + q.x * w + q.y * z - q.z * y;
-    temp[2] = q.w * y - q.x * z + q.y * w + q.z * x;
-    temp[3] = q.w * z + q.x * y - q.y * x + q.z * w;
-
-    w = temp[0]; x = temp[1]; y = temp[2]; z = temp[3];
-
-    temp[0] = w * q_star.w - x * q_star.x - y * q_star.y - z * q_star.z;
-    data[0] = w * q_star.x + x * q_star.w + y * q_star.z - z * q_star.y;
-    data[1] = w * q_star.y - x * q_star.z + y * q_star.w + z * q_star.x;
-    data[2] = w * q_star.z + x * q_star.y - y * q_star.x + z * q_star.w;
+    //Takes the vector data and rotates it according to quaternion q
+    data = Rotate(ToQuat(q), data);
 }
 void QuatRotate(glm::quat q, glm::vec3& data)
 {
@@ -149,32 +104,15 @@ glm::quat QuaternionMultiply(glm::quat q1, glm::quat q2)
 
     return new_q;
 }
-glm::quat GetRotationQuaternion(std::vector<float> vec1, std::vector<float> vec2)
+glm::quat GetRotationQuaternion(Vec3 const& vec1, Vec3 const& vec2)
 {
     //returns the Quaternion that rotates vec1 to vec2
-    glm::quat q;
-    std::vector<float> cross = CrossProduct(vec1, vec2);
-    q.w = sqrt(Magnitude(vec1) * Magnitude(vec1) * Magnitude(vec2) * Magnitude(vec2)) + DotProduct(vec1, vec2);
-    q.x = cross[0];
-    q.y = cross[1];
-    q.z = cross[2];
-
-    float mag = Magnitude({ q.w, q.x, q.y, q.z });
-    q.w /= mag; q.x /= mag; q.y /= mag; q.z /= mag;
-    return q;
+    return ToGlmQuat(RotationBetween(vec1, vec2));
 }
-glm::quat GetRotationQuaternion(float angle, std::vector<float> vec)
+glm::quat GetRotationQuaternion(float angle, Vec3 const& vec)
 {
-    //returns the Quaternion that rotates about the axis defined by vec, by and angle of angle
-    glm::quat q;
-    q.w = cos(angle * 3.14159 / 360);
-    q.x = vec[0] * sin(angle * 3.14159 / 360);
-    q.y = vec[0] * sin(angle * 3.14159 / 360);
-    q.z = vec[0] * sin(angle * 3.14159 / 360);
-
-    float mag = Magnitude({ q.w, q.x, q.y, q.z });
-    q.w /= mag; q.x /= mag; q.y /= mag; q.z /= mag;
-    return q;
+    //returns the Quaternion that rotates about the axis defined by vec, by and angle of angle (in degrees)
+    return ToGlmQuat(AxisAngle(vec, angle * 3.14159f / 180.0f));
 }
 glm::quat Conjugate(glm::quat q)
 {
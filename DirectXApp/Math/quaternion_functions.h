@@ -1,23 +1,28 @@
 #pragma once
 
-#include <vector>
-#include "glm.h"
+#include <Math/glm.h>
+#include "vector_math.h"
 
-float DotProduct(std::vector<float> vec1, std::vector<float> vec2);
-std::vector<float> CrossProduct(std::vector<float> vec1, std::vector<float> vec2);
+//3-vectors are passed around as Vec3 (see vector_math.h) so none of these allocate
+float DotProduct(Vec3 const& vec1, Vec3 const& vec2);
+float DotProduct(glm::quat const& q1, glm::quat const& q2);
+Vec3 CrossProduct(Vec3 const& vec1, Vec3 const& vec2);
 
-float Magnitude(std::vector<float> vec);
+float Magnitude(Vec3 const& vec);
 void Normalize(glm::quat& q);
-void Normalize(std::vector<float> &vec);
+void Normalize(Vec3& vec);
 
-void QuatRotate(glm::quat q, std::vector<float>& data);
+void QuatRotate(glm::quat q, Vec3& data);
 void QuatRotate(glm::quat q, glm::vec3& data);
 void QuatRotate(glm::quat q1, glm::quat& q2);
 glm::quat QuaternionMultiply(glm::quat q1, glm::quat q2);
-glm::quat GetRotationQuaternion(std::vector<float> vec1, std::vector<float> vec2);
-glm::quat GetRotationQuaternion(float angle, std::vector<float> vec);
+glm::quat GetRotationQuaternion(Vec3 const& vec1, Vec3 const& vec2);
+glm::quat GetRotationQuaternion(float angle, Vec3 const& vec);
 glm::quat Conjugate(glm::quat q);
 
+inline Quat ToQuat(glm::quat const& q) { return { q.w, q.x, q.y, q.z }; }
+inline glm::quat ToGlmQuat(Quat const& q) { return glm::quat(q.w, q.x, q.y, q.z); }
+
 void matrixMultiply(float* m1, int rows1, int columns1, float* m2, int rows2, int columns2, float* prod);
 /*
 void getEllipsePoint(float roll, float pitch, float yaw, float xr, float yr, float zr, float x_off, float y_off, float z_off, float u, float v, float& x, float& y, float& z);
@@ -1,5 +1,7 @@
 #include "pch.h"
 
+#include <cstdint>
+#include <cstring>
 #include <iostream>
 
 #include <Math/quaternion_functions.h>
@@ -61,7 +63,7 @@ glm::quat Madgwick(glm::quat q, float gx, float gy, float gz, float ax, float ay
     /*
     //Calculate the reference direction of Earth's magnetic field, b
     glm::quat h = QuaternionMultiply(q, QuaternionMultiply({ 0, mx, my, mz }, Conjugate(q)));
-    glm::quat b = { 0, Magnitude({h.x, h.y}), 0, h.z };
+    glm::quat b = { 0, Magnitude({h.x, h.y, 0.0f}), 0, h.z };
 
     // Gradient decent algorithm corrective step
     float F[6][1];
@@ -99,7 +101,7 @@ glm::quat Madgwick(glm::quat q, float gx, float gy, float gz, float ax, float ay
     */
 
     glm::quat h = QuaternionMultiply(q, QuaternionMultiply({ 0, mx, my, mz }, Conjugate(q)));
-    glm::quat b = { 0, Magnitude({h.x, h.y}), 0, h.z };
+    glm::quat b = { 0, Magnitude({h.x, h.y, 0.0f}), 0, h.z };
     _2bx = sqrt(h.x * h.x + h.y * h.y);
     _2bz = h.z;
     _4bx = 2.0f * _2bx;
@@ -451,10 +453,10 @@ glm::quat Floyd(glm::quat q, float gx, float gy, float gz, float ax, float ay, f
     float recipNorm;
     //float q0 = q.w, q1 = q.x, q2 = q.y, q3 = q.z;
 
-    std::vector<float> a_base = { 0, 1, 0 };
-    std::vector<float> mag_base = { bx, by, bz };
-    std::vector<float> a_reading = { ax / (float)9.80665, ay / (float)9.80665, az / (float)9.80665 };
-    std::vector<float> mag_reading = { mx, my, mz};
+    Vec3 a_base = { 0, 1, 0 };
+    Vec3 mag_base = { bx, by, bz };
+    Vec3 a_reading = { ax / (float)9.80665, ay / (float)9.80665, az / (float)9.80665 };
+    Vec3 mag_reading = { mx, my, mz};
 
     //First, the current rotation quaternion is updated with Gyroscope information
     //convert Gyroscope readings to rad/s
@@ -502,7 +504,7 @@ glm::quat Floyd(glm::quat q, float gx, float gy, float gz, float ax, float ay, f
 
     //Qa shouldn't have any rotation in the y-axis, create a vector pointing along the z-axis and rotate it by Qa
     //if it's pointing in the x-axis at all, rotate Qa so that it no longer is
-    std::vector<float> zee = { 0, 0, 1 };
+    Vec3 zee = { 0, 0, 1 };
     QuatRotate(Qa, zee);
     float deg = atan2(zee[0], zee[2]);
     if (deg < 0) deg += 2 * 3.14159;
@@ -512,7 +514,7 @@ glm::quat Floyd(glm::quat q, float gx, float gy, float gz, float ax, float ay, f
     Qa = QuaternionMultiply(Qm, Qa);
 
     //Make sure that the two quaternions are "close" to eachother before combining them, otherwise there will be an unintended 180 degree rotation
-    if (DotProduct({ Qa.w, Qa.x, Qa.y, Qa.z }, { q.w, q.x, q.y, q.z }) < 0)  Qa *= -1;
+    if (DotProduct(Qa, q) < 0)  Qa *= -1;
 
     float gamma = .0035; //represents what percentage of the rotation quaternion comes from acc. + mag. data
     q = (1 - gamma) * q + gamma * Qa;
@@ -745,11 +747,13 @@ void MadgwickAHRSupdateIMU(glm::quat& q_first, glm::quat& q_second, float gx, fl
 // See: http://en.wikipedia.org/wiki/Fast_inverse_square_root
 
 float invSqrt(float x) {
+    //The bits are moved with memcpy and a 32-bit integer so the trick still works where long is 64 bits wide
     float halfx = 0.5f * x;
     float y = x;
-    long i = *(long*)&y;
+    int32_t i;
+    memcpy(&i, &y, sizeof(i));
     i = 0x5f3759df - (i >> 1);
-    y = *(float*)&i;
+    memcpy(&y, &i, sizeof(y));
     y = y * (1.5f - (halfx * y * y));
     return y;
 }
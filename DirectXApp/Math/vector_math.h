@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cmath>
+
+//Fixed size 3-vectors and quaternions for the math that runs on every sample (rotating the club shaft, finding the
+//heading offset, the fusion filters). They live on the stack and get passed around by value, so unlike the
+//std::vector<float> versions of these functions that used to be in quaternion_functions.h nothing here ever touches
+//the heap. Both types are 16 byte aligned so that a whole vector or quaternion fits in (and can be loaded straight
+//into) a single SIMD register. Quaternions are stored in the order [w, x, y, z], the same order as the float[4]
+//arrays used by madgwick_batch.h and the SwingPhaseDetector.
+//
+//Everything that doesn't need a square root is constexpr. Nothing in here depends on glm or Windows so the same
+//header gets used by the portable code, quaternion_functions.h has the versions that work on glm::quat.
+
+struct alignas(16) Vec3
+{
+	float x, y, z;
+
+	constexpr float operator[](int i) const { return (i == 0) ? x : (i == 1) ? y : z; }
+	constexpr float& operator[](int i) { return (i == 0) ? x : (i == 1) ? y : z; }
+};
+
+struct alignas(16) Quat
+{
+	float w, x, y, z;
+
+	static constexpr Quat identity() { return { 1.0f, 0.0f, 0.0f, 0.0f }; }
+	constexpr Vec3 vector() const { return { x, y, z }; }
+};
+
+static_assert(sizeof(Vec3) == 16 && sizeof(Quat) == 16, "Vectors and quaternions should each fill a single SIMD register");
+
+//Vector Methods
+constexpr Vec3 operator+(Vec3 const& a, Vec3 const& b) { return { a.x + b.x, a.y + b.y, a.z + b.z }; }
+constexpr Vec3 operator-(Vec3 const& a, Vec3 const& b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+constexpr Vec3 operator-(Vec3 const& a) { return { -a.x, -a.y, -a.z }; }
+constexpr Vec3 operator*(Vec3 const& a, float s) { return { a.x * s, a.y * s, a.z * s }; }
+constexpr Vec3 operator*(float s, Vec3 const& a) { return { a.x * s, a.y * s, a.z * s }; }
+constexpr bool operator==(Vec3 const& a, Vec3 const& b) { return a.x == b.x && a.y == b.y && a.z == b.z; }
+
+constexpr float Dot(Vec3 const& a, Vec3 const& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+constexpr Vec3 Cross(Vec3 const& a, Vec3 const& b) { return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; }
+inline float Length(Vec3 const& a) { return sqrtf(Dot(a, a)); }
+inline float Distance(Vec3 const& a, Vec3 const& b) { return Length(a - b); }
+inline Vec3 Normalized(Vec3 const& a)
+{
+	float length = Length(a);
+	return (length > 0.0f) ? a * (1.0f / length) : a;
+}
+
+//Quaternion Methods
+constexpr Quat operator*(Quat const& a, Quat const& b)
+{
+	//Hamilton product, a * b applies the rotation b first and then a
+	return { a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z,
+		a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+		a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+		a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w };
+}
+constexpr Quat operator*(Quat const& q, float s) { return { q.w * s, q.x * s, q.y * s, q.z * s }; }
+constexpr Quat operator+(Quat const& a, Quat const& b) { return { a.w + b.w, a.x + b.x, a.y + b.y, a.z + b.z }; }
+constexpr bool operator==(Quat const& a, Quat const& b) { return a.w == b.w && a.x == b.x && a.y == b.y && a.z == b.z; }
+
+constexpr Quat Conjugate(Quat const& q) { return { q.w, -q.x, -q.y, -q.z }; }
+constexpr float Dot(Quat const& a, Quat const& b) { return a.w * b.w + a.x * b.x + a.y * b.y + a.z * b.z; }
+inline float Length(Quat const& q) { return sqrtf(Dot(q, q)); }
+inline Quat Normalized(Quat const& q)
+{
+	float length = Length(q);
+	return (length > 0.0f) ? q * (1.0f / length) : q;
+}
+
+constexpr Vec3 Rotate(Quat const& q, Vec3 const& v)
+{
+	//The same thing as q * {0, v} * conjugate(q), but written out so it doesn't multiply by all of the zeros. For
+	//a unit quaternion the first term is just v, the long form keeps the same scaling as the full product when q
+	//isn't quite normalized.
+	return Cross(q.vector(), v) * (2.0f * q.w) + q.vector() * (2.0f * Dot(q.vector(), v)) + v * (q.w * q.w - Dot(q.vector(), q.vector()));
+}
+
+inline Quat AxisAngle(Vec3 const& axis, float radians)
+{
+	//Rotation of the given number of radians about the axis, the axis doesn't need to be normalized
+	Vec3 unit = Normalized(axis);
+	float s = sinf(radians / 2.0f);
+	return { cosf(radians / 2.0f), unit.x * s, unit.y * s, unit.z * s };
+}
+
+inline Quat RotationBetween(Vec3 const& from, Vec3 const& to)
+{
+	//The shortest rotation that takes the direction of from to the direction of to
+	Vec3 cross = Cross(from, to);
+	Quat q = { sqrtf(Dot(from, from) * Dot(to, to)) + Dot(from, to), cross.x, cross.y, cross.z };
+	return Normalized(q);
+}
+
+inline Quat Slerp(Quat const& a, Quat const& b, float t)
+{
+	//Spherical linear interpolation from a (t = 0) to b (t = 1), turns at a steady rate about a single axis and
+	//goes the short way around. When the two are almost the same a normalized straight line is just as good and
+	//doesn't divide by the sine of a tiny angle.
+	float cosine = Dot(a, b);
+	Quat end = (cosine < 0.0f) ? b * -1.0f : b;
+	cosine = fabsf(cosine);
+	if (cosine > 0.9995f) return Normalized(a * (1.0f - t) + end * t);
+
+	float angle = acosf(cosine);
+	float sine = sinf(angle);
+	return a * (sinf((1.0f - t) * angle) / sine) + end * (sinf(t * angle) / sine);
+}
\ No newline at end of file
@@ -159,6 +159,7 @@ void CalibrationMode::initializeCalibrationVariables()
 	m_graphDataX.clear();
 	m_graphDataY.clear();
 	m_graphDataZ.clear();
+	m_magFitter.reset();
 }
 
 void CalibrationMode::prepareRecording()
@@ -407,6 +408,9 @@ void CalibrationMode::addData(std::vector<std::vector<std::vector<float> > > con
 				m_graphDataZ.push_back({ timeStamp + i * timeIncrement, sensorData[calibrationType][2][i] });
 			}
 
+			//Magnetometer readings go straight into the ellipsoid fit as they come in
+			if (m_currentSensor == MAG_SENSOR) m_magFitter.addSample(m_graphDataX.back().y, m_graphDataY.back().y, m_graphDataZ.back().y);
+
 			//TODO: The below block just adds all the data points in the array. There's no reason it needs to happen here,
 			//this should probably be moved into one of the accelerometer specific methods.
 			if (calibrationType == raw_acceleration || calibrationType == 0)
@@ -1773,71 +1777,64 @@ void CalibrationMode::calculateCalNumbers()
 	}
 	else if (m_currentSensor == MAG_SENSOR)
 	{
-		//Get the minimum and maximum values for each of the principle axes. Also
-		//add data points without timestamps to calibrated data vectors.
-		float mag_min[3] = { m_graphDataX[0].y, m_graphDataY[0].y , m_graphDataZ[0].y };
-		float mag_max[3] = { m_graphDataX[0].y, m_graphDataY[0].y , m_graphDataZ[0].y };
+		//The ellipsoid fit has been kept up to date as the data came in, so all that's left is to solve it for the
+		//hard iron offsets and soft iron gains. mx, my and mz only need to be the right size, displayGraph() fills
+		//them in with the calibrated readings.
+		mx.resize(m_graphDataX.size());
+		my.resize(m_graphDataY.size());
+		mz.resize(m_graphDataZ.size());
 
-		mx.clear();
-		my.clear();
-		mz.clear();
+		float gain[9];
+		bool solved = m_refineMagFit ? refineMagnetometerFit(gain) : m_magFitter.solve(mag_off, gain);
 
-		for (int i = 0; i < m_graphDataX.size(); i++)
+		if (!solved)
 		{
-			if (m_graphDataX[i].y < mag_min[0]) mag_min[0] = m_graphDataX[i].y;
-			if (m_graphDataY[i].y < mag_min[1]) mag_min[1] = m_graphDataY[i].y;
-			if (m_graphDataZ[i].y < mag_min[2]) mag_min[2] = m_graphDataZ[i].y;
-
-			if (m_graphDataX[i].y > mag_max[0]) mag_max[0] = m_graphDataX[i].y;
-			if (m_graphDataY[i].y > mag_max[1]) mag_max[1] = m_graphDataY[i].y;
-			if (m_graphDataZ[i].y > mag_max[2]) mag_max[2] = m_graphDataZ[i].y;
+			//Not enough data was collected for a fit, fall back to centering the data and leaving the gains alone
+			float mag_min[3] = { m_graphDataX[0].y, m_graphDataY[0].y , m_graphDataZ[0].y };
+			float mag_max[3] = { m_graphDataX[0].y, m_graphDataY[0].y , m_graphDataZ[0].y };
 
-			mx.push_back(m_graphDataX[i].y);
-			my.push_back(m_graphDataY[i].y);
-			mz.push_back(m_graphDataZ[i].y);
-		}
-
-		//Set the offset values
-		mag_off[0] = (mag_max[0] + mag_min[0]) / 2.0f;
-		mag_off[1] = (mag_max[1] + mag_min[1]) / 2.0f;
-		mag_off[2] = (mag_max[2] + mag_min[2]) / 2.0f;
+			for (int i = 0; i < m_graphDataX.size(); i++)
+			{
+				if (m_graphDataX[i].y < mag_min[0]) mag_min[0] = m_graphDataX[i].y;
+				if (m_graphDataY[i].y < mag_min[1]) mag_min[1] = m_graphDataY[i].y;
+				if (m_graphDataZ[i].y < mag_min[2]) mag_min[2] = m_graphDataZ[i].y;
 
-		float og_x_off = mag_off[0], og_y_off = mag_off[1], og_z_off = mag_off[2]; //use these variables to reset data back to original location before applying new cal numbers
+				if (m_graphDataX[i].y > mag_max[0]) mag_max[0] = m_graphDataX[i].y;
+				if (m_graphDataY[i].y > mag_max[1]) mag_max[1] = m_graphDataY[i].y;
+				if (m_graphDataZ[i].y > mag_max[2]) mag_max[2] = m_graphDataZ[i].y;
+			}
 
-		//correct hard iron so data points can be used in best fit algorithm
-		for (int i = 0; i < mx.size(); i++)
-		{
-			mx[i] -= mag_off[0];
-			my[i] -= mag_off[1];
-			mz[i] -= mag_off[2];
+			for (int i = 0; i < 3; i++)
+			{
+				mag_off[i] = (mag_max[i] + mag_min[i]) / 2.0f;
+				for (int j = 0; j < 3; j++) gain[3 * i + j] = (i == j) ? 1.0f : 0.0f;
+			}
 		}
 
-		//convert each data point to spherical coordinates and add to RUV array
-		//TODO: This can most likely be taken out
-		std::vector<std::vector<double> > RUV;
-		for (int i = 0; i < mx.size(); i++)
+		for (int i = 0; i < 3; i++)
 		{
-			std::vector<double> ruv;
-			float xi = mx[i];
-			float yi = my[i];
-			float zi = mz[i];
-			ruv.push_back(sqrt(xi * xi + yi * yi + zi * zi)); //r
-			ruv.push_back(atan2(yi, xi)); //u
-			ruv.push_back(atan2(sqrt(xi * xi + yi * yi), zi)); //v
-			RUV.push_back(ruv);
+			for (int j = 0; j < 3; j++) mag_gain[i][j] = gain[3 * i + j];
 		}
+	}
+}
 
-		//figure out best fit ellipse for data set and calculate soft-iron gain from it, also slightly changes location of hard iron when best fit ellipse isn't at origin
-		ellipseBestFit(mx, my, mz, RUV, &mag_off[0], &mag_gain[0][0]);
+bool CalibrationMode::refineMagnetometerFit(float* gain)
+{
+	//Uses the streaming ellipsoid fit as the starting point for the (much slower) Gauss-Newton fit
+	//over every recorded point. The Gauss-Newton fit expects the data to be centered on origin.
+	Eigen::MatrixXf parameters;
+	if (!m_magFitter.solve(mag_off, parameters)) return false;
 
-		//put data points back to original location
-		for (int i = 0; i < mx.size(); i++)
-		{
-			mx[i] += og_x_off;
-			my[i] += og_y_off;
-			mz[i] += og_z_off;
-		}
+	for (int i = 0; i < m_graphDataX.size(); i++)
+	{
+		mx[i] = m_graphDataX[i].y - mag_off[0];
+		my[i] = m_graphDataY[i].y - mag_off[1];
+		mz[i] = m_graphDataZ[i].y - mag_off[2];
 	}
+
+	ellipseGaussNewtonFit(mx, my, mz, parameters);
+	ellipseParametersToCalibration(parameters, mag_off, gain);
+	return true;
 }
 
 void CalibrationMode::initializeModel()
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Mode.h"
+#include "Math/glm.h"
 #include "Math/ellipse_math.h"
 
 enum class SensorCalibrationAction
@@ -60,6 +61,7 @@ private:
 	void magnetometerAxisCalibration();
 
 	void calculateCalNumbers();
+	bool refineMagnetometerFit(float* gain);
 
 	void initializeModel();
 	void loadModeMainPage();
@@ -113,6 +115,8 @@ private:
 	float m_timeStamp;
 	float acc_cal[3][6]; //needed to isolate data from all six portions of the acc. tumble calibration: x1, x2, x3, x4, x5, x6, y1, y2... z6
 	std::vector<float> mx, my, mz; //holds calibrated magnetometer data
+	EllipsoidFitter m_magFitter; //fits an ellipsoid to the magnetometer data as it's recorded
+	bool m_refineMagFit = false; //run a Gauss-Newton fit over all of the data after the streaming fit (slower, but minimizes the geometric distance instead of the algebraic one)
 	int avg_count; //used for averaging accelerometer data from tumble test
 
 	//calibration variables
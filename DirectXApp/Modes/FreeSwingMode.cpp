@@ -28,25 +28,22 @@ uint32_t FreeSwingMode::initializeMode(winrt::Windows::Foundation::Size windowSi
 	for (int i = 0; i < 39; i++)
 	{
 		m_quaternions.push_back({ 1.0f, 0.0f, 0.0f, 0.0f });
-		m_eulerAngles.push_back({ 0.0f, 0.0f, 0.0f });
-		m_angularVelocities.push_back({ 0.0f, 0.0f });
 		m_timeStamps.push_back(0.0f);
 	}
 	m_renderQuaternion = { m_quaternions[0].x, m_quaternions[0].y, m_quaternions[0].z, m_quaternions[0].w };
 
-	m_converged = false; //We need to let the filter re-converge every time this mode is opened
-	m_convergenceQuaternions = {};
+	m_converged = false; //The orientation of the sensor has to be found every time this mode is opened
 
 	//We spend the entirety of our time in this mode with the Personal Caddie in Sensor Active
 	//Mode. To get there we need to first put the Sensor into Idle mode
 	auto mode = PersonalCaddiePowerMode::SENSOR_IDLE_MODE;
 	m_mode_screen_handler(ModeAction::PersonalCaddieChangeMode, (void*)&mode);
 
-	//Set the swing phase to be the start of the swing. This will allow
+	//Reset the swing phase detector to the start of the swing. This will allow
 	//proper initialization of swing start time and club Euler Angles. Since
 	//Euler Angles are going to be used, we also alert the Personal Caddie
 	//to start calculating them for us.
-	m_swing_phase = SwingPhase::START;
+	m_swingDetector.reset();
 	DataType dt = DataType::EULER_ANGLES;
 	m_mode_screen_handler(ModeAction::PersonalCaddieToggleCalculatedData, (void*)&dt);
 
@@ -61,6 +58,11 @@ uint32_t FreeSwingMode::initializeMode(winrt::Windows::Foundation::Size windowSi
 	m_uiManager.addElement<TextOverlay>(calculated_swing_speed, L"Swing Speed Text");
 	m_uiManager.getElement<TextOverlay>(L"Swing Speed Text")->updateState(UIElementState::Invisible);
 
+	TextOverlay peak_rotation(m_uiManager.getScreenSize(), { 0.25, 0.72 }, { 0.35, 0.075 }, L"Peak Rotation = ",
+		0.5f, { UIColor::White }, { 0, 16 }, UITextJustification::CenterLeft, false);
+	m_uiManager.addElement<TextOverlay>(peak_rotation, L"Peak Rotation Text");
+	m_uiManager.getElement<TextOverlay>(L"Peak Rotation Text")->updateState(UIElementState::Invisible);
+
 	//The NeedMaterial modeState lets the mode screen know that it needs to pass
 	//a list of materials to this mode that it can use to initialize 3d objects
 	return (ModeState::CanTransfer | ModeState::NeedMaterial | ModeState::Active);
@@ -93,8 +95,11 @@ void FreeSwingMode::uninitializeMode()
 	//Clear out any existing swing data
 	m_swingPath.clear();
 
-	//Put the Personal Caddie back into Connected Mode when leaving this page. This can be 
-	//done without going into Sensor Idle Mode first.
+	//Stop catching swing bursts, then put the Personal Caddie back into Connected Mode when leaving
+	//this page. This can be done without going into Sensor Idle Mode first.
+	bool burst_capture = false;
+	m_mode_screen_handler(ModeAction::SwingBurstCapture, (void*)&burst_capture);
+
 	auto mode = PersonalCaddiePowerMode::CONNECTED_MODE;
 	m_mode_screen_handler(ModeAction::PersonalCaddieChangeMode, (void*)&mode);
 }
@@ -124,17 +129,21 @@ void FreeSwingMode::pc_ModeChange(PersonalCaddiePowerMode newMode)
 {
 	//As soon as we enter Sensor Idle Mode we jump straight into Sensor Active mode. Before that,
 	//however, we also get the current Heading for the sensor which is located in the Personal Caddie
-	//class and temporarily update the beta value of the Madgewick filter. The heading allows the sensor
-	//to line up with the orientation of the computer screen while the beta value allows the sensor to 
-	//quickly converge to the correct location.
+	//class and ask for the orientation of the sensor to be found from the first data set. The heading allows
+	//the sensor to line up with the orientation of the computer screen while the alignment puts the club in
+	//the correct location straight away instead of waiting for the Madgwick filter to converge.
 	if (newMode == PersonalCaddiePowerMode::SENSOR_IDLE_MODE)
 	{
 		//Get the current Heading Offset
 		m_mode_screen_handler(ModeAction::IMUHeading, nullptr);
 
-		//Temporarily increase Madgwick beta gain to 2.5
-		float initial_beta_value = 2.5f;
-		m_mode_screen_handler(ModeAction::MadgwickUpdateFilter, (void*)&initial_beta_value);
+		//Find the orientation from the first data set instead of converging on it
+		m_mode_screen_handler(ModeAction::AlignAttitude, nullptr);
+
+		//Have the Personal Caddie catch every swing at its full ODR as well, the window around
+		//impact gets looked at once the swing is over
+		bool burst_capture = true;
+		m_mode_screen_handler(ModeAction::SwingBurstCapture, (void*)&burst_capture);
 
 		//Put the Sensor into Active mode to start taking readings
 		auto mode = PersonalCaddiePowerMode::SENSOR_ACTIVE_MODE;
@@ -156,7 +165,6 @@ void FreeSwingMode::addQuaternions(std::vector<glm::quat> const& quaternions, in
 	}
 
 	m_currentQuaternion = -1; //reset the current quaternion to be rendered
-	m_update_in_process = true; //will get set to false after the addData method below completes
 
 	for (int i = 0; i < quaternion_number; i++)
 	{
@@ -164,41 +172,60 @@ void FreeSwingMode::addQuaternions(std::vector<glm::quat> const& quaternions, in
 		m_timeStamps[i] = time_stamp + i * delta_t;
 	}
 
-	m_newQuaternions = true; //this variable is used for adding rotation quaternions to current swing path only a single time
 	data_start_timer = std::chrono::steady_clock::now(); //set relative time
-
-	if (!m_converged)
-	{
-		//if the filter hasn't yet converged add the first quaternion from this set to the convergence array
-		//and call the conergenceCheck() method
-		m_convergenceQuaternions.push_back(m_quaternions[0]);
-		convergenceCheck();
-	}
 }
 
-void FreeSwingMode::addData(std::vector<std::vector<std::vector<float> > > const& sensorData, float sensorODR, float timeStamp, int totalSamples)
+void FreeSwingMode::attitudeAligned()
 {
-	//For now the only thing we care about data wise are the Euler Angles as these
-	//tell us what phase of the swing we're currently in.
+	//The Personal Caddie found the orientation of the sensor from the data set that comes along with
+	//this call, so the swing phases mean something from here on
+	m_converged = true;
+}
 
-	//make sure that the length of the m_eulerAngles vector is the same as the total samples coming in.
-	if (m_eulerAngles.size() != totalSamples)
+void FreeSwingMode::addSessionData(SessionDataStore const& sessionData, uint64_t firstNewSample, int totalSamples)
+{
+	//Every new sample gets run through the swing phase detector, not just the ones that end up
+	//being rendered. The detector goes off of the time stamps from the sensor so the phases it finds
+	//are the same no matter how fast the screen refreshes.
+	if (!m_converged) return; //the swing phases don't mean anything until the orientation of the sensor is known
+
+	SessionView newData = sessionData.view(firstNewSample, firstNewSample + totalSamples);
+	SessionTimeSpan times = newData.timeSpan();
+	SessionChannelSpan roll = newData.channel(sessionChannel(static_cast<int>(DataType::EULER_ANGLES), X));
+	SessionChannelSpan pitch = newData.channel(sessionChannel(static_cast<int>(DataType::EULER_ANGLES), Y));
+	SessionChannelSpan yaw = newData.channel(sessionChannel(static_cast<int>(DataType::EULER_ANGLES), Z));
+	SessionChannelSpan pitch_rate = newData.channel(sessionChannel(static_cast<int>(DataType::ROTATION), Y));
+	SessionChannelSpan yaw_rate = newData.channel(sessionChannel(static_cast<int>(DataType::ROTATION), Z));
+	SessionChannelSpan qw = newData.channel(SESSION_QUATERNION_CHANNEL), qx = newData.channel(SESSION_QUATERNION_CHANNEL + 1);
+	SessionChannelSpan qy = newData.channel(SESSION_QUATERNION_CHANNEL + 2), qz = newData.channel(SESSION_QUATERNION_CHANNEL + 3);
+
+	for (size_t i = 0; i < newData.size(); i++)
 	{
-		m_eulerAngles.erase(m_eulerAngles.begin() + totalSamples, m_eulerAngles.end());
-		m_angularVelocities.erase(m_angularVelocities.begin() + totalSamples, m_angularVelocities.end());
-	}
+		//Remember to rotate the quaternion by the heading offset so the club lines up with
+		//the ball the same way it does on screen
+		glm::quat adjusted_q = QuaternionMultiply(m_headingOffset, glm::quat(qw[i], qx[i], qy[i], qz[i]));
+		SwingSample sample = { times[i], ToQuat(adjusted_q), { roll[i], pitch[i], yaw[i] }, pitch_rate[i], yaw_rate[i] };
 
-	m_sensorODR = sensorODR; //this value should always stay the same, this is just the best place to originally set it
+		SwingPhase previous_phase = m_swingDetector.phase();
+		SwingPhaseEvent event;
+		bool phase_changed = m_swingDetector.addSample(sample, event);
 
-	int euler_angle_index = static_cast<int>(DataType::EULER_ANGLES);
-	int angular_velocity_index = static_cast<int>(DataType::ROTATION);
-	for (int i = 0; i < totalSamples; i++)
-	{
-		m_eulerAngles[i] = { sensorData[euler_angle_index][X][i], sensorData[euler_angle_index][Y][i] , sensorData[euler_angle_index][Z][i] };
-		m_angularVelocities[i] = {sensorData[angular_velocity_index][Y][i], sensorData[angular_velocity_index][Z][i] };
+		if (previous_phase == SwingPhase::IMPACT)
+		{
+			//Save information about the club's position for every sample that was part of impact. This will
+			//let us know if the club is swinging down the target line, on an out-to-in path or on an in-to-out
+			//path which has large implications for the flight of the golf ball. Shift data points so that
+			//the golf ball will be at the center of the graph.
+			Vec3 path = m_swingDetector.clubVector() - m_swingDetector.ballLocation();
+			m_swingPath.push_back({ path.y, path.x });
+			m_tangential_swing_speed += pitch_rate[i];
+			m_radial_swing_speed += yaw_rate[i];
+		}
+
+		if (phase_changed) swingPhaseChange(event);
 	}
 
-	m_update_in_process = false; //was initially set to true in the above addQuaternions() method
+	if (!newData.intact()) OutputDebugString(L"Session data was overwritten while the swing detector was reading it.\n");
 }
 
 void FreeSwingMode::update()
@@ -206,8 +233,6 @@ void FreeSwingMode::update()
 	//Animate the current rotation quaternion obtained from the Personal Caddie. We need to look at the 
 	//time stamp to figure out which quaternion is correct. We do this since the ODR of the sensors won't always
 	//match up with the frame rate of the current screen.
-	
-	while (m_update_in_process) {}; //data is currently being updated asynchronously, wait for it to finish
 
 	float time_elapsed_since_data_start = (float)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - data_start_timer).count() / 1000000000.0f;
 	float quat[3];
@@ -236,14 +261,10 @@ void FreeSwingMode::update()
 		float Q_computer[3] = { Q_sensor[computer_axis_from_sensor_axis[0]], Q_sensor[computer_axis_from_sensor_axis[1]], Q_sensor[computer_axis_from_sensor_axis[2]] };
 
 		m_renderQuaternion = { Q_computer[0], Q_computer[1], Q_computer[2], adjusted_q.w };
-		m_current_club_angles = m_eulerAngles[m_currentQuaternion]; //Update the current euler angles for the club as well
 	}
 
 	//Rotate each face according to the given quaternion
 	for (int i = 0; i < m_volumeElements.size(); i++) ((Model*)m_volumeElements[i].get())->translateAndRotateFace({ 0.0f, 0.0f, 1.0f }, m_renderQuaternion);
-
-	//TEST: Once all visual updates are complete check the current swing phase
-	swingUpdate();
 }
 
 void FreeSwingMode::handleKeyPress(winrt::Windows::System::VirtualKey pressedKey)
@@ -298,7 +319,7 @@ void FreeSwingMode::setCurrentHeadingOffset()
 	currentHeading.z = 0;
 
 	//Calculate the angle from the current heading to true North by calculating the cross product
-	float angle = asin(CrossProduct({ currentHeading.x, currentHeading.y, currentHeading.z }, {trueNorth.x, trueNorth.y, trueNorth.z})[2] / sqrt(currentHeading.x * currentHeading.x + currentHeading.y * currentHeading.y));
+	float angle = asin(CrossProduct({ currentHeading.x, currentHeading.y, currentHeading.z }, { trueNorth.x, trueNorth.y, trueNorth.z }).z / sqrt(currentHeading.x * currentHeading.x + currentHeading.y * currentHeading.y));
 
 	//return the proper rotation quaternion about the y-axis as opposed to the z-axis
 	//as it gets applied after the Madgwick filter (so +y is up instead of +z)
@@ -306,298 +327,108 @@ void FreeSwingMode::setCurrentHeadingOffset()
 	m_mode_screen_handler(ModeAction::IMUHeading, (void*)&m_headingOffset);
 }
 
-void FreeSwingMode::convergenceCheck()
+void FreeSwingMode::swingPhaseChange(SwingPhaseEvent const& event)
 {
-	//We check to see if the filter has converged so that we can update the filter's beta value
-	//to something more useful. To check for convergence, we average the last 10 quaternions together
-	//and check the error between this and the current quaternion. If the error in the w, x, y and z
-	//fields are all below a certain threshold then the convergence check passes and we reset the
-	//beta value of the filter.
-	if (m_convergenceQuaternions.size() >= 10)
+	//Gets called whenever the swing phase detector finds the start of a new phase. At each stage
+	//of the swing we draw a large colored circle as an indicator.
+#if defined(_DEBUG)
+	std::wstring debug = L"Swing phase " + std::to_wstring(static_cast<int>(event.phase)) + L" started at sample " + std::to_wstring(event.sample) +
+		L" (t = " + std::to_wstring(event.time) + L" s), detected " + std::to_wstring(event.detected_sample - event.sample) + L" samples later\n";
+	OutputDebugString(&debug[0]);
+#endif
+
+	switch (event.phase)
 	{
-		glm::quat averageQuaternion = { 0, 0, 0, 0 };
-		float error_threshold = 0.05f;
-
-		for (int i = m_convergenceQuaternions.size() - 10; i < m_convergenceQuaternions.size(); i++) averageQuaternion += m_convergenceQuaternions[i];
-		averageQuaternion /= 10;
-
-		float w_error = (averageQuaternion.w - m_convergenceQuaternions.back().w) / (averageQuaternion.w + m_convergenceQuaternions.back().w);
-		float x_error = (averageQuaternion.x - m_convergenceQuaternions.back().x) / (averageQuaternion.x + m_convergenceQuaternions.back().x);
-		float y_error = (averageQuaternion.y - m_convergenceQuaternions.back().y) / (averageQuaternion.y + m_convergenceQuaternions.back().y);
-		float z_error = (averageQuaternion.z - m_convergenceQuaternions.back().z) / (averageQuaternion.z + m_convergenceQuaternions.back().z);
-
-		if (w_error >= 1.0f) w_error = 1.0f / w_error;
-
-		if (w_error > error_threshold || w_error < -error_threshold) return;
-		if (x_error > error_threshold || x_error < -error_threshold) return;
-		if (y_error > error_threshold || y_error < -error_threshold) return;
-		if (z_error > error_threshold || z_error < -error_threshold) return;
-
-		//If all error check pass we reset the beta value of the filter to once again bias the gyro readings
-		float initial_beta_value = 0.041f;
-		m_mode_screen_handler(ModeAction::MadgwickUpdateFilter, (void*)&initial_beta_value);;
-
-		//And do a little clean up
-		m_convergenceQuaternions.clear();
-		m_converged = true; //prevents this convergenceCheck() from being called again
-	}
-}
-
-void FreeSwingMode::swingUpdate()
-{
-	//DEBUG: Print out the location of the clubhead at all times
-	/*std::vector<float> club_orientation = { 1.0f, 0.0f, 0.0f };
-	QuatRotate(QuaternionMultiply(m_headingOffset, m_quaternions[m_currentQuaternion]), club_orientation);
-	std::wstring debug = L"Club Head Location = [" + std::to_wstring(club_orientation[0]) + L", " + std::to_wstring(club_orientation[1]) + L", " + std::to_wstring(club_orientation[2]) + L"]\n";
-	OutputDebugString(&debug[0]);*/
-
-	switch (m_swing_phase)
-	{
-	case SwingPhase::START:
-	{
-		//In this phase all we do is set the initial euler angles for the club and
-		//the start time-stamp for the swing. This only happens though if the 
-		//Madgwick filter has properly converged on the club's real world posiiton.
-		if (m_converged)
-		{
-			m_initial_club_angles = m_current_club_angles;
-			m_swing_start_time = std::chrono::steady_clock::now();
-			m_swing_phase = SwingPhase::PRE_ADDRESS;
-		}
-		break;
-	}
-	case SwingPhase::PRE_ADDRESS:
-	{
-		//In this phase of the swing we're waiting for the golfer to put the club head
-		//behind the ball and remain relatively still. Most golfer's have the tendency 
-		//to waggle the club a few times before they fully address the ball, which will
-		//happen in this phase.
-		if (detectAddress(m_initial_club_angles, m_current_club_angles, m_swing_start_time))
-		{
-			//Once the golfer has stopped moving within a certain threshold, we move on
-			//to the address portion of the swing
-			m_swing_phase = SwingPhase::ADDRESS;
-			m_initial_club_angles = m_current_club_angles; //the initial angles now mark the address angles
-
-			//Create a vector pointing along the shaft of the club at address. This will 
-			//help us detect when we're close to impact with the ball later on.
-			m_ball_location = { 1.0f, 0.0f, 0.0f };
-			auto currentQuat = QuaternionMultiply(m_headingOffset, m_quaternions[m_currentQuaternion]);
-			QuatRotate(currentQuat, m_ball_location);
-
-			//In case this isn't the first swing that's been taken so far, now is a good time
-			//to reset any kind of swing data.
-			for (int i = 1; i < 7; i++) m_uiManager.removeElement<Ellipse>(L"Ellipse " + std::to_wstring(i));
-			m_uiManager.getElement<Graph>(L"Graph")->removeAllLines();
-			m_uiManager.getElement<Graph>(L"Graph")->updateState(UIElementState::Invisible);
-			m_swingPath.clear();
-			m_tangential_swing_speed = 0.0f;
-			m_radial_swing_speed = 0.0f;
-			m_uiManager.getElement<TextOverlay>(L"Swing Speed Text")->updateState(UIElementState::Invisible);
-
-			//At each stage of the swing we draw a large colored circle as an indicator
-			Ellipse address_ellipse(m_uiManager.getScreenSize(), { 0.1429f, 0.25f }, { MAX_SCREEN_HEIGHT / MAX_SCREEN_WIDTH * 0.033f, 0.033f }, false, UIColor::Red);
-			m_uiManager.addElement<Ellipse>(address_ellipse, L"Ellipse 1");
-		}
-		break;
-	}
 	case SwingPhase::ADDRESS:
 	{
-		//In the address phase of the swing all we're really doing is waiting
-		//for the golfer to initiate the swing which is a simple check.
-		if (detectBackswing(m_initial_club_angles, m_current_club_angles))
-		{
-			m_swing_phase = SwingPhase::BACKSWING;
-			m_initial_club_angles = m_current_club_angles; //the initial angles now mark the address angles
-
-			//Set some variables needed during backswing detection
-			m_previous_pitch_average = 0.0f;
-			m_previous_yaw_average = 0.0f;
-			m_current_pitch_average = 0.0f;
-			m_current_yaw_average = 0.0f;
-			m_backswing_point = 0; //set the backswing average index to 0
-
-			Ellipse backswing_ellipse(m_uiManager.getScreenSize(), { 0.2857f, 0.25f }, { MAX_SCREEN_HEIGHT / MAX_SCREEN_WIDTH * 0.033f, 0.033f }, false, UIColor::Orange);
-			m_uiManager.addElement<Ellipse>(backswing_ellipse, L"Ellipse 2");
-		}
+		//In case this isn't the first swing that's been taken so far, now is a good time
+		//to reset any kind of swing data.
+		for (int i = 1; i < 7; i++) m_uiManager.removeElement<Ellipse>(L"Ellipse " + std::to_wstring(i));
+		m_uiManager.getElement<Graph>(L"Graph")->removeAllLines();
+		m_uiManager.getElement<Graph>(L"Graph")->updateState(UIElementState::Invisible);
+		m_swingPath.clear();
+		m_tangential_swing_speed = 0.0f;
+		m_radial_swing_speed = 0.0f;
+		m_uiManager.getElement<TextOverlay>(L"Swing Speed Text")->updateState(UIElementState::Invisible);
+		m_uiManager.getElement<TextOverlay>(L"Peak Rotation Text")->updateState(UIElementState::Invisible);
+
+		Ellipse address_ellipse(m_uiManager.getScreenSize(), { 0.1429f, 0.25f }, { MAX_SCREEN_HEIGHT / MAX_SCREEN_WIDTH * 0.033f, 0.033f }, false, UIColor::Red);
+		m_uiManager.addElement<Ellipse>(address_ellipse, L"Ellipse 1");
 		break;
 	}
 	case SwingPhase::BACKSWING:
 	{
-		//During the backswing we look at the angular velocity along the pitch and yaw
-		//axes. They should both increase (in either the positive or negative direction)
-		//before reaching a peak and then going back towards 0. The transition phase is
-		//entered when both of these angular velocities get close enough to 0. Since
-		//the data is noisy a moving average is used.
-		if (m_backswing_point < TRANSITION_MOVING_AVERAGE_POINTS)
-		{
-			m_current_pitch_average += m_angularVelocities[m_currentQuaternion].first;
-			m_current_yaw_average += m_angularVelocities[m_currentQuaternion].second;
-			m_backswing_point++;
-		}
-		else
-		{
-			if (detectTransition(m_previous_pitch_average, m_current_pitch_average, m_previous_yaw_average, m_current_yaw_average, TRANSITION_MOVING_AVERAGE_POINTS / m_sensorODR))
-			{
-				m_swing_phase = SwingPhase::TRANSITION;
-				
-				Ellipse transition_ellipse(m_uiManager.getScreenSize(), { 0.4286f, 0.25f }, { MAX_SCREEN_HEIGHT / MAX_SCREEN_WIDTH * 0.033f, 0.033f }, false, UIColor::Yellow);
-				m_uiManager.addElement<Ellipse>(transition_ellipse, L"Ellipse 3");
-			}
-			else
-			{
-				m_backswing_point = 0;
-			}
-
-			m_previous_pitch_average = m_current_pitch_average;
-			m_previous_yaw_average = m_current_yaw_average;
-			m_current_pitch_average = 0.0f;
-			m_current_yaw_average = 0.0f;
-		}
+		Ellipse backswing_ellipse(m_uiManager.getScreenSize(), { 0.2857f, 0.25f }, { MAX_SCREEN_HEIGHT / MAX_SCREEN_WIDTH * 0.033f, 0.033f }, false, UIColor::Orange);
+		m_uiManager.addElement<Ellipse>(backswing_ellipse, L"Ellipse 2");
 		break;
 	}
 	case SwingPhase::TRANSITION:
 	{
-		//The transition is usually pretty short in comparison to the backswing and 
-		//downswing. The end of the phase is calculated in a pretty similar way that
-		//the beginning of the phase was. We wait until the angular velocity along the
-		//pitch and yaw axes have both inverted from the beginning of the phase which
-		//signals the start of the downswing.
-		if (detectDownswing(m_previous_pitch_average, m_current_pitch_average, m_previous_yaw_average, m_current_yaw_average, TRANSITION_MOVING_AVERAGE_POINTS / m_sensorODR))
-		{
-			m_swing_phase = SwingPhase::DOWNSWING;
-			
-			Ellipse downswing_ellipse(m_uiManager.getScreenSize(), { 0.5714f, 0.25f }, { MAX_SCREEN_HEIGHT / MAX_SCREEN_WIDTH * 0.033f, 0.033f }, false, UIColor::Green);
-			m_uiManager.addElement<Ellipse>(downswing_ellipse, L"Ellipse 4");
-		}
-		else
-		{
-			m_previous_pitch_average = m_current_pitch_average;
-			m_previous_yaw_average = m_current_yaw_average;
-			m_current_pitch_average = 0.0f;
-			m_current_yaw_average = 0.0f;
-			m_backswing_point = 0;
-		}
-		
+		Ellipse transition_ellipse(m_uiManager.getScreenSize(), { 0.4286f, 0.25f }, { MAX_SCREEN_HEIGHT / MAX_SCREEN_WIDTH * 0.033f, 0.033f }, false, UIColor::Yellow);
+		m_uiManager.addElement<Ellipse>(transition_ellipse, L"Ellipse 3");
 		break;
 	}
 	case SwingPhase::DOWNSWING:
 	{
-		//The downswing is everything that occurs between the transition and impact
-		//phases of the swing. Since we want to see a little bit before impact to get
-		//a sense of what direction the club is travelling, the downswing phase ends
-		//a few milliseconds before the club actually hits the ball. Furthermore,
-		//since the club is moving so fast in the downswing we want to use every single
-		//quaternion that's available to us, not just the one being rendered on the screen.
-		//Because of this, we iterate directly through the quaternion vector when sensing
-		//proximity to impact.
-		if (!m_newQuaternions) return; //no need to recheck the same quaternions
-
-		for (int i = 0; i < m_quaternions.size(); i++)
-		{
-			//Remember to rotate the current quaternion by the heading offset before checking
-			//for impact
-			if (detectImpact(m_ball_location, QuaternionMultiply(m_headingOffset, m_quaternions[i])))
-			{
-				m_swing_phase = SwingPhase::IMPACT;
-
-				Ellipse impact_ellipse(m_uiManager.getScreenSize(), { 0.7143f, 0.25f }, { MAX_SCREEN_HEIGHT / MAX_SCREEN_WIDTH * 0.033f, 0.033f }, false, UIColor::Blue);
-				m_uiManager.addElement<Ellipse>(impact_ellipse, L"Ellipse 5");
-			}
-		}
-
-		m_newQuaternions = false; //setting this bool prevents from checking the same points over and over
-
+		Ellipse downswing_ellipse(m_uiManager.getScreenSize(), { 0.5714f, 0.25f }, { MAX_SCREEN_HEIGHT / MAX_SCREEN_WIDTH * 0.033f, 0.033f }, false, UIColor::Green);
+		m_uiManager.addElement<Ellipse>(downswing_ellipse, L"Ellipse 4");
 		break;
 	}
 	case SwingPhase::IMPACT:
 	{
-		//This phase is very similar to the downswing phase in that it happens very quickly
-		//so we look at every single quaternion for information. The difference here is we
-		//save position data from each of these quaternions to get important info about
-		//the contact with the ball (things like swing speed and direction of the club head).
-		//Once the club travels a certain distance past the ball we move on to the final 
-		//phase of the swing
-		if (!m_newQuaternions) return; //no need to recheck the same quaternions
-
-		for (int i = 0; i < m_quaternions.size(); i++)
-		{
-			std::vector<float> club_orientation = { 1.0f, 0.0f, 0.0f }; //will get rotated according to the current quaternion
-
-			if (detectFollowThrough(m_ball_location, club_orientation, QuaternionMultiply(m_headingOffset, m_quaternions[i])))
-			{
-				m_swing_phase = SwingPhase::FOLLOW_THROUGH;
-
-				Ellipse follow_through_ellipse(m_uiManager.getScreenSize(), { 0.8571f, 0.25f }, { MAX_SCREEN_HEIGHT / MAX_SCREEN_WIDTH * 0.033f, 0.033f }, false, UIColor::Purple);
-				m_uiManager.addElement<Ellipse>(follow_through_ellipse, L"Ellipse 6");
-
-				//Set some variables needed for follow through end detection
-				m_previous_pitch_average = 0.0f;
-				m_previous_yaw_average = 0.0f;
-				m_current_pitch_average = 0.0f;
-				m_current_yaw_average = 0.0f;
-				m_backswing_point = 0;
-			}
-
-			//First, save information about the rotation quaternions rate of change along the
-			//XY plane. This will let us know if the club is swinging down the target line,
-			//on an out-to-in path or on an in-to-out path which has large implications for 
-			//the flight of the golf ball. Shift data points so that the golf ball will be at 
-			//the center of the graph
-			m_swingPath.push_back({ club_orientation[1] - m_ball_location[1], club_orientation[0] - m_ball_location[0]});
-			m_tangential_swing_speed += m_angularVelocities[i].first;
-			m_radial_swing_speed += m_angularVelocities[i].second;
-
-			/*std::wstring debug = L"Club Head Location = [" + std::to_wstring(club_orientation[1]) + L", " + std::to_wstring(club_orientation[1]) + L", " + std::to_wstring(club_orientation[2]) + L"]\n";
-			OutputDebugString(&debug[0]);*/
-		}
-
-		m_newQuaternions = false; //setting this bool prevents from checking/adding the same points over and over
-
+		Ellipse impact_ellipse(m_uiManager.getScreenSize(), { 0.7143f, 0.25f }, { MAX_SCREEN_HEIGHT / MAX_SCREEN_WIDTH * 0.033f, 0.033f }, false, UIColor::Blue);
+		m_uiManager.addElement<Ellipse>(impact_ellipse, L"Ellipse 5");
 		break;
 	}
 	case SwingPhase::FOLLOW_THROUGH:
 	{
-		//After impact, the club will travel upwards some distance before coming to a stop, this
-		//is known as the follow through. We use this phase of the swing to create graphs from the 
-		//information gathered during impact.
-
-		if (detectSwingEnd(m_previous_pitch_average, m_current_pitch_average, m_previous_yaw_average, m_current_yaw_average, TRANSITION_MOVING_AVERAGE_POINTS / m_sensorODR))
-		{
-			m_swing_phase = SwingPhase::END;
-
-			m_uiManager.getElement<Graph>(L"Graph")->setAxisMaxAndMins({ -1.0f,  -1.0f }, { 1.0f, 1.0f });
-			m_uiManager.getElement<Graph>(L"Graph")->addAxisLine(0, 0.0f);
-			m_uiManager.getElement<Graph>(L"Graph")->addAxisLine(1, 0.0f);
-			m_uiManager.getElement<Graph>(L"Graph")->addGraphData(m_swingPath, UIColor::Red);
-			m_uiManager.getElement<Graph>(L"Graph")->removeState(UIElementState::Invisible);
-
-			//Calculate the speed of the swing
-			float swing_speed = calculateSwingSpeed();
-			m_uiManager.getElement<TextOverlay>(L"Swing Speed Text")->updateText(L"Swing Speed = " + std::to_wstring(swing_speed) + L" mph");
-			m_uiManager.getElement<TextOverlay>(L"Swing Speed Text")->removeState(UIElementState::Invisible);
-			
-		}
-		else
-		{
-			m_previous_pitch_average = m_current_pitch_average;
-			m_previous_yaw_average = m_current_yaw_average;
-			m_current_pitch_average = 0.0f;
-			m_current_yaw_average = 0.0f;
-			m_backswing_point = 0;
-		}
-
+		Ellipse follow_through_ellipse(m_uiManager.getScreenSize(), { 0.8571f, 0.25f }, { MAX_SCREEN_HEIGHT / MAX_SCREEN_WIDTH * 0.033f, 0.033f }, false, UIColor::Purple);
+		m_uiManager.addElement<Ellipse>(follow_through_ellipse, L"Ellipse 6");
 		break;
 	}
 	case SwingPhase::END:
 	{
-		//Once the swing is over we simply go back to the start and do everything again.
-		m_swing_phase = SwingPhase::START;
+		//Once the club comes back down after the follow through we create graphs from the
+		//information gathered during impact.
+		if (m_swingPath.empty()) break;
+
+		m_uiManager.getElement<Graph>(L"Graph")->setAxisMaxAndMins({ -1.0f,  -1.0f }, { 1.0f, 1.0f });
+		m_uiManager.getElement<Graph>(L"Graph")->addAxisLine(0, 0.0f);
+		m_uiManager.getElement<Graph>(L"Graph")->addAxisLine(1, 0.0f);
+		m_uiManager.getElement<Graph>(L"Graph")->addGraphData(m_swingPath, UIColor::Red);
+		m_uiManager.getElement<Graph>(L"Graph")->removeState(UIElementState::Invisible);
+
+		//Calculate the speed of the swing
+		float swing_speed = calculateSwingSpeed();
+		m_uiManager.getElement<TextOverlay>(L"Swing Speed Text")->updateText(L"Swing Speed = " + std::to_wstring(swing_speed) + L" mph");
+		m_uiManager.getElement<TextOverlay>(L"Swing Speed Text")->removeState(UIElementState::Invisible);
+
+		//The burst the Personal Caddie caught around impact has been sent over by now, see getSwingBurst()
+		double impact_time = m_swingDetector.impact().time;
+		m_mode_screen_handler(ModeAction::SwingBurstLookup, (void*)&impact_time);
 		break;
 	}
 	}
 }
 
+void FreeSwingMode::getSwingBurst(SwingBurst const* burst)
+{
+	//The burst holds the swing at the full ODR of the gyroscope, so the fastest rotation of the club
+	//through impact can be read straight from it instead of from the slower live stream.
+	if (burst == nullptr) return;
+
+	float peak_rotation = 0.0f;
+	for (int i = 0; i < burst->samples; i++)
+	{
+		float x = burst->at(GYR_SENSOR, X, i), y = burst->at(GYR_SENSOR, Y, i), z = burst->at(GYR_SENSOR, Z, i);
+		float rotation = sqrt(x * x + y * y + z * z);
+		if (rotation > peak_rotation) peak_rotation = rotation;
+	}
+
+	m_uiManager.getElement<TextOverlay>(L"Peak Rotation Text")->updateText(L"Peak Rotation = " + std::to_wstring(peak_rotation) + L" deg/s");
+	m_uiManager.getElement<TextOverlay>(L"Peak Rotation Text")->removeState(UIElementState::Invisible);
+}
+
 float FreeSwingMode::calculateSwingSpeed()
 {
 	//First take the average of the angular velocities recorded during the 
@@ -5,7 +5,7 @@
 #include "Math/SensorFusion/FusionAhrs.h"
 #include "Math/SensorFusion/FusionOffset.h"
 //#include "Math/quaternion_functions.h"
-#include "Golf/SwingPhaseDetection.h"
+#include "Golf/SwingPhaseDetector.h"
 
 class FreeSwingMode : public Mode
 {
@@ -22,7 +22,9 @@ public:
 
 	virtual void getIMUHeadingOffset(glm::quat heading) override;
 	virtual void addQuaternions(std::vector<glm::quat> const& quaternions, int quaternion_number, float time_stamp, float delta_t) override;
-	virtual void addData(std::vector<std::vector<std::vector<float> > > const& sensorData, float sensorODR, float timeStamp, int totalSamples) override;
+	virtual void addSessionData(SessionDataStore const& sessionData, uint64_t firstNewSample, int totalSamples) override;
+	virtual void attitudeAligned() override;
+	virtual void getSwingBurst(SwingBurst const* burst) override;
 
 	void setCurrentHeadingOffset();
 
@@ -30,37 +32,24 @@ private:
 	void initializeTextOverlay();
 	void loadModel();
 
-	void convergenceCheck();
-
-	void swingUpdate();
+	void swingPhaseChange(SwingPhaseEvent const& event);
 
 	float calculateSwingSpeed();
 
 	std::chrono::steady_clock::time_point data_start_timer;
 
 	volatile int m_currentQuaternion;
-	volatile bool m_update_in_process;
 	DirectX::XMVECTOR m_renderQuaternion; //the current quaternion to be applied on screen
 	std::vector<glm::quat> m_quaternions;
-	std::vector<ClubEulerAngles> m_eulerAngles; //holds euler angles coming from the Personal Caddie
-	std::vector<std::pair<float, float> > m_angularVelocities; //each pair holds the pitch and yaw angular velocities as read from the sensor
 	glm::quat m_headingOffset = { 1.0f, 0.0f, 0.0f, 0.0f };
 	std::vector<float> m_timeStamps; //helps figure out which quaternion to actually render (depends on screen refresh rate)
-	float m_sensorODR = 0.0f;
-
-	bool m_converged;
-	std::vector<glm::quat> m_convergenceQuaternions;
-
-	//Swing phase variables
-	SwingPhase m_swing_phase;
-	ClubEulerAngles m_current_club_angles, m_initial_club_angles;
-	std::chrono::time_point<std::chrono::steady_clock> m_swing_start_time;
-	std::vector<float> m_ball_location;
-	int m_backswing_point; //keeps track of which point is being looked at for the data average
-	float m_previous_pitch_average, m_current_pitch_average;
-	float m_previous_yaw_average, m_current_yaw_average;
+
+	bool m_converged; //false until the orientation of the sensor is known, see attitudeAligned()
+
+	//Swing phase variables. Every sample in the session data store gets passed to the swing phase detector
+	//as it comes in, so swing phases don't depend on the frame rate or on which samples get rendered.
+	SwingPhaseDetector m_swingDetector;
 	std::vector<DirectX::XMFLOAT2> m_swingPath; //Tracks the club path through the impact zone
-	volatile bool m_newQuaternions = false;
 	float m_tangential_swing_speed, m_radial_swing_speed;
 
 	//Array used to swap real world coordinates to DirectX coordinates
@@ -3,6 +3,7 @@
 #include "Graphics/Objects/3D/Elements/model.h"
 #include "Math/quaternion_functions.h"
 
+#include <ctime>
 #include <limits>
 
 GraphMode::GraphMode()
@@ -63,6 +64,12 @@ uint32_t GraphMode::initializeMode(winrt::Windows::Foundation::Size windowSize,
 	m_uiManager.addElement<CheckBox>(linearAccelerationCheckBox, L"Check Box 7");
 	m_uiManager.addElement<TextOverlay>(linearAccelerationBoxLabel, L"Label 7");
 
+	//When this box is checked the raw data of each recording also gets saved to a session file
+	CheckBox saveSessionCheckBox(m_uiManager.getScreenSize(), { 0.15f, 0.28f }, { square_ratio * 0.025f, 0.025f });
+	TextOverlay saveSessionBoxLabel(m_uiManager.getScreenSize(), { 0.085f, 0.28f }, { square_ratio * 0.195f, 0.025 }, L"Save Session File", 0.85f, { UIColor::White }, { 0, 17 }, UITextJustification::CenterRight, false);
+	m_uiManager.addElement<CheckBox>(saveSessionCheckBox, L"Save Session Box");
+	m_uiManager.addElement<TextOverlay>(saveSessionBoxLabel, L"Save Session Label");
+
 	//Initialize all overlay text
 	initializeTextOverlay();
 
@@ -72,7 +79,6 @@ uint32_t GraphMode::initializeMode(winrt::Windows::Foundation::Size windowSize,
 	//Initialize 3D rendering data
 	m_quaternions.clear();
 	m_timeStamps.clear();
-	m_convergenceQuaternions.clear();
 	for (int i = 0; i < 39; i++)
 	{
 		m_quaternions.push_back({ 1.0f, 0.0f, 0.0f, 0.0f });
@@ -129,7 +135,14 @@ void GraphMode::uninitializeMode()
 	//Put the sensor back into connected mode before exiting
 	auto mode = PersonalCaddiePowerMode::CONNECTED_MODE;
 	m_mode_screen_handler(ModeAction::PersonalCaddieChangeMode, (void*)&mode);//request the Personal Caddie to be placed into active mode to start recording data
-	m_graphData.clear(); //clear out any recorded data
+	resetData(); //forget about any recorded data
+
+	//Leaving in the middle of a recording still finishes off its session file
+	if (m_savingSession)
+	{
+		m_mode_screen_handler(ModeAction::SessionRecording, nullptr);
+		m_savingSession = false;
+	}
 }
 
 void GraphMode::initializeTextOverlay()
@@ -156,8 +169,6 @@ void GraphMode::update()
 	//match up with the frame rate of the current screen.
 	if (m_needsCamera)
 	{
-		while (m_update_in_process) {}; //data is currently being updated asynchronously, wait for it to finish
-
 		float time_elapsed_since_data_start = (float)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - data_start_timer).count() / 1000000000.0f;
 		float quat[3];
 		bool updated = false;
@@ -221,27 +232,41 @@ void GraphMode::uiElementStateChangeHandler(std::shared_ptr<ManagedUIElement> el
 			
 			resetData();
 
+			//If asked to, save everything the Personal Caddie sends during the recording to a session file named after
+			//the time the recording started. The file gets opened before the sensors are turned on so it has the
+			//whole recording.
+			if (m_uiManager.getElement<CheckBox>(L"Save Session Box")->isChecked())
+			{
+				wchar_t time_text[32] = {};
+				std::time_t now = std::time(nullptr);
+				std::tm local_time;
+				localtime_s(&local_time, &now);
+				std::wcsftime(time_text, 32, L"%Y-%m-%d_%H-%M-%S", &local_time);
+
+				std::wstring file_name = L"Session_" + std::wstring(time_text);
+				m_mode_screen_handler(ModeAction::SessionRecording, (void*)&file_name);
+				m_savingSession = true;
+			}
+
 			//Put the Personal Caddie into Sensor Active mode to start recording data
 			auto mode = PersonalCaddiePowerMode::SENSOR_ACTIVE_MODE;
 			m_mode_screen_handler(ModeAction::PersonalCaddieChangeMode, (void*)&mode);//request the Personal Caddie to be placed into active mode to start recording data
 
 			//Certain extrapolated data types (like linear acceleration) require using the current
-			//rotation quaternion from the Personal Caddie, which requires the Madgwick filter to converge first.
-			//If one of these data types is selected set the m_converge variable to false, manually change the 
-			//value of the Madgwick filter's beta value, and alert the Personal Caddie to start calculating the 
+			//rotation quaternion from the Personal Caddie, which needs to match the real orientation of the sensor.
+			//If one of these data types is selected set the m_converged variable to false, have the Personal Caddie
+			//find the orientation from the first data set it gets, and alert it to start calculating the 
 			//specific data type
 			if (m_selectedDataTypes >= (1 << static_cast<int>(DataType::LINEAR_ACCELERATION))) //TODO: remove first part of OR when ready
 			{
 				toggleCalculatedDataTypes();
 				
-				//Temporarily increase the beta value for the Madgwick filter
-				float initial_beta_value = 2.5f;
-				m_mode_screen_handler(ModeAction::MadgwickUpdateFilter, (void*)&initial_beta_value);
-				m_converged = false; //this prevents data collection from starting until the Madgwick filter quaternions converge
+				m_mode_screen_handler(ModeAction::AlignAttitude, nullptr);
+				m_converged = false; //this prevents data collection from starting until the orientation is known
 			}
 
 			//DEBUG: If We're currently gathering linear acceleration data, render an image of the sensor with 
-			//quaternions from the Personal Caddie to confirm that convergence has happened
+			//quaternions from the Personal Caddie to confirm that the orientation is right
 			if (m_selectedDataTypes & (1 << static_cast<int>(DataType::LINEAR_ACCELERATION))) m_needsCamera = true; //TODO: same as above todo
 		}
 		else
@@ -256,6 +281,13 @@ void GraphMode::uiElementStateChangeHandler(std::shared_ptr<ManagedUIElement> el
 			auto mode = PersonalCaddiePowerMode::SENSOR_IDLE_MODE;
 			m_mode_screen_handler(ModeAction::PersonalCaddieChangeMode, (void*)&mode);//request the Personal Caddie to be placed into active mode to start recording data
 
+			//Close the session file if one was being saved
+			if (m_savingSession)
+			{
+				m_mode_screen_handler(ModeAction::SessionRecording, nullptr);
+				m_savingSession = false;
+			}
+
 			//If an extraploated data type was being recorded, tell the Personal Caddie to stop
 			//calculations on it
 			toggleCalculatedDataTypes();
@@ -265,21 +297,24 @@ void GraphMode::uiElementStateChangeHandler(std::shared_ptr<ManagedUIElement> el
 			for (int i = 0; i < static_cast<int>(DataType::END); i++)
 			{
 				if (!(m_selectedDataTypes & (1 << i))) continue; //don't try and add data that isn't actually there
+				if (!m_recordingStarted) break; //no data was recorded
 				if (!mins_maxes_set)
 				{
 					//set the min and max data values for the graph. I'd rather do this outside of this loop,
 					//however, this was easier since you don't know which data types are actually getting graphed.
 					//TODO: May just be easier to set the max x variable when clicking the stop record button.
-					m_uiManager.getElement<Graph>(L"Graph")->setAxisMaxAndMins({ 0.0f,  m_minimalPoint.y }, { m_graphData[i][X].back().x, m_maximalPoint.y });
+					m_uiManager.getElement<Graph>(L"Graph")->setAxisMaxAndMins({ 0.0f,  m_minimalPoint.y }, { m_maximalPoint.x, m_maximalPoint.y });
 					mins_maxes_set = true;
 				}
 
 				//The color for each line gets selected from the m_lineColors vector. Modular division
 				//is used when setting the index to make sure that if more lines are plotted than colors
 				//are available, the colors wrap around back to the beginning of the vector.
-				m_uiManager.getElement<Graph>(L"Graph")->addGraphData(m_graphData[i][X], m_lineColors[(m_currentLineColor++) % m_lineColors.size()], getDataTypeText(static_cast<DataType>(i)) + L".x");
-				m_uiManager.getElement<Graph>(L"Graph")->addGraphData(m_graphData[i][Y], m_lineColors[(m_currentLineColor++) % m_lineColors.size()], getDataTypeText(static_cast<DataType>(i)) + L".y");
-				m_uiManager.getElement<Graph>(L"Graph")->addGraphData(m_graphData[i][Z], m_lineColors[(m_currentLineColor++) % m_lineColors.size()], getDataTypeText(static_cast<DataType>(i)) + L".z");
+				for (int axis = X; axis <= Z; axis++)
+				{
+					std::wstring axis_name = (axis == X) ? L".x" : ((axis == Y) ? L".y" : L".z");
+					m_uiManager.getElement<Graph>(L"Graph")->addGraphData(m_graphData[sessionChannel(i, axis)], m_lineColors[(m_currentLineColor++) % m_lineColors.size()], getDataTypeText(static_cast<DataType>(i)) + axis_name);
+				}
 			}
 
 			//DEBUG: If We're currently gathering linear acceleration data, stop rendering image of the sensor
@@ -301,22 +336,11 @@ void GraphMode::uiElementStateChangeHandler(std::shared_ptr<ManagedUIElement> el
 
 void GraphMode::resetData()
 {
-	//This method simply clears out any data accumlated in the graphData structure and recreates
-	//empty arrays for all of the data types. It then looks at the m_selectedDataTypes variable
-	//and creates vectors and pairs to hold X, Y and Z data.
+	//This method forgets about any previously recorded samples. New pyramids are created instead of clearing
+	//out the old ones as the graph may still be holding on to them.
+	m_recordingStarted = false;
 	m_graphData.clear();
-	for (int i = 0; i < static_cast<int>(DataType::END); i++)
-	{
-		m_graphData.push_back({});
-
-		if (m_selectedDataTypes & (1 << i))
-		{
-			for (int j = 0; j < 3; j++)
-			{
-				m_graphData.back().push_back({});
-			}
-		}
-	}
+	for (int i = 0; i < SESSION_DATA_TYPES * SESSION_AXES; i++) m_graphData.push_back(std::make_shared<DecimationPyramid>());
 
 	//reset the local minimums and maximums. Use the maximum and minimum float values to ensure
 	//that they get overwritten
@@ -352,49 +376,44 @@ std::wstring GraphMode::getDataTypeText(DataType t)
 	}
 }
 
-void GraphMode::addData(std::vector<std::vector<std::vector<float> > > const& sensorData, float sensorODR, float timeStamp, int totalSamples)
+void GraphMode::addSessionData(SessionDataStore const& sessionData, uint64_t firstNewSample, int totalSamples)
 {
 	//If we're currently recording data, then every time a new set of data is ready this method will
-	//get called and add the selected data to the data set for each axis.
+	//get called. Each selected channel of the new data gets added to its DecimationPyramid, and the
+	//minimum and maximum values are tracked for scaling the graph.
 	if (!m_recording) return; //only add data if we're actually recording
-	if (!m_converged) return; //if the current data type needs the Madgwick filter to converge first don't record data yet
+	if (!m_converged) return; //if the current data type needs the orientation of the sensor don't record data until it's known
 
-	m_update_in_process = true; //prevent access to data vectors while update is occuring
+	SessionView newData = sessionData.view(firstNewSample, firstNewSample + totalSamples);
+	if (newData.empty()) return;
+	m_recordingStarted = true;
 
-	for (int i = 0; i < totalSamples; i++)
+	SessionTimeSpan times = newData.timeSpan();
+	for (int j = 0; j < static_cast<int>(DataType::END); j++)
 	{
-		for (int j = 0; j < static_cast<int>(DataType::END); j++)
-		{
-			if (!(m_selectedDataTypes & (1 << j))) continue; //skip over any non-selected data types
-
-			float x_data = sensorData[j][X][i];
-			float y_data = sensorData[j][Y][i];
-			float z_data = sensorData[j][Z][i];
-			float time_stamp = timeStamp + i / sensorODR;
+		if (!(m_selectedDataTypes & (1 << j))) continue; //skip over any non-selected data types
 
-			m_graphData[j][X].push_back({ time_stamp, x_data });
-			m_graphData[j][Y].push_back({ time_stamp, y_data });
-			m_graphData[j][Z].push_back({ time_stamp, z_data });
+		for (int axis = X; axis <= Z; axis++)
+		{
+			DecimationPyramid& pyramid = *m_graphData[sessionChannel(j, axis)];
+			SessionChannelSpan data = newData.channel(sessionChannel(j, axis));
+			for (size_t i = 0; i < data.size(); i++) pyramid.append(static_cast<float>(times[i]), data[i]);
 
 			//check to see if any new mins or maxes have been found
-			if (x_data > m_maximalPoint.y) m_maximalPoint.y = x_data;
-			else if (x_data < m_minimalPoint.y) m_minimalPoint.y = x_data;
-
-			if (y_data > m_maximalPoint.y) m_maximalPoint.y = y_data;
-			else if (y_data < m_minimalPoint.y) m_minimalPoint.y = y_data;
-
-			if (z_data > m_maximalPoint.y) m_maximalPoint.y = z_data;
-			else if (z_data < m_minimalPoint.y) m_minimalPoint.y = z_data;
+			if (pyramid.maximumY() > m_maximalPoint.y) m_maximalPoint.y = pyramid.maximumY();
+			if (pyramid.minimumY() < m_minimalPoint.y) m_minimalPoint.y = pyramid.minimumY();
 		}
 	}
+
+	m_maximalPoint.x = static_cast<float>(newData.timeAt(newData.size() - 1)); //the time of the most recent sample sets the end of the graph's x-axis
+
+	//The store only wraps onto these samples if the graph has fallen a whole store's worth of data behind, but if it
+	//does happen the graph can have a few points from a later part of the session in it
+	if (!newData.intact()) OutputDebugString(L"Session data was overwritten while the graph was reading it.\n");
 }
 
 void GraphMode::addQuaternions(std::vector<glm::quat> const& quaternions, int quaternion_number, float time_stamp, float delta_t)
 {
-	//Certain data types require that the calculated rotation quaternion has correctly converge on 
-	//the sensor's real life orientation. Linear Acceleration for example is calculated by removing 
-	//the effects of gravity calculated by looking at the current orientation. For these data types 
-	//we wait for the convergence to happen before any data is recorded.
 	//make sure that the length of the m_quaternion and m_timestamp vectors are the same as the quaternion_number parameter.
 	if (m_quaternions.size() != quaternion_number)
 	{
@@ -410,16 +429,7 @@ void GraphMode::addQuaternions(std::vector<glm::quat> const& quaternions, int qu
 		m_timeStamps[i] = time_stamp + i * delta_t;
 	}
 
-	if (!m_converged)
-	{
-		//if the filter hasn't yet converged add the first quaternion from this set to the convergence array
-		//and call the conergenceCheck() method
-		for (int i = 0; i < quaternion_number; i++) m_convergenceQuaternions.push_back(quaternions[i]);
-		convergenceCheck();
-	}
-
 	data_start_timer = std::chrono::steady_clock::now(); //set relative time
-	m_update_in_process = false; //grant access to data vectors once update is complete
 }
 
 void GraphMode::pc_ModeChange(PersonalCaddiePowerMode newMode)
@@ -475,42 +485,17 @@ void GraphMode::toggleCalculatedDataTypes()
 	}
 }
 
-void GraphMode::convergenceCheck()
+void GraphMode::attitudeAligned()
 {
-	//We check to see if the filter has converged so that we can update the filter's beta value
-	//to something more useful. To check for convergence, we average the last 10 quaternions together
-	//and check the error between this and the current quaternion. If the error in the w, x, y and z
-	//fields are all below a certain threshold then the convergence check passes and we reset the
-	//beta value of the filter.
-	if (m_convergenceQuaternions.size() >= 10)
-	{
-		glm::quat averageQuaternion = { 0, 0, 0, 0 };
-		float error_threshold = 0.05f;
-
-		for (int i = m_convergenceQuaternions.size() - 10; i < m_convergenceQuaternions.size(); i++) averageQuaternion += m_convergenceQuaternions[i];
-		averageQuaternion /= 10;
-
-		float w_error = (averageQuaternion.w - m_convergenceQuaternions.back().w) / (averageQuaternion.w + m_convergenceQuaternions.back().w);
-		float x_error = (averageQuaternion.x - m_convergenceQuaternions.back().x) / (averageQuaternion.x + m_convergenceQuaternions.back().x);
-		float y_error = (averageQuaternion.y - m_convergenceQuaternions.back().y) / (averageQuaternion.y + m_convergenceQuaternions.back().y);
-		float z_error = (averageQuaternion.z - m_convergenceQuaternions.back().z) / (averageQuaternion.z + m_convergenceQuaternions.back().z);
-
-		if (w_error >= 1.0f) w_error = 1.0f / w_error;
-
-		if (w_error > error_threshold || w_error < -error_threshold) return;
-		if (x_error > error_threshold || x_error < -error_threshold) return;
-		if (y_error > error_threshold || y_error < -error_threshold) return;
-		if (z_error > error_threshold || z_error < -error_threshold) return;
-
-		//If all error check pass we reset the beta value of the filter to once again bias the gyro readings
-		float initial_beta_value = 0.041f;
-		m_mode_screen_handler(ModeAction::MadgwickUpdateFilter, (void*)&initial_beta_value);;
-
-		//And do a little clean up
-		createAlert(L"Convergence Complete", UIColor::DarkGray);
-		m_convergenceQuaternions.clear();
-		m_converged = true; //prevents this convergenceCheck() from being called again and starts data capture
-	}
+	//Certain data types require that the calculated rotation quaternion matches the sensor's real life
+	//orientation. Linear Acceleration for example is calculated by removing the effects of gravity 
+	//calculated by looking at the current orientation. The Personal Caddie finds the orientation from
+	//the first data set it gets, which is the one that comes along with this call, so data can be
+	//recorded from here on.
+	if (m_converged) return;
+
+	createAlert(L"Orientation Found", UIColor::DarkGray);
+	m_converged = true; //starts data capture
 }
 
 void GraphMode::getIMUHeadingOffset(glm::quat heading)
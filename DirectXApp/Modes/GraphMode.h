@@ -2,6 +2,7 @@
 
 #include "Mode.h"
 #include "Devices/PersonalCaddie.h"
+#include "Graphics/Objects/2D/Graph/DecimationPyramid.h"
 
 class GraphMode : public Mode
 {
@@ -14,8 +15,9 @@ public:
 	virtual void update() override;
 	virtual void handleKeyPress(winrt::Windows::System::VirtualKey pressedKey) override;
 
-	virtual void addData(std::vector<std::vector<std::vector<float> > > const& sensorData, float sensorODR, float timeStamp, int totalSamples) override;
+	virtual void addSessionData(SessionDataStore const& sessionData, uint64_t firstNewSample, int totalSamples) override;
 	virtual void addQuaternions(std::vector<glm::quat> const& quaternions, int quaternion_number, float time_stamp, float delta_t) override;
+	virtual void attitudeAligned() override;
 	virtual void pc_ModeChange(PersonalCaddiePowerMode newMode) override;
 	virtual void getIMUHeadingOffset(glm::quat heading) override;
 
@@ -23,7 +25,6 @@ private:
 	void initializeTextOverlay();
 	DataType getCurrentlySelectedDataType(std::wstring dropDownSelection);
 	float testIntegrateData(float p1, float p2, float t);
-	void convergenceCheck();
 	void toggleCalculatedDataTypes();
 
 	void loadModel();
@@ -37,24 +38,26 @@ private:
 
 	std::chrono::steady_clock::time_point data_collection_start, data_receieved;
 	bool m_recording;
+	bool m_savingSession = false; //the raw data of the current recording is also being saved to a session file
 	//DataType m_currentDataType; //deprecated
 	uint32_t m_selectedDataTypes;
 
-	//Variables for detecting Madgwick filter convergence
-	bool m_converged = true;
-	std::vector<glm::quat> m_convergenceQuaternions;
+	bool m_converged = true; //false until the orientation of the sensor is known, see attitudeAligned()
 
 	//Rendering Variables
 	std::chrono::steady_clock::time_point data_start_timer;
 	volatile int m_currentQuaternion;
-	volatile bool m_update_in_process;
 	DirectX::XMVECTOR m_renderQuaternion; //the current quaternion to be applied on screen
 	std::vector<glm::quat> m_quaternions;
 	glm::quat m_headingOffset = { 1.0f, 0.0f, 0.0f, 0.0f };
 	std::vector<float> m_timeStamps;
 	int computer_axis_from_sensor_axis[3] = { 1, 2, 0 }; //Array used to swap real world coordinates to DirectX coordinates
 
-	std::vector<std::vector<std::vector<DirectX::XMFLOAT2> > > m_graphData = {}; //Holds data from the sensor for all possible data types
+	//Each selected channel of the session data store gets copied into a DecimationPyramid as the data comes in. When
+	//recording stops the graph only needs to draw a couple of lines per pixel from each pyramid, instead of a line
+	//for every sample, and it can go back to the pyramids for more detail when zooming in.
+	std::vector<std::shared_ptr<DecimationPyramid> > m_graphData; //one pyramid for every session channel (DataType and Axis)
+	bool m_recordingStarted = false;
 	DirectX::XMFLOAT2 m_minimalPoint, m_maximalPoint; //used for scaling of the graph
 	std::vector<UIColor> m_lineColors; //holds multiple colors to be graphed
 	int m_currentLineColor; //used to select a graph line color from the above vector
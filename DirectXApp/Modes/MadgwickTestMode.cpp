@@ -253,7 +253,6 @@ void MadgwickTestMode::addQuaternions(std::vector<glm::quat> const& quaternions,
 	}
 
 	m_currentQuaternion = -1; //reset the current quaternion to be rendered
-	m_update_in_process = true;
 
 	for (int i = 0; i < quaternion_number; i++)
 	{
@@ -263,8 +262,6 @@ void MadgwickTestMode::addQuaternions(std::vector<glm::quat> const& quaternions,
 
 	data_start_timer = std::chrono::steady_clock::now(); //set relative time
 
-	//m_update_in_process = false;
-
 	if (!m_converged)
 	{
 		//if the filter hasn't yet converged add the first quaternion from this set to the convergence array
@@ -323,7 +320,6 @@ void MadgwickTestMode::addData(std::vector<std::vector<std::vector<float> > > co
 
 		deltaT = m_timeStamps[i] - m_timeStamps[i - 1]; //should always equal sensor ODR since only the first time stamp is recorded 
 	}
-	m_update_in_process = false; //set this to false after addQuaternion and addData has been called
 }
 
 void MadgwickTestMode::update()
@@ -331,8 +327,6 @@ void MadgwickTestMode::update()
 	//Animate the current rotation quaternion obtained from the Personal Caddie. We need to look at the 
 	//time stamp to figure out which quaternion is correct. We do this since the ODR of the sensors won't always
 	//match up with the frame rate of the current screen.
-	
-	while (m_update_in_process) {}; //data is currently being updated asynchronously, wait for it to finish
 
 	float time_elapsed_since_data_start = (float)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - data_start_timer).count() / 1000000000.0f;
 	float quat[3];
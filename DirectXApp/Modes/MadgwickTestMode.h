@@ -43,7 +43,6 @@ private:
 	std::chrono::steady_clock::time_point data_start_timer;
 
 	volatile int m_currentQuaternion;
-	volatile bool m_update_in_process;
 	DirectX::XMVECTOR m_renderQuaternion; //the current quaternion to be applied on screen
 	std::vector<glm::quat> m_quaternions;
 	glm::quat m_headingOffset = { 1.0f, 0.0f, 0.0f, 0.0f };
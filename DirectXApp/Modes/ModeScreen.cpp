@@ -84,6 +84,9 @@ void ModeScreen::update()
 	//after processing input, see if there are any event handlers that were triggered
 	processEvents();
 
+	//pass any new data from the Personal Caddie to the current mode
+	processSampleBatches();
+
 	//Have the current state make any necessary updates based on the 
 	//input and events that have just been processed
 	getCurrentMode()->uiUpdate(); //Updates based on interaction with UI Elements on screen
@@ -125,6 +128,50 @@ void ModeScreen::processMouseInput(InputState* inputState)
 	if (inputState->scrollWheelDirection != 0) inputState->scrollWheelDirection = 0; //let the input processor know that mouse scroll has been handled
 }
 
+void ModeScreen::processSampleBatches()
+{
+	//Drains every data set that the Personal Caddie has finished processing since the last frame and passes
+	//them to the current mode. Since this happens on the same thread that calls each mode's update() method,
+	//modes no longer need to wait for data to finish being written before they can use it.
+	if (m_personalCaddie == nullptr) return;
+
+	SampleBatchQueue& queue = m_personalCaddie->getSampleBatchQueue();
+	while (SampleBatch* batch = queue.front())
+	{
+		//TODO: Remove the mode specific logic, it should be the same regardless of the mode
+		std::shared_ptr<Mode> mode = getCurrentMode();
+		if (batch->attitudeAligned) mode->attitudeAligned();
+		mode->addSessionData(m_personalCaddie->getSessionData(), batch->firstSessionSample, batch->numberOfSamples);
+
+		if (m_currentMode == ModeType::CALIBRATION)
+		{
+			mode->addData(batch->sensorData, batch->sensorODR, batch->timeStamp, batch->numberOfSamples);
+			mode->addQuaternions(batch->quaternions, batch->numberOfSamples, batch->timeStamp, 1.0f / batch->sensorODR);
+		}
+		else if (m_currentMode == ModeType::GRAPH_MODE)
+		{
+			mode->addQuaternions(batch->quaternions, batch->numberOfSamples, batch->timeStamp, 1.0f / batch->sensorODR);
+		}
+		else if (m_currentMode == ModeType::MADGWICK || m_currentMode == ModeType::FREE)
+		{
+			mode->addQuaternions(batch->quaternions, batch->numberOfSamples, batch->timeStamp, 1.0f / batch->sensorODR);
+			mode->addData(batch->sensorData, batch->sensorODR, batch->timeStamp, batch->numberOfSamples);
+		}
+
+		queue.pop();
+	}
+
+	//If the render thread falls far enough behind the BLE thread, data sets get dropped. Let
+	//the debug output know whenever this happens.
+	uint64_t overruns = queue.overruns();
+	if (overruns != m_reportedSampleBatchOverruns)
+	{
+		std::wstring message = L"Sample batch queue overrun, " + std::to_wstring(overruns - m_reportedSampleBatchOverruns) + L" data sets dropped (" + std::to_wstring(overruns) + L" total)\n";
+		OutputDebugString(&message[0]);
+		m_reportedSampleBatchOverruns = overruns;
+	}
+}
+
 void ModeScreen::processEvents()
 {
 	//There are times when handler methods asynchronously receive information that we'd like to display
@@ -305,21 +352,10 @@ void ModeScreen::PersonalCaddieHandler(PersonalCaddieEventType pcEvent, void* ev
 	}
 	case PersonalCaddieEventType::DATA_READY:
 	{
-		//The imu on the personal caddie has finished taking readings and has sent the data over.
-		//Send the data to the current mode if it needs it.
-
-		//TODO: Remove the mode specific logic, it should be the same regardless of the mode
-		
-		if (m_currentMode == ModeType::GRAPH_MODE || m_currentMode == ModeType::CALIBRATION)
-		{
-			m_modes[static_cast<int>(m_currentMode)]->addData(m_personalCaddie->getSensorData(), m_personalCaddie->getMaxODR(), m_personalCaddie->getDataTimeStamp(), m_personalCaddie->getNumberOfSamples());
-			m_modes[static_cast<int>(m_currentMode)]->addQuaternions(m_personalCaddie->getQuaternions(), m_personalCaddie->getNumberOfSamples(), m_personalCaddie->getCurrentTime(), 1.0f / m_personalCaddie->getMaxODR());
-		}
-		else if (m_currentMode == ModeType::MADGWICK || m_currentMode == ModeType::FREE)
-		{
-			m_modes[static_cast<int>(m_currentMode)]->addQuaternions(m_personalCaddie->getQuaternions(), m_personalCaddie->getNumberOfSamples(), m_personalCaddie->getCurrentTime(), 1.0f / m_personalCaddie->getMaxODR());
-			m_modes[static_cast<int>(m_currentMode)]->addData(m_personalCaddie->getSensorData(), m_personalCaddie->getMaxODR(), m_personalCaddie->getDataTimeStamp(), m_personalCaddie->getNumberOfSamples());
-		}
+		//The imu on the personal caddie has finished taking readings and has sent the data over. This
+		//event comes in on the BLE thread so the data isn't passed to the current mode here, instead it
+		//gets pulled from the Personal Caddie's sample batch queue in processSampleBatches() as part of
+		//the normal update loop.
 		break;
 	}
 	case PersonalCaddieEventType::PC_ERROR:
@@ -542,6 +578,40 @@ void ModeScreen::ModeHandler(ModeAction action, void* eventArgs)
 		m_personalCaddie->setMadgwickBeta(beta_value);
 		break;
 	}
+	case SessionRecording:
+	{
+		//Starts or stops saving the raw data coming from the Personal Caddie to a binary session file (.pcs) in the local
+		//folder of the app, which can be played back later with the Replay Tool. The eventArgs holds a pointer to the name
+		//of the file (a std::wstring without the extension) to start a recording, or a nullptr to stop the current one.
+		if (eventArgs == nullptr) m_personalCaddie->stopSessionFile();
+		else m_personalCaddie->startSessionFile(*((std::wstring*)eventArgs));
+		break;
+	}
+	case SwingBurstCapture:
+	{
+		//Turns swing burst capture on the Personal Caddie on or off, the eventArgs holds a pointer to a bool. The window
+		//is the one the firmware uses by default and a swing is anything faster than 1000 deg/s. Like the other sensor
+		//settings it takes effect the next time the Personal Caddie goes into sensor active mode.
+		bool enable = *((bool*)eventArgs);
+		m_personalCaddie->setBurstCapture(enable, 1000.0f, BURST_CAPTURE_DEFAULT_PRE_MS / 1000.0f, BURST_CAPTURE_DEFAULT_POST_MS / 1000.0f);
+		break;
+	}
+	case SwingBurstLookup:
+	{
+		//Hands the current mode the most recent swing burst that covers the time (a double on the session data store's
+		//timeline) pointed to by the eventArgs. The burst stays valid until SWING_BURST_SLOTS - 1 newer ones come in.
+		double time_stamp = *((double*)eventArgs);
+		getCurrentMode()->getSwingBurst(m_personalCaddie->getSwingBursts().find(time_stamp));
+		break;
+	}
+	case AlignAttitude:
+	{
+		//Instead of turning up the Madgwick filter's beta value and waiting for it to converge, the Personal Caddie can find the
+		//orientation of the sensor from gravity and the magnetic field in the next data set. The current mode's attitudeAligned()
+		//method gets called once that data set comes through.
+		m_personalCaddie->alignAttitude();
+		break;
+	}
 	default: return;
 	}
 }
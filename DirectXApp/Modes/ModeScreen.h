@@ -52,6 +52,7 @@ private:
 	void processKeyboardInput(InputState* inputState);
 	void processMouseInput(InputState* inputState);
 	void processEvents();
+	void processSampleBatches();
 
 	//Mode Methods
 	void changeCurrentMode(ModeType mt);
@@ -74,6 +75,9 @@ private:
 	Camera                                  m_camera; //a camera for rendering 3D scenes of certain modes
 	std::vector<std::shared_ptr<Material> > m_materials; //materials used for rendering 3D objects
 
+	//Data Variables
+	uint64_t                                m_reportedSampleBatchOverruns = 0; //the number of sample batch queue overruns that have been logged
+
 	//Input Variables
 	DirectX::XMFLOAT2                       m_previousMousePosition; //let's us know if the mouse has moved since the last frame was rendered
 
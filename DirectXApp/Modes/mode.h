@@ -64,7 +64,11 @@ enum ModeAction
 	BLEConnection,
 	BLENotifications,
 	IMUHeading,
-	ChangeMode
+	ChangeMode,
+	SessionRecording,
+	SwingBurstCapture,
+	SwingBurstLookup,
+	AlignAttitude
 };
 
 //Class definition
@@ -93,6 +97,8 @@ public:
 	//Data Gathering Methods
 	virtual void addData(std::vector<std::vector<std::vector<float> > > const& sensorData, float sensorODR, float timeStamp, int totalSamples) {} //A method that modes can overwrite when they need data from the Personal Caddie
 	virtual void addQuaternions(std::vector<glm::quat> const& quaternions, int quaternion_number, float time_stamp, float delta_t) {} //A method that modes can overwrite when they need data from the Personal Caddie
+	virtual void addSessionData(SessionDataStore const& sessionData, uint64_t firstNewSample, int totalSamples) {} //Lets modes read data straight out of the Personal Caddie's session store instead of copying it
+	virtual void attitudeAligned() {} //Called before the first batch of data whose orientation was found from gravity and the magnetic field, see ModeAction::AlignAttitude
 
 	//Alert Methods
 	void createAlert(std::wstring message, UIColor color, long long duration = 2500); //default to 2.5 second alerts
@@ -107,6 +113,7 @@ public:
 	virtual void getBLEDeviceWatcherStatus(bool status) {};
 	virtual void getString(std::wstring message) {}; //This method is used to pass strings from the mode screen to the active mode, it's up to each individual mode on if and how to implement this
 	virtual void getIMUHeadingOffset(glm::quat heading) {};
+	virtual void getSwingBurst(SwingBurst const* burst) {}; //nullptr when there's no burst at the time that was asked for
 
 	//Methods for handling Personal Caddie, BLE and Sensor Events
 	virtual void pc_ModeChange(PersonalCaddiePowerMode newMode) {};
@@ -16,6 +16,7 @@ extern "C" {
 #define ACC_START 1                                                       /**< start of the accelerometer section of the settings array **/
 #define GYR_START 11                                                      /**< start of the accelerometer section of the settings array **/
 #define MAG_START 21                                                      /**< start of the accelerometer section of the settings array **/
+#define DATA_ENCODING 31                                                  /**< last byte of the settings array, selects how samples are encoded in the data characteristic (see sample_packing.h) **/
 
 //A list of the different sensor types
 typedef enum
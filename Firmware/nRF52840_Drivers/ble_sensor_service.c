@@ -5,6 +5,7 @@
 #include "app_error.h"
 #include "SEGGER_RTT.h"
 #include "sdk_macros.h"
+#include "boot_cache.h"
 
 /**@brief Function for handling the Write event.
  *
@@ -66,7 +67,11 @@ uint32_t ble_sensor_service_init(ble_sensor_service_t * p_ss, const ble_sensor_s
     VERIFY_SUCCESS(err_code);
 
     // Add Available Sesnors characteristic
-    return ble_sensor_service_available_sensors_char_add(p_ss);
+    err_code = ble_sensor_service_available_sensors_char_add(p_ss);
+    VERIFY_SUCCESS(err_code);
+
+    // Add Burst Data characteristic
+    return ble_sensor_service_burst_char_add(p_ss);
 }
 
 uint32_t ble_sensor_service_data_char_add(ble_sensor_service_t * p_ss)
@@ -126,6 +131,7 @@ uint32_t ble_sensor_service_data_char_add(ble_sensor_service_t * p_ss)
     add_large_char_params.uuid_type         = p_ss->uuid_type;
     add_large_char_params.init_len          = LARGE_DATA_CHARACTERISTIC_SIZE * sizeof(uint8_t);
     add_large_char_params.max_len           = LARGE_DATA_CHARACTERISTIC_SIZE * sizeof(uint8_t);
+    add_large_char_params.is_var_len        = true; //packed samples (see sample_packing.h) don't fill the whole characteristic
     add_large_char_params.char_props.read   = 1;
     add_large_char_params.char_props.notify = 1;
 
@@ -165,15 +171,16 @@ uint32_t ble_sensor_service_available_sensors_char_add(ble_sensor_service_t * p_
     ble_add_char_params_t add_char_params;
 
     //Add Available Sensors characteristic. This is a read only
-    //characteristic that holds 20 bytes. The first 10 bytes
+    //characteristic that holds 41 bytes. The first 10 bytes
     //represent the sensors available on the internal TWI bus and
     //the second 10 bytes represent availble sensors on the 
-    //external TWI bus.
+    //external TWI bus. The last 21 bytes are the boot timing
+    //(see boot_cache.h).
     memset(&add_char_params, 0, sizeof(add_char_params));
     add_char_params.uuid              = AVAILABLE_SENSORS_CHAR_UUID;
     add_char_params.uuid_type         = p_ss->uuid_type;
-    add_char_params.init_len          = 20 * sizeof(uint8_t);
-    add_char_params.max_len           = 20 * sizeof(uint8_t);
+    add_char_params.init_len          = (BOOT_TIMING_OFFSET + BOOT_TIMING_SIZE) * sizeof(uint8_t);
+    add_char_params.max_len           = (BOOT_TIMING_OFFSET + BOOT_TIMING_SIZE) * sizeof(uint8_t);
     add_char_params.char_props.read   = 1;
 
     add_char_params.read_access       = SEC_OPEN;
@@ -183,4 +190,29 @@ uint32_t ble_sensor_service_available_sensors_char_add(ble_sensor_service_t * p_
                                   &p_ss->available_handle);
 
     return err_code;
-}
\ No newline at end of file
+}
+
+uint32_t ble_sensor_service_burst_char_add(ble_sensor_service_t * p_ss)
+{
+    ble_add_char_params_t add_char_params;
+
+    //Add Burst Data characteristic. When burst capture is on, the full rate window
+    //around each swing gets sent through this characteristic a chunk at a time
+    //(see burst_capture.h for the layout). It's kept separate from the other data
+    //characteristics so the front end never mixes it up with the live stream.
+    memset(&add_char_params, 0, sizeof(add_char_params));
+    add_char_params.uuid              = BURST_DATA_CHARACTERISTIC_UUID;
+    add_char_params.uuid_type         = p_ss->uuid_type;
+    add_char_params.init_len          = BURST_DATA_CHARACTERISTIC_SIZE * sizeof(uint8_t);
+    add_char_params.max_len           = BURST_DATA_CHARACTERISTIC_SIZE * sizeof(uint8_t);
+    add_char_params.is_var_len        = true; //the last chunk of a window and packed chunks don't fill the whole characteristic
+    add_char_params.char_props.read   = 1;
+    add_char_params.char_props.notify = 1;
+
+    add_char_params.read_access       = SEC_OPEN;
+    add_char_params.cccd_write_access = SEC_OPEN;
+
+    return characteristic_add(p_ss->service_handle,
+                                  &add_char_params,
+                                  &p_ss->burst_handle);
+}
@@ -30,12 +30,15 @@ NRF_SDH_BLE_OBSERVER(_name ## _obs,                                         \
 #define MEDIUM_DATA_CHARACTERISTIC_UUID   0xBF37
 #define LARGE_DATA_CHARACTERISTIC_UUID    0xBF38
 #define AVAILABLE_SENSORS_CHAR_UUID       0xBF39
+#define BURST_DATA_CHARACTERISTIC_UUID    0xBF3A
 
 #define MAX_SENSOR_SAMPLES 39                /**< The max number of sensor samples we can put into a characteristic and still send out all data with 1 notification*/
 #define SAMPLE_SIZE     6                    /**< The size (in bytes) of a full sensor sample reading (includes x, y and z axes) */
-#define SMALL_DATA_CHARACTERISTIC_SIZE 5 + 3 * 4 * SAMPLE_SIZE
-#define MEDIUM_DATA_CHARACTERISTIC_SIZE 5 + 3 * 8 * SAMPLE_SIZE
-#define LARGE_DATA_CHARACTERISTIC_SIZE 5 + 3 * MAX_SENSOR_SAMPLES / 3 * SAMPLE_SIZE
+#define DATA_CHARACTERISTIC_HEADER_SIZE 9   /**< 4 byte time stamp, 1 byte sample count, 2 byte packet sequence number and 2 byte dropped packet count */
+#define SMALL_DATA_CHARACTERISTIC_SIZE DATA_CHARACTERISTIC_HEADER_SIZE + 3 * 4 * SAMPLE_SIZE
+#define MEDIUM_DATA_CHARACTERISTIC_SIZE DATA_CHARACTERISTIC_HEADER_SIZE + 3 * 8 * SAMPLE_SIZE
+#define LARGE_DATA_CHARACTERISTIC_SIZE DATA_CHARACTERISTIC_HEADER_SIZE + 3 * MAX_SENSOR_SAMPLES / 3 * SAMPLE_SIZE
+#define BURST_DATA_CHARACTERISTIC_SIZE LARGE_DATA_CHARACTERISTIC_SIZE /**< Same size as the large data characteristic so it fits in a single packet too */
 
 // Forward declaration of the ble_sensor_service_t type.
 typedef struct ble_sensor_service_s ble_sensor_service_t;
@@ -56,6 +59,7 @@ struct ble_sensor_service_s
     ble_gatts_char_handles_t    data_handles[3];                        /**< Handles related to the Data Characteristic. */
     ble_gatts_char_handles_t    settings_handles;                       /**< Handles related to the Settings Characteristic. */
     ble_gatts_char_handles_t    available_handle;                       /**< Handle related to the Available Sensors Characteristic. */
+    ble_gatts_char_handles_t    burst_handle;                           /**< Handles related to the Burst Data Characteristic. */
     uint8_t                     uuid_type;                              /**< UUID type for the Sensor Service. */
     ble_sensor_service_setting_write_handler_t setting_write_handler;   /**< Event handler to be called when the Settings Characteristic is written. */
 };
@@ -102,6 +106,16 @@ uint32_t ble_sensor_service_settings_char_add(ble_sensor_service_t * p_ss, const
  */
 uint32_t ble_sensor_service_available_sensors_char_add(ble_sensor_service_t * p_ss);
 
+/**@brief Function for adding the Burst Data Characteristic.
+ *
+ * @param[out] p_ss       Sensor Service structure. This structure must be supplied by
+ *                        the application. It is initialized by this function and will later
+ *                        be used to identify this particular service instance.
+ *
+ * @retval NRF_SUCCESS If the characteristic was initialized successfully. Otherwise, an error code is returned.
+ */
+uint32_t ble_sensor_service_burst_char_add(ble_sensor_service_t * p_ss);
+
 /**@brief Function for handling the application's BLE stack events.
  *
  * @details This function handles all events from the BLE stack that are of interest to the Sensor Service.
@@ -3,12 +3,18 @@
 #include "SEGGER_RTT.h"
 #include "sensor_settings.h"
 #include "personal_caddie_operating_modes.h"
+#include "nRF_Implementations/pc_twi.h"
+
+#include <string.h>
 
 //set up settings variables
 static imu_communication_t* imu_comm;
 static uint8_t*             p_sensor_settings;
 
 static struct bmi2_dev    bmi270; //driver defined struct for holding functional pointers and other info
+static bmi270_fifo_t      bmi270_fifo; //holds the buffer for reading batches of samples out of the FIFO
+static uint8_t            odr_override = 0; //when not 0, the acc and gyr run at this ODR instead of the one in the settings array (used by burst capture)
+static uint8_t            burst_buffer[1 + BMI270_CONFIG_BURST_LENGTH]; //register address followed by a chunk of a long write, EasyDMA can't read the config file straight out of flash
 
 //custom enums
 enum bmi270_power_mode {
@@ -36,6 +42,13 @@ void bmi270init(imu_communication_t* comm, uint8_t* settings)
     bmi270.read = bmi270_read_register; //set the I2C read functional pointer
     bmi270.write = bmi270_write_register; //set the I2C write functional pointer
     bmi270.delay_us = bmi270_delay; //set the microsecond delay functional pointer
+
+    //When the sensor gets initialized the Bosch driver uploads its ~8 KB config file read_write_len
+    //bytes at a time, each chunk being a write of its address and then a write of the data. Left
+    //at 0 the driver bumps this up to 2 bytes, which is thousands of tiny transfers. Long writes
+    //go out as single TWI transfers (see bmi270_write_register()) so the whole file only takes
+    //a handful of bursts.
+    bmi270.read_write_len = BMI270_CONFIG_BURST_LENGTH;
     
     //First we set up the communication interface pointer and then call the 
     //driver's built-in init method. This method performs a soft-reset of the 
@@ -211,6 +224,18 @@ int32_t bmi270_active_mode_enable(int current_mode)
             break;
     }
 
+    //Burst capture needs both sensors running at the same (fast) ODR no matter what the settings
+    //array says. The BMI270 only supports ODRs this high with the filters in performance mode, and
+    //advanced power saving has to be off for them.
+    if (odr_override != 0)
+    {
+        config[ACC_SENSOR].cfg.acc.odr = odr_override;
+        config[GYR_SENSOR].cfg.gyr.odr = odr_override;
+        config[ACC_SENSOR].cfg.acc.filter_perf = BMI2_PERF_OPT_MODE;
+        config[GYR_SENSOR].cfg.gyr.filter_perf = BMI2_PERF_OPT_MODE;
+        power_save = 0;
+    }
+
     //Low pass filter bandwidth
     config[ACC_SENSOR].cfg.acc.bwp = p_sensor_settings[ACC_START + LOW_PASS_FILTER];
     config[GYR_SENSOR].cfg.gyr.bwp = p_sensor_settings[GYR_START + LOW_PASS_FILTER];
@@ -322,9 +347,16 @@ int8_t bmi270_read_register(uint8_t reg_addr, uint8_t *reg_data, uint32_t len, v
 int8_t bmi270_write_register(uint8_t reg_addr, const uint8_t *reg_data, uint32_t len, void *intf_ptr)
 {
     //This method converts my function pointer for a I2C write into the form required
-    //by Bosch's drivers.
+    //by Bosch's drivers. Writes that are too long for the TWI transfer queue to copy (only
+    //the config file upload) get put together with their register address in RAM and sent
+    //as a single burst.
     sensor_communication_t* comm = (sensor_communication_t*)intf_ptr;
-    return (int8_t) imu_comm->acc_comm.write_register((void*)comm->twi_bus, comm->address, reg_addr, reg_data, (uint16_t)len);
+    if (len <= TWI_QUEUE_MAX_WRITE_LENGTH) return (int8_t) imu_comm->acc_comm.write_register((void*)comm->twi_bus, comm->address, reg_addr, reg_data, (uint16_t)len);
+    if (len > BMI270_CONFIG_BURST_LENGTH) return BMI2_E_COM_FAIL;
+
+    burst_buffer[0] = reg_addr;
+    memcpy(burst_buffer + 1, reg_data, len);
+    return (int8_t) sensor_write_burst((void*)comm->twi_bus, comm->address, burst_buffer, (uint16_t)(len + 1));
 }
 
 void bmi270_delay(uint32_t period, void *intf_ptr)
@@ -441,4 +473,86 @@ int32_t bmi270_get_gyr_data(uint8_t* pBuff, uint8_t offset)
     }
 
     return rslt;
-}
\ No newline at end of file
+}
+
+void bmi270_odr_override_set(uint8_t odr)
+{
+    //Sets an ODR (one of the BMI2_ACC_ODR values, the gyr values match them up to 1600 Hz) that the
+    //acc and gyr get set to the next time active mode is enabled instead of the ODRs in the settings
+    //array. Passing 0 goes back to using the settings array.
+    odr_override = odr;
+}
+
+int32_t bmi270_fifo_mode_enable(uint8_t samples)
+{
+    //In FIFO mode the BMI270 buffers acc and gyr samples in its own FIFO at the sensor ODR instead
+    //of us reading the data registers every time the data timer goes off. The FIFO watermark is
+    //set to a full data characteristic worth of samples and the watermark interrupt is mapped to
+    //the INT1 pin, so the nRF chip only needs to wake up and read the sensor once per characteristic.
+    //This should be called after the sensors have been put into active mode.
+    if (imu_comm->sensor_model[ACC_SENSOR] != BMI270_ACC || imu_comm->sensor_model[GYR_SENSOR] != BMI270_GYR) return -1; //headerless frames need both sensors
+
+    //Start with a clean configuration and then turn on headerless mode with only acc and gyr data
+    int8_t rslt = bmi2_set_fifo_config(BMI2_FIFO_ALL_EN | BMI2_FIFO_HEADER_EN | BMI2_FIFO_TIME_EN | BMI2_FIFO_STOP_ON_FULL, BMI2_DISABLE, &bmi270);
+    if (rslt == BMI2_OK) rslt = bmi2_set_fifo_config(BMI2_FIFO_ACC_EN | BMI2_FIFO_GYR_EN, BMI2_ENABLE, &bmi270);
+    if (rslt == BMI2_OK) rslt = bmi2_set_fifo_wm(bmi270_fifo_watermark(samples), &bmi270);
+
+    //The interrupt pin is push-pull and active high. It's also non-latched, so the pin stays high for
+    //as long as the FIFO is above the watermark and drops as soon as enough frames have been read.
+    struct bmi2_int_pin_config int_cfg;
+    if (rslt == BMI2_OK) rslt = bmi2_get_int_pin_config(&int_cfg, &bmi270);
+    if (rslt == BMI2_OK)
+    {
+        int_cfg.pin_type = BMI2_INT1;
+        int_cfg.int_latch = BMI2_INT_NON_LATCH;
+        int_cfg.pin_cfg[0].lvl = BMI2_INT_ACTIVE_HIGH;
+        int_cfg.pin_cfg[0].od = BMI2_INT_PUSH_PULL;
+        int_cfg.pin_cfg[0].output_en = BMI2_INT_OUTPUT_ENABLE;
+        int_cfg.pin_cfg[0].input_en = BMI2_INT_INPUT_DISABLE;
+        rslt = bmi2_set_int_pin_config(&int_cfg, &bmi270);
+    }
+    if (rslt == BMI2_OK) rslt = bmi2_map_data_int(BMI2_FWM_INT, BMI2_INT1, &bmi270);
+
+    //Throw out anything that made it into the FIFO while it was being configured
+    if (rslt == BMI2_OK) rslt = bmi2_set_command_register(BMI2_FIFO_FLUSH_CMD, &bmi270);
+
+    if (rslt != BMI2_OK) SEGGER_RTT_WriteString(0, "Error: Couldn't put BMI270 Sensor into FIFO mode.\n");
+    else bmi270_fifo_init(&bmi270_fifo, bmi270.read, bmi270.intf_ptr, bmi270.gyr_cross_sens_zx);
+
+    return rslt;
+}
+
+int32_t bmi270_fifo_mode_disable()
+{
+    //Unmap the watermark interrupt and stop filling the FIFO
+    if (imu_comm->sensor_model[ACC_SENSOR] != BMI270_ACC || imu_comm->sensor_model[GYR_SENSOR] != BMI270_GYR) return 0;
+
+    int8_t rslt = bmi2_map_data_int(BMI2_FWM_INT, BMI2_INT_NONE, &bmi270);
+    if (rslt == BMI2_OK) rslt = bmi2_set_fifo_config(BMI2_FIFO_ACC_EN | BMI2_FIFO_GYR_EN, BMI2_DISABLE, &bmi270);
+    if (rslt == BMI2_OK) rslt = bmi2_set_command_register(BMI2_FIFO_FLUSH_CMD, &bmi270);
+
+    if (rslt != BMI2_OK) SEGGER_RTT_WriteString(0, "Error: Couldn't take BMI270 Sensor out of FIFO mode.\n");
+    return rslt;
+}
+
+int32_t bmi270_fifo_set_watermark(uint8_t samples)
+{
+    //Changes how many samples the FIFO collects before the watermark interrupt goes off
+    int8_t rslt = bmi2_set_fifo_wm(bmi270_fifo_watermark(samples), &bmi270);
+    if (rslt != BMI2_OK) SEGGER_RTT_WriteString(0, "Error: Couldn't update BMI270 FIFO watermark.\n");
+    return rslt;
+}
+
+int32_t bmi270_fifo_frames_waiting(uint16_t* frames)
+{
+    //Returns the number of full acc + gyr frames currently sitting in the FIFO
+    return bmi270_fifo_frames_available(&bmi270_fifo, frames);
+}
+
+int32_t bmi270_get_fifo_data(uint8_t* pBuff, uint16_t offset, uint16_t stride, uint8_t samples, uint8_t* samples_read)
+{
+    //Reads a full data characteristic worth of samples out of the FIFO in a single burst. The acc
+    //reading of each sample starts at pBuff + offset + n * stride with the gyr reading right after
+    //it. If the FIFO doesn't have enough samples yet then nothing is read.
+    return bmi270_fifo_read(&bmi270_fifo, pBuff, offset, stride, samples, samples_read);
+}
@@ -4,11 +4,13 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "Bosch/bmi270.h"
+#include "bmi270_fifo.h"
 #include "sensor_settings.h"
 #include "sensor_communication.h"
 
 #define BMI270_SUSPEND_TO_ACTIVE_DELAY_US 45000
 #define BMI270_CONFIG_TO_ACTIVE_DELAY_US 2000
+#define BMI270_CONFIG_BURST_LENGTH 1024 /**< Bytes of the config file sent in each burst when the sensor gets initialized, divides the 8 KB file evenly */
 
 #ifdef __cplusplus
 extern "C" {
@@ -22,6 +24,7 @@ int32_t bmi270_idle_mode_enable(int current_mode);
 int32_t bmi270_active_mode_enable(int current_mode);
 
 void bmi270_get_actual_settings();
+void bmi270_odr_override_set(uint8_t odr);
 
 //Implementations of Driver Functional Pointers
 int8_t bmi270_read_register(uint8_t reg_addr, uint8_t *reg_data, uint32_t len, void *intf_ptr);
@@ -33,6 +36,13 @@ int32_t bmi270_get_dummy_data(uint8_t* pBuff, uint8_t offset);
 int32_t bmi270_get_acc_data(uint8_t* pBuff, uint8_t offset);
 int32_t bmi270_get_gyr_data(uint8_t* pBuff, uint8_t offset);
 
+//FIFO Methods
+int32_t bmi270_fifo_mode_enable(uint8_t samples);
+int32_t bmi270_fifo_mode_disable();
+int32_t bmi270_fifo_set_watermark(uint8_t samples);
+int32_t bmi270_fifo_frames_waiting(uint16_t* frames);
+int32_t bmi270_get_fifo_data(uint8_t* pBuff, uint16_t offset, uint16_t stride, uint8_t samples, uint8_t* samples_read);
+
 #ifdef __cplusplus
 }
 #endif
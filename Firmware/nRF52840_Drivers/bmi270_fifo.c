@@ -0,0 +1,102 @@
+#include "bmi270_fifo.h"
+
+static void write_axis(uint8_t* pBuff, int16_t value)
+{
+    //Characteristics are little endian, same as the nRF52840 and the BMI270
+    pBuff[0] = value & 0xFF;
+    pBuff[1] = ((value & 0xFF00) >> 8);
+}
+
+static bool is_dummy_frame(const uint8_t* data, uint8_t dummy_header)
+{
+    //When a sensor doesn't have a new sample ready the BMI270 puts a dummy value into its
+    //part of the FIFO frame. These frames get thrown out instead of being sent.
+    return (data[0] == dummy_header && data[1] == BMI2_FIFO_HEADERLESS_DUMMY_BYTE_1 &&
+            data[2] == BMI2_FIFO_HEADERLESS_DUMMY_BYTE_2 && data[3] == BMI2_FIFO_HEADERLESS_DUMMY_BYTE_3);
+}
+
+void bmi270_fifo_init(bmi270_fifo_t* fifo, bmi2_read_fptr_t read, void* intf_ptr, int16_t gyr_cross_sens_zx)
+{
+    fifo->read = read;
+    fifo->intf_ptr = intf_ptr;
+    fifo->gyr_cross_sens_zx = gyr_cross_sens_zx;
+}
+
+uint16_t bmi270_fifo_watermark(uint8_t samples)
+{
+    //The watermark interrupt goes off as soon as the FIFO holds this many bytes, which is
+    //enough frames to fill a single data characteristic
+    if (samples > BMI270_FIFO_MAX_BURST_FRAMES) samples = BMI270_FIFO_MAX_BURST_FRAMES;
+    return (uint16_t)samples * BMI270_FIFO_FRAME_SIZE;
+}
+
+int8_t bmi270_fifo_frames_available(bmi270_fifo_t* fifo, uint16_t* frames)
+{
+    //Reads the FIFO length registers and converts the byte count into a number of whole frames
+    uint8_t length_data[2] = { 0 };
+    int8_t rslt = fifo->read(BMI2_FIFO_LENGTH_0_ADDR, length_data, 2, fifo->intf_ptr);
+    if (rslt != BMI2_INTF_RET_SUCCESS)
+    {
+        *frames = 0;
+        return BMI2_E_COM_FAIL;
+    }
+
+    uint16_t length = (uint16_t)(((length_data[1] << 8) | length_data[0]) & BMI270_FIFO_LENGTH_MASK);
+    *frames = length / BMI270_FIFO_FRAME_SIZE;
+    return BMI2_OK;
+}
+
+int8_t bmi270_fifo_read(bmi270_fifo_t* fifo, uint8_t* pBuff, uint16_t offset, uint16_t stride, uint8_t samples, uint8_t* samples_read)
+{
+    //Reads exactly enough frames to fill a data characteristic out of the FIFO with a single
+    //burst read, leaving anything newer in the FIFO for the next characteristic. If there
+    //aren't enough frames in the FIFO yet then nothing is read and samples_read is set to 0.
+    *samples_read = 0;
+    if (samples > BMI270_FIFO_MAX_BURST_FRAMES) samples = BMI270_FIFO_MAX_BURST_FRAMES;
+
+    uint16_t frames = 0;
+    int8_t rslt = bmi270_fifo_frames_available(fifo, &frames);
+    if (rslt != BMI2_OK || frames < samples) return rslt;
+
+    //The FIFO data register doesn't auto-increment, reading more than one byte from it
+    //just keeps pulling bytes out of the FIFO
+    uint16_t length = (uint16_t)samples * BMI270_FIFO_FRAME_SIZE;
+    if (fifo->read(BMI2_FIFO_DATA_ADDR, fifo->buffer, length, fifo->intf_ptr) != BMI2_INTF_RET_SUCCESS) return BMI2_E_COM_FAIL;
+
+    *samples_read = bmi270_fifo_unpack(fifo->buffer, length, pBuff, offset, stride, samples, fifo->gyr_cross_sens_zx);
+    return BMI2_OK;
+}
+
+uint8_t bmi270_fifo_unpack(const uint8_t* fifo_data, uint16_t length, uint8_t* pBuff, uint16_t offset, uint16_t stride, uint8_t max_samples, int16_t gyr_cross_sens_zx)
+{
+    //Takes raw headerless FIFO frames and puts them into the given buffer. Each sample in the
+    //buffer starts stride bytes after the previous one, with the acc reading first followed
+    //by the gyr reading (the same layout as the composite data characteristic). The same
+    //gyroscope cross axis compensation that the Bosch driver applies to register reads is
+    //applied here so FIFO data matches data read one sample at a time.
+    uint8_t samples = 0;
+    for (uint16_t index = 0; index + BMI270_FIFO_FRAME_SIZE <= length && samples < max_samples; index += BMI270_FIFO_FRAME_SIZE)
+    {
+        const uint8_t* gyr = fifo_data + index;
+        const uint8_t* acc = gyr + 6;
+        if (is_dummy_frame(gyr, BMI2_FIFO_HEADERLESS_DUMMY_GYR) || is_dummy_frame(acc, BMI2_FIFO_HEADERLESS_DUMMY_ACC)) continue;
+
+        int16_t gyr_x = (int16_t)((gyr[1] << 8) | gyr[0]);
+        int16_t gyr_y = (int16_t)((gyr[3] << 8) | gyr[2]);
+        int16_t gyr_z = (int16_t)((gyr[5] << 8) | gyr[4]);
+
+        int32_t compensated_x = (int32_t)gyr_x - (int16_t)(((int32_t)gyr_cross_sens_zx * (int32_t)gyr_z) / 512);
+        if (compensated_x > INT16_MAX) compensated_x = INT16_MAX;
+        else if (compensated_x < INT16_MIN) compensated_x = INT16_MIN;
+
+        uint8_t* sample = pBuff + offset + samples * stride;
+        for (int i = 0; i < 6; i++) sample[i] = acc[i]; //the acc data is already in the right byte order
+        write_axis(sample + 6, (int16_t)compensated_x);
+        write_axis(sample + 8, gyr_y);
+        write_axis(sample + 10, gyr_z);
+
+        samples++;
+    }
+
+    return samples;
+}
@@ -0,0 +1,55 @@
+#ifndef BMI270_FIFO_H__
+#define BMI270_FIFO_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "Bosch/bmi2_defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+The bmi270_fifo files handle reading batches of accelerometer and gyroscope samples
+out of the BMI270's hardware FIFO. The FIFO is run in headerless mode with only the
+acc and gyr enabled, so every frame is exactly 12 bytes (gyr x, y, z followed by acc
+x, y, z). Instead of reading the data registers once per sample, the whole batch for
+a data characteristic gets read in a single burst and then unpacked straight into the
+characteristic.
+
+Nothing in here depends on the nRF SDK, all communication goes through the same Bosch
+style read function pointer used by the BMI270 driver. This way the files can be built
+and tested on a computer against a simulated BMI270 register map.
+*/
+
+#define BMI270_FIFO_FRAME_SIZE        12                                          /**< Size (in bytes) of a headerless FIFO frame with acc and gyr data */
+#define BMI270_FIFO_MAX_BURST_FRAMES  39                                          /**< Max frames read in a single burst (matches MAX_SENSOR_SAMPLES in ble_sensor_service.h) */
+#define BMI270_FIFO_MAX_FRAMES        (2048 / BMI270_FIFO_FRAME_SIZE)             /**< The BMI270 FIFO holds 2 KB of data */
+#define BMI270_FIFO_LENGTH_MASK       0x3FFF                                      /**< Only the lower 14 bits of the FIFO length registers hold the byte count */
+
+//Forward declaration of the bmi270_fifo_t type.
+typedef struct bmi270_fifo_s bmi270_fifo_t;
+
+//Struct to hold everything needed for reading from the FIFO
+struct bmi270_fifo_s
+{
+    bmi2_read_fptr_t read;                                                        /**< Reads registers from the BMI270 */
+    void*            intf_ptr;                                                    /**< Passed to the read function, points to the sensor_communication_t for the chip */
+    int16_t          gyr_cross_sens_zx;                                           /**< Gyroscope cross axis sensitivity (loaded from the chip by the Bosch driver) */
+    uint8_t          buffer[BMI270_FIFO_MAX_BURST_FRAMES * BMI270_FIFO_FRAME_SIZE]; /**< Holds the raw bytes of a single burst read */
+};
+
+//Init methods
+void bmi270_fifo_init(bmi270_fifo_t* fifo, bmi2_read_fptr_t read, void* intf_ptr, int16_t gyr_cross_sens_zx);
+
+//Reading Methods
+uint16_t bmi270_fifo_watermark(uint8_t samples);
+int8_t bmi270_fifo_frames_available(bmi270_fifo_t* fifo, uint16_t* frames);
+int8_t bmi270_fifo_read(bmi270_fifo_t* fifo, uint8_t* pBuff, uint16_t offset, uint16_t stride, uint8_t samples, uint8_t* samples_read);
+uint8_t bmi270_fifo_unpack(const uint8_t* fifo_data, uint16_t length, uint8_t* pBuff, uint16_t offset, uint16_t stride, uint8_t max_samples, int16_t gyr_cross_sens_zx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BMI270_FIFO_H__
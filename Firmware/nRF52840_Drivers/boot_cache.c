@@ -0,0 +1,115 @@
+#include "boot_cache.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#define BOOT_CACHE_CRC_START  (offsetof(boot_cache_t, crc) + sizeof(uint32_t))  /**< The CRC covers everything after its own field */
+
+static void put_uint32(uint8_t* p_data, uint32_t value)
+{
+    //Little endian, the same as everything else the front end reads
+    for (int i = 0; i < 4; i++) p_data[i] = (value >> (8 * i)) & 0xFF;
+}
+
+static uint32_t get_uint32(const uint8_t* p_data)
+{
+    return (uint32_t)p_data[0] | ((uint32_t)p_data[1] << 8) | ((uint32_t)p_data[2] << 16) | ((uint32_t)p_data[3] << 24);
+}
+
+static uint32_t record_crc(const boot_cache_t* cache)
+{
+    return boot_cache_crc32((const uint8_t*)cache + BOOT_CACHE_CRC_START, sizeof(boot_cache_t) - BOOT_CACHE_CRC_START);
+}
+
+uint32_t boot_cache_crc32(const uint8_t* p_data, uint32_t length)
+{
+    //The standard (reflected 0xEDB88320) CRC32 a bit at a time. The record only gets checked once
+    //per power up and written once in a while so there's no need for a lookup table.
+    uint32_t crc = 0xFFFFFFFF;
+    for (uint32_t i = 0; i < length; i++)
+    {
+        crc ^= p_data[i];
+        for (int bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+
+    return ~crc;
+}
+
+void boot_cache_build(boot_cache_t* cache, const uint8_t* internal_sensors, uint8_t internal_sensors_found,
+                      const uint8_t* external_sensors, uint8_t external_sensors_found, const uint8_t* sensor_settings)
+{
+    //Fills in a record from the current sensor map and settings array and seals it with the CRC.
+    //Unused slots are always 0xFF (and the padding always 0) so two records of the same setup
+    //compare equal byte for byte.
+    memset(cache, 0, sizeof(boot_cache_t));
+    memset(cache->internal_sensors, 0xFF, BOOT_CACHE_MAX_SENSORS);
+    memset(cache->external_sensors, 0xFF, BOOT_CACHE_MAX_SENSORS);
+
+    if (internal_sensors_found > BOOT_CACHE_MAX_SENSORS) internal_sensors_found = BOOT_CACHE_MAX_SENSORS;
+    if (external_sensors_found > BOOT_CACHE_MAX_SENSORS) external_sensors_found = BOOT_CACHE_MAX_SENSORS;
+    memcpy(cache->internal_sensors, internal_sensors, internal_sensors_found);
+    memcpy(cache->external_sensors, external_sensors, external_sensors_found);
+    cache->internal_sensors_found = internal_sensors_found;
+    cache->external_sensors_found = external_sensors_found;
+    memcpy(cache->sensor_settings, sensor_settings, BOOT_CACHE_SETTINGS_LENGTH);
+
+    cache->magic = BOOT_CACHE_MAGIC;
+    cache->version = BOOT_CACHE_VERSION;
+    cache->size = sizeof(boot_cache_t);
+    cache->crc = record_crc(cache);
+}
+
+bool boot_cache_valid(const boot_cache_t* cache)
+{
+    //A record is only used if it came from this version of the firmware, made it to flash in one
+    //piece and actually has a sensor in it
+    if (cache->magic != BOOT_CACHE_MAGIC || cache->version != BOOT_CACHE_VERSION || cache->size != sizeof(boot_cache_t)) return false;
+    if (cache->crc != record_crc(cache)) return false;
+    if (cache->internal_sensors_found > BOOT_CACHE_MAX_SENSORS || cache->external_sensors_found > BOOT_CACHE_MAX_SENSORS) return false;
+
+    return (cache->internal_sensors_found + cache->external_sensors_found) > 0;
+}
+
+void boot_cache_invalidate(boot_cache_t* cache)
+{
+    memset(cache, 0, sizeof(boot_cache_t));
+}
+
+bool boot_cache_equal(const boot_cache_t* a, const boot_cache_t* b)
+{
+    //Used to skip flash writes that wouldn't change anything
+    return memcmp(a, b, sizeof(boot_cache_t)) == 0;
+}
+
+bool boot_cache_confirmed(const boot_cache_t* cache, uint8_t internal_sensors_answered, uint8_t external_sensors_answered)
+{
+    //Only the cached addresses get probed at power up, so the cache checks out when every one
+    //of them answered
+    return boot_cache_valid(cache) && internal_sensors_answered == cache->internal_sensors_found && external_sensors_answered == cache->external_sensors_found;
+}
+
+uint32_t boot_timing_total_us(const boot_timing_t* timing)
+{
+    return timing->sensors_ready_us + timing->configure_us + timing->first_sample_us;
+}
+
+void boot_timing_encode(const boot_timing_t* timing, uint8_t* p_data)
+{
+    //Writes the BOOT_TIMING_SIZE bytes that go at BOOT_TIMING_OFFSET of the available sensors characteristic
+    p_data[0] = timing->discovery;
+    put_uint32(p_data + 1, timing->sensors_ready_us);
+    put_uint32(p_data + 5, timing->discovery_us);
+    put_uint32(p_data + 9, timing->configure_us);
+    put_uint32(p_data + 13, timing->first_sample_us);
+    put_uint32(p_data + 17, boot_timing_total_us(timing));
+}
+
+void boot_timing_decode(const uint8_t* p_data, boot_timing_t* timing)
+{
+    //The total isn't read back since it's always the sum of the stages
+    timing->discovery = p_data[0];
+    timing->sensors_ready_us = get_uint32(p_data + 1);
+    timing->discovery_us = get_uint32(p_data + 5);
+    timing->configure_us = get_uint32(p_data + 9);
+    timing->first_sample_us = get_uint32(p_data + 13);
+}
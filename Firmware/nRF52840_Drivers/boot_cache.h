@@ -0,0 +1,110 @@
+#ifndef BOOT_CACHE_H__
+#define BOOT_CACHE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+The boot_cache files let the Personal Caddie skip most of sensor discovery when it
+powers up. The first time it's turned on every address of both TWI buses gets scanned,
+then the sensors that were found and the settings array get saved to flash. Every power
+up after that only the saved addresses get checked, and as soon as all of them answer
+the saved sensor map gets used as is. If any of them doesn't answer (a sensor was
+unplugged or the record is from a different layout) the full scan runs again and a new
+record gets saved. The settings array gets saved again whenever a stream delivers its
+first sample, so the last settings that were known to work are the ones the next power
+up starts with.
+
+A record is protected by a magic number, a version, its own size and a CRC32 so anything
+left over from different firmware (or half written when the power went out) gets thrown
+away instead of used.
+
+The boot timing says how long each part of getting to the first sample took. Only the
+time the Personal Caddie spends doing work counts, the time spent advertising and waiting
+for the front end to ask for data doesn't, so the total can be held to a budget. It's
+added to the end of the available sensors characteristic:
+
+    byte 20     how the sensors were found (see boot_discovery_t)
+    bytes 21-24 microseconds from reset until the sensors were powered up and found
+    bytes 25-28 microseconds of that spent finding the sensors (checking the cache or scanning)
+    bytes 29-32 microseconds spent configuring the sensors when the first connection came
+                in (mostly uploading the BMI270 config file)
+    bytes 33-36 microseconds from the first request for data until the first sample was read
+    bytes 37-40 boot to first sample, the sum of the three stages above
+
+Stages that haven't happened yet are 0. Forgetting the cache (so a sensor that was just
+plugged in gets found at the next power up) is done through the settings characteristic
+by writing a single byte, BOOT_CACHE_COMMAND.
+
+Nothing in here depends on the nRF SDK so the same files get built on a computer, where
+the whole startup is timed against a simulated BMI270 (see Replay_Tool/boot_budget.cpp).
+*/
+
+#define BOOT_CACHE_MAGIC                0x43424350                                /**< "PCBC" */
+#define BOOT_CACHE_VERSION              1
+#define BOOT_CACHE_MAX_SENSORS          10                                        /**< Addresses kept for each bus, the same as the available sensors characteristic */
+#define BOOT_CACHE_SETTINGS_LENGTH      32                                        /**< The whole sensor settings array (SENSOR_SETTINGS_LENGTH) */
+#define BOOT_CACHE_COMMAND              9                                         /**< First byte of a settings characteristic write that forgets the cached sensors */
+#define BOOT_CACHE_POWER_ON_TIMEOUT_US  50000                                     /**< Longest the cached sensors get to answer after being powered up before the full scan takes over */
+#define BOOT_CACHE_PROBE_INTERVAL_US    500                                       /**< Wait between rounds of checking the cached sensors while they power up */
+#define BOOT_TIMING_OFFSET              20                                        /**< Where the boot timing starts in the available sensors characteristic */
+#define BOOT_TIMING_SIZE                21
+
+//How the sensors were found at power up
+typedef enum
+{
+    BOOT_DISCOVERY_NONE = 0,                                                      /**< Sensors haven't been found yet */
+    BOOT_DISCOVERY_CACHED = 1,                                                    /**< Every cached sensor answered */
+    BOOT_DISCOVERY_SCAN = 2,                                                      /**< There wasn't a usable record so both buses were scanned */
+    BOOT_DISCOVERY_CACHE_MISS = 3                                                 /**< There was a record but one of its sensors didn't answer, so both buses were scanned */
+} boot_discovery_t;
+
+//The record that gets saved to flash. The size is a multiple of 4 bytes since flash
+//records are written a word at a time.
+typedef struct
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t size;                                                                /**< sizeof(boot_cache_t) when the record was written */
+    uint32_t crc;                                                                 /**< CRC32 of everything after this field */
+    uint8_t  internal_sensors[BOOT_CACHE_MAX_SENSORS];                            /**< Addresses of the sensors on the internal bus, 0xFF for unused slots */
+    uint8_t  external_sensors[BOOT_CACHE_MAX_SENSORS];
+    uint8_t  internal_sensors_found;
+    uint8_t  external_sensors_found;
+    uint8_t  sensor_settings[BOOT_CACHE_SETTINGS_LENGTH];                         /**< Last settings array a stream worked with */
+    uint8_t  reserved[2];
+} boot_cache_t;
+
+//How long each part of the startup took, all in microseconds
+typedef struct
+{
+    uint8_t  discovery;                                                           /**< A boot_discovery_t */
+    uint32_t sensors_ready_us;                                                    /**< Reset until sensors_init() was done */
+    uint32_t discovery_us;                                                        /**< Part of sensors_ready_us spent checking the cache or scanning */
+    uint32_t configure_us;                                                        /**< Configuring the sensors for the first connection */
+    uint32_t first_sample_us;                                                     /**< First request for data until the first sample was read */
+} boot_timing_t;
+
+//Record Methods
+uint32_t boot_cache_crc32(const uint8_t* p_data, uint32_t length);
+void boot_cache_build(boot_cache_t* cache, const uint8_t* internal_sensors, uint8_t internal_sensors_found,
+                      const uint8_t* external_sensors, uint8_t external_sensors_found, const uint8_t* sensor_settings);
+bool boot_cache_valid(const boot_cache_t* cache);
+void boot_cache_invalidate(boot_cache_t* cache);
+bool boot_cache_equal(const boot_cache_t* a, const boot_cache_t* b);
+bool boot_cache_confirmed(const boot_cache_t* cache, uint8_t internal_sensors_answered, uint8_t external_sensors_answered);
+
+//Timing Methods
+uint32_t boot_timing_total_us(const boot_timing_t* timing);
+void boot_timing_encode(const boot_timing_t* timing, uint8_t* p_data);
+void boot_timing_decode(const uint8_t* p_data, boot_timing_t* timing);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BOOT_CACHE_H__
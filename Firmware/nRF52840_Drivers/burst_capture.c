@@ -0,0 +1,198 @@
+#include "burst_capture.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#define BURST_CAPTURE_GYR_OFFSET 6 //the gyroscope reading comes right after the accelerometer reading in each sample
+
+static int16_t read_int16(const uint8_t* data)
+{
+    return (int16_t)((uint16_t)data[0] | ((uint16_t)data[1] << 8));
+}
+
+static uint16_t read_uint16(const uint8_t* data)
+{
+    return (uint16_t)((uint16_t)data[0] | ((uint16_t)data[1] << 8));
+}
+
+static void write_uint16(uint8_t* data, uint16_t value)
+{
+    data[0] = value & 0xFF;
+    data[1] = (value >> 8) & 0xFF;
+}
+
+static void write_uint32(uint8_t* data, uint32_t value)
+{
+    for (int i = 0; i < 4; i++) data[i] = (value >> (8 * i)) & 0xFF;
+}
+
+static uint32_t gyroscope_magnitude_squared(const uint8_t* sample)
+{
+    //Three int16s squared add up to at most 3 * 2^30, which still fits in a uint32_t
+    uint32_t magnitude = 0;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        int32_t reading = read_int16(sample + BURST_CAPTURE_GYR_OFFSET + 2 * axis);
+        magnitude += (uint32_t)(reading * reading);
+    }
+    return magnitude;
+}
+
+static uint16_t milliseconds_to_samples(uint16_t milliseconds, float odr)
+{
+    return (uint16_t)(milliseconds * odr / 1000.0f + 0.5f);
+}
+
+static void rearm(burst_capture_t* burst)
+{
+    //Starts filling the buffer from scratch. Whatever was in it is either from before the last
+    //burst or from a window that's already been sent.
+    burst->head = 0;
+    burst->count = 0;
+    burst->sent = 0;
+    burst->quiet = false;
+    burst->state = burst->enabled ? BURST_CAPTURE_ARMED : BURST_CAPTURE_OFF;
+}
+
+void burst_capture_init(burst_capture_t* burst)
+{
+    //Burst capture starts off turned off with the default window and threshold
+    memset(burst, 0, sizeof(burst_capture_t));
+    burst_capture_configure(burst, false, BURST_CAPTURE_DEFAULT_THRESHOLD, BURST_CAPTURE_DEFAULT_PRE_MS, BURST_CAPTURE_DEFAULT_POST_MS);
+}
+
+void burst_capture_configure(burst_capture_t* burst, bool enable, uint16_t threshold, uint16_t pre_ms, uint16_t post_ms)
+{
+    //The new settings don't take effect until the next time data collection starts, the sensors
+    //need to be running at BURST_CAPTURE_ODR for any of this to work.
+    if (threshold == 0) threshold = BURST_CAPTURE_DEFAULT_THRESHOLD;
+
+    burst->enabled = enable;
+    burst->threshold_squared = (uint32_t)threshold * threshold;
+    burst->quiet_squared = burst->threshold_squared / 4; //half the magnitude
+    burst->pre_ms = pre_ms;
+    burst->post_ms = post_ms;
+}
+
+void burst_capture_configure_command(burst_capture_t* burst, const uint8_t* command)
+{
+    //Applies a burst capture write to the settings characteristic, command points to the
+    //byte after the command byte itself (see burst_capture.h for the layout)
+    burst_capture_configure(burst, command[0] != 0, read_uint16(command + 1), read_uint16(command + 3), read_uint16(command + 5));
+}
+
+void burst_capture_start(burst_capture_t* burst, float odr)
+{
+    //Called every time data collection starts with the ODR the sensors are actually running at.
+    //The window has to fit in the buffer with room for the trigger sample, if it doesn't the
+    //pre trigger part gets cut down since what comes after impact is the more interesting part.
+    if (odr <= 0.0f) odr = BURST_CAPTURE_ODR;
+    burst->ticks_per_sample_q8 = (uint32_t)(256.0f * BURST_CAPTURE_TICK_FREQUENCY / odr + 0.5f);
+
+    burst->post_samples = milliseconds_to_samples(burst->post_ms, odr);
+    if (burst->post_samples > BURST_CAPTURE_MAX_SAMPLES - 1) burst->post_samples = BURST_CAPTURE_MAX_SAMPLES - 1;
+
+    burst->pre_samples = milliseconds_to_samples(burst->pre_ms, odr);
+    if (burst->pre_samples > BURST_CAPTURE_MAX_SAMPLES - 1 - burst->post_samples) burst->pre_samples = BURST_CAPTURE_MAX_SAMPLES - 1 - burst->post_samples;
+
+    rearm(burst);
+}
+
+void burst_capture_cancel(burst_capture_t* burst)
+{
+    //Throws away the current window (if there is one), used when it can't be sent
+    rearm(burst);
+}
+
+bool burst_capture_add(burst_capture_t* burst, const uint8_t* sample, uint32_t time_stamp)
+{
+    //Adds a raw sample (laid out like the composite data characteristic) that was read at the
+    //given time stamp. Returns true when this sample completes a window and it's ready to send.
+    if (burst->state == BURST_CAPTURE_OFF || burst->state == BURST_CAPTURE_FROZEN) return false;
+
+    uint16_t position = burst->head;
+    memcpy(burst->samples + position * BURST_CAPTURE_SAMPLE_SIZE, sample, BURST_CAPTURE_SAMPLE_SIZE);
+    burst->head = (uint16_t)((position + 1) % BURST_CAPTURE_MAX_SAMPLES);
+    if (burst->count < BURST_CAPTURE_MAX_SAMPLES) burst->count++;
+
+    if (burst->state == BURST_CAPTURE_ARMED)
+    {
+        uint32_t magnitude = gyroscope_magnitude_squared(sample);
+        if (magnitude < burst->quiet_squared) burst->quiet = true;
+        if (!burst->quiet || magnitude < burst->threshold_squared) return false;
+
+        //There might not be a full pre trigger window yet if the swing came right after
+        //data collection started (or right after the last burst), just keep what there is
+        uint16_t pre = (uint16_t)(burst->count - 1);
+        if (pre > burst->pre_samples) pre = burst->pre_samples;
+
+        burst->trigger_time = time_stamp;
+        burst->trigger_index = pre;
+        burst->window_start = (uint16_t)((position + BURST_CAPTURE_MAX_SAMPLES - pre) % BURST_CAPTURE_MAX_SAMPLES);
+        burst->window_samples = (uint16_t)(pre + 1);
+        burst->post_remaining = burst->post_samples;
+        burst->state = BURST_CAPTURE_TRIGGERED;
+    }
+    else
+    {
+        burst->window_samples++;
+        burst->post_remaining--;
+    }
+
+    if (burst->post_remaining > 0) return false;
+
+    burst->sent = 0;
+    burst->state = BURST_CAPTURE_FROZEN;
+    return true;
+}
+
+bool burst_capture_pending(const burst_capture_t* burst)
+{
+    return burst->state == BURST_CAPTURE_FROZEN && burst->sent < burst->window_samples;
+}
+
+uint8_t burst_capture_chunk(const burst_capture_t* burst, uint8_t* pBuff, uint16_t capacity, uint16_t* length)
+{
+    //Puts the next notification worth of the frozen window into pBuff (which holds capacity bytes,
+    //header included) and returns how many samples made it in. Nothing changes until
+    //burst_capture_chunk_sent() gets called, so if the notification can't be queued the same chunk
+    //just gets built again later. Packed samples all depend on each other so a chunk never wraps
+    //around the end of the buffer.
+    *length = 0;
+    if (!burst_capture_pending(burst) || capacity <= BURST_CAPTURE_HEADER_SIZE) return 0;
+
+    uint16_t start = (uint16_t)((burst->window_start + burst->sent) % BURST_CAPTURE_MAX_SAMPLES);
+    uint16_t remaining = burst->window_samples - burst->sent;
+    if (remaining > BURST_CAPTURE_MAX_SAMPLES - start) remaining = BURST_CAPTURE_MAX_SAMPLES - start;
+    if (remaining > SAMPLE_PACKING_MAX_SAMPLES) remaining = SAMPLE_PACKING_MAX_SAMPLES;
+
+    uint16_t samples_length = 0;
+    bool packed = false;
+    uint8_t count = sample_packing_encode(burst->samples + start * BURST_CAPTURE_SAMPLE_SIZE, (uint8_t)remaining, SAMPLE_ENCODING_PACKED,
+        pBuff + BURST_CAPTURE_HEADER_SIZE, (uint16_t)(capacity - BURST_CAPTURE_HEADER_SIZE), &samples_length, &packed);
+    if (count == 0) return 0;
+
+    uint32_t ticks_before_trigger = (uint32_t)(((uint64_t)burst->trigger_index * burst->ticks_per_sample_q8 + 128) >> 8);
+    write_uint32(pBuff, burst->trigger_time - ticks_before_trigger);
+    pBuff[4] = packed ? (count | SAMPLE_PACKING_PACKED_FLAG) : count;
+    pBuff[5] = burst->burst_number;
+    write_uint16(pBuff + 6, burst->sent);
+    write_uint16(pBuff + 8, burst->window_samples);
+    write_uint16(pBuff + 10, burst->trigger_index);
+    write_uint32(pBuff + 12, burst->ticks_per_sample_q8);
+
+    *length = BURST_CAPTURE_HEADER_SIZE + samples_length;
+    return count;
+}
+
+void burst_capture_chunk_sent(burst_capture_t* burst, uint8_t count)
+{
+    //Moves on to the next chunk, once the whole window has gone out the buffer starts filling again
+    if (burst->state != BURST_CAPTURE_FROZEN) return;
+
+    burst->sent += count;
+    if (burst->sent < burst->window_samples) return;
+
+    burst->burst_number++;
+    rearm(burst);
+}
@@ -0,0 +1,115 @@
+#ifndef BURST_CAPTURE_H__
+#define BURST_CAPTURE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sample_packing.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+The burst_capture files catch the part of a swing around impact at the full ODR of the
+sensors. The live data stream can only send as many samples as fit through the connection
+interval, which isn't nearly enough to see what happens in the few tens of milliseconds
+around impact. With burst capture turned on the BMI270 runs at BURST_CAPTURE_ODR and every
+sample it reads goes into a circular buffer in RAM, while only every Nth sample goes into
+the live stream.
+
+Every sample that goes in is checked for a swing. Once the magnitude of the gyroscope
+reading goes over the threshold the buffer keeps filling for the post trigger samples and
+then freezes, holding the pre trigger samples, the trigger sample and the post trigger
+samples. The frozen window then gets sent through the burst data characteristic a few
+notifications at a time (whenever the live stream leaves room in the notification queue).
+Once the whole window has been sent the buffer starts filling again, but it won't trigger
+until the gyroscope has dropped below half the threshold so a single swing can't set off
+a second burst on its follow through.
+
+Each notification of the burst data characteristic is:
+
+    bytes 0-3   time stamp (16 MHz timer ticks) of the first sample of the window
+    byte 4      samples in this notification, the high bit is set if they're packed
+    byte 5      burst number (goes up by one for every burst)
+    bytes 6-7   index in the window of the first sample in this notification
+    bytes 8-9   samples in the whole window
+    bytes 10-11 index in the window of the sample that set off the trigger
+    bytes 12-15 timer ticks between samples * 256
+    bytes 16-   the samples, raw or packed exactly like the composite data characteristic
+                (see sample_packing.h)
+
+Burst capture is set up through the settings characteristic, each write being:
+
+    byte 0      8 (the burst capture command)
+    byte 1      1 to turn burst capture on, 0 to turn it off
+    bytes 2-3   gyroscope threshold in LSB (the magnitude of the x, y and z readings)
+    bytes 4-5   milliseconds of data to keep from before the trigger
+    bytes 6-7   milliseconds of data to keep from after the trigger
+
+Nothing in here depends on the nRF SDK so the same files get built on a computer to check
+the windows against the front end (see Replay_Tool/burst_capture.cpp).
+*/
+
+#define BURST_CAPTURE_MAX_SAMPLES         1024                                    /**< Size of the circular buffer, 18 KB of RAM and 640 ms at BURST_CAPTURE_ODR */
+#define BURST_CAPTURE_SAMPLE_SIZE         SAMPLE_PACKING_SAMPLE_SIZE              /**< Size (in bytes) of a raw sample, acc, gyr and mag as int16s */
+#define BURST_CAPTURE_HEADER_SIZE         16                                      /**< Size (in bytes) of the header of a burst data notification */
+#define BURST_CAPTURE_COMMAND             8                                       /**< First byte of a settings characteristic write that sets up burst capture */
+#define BURST_CAPTURE_ODR                 1600.0f                                 /**< Fastest ODR the BMI270 accelerometer supports, the gyroscope is run at the same rate */
+#define BURST_CAPTURE_TICK_FREQUENCY      16000000.0f                             /**< The data timer the time stamps come from */
+#define BURST_CAPTURE_DEFAULT_THRESHOLD   16384                                   /**< 1000 deg/s with the gyroscope at +/- 2000 deg/s */
+#define BURST_CAPTURE_DEFAULT_PRE_MS      400
+#define BURST_CAPTURE_DEFAULT_POST_MS     150
+
+typedef enum
+{
+    BURST_CAPTURE_OFF,
+    BURST_CAPTURE_ARMED,                                                          /**< Filling the buffer and waiting for a swing */
+    BURST_CAPTURE_TRIGGERED,                                                      /**< Saw a swing, collecting the post trigger samples */
+    BURST_CAPTURE_FROZEN                                                          /**< The window is waiting to be sent, new samples don't go into the buffer */
+} burst_capture_state_t;
+
+//Everything needed to capture and send a burst
+typedef struct
+{
+    uint8_t               samples[BURST_CAPTURE_MAX_SAMPLES * BURST_CAPTURE_SAMPLE_SIZE]; /**< The circular buffer */
+    uint16_t              head;                                                   /**< Where the next sample goes */
+    uint16_t              count;                                                  /**< Samples in the buffer, stops going up once it's full */
+    burst_capture_state_t state;
+    bool                  enabled;
+    bool                  quiet;                                                  /**< The gyroscope has dropped below half the threshold since the last burst */
+    uint32_t              threshold_squared;                                      /**< Squared magnitude (in LSB) of the gyroscope that sets off a burst */
+    uint32_t              quiet_squared;
+    uint16_t              pre_ms;                                                 /**< How much data to keep from before the trigger, turned into samples when capture starts */
+    uint16_t              post_ms;
+    uint16_t              pre_samples;                                            /**< Samples kept from before the trigger sample */
+    uint16_t              post_samples;                                           /**< Samples kept from after the trigger sample */
+    uint16_t              post_remaining;
+    uint32_t              trigger_time;                                           /**< Time stamp of the trigger sample */
+    uint32_t              ticks_per_sample_q8;                                    /**< Timer ticks between samples * 256 */
+    uint16_t              window_start;                                           /**< Position in the buffer of the first sample of the window */
+    uint16_t              window_samples;
+    uint16_t              trigger_index;                                          /**< Position in the window of the trigger sample */
+    uint16_t              sent;                                                   /**< Samples of the window that have been sent */
+    uint8_t               burst_number;
+} burst_capture_t;
+
+//Setup Methods
+void burst_capture_init(burst_capture_t* burst);
+void burst_capture_configure(burst_capture_t* burst, bool enable, uint16_t threshold, uint16_t pre_ms, uint16_t post_ms);
+void burst_capture_configure_command(burst_capture_t* burst, const uint8_t* command);
+void burst_capture_start(burst_capture_t* burst, float odr);
+void burst_capture_cancel(burst_capture_t* burst);
+
+//Capture Methods
+bool burst_capture_add(burst_capture_t* burst, const uint8_t* sample, uint32_t time_stamp);
+
+//Transfer Methods
+bool burst_capture_pending(const burst_capture_t* burst);
+uint8_t burst_capture_chunk(const burst_capture_t* burst, uint8_t* pBuff, uint16_t capacity, uint16_t* length);
+void burst_capture_chunk_sent(burst_capture_t* burst, uint8_t count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BURST_CAPTURE_H__
@@ -6277,7 +6277,7 @@
 // <i> This option can be used when app_timer is used for timestamping.
 
 #ifndef APP_TIMER_KEEPS_RTC_ACTIVE
-#define APP_TIMER_KEEPS_RTC_ACTIVE 0
+#define APP_TIMER_KEEPS_RTC_ACTIVE 1
 #endif
 
 // <o> APP_TIMER_SAFE_WINDOW_MS - Maximum possible latency (in milliseconds) of handling app_timer event. 
@@ -11410,7 +11410,7 @@
 // <i> Requested BLE GAP data length to be negotiated.
 //GAP data length includes the MTU packet as well as a 4 byte header, so its length should be MAX_MTU + 4
 #ifndef NRF_SDH_BLE_GAP_DATA_LENGTH
-#define NRF_SDH_BLE_GAP_DATA_LENGTH 246
+#define NRF_SDH_BLE_GAP_DATA_LENGTH 251
 #endif
 
 // <o> NRF_SDH_BLE_PERIPHERAL_LINK_COUNT - Maximum number of peripheral links. 
@@ -11438,14 +11438,15 @@
 #endif
 
 // <o> NRF_SDH_BLE_GATT_MAX_MTU_SIZE - Static maximum MTU size.
-//The MTU needs 3 bytes for a header, so the maximum raw data per packet is MAX_MTU - 3
+//The MTU needs 3 bytes for a header, so the maximum raw data per packet is MAX_MTU - 3. The large data
+//characteristic is 243 bytes (9 byte header + 13 samples) so this needs to be at least 246.
 #ifndef NRF_SDH_BLE_GATT_MAX_MTU_SIZE
-#define NRF_SDH_BLE_GATT_MAX_MTU_SIZE 242
+#define NRF_SDH_BLE_GATT_MAX_MTU_SIZE 247
 #endif
 
 // <o> NRF_SDH_BLE_GATTS_ATTR_TAB_SIZE - Attribute Table size in bytes. The size must be a multiple of 4. 
 #ifndef NRF_SDH_BLE_GATTS_ATTR_TAB_SIZE
-#define NRF_SDH_BLE_GATTS_ATTR_TAB_SIZE 1680 //started at 1408, 1680 is smallest value that works after adding new characteristic
+#define NRF_SDH_BLE_GATTS_ATTR_TAB_SIZE 1968 //started at 1408, 1680 is smallest value that works after adding new characteristic, another 288 bytes for the burst data characteristic
 #endif
 
 // <o> NRF_SDH_BLE_VS_UUID_COUNT - The number of vendor-specific UUIDs. 
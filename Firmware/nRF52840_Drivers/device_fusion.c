@@ -0,0 +1,143 @@
+#include "device_fusion.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#define DEVICE_FUSION_ALL_PARTS ((1 << DEVICE_FUSION_TABLE_PARTS) - 1)
+
+static bool table_complete(const device_fusion_table_t* table)
+{
+    return table->parts_received == DEVICE_FUSION_ALL_PARTS;
+}
+
+static int16_t read_reading(const uint8_t* sample, uint8_t sensor, uint8_t axis)
+{
+    const uint8_t* reading = sample + 6 * sensor + 2 * axis;
+    return (int16_t)((uint16_t)reading[0] | ((uint16_t)reading[1] << 8));
+}
+
+static FusionVector calibrate(const device_fusion_table_t* table, const uint8_t* sample, uint8_t sensor)
+{
+    //Same math as CompositeDataDecoder::decode() in the front end, calibrated = matrix * reading + bias
+    float x = read_reading(sample, sensor, 0), y = read_reading(sample, sensor, 1), z = read_reading(sample, sensor, 2);
+    const float* m = table->values;
+
+    FusionVector calibrated = {{
+        m[0] * x + m[1] * y + m[2] * z + m[9],
+        m[3] * x + m[4] * y + m[5] * z + m[10],
+        m[6] * x + m[7] * y + m[8] * z + m[11],
+    }};
+    return calibrated;
+}
+
+static void align(device_fusion_t* fusion, const uint8_t* samples, uint8_t count, bool use_magnetometer)
+{
+    //Averages gravity and the magnetic field over the packet and seeds the AHRS with the orientation
+    //they give. The gyroscope isn't needed for this, the packet still gets run through the AHRS after.
+    FusionAlignment alignment;
+    FusionAlignmentReset(&alignment);
+    for (uint8_t i = 0; i < count; i++)
+    {
+        const uint8_t* sample = samples + i * DEVICE_FUSION_SAMPLE_SIZE;
+        if (use_magnetometer) FusionAlignmentAdd(&alignment, calibrate(&fusion->tables[0], sample, 0), calibrate(&fusion->tables[2], sample, 2));
+        else FusionAlignmentAddNoMagnetometer(&alignment, calibrate(&fusion->tables[0], sample, 0));
+    }
+
+    FusionQuaternion quaternion;
+    if (!FusionAlignmentQuaternion(&alignment, FusionConventionNwu, &quaternion)) return; //moving too much, try again with the next packet
+
+    FusionAhrsSetInitialQuaternion(&fusion->ahrs, quaternion);
+    fusion->aligned = true;
+}
+
+void device_fusion_init(device_fusion_t* fusion)
+{
+    //Forgets any calibration tables and starts the AHRS from scratch
+    memset(fusion->tables, 0, sizeof(fusion->tables));
+    device_fusion_reset(fusion, 100.0f);
+}
+
+void device_fusion_reset(device_fusion_t* fusion, float odr)
+{
+    //Called every time data collection starts. The AHRS starts over and gets seeded with the
+    //orientation found from the first packet of samples, so there's no jump from wherever it was
+    //the last time data was collected and no waiting for it to converge either.
+    if (odr <= 0.0f) odr = 100.0f;
+    fusion->odr = odr;
+    fusion->aligned = false;
+
+    unsigned int sample_rate = (unsigned int)(odr + 0.5f);
+    FusionOffsetInitialise(&fusion->offset, sample_rate);
+    FusionAhrsInitialise(&fusion->ahrs);
+
+    const FusionAhrsSettings settings = {
+        FusionConventionNwu,
+        DEVICE_FUSION_GAIN,
+        DEVICE_FUSION_GYROSCOPE_RANGE,
+        DEVICE_FUSION_ACCELERATION_REJECTION,
+        DEVICE_FUSION_MAGNETIC_REJECTION,
+        DEVICE_FUSION_RECOVERY_SECONDS * sample_rate,
+    };
+    FusionAhrsSetSettings(&fusion->ahrs, &settings);
+}
+
+void device_fusion_set_table(device_fusion_t* fusion, uint8_t sensor, const float* values)
+{
+    //Sets a whole table at once
+    if (sensor >= DEVICE_FUSION_SENSORS) return;
+    for (int i = 0; i < DEVICE_FUSION_TABLE_VALUES; i++) fusion->tables[sensor].values[i] = values[i];
+    fusion->tables[sensor].parts_received = DEVICE_FUSION_ALL_PARTS;
+}
+
+bool device_fusion_set_table_part(device_fusion_t* fusion, uint8_t sensor, uint8_t part, const uint8_t* values)
+{
+    //Sets part of a table from the bytes of a settings characteristic write (everything after the
+    //sensor and part bytes). Returns false if the sensor or part doesn't exist.
+    if (sensor >= DEVICE_FUSION_SENSORS || part >= DEVICE_FUSION_TABLE_PARTS) return false;
+
+    device_fusion_table_t* table = &fusion->tables[sensor];
+    for (int i = 0; i < DEVICE_FUSION_PART_VALUES; i++)
+    {
+        const uint8_t* value = values + 4 * i;
+        uint32_t bits = (uint32_t)value[0] | ((uint32_t)value[1] << 8) | ((uint32_t)value[2] << 16) | ((uint32_t)value[3] << 24);
+        memcpy(&table->values[part * DEVICE_FUSION_PART_VALUES + i], &bits, sizeof(float));
+    }
+    table->parts_received |= (uint8_t)(1 << part);
+
+    return true;
+}
+
+bool device_fusion_ready(const device_fusion_t* fusion)
+{
+    //The AHRS can't run at all without the accelerometer and gyroscope
+    return table_complete(&fusion->tables[0]) && table_complete(&fusion->tables[1]);
+}
+
+void device_fusion_update(device_fusion_t* fusion, const uint8_t* samples, uint8_t count, float* quaternions, float* linear_acceleration)
+{
+    //Runs every raw sample (laid out like the composite data characteristic, acc, gyr and mag
+    //as int16s) through the AHRS. The quaternion after sample i goes into quaternions[4 * i]
+    //(w, x, y, z) and when linear_acceleration isn't NULL the linear acceleration (in g) goes
+    //into linear_acceleration[3 * i].
+    const float delta_time = 1.0f / fusion->odr;
+    const bool use_magnetometer = table_complete(&fusion->tables[2]);
+
+    if (!fusion->aligned) align(fusion, samples, count, use_magnetometer);
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        const uint8_t* sample = samples + i * DEVICE_FUSION_SAMPLE_SIZE;
+        FusionVector accelerometer = FusionVectorMultiplyScalar(calibrate(&fusion->tables[0], sample, 0), 1.0f / DEVICE_FUSION_GRAVITY);
+        FusionVector gyroscope = FusionOffsetUpdate(&fusion->offset, calibrate(&fusion->tables[1], sample, 1));
+
+        if (use_magnetometer) FusionAhrsUpdate(&fusion->ahrs, gyroscope, accelerometer, calibrate(&fusion->tables[2], sample, 2), delta_time);
+        else FusionAhrsUpdateNoMagnetometer(&fusion->ahrs, gyroscope, accelerometer, delta_time);
+
+        FusionQuaternion q = FusionAhrsGetQuaternion(&fusion->ahrs);
+        for (int component = 0; component < 4; component++) quaternions[4 * i + component] = q.array[component];
+
+        if (linear_acceleration == NULL) continue;
+        FusionVector linear = FusionAhrsGetLinearAcceleration(&fusion->ahrs);
+        for (int axis = 0; axis < DEVICE_FUSION_AXES; axis++) linear_acceleration[3 * i + axis] = linear.array[axis];
+    }
+}
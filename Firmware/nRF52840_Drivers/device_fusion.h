@@ -0,0 +1,96 @@
+#ifndef DEVICE_FUSION_H__
+#define DEVICE_FUSION_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "../../DirectXApp/Math/SensorFusion/FusionAhrs.h"
+#include "../../DirectXApp/Math/SensorFusion/FusionAlignment.h"
+#include "../../DirectXApp/Math/SensorFusion/FusionOffset.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+The device_fusion files run the Fusion AHRS (the same FusionAhrs and FusionOffset code the
+front end uses, which lives in DirectXApp/Math/SensorFusion) on the Personal Caddie itself.
+With one of the fused sample encodings every sample read from the sensors goes through the
+AHRS at the full ODR and only the resulting orientation (plus optionally the linear
+acceleration) gets sent, see sample_packing.h for how that's encoded.
+
+The AHRS needs calibrated readings in real units with all three sensors lined up on the
+same axes. The front end already folds the LSB conversion, axis swapping and calibration
+numbers of each sensor into a single 3x3 matrix and bias (see CompositeDataDecoder.h), so
+it sends those over and the readings here go through the exact same math:
+
+    calibrated = matrix * reading + bias   (acc in m/s^2, gyr in deg/s, mag in uT)
+
+A table is 12 floats (the matrix row by row followed by the bias). They get sent through
+the settings characteristic 6 floats at a time, each write being:
+
+    byte 0      7 (the set fusion table command)
+    byte 1      sensor (0 = acc, 1 = gyr, 2 = mag)
+    byte 2      part (0 = values 0-5, 1 = values 6-11)
+    bytes 3-26  the 6 little endian floats
+
+Fused encodings can only be turned on once the acc and gyr tables have both arrived, the
+magnetometer is optional and the AHRS runs without it until its table shows up.
+
+Rather than starting from no rotation and letting the AHRS converge, the first packet of
+samples after a reset gets averaged and the orientation is worked out from gravity and the
+magnetic field in one go (see FusionAlignment.h). The AHRS starts from there, so the very
+first quaternions that get sent are already right. If the Personal Caddie was moving too
+much during the first packet the next one is tried instead.
+
+Nothing in here depends on the nRF SDK so the same files get built on a computer to check
+the results against the filter the front end runs (see Replay_Tool/fusion_compare.cpp).
+*/
+
+#define DEVICE_FUSION_SENSORS         3                                           /**< acc, gyr and mag in the same order as sensor_type_t */
+#define DEVICE_FUSION_AXES            3
+#define DEVICE_FUSION_TABLE_VALUES    12                                          /**< 3x3 matrix followed by the bias for a single sensor */
+#define DEVICE_FUSION_PART_VALUES     6                                           /**< Floats sent in a single write to the settings characteristic */
+#define DEVICE_FUSION_TABLE_PARTS     (DEVICE_FUSION_TABLE_VALUES / DEVICE_FUSION_PART_VALUES)
+#define DEVICE_FUSION_COMMAND         7                                           /**< First byte of a settings characteristic write that holds part of a table */
+#define DEVICE_FUSION_SAMPLE_SIZE     18                                          /**< Size (in bytes) of a raw sample, matches SAMPLE_SIZE * 3 */
+#define DEVICE_FUSION_GRAVITY         9.80665f                                    /**< The AHRS wants acceleration in g */
+
+//AHRS settings, the same ones the front end uses in the MadgwickTestMode
+#define DEVICE_FUSION_GAIN                   0.5f
+#define DEVICE_FUSION_GYROSCOPE_RANGE        2000.0f                              /**< deg/s */
+#define DEVICE_FUSION_ACCELERATION_REJECTION 10.0f                                /**< degrees */
+#define DEVICE_FUSION_MAGNETIC_REJECTION     10.0f                                /**< degrees */
+#define DEVICE_FUSION_RECOVERY_SECONDS       5
+
+//Calibration table for a single sensor
+typedef struct
+{
+    float   values[DEVICE_FUSION_TABLE_VALUES];                                   /**< The matrix row by row followed by the bias */
+    uint8_t parts_received;                                                       /**< One bit for each part of the table that's arrived */
+} device_fusion_table_t;
+
+//Everything needed to run the AHRS on raw samples
+typedef struct
+{
+    FusionAhrs            ahrs;
+    FusionOffset          offset;
+    device_fusion_table_t tables[DEVICE_FUSION_SENSORS];
+    float                 odr;                                                    /**< Samples are spaced 1 / odr seconds apart */
+    bool                  aligned;                                                /**< The AHRS has been seeded with the orientation from a packet of samples */
+} device_fusion_t;
+
+//Setup Methods
+void device_fusion_init(device_fusion_t* fusion);
+void device_fusion_reset(device_fusion_t* fusion, float odr);
+void device_fusion_set_table(device_fusion_t* fusion, uint8_t sensor, const float* values);
+bool device_fusion_set_table_part(device_fusion_t* fusion, uint8_t sensor, uint8_t part, const uint8_t* values);
+bool device_fusion_ready(const device_fusion_t* fusion);
+
+//Update Methods
+void device_fusion_update(device_fusion_t* fusion, const uint8_t* samples, uint8_t count, float* quaternions, float* linear_acceleration);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DEVICE_FUSION_H__
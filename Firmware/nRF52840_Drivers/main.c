@@ -25,11 +25,17 @@
 #include "bmi270_drv.h"
 #include "bmm150_drv.h"
 #include "ble_sensor_service.h"
+#include "sample_packing.h"
+#include "device_fusion.h"
+#include "burst_capture.h"
+#include "throughput_scheduler.h"
+#include "boot_cache.h"
 #include "ble_pc_service.h"
 #include "personal_caddie_operating_modes.h"
 #include "nRF_Implementations/pc_twi.h"
 #include "nRF_Implementations/pc_ble.h"
 #include "nRF_Implementations/pc_timer.h"
+#include "nRF_Implementations/pc_flash.h"
 
 //Soft Device Parameters
 #define DEAD_BEEF                       0xDEADBEEF                                 /**< Value used as error code on stack dump, can be used to identify stack location on stack unwind. */
@@ -46,16 +52,43 @@ static uint8_t external_sensors[10];
 static uint8_t internal_sensors_found = 0;
 static uint8_t external_sensors_found = 0;
 
+//Fast Boot Parameters
+static boot_cache_t m_boot_cache;                                                   /**< Sensor map and settings saved in flash (see boot_cache.h), invalid when there isn't a usable record */
+static bool m_boot_cache_enabled = true;                                            /**< Cleared when the front end asks to forget the cached sensors, nothing gets saved again until the next power up */
+static boot_timing_t m_boot_timing;                                                 /**< How long each stage of getting to the first sample took */
+static uint32_t m_boot_start_time = 0;                                              /**< RTC time (app timer ticks) right after the timers were initialized */
+static uint32_t m_active_mode_start_time = 0;                                       /**< RTC time sensor active mode was last started at */
+static bool m_first_sample_pending = false;                                         /**< Sensor active mode has started but the first data set hasn't gone out yet */
+
 //IMU Sensor Data Parameters
 static uint8_t small_characteristic_data[SMALL_DATA_CHARACTERISTIC_SIZE];           /**< A small array for holding current sensor readings */
 static uint8_t medium_characteristic_data[MEDIUM_DATA_CHARACTERISTIC_SIZE];         /**< A medium array for holding current sensor readings */
 static uint8_t large_characteristic_data[LARGE_DATA_CHARACTERISTIC_SIZE];           /**< A large array for holding current sensor readings */
 static uint8_t* composite_characteristic_data;                                      /**< A pointer to the current data characteristic (changes with number of sensor samples */
+static uint8_t m_sample_buffer[MAX_SENSOR_SAMPLES * 3 * SAMPLE_SIZE];               /**< Holds raw samples until they get packed into the large data characteristic (only used with packed encoding) */
+static uint8_t m_data_encoding = SAMPLE_ENCODING_RAW;                               /**< How samples are encoded in the data characteristic, negotiated with the front end through the settings characteristic */
+static device_fusion_t m_device_fusion;                                             /**< The AHRS that runs on every sample when one of the fused encodings is in use */
+static float m_fused_quaternions[MAX_SENSOR_SAMPLES * 4];                           /**< Orientation after each sample of the current data set (fused encodings only) */
+static float m_fused_linear_acceleration[MAX_SENSOR_SAMPLES * 3];                   /**< Linear acceleration (in g) of each sample of the current data set (SAMPLE_ENCODING_FUSED_LINEAR only) */
 uint8_t sensor_settings[SENSOR_SETTINGS_LENGTH];                                    /**< An array represnting the IMU sensor settings */
 uint8_t m_current_sensor_samples = 10;                                              /**< The number of sensor samples currently being put into the acc,gy and mag characteristics (must be less than MAX_SENSOR_SAMPLES */
 uint32_t m_time_stamp;                                                              /**< Keeps track of the time that each data set is read at (this is measured in ticks of a 16MHz clock, i.e. 1 LSB = 1/16000000s = 62.5ns) */
 volatile bool m_data_ready = false;                                                 /**< Indicates when all characteristics have been filled with new data and we're ready to send it to the client  */
 bool m_use_composite_data  = true;                                                  /**< If this boolean is true, then all three sensors will have their data put into a single shared characteristic */
+bool m_use_fifo_data = true;                                                        /**< If this boolean is true, and the BMI270 is the acc and gyr, samples are buffered in the BMI270 FIFO and read once per characteristic */
+static bool m_fifo_mode_active = false;                                             /**< True while data is being collected through the BMI270 FIFO instead of the data read timer */
+static uint8_t m_fifo_watermark_samples = 0;                                        /**< The number of samples the BMI270 FIFO watermark is currently set to */
+volatile bool m_fifo_watermark_reached = false;                                     /**< Set by the IMU interrupt when the FIFO holds enough samples for a full characteristic */
+volatile uint32_t m_fifo_watermark_time = 0;                                        /**< Data clock time (in ticks) when the FIFO watermark interrupt went off */
+static burst_capture_t m_burst_capture;                                             /**< Holds samples at the full BMI270 ODR and catches the window around each swing */
+static bool m_burst_mode_active = false;                                            /**< True while the BMI270 runs at BURST_CAPTURE_ODR and the live stream only gets every Nth sample */
+static uint16_t m_burst_decimation = 1;                                             /**< Every Nth sample read in burst mode goes into the live stream */
+static uint32_t m_burst_samples_read = 0;                                           /**< Samples read since burst mode started, used to pick out the live samples */
+static uint8_t m_burst_live_samples = 0;                                            /**< Samples in the current live data set so far (burst mode only) */
+static uint32_t m_burst_live_time_stamp = 0;                                        /**< Time stamp of the first sample in the current live data set (burst mode only) */
+static uint8_t m_burst_fifo_samples[BMI270_FIFO_MAX_BURST_FRAMES * 3 * SAMPLE_SIZE]; /**< Each batch of samples read out of the FIFO in burst mode lands here first */
+static uint8_t burst_characteristic_data[BURST_DATA_CHARACTERISTIC_SIZE];           /**< Holds the chunk of the current burst that's being sent */
+#define BURST_NOTIFICATION_QUEUE_LIMIT 6                                            /**< Burst notifications only get queued while fewer than this many notifications are waiting, the rest of the queue is left for the live stream */
 
 //IMU Sensor Communication Parameters
 imu_communication_t imu_comm;                                                       /**< Structure that Holds information on how to communicate with each sensor */
@@ -65,6 +98,13 @@ static float current_sensor_odr = 59.5;
 volatile bool m_notification_done = true;                                           /**< Indicates the number of notifications sent out in a single connection interval  */
 volatile int m_notifications_in_queue = 0;                                          /**< Let's us know the current number of notifications in the queue  */
 volatile int m_notification_queue_limit = 1;                                        /**< Limits the number of notifications allowed in the notification queue based on the current sensor ODR and connection interval*/
+static uint16_t m_packet_sequence = 0;                                              /**< Sequence number of the next composite data notification, goes up by one for every data set whether it gets sent or not */
+static uint16_t m_dropped_packets = 0;                                              /**< Number of composite data notifications that couldn't be added to the notification queue (wraps around) */
+static throughput_scheduler_t m_throughput;                                         /**< Picks the number of samples in each data set from how well the link is keeping up */
+volatile uint32_t m_notifications_completed = 0;                                    /**< Every notification the SoftDevice has finished sending (live and burst), wraps around */
+static uint16_t m_att_mtu = BLE_GATT_ATT_MTU_DEFAULT;                               /**< ATT MTU of the current connection */
+static uint16_t m_data_length = 27;                                                 /**< Payload bytes in a single radio packet of the current connection */
+static uint8_t m_phy = BLE_GAP_PHY_1MBPS;                                           /**< PHY of the current connection */
 
 //LED Pin Parameters
 #define RED_LED            NRF_GPIO_PIN_MAP(0, 24)                                  /**< Red LED Indicator on BLE 33 sense (part of triple RGB LED)*/
@@ -346,16 +386,137 @@ static void default_sensor_select()
     }
 }
 
+static void available_sensors_characteristic_refresh()
+{
+    //The available sensors characteristic holds the addresses of the sensors found on the internal
+    //TWI bus followed by the ones found on the external bus (0xFF for empty slots). This allows the
+    //front end application to dynamically choose which sensors to use. The boot timing goes at the
+    //end and gets filled in as the Personal Caddie starts up (see boot_cache.h).
+    uint8_t available_sensors[BOOT_TIMING_OFFSET + BOOT_TIMING_SIZE];
+    memcpy(available_sensors, internal_sensors, BOOT_CACHE_MAX_SENSORS);
+    memcpy(available_sensors + BOOT_CACHE_MAX_SENSORS, external_sensors, BOOT_CACHE_MAX_SENSORS);
+    boot_timing_encode(&m_boot_timing, available_sensors + BOOT_TIMING_OFFSET);
+
+    ble_gatts_value_t available_sensors_value;
+    available_sensors_value.len = sizeof(available_sensors);
+    available_sensors_value.p_value = available_sensors;
+    available_sensors_value.offset = 0;
+
+    uint32_t err_code = sd_ble_gatts_value_set(m_conn_handle, m_ss.available_handle.value_handle, &available_sensors_value);
+    APP_ERROR_CHECK(err_code);
+}
+
+static void boot_cache_load()
+{
+    //Reads the sensor map and settings saved the last time the Personal Caddie was on. Anything
+    //that doesn't check out (no record, a record from other firmware, a half written record) just
+    //means the full scan runs.
+    if (!flash_record_read(FLASH_BOOT_CACHE_KEY, &m_boot_cache, sizeof(boot_cache_t)) || !boot_cache_valid(&m_boot_cache))
+    {
+        boot_cache_invalidate(&m_boot_cache);
+        SEGGER_RTT_WriteString(0, "No cached sensors, both TWI buses will be scanned.\n");
+    }
+}
+
+static void boot_cache_save()
+{
+    //Saves the current sensor map and settings array so the next power up can start with them. The
+    //first byte of the settings array (the last command) and the sample encoding (the fused encodings
+    //need tables that aren't saved) don't get restored, so they're left out to keep the record from
+    //changing every time they do. Nothing gets written if the record wouldn't change.
+    if (!m_boot_cache_enabled) return;
+
+    uint8_t settings[SENSOR_SETTINGS_LENGTH];
+    memcpy(settings, sensor_settings, SENSOR_SETTINGS_LENGTH);
+    settings[0] = 0;
+    settings[DATA_ENCODING] = 0;
+
+    boot_cache_t cache;
+    boot_cache_build(&cache, internal_sensors, internal_sensors_found, external_sensors, external_sensors_found, settings);
+    if (boot_cache_equal(&cache, &m_boot_cache)) return;
+
+    ret_code_t err_code = flash_record_write(FLASH_BOOT_CACHE_KEY, &cache, sizeof(boot_cache_t));
+    if (err_code == NRF_SUCCESS) m_boot_cache = cache;
+    else SEGGER_RTT_printf(0, "Couldn't save the sensor map to flash (0x%x).\n", err_code);
+}
+
+static void boot_cache_settings_restore()
+{
+    //The sensor drivers fill the settings array with their defaults when they get initialized, this
+    //puts the last settings that worked back in their place. It only happens when the sensors that
+    //ended up selected are the cached ones, otherwise the cached settings wouldn't make sense for them.
+    if (m_boot_cache.sensor_settings[ACC_START + SENSOR_MODEL] != imu_comm.sensor_model[0] ||
+        m_boot_cache.sensor_settings[GYR_START + SENSOR_MODEL] != imu_comm.sensor_model[1] ||
+        m_boot_cache.sensor_settings[MAG_START + SENSOR_MODEL] != imu_comm.sensor_model[2]) return;
+
+    memcpy(sensor_settings + ACC_START, m_boot_cache.sensor_settings + ACC_START, DATA_ENCODING - ACC_START);
+}
+
+static bool cached_sensor_discovery()
+{
+    //Makes sure that every sensor in the boot cache is still there. Only the cached addresses get
+    //probed (on both TWI buses at once) and they get probed over and over until they've all answered,
+    //so instead of waiting a fixed amount of time for the sensors to power up this moves on as soon
+    //as they're ready. If one of them still hasn't answered after BOOT_CACHE_POWER_ON_TIMEOUT_US then
+    //the sensors have changed and the full scan needs to run.
+    if (!boot_cache_valid(&m_boot_cache)) return false;
+
+    uint32_t start_time = get_rtc_time();
+    for (;;)
+    {
+        internal_sensors_found = 0;
+        external_sensors_found = 0;
+
+        twi_scan_request_t requests[2] = {
+            { get_internal_twi_bus(), m_boot_cache.internal_sensors, m_boot_cache.internal_sensors_found, internal_sensors, &internal_sensors_found },
+            { get_external_twi_bus(), m_boot_cache.external_sensors, m_boot_cache.external_sensors_found, external_sensors, &external_sensors_found }
+            };
+        twi_address_scan_buses(requests, 2);
+
+        if (boot_cache_confirmed(&m_boot_cache, internal_sensors_found, external_sensors_found)) return true;
+        if (get_rtc_microseconds_since(start_time) >= BOOT_CACHE_POWER_ON_TIMEOUT_US) break;
+        delay_microseconds(BOOT_CACHE_PROBE_INTERVAL_US);
+    }
+
+    //Throw away whatever did answer, the full scan starts over from scratch
+    SEGGER_RTT_WriteString(0, "Cached sensors didn't answer, scanning both TWI buses.\n");
+    for (int i = 0; i < BOOT_CACHE_MAX_SENSORS; i++)
+    {
+        internal_sensors[i] = 0xff;
+        external_sensors[i] = 0xff;
+    }
+    internal_sensors_found = 0;
+    external_sensors_found = 0;
+
+    return false;
+}
+
+static void full_sensor_discovery(bool powered_up)
+{
+    //Scans every address of the internal and external TWI bus at the same time looking for sensors.
+    //Sensors that are still powering up won't answer, so unless the cache check already spent long
+    //enough waiting on them there's a slight delay first.
+    if (!powered_up) delay_microseconds(BOOT_CACHE_POWER_ON_TIMEOUT_US); //slight delay so sensors have time to power on
+
+    twi_scan_request_t requests[2] = {
+        { get_internal_twi_bus(), NULL, 0, internal_sensors, &internal_sensors_found },
+        { get_external_twi_bus(), NULL, 0, external_sensors, &external_sensors_found }
+        };
+    twi_address_scan_buses(requests, 2);
+}
+
 static void sensors_init(bool discovery)
 {
     //When first turning on the Personal Caddie we need send power to all sensors on
-    //both the internal and external lines. We then scan both the internal
-    //and external TWI bus to see what sensors are available so we can populate some
-    //arrays with this information. If there are no sensors on the external line then 
-    //power will be shut off (there will always be sensors on the internal line).
-    //Subsequent calls to this method don't require this procedure.
-    //Regardless of whether or not we enter this method in discovery mode, both TWI buses
-    //need to be enabled.
+    //both the internal and external lines. We then find out which sensors are available
+    //on the internal and external TWI bus so we can populate some arrays with this
+    //information. Usually this is just a quick check that the sensors saved in flash
+    //the last time are still there, otherwise both buses get scanned. If there are no
+    //sensors on the external line then power will be shut off (there will always be
+    //sensors on the internal line). Subsequent calls to this method don't require this
+    //procedure, and since the sensors are already powered by then there's no need to
+    //wait on them. Regardless of whether or not we enter this method in discovery mode,
+    //both TWI buses need to be enabled.
 
     //Enable the power lines
     power_line_init();
@@ -365,48 +526,44 @@ static void sensors_init(bool discovery)
     //Then enable the TWI lines
     enable_twi_bus(get_internal_twi_bus_id());
     enable_twi_bus(get_external_twi_bus_id());
-    delay_microseconds(50000); //slight delay so sensors have time to power on
-    //nrf_delay_ms(50);
     
     if (discovery)
     {
+        uint32_t discovery_start_time = get_rtc_time();
+
         //First reset the sensor settings array, everything goes to zero except
         //the sensor models which are set to the default sensors.
         for (int i = 0; i < SENSOR_SETTINGS_LENGTH; i++) sensor_settings[i] = 0;
-        sensor_settings[ACC_START + SENSOR_MODEL] = default_sensors[0];
-        sensor_settings[GYR_START + SENSOR_MODEL] = default_sensors[1];
-        sensor_settings[MAG_START + SENSOR_MODEL] = default_sensors[2];
+        sensor_settings[DATA_ENCODING] = m_data_encoding;
 
         //Then initialize the internal and external sensors arrays so that each element
         //has a value of 0xFF. This value alerts the front end that no sensor is present.
-        for (int i = 0; i < 10; i++)
+        for (int i = 0; i < BOOT_CACHE_MAX_SENSORS; i++)
         {
             internal_sensors[i] = 0xff;
             external_sensors[i] = 0xff;
         }
 
-        //Initiate the TWI bus scan, looking for sensors
-        twi_address_scan(internal_sensors, &internal_sensors_found, get_internal_twi_bus()); //Scan the internal TWI bus
-        twi_address_scan(external_sensors, &external_sensors_found, get_external_twi_bus()); //Then scan the external bus
-
-        //We also need to populate the available sensors characteristic with all the sensors
-        //that were found on the internal and external TWI buses. This will allow the front
-        //end application to dynamically choose which sensors to use.
-        ble_gatts_value_t internal_available_sensors, external_available_sensors;
-
-        internal_available_sensors.len = 10;
-        internal_available_sensors.p_value = internal_sensors;
-        internal_available_sensors.offset = 0;
-
-        external_available_sensors.len = 10;
-        external_available_sensors.p_value = external_sensors;
-        external_available_sensors.offset = 10;
-
-        uint32_t err_code = sd_ble_gatts_value_set(m_conn_handle, m_ss.available_handle.value_handle, &internal_available_sensors);
-        APP_ERROR_CHECK(err_code);
+        //Look for the cached sensors first, and if they're all there use the cached sensor
+        //models as the defaults. Otherwise fall back to scanning both buses.
+        bool cache_available = boot_cache_valid(&m_boot_cache);
+        if (cached_sensor_discovery())
+        {
+            m_boot_timing.discovery = BOOT_DISCOVERY_CACHED;
+            default_sensors[0] = m_boot_cache.sensor_settings[ACC_START + SENSOR_MODEL];
+            default_sensors[1] = m_boot_cache.sensor_settings[GYR_START + SENSOR_MODEL];
+            default_sensors[2] = m_boot_cache.sensor_settings[MAG_START + SENSOR_MODEL];
+        }
+        else
+        {
+            m_boot_timing.discovery = cache_available ? BOOT_DISCOVERY_CACHE_MISS : BOOT_DISCOVERY_SCAN;
+            full_sensor_discovery(cache_available);
+        }
+        m_boot_timing.discovery_us = get_rtc_microseconds_since(discovery_start_time);
 
-        err_code = sd_ble_gatts_value_set(m_conn_handle, m_ss.available_handle.value_handle, &external_available_sensors);
-        APP_ERROR_CHECK(err_code);
+        sensor_settings[ACC_START + SENSOR_MODEL] = default_sensors[0];
+        sensor_settings[GYR_START + SENSOR_MODEL] = default_sensors[1];
+        sensor_settings[MAG_START + SENSOR_MODEL] = default_sensors[2];
 
         //If no sensors were found on the external line it means that nothing is actually
         //hooked up which will leach current so there's no need to keep the external
@@ -485,6 +642,9 @@ static void sensors_init(bool discovery)
     fxos8700init(&imu_comm, sensor_settings);
     fxas21002init(&imu_comm, sensor_settings);
 
+    //When the cached sensors were found, the settings they last worked with replace the defaults
+    if (discovery && m_boot_timing.discovery == BOOT_DISCOVERY_CACHED) boot_cache_settings_restore();
+
     //regardless of whether or not any sensors are found, disable the power pins and TWI bus
     disable_twi_bus(get_internal_twi_bus_id());
     disable_twi_bus(get_external_twi_bus_id());
@@ -503,6 +663,33 @@ static void sensors_init(bool discovery)
     settings.offset = 0;
     uint32_t err_code = sd_ble_gatts_value_set(m_conn_handle, m_ss.settings_handles.value_handle, &settings);
     APP_ERROR_CHECK(err_code);
+
+    if (discovery)
+    {
+        //A scan means the sensor map has changed (or there wasn't one yet), so save it right away
+        //instead of waiting for the first sample. The sensors are now ready to go.
+        if (m_boot_timing.discovery != BOOT_DISCOVERY_CACHED) boot_cache_save();
+        m_boot_timing.sensors_ready_us = get_rtc_microseconds_since(m_boot_start_time);
+        available_sensors_characteristic_refresh();
+        SEGGER_RTT_printf(0, "Sensors ready %d us after power up (%d us finding them).\n", m_boot_timing.sensors_ready_us, m_boot_timing.discovery_us);
+    }
+}
+
+static void boot_first_sample_sent()
+{
+    //Gets called once the data set holding the first sample of a stream is in the notification queue.
+    //The sensors just showed that the current settings work, so they become the settings the next
+    //power up starts with. The first stream after powering up also finishes off the boot timing.
+    m_first_sample_pending = false;
+    if (m_boot_timing.first_sample_us == 0)
+    {
+        m_boot_timing.first_sample_us = get_rtc_microseconds_since(m_active_mode_start_time);
+        available_sensors_characteristic_refresh();
+        SEGGER_RTT_printf(0, "Boot to first sample: %d us (sensors ready %d us, configuring %d us, first sample %d us).\n", boot_timing_total_us(&m_boot_timing),
+            m_boot_timing.sensors_ready_us, m_boot_timing.configure_us, m_boot_timing.first_sample_us);
+    }
+
+    boot_cache_save();
 }
 
 static void error_notification(int err_code)
@@ -557,33 +744,23 @@ static uint32_t data_notification_error_handler(uint32_t* ret)
     return 0;
 }
 
-static void characteristic_update_and_notify_composite_characteristic()
+static void composite_characteristic_notify(uint8_t* characteristic_data, uint16_t data_characteristic_size, uint16_t characteristic_handle, uint32_t time_stamp, uint8_t sample_count)
 {
-    //Add data to the appropriate characteristic based on the number of 
-    //samples we're collecting (which is a factor of the current sensor
-    //ODR and BLE connection interval).
-    uint16_t data_characteristic_size, characteristic_handle;
-    if (composite_characteristic_data == small_characteristic_data)
-    {
-        data_characteristic_size = SMALL_DATA_CHARACTERISTIC_SIZE; //5 bytes for time and samples + 4 samples max * 6 bytes/sample * 3 sensors
-        characteristic_handle = m_ss.data_handles[0].value_handle;
-    }
-    else if (composite_characteristic_data == medium_characteristic_data)
-    {
-        data_characteristic_size = MEDIUM_DATA_CHARACTERISTIC_SIZE; //5 bytes for time and samples + 8 samples max * 6 bytes/sample * 3 sensors
-        characteristic_handle = m_ss.data_handles[1].value_handle;
-    }
-    else
-    {
-        data_characteristic_size = LARGE_DATA_CHARACTERISTIC_SIZE; //5 bytes for time and samples + 13 samples max * 6 bytes/sample * 3 sensors
-        characteristic_handle = m_ss.data_handles[2].value_handle;
-    }
-
     //Add the time stamp for the current data set and current number of 
     //samples to the beginning of the characteristic.
-    uint8_t* time_start = (uint8_t*)&m_time_stamp; //cast the float to a 32-bit integer to take up 4 array slots
-    for (int i = 0; i < 4; i++) composite_characteristic_data[i] = *(time_start + i);
-    composite_characteristic_data[4] = m_current_sensor_samples;
+    uint8_t* time_start = (uint8_t*)&time_stamp; //cast the float to a 32-bit integer to take up 4 array slots
+    for (int i = 0; i < 4; i++) characteristic_data[i] = *(time_start + i);
+    characteristic_data[4] = sample_count;
+
+    //Follow that with the sequence number of this data set and the number of data sets that
+    //have been dropped so far (both little endian). The sequence number goes up even when a data
+    //set gets dropped, so the front end can tell exactly which data sets never made it, and the
+    //dropped count lets it know which of those were thrown away here instead of lost on the way.
+    characteristic_data[5] = m_packet_sequence & 0xFF;
+    characteristic_data[6] = (m_packet_sequence >> 8) & 0xFF;
+    characteristic_data[7] = m_dropped_packets & 0xFF;
+    characteristic_data[8] = (m_dropped_packets >> 8) & 0xFF;
+    m_packet_sequence++;
 
     //Setup composite data notification
     ble_gatts_hvx_params_t data_notify_params;
@@ -591,7 +768,7 @@ static void characteristic_update_and_notify_composite_characteristic()
     
     data_notify_params.type = BLE_GATT_HVX_NOTIFICATION;
     data_notify_params.handle = characteristic_handle;
-    data_notify_params.p_data = composite_characteristic_data;
+    data_notify_params.p_data = characteristic_data;
     data_notify_params.p_len  = &data_characteristic_size;
     data_notify_params.offset = 0;
 
@@ -600,15 +777,128 @@ static void characteristic_update_and_notify_composite_characteristic()
     //the queue is full don't add the current data set. Newer data will get
     //added as the queue empties out.
     uint32_t ret = 0;
+    int queue_depth = m_notifications_in_queue;
     ret = sd_ble_gatts_hvx(m_conn_handle, &data_notify_params);
     data_notification_error_handler(&ret);
 
-    if (ret == 0x69) return;
+    if (ret == 0x69)
+    {
+        //The data set is gone, count it so the front end knows about it
+        m_dropped_packets++;
+        throughput_scheduler_dropped(&m_throughput);
+        SEGGER_RTT_printf(0, "Dropped data set %d (%d dropped so far).\n", (uint16_t)(m_packet_sequence - 1), m_dropped_packets);
+        return;
+    }
     m_notifications_in_queue++;
+    throughput_scheduler_queued(&m_throughput, (queue_depth > 0) ? queue_depth : 0, data_characteristic_size, sample_count & SAMPLE_PACKING_COUNT_MASK);
+    if (m_first_sample_pending) boot_first_sample_sent();
 
     //SEGGER_RTT_printf(0, "Queue has %d notifications in it.\n", m_notifications_in_queue);
 }
 
+static uint32_t live_ticks_per_sample()
+{
+    //Time between the samples of the live data stream. In burst mode the sensors run faster than the
+    //ODR in the settings and the live stream only gets every Nth sample.
+    if (m_burst_mode_active) return (uint32_t)(16000000.0 * m_burst_decimation / BURST_CAPTURE_ODR);
+    return (uint32_t)(16000000.0 / current_sensor_odr);
+}
+
+static void characteristic_update_and_notify_packed_characteristic(uint8_t samples)
+{
+    //With the packed encoding the samples sit in the sample buffer until now, and then get packed
+    //into the large characteristic. Usually a whole data set fits in a single notification, but if
+    //the readings are jumping around too much to pack well they get split across as many
+    //notifications as it takes (sent raw if that fits more samples). Each notification gets its
+    //own sequence number and the time stamp of its first sample.
+    uint32_t ticks_per_sample = live_ticks_per_sample();
+    uint8_t sent = 0;
+
+    while (sent < samples)
+    {
+        uint16_t length = 0;
+        bool packed = false;
+        uint8_t count = sample_packing_encode(m_sample_buffer + sent * 3 * SAMPLE_SIZE, samples - sent, m_data_encoding,
+            large_characteristic_data + DATA_CHARACTERISTIC_HEADER_SIZE, LARGE_DATA_CHARACTERISTIC_SIZE - DATA_CHARACTERISTIC_HEADER_SIZE, &length, &packed);
+        if (count == 0) break;
+
+        composite_characteristic_notify(large_characteristic_data, DATA_CHARACTERISTIC_HEADER_SIZE + length, m_ss.data_handles[2].value_handle,
+            m_time_stamp + sent * ticks_per_sample, packed ? (count | SAMPLE_PACKING_PACKED_FLAG) : count);
+        sent += count;
+    }
+}
+
+static bool fused_encoding(uint8_t encoding)
+{
+    return encoding == SAMPLE_ENCODING_FUSED || encoding == SAMPLE_ENCODING_FUSED_LINEAR;
+}
+
+static void characteristic_update_and_notify_fused_characteristic(uint8_t samples)
+{
+    //With the fused encodings every sample in the sample buffer goes through the AHRS first, and
+    //only the orientation (and linear acceleration if it was asked for) gets sent. Those are a
+    //third (or two thirds) the size of a raw sample so a data set almost always fits in a single
+    //notification, but just like with packed samples it gets split up if it doesn't.
+    float* linear_acceleration = (m_data_encoding == SAMPLE_ENCODING_FUSED_LINEAR) ? m_fused_linear_acceleration : NULL;
+    device_fusion_update(&m_device_fusion, m_sample_buffer, samples, m_fused_quaternions, linear_acceleration);
+
+    uint32_t ticks_per_sample = live_ticks_per_sample();
+    uint8_t sent = 0;
+
+    while (sent < samples)
+    {
+        uint16_t length = 0;
+        uint8_t count = sample_packing_encode_fused(m_fused_quaternions + 4 * sent, (linear_acceleration != NULL) ? linear_acceleration + 3 * sent : NULL, samples - sent,
+            large_characteristic_data + DATA_CHARACTERISTIC_HEADER_SIZE, LARGE_DATA_CHARACTERISTIC_SIZE - DATA_CHARACTERISTIC_HEADER_SIZE, &length);
+        if (count == 0) break;
+
+        composite_characteristic_notify(large_characteristic_data, DATA_CHARACTERISTIC_HEADER_SIZE + length, m_ss.data_handles[2].value_handle,
+            m_time_stamp + sent * ticks_per_sample, count | SAMPLE_PACKING_FUSED_FLAG);
+        sent += count;
+    }
+}
+
+static void throughput_data_set_sent();
+
+static void characteristic_update_and_notify_composite_characteristic(uint8_t samples)
+{
+    if (m_data_encoding == SAMPLE_ENCODING_PACKED)
+    {
+        characteristic_update_and_notify_packed_characteristic(samples);
+        throughput_data_set_sent();
+        return;
+    }
+    else if (fused_encoding(m_data_encoding))
+    {
+        characteristic_update_and_notify_fused_characteristic(samples);
+        throughput_data_set_sent();
+        return;
+    }
+
+    //Add data to the appropriate characteristic based on the number of 
+    //samples we're collecting (which is a factor of the current sensor
+    //ODR and BLE connection interval).
+    uint16_t data_characteristic_size, characteristic_handle;
+    if (composite_characteristic_data == small_characteristic_data)
+    {
+        data_characteristic_size = SMALL_DATA_CHARACTERISTIC_SIZE; //9 byte header + 4 samples max * 6 bytes/sample * 3 sensors
+        characteristic_handle = m_ss.data_handles[0].value_handle;
+    }
+    else if (composite_characteristic_data == medium_characteristic_data)
+    {
+        data_characteristic_size = MEDIUM_DATA_CHARACTERISTIC_SIZE; //9 byte header + 8 samples max * 6 bytes/sample * 3 sensors
+        characteristic_handle = m_ss.data_handles[1].value_handle;
+    }
+    else
+    {
+        data_characteristic_size = LARGE_DATA_CHARACTERISTIC_SIZE; //9 byte header + 13 samples max * 6 bytes/sample * 3 sensors
+        characteristic_handle = m_ss.data_handles[2].value_handle;
+    }
+
+    composite_characteristic_notify(composite_characteristic_data, data_characteristic_size, characteristic_handle, m_time_stamp, samples);
+    throughput_data_set_sent();
+}
+
 static void characteristic_update_and_notify_individual_characteristics()
 {
 //    //Add the time stamp for the current data set and current number of 
@@ -699,7 +989,7 @@ static void characteristic_update_and_notify()
 {
     if (m_use_composite_data)
     {
-        characteristic_update_and_notify_composite_characteristic();
+        characteristic_update_and_notify_composite_characteristic(m_current_sensor_samples);
     }
     else
     {
@@ -723,162 +1013,176 @@ float findDecimalLCM(float a, float b)
     return findLCM(a * 1000000, b * 1000000) / 1000000.0;
 }
 
-void calculate_samples_and_connection_interval()
+static uint8_t max_data_set_samples()
 {
-   //This method is used to select the number of samples to store in the 
-   //data characteristics as a function of the current sensor ODR and desired data collection time.
-   //It get's called when the application first starts, and any time the
-   //ODR of the sensors is updated from the front end application.
-   //We want to minimize the amount of lag that occurs with the image on screen,
-   //which is accomplished by minimizing the data collection time. 
-   //After some testing, 80 milliseconds seems to be a good target time for the data collection period.
-   //There is a small lag seen on the screen in this case, but not really that noticeable,
-   //and it allows us to collect at least a few samples at lower ODR values, which is 
-   //more efficient than sending out samples 1 at a time.
-
-   float desired_lag_time = 0.08; //in seconds.
-   m_current_sensor_samples = current_sensor_odr * desired_lag_time;
-
-   if ((float)m_current_sensor_samples == (float)(current_sensor_odr * desired_lag_time))
-   {
-       //We need the data collection period to be less than the connection
-       //interval to ensure we get data in every single connection 
-       //interval. If the data collection time evenly divides the connection
-       //interval reduce the sample count by 1.
-       m_current_sensor_samples--;
-   }
-
-   //The desired lag time variable above represents what we "hope" the connection 
-   //interval will be. Since the connection interval is negotiated between the 
-   //BLE peripheral and Central we won't actually know what the connection interval
-   //is until it's set. In this method we assume that the desired lag time becomes the 
-   //connection interval and set the number of samples to collect for eac notification
-   //accordingly. Essentially, we want the data collection time to be as close to the 
-   //lag time while still being less than it. This will ensure that new data makes it to 
-   //the front end during each connection interval
-   if (m_use_composite_data)
-   {
-       //In the case where a single characteristic is being used for each sensor, we can hold
-       //MAX_SENSOR_SAMPLES worth of data in the entire characteristic, which means each 
-       //individual sensor can only contribute MAX_SENSOR_SAMPLES/3 before the characteristic
-       //is full.
-       if (m_current_sensor_samples > (MAX_SENSOR_SAMPLES / 3))
-       {
-          
-           //If we exceed the number of samples that will fit in the characteristic
-           //we can simply split up the data between a few notifications. The fewer notifications
-           //the better, and there's a cap on five notifcations. As an example, at a sensor
-           //ODR of 100Hz it will take 16 samples to reach the desired lag time of 0.16 seconds.
-           //Since the data collection time equals the connection interval we lower the number
-           //of samples to 15 (which will instead take 0.15 seconds to collect). The maximum
-           //number of samples that fit in the characteristic is 13 so what we do is split the 
-           //15 data points into 3 groups of 5 data points, each of which is sent out in a 
-           //different notification.
-           bool found = false;
-           for (int i = 2; i <= 5; i++)
-           {
-               if (m_current_sensor_samples % i == 0)
-               {
-                   m_current_sensor_samples = m_current_sensor_samples / i;
-                   found = true;
-                   break;
-               }
-           }
-
-           //If the number of samples can't be split up into 5 notifications or
-           //less then just use the full characteristic
-           if (!found) m_current_sensor_samples = (MAX_SENSOR_SAMPLES / 3);
-       }
-   }
-   else
-   {
-       //Unlike when using a single 
-       //composite charcteristic, when using three separate characteristics the odds are lower 
-       //that data from each sensor will make it to the front end in a single connection interval
-       //(although it's possible to achieve multiple characteristic notifications in a single 
-       //connection interval, only one is guaranteed during times of high BLE traffic). Since this
-       //is the case we want to minimize the total notifications going out, so just fill each
-       //characteristic to max capacity.
-       if (m_current_sensor_samples > MAX_SENSOR_SAMPLES) m_current_sensor_samples = MAX_SENSOR_SAMPLES;
-   }
-   
-   SEGGER_RTT_printf(0, "%d sensor samples have been selected.\n", m_current_sensor_samples);
-
-   //Set the desired maximum and minimum connection interval values (which are used to negotiate
-   //the interval with the central device) based on the desired lag time above. These values
-   //must be multiples of 15 milliseconds with at least 15 millisecond spacing between them.
-   desired_maximum_connection_interval = (int)(desired_lag_time * 1000) - ((int)(desired_lag_time * 1000) % 15); //round down to the nearst 15th millisecond
-   desired_minimum_connection_interval = desired_maximum_connection_interval - 15;
+    //The most samples that can go into a single data set. Raw samples fill up the large
+    //characteristic at MAX_SENSOR_SAMPLES / 3, packed samples take up around half the space
+    //so a data set can go all the way up to MAX_SENSOR_SAMPLES (the rare data set that doesn't
+    //pack well enough gets split across a few notifications when it's sent). Fused quaternions
+    //are a third the size of a raw sample, add the linear acceleration and it's two thirds.
+    switch (m_data_encoding)
+    {
+        case SAMPLE_ENCODING_PACKED:
+        case SAMPLE_ENCODING_FUSED:
+            return MAX_SENSOR_SAMPLES;
+        case SAMPLE_ENCODING_FUSED_LINEAR:
+            return (LARGE_DATA_CHARACTERISTIC_SIZE - DATA_CHARACTERISTIC_HEADER_SIZE) / (SAMPLE_PACKING_QUATERNION_SIZE + SAMPLE_PACKING_LINEAR_SIZE);
+        default:
+            return MAX_SENSOR_SAMPLES / 3;
+    }
 }
 
-void set_sensor_samples(int actual_connection_interval)
+static uint8_t* data_set_samples()
 {
-    //This method gets called after the connection interval has been changed. It's used to 
-    //confirm that the number of data samples we collect in a single period is maximized.
-    //It pretty much has the same logic as the calculate_samples_and_connection_interval()
-    //method above, however, it uses the actual negotiated connection interval instead of 
-    //the desired one.
-    if (actual_connection_interval != 0) m_connection_interval = actual_connection_interval;
-    int maximum_samples = current_sensor_odr * (float)m_connection_interval / 1000.0;
+    //Where the samples of the current data set get read into. Raw samples go straight into the
+    //data characteristic after the header, packed samples and samples that still need to go
+    //through the AHRS wait in the sample buffer.
+    if (m_data_encoding != SAMPLE_ENCODING_RAW) return m_sample_buffer;
+    return composite_characteristic_data + DATA_CHARACTERISTIC_HEADER_SIZE; //the composite data characteristic has the timestamp, number of data points and sequence variables at the front of the characteristic
+}
 
-    if ((float)maximum_samples == (float)(current_sensor_odr * (float)m_connection_interval / 1000.0))
+static float data_set_sample_size()
+{
+    //Bytes a single sample takes up in a notification with the current encoding. Packed samples
+    //change size with the data, the scheduler starts with half a raw sample and measures the rest.
+    switch (m_data_encoding)
     {
-        maximum_samples--;
+        case SAMPLE_ENCODING_PACKED:
+            return SAMPLE_PACKING_SAMPLE_SIZE / 2.0f;
+        case SAMPLE_ENCODING_FUSED:
+            return SAMPLE_PACKING_QUATERNION_SIZE;
+        case SAMPLE_ENCODING_FUSED_LINEAR:
+            return SAMPLE_PACKING_QUATERNION_SIZE + SAMPLE_PACKING_LINEAR_SIZE;
+        default:
+            return SAMPLE_PACKING_SAMPLE_SIZE;
     }
+}
 
-    if (m_use_composite_data)
+static void throughput_link_get(throughput_link_t* link)
+{
+    //Everything the throughput scheduler needs to know about the connection and the live stream
+    memset(link, 0, sizeof(throughput_link_t));
+    link->odr = 16000000.0f / live_ticks_per_sample();
+    link->interval_us = 1000 * (uint32_t)m_connection_interval;
+    link->att_mtu = m_att_mtu;
+    link->data_length = m_data_length;
+    link->phy_mbps = (m_phy == BLE_GAP_PHY_2MBPS) ? 2 : 1;
+    link->event_length_us = 0; //connection event extension is on
+    link->max_packets_per_event = 0; //up to the central, the scheduler finds out
+    link->queue_size = HVN_TX_QUEUE_SIZE;
+    link->max_samples = max_data_set_samples();
+    link->max_notification = LARGE_DATA_CHARACTERISTIC_SIZE;
+    link->header_size = DATA_CHARACTERISTIC_HEADER_SIZE;
+    link->sample_size = data_set_sample_size();
+}
+
+static uint16_t composite_characteristic_size(uint8_t const* characteristic_data)
+{
+    if (characteristic_data == small_characteristic_data) return SMALL_DATA_CHARACTERISTIC_SIZE;
+    else if (characteristic_data == medium_characteristic_data) return MEDIUM_DATA_CHARACTERISTIC_SIZE;
+    return LARGE_DATA_CHARACTERISTIC_SIZE;
+}
+
+static void sensor_samples_apply(uint8_t samples)
+{
+    //Sets the number of samples that go into each data set, and for raw samples picks the smallest
+    //data characteristic they fit in. This can happen in between two data sets while the next one
+    //has already started (the data read timer doesn't stop for it), so any samples already read into
+    //the old characteristic get moved over. The BMI270 FIFO watermark follows m_current_sensor_samples
+    //on its own.
+    if (samples < 1) samples = 1;
+    if (samples > max_data_set_samples()) samples = max_data_set_samples();
+
+    uint8_t* characteristic_data = large_characteristic_data;
+    if (samples < 5) characteristic_data = small_characteristic_data;
+    else if (samples < 9) characteristic_data = medium_characteristic_data;
+
+    if (characteristic_data != composite_characteristic_data)
     {
-        if (maximum_samples > (MAX_SENSOR_SAMPLES / 3))
+        if (composite_characteristic_data != NULL)
         {
-            bool found = false;
-            for (int i = 2; i <= 5; i++)
-            {
-                if (maximum_samples % i == 0)
-                {
-                    maximum_samples = maximum_samples / i;
-                    found = true;
-                    break;
-                }
-            }
-
-            if (!found) maximum_samples = (MAX_SENSOR_SAMPLES / 3);
+            uint16_t size = composite_characteristic_size(characteristic_data);
+            if (composite_characteristic_size(composite_characteristic_data) < size) size = composite_characteristic_size(composite_characteristic_data);
+            memcpy(characteristic_data + DATA_CHARACTERISTIC_HEADER_SIZE, composite_characteristic_data + DATA_CHARACTERISTIC_HEADER_SIZE, size - DATA_CHARACTERISTIC_HEADER_SIZE);
         }
-    }
-    else
-    {
-        if (maximum_samples > MAX_SENSOR_SAMPLES) maximum_samples = MAX_SENSOR_SAMPLES;
+        composite_characteristic_data = characteristic_data;
     }
 
-    //If the new maximum value doesn't match the value for m_current_sensor_samples
-    //calculated in the calculate_samples_and_connection_interval() method, update
-    //that value now.
-    if (maximum_samples != m_current_sensor_samples)
+    if (samples != m_current_sensor_samples)
     {
-        m_current_sensor_samples = maximum_samples;
-        SEGGER_RTT_printf(0, "Based on connection interval and ODR, sensor samples have been adjusted to %d.\n", m_current_sensor_samples);
+        m_current_sensor_samples = samples;
+        SEGGER_RTT_printf(0, "Data sets now hold %d samples.\n", m_current_sensor_samples);
     }
+}
 
-    //Make sure we collect at least 1 sample
-    if (m_current_sensor_samples < 1) m_current_sensor_samples = 1;
+static void throughput_init()
+{
+    //There's no connection yet so the scheduler starts out with the biggest data sets, it gets the
+    //real link as soon as a connection is made
+    throughput_link_t link;
+    throughput_link_get(&link);
+    throughput_scheduler_init(&m_throughput, &link);
+    sensor_samples_apply(throughput_scheduler_samples(&m_throughput));
+}
 
-    //Set the data characteristic pointer to the appropriately sized characteristic
-    //based on the number of samples
-    if (m_current_sensor_samples < 5)
-    {
-        composite_characteristic_data = small_characteristic_data;
-        SEGGER_RTT_WriteString(0, "Using small data characteristic.\n");
-    }
-    else if (m_current_sensor_samples < 9)
-    {
-        composite_characteristic_data = medium_characteristic_data;
-        SEGGER_RTT_WriteString(0, "Using medium data characteristic.\n");
-    }
-    else
+static void throughput_link_refresh()
+{
+    //Called whenever something the throughput scheduler depends on changes (the connection interval,
+    //the ATT MTU, data length or PHY, the ODR or the sample encoding) and each time a stream starts.
+    //The link model picks the data set size again from scratch.
+    throughput_link_t link;
+    throughput_link_get(&link);
+    throughput_scheduler_link_set(&m_throughput, &link);
+    sensor_samples_apply(throughput_scheduler_samples(&m_throughput));
+}
+
+static void throughput_data_set_sent()
+{
+    //Called after every live data set. Every THROUGHPUT_SCHEDULER_WINDOW_EVENTS connection events
+    //the scheduler looks at how the notification queue held up and may change the data set size.
+    if (throughput_scheduler_update(&m_throughput, m_time_stamp, m_notifications_completed))
     {
-        composite_characteristic_data = large_characteristic_data;
-        SEGGER_RTT_WriteString(0, "Using large data characteristic.\n");
+        sensor_samples_apply(throughput_scheduler_samples(&m_throughput));
     }
-    SEGGER_RTT_WriteString(0, "\n");
+}
+
+void throughput_connection_interval_select()
+{
+    //Picks the connection interval to ask the central for. The shorter the interval the sooner each
+    //data set gets sent, so this is the shortest one the link model thinks can carry the stream at
+    //the current ODR (see throughput_model_preferred_interval()). The min and max values must be
+    //multiples of 15 milliseconds with at least 15 milliseconds between them.
+    throughput_link_t link;
+    throughput_link_get(&link);
+
+    //This usually gets called before the GATT module has finished asking the central for bigger
+    //packets, so assume it gets them
+    link.att_mtu = NRF_SDH_BLE_GATT_MAX_MTU_SIZE;
+    link.data_length = NRF_SDH_BLE_GAP_DATA_LENGTH;
+    throughput_model_preferred_interval(&link, &desired_minimum_connection_interval, &desired_maximum_connection_interval);
+    SEGGER_RTT_printf(0, "Asking for a connection interval of %d - %d milliseconds.\n", desired_minimum_connection_interval, desired_maximum_connection_interval);
+}
+
+void throughput_connection_interval_update(int actual_connection_interval)
+{
+    //Called after the connection interval has been negotiated with the central
+    if (actual_connection_interval != 0) m_connection_interval = actual_connection_interval;
+    throughput_link_refresh();
+}
+
+void throughput_link_update(uint16_t att_mtu, uint16_t data_length, uint8_t phy)
+{
+    //Called when the connection's ATT MTU, data length or PHY changes
+    m_att_mtu = att_mtu;
+    m_data_length = data_length;
+    m_phy = phy;
+    throughput_link_refresh();
+}
+
+void throughput_notifications_complete(int count)
+{
+    //Called from the BLE event handler with every BLE_GATTS_EVT_HVN_TX_COMPLETE
+    m_notifications_completed += count;
 }
 
 void data_read_handler(int measurements_taken)
@@ -886,17 +1190,15 @@ void data_read_handler(int measurements_taken)
     //Everytime the data reading timer goes off we take sensor readings and then 
     //update the appropriate characteristic values. The timer should go off SENSOR_SAMPLES times
     //every connection interval
-    int offset = SAMPLE_SIZE * measurements_taken;
-
     if (m_use_composite_data)
     {
         //If the m_use_composite_data boolean is true then data from all three sensors is 
-        //stored in a single characteristic.
-        offset *= 3; //we can only fit 1/3 of the data when sharing a single characteristic
-        offset += 5; //the composite data characteristic has the timestamp and number of data points variables at the front of the characteristic
-        imu_comm.acc_comm.get_data(composite_characteristic_data, offset);
-        imu_comm.gyr_comm.get_data(composite_characteristic_data, offset + SAMPLE_SIZE);
-        imu_comm.mag_comm.get_data(composite_characteristic_data, offset + SAMPLE_SIZE + SAMPLE_SIZE);
+        //stored in a single characteristic. The get_data() offsets are only 8 bits so
+        //move the pointer to the start of the sample instead.
+        uint8_t* sample = data_set_samples() + 3 * SAMPLE_SIZE * measurements_taken; //we can only fit 1/3 of the data when sharing a single characteristic
+        imu_comm.acc_comm.get_data(sample, 0);
+        imu_comm.gyr_comm.get_data(sample, SAMPLE_SIZE);
+        imu_comm.mag_comm.get_data(sample, SAMPLE_SIZE + SAMPLE_SIZE);
     }
     else
     {
@@ -909,6 +1211,200 @@ void data_read_handler(int measurements_taken)
     }
 }
 
+static void fifo_watermark_handler()
+{
+    //Called from the GPIOTE interrupt when the BMI270 FIFO reaches its watermark. All we do here
+    //is save the time and flag the main loop, the actual reading happens outside of the interrupt.
+    m_fifo_watermark_time = get_current_data_time();
+    m_fifo_watermark_reached = true;
+}
+
+static void fifo_data_read()
+{
+    //When the BMI270 FIFO is in use the sensor collects acc and gyr samples on its own at its ODR,
+    //and once it has enough for a full characteristic its watermark interrupt goes off. Instead of
+    //a TWI transaction (and CPU wake up) for every sample, each characteristic worth of samples is
+    //read in a single burst and unpacked straight into the composite characteristic. If the main
+    //loop fell behind there may be more than one characteristic worth of data waiting so keep
+    //reading until the FIFO drops below the watermark, this also lets the interrupt pin go low
+    //again so the next watermark creates a new rising edge.
+    const uint16_t stride = 3 * SAMPLE_SIZE;
+    uint32_t ticks_per_sample = (uint32_t)(16000000.0 / current_sensor_odr);
+
+    //The watermark went off right after the last sample of the oldest data set was taken
+    uint32_t time_stamp = m_fifo_watermark_time - (m_current_sensor_samples - 1) * ticks_per_sample;
+
+    for (int i = 0; i < BMI270_FIFO_MAX_FRAMES; i++)
+    {
+        //The throughput scheduler can change the data set size (and with it the characteristic raw
+        //samples go into) after any data set, so look up where the samples go every time
+        uint8_t* samples = data_set_samples();
+        uint8_t samples_read = 0;
+        if (bmi270_get_fifo_data(samples, 0, stride, m_current_sensor_samples, &samples_read) != 0 || samples_read == 0) break;
+
+        //The magnetometer doesn't have a FIFO of its own and runs at a much lower ODR than the
+        //acc and gyr, so it gets read once and its reading is used for every sample in the set
+        uint8_t* mag_data = samples + 2 * SAMPLE_SIZE;
+        imu_comm.mag_comm.get_data(samples, 2 * SAMPLE_SIZE);
+        for (int j = 1; j < samples_read; j++) memcpy(mag_data + j * stride, mag_data, SAMPLE_SIZE);
+
+        m_time_stamp = time_stamp;
+        characteristic_update_and_notify_composite_characteristic(samples_read);
+        time_stamp += samples_read * ticks_per_sample;
+    }
+}
+
+static void burst_fifo_data_read()
+{
+    //In burst mode the FIFO fills up at BURST_CAPTURE_ODR and its watermark is set as high as it
+    //goes. Every sample read out of it goes into the burst capture buffer (which watches for a swing),
+    //and every Nth sample also goes into the current live data set so the live stream carries on at
+    //about the ODR it was set to. Live data sets no longer line up with FIFO reads so they get filled
+    //a sample at a time and sent as soon as they're full.
+    const uint16_t stride = 3 * SAMPLE_SIZE;
+    uint32_t ticks_per_sample = (uint32_t)(16000000.0 / BURST_CAPTURE_ODR);
+
+    //The watermark went off right after the last sample of the first batch was taken
+    uint32_t time_stamp = m_fifo_watermark_time - (BMI270_FIFO_MAX_BURST_FRAMES - 1) * ticks_per_sample;
+
+    for (int i = 0; i < BMI270_FIFO_MAX_FRAMES; i++)
+    {
+        uint8_t samples_read = 0;
+        if (bmi270_get_fifo_data(m_burst_fifo_samples, 0, stride, BMI270_FIFO_MAX_BURST_FRAMES, &samples_read) != 0 || samples_read == 0) break;
+
+        //Just like fifo_data_read(), the magnetometer gets read once for the whole batch
+        uint8_t* mag_data = m_burst_fifo_samples + 2 * SAMPLE_SIZE;
+        imu_comm.mag_comm.get_data(m_burst_fifo_samples, 2 * SAMPLE_SIZE);
+        for (int j = 1; j < samples_read; j++) memcpy(mag_data + j * stride, mag_data, SAMPLE_SIZE);
+
+        for (int j = 0; j < samples_read; j++)
+        {
+            const uint8_t* sample = m_burst_fifo_samples + j * stride;
+            if (burst_capture_add(&m_burst_capture, sample, time_stamp))
+            {
+                SEGGER_RTT_printf(0, "Swing detected, sending burst %d (%d samples).\n", m_burst_capture.burst_number, m_burst_capture.window_samples);
+            }
+
+            if (m_burst_samples_read++ % m_burst_decimation == 0)
+            {
+                if (m_burst_live_samples == 0) m_burst_live_time_stamp = time_stamp;
+                memcpy(data_set_samples() + m_burst_live_samples * stride, sample, stride);
+
+                if (++m_burst_live_samples >= m_current_sensor_samples)
+                {
+                    m_time_stamp = m_burst_live_time_stamp;
+                    characteristic_update_and_notify_composite_characteristic(m_burst_live_samples);
+                    m_burst_live_samples = 0;
+                }
+            }
+
+            time_stamp += ticks_per_sample;
+        }
+    }
+}
+
+static void burst_transfer()
+{
+    //Sends as much of a frozen burst window as the notification queue has room for. The live stream
+    //always comes first, so burst notifications only take up part of the queue. If a notification
+    //can't be queued the same chunk gets built again the next time around, anything worse than a full
+    //queue (like the front end not listening for bursts) means the burst can't be sent at all so it's
+    //thrown away and the buffer starts looking for the next swing.
+    while (burst_capture_pending(&m_burst_capture) && m_notifications_in_queue < BURST_NOTIFICATION_QUEUE_LIMIT)
+    {
+        uint16_t length = 0;
+        uint8_t count = burst_capture_chunk(&m_burst_capture, burst_characteristic_data, BURST_DATA_CHARACTERISTIC_SIZE, &length);
+        if (count == 0) break;
+
+        ble_gatts_hvx_params_t burst_notify_params;
+        memset(&burst_notify_params, 0, sizeof(burst_notify_params));
+
+        burst_notify_params.type = BLE_GATT_HVX_NOTIFICATION;
+        burst_notify_params.handle = m_ss.burst_handle.value_handle;
+        burst_notify_params.p_data = burst_characteristic_data;
+        burst_notify_params.p_len  = &length;
+        burst_notify_params.offset = 0;
+
+        uint32_t ret = sd_ble_gatts_hvx(m_conn_handle, &burst_notify_params);
+        if (ret == NRF_ERROR_RESOURCES) break;
+        if (ret != NRF_SUCCESS)
+        {
+            SEGGER_RTT_printf(0, "Couldn't send burst %d (error 0x%x), throwing it away.\n", m_burst_capture.burst_number, ret);
+            burst_capture_cancel(&m_burst_capture);
+            break;
+        }
+
+        m_notifications_in_queue++;
+        burst_capture_chunk_sent(&m_burst_capture, count);
+    }
+}
+
+static bool burst_mode_possible()
+{
+    //Burst capture relies on the BMI270 FIFO to keep up with BURST_CAPTURE_ODR
+    return m_burst_capture.enabled && m_use_fifo_data && m_use_composite_data &&
+        imu_comm.sensor_model[0] == BMI270_ACC && imu_comm.sensor_model[1] == BMI270_GYR;
+}
+
+static void fifo_watermark_update()
+{
+    //The number of samples per characteristic can change while data is being collected (when
+    //the connection interval gets updated). Since that happens inside of a BLE event the new
+    //watermark gets set from the main loop instead.
+    bmi270_fifo_set_watermark(m_current_sensor_samples); //any errors get printed by the driver, don't keep retrying
+    m_fifo_watermark_samples = m_current_sensor_samples;
+}
+
+static bool fifo_mode_start()
+{
+    //Attempts to start collecting data through the BMI270 FIFO. This is only possible when the
+    //BMI270 is being used for both the acc and the gyr. Returns false if the normal data read
+    //timer should be used instead.
+    m_fifo_mode_active = false;
+    m_burst_mode_active = false;
+    if (!m_use_fifo_data || !m_use_composite_data) return false;
+    if (imu_comm.sensor_model[0] != BMI270_ACC || imu_comm.sensor_model[1] != BMI270_GYR) return false;
+
+    //When burst capture is on the BMI270 has already been put into active mode at BURST_CAPTURE_ODR
+    //(see sensor_active_mode_start()), and the FIFO gets read whenever it's as full as a single read
+    //allows instead of once per data set
+    uint8_t watermark = burst_mode_possible() ? BMI270_FIFO_MAX_BURST_FRAMES : m_current_sensor_samples;
+    if (bmi270_fifo_mode_enable(watermark) != 0) return false;
+
+    if (burst_mode_possible())
+    {
+        m_burst_decimation = (uint16_t)(BURST_CAPTURE_ODR / current_sensor_odr + 0.5f);
+        if (m_burst_decimation < 1) m_burst_decimation = 1;
+        m_burst_samples_read = 0;
+        m_burst_live_samples = 0;
+        m_burst_mode_active = true;
+        burst_capture_start(&m_burst_capture, BURST_CAPTURE_ODR);
+        device_fusion_reset(&m_device_fusion, BURST_CAPTURE_ODR / m_burst_decimation); //the live stream's real ODR
+        SEGGER_RTT_printf(0, "Burst capture engaged, live stream gets every %d samples.\n", m_burst_decimation);
+    }
+
+    m_fifo_watermark_samples = watermark;
+    m_fifo_watermark_reached = false;
+    m_fifo_mode_active = true;
+    sensor_interrupt_enable();
+    data_clock_start();
+
+    SEGGER_RTT_printf(0, "BMI270 FIFO mode engaged, reading %d samples per watermark.\n", m_current_sensor_samples);
+    return true;
+}
+
+static void fifo_mode_stop()
+{
+    //Stops FIFO data collection, needs to be called while the TWI bus is still on
+    if (!m_fifo_mode_active) return;
+
+    sensor_interrupt_disable();
+    bmi270_fifo_mode_disable();
+    m_fifo_mode_active = false;
+    m_burst_mode_active = false;
+    m_fifo_watermark_reached = false;
+}
+
 
 //Functions for updating sensor power modes and settings
 static void sensor_idle_mode_start()
@@ -928,7 +1424,8 @@ static void sensor_idle_mode_start()
     if (current_operating_mode == SENSOR_ACTIVE_MODE)
     {
         //If we're transitioning from active to idle mode we need to stop the data collection timer
-        //and start the led timer back up.
+        //(or FIFO) and start the led timer back up.
+        fifo_mode_stop();
         data_timers_stop();
 
         //the LED is deactivated during data collection so turn it back on
@@ -961,6 +1458,7 @@ static void sensor_active_mode_start()
     //and then start the data collection timer. We also disable the LED to save on power
     if (current_operating_mode == SENSOR_ACTIVE_MODE) return; //no need to change anything if already in active mode
     led_timers_stop();
+    m_active_mode_start_time = get_rtc_time(); //the time until the first data set goes out is part of the boot timing
 
     //TODO: Comment out the twi bus enable commands below and put a break point in the assert_nrf_callback()
     //method around line 95. See what error it kicks up. In the future, handle this error in that method by
@@ -978,17 +1476,27 @@ static void sensor_active_mode_start()
     lsm9ds1_active_mode_enable();
     fxos8700_active_mode_enable();
     fxas21002_active_mode_enable(current_operating_mode);
+    bmi270_odr_override_set(burst_mode_possible() ? BMI2_ACC_ODR_1600HZ : 0); //burst capture needs the BMI270 at BURST_CAPTURE_ODR
     bmi270_active_mode_enable(current_operating_mode);
     bmm150_active_mode_enable(sensor_odr_calculate(), current_operating_mode);
 
     //uncomment the below lines to read active sensor registers and confirm settings
     bmm150_get_actual_settings();
 
-    //start data acquisition by turning on the data timers
-    data_timers_start();
+    //Every new stream of data starts over at sequence number 0 with nothing dropped, and the
+    //AHRS (only used by the fused encodings) starts over too
+    m_packet_sequence = 0;
+    m_dropped_packets = 0;
+    device_fusion_reset(&m_device_fusion, current_sensor_odr);
+    throughput_link_refresh(); //the scheduler starts over from the link model too
+
+    //start data acquisition by putting the BMI270 into FIFO mode, or if that isn't possible
+    //by turning on the data timers
+    if (!fifo_mode_start()) data_timers_start();
     
     current_operating_mode = SENSOR_ACTIVE_MODE; //set the current operating mode to active
     m_data_ready = false; //Want to make sure we start with fresh data
+    m_first_sample_pending = true;
     SEGGER_RTT_WriteString(0, "Sensor Active Mode engaged.\n");
 }
 
@@ -1020,14 +1528,25 @@ static void connected_mode_start()
         if (default_sensors[2] == BMM150_MAG) bmm150_init = true;
     }
 
+    //FIFO data collection needs to be stopped while the TWI bus is still on
+    if (current_operating_mode == SENSOR_ACTIVE_MODE) fifo_mode_stop();
+
     //Call the connected_mode_enable() method for all sensors. Only sensors that are in active
     //use will actually do anything with these methods
+    uint32_t configure_start_time = get_rtc_time();
     bmi270_connected_mode_enable(bmi270_init);
     bmm150_connected_mode_enable(bmm150_init);
     fxos8700_connected_mode_enable();
     fxas21002_connected_mode_enable();
     lsm9ds1_connected_mode_enable();
 
+    //Configuring the sensors for the first connection is part of the boot timing
+    if (current_operating_mode == ADVERTISING_MODE && m_boot_timing.configure_us == 0)
+    {
+        m_boot_timing.configure_us = get_rtc_microseconds_since(configure_start_time);
+        available_sensors_characteristic_refresh();
+    }
+
     //Disable all active TWI busses
     disable_twi_bus(imu_comm.acc_comm.twi_bus->inst_idx);
     disable_twi_bus(imu_comm.gyr_comm.twi_bus->inst_idx);
@@ -1080,6 +1599,45 @@ static void advertising_mode_start()
     //TODO: Implement this feature
 }
 
+static void settings_characteristic_refresh()
+{
+    //Puts the current sensor settings back into the settings characteristic, either because
+    //something in them changed or because a command overwrote the characteristic
+    ble_gatts_value_t settings;
+    settings.len = SENSOR_SETTINGS_LENGTH;
+    settings.p_value = sensor_settings;
+    settings.offset = 0;
+    uint32_t err_code = sd_ble_gatts_value_set(m_conn_handle, m_ss.settings_handles.value_handle, &settings);
+    if (err_code != NRF_SUCCESS) error_notification(err_code);
+}
+
+static void data_encoding_update(uint8_t encoding)
+{
+    //Called when the front end asks for a new sample encoding. Anything this firmware doesn't know
+    //about falls back to raw samples, and the encoding can't change in the middle of a data set so
+    //requests that come in while data is being collected are ignored. The fused encodings need the
+    //calibration tables for the AHRS, so if those haven't been sent yet nothing changes. Either way
+    //the encoding that's actually in use gets written back to the settings characteristic for the
+    //front end to read.
+    if (encoding >= SAMPLE_ENCODING_END) encoding = SAMPLE_ENCODING_RAW;
+    if (current_operating_mode == SENSOR_ACTIVE_MODE) encoding = m_data_encoding;
+    if (fused_encoding(encoding) && !device_fusion_ready(&m_device_fusion))
+    {
+        SEGGER_RTT_WriteString(0, "Can't use fused samples until the fusion tables have been sent.\n");
+        encoding = m_data_encoding;
+    }
+
+    sensor_settings[DATA_ENCODING] = encoding;
+    if (encoding != m_data_encoding)
+    {
+        m_data_encoding = encoding;
+        throughput_link_refresh(); //packed and fused samples let more of them fit into a single data set
+        SEGGER_RTT_printf(0, "Data characteristic now using sample encoding %d.\n", encoding);
+    }
+
+    settings_characteristic_refresh();
+}
+
 static void update_sensor_settings_array()
 {
     //This method gets called when the sensor settings array is updated in the front end.
@@ -1092,29 +1650,32 @@ static void update_sensor_settings_array()
     //sensor and initialize the new one.
     uint8_t new_sensors = 0;
 
-    if (imu_comm.sensor_model[ACC_SENSOR] != sensor_settings[ACC_START + SENSOR_MODEL])
+    if (imu_comm.sensor_model[0] != sensor_settings[ACC_START + SENSOR_MODEL])
     {
         new_sensors |= 0b001;
-        default_sensors[ACC_SENSOR] = sensor_settings[ACC_START + SENSOR_MODEL];
-        sensors_initialized[ACC_SENSOR] = false;
+        default_sensors[0] = sensor_settings[ACC_START + SENSOR_MODEL];
+        sensors_initialized[0] = false;
     }
 
-    if (imu_comm.sensor_model[GYR_SENSOR] != sensor_settings[GYR_START + SENSOR_MODEL])
+    if (imu_comm.sensor_model[1] != sensor_settings[GYR_START + SENSOR_MODEL])
     {
         new_sensors |= 0b010;
-        default_sensors[GYR_SENSOR] = sensor_settings[GYR_START + SENSOR_MODEL];
-        sensors_initialized[GYR_SENSOR] = false;
+        default_sensors[1] = sensor_settings[GYR_START + SENSOR_MODEL];
+        sensors_initialized[1] = false;
     }
     
-    if (imu_comm.sensor_model[MAG_SENSOR] != sensor_settings[MAG_START + SENSOR_MODEL])
+    if (imu_comm.sensor_model[2] != sensor_settings[MAG_START + SENSOR_MODEL])
     {
         new_sensors |= 0b100;
-        default_sensors[MAG_SENSOR] = sensor_settings[MAG_START + SENSOR_MODEL];
-        sensors_initialized[MAG_SENSOR] = false;
+        default_sensors[2] = sensor_settings[MAG_START + SENSOR_MODEL];
+        sensors_initialized[2] = false;
     }
 
     if (new_sensors) sensors_init(false);
 
+    //The last byte of the settings array holds the sample encoding
+    data_encoding_update(sensor_settings[DATA_ENCODING]);
+
     //Check to see if the ODR was updated. If so we update the data reading timer
     //and update the connection interval accordingly.
     float new_sensor_odr = sensor_odr_calculate();
@@ -1143,7 +1704,7 @@ static void update_sensor_settings_array()
         //more efficient to store more samples in the data characteristic. We
         //also need to update the data acquisition timer to math the ODR.
         update_data_read_timer(1000.0 / current_sensor_odr);
-        set_sensor_samples(0); //using 0 here forces the method to use the current connection interval
+        throughput_link_refresh();
     }
 }
 
@@ -1177,6 +1738,34 @@ static void sensor_settings_write_handler(uint16_t conn_handle, ble_sensor_servi
         case 5:
             sensor_active_mode_start();
             break;
+        case 6:
+            data_encoding_update(*(settings_state + 1));
+            break;
+        case DEVICE_FUSION_COMMAND:
+            //Part of a calibration table for the AHRS (see device_fusion.h). These can come in at
+            //any time, even while data is being collected, since calibration is allowed to change.
+            if (!device_fusion_set_table_part(&m_device_fusion, *(settings_state + 1), *(settings_state + 2), settings_state + 3))
+            {
+                SEGGER_RTT_printf(0, "Fusion table part %d for sensor %d doesn't exist.\n", *(settings_state + 2), *(settings_state + 1));
+            }
+            settings_characteristic_refresh();
+            break;
+        case BURST_CAPTURE_COMMAND:
+            //Turns burst capture on or off and sets the trigger threshold and window (see burst_capture.h).
+            //The BMI270 ODR can't change in the middle of collecting data so this takes effect the next
+            //time sensor active mode starts.
+            burst_capture_configure_command(&m_burst_capture, settings_state + 1);
+            SEGGER_RTT_printf(0, "Burst capture turned %s.\n", m_burst_capture.enabled ? "on" : "off");
+            settings_characteristic_refresh();
+            break;
+        case BOOT_CACHE_COMMAND:
+            //Forgets the cached sensors so that the next power up scans both TWI buses (i.e. after a new
+            //sensor has been plugged in). Nothing gets cached again until then.
+            m_boot_cache_enabled = false;
+            boot_cache_invalidate(&m_boot_cache);
+            if (flash_record_delete(FLASH_BOOT_CACHE_KEY) == NRF_SUCCESS) SEGGER_RTT_WriteString(0, "Cached sensors forgotten, both TWI buses will be scanned at the next power up.\n");
+            else SEGGER_RTT_WriteString(0, "Couldn't forget the cached sensors.\n");
+            break;
     }    
 }
 
@@ -1313,8 +1902,10 @@ int main(void)
     ble_event_handler_t ble_handlers;
     ble_handlers.gap_connected_handler = on_gap_connection_handler;
     ble_handlers.gap_disconnected_handler = on_gap_disconnection_handler;
-    ble_handlers.gap_connection_interval_handler = calculate_samples_and_connection_interval;
-    ble_handlers.gap_update_sensor_samples = set_sensor_samples;
+    ble_handlers.gap_connection_interval_handler = throughput_connection_interval_select;
+    ble_handlers.gap_update_sensor_samples = throughput_connection_interval_update;
+    ble_handlers.gap_link_update_handler = throughput_link_update;
+    ble_handlers.gatts_tx_complete_handler = throughput_notifications_complete;
 
     timer_handlers_t timer_handlers;
     timer_handlers.data_read_handler = data_read_handler;
@@ -1323,12 +1914,19 @@ int main(void)
     //Initialize.
     log_init();
     timers_init(&active_led, &m_data_ready, &m_current_sensor_samples, &m_time_stamp, &timer_handlers);
+    m_boot_start_time = get_rtc_time(); //the boot timing starts here
     power_management_init();
     ble_stack_init(&ble_handlers, &m_conn_handle, &m_notification_done, &m_notifications_in_queue, &m_current_sensor_samples, &desired_minimum_connection_interval, &desired_maximum_connection_interval);
     enable_connection_event_extension();
     gatt_init();
     services_init();
+    throughput_init();
+    device_fusion_init(&m_device_fusion);
+    burst_capture_init(&m_burst_capture);
     twi_init();
+    sensor_interrupt_init(fifo_watermark_handler);
+    flash_storage_init();
+    boot_cache_load();
     sensors_init(true);
     gap_params_init(current_sensor_odr);
     advertising_init();
@@ -1354,5 +1952,27 @@ int main(void)
             characteristic_update_and_notify();
             m_data_ready = false;
         }
+
+        //When the BMI270 FIFO is in use, data gets read here instead of in the data read timer
+        if (m_fifo_mode_active)
+        {
+            if (!m_burst_mode_active && m_fifo_watermark_samples != m_current_sensor_samples)
+            {
+                //If the watermark goes down the FIFO may already be past it, so read it right away
+                fifo_watermark_update();
+                m_fifo_watermark_time = get_current_data_time();
+                m_fifo_watermark_reached = true;
+            }
+
+            if (m_fifo_watermark_reached)
+            {
+                m_fifo_watermark_reached = false;
+                if (m_burst_mode_active) burst_fifo_data_read();
+                else fifo_data_read();
+            }
+
+            //Any burst that's waiting goes out a few notifications at a time as the queue empties
+            if (m_burst_mode_active) burst_transfer();
+        }
     }
 }
\ No newline at end of file
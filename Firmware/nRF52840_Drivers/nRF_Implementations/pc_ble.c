@@ -12,6 +12,9 @@
 #define APP_BLE_CONN_CFG_TAG            1                                       /**< A tag identifying the SoftDevice BLE configuration. */
 
 static uint16_t sensor_connection_interval;                                     /**< Variable that holds the desired connection interval (in milliseconds) */
+static uint16_t m_att_mtu = BLE_GATT_ATT_MTU_DEFAULT;                           /**< ATT MTU of the current connection */
+static uint16_t m_data_length = 27;                                             /**< Payload bytes in a single radio packet of the current connection */
+static uint8_t  m_phy = BLE_GAP_PHY_1MBPS;                                      /**< PHY the current connection transmits on */
 
 BLE_ADVERTISING_DEF(m_advertising);                                             /**< Advertising module instance. */
 NRF_BLE_QWR_DEF(m_qwr);                                                         /**< Context for the Queued Write module.*/
@@ -71,6 +74,8 @@ void ble_stack_init(ble_event_handler_t* handler_methods, uint16_t* connection_h
     m_ble_event_handlers.gap_disconnected_handler = handler_methods->gap_disconnected_handler;
     m_ble_event_handlers.gap_connection_interval_handler = handler_methods->gap_connection_interval_handler;
     m_ble_event_handlers.gap_update_sensor_samples = handler_methods->gap_update_sensor_samples;
+    m_ble_event_handlers.gap_link_update_handler = handler_methods->gap_link_update_handler;
+    m_ble_event_handlers.gatts_tx_complete_handler = handler_methods->gatts_tx_complete_handler;
 
     //Set a reference to the connection handle (the physical variable is in main.c
     //as there are other modules that need access to it)
@@ -105,7 +110,7 @@ void ble_stack_init(ble_event_handler_t* handler_methods, uint16_t* connection_h
     memset(&ble_cfg, 0, sizeof(ble_cfg));
 
     ble_cfg.conn_cfg.conn_cfg_tag = APP_BLE_CONN_CFG_TAG;
-    ble_cfg.conn_cfg.params.gatts_conn_cfg.hvn_tx_queue_size = 12; //Increase the total notifications that can be queued at a given time
+    ble_cfg.conn_cfg.params.gatts_conn_cfg.hvn_tx_queue_size = HVN_TX_QUEUE_SIZE; //Increase the total notifications that can be queued at a given time
     err_code = sd_ble_cfg_set(BLE_CONN_CFG_GATTS, &ble_cfg, ram_start);
     APP_ERROR_CHECK(err_code);
 
@@ -310,10 +315,39 @@ void gap_params_init(float current_sensor_odr)
 
 void gatt_init(void)
 {
-    ret_code_t err_code = nrf_ble_gatt_init(&m_gatt, NULL);
+    ret_code_t err_code = nrf_ble_gatt_init(&m_gatt, gatt_evt_handler);
     APP_ERROR_CHECK(err_code);
 }
 
+static void link_update()
+{
+    //Lets main.c know how much each notification and radio packet can hold now
+    if (m_ble_event_handlers.gap_link_update_handler != NULL) m_ble_event_handlers.gap_link_update_handler(m_att_mtu, m_data_length, m_phy);
+}
+
+static void gatt_evt_handler(nrf_ble_gatt_t * p_gatt, nrf_ble_gatt_evt_t const * p_evt)
+{
+    //The GATT module negotiates the ATT MTU and data length on its own after a connection is made,
+    //all we do here is pass the results along
+    switch (p_evt->evt_id)
+    {
+        case NRF_BLE_GATT_EVT_ATT_MTU_UPDATED:
+            m_att_mtu = p_evt->params.att_mtu_effective;
+            SEGGER_RTT_printf(0, "ATT MTU updated to %u bytes.\n", m_att_mtu);
+            link_update();
+            break;
+
+        case NRF_BLE_GATT_EVT_DATA_LENGTH_UPDATED:
+            m_data_length = p_evt->params.data_length;
+            SEGGER_RTT_printf(0, "Data length updated to %u bytes.\n", m_data_length);
+            link_update();
+            break;
+
+        default:
+            break;
+    }
+}
+
 static void on_adv_evt(ble_adv_evt_t ble_adv_evt)
 {
     ret_code_t err_code;
@@ -369,6 +403,13 @@ static void ble_evt_handler(ble_evt_t const * p_ble_evt, void * p_context)
             //Set the radio power for the connection to -4dBm (slight power savings)
             sd_ble_gap_tx_power_set(BLE_GAP_TX_POWER_ROLE_CONN, *p_conn_handle, -4);
 
+            //Every connection starts out with the smallest packets, the GATT module and the central
+            //make them bigger from here
+            m_att_mtu = BLE_GATT_ATT_MTU_DEFAULT;
+            m_data_length = 27;
+            m_phy = BLE_GAP_PHY_1MBPS;
+            link_update();
+
             m_ble_event_handlers.gap_connected_handler();
             SEGGER_RTT_printf(0, "Connected to the Personal Caddie with a connection interval of %u milliseconds.\n",
                               p_ble_evt->evt.gap_evt.params.connected.conn_params.max_conn_interval * 5 / 4);
@@ -388,6 +429,15 @@ static void ble_evt_handler(ble_evt_t const * p_ble_evt, void * p_context)
             APP_ERROR_CHECK(err_code);
         } break;
 
+        case BLE_GAP_EVT_PHY_UPDATE:
+            if (p_ble_evt->evt.gap_evt.params.phy_update.status == BLE_HCI_STATUS_CODE_SUCCESS)
+            {
+                m_phy = p_ble_evt->evt.gap_evt.params.phy_update.tx_phy;
+                SEGGER_RTT_printf(0, "PHY updated to %u.\n", m_phy);
+                link_update();
+            }
+            break;
+
         case BLE_GAP_EVT_CONN_PARAM_UPDATE:
             sensor_connection_interval = p_ble_evt->evt.gap_evt.params.conn_param_update.conn_params.min_conn_interval * 5 / 4;
             //update the number of samples we collect based on the connection interval negotiated
@@ -412,7 +462,8 @@ static void ble_evt_handler(ble_evt_t const * p_ble_evt, void * p_context)
         case BLE_GATTS_EVT_HVN_TX_COMPLETE:
             //SEGGER_RTT_printf(0, "Notification %d sent.\n", ++debug_total_notifications);
             *p_notification_done = true; //set the notification done bool to true to allow more notifications
-            (*p_notifications_in_queue)--;
+            (*p_notifications_in_queue) -= p_ble_evt->evt.gatts_evt.params.hvn_tx_complete.count; //a single event can cover more than one notification
+            if (m_ble_event_handlers.gatts_tx_complete_handler != NULL) m_ble_event_handlers.gatts_tx_complete_handler(p_ble_evt->evt.gatts_evt.params.hvn_tx_complete.count);
             break;
 
         case BLE_GAP_EVT_DATA_LENGTH_UPDATE:
@@ -25,11 +25,14 @@ from examples in the nRF SDK, but they've been moved to this location to
 reduce clutter in main.c
 */
 
+#define HVN_TX_QUEUE_SIZE 12 /**< Notifications the SoftDevice can hold at once */
+
 // Forward declaration of the ble_event_handler_t type.
 typedef struct ble_event_handler_s ble_event_handler_t;
 
 typedef void (*pc_ble_handler_t) (void); //Function pointer for methods to be passed to BLE handler
 typedef void (*pc_ble_handler_i_t) (int); //Function pointer for methods to be passed to BLE handler (takes an integer parameter)
+typedef void (*pc_ble_link_handler_t) (uint16_t, uint16_t, uint8_t); //Function pointer for the link handler (ATT MTU, data length and PHY)
 
 
 //Struct to hold function pointers for BLE Event handler
@@ -39,6 +42,8 @@ struct ble_event_handler_s
     pc_ble_handler_t gap_disconnected_handler;   /**< This method will get called when a connection is lost. */
     pc_ble_handler_t gap_connection_interval_handler;   /**< This method will get called when the connection interval needs to be updated */
     pc_ble_handler_i_t gap_update_sensor_samples;  /**<this method updates the number of samples to collect after the connection interval is updated */
+    pc_ble_link_handler_t gap_link_update_handler;  /**< This method gets called when the ATT MTU, data length or PHY of the connection changes */
+    pc_ble_handler_i_t gatts_tx_complete_handler;  /**< This method gets called with the number of notifications the SoftDevice just finished sending */
 };
 
 //BLE Stack Methods
@@ -64,6 +69,7 @@ void gatt_init(void);
 static void on_adv_evt(ble_adv_evt_t ble_adv_evt);
 static void pm_evt_handler(pm_evt_t const * p_evt);
 static void ble_evt_handler(ble_evt_t const * p_ble_evt, void * p_context);
+static void gatt_evt_handler(nrf_ble_gatt_t * p_gatt, nrf_ble_gatt_evt_t const * p_evt);
 static void nrf_qwr_error_handler(uint32_t nrf_error);
 static void on_conn_params_evt(ble_conn_params_evt_t * p_evt);
 static void conn_params_error_handler(uint32_t nrf_error);
@@ -0,0 +1,119 @@
+#include "pc_flash.h"
+#include "app_error.h"
+#include "SEGGER_RTT.h"
+
+#include <string.h>
+
+static volatile bool m_fds_initialized = false;                            //Set by the FDS_EVT_INIT event
+static volatile bool m_write_pending = false;                              //A write or delete hasn't finished yet
+static uint32_t      m_write_buffer[FLASH_MAX_RECORD_SIZE / sizeof(uint32_t)]; //FDS writes straight from the caller's buffer, so records get copied here first
+
+static void fds_event_handler(fds_evt_t const * p_evt)
+{
+    //All FDS operations other than reads are asynchronous, this is where they finish
+    switch (p_evt->id)
+    {
+        case FDS_EVT_INIT:
+            if (p_evt->result == NRF_SUCCESS) m_fds_initialized = true;
+            else SEGGER_RTT_printf(0, "Flash Error: Couldn't initialize flash storage (0x%x).\n", p_evt->result);
+            break;
+        case FDS_EVT_WRITE:
+        case FDS_EVT_UPDATE:
+        case FDS_EVT_DEL_RECORD:
+            if (p_evt->write.file_id != FLASH_FILE_ID) break; //the peer manager's records come through here too
+            m_write_pending = false;
+            if (p_evt->result != NRF_SUCCESS) SEGGER_RTT_printf(0, "Flash Error: Record 0x%x couldn't be saved (0x%x).\n", p_evt->write.record_key, p_evt->result);
+            break;
+        default:
+            break;
+    }
+}
+
+void flash_storage_init()
+{
+    //Registers for FDS events and starts the library up. The peer manager calls fds_init() again
+    //later on, which doesn't do anything once FDS is already running. Initialization finishes in
+    //the background (the SoftDevice needs to be enabled first) so this waits for it, the records
+    //in here are needed right away when the sensors get initialized.
+    ret_code_t err_code = fds_register(fds_event_handler);
+    APP_ERROR_CHECK(err_code);
+
+    err_code = fds_init();
+    APP_ERROR_CHECK(err_code);
+
+    while (!m_fds_initialized) __WFE(); //sleep until the FDS_EVT_INIT event comes in
+}
+
+bool flash_record_read(uint16_t key, void* p_data, uint16_t length)
+{
+    //Copies a record into p_data. Returns false if the record doesn't exist or is a different
+    //size than expected (i.e. it was written by a different version of the firmware).
+    if (!m_fds_initialized) return false;
+
+    fds_record_desc_t desc = {0};
+    fds_find_token_t  token = {0};
+    if (fds_record_find(FLASH_FILE_ID, key, &desc, &token) != NRF_SUCCESS) return false;
+
+    fds_flash_record_t record = {0};
+    if (fds_record_open(&desc, &record) != NRF_SUCCESS) return false;
+
+    bool size_matches = (record.p_header->length_words * sizeof(uint32_t) == length);
+    if (size_matches) memcpy(p_data, record.p_data, length);
+
+    fds_record_close(&desc);
+    return size_matches;
+}
+
+ret_code_t flash_record_write(uint16_t key, void const* p_data, uint16_t length)
+{
+    //Writes a record, replacing it if it's already there. The length has to be a multiple of 4
+    //bytes. Only one write can be in progress at a time, NRF_ERROR_BUSY means try again later.
+    //If flash is full the space taken up by old records gets reclaimed and the write has to be
+    //tried again.
+    if (!m_fds_initialized) return NRF_ERROR_INVALID_STATE;
+    if (length > FLASH_MAX_RECORD_SIZE || (length % sizeof(uint32_t)) != 0) return NRF_ERROR_INVALID_LENGTH;
+    if (m_write_pending) return NRF_ERROR_BUSY;
+
+    memcpy(m_write_buffer, p_data, length);
+    fds_record_t const record = {
+        .file_id = FLASH_FILE_ID,
+        .key = key,
+        .data.p_data = m_write_buffer,
+        .data.length_words = length / sizeof(uint32_t)
+        };
+
+    fds_record_desc_t desc = {0};
+    fds_find_token_t  token = {0};
+    m_write_pending = true;
+
+    ret_code_t err_code;
+    if (fds_record_find(FLASH_FILE_ID, key, &desc, &token) == NRF_SUCCESS) err_code = fds_record_update(&desc, &record);
+    else err_code = fds_record_write(&desc, &record);
+
+    if (err_code != NRF_SUCCESS) m_write_pending = false;
+    if (err_code == FDS_ERR_NO_SPACE_IN_FLASH) fds_gc();
+
+    return err_code;
+}
+
+ret_code_t flash_record_delete(uint16_t key)
+{
+    //Deletes a record if it's there, finishes in the background like a write
+    if (!m_fds_initialized) return NRF_ERROR_INVALID_STATE;
+    if (m_write_pending) return NRF_ERROR_BUSY;
+
+    fds_record_desc_t desc = {0};
+    fds_find_token_t  token = {0};
+    if (fds_record_find(FLASH_FILE_ID, key, &desc, &token) != NRF_SUCCESS) return NRF_SUCCESS; //nothing to delete
+
+    m_write_pending = true;
+    ret_code_t err_code = fds_record_delete(&desc);
+    if (err_code != NRF_SUCCESS) m_write_pending = false;
+
+    return err_code;
+}
+
+bool flash_write_pending()
+{
+    return m_write_pending;
+}
@@ -0,0 +1,41 @@
+#ifndef PC_FLASH_H__
+#define PC_FLASH_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "fds.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+The PersonalCaddie_flash files keep small records in flash that need to survive
+a power cycle (like the sensor map in boot_cache.h). They sit on top of the Flash
+Data Storage library, which the peer manager uses for bonding information as well,
+so records here use their own file ID to stay out of its way. Reads are immediate,
+writes are queued and finish in the background, the record being written is copied
+first so the caller doesn't need to hang on to it.
+*/
+
+#define FLASH_FILE_ID            0x5043                                     /**< "PC", kept below the peer manager's range of file IDs */
+#define FLASH_BOOT_CACHE_KEY     0x0001                                     /**< Record key of the boot cache (see boot_cache.h) */
+#define FLASH_MAX_RECORD_SIZE    128                                        /**< Largest record that can be written, in bytes */
+
+//Init methods
+void flash_storage_init();
+
+//Record methods
+bool flash_record_read(uint16_t key, void* p_data, uint16_t length);
+ret_code_t flash_record_write(uint16_t key, void const* p_data, uint16_t length);
+ret_code_t flash_record_delete(uint16_t key);
+
+//Get methods
+bool flash_write_pending();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PC_FLASH_H__
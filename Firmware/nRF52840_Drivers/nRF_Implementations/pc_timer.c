@@ -79,6 +79,14 @@ void data_timers_start(void)
     nrf_drv_timer_enable(&m_data_start_timer);
 }
 
+void data_clock_start(void)
+{
+    //Only starts the data start timer. When the IMU buffers samples in its own FIFO we don't
+    //need the data read timer going off for every sample, but we still need the clock for
+    //time stamping each data set. data_timers_stop() turns this timer back off.
+    nrf_drv_timer_enable(&m_data_start_timer);
+}
+
 void data_timers_stop(void)
 {
     //Stop and reset the data timers
@@ -120,6 +128,21 @@ uint32_t get_current_data_time()
     return nrf_drv_timer_capture(&m_data_start_timer, NRF_TIMER_CC_CHANNEL2);
 }
 
+uint32_t get_rtc_time()
+{
+    //The app timer's RTC is kept running from timers_init() on (APP_TIMER_KEEPS_RTC_ACTIVE), so
+    //unlike the data clock this can be used to time things at any point after power up
+    return app_timer_cnt_get();
+}
+
+uint32_t get_rtc_microseconds_since(uint32_t start_ticks)
+{
+    //The RTC counter is only 24 bits and wraps every 1024 seconds, which is plenty for timing
+    //the different stages of starting up
+    uint32_t ticks = app_timer_cnt_diff_compute(app_timer_cnt_get(), start_ticks);
+    return (uint32_t)(((uint64_t)ticks * 1000000 * (APP_TIMER_CONFIG_RTC_FREQUENCY + 1)) / APP_TIMER_CLOCK_FREQ); //APP_TIMER_CONFIG_RTC_FREQUENCY is the prescaler
+}
+
 void update_data_read_timer(float milliseconds)
 {
     //Used to change how often the data read timer goes off.
@@ -153,7 +176,10 @@ static void data_read_timer_handler(nrf_timer_event_t event_type, void* p_contex
         *p_current_time_stamp = time_stamp;
         //SEGGER_RTT_printf(0, "Data set begins at time (in ticks) %d\n", time_stamp);
     }
-    else if ( measurements_taken == *p_total_sensor_samples)
+
+    //This isn't an else if, a data set can be a single sample. The data set size can also go down
+    //while a data set is being read so it's finished as soon as it has enough samples.
+    if (measurements_taken >= *p_total_sensor_samples)
     {
         //after all the samples are read, update the characteristics and notify
         *p_data_ready = true; //flags the main loop to broadcast data notifications
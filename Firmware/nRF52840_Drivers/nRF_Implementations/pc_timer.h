@@ -40,10 +40,13 @@ void led_timers_start(void);
 void led_timers_stop(void);
 void data_timers_start(void);
 void data_timers_stop(void);
+void data_clock_start(void);
 void delay_microseconds(uint32_t microseconds);
 
 //Get Methods
 uint32_t get_current_data_time();
+uint32_t get_rtc_time();
+uint32_t get_rtc_microseconds_since(uint32_t start_ticks);
 
 //Handlers
 static void data_read_timer_handler(nrf_timer_event_t event_type, void* p_context);
@@ -1,9 +1,11 @@
 #include "pc_twi.h"
+#include "pc_twi_queue.h"
+#include "pc_timer.h"
 #include "app_error.h"
+#include "app_util_platform.h"
 #include "SEGGER_RTT.h"
 #include "nrf_gpio.h"
 #include "sensor_settings.h"
-#include "stdlib.h"
 
 //Global TWI variables
 #if TWI0_ENABLED
@@ -28,12 +30,21 @@ const nrf_drv_twi_t m_twi_external = NRF_DRV_TWI_INSTANCE(EXTERNAL_TWI_INSTANCE_
 #define INTERNAL_PULLUP              NRF_GPIO_PIN_MAP(1, 0)                          /**< Pullup resistors on BLE 33 sense have separate power source*/
 #define INTERNAL_MIC_POWER_PIN       NRF_GPIO_PIN_MAP(0, 17)                         /**< Pin for powering BLE 33 Sense onboard microphone */
 #define INTERNAL_MIC_CLOCK_PIN       NRF_GPIO_PIN_MAP(0, 26)                         /**< Pin for clock signal of BLE 33 Sense onboard microphone */
+#define INTERNAL_IMU_INT_PIN         NRF_GPIO_PIN_MAP(0, 11)                         /**< Pin connected to INT1 of the BLE 33 Sense onboard IMU */
 
 volatile bool m_xfer_internal_done = false; //Indicates if operation on the internal TWI bus has ended.
 volatile bool m_xfer_external_done = false; //Indicates if operation on the external TWI bus has ended.
 bool m_display_twi_events = true;  //There are times were we don't bother displaying twi event messages (such as getting address NACKs during device scan)
 
 static int m_twi_internal_bus_status, m_twi_external_bus_status;  // lets us know the status of the internal and external TWI bus after each communication attempt
+static sensor_interrupt_handler_t m_sensor_interrupt_handler = NULL; // gets called when the IMU interrupt pin goes high
+
+//Holds the result of a blocking register read or write while it waits in the transfer queue
+typedef struct
+{
+    volatile bool    done;
+    volatile int32_t result;
+} blocking_transfer_t;
 
 void twi_handler(nrf_drv_twi_evt_t const * p_event, void * p_context, uint8_t twi_bus)
 {
@@ -65,18 +76,61 @@ void twi_handler(nrf_drv_twi_evt_t const * p_event, void * p_context, uint8_t tw
     }
 }
 
+static int32_t twi_event_result(nrf_drv_twi_evt_t const * p_event)
+{
+    //Converts a TWI event into the error code handed to transfer callbacks
+    switch (p_event->type)
+    {
+        case NRF_DRV_TWI_EVT_DONE:         return NRF_SUCCESS;
+        case NRF_DRV_TWI_EVT_ADDRESS_NACK: return NRF_ERROR_DRV_TWI_ERR_ANACK;
+        case NRF_DRV_TWI_EVT_DATA_NACK:    return NRF_ERROR_DRV_TWI_ERR_DNACK;
+        case NRFX_TWI_EVT_OVERRUN:         return NRF_ERROR_DRV_TWI_ERR_OVERRUN;
+        default:                           return NRF_ERROR_INTERNAL;
+    }
+}
+
 void internal_twi_handler(nrf_drv_twi_evt_t const * p_event, void * p_context)
 {
     m_twi_internal_bus_status = p_event->type;
     twi_handler(p_event, p_context, INTERNAL_TWI_INSTANCE_ID); //forward the event to the main twi handler
-    m_xfer_internal_done = true; //unblock TWI communications
+    m_xfer_internal_done = true; //unblock the address scan
+    twi_queue_transfer_complete(INTERNAL_TWI_INSTANCE_ID, twi_event_result(p_event)); //call back and start the next queued transfer
 }
 
 void external_twi_handler(nrf_drv_twi_evt_t const * p_event, void * p_context)
 {
     m_twi_external_bus_status = p_event->type;
     twi_handler(p_event, p_context, EXTERNAL_TWI_INSTANCE_ID);  //forward the event to the main twi handler
-    m_xfer_external_done = true; //unblock TWI communications
+    m_xfer_external_done = true; //unblock the address scan
+    twi_queue_transfer_complete(EXTERNAL_TWI_INSTANCE_ID, twi_event_result(p_event)); //call back and start the next queued transfer
+}
+
+static int32_t twi_queue_start_transfer(uint8_t bus, twi_transfer_t const* transfer)
+{
+    //Hands a transfer from the queue to the TWI driver. Reads send the register address and then
+    //read straight into the caller's buffer, writes send the register address and data together.
+    nrf_drv_twi_xfer_desc_t xfer = {
+        .address = transfer->address,
+        .primary_length = transfer->primary_length,
+        .secondary_length = transfer->read_length,
+        .p_primary_buf = (uint8_t*)transfer->p_primary_buf,
+        .p_secondary_buf = transfer->p_read_buf,
+        .type = (transfer->p_read_buf != NULL) ? NRF_DRV_TWI_XFER_TXRX : NRF_DRV_TWI_XFER_TX};
+
+    nrf_drv_twi_t const* instance = (bus == INTERNAL_TWI_INSTANCE_ID) ? &m_twi_internal : &m_twi_external;
+    return (int32_t)nrf_drv_twi_xfer(instance, &xfer, 0); //no flags needed here
+}
+
+static void twi_queue_critical_enter()
+{
+    //Both TWI interrupts run at APP_IRQ_PRIORITY_HIGH and can call back into the queue, so
+    //they need to be kept out while a queue is being changed
+    app_util_critical_region_enter(NULL);
+}
+
+static void twi_queue_critical_exit()
+{
+    app_util_critical_region_exit(0);
 }
 
 void twi_init()
@@ -107,6 +161,15 @@ void twi_init()
     err_code = nrf_drv_twi_init(&m_twi_internal, &twi_internal_config, internal_twi_handler, NULL);
     err_code = nrf_drv_twi_init(&m_twi_external, &twi_external_config, external_twi_handler, NULL);
     APP_ERROR_CHECK(err_code);
+
+    //All sensor register reads and writes go through the transfer queue
+    const twi_queue_backend_t twi_queue_backend = {
+        .start          = twi_queue_start_transfer,
+        .time           = get_current_data_time,
+        .critical_enter = twi_queue_critical_enter,
+        .critical_exit  = twi_queue_critical_exit
+        };
+    twi_queue_init(&twi_queue_backend);
 }
 
 void enable_twi_bus(int instance_id)
@@ -279,151 +342,209 @@ void disable_external_power_line()
     SEGGER_RTT_WriteString(0, "External Sensor Power Line Disabled.\n");
 }
 
+static void sensor_interrupt_pin_handler(nrf_drv_gpiote_pin_t pin, nrf_gpiote_polarity_t action)
+{
+    //The GPIOTE driver needs a handler with this signature, just forward the event
+    if (m_sensor_interrupt_handler != NULL) m_sensor_interrupt_handler();
+}
+
+void sensor_interrupt_init(sensor_interrupt_handler_t handler)
+{
+    //Sets up a GPIOTE event for the rising edge of the IMU's interrupt pin. Currently this is
+    //only used for the BMI270 FIFO watermark interrupt. The low power (PORT event) version of
+    //GPIOTE is used so having the pin configured doesn't add to the sleep current.
+    m_sensor_interrupt_handler = handler;
+
+    ret_code_t err_code = NRF_SUCCESS;
+    if (!nrf_drv_gpiote_is_init())
+    {
+        err_code = nrf_drv_gpiote_init();
+        APP_ERROR_CHECK(err_code);
+    }
+
+    nrf_drv_gpiote_in_config_t pin_config = GPIOTE_CONFIG_IN_SENSE_LOTOHI(false);
+    pin_config.pull = NRF_GPIO_PIN_PULLDOWN; //keeps the pin from floating while the sensors are powered off
+
+    err_code = nrf_drv_gpiote_in_init(INTERNAL_IMU_INT_PIN, &pin_config, sensor_interrupt_pin_handler);
+    APP_ERROR_CHECK(err_code);
+}
+
+void sensor_interrupt_enable()
+{
+    nrf_drv_gpiote_in_event_enable(INTERNAL_IMU_INT_PIN, true);
+}
+
+void sensor_interrupt_disable()
+{
+    nrf_drv_gpiote_in_event_disable(INTERNAL_IMU_INT_PIN);
+}
+
+static bool imu_sensor_address(uint8_t add)
+{
+    //The BLE 33 Sense comes with some other sensors on board which we (for now at least) don't
+    //care about, so only addresses that belong to one of the IMU sensors count
+    for (int i = ACC_SENSOR; i <= MAG_SENSOR; i++)
+    {
+        int stop;
+        if (i == ACC_SENSOR) stop = ACC_MODEL_END;
+        else if (i == GYR_SENSOR) stop = GYR_MODEL_END;
+        else stop = MAG_MODEL_END;
+
+        //iterate through all sensor models of type i
+        for (int j = 0; j < stop; j++)
+        {
+            if (add == get_sensor_low_address(i, j) || add == get_sensor_high_address(i, j)) return true;
+        }
+    }
+
+    return false;
+}
+
 void twi_address_scan(uint8_t* addresses, uint8_t* device_count, nrf_drv_twi_t const * bus)
 {
     //This method scans for all possible TWI addresses on the given bus. If an
     //address is found it gets added to the given array of addresses and the count
     //of devices gets incremented.
-    uint8_t sample_data;
+    twi_scan_request_t request = {
+        .bus = bus,
+        .candidates = NULL,
+        .candidate_count = 0,
+        .addresses = addresses,
+        .device_count = device_count
+        };
+    twi_address_scan_buses(&request, 1);
+}
+
+void twi_address_scan_buses(twi_scan_request_t* requests, uint8_t request_count)
+{
+    //Tries every candidate address of each request and adds the IMU sensors that answer to
+    //its list. Each bus only ever has a single probe on it, but the probes on different buses
+    //run at the same time. The CPU sleeps until a probe finishes on either bus, collects the
+    //answer and puts the next probe for that bus straight on, so scanning both buses takes
+    //about as long as scanning one of them.
+    uint8_t next[TWI_QUEUE_BUSES] = {0};       //index of the next candidate to try on each bus
+    bool    waiting[TWI_QUEUE_BUSES] = {false}; //a probe is on the bus
+    uint8_t probed[TWI_QUEUE_BUSES];           //address of the probe that's on the bus
+    uint8_t sample_data[TWI_QUEUE_BUSES];
 
     //We expect to get failures on most of our address search attempts. Because of this
     //we surpress logging of address NACKs (of which there will be a lot), but enable
     //successful TWI events so we can see what addresses lead to a hit.
     m_display_twi_events = false;
-    uint8_t instance = ((nrf_drv_twi_t const*)bus)->inst_idx;
-    volatile bool * m_xfer_done;
-    int* m_twi_bus_status;
-    if (instance == INTERNAL_TWI_INSTANCE_ID)
+    for (int r = 0; r < request_count; r++)
     {
-        m_xfer_done = &m_xfer_internal_done; //set to false before any read or write operations (this gets set to true in twi_handler when the transfer is complete)
-        m_twi_bus_status = &m_twi_internal_bus_status;
-        SEGGER_RTT_WriteString(0, "Initiating Sensor Scan on Internal TWI bus.\n");
-    }
-    else
-    {
-        m_xfer_done = &m_xfer_external_done;
-        m_twi_bus_status = &m_twi_external_bus_status;
-        SEGGER_RTT_WriteString(0, "Initiating Sensor Scan on External TWI bus.\n");
+        if (requests[r].bus->inst_idx == INTERNAL_TWI_INSTANCE_ID) SEGGER_RTT_WriteString(0, "Initiating Sensor Scan on Internal TWI bus.\n");
+        else SEGGER_RTT_WriteString(0, "Initiating Sensor Scan on External TWI bus.\n");
     }
 
-    for (uint8_t add = 0; add <= 127; add++)
+    for (;;)
     {
-        ret_code_t err_code;
-        *m_xfer_done = false;
-
-        do
+        bool busy = false;
+        for (int r = 0; r < request_count; r++)
         {
-            err_code = nrf_drv_twi_rx(bus, add, &sample_data, sizeof(sample_data));
-        } while (err_code == 0x11); //if the nrf is currently busy doing something else this line will wait until its done before executing
-        while (*m_xfer_done == false); //this line forces the program to wait for the TWI transfer to complete before moving on
+            twi_scan_request_t* p_request = &requests[r];
+            uint8_t instance = p_request->bus->inst_idx;
+            volatile bool * m_xfer_done = (instance == INTERNAL_TWI_INSTANCE_ID) ? &m_xfer_internal_done : &m_xfer_external_done; //gets set to true in twi_handler when the transfer is complete
+            int* m_twi_bus_status = (instance == INTERNAL_TWI_INSTANCE_ID) ? &m_twi_internal_bus_status : &m_twi_external_bus_status;
+            uint16_t candidates = (p_request->candidates != NULL) ? p_request->candidate_count : 128;
+
+            //If a sensor was found we add it to the list, get the bus status from the
+            //current twi bus and add the current address if we get an ACK
+            if (waiting[r] && *m_xfer_done)
+            {
+                waiting[r] = false;
+                if (*m_twi_bus_status == NRF_DRV_TWI_EVT_DONE && imu_sensor_address(probed[r])) p_request->addresses[(*p_request->device_count)++] = probed[r];
+            }
 
-        //If a sensor was found so we add it to the list, get the bus status from the 
-        //current twi bus and add the current address if we get an ACK
-        if (*m_twi_bus_status == NRF_DRV_TWI_EVT_DONE)
-        {
-            //We've found a TWI address, before adding it to the array though make sure that
-            //it's an IMU sensor. The BLE 33 Sense comes with some other sensors on board
-            //which we (for now at least) don't care about.
-            bool add_to_list = false;
-            for (int i = ACC_SENSOR; i <= MAG_SENSOR; i++)
+            //The scan talks to the bus directly instead of going through the transfer queue (it needs a
+            //plain read without a register address), so it has to wait for anything queued to finish first
+            while (!waiting[r] && next[r] < candidates && twi_queue_idle(instance))
             {
-                int stop;
-                if (i == ACC_SENSOR) stop = ACC_MODEL_END;
-                else if (i == GYR_SENSOR) stop = GYR_MODEL_END;
-                else stop = MAG_MODEL_END;
-
-                //iterate through all sensor models of type i
-                for (int j = 0; j < stop; j++)
-                {
-                    uint8_t valid_sensor_address_l = get_sensor_low_address(i, j);
-                    uint8_t valid_sensor_address_h = get_sensor_high_address(i, j);
-
-                    if (add == valid_sensor_address_l || add == valid_sensor_address_h)
-                    {
-                        addresses[(*device_count)++] = add;
-                        add_to_list = true;
-                        break;
-                    }
-                }
-
-                if (add_to_list) break;
+                probed[r] = (p_request->candidates != NULL) ? p_request->candidates[next[r]] : next[r];
+                next[r]++;
+
+                *m_xfer_done = false;
+                if (nrf_drv_twi_rx(p_request->bus, probed[r], &sample_data[r], 1) == NRF_SUCCESS) waiting[r] = true;
             }
+
+            if (waiting[r] || next[r] < candidates) busy = true;
         }
+
+        if (!busy) break;
+        __WFE(); //sleep until a TWI interrupt says one of the probes is complete
     }
 
     m_display_twi_events = true; //flip this boolean back to true so we can see future error messages
     SEGGER_RTT_WriteString(0, "\n");
 }
 
+static void blocking_transfer_done(int32_t result, void* p_context)
+{
+    blocking_transfer_t* p_transfer = (blocking_transfer_t*)p_context;
+    p_transfer->result = result;
+    p_transfer->done = true;
+}
+
+static int32_t wait_for_transfer(int32_t queue_result, blocking_transfer_t* p_transfer)
+{
+    //The sensor drivers expect register access to be synchronous, so the blocking read and write
+    //methods queue their transfer like anything else and then wait here for its callback
+    APP_ERROR_CHECK(queue_result);
+    while (!p_transfer->done) __WFE(); //sleep until the TWI interrupt comes in instead of spinning
+    return p_transfer->result;
+}
+
 int32_t sensor_read_register(void *bus, uint8_t add, uint8_t reg, uint8_t *bufp, uint16_t len)
 {
     //This method allows for the reading of a sensor register(s). In most cases only a single register 
     //will be read, however, some sensors have a register auto-increment method so if the input read 
     //length is greater than 1 multiple registers can be read with a single command.
-    ret_code_t err_code = 0;
-
-    const nrf_drv_twi_xfer_desc_t sensor_read = {
-        .address = add,
-        .primary_length = 1,
-        .secondary_length = (uint8_t)len,
-        .p_primary_buf = &reg,
-        .p_secondary_buf = bufp,
-        .type =  NRF_DRV_TWI_XFER_TXRX};
-
-    //set the m_xfer_done bool to false given the current TWI bus
-    uint8_t instance = ((nrf_drv_twi_t const*)bus)->inst_idx;
-    volatile bool * m_xfer_done;
-    if (instance == INTERNAL_TWI_INSTANCE_ID) m_xfer_done = &m_xfer_internal_done; //set to false before any read or write operations (this gets set to true in twi_handler when the transfer is complete)
-    else m_xfer_done = &m_xfer_external_done;
-
-    *m_xfer_done = false;
-
-    do
-    {
-        err_code = nrf_drv_twi_xfer((nrf_drv_twi_t const*)bus, &sensor_read, 0); //no flags needed here
-    } while (err_code == 0x11); //if the nrf is currently busy doing something else this line will wait until its done before executing
-    while (*m_xfer_done == false); //this line forces the program to wait for the TWI transfer to complete before moving on
-
-    APP_ERROR_CHECK(err_code);
-    return (int32_t)err_code;
+    blocking_transfer_t transfer = { .done = false, .result = NRF_SUCCESS };
+    int32_t err_code = sensor_read_register_async(bus, add, reg, bufp, len, blocking_transfer_done, &transfer, NULL);
+    return wait_for_transfer(err_code, &transfer);
 }
+
 int32_t sensor_write_register(void *bus, uint8_t add, uint8_t reg, const uint8_t *bufp, uint16_t len)
 {
     //This method is for writing data to a single register for a sensor
-    ret_code_t err_code = 0;
-
-    uint8_t* register_and_data = (uint8_t*)malloc(len * sizeof(uint8_t));
-    register_and_data[0] = reg;
-    for (int i = 0; i < len; i++) register_and_data[i + 1] = bufp[i];
-
-    //the primary buffer will hold the register address, as well as the value to write into it.
-    //for a single write operation, the secondary buffer has no use in a single write command
-    const nrf_drv_twi_xfer_desc_t sensor_write = {
-        .address = add,
-        .primary_length = 1 + len,
-        .secondary_length = 0,
-        .p_primary_buf = register_and_data,
-        .p_secondary_buf = NULL,
-        .type =  NRF_DRV_TWI_XFER_TX};
-
-    //set the m_xfer_done bool to false given the current TWI bus
-    uint8_t instance = ((nrf_drv_twi_t const*)bus)->inst_idx;
-    volatile bool * m_xfer_done;
-    if (instance == INTERNAL_TWI_INSTANCE_ID) m_xfer_done = &m_xfer_internal_done; //set to false before any read or write operations (this gets set to true in twi_handler when the transfer is complete)
-    else m_xfer_done = &m_xfer_external_done;
-
-    *m_xfer_done = false;
+    blocking_transfer_t transfer = { .done = false, .result = NRF_SUCCESS };
+    int32_t err_code = sensor_write_register_async(bus, add, reg, bufp, len, blocking_transfer_done, &transfer, NULL);
+    return wait_for_transfer(err_code, &transfer);
+}
 
-    do
-    {
-        err_code = nrf_drv_twi_xfer((nrf_drv_twi_t const*)bus, &sensor_write, 0); //no flags needed here
-    } while (err_code == 0x11); //if the nrf is currently busy doing something else this line will wait until its done before executing
-    while (*m_xfer_done == false); //this line forces the program to wait for the TWI transfer to complete before moving on
+int32_t sensor_write_burst(void *bus, uint8_t add, const uint8_t *bufp, uint16_t len)
+{
+    //Writes a block that's too long for sensor_write_register() in a single transfer. bufp holds
+    //the register address followed by the data and has to be in RAM since EasyDMA reads it
+    //straight from there.
+    uint8_t instance = ((nrf_drv_twi_t const*)bus)->inst_idx;
+    blocking_transfer_t transfer = { .done = false, .result = NRF_SUCCESS };
+    int32_t err_code = twi_queue_write_burst(instance, add, bufp, len, blocking_transfer_done, &transfer, NULL);
+    if (err_code == TWI_QUEUE_ERROR_PARAM) return NRF_ERROR_INVALID_LENGTH;
+    return wait_for_transfer((err_code == TWI_QUEUE_SUCCESS) ? NRF_SUCCESS : NRF_ERROR_NO_MEM, &transfer);
+}
 
-    free(register_and_data); //release memory after write operation is complete
+int32_t sensor_read_register_async(void *bus, uint8_t add, uint8_t reg, uint8_t *bufp, uint16_t len,
+                                   twi_transfer_callback_t callback, void* p_context, twi_transfer_group_t* p_group)
+{
+    //Queues a register read and returns right away. The callback gets called from the TWI interrupt
+    //once bufp has been filled. Reads on the internal and external buses run at the same time, so
+    //putting the acc, gyr and mag reads for a sample into one group lets them all go out together
+    //and the group callback fires when the whole sample is in.
+    uint8_t instance = ((nrf_drv_twi_t const*)bus)->inst_idx;
+    int32_t err_code = twi_queue_read(instance, add, reg, bufp, len, callback, p_context, p_group);
+    return (err_code == TWI_QUEUE_SUCCESS) ? NRF_SUCCESS : NRF_ERROR_NO_MEM;
+}
 
-    APP_ERROR_CHECK(err_code);
-    return (int32_t)err_code;
+int32_t sensor_write_register_async(void *bus, uint8_t add, uint8_t reg, const uint8_t *bufp, uint16_t len,
+                                    twi_transfer_callback_t callback, void* p_context, twi_transfer_group_t* p_group)
+{
+    //Queues a register write and returns right away. The data is copied into the queue so bufp can
+    //be reused as soon as this returns.
+    uint8_t instance = ((nrf_drv_twi_t const*)bus)->inst_idx;
+    int32_t err_code = twi_queue_write(instance, add, reg, bufp, len, callback, p_context, p_group);
+    if (err_code == TWI_QUEUE_ERROR_PARAM) return NRF_ERROR_INVALID_LENGTH;
+    return (err_code == TWI_QUEUE_SUCCESS) ? NRF_SUCCESS : NRF_ERROR_NO_MEM;
 }
 
 void turn_on_mic()
@@ -5,6 +5,8 @@
 #include <stdbool.h>
 
 #include "nrf_drv_twi.h"
+#include "nrf_drv_gpiote.h"
+#include "pc_twi_queue.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -14,7 +16,9 @@ extern "C" {
 The PersonalCaddie_twi files hold all information necessary for communication 
 over the TWI peripheral of the nRF52840. This includes initialization and 
 turning on/off of two TWI buses, methods for reading/writing IMU sensors, handler 
-methods, as well as a method for scanning both TWI buses for connected sensors.
+methods, as well as methods for scanning both TWI buses (at the same time) for
+connected sensors.
+Register reads and writes go through the transfer queue in pc_twi_queue.h.
 */
 
 //Handler methods
@@ -41,10 +45,33 @@ void disable_internal_power_line();
 void enable_external_power_line();
 void disable_external_power_line();
 
-//Reading/Writing Methods
+//Sensor Interrupt Methods
+typedef void (*sensor_interrupt_handler_t) (void); //Function pointer for the method called when the IMU interrupt pin goes high
+void sensor_interrupt_init(sensor_interrupt_handler_t handler);
+void sensor_interrupt_enable();
+void sensor_interrupt_disable();
+
+//Scanning Methods
+typedef struct
+{
+    nrf_drv_twi_t const * bus;
+    uint8_t const*        candidates;      /**< Addresses to try, NULL to try every address from 0 to 127 */
+    uint8_t               candidate_count;
+    uint8_t*              addresses;       /**< IMU sensors that answered get added to the end of this array */
+    uint8_t*              device_count;    /**< Sensors in the addresses array, goes up by one for every sensor found */
+} twi_scan_request_t;
+
 void twi_address_scan(uint8_t* addresses, uint8_t* device_count, nrf_drv_twi_t const * bus);
+void twi_address_scan_buses(twi_scan_request_t* requests, uint8_t request_count);
+
+//Reading/Writing Methods
 int32_t sensor_read_register(void *bus, uint8_t add, uint8_t reg, uint8_t *bufp, uint16_t len);
 int32_t sensor_write_register(void *bus, uint8_t add, uint8_t reg, const uint8_t *bufp, uint16_t len);
+int32_t sensor_write_burst(void *bus, uint8_t add, const uint8_t *bufp, uint16_t len);
+int32_t sensor_read_register_async(void *bus, uint8_t add, uint8_t reg, uint8_t *bufp, uint16_t len,
+                                   twi_transfer_callback_t callback, void* p_context, twi_transfer_group_t* p_group);
+int32_t sensor_write_register_async(void *bus, uint8_t add, uint8_t reg, const uint8_t *bufp, uint16_t len,
+                                    twi_transfer_callback_t callback, void* p_context, twi_transfer_group_t* p_group);
 
 //DEBUG
 void turn_on_mic();
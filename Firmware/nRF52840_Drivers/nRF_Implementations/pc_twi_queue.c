@@ -0,0 +1,228 @@
+#include "pc_twi_queue.h"
+#include <string.h>
+
+//Each bus has a ring of transfer descriptors. The transfer at the head of the ring is the one
+//that's currently on the bus (when active is true), everything behind it is waiting its turn.
+typedef struct
+{
+    twi_transfer_t    transfers[TWI_QUEUE_LENGTH];
+    uint8_t           head;
+    uint8_t           count;
+    bool              active;
+    twi_queue_stats_t stats;
+} twi_bus_queue_t;
+
+static twi_bus_queue_t m_queues[TWI_QUEUE_BUSES];
+static twi_queue_backend_t m_backend;
+
+static void critical_enter()
+{
+    if (m_backend.critical_enter != NULL) m_backend.critical_enter();
+}
+
+static void critical_exit()
+{
+    if (m_backend.critical_exit != NULL) m_backend.critical_exit();
+}
+
+static uint32_t current_time()
+{
+    return (m_backend.time != NULL) ? m_backend.time() : 0;
+}
+
+static void group_transfer_done(twi_transfer_group_t* p_group, int32_t result)
+{
+    //Counts down the transfers left in a group and calls the group callback after the last one
+    critical_enter();
+    if (result != TWI_QUEUE_SUCCESS && p_group->result == TWI_QUEUE_SUCCESS) p_group->result = result;
+    bool group_done = (--p_group->remaining == 0);
+    critical_exit();
+
+    if (group_done && p_group->callback != NULL) p_group->callback(p_group->result, p_group->p_context);
+}
+
+static bool finish_transfer(uint8_t bus, int32_t result)
+{
+    //Takes the transfer at the head of the queue off and lets whoever queued it know that it's
+    //done. Returns true if there's another transfer waiting that needs to be started.
+    twi_bus_queue_t* p_queue = &m_queues[bus];
+
+    critical_enter();
+    if (!p_queue->active)
+    {
+        //This event didn't come from a queued transfer (the address scan talks to the bus directly)
+        critical_exit();
+        return false;
+    }
+
+    twi_transfer_t* p_transfer = &p_queue->transfers[p_queue->head];
+    twi_transfer_callback_t callback = p_transfer->callback;
+    void* p_context = p_transfer->p_context;
+    twi_transfer_group_t* p_group = p_transfer->p_group;
+
+    uint32_t latency = current_time() - p_transfer->queued_time;
+    p_queue->stats.transfers++;
+    if (result != TWI_QUEUE_SUCCESS) p_queue->stats.errors++;
+    p_queue->stats.total_latency += latency;
+    if (latency > p_queue->stats.max_latency) p_queue->stats.max_latency = latency;
+
+    p_queue->head = (p_queue->head + 1) % TWI_QUEUE_LENGTH;
+    p_queue->count--;
+    p_queue->stats.depth = p_queue->count;
+    bool start_next = (p_queue->count > 0);
+    p_queue->active = start_next;
+    critical_exit();
+
+    //The descriptor can be reused as soon as it's off the queue, so everything needed from it was
+    //copied out above before calling back
+    if (callback != NULL) callback(result, p_context);
+    if (p_group != NULL) group_transfer_done(p_group, result);
+
+    return start_next;
+}
+
+static void start_transfers(uint8_t bus)
+{
+    //Starts the transfer at the head of the queue. If the backend can't start it then it gets
+    //finished with the error and the one behind it is tried instead.
+    twi_bus_queue_t* p_queue = &m_queues[bus];
+    for (;;)
+    {
+        int32_t result = m_backend.start(bus, &p_queue->transfers[p_queue->head]);
+        if (result == TWI_QUEUE_SUCCESS) return;
+        if (!finish_transfer(bus, result)) return;
+    }
+}
+
+static int32_t queue_transfer(uint8_t bus, uint8_t address, const uint8_t* p_primary, uint16_t primary_length, bool copy_primary, uint8_t* p_read_buf, uint16_t read_length,
+                              twi_transfer_callback_t callback, void* p_context, twi_transfer_group_t* p_group)
+{
+    if (bus >= TWI_QUEUE_BUSES || (copy_primary && primary_length > sizeof(((twi_transfer_t*)0)->primary_buf))) return TWI_QUEUE_ERROR_PARAM;
+    twi_bus_queue_t* p_queue = &m_queues[bus];
+
+    critical_enter();
+    if (p_queue->count == TWI_QUEUE_LENGTH)
+    {
+        p_queue->stats.rejected++;
+        critical_exit();
+        return TWI_QUEUE_ERROR_FULL;
+    }
+
+    twi_transfer_t* p_transfer = &p_queue->transfers[(p_queue->head + p_queue->count) % TWI_QUEUE_LENGTH];
+    p_transfer->address = address;
+    if (copy_primary)
+    {
+        memcpy(p_transfer->primary_buf, p_primary, primary_length);
+        p_transfer->p_primary_buf = p_transfer->primary_buf;
+    }
+    else p_transfer->p_primary_buf = p_primary;
+    p_transfer->primary_length = primary_length;
+    p_transfer->p_read_buf = p_read_buf;
+    p_transfer->read_length = read_length;
+    p_transfer->callback = callback;
+    p_transfer->p_context = p_context;
+    p_transfer->p_group = p_group;
+    p_transfer->queued_time = current_time();
+    if (p_group != NULL) p_group->remaining++;
+
+    p_queue->count++;
+    p_queue->stats.depth = p_queue->count;
+    if (p_queue->count > p_queue->stats.max_depth) p_queue->stats.max_depth = p_queue->count;
+
+    //If the bus isn't doing anything then this transfer can go right away, otherwise it gets
+    //started when the transfer ahead of it finishes
+    bool start_now = !p_queue->active;
+    p_queue->active = true;
+    critical_exit();
+
+    if (start_now) start_transfers(bus);
+    return TWI_QUEUE_SUCCESS;
+}
+
+void twi_queue_init(twi_queue_backend_t const* backend)
+{
+    m_backend = *backend;
+    memset(m_queues, 0, sizeof(m_queues));
+}
+
+int32_t twi_queue_read(uint8_t bus, uint8_t address, uint8_t reg, uint8_t* p_data, uint16_t length,
+                       twi_transfer_callback_t callback, void* p_context, twi_transfer_group_t* p_group)
+{
+    //Queues a read of length bytes starting at the given register. p_data needs to stay
+    //valid (and in RAM for EasyDMA) until the callback is called.
+    return queue_transfer(bus, address, &reg, 1, true, p_data, length, callback, p_context, p_group);
+}
+
+int32_t twi_queue_write(uint8_t bus, uint8_t address, uint8_t reg, const uint8_t* p_data, uint16_t length,
+                        twi_transfer_callback_t callback, void* p_context, twi_transfer_group_t* p_group)
+{
+    //Queues a register write. The data is copied into the transfer descriptor so p_data
+    //doesn't need to stick around after this returns.
+    if (length > TWI_QUEUE_MAX_WRITE_LENGTH) return TWI_QUEUE_ERROR_PARAM;
+
+    uint8_t register_and_data[1 + TWI_QUEUE_MAX_WRITE_LENGTH];
+    register_and_data[0] = reg;
+    if (length > 0) memcpy(register_and_data + 1, p_data, length);
+
+    return queue_transfer(bus, address, register_and_data, 1 + length, true, NULL, 0, callback, p_context, p_group);
+}
+
+int32_t twi_queue_write_burst(uint8_t bus, uint8_t address, const uint8_t* p_buffer, uint16_t length,
+                              twi_transfer_callback_t callback, void* p_context, twi_transfer_group_t* p_group)
+{
+    //Queues a write that's too long to be copied into a transfer descriptor. p_buffer holds the
+    //register address followed by the data and goes to the bus as is, so it needs to stay valid
+    //(and in RAM for EasyDMA) until the callback is called. The whole thing goes out as a single
+    //transfer no matter how long it is.
+    if (length < 2) return TWI_QUEUE_ERROR_PARAM;
+    return queue_transfer(bus, address, p_buffer, length, false, NULL, 0, callback, p_context, p_group);
+}
+
+void twi_group_begin(twi_transfer_group_t* p_group, twi_transfer_callback_t callback, void* p_context)
+{
+    //The group starts with an extra count that only gets removed by twi_group_end(). This keeps
+    //the group callback from going off early if the first transfer finishes before the rest of
+    //the group has been queued.
+    p_group->remaining = 1;
+    p_group->result = TWI_QUEUE_SUCCESS;
+    p_group->callback = callback;
+    p_group->p_context = p_context;
+}
+
+void twi_group_end(twi_transfer_group_t* p_group)
+{
+    group_transfer_done(p_group, TWI_QUEUE_SUCCESS);
+}
+
+void twi_queue_transfer_complete(uint8_t bus, int32_t result)
+{
+    //Gets called from the TWI event handler of the given bus
+    if (bus >= TWI_QUEUE_BUSES) return;
+    if (finish_transfer(bus, result)) start_transfers(bus);
+}
+
+bool twi_queue_idle(uint8_t bus)
+{
+    return (bus >= TWI_QUEUE_BUSES) || !m_queues[bus].active;
+}
+
+void twi_queue_get_stats(uint8_t bus, twi_queue_stats_t* p_stats)
+{
+    if (bus >= TWI_QUEUE_BUSES) return;
+
+    critical_enter();
+    *p_stats = m_queues[bus].stats;
+    critical_exit();
+}
+
+void twi_queue_reset_stats(uint8_t bus)
+{
+    if (bus >= TWI_QUEUE_BUSES) return;
+
+    critical_enter();
+    uint16_t depth = m_queues[bus].stats.depth;
+    memset(&m_queues[bus].stats, 0, sizeof(twi_queue_stats_t));
+    m_queues[bus].stats.depth = depth;
+    m_queues[bus].stats.max_depth = depth;
+    critical_exit();
+}
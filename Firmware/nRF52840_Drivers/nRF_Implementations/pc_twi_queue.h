@@ -0,0 +1,120 @@
+#ifndef PC_TWI_QUEUE_H__
+#define PC_TWI_QUEUE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+The PersonalCaddie_twi_queue files hold a non-blocking transfer queue for the TWI
+buses. Each bus gets its own queue of statically allocated transfer descriptors, so
+nothing is ever allocated at run time. A transfer is started as soon as its bus is
+free and the next one in line is started from the completion event, so a transfer
+on the internal bus and a transfer on the external bus can be in progress at the
+same time. Completion callbacks get called from the TWI event handler.
+
+Writes are normally copied into the transfer descriptor, which keeps them short. Long
+writes (like the BMI270 config file) can go out as a single burst instead, in which case
+the caller's buffer is handed to the bus as is and has to stick around until the
+callback.
+
+Transfers can also be put into a group, which has its own callback that gets called
+once every transfer in the group is done. This is used to chain the reads for a
+single sample together even when the sensors are spread across both buses.
+
+Nothing in here depends on the nRF SDK. The actual hardware access goes through the
+twi_queue_backend_t function pointers (see pc_twi.c), which makes it possible to run
+the queue on a computer against a fake TWI backend.
+*/
+
+#define TWI_QUEUE_BUSES            2                                        /**< Internal and external TWI bus */
+#define TWI_QUEUE_LENGTH           16                                       /**< Transfers that can be waiting on a single bus at once */
+#define TWI_QUEUE_MAX_WRITE_LENGTH 32                                       /**< Max bytes of data in a single register write (the register address is extra) */
+
+#define TWI_QUEUE_SUCCESS          0
+#define TWI_QUEUE_ERROR_FULL       -1                                       /**< Every transfer descriptor for the bus is in use */
+#define TWI_QUEUE_ERROR_PARAM      -2                                       /**< Bad bus number, a write that's too long or an empty burst */
+
+//Forward declarations
+typedef struct twi_transfer_s twi_transfer_t;
+typedef struct twi_transfer_group_s twi_transfer_group_t;
+typedef struct twi_queue_backend_s twi_queue_backend_t;
+typedef struct twi_queue_stats_s twi_queue_stats_t;
+
+typedef void (*twi_transfer_callback_t) (int32_t result, void* p_context); //result is 0 when the transfer was successful
+
+//A single register read or write
+struct twi_transfer_s
+{
+    uint8_t                 address;                                        /**< TWI address of the sensor */
+    uint8_t                 primary_buf[1 + TWI_QUEUE_MAX_WRITE_LENGTH];    /**< Register address followed by the data for writes */
+    const uint8_t*          p_primary_buf;                                  /**< What actually goes out on the bus, either primary_buf or the caller's buffer for bursts */
+    uint16_t                primary_length;
+    uint8_t*                p_read_buf;                                     /**< Where read data goes, NULL for writes */
+    uint16_t                read_length;
+    twi_transfer_callback_t callback;
+    void*                   p_context;
+    twi_transfer_group_t*   p_group;
+    uint32_t                queued_time;                                    /**< Backend time when the transfer was queued, used for latency stats */
+};
+
+//A set of transfers that report back together
+struct twi_transfer_group_s
+{
+    volatile uint8_t        remaining;                                      /**< Transfers that haven't finished yet (+1 until the group is closed) */
+    volatile int32_t        result;                                         /**< First error from any transfer in the group */
+    twi_transfer_callback_t callback;
+    void*                   p_context;
+};
+
+//The hardware side of the queue
+struct twi_queue_backend_s
+{
+    int32_t  (*start)(uint8_t bus, twi_transfer_t const* transfer);         /**< Starts a transfer, returns 0 if it was started */
+    uint32_t (*time)(void);                                                 /**< Current time in any unit, only used for stats (can be NULL) */
+    void     (*critical_enter)(void);                                       /**< Keeps the TWI interrupt out while the queue is being changed */
+    void     (*critical_exit)(void);
+};
+
+struct twi_queue_stats_s
+{
+    uint32_t transfers;                                                     /**< Transfers that have completed */
+    uint32_t errors;                                                        /**< Transfers that completed with an error */
+    uint32_t rejected;                                                      /**< Transfers that couldn't be queued because the queue was full */
+    uint16_t depth;                                                         /**< Transfers currently waiting or in progress */
+    uint16_t max_depth;
+    uint32_t total_latency;                                                 /**< Sum of the time from queueing to completion */
+    uint32_t max_latency;
+};
+
+//Init methods
+void twi_queue_init(twi_queue_backend_t const* backend);
+
+//Queueing methods
+int32_t twi_queue_read(uint8_t bus, uint8_t address, uint8_t reg, uint8_t* p_data, uint16_t length,
+                       twi_transfer_callback_t callback, void* p_context, twi_transfer_group_t* p_group);
+int32_t twi_queue_write(uint8_t bus, uint8_t address, uint8_t reg, const uint8_t* p_data, uint16_t length,
+                        twi_transfer_callback_t callback, void* p_context, twi_transfer_group_t* p_group);
+int32_t twi_queue_write_burst(uint8_t bus, uint8_t address, const uint8_t* p_buffer, uint16_t length,
+                              twi_transfer_callback_t callback, void* p_context, twi_transfer_group_t* p_group);
+
+//Group methods
+void twi_group_begin(twi_transfer_group_t* p_group, twi_transfer_callback_t callback, void* p_context);
+void twi_group_end(twi_transfer_group_t* p_group);
+
+//Event methods
+void twi_queue_transfer_complete(uint8_t bus, int32_t result);
+
+//Get methods
+bool twi_queue_idle(uint8_t bus);
+void twi_queue_get_stats(uint8_t bus, twi_queue_stats_t* p_stats);
+void twi_queue_reset_stats(uint8_t bus);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PC_TWI_QUEUE_H__
@@ -0,0 +1,346 @@
+#include "sample_packing.h"
+
+#include <math.h>
+#include <stddef.h>
+
+#define SAMPLE_PACKING_AXIS_HEADER_BITS (16 + SAMPLE_PACKING_WIDTH_BITS)
+#define SAMPLE_PACKING_QUATERNION_SCALE (32767.0f * 1.41421356f) //the three smallest components all fit in +/- 1/sqrt(2)
+
+//Bit stream helpers, bits are added starting with the lowest bit of each byte
+typedef struct
+{
+    uint8_t* pBuff;
+    uint16_t position;
+    uint32_t accumulator;
+    uint8_t  bits;
+} bit_writer_t;
+
+typedef struct
+{
+    const uint8_t* pBuff;
+    uint16_t position;
+    uint16_t length;
+    uint64_t accumulator;
+    uint8_t  bits;
+} bit_reader_t;
+
+static void write_bits(bit_writer_t* writer, uint32_t value, uint8_t bits)
+{
+    //At most 21 bits get written at a time so the accumulator never overflows
+    writer->accumulator |= value << writer->bits;
+    writer->bits += bits;
+    while (writer->bits >= 8)
+    {
+        writer->pBuff[writer->position++] = writer->accumulator & 0xFF;
+        writer->accumulator >>= 8;
+        writer->bits -= 8;
+    }
+}
+
+static void flush_bits(bit_writer_t* writer)
+{
+    if (writer->bits > 0) writer->pBuff[writer->position++] = writer->accumulator & 0xFF;
+    writer->accumulator = 0;
+    writer->bits = 0;
+}
+
+static uint32_t read_bits(bit_reader_t* reader, uint8_t bits)
+{
+    //Refill a byte at a time, reads past the end of the buffer give 0s (the caller already
+    //checked that the buffer is long enough for every bit it's going to read)
+    while (reader->bits < bits)
+    {
+        uint64_t next = (reader->position < reader->length) ? reader->pBuff[reader->position] : 0;
+        reader->position++;
+        reader->accumulator |= next << reader->bits;
+        reader->bits += 8;
+    }
+
+    uint32_t value = (uint32_t)(reader->accumulator & ((1u << bits) - 1));
+    reader->accumulator >>= bits;
+    reader->bits -= bits;
+    return value;
+}
+
+static int16_t read_reading(const uint8_t* samples, uint8_t sample, uint8_t axis)
+{
+    const uint8_t* reading = samples + sample * SAMPLE_PACKING_SAMPLE_SIZE + 2 * axis;
+    return (int16_t)((uint16_t)reading[0] | ((uint16_t)reading[1] << 8));
+}
+
+static uint16_t zigzag_difference(int16_t previous, int16_t current)
+{
+    //The difference wraps around in 16 bits, which the decoder undoes by adding it back with the
+    //same wrap around. Zigzag encoding then turns small negative differences into small numbers.
+    uint16_t difference = (uint16_t)((uint16_t)current - (uint16_t)previous);
+    return (uint16_t)((difference << 1) ^ (0u - (difference >> 15)));
+}
+
+static int16_t unzigzag(int16_t previous, uint16_t value)
+{
+    uint16_t difference = (uint16_t)((value >> 1) ^ (0u - (value & 1)));
+    return (int16_t)(uint16_t)((uint16_t)previous + difference);
+}
+
+static uint8_t bit_width(uint16_t value)
+{
+    uint8_t width = 0;
+    while (value)
+    {
+        width++;
+        value >>= 1;
+    }
+    return width;
+}
+
+static uint32_t packed_bits(uint8_t count, uint16_t total_width)
+{
+    if (count == 0) return 0;
+    return SAMPLE_PACKING_AXES * SAMPLE_PACKING_AXIS_HEADER_BITS + (uint32_t)(count - 1) * total_width;
+}
+
+uint16_t sample_packing_packed_size(const uint8_t* samples, uint8_t count)
+{
+    //Size (in bytes) that all of the given raw samples would take up once packed
+    uint16_t total_width = 0;
+    for (int axis = 0; axis < SAMPLE_PACKING_AXES; axis++)
+    {
+        uint16_t largest = 0;
+        for (int i = 1; i < count; i++)
+        {
+            uint16_t value = zigzag_difference(read_reading(samples, i - 1, axis), read_reading(samples, i, axis));
+            if (value > largest) largest = value;
+        }
+        total_width += bit_width(largest);
+    }
+
+    return (uint16_t)((packed_bits(count, total_width) + 7) / 8);
+}
+
+uint8_t sample_packing_encode(const uint8_t* samples, uint8_t count, uint8_t encoding, uint8_t* pBuff, uint16_t capacity, uint16_t* length, bool* packed)
+{
+    //Puts as many of the given raw samples as possible into pBuff (which holds capacity bytes) and
+    //returns how many made it. Any samples that don't fit need to go out in the next notification.
+    //When packing is allowed both encodings are looked at, and whichever one fits more samples (or
+    //the same number of samples in fewer bytes) gets used.
+    if (count > SAMPLE_PACKING_MAX_SAMPLES) count = SAMPLE_PACKING_MAX_SAMPLES;
+
+    uint8_t raw_count = (uint8_t)((capacity / SAMPLE_PACKING_SAMPLE_SIZE < count) ? capacity / SAMPLE_PACKING_SAMPLE_SIZE : count);
+    uint8_t packed_count = 0;
+    uint8_t widths[SAMPLE_PACKING_AXES] = { 0 };
+
+    if (encoding == SAMPLE_ENCODING_PACKED)
+    {
+        //The difference width of each axis can only grow as samples are added, so keep adding
+        //samples until the packed size goes over the capacity
+        uint8_t next_widths[SAMPLE_PACKING_AXES] = { 0 };
+        uint16_t total_width = 0;
+        for (uint8_t i = 0; i < count; i++)
+        {
+            uint16_t next_total_width = 0;
+            for (int axis = 0; axis < SAMPLE_PACKING_AXES; axis++)
+            {
+                if (i > 0)
+                {
+                    uint8_t width = bit_width(zigzag_difference(read_reading(samples, i - 1, axis), read_reading(samples, i, axis)));
+                    if (width > next_widths[axis]) next_widths[axis] = width;
+                }
+                next_total_width += next_widths[axis];
+            }
+
+            if ((packed_bits(i + 1, next_total_width) + 7) / 8 > capacity) break;
+            for (int axis = 0; axis < SAMPLE_PACKING_AXES; axis++) widths[axis] = next_widths[axis];
+            total_width = next_total_width;
+            packed_count = i + 1;
+        }
+
+        uint16_t packed_length = (uint16_t)((packed_bits(packed_count, total_width) + 7) / 8);
+        if (packed_count > raw_count || (packed_count == raw_count && packed_count > 0 && packed_length < raw_count * SAMPLE_PACKING_SAMPLE_SIZE))
+        {
+            bit_writer_t writer = { pBuff, 0, 0, 0 };
+            for (int axis = 0; axis < SAMPLE_PACKING_AXES; axis++)
+            {
+                int16_t previous = read_reading(samples, 0, axis);
+                write_bits(&writer, (uint16_t)previous, 16);
+                write_bits(&writer, widths[axis], SAMPLE_PACKING_WIDTH_BITS);
+                if (widths[axis] == 0) continue;
+
+                for (uint8_t i = 1; i < packed_count; i++)
+                {
+                    int16_t current = read_reading(samples, i, axis);
+                    write_bits(&writer, zigzag_difference(previous, current), widths[axis]);
+                    previous = current;
+                }
+            }
+            flush_bits(&writer);
+
+            *length = writer.position;
+            *packed = true;
+            return packed_count;
+        }
+    }
+
+    for (uint16_t i = 0; i < raw_count * SAMPLE_PACKING_SAMPLE_SIZE; i++) pBuff[i] = samples[i];
+    *length = raw_count * SAMPLE_PACKING_SAMPLE_SIZE;
+    *packed = false;
+    return raw_count;
+}
+
+int sample_packing_decode(const uint8_t* pBuff, uint16_t length, uint8_t count, bool packed, int16_t* readings, uint16_t stride)
+{
+    //Turns the samples of a notification (everything after the header) back into readings. Each
+    //axis is written to its own row of the readings array, with stride readings between rows, so
+    //the reading for sample i of axis a ends up at readings[a * stride + i]. Returns the number of
+    //samples decoded or -1 if the buffer is too short to hold them.
+    if (count > SAMPLE_PACKING_MAX_SAMPLES || count > stride) return -1;
+    if (count == 0) return 0;
+
+    if (!packed)
+    {
+        if (length < count * SAMPLE_PACKING_SAMPLE_SIZE) return -1;
+        for (uint8_t i = 0; i < count; i++)
+        {
+            for (int axis = 0; axis < SAMPLE_PACKING_AXES; axis++) readings[axis * stride + i] = read_reading(pBuff, i, axis);
+        }
+        return count;
+    }
+
+    //Every axis header has to fit before any of the widths can be trusted, after that make sure
+    //the differences fit too so the bit reader never needs to go past the end of the buffer
+    uint32_t available_bits = (uint32_t)length * 8;
+    if (available_bits < SAMPLE_PACKING_AXES * SAMPLE_PACKING_AXIS_HEADER_BITS) return -1;
+
+    bit_reader_t reader = { pBuff, 0, length, 0, 0 };
+    uint32_t used_bits = 0;
+    for (int axis = 0; axis < SAMPLE_PACKING_AXES; axis++)
+    {
+        int16_t* row = readings + axis * stride;
+        row[0] = (int16_t)(uint16_t)read_bits(&reader, 16);
+        uint8_t width = (uint8_t)read_bits(&reader, SAMPLE_PACKING_WIDTH_BITS);
+        if (width > 16) return -1;
+
+        used_bits += SAMPLE_PACKING_AXIS_HEADER_BITS + (uint32_t)(count - 1) * width;
+        if (used_bits > available_bits) return -1;
+
+        if (width == 0)
+        {
+            for (uint8_t i = 1; i < count; i++) row[i] = row[0];
+            continue;
+        }
+        for (uint8_t i = 1; i < count; i++) row[i] = unzigzag(row[i - 1], (uint16_t)read_bits(&reader, width));
+    }
+
+    return count;
+}
+
+static void write_int16(uint8_t* pBuff, int32_t value)
+{
+    //Clamps to the int16 range and adds the value in little endian order
+    if (value > 32767) value = 32767;
+    else if (value < -32768) value = -32768;
+    pBuff[0] = (uint8_t)((uint16_t)value & 0xFF);
+    pBuff[1] = (uint8_t)((uint16_t)value >> 8);
+}
+
+static int32_t round_to_int(float value)
+{
+    return (int32_t)floorf(value + 0.5f);
+}
+
+static void quaternion_encode(const float* quaternion, uint8_t* pBuff)
+{
+    //q and -q are the same rotation, so flip the quaternion if needed to make the largest component positive.
+    //That component then doesn't need to be sent, it's whatever makes the length of the quaternion 1.
+    uint8_t largest = 0;
+    for (uint8_t component = 1; component < 4; component++)
+    {
+        if (fabsf(quaternion[component]) > fabsf(quaternion[largest])) largest = component;
+    }
+    float sign = (quaternion[largest] < 0.0f) ? -1.0f : 1.0f;
+
+    uint8_t slot = 0;
+    for (uint8_t component = 0; component < 4; component++)
+    {
+        if (component == largest) continue;
+
+        int32_t value = round_to_int(sign * quaternion[component] * SAMPLE_PACKING_QUATERNION_SCALE);
+        if (value > 32767) value = 32767;
+        else if (value < -32767) value = -32767;
+        if (slot < 2) value = (value & ~1) | ((largest >> slot) & 1);
+
+        write_int16(pBuff + 2 * slot, value);
+        slot++;
+    }
+}
+
+static void quaternion_decode(const uint8_t* pBuff, float* quaternion)
+{
+    int16_t values[3];
+    for (int slot = 0; slot < 3; slot++) values[slot] = (int16_t)((uint16_t)pBuff[2 * slot] | ((uint16_t)pBuff[2 * slot + 1] << 8));
+    uint8_t largest = (uint8_t)((values[0] & 1) | ((values[1] & 1) << 1));
+
+    float sum = 0.0f;
+    uint8_t slot = 0;
+    for (uint8_t component = 0; component < 4; component++)
+    {
+        if (component == largest) continue;
+        quaternion[component] = values[slot++] / SAMPLE_PACKING_QUATERNION_SCALE;
+        sum += quaternion[component] * quaternion[component];
+    }
+    quaternion[largest] = (sum < 1.0f) ? sqrtf(1.0f - sum) : 0.0f;
+}
+
+uint8_t sample_packing_encode_fused(const float* quaternions, const float* linear_acceleration, uint8_t count, uint8_t* pBuff, uint16_t capacity, uint16_t* length)
+{
+    //Puts as many fused samples as will fit into pBuff and returns how many made it. The quaternion for
+    //sample i is quaternions[4 * i] to quaternions[4 * i + 3] (w, x, y, z), and when linear_acceleration
+    //isn't NULL its x, y and z (in g) for sample i are at linear_acceleration[3 * i].
+    uint16_t sample_size = SAMPLE_PACKING_QUATERNION_SIZE + ((linear_acceleration != NULL) ? SAMPLE_PACKING_LINEAR_SIZE : 0);
+    if (count > SAMPLE_PACKING_MAX_SAMPLES) count = SAMPLE_PACKING_MAX_SAMPLES;
+    if (count > capacity / sample_size) count = (uint8_t)(capacity / sample_size);
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        uint8_t* sample = pBuff + i * sample_size;
+        quaternion_encode(quaternions + 4 * i, sample);
+        if (linear_acceleration == NULL) continue;
+
+        for (int axis = 0; axis < 3; axis++)
+        {
+            write_int16(sample + SAMPLE_PACKING_QUATERNION_SIZE + 2 * axis, round_to_int(linear_acceleration[3 * i + axis] / SAMPLE_PACKING_LINEAR_LSB));
+        }
+    }
+
+    *length = count * sample_size;
+    return count;
+}
+
+int sample_packing_decode_fused(const uint8_t* pBuff, uint16_t length, uint8_t count, float* quaternions, float* linear_acceleration, bool* has_linear)
+{
+    //Turns the fused samples of a notification back into quaternions (laid out the same way as for
+    //sample_packing_encode_fused()) and, if it was sent and linear_acceleration isn't NULL, linear
+    //acceleration in g. Returns the number of samples decoded or -1 if the buffer is too short.
+    *has_linear = false;
+    if (count > SAMPLE_PACKING_MAX_SAMPLES) return -1;
+    if (count == 0) return 0;
+
+    uint16_t sample_size = SAMPLE_PACKING_QUATERNION_SIZE;
+    if (length >= count * (SAMPLE_PACKING_QUATERNION_SIZE + SAMPLE_PACKING_LINEAR_SIZE)) sample_size += SAMPLE_PACKING_LINEAR_SIZE;
+    else if (length < count * SAMPLE_PACKING_QUATERNION_SIZE) return -1;
+    *has_linear = (sample_size > SAMPLE_PACKING_QUATERNION_SIZE);
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        const uint8_t* sample = pBuff + i * sample_size;
+        quaternion_decode(sample, quaternions + 4 * i);
+        if (!*has_linear || linear_acceleration == NULL) continue;
+
+        for (int axis = 0; axis < 3; axis++)
+        {
+            const uint8_t* reading = sample + SAMPLE_PACKING_QUATERNION_SIZE + 2 * axis;
+            linear_acceleration[3 * i + axis] = (int16_t)((uint16_t)reading[0] | ((uint16_t)reading[1] << 8)) * SAMPLE_PACKING_LINEAR_LSB;
+        }
+    }
+
+    return count;
+}
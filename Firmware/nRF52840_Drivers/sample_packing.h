@@ -0,0 +1,78 @@
+#ifndef SAMPLE_PACKING_H__
+#define SAMPLE_PACKING_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+The sample_packing files handle the optional compressed encoding of the samples in the
+composite data characteristic. Consecutive IMU readings are very close to each other, so
+instead of sending every reading as a full int16 each axis is sent as its first reading
+followed by the (zigzag encoded) differences between readings, using only as many bits
+as the largest difference in the notification needs. When the differences are too large
+for this to save anything the samples are sent raw, the same as before.
+
+The packed samples are a single little endian bit stream that starts right after the
+header of the characteristic. Every axis (acc x, y, z, gyr x, y, z, mag x, y, z) gets:
+
+    16 bits  first reading
+     5 bits  bit width of the differences (0 - 16)
+  followed by the differences for the rest of the samples, one axis after the other.
+
+The high bit of the sample count byte in the header is set when the samples are packed.
+The sample count itself never goes above MAX_SENSOR_SAMPLES so the bit is otherwise unused.
+
+With the fused encodings the Personal Caddie runs the AHRS itself (see device_fusion.h)
+and sends orientation instead of readings, and the next bit of the sample count byte is
+set instead. Each fused sample is a quaternion in "smallest three" form: the largest
+component is dropped (it's made positive, so it can be rebuilt from the other three) and
+the other three, which can't be larger than 1/sqrt(2), are sent as int16s scaled to use
+the full range. The lowest bit of the first two int16s holds the index of the dropped
+component. With SAMPLE_ENCODING_FUSED_LINEAR each quaternion is followed by the linear
+acceleration as three int16s in mg, so the size of the samples (6 or 12 bytes) says
+whether it's there or not.
+
+Nothing in here depends on the nRF SDK. The Personal Caddie uses these files to encode
+data and the front end uses the exact same files to decode it.
+*/
+
+#define SAMPLE_PACKING_AXES           9                                   /**< acc, gyr and mag readings in each sample */
+#define SAMPLE_PACKING_SAMPLE_SIZE    (2 * SAMPLE_PACKING_AXES)           /**< Size (in bytes) of a single raw sample */
+#define SAMPLE_PACKING_MAX_SAMPLES    39                                  /**< Most samples in a single notification (matches MAX_SENSOR_SAMPLES in ble_sensor_service.h) */
+#define SAMPLE_PACKING_WIDTH_BITS     5                                   /**< Bits used to hold the difference width of each axis */
+#define SAMPLE_PACKING_PACKED_FLAG    0x80                                /**< Set in the sample count byte of the header when the samples are packed */
+#define SAMPLE_PACKING_FUSED_FLAG     0x40                                /**< Set in the sample count byte of the header when the samples are fused orientations */
+#define SAMPLE_PACKING_COUNT_MASK     0x3F                                /**< The rest of the sample count byte */
+#define SAMPLE_PACKING_QUATERNION_SIZE 6                                  /**< Size (in bytes) of a fused quaternion */
+#define SAMPLE_PACKING_LINEAR_SIZE    6                                   /**< Size (in bytes) of the linear acceleration that can follow a fused quaternion */
+#define SAMPLE_PACKING_LINEAR_LSB     0.001f                              /**< Linear acceleration is sent in mg, which covers +/- 32 g */
+
+//How the samples in the composite data characteristic are encoded. This is negotiated through
+//the DATA_ENCODING byte of the settings characteristic.
+typedef enum
+{
+    SAMPLE_ENCODING_RAW    = 0,                                           /**< Every sample is 9 little endian int16 readings */
+    SAMPLE_ENCODING_PACKED = 1,                                           /**< Delta + zigzag + bit packing, with a raw fallback */
+    SAMPLE_ENCODING_FUSED  = 2,                                           /**< Orientation quaternions from the AHRS on the Personal Caddie */
+    SAMPLE_ENCODING_FUSED_LINEAR = 3,                                     /**< Orientation quaternions followed by linear acceleration */
+    SAMPLE_ENCODING_END    = 4
+} sample_encoding_t;
+
+//Encoding Methods
+uint16_t sample_packing_packed_size(const uint8_t* samples, uint8_t count);
+uint8_t sample_packing_encode(const uint8_t* samples, uint8_t count, uint8_t encoding, uint8_t* pBuff, uint16_t capacity, uint16_t* length, bool* packed);
+uint8_t sample_packing_encode_fused(const float* quaternions, const float* linear_acceleration, uint8_t count, uint8_t* pBuff, uint16_t capacity, uint16_t* length);
+
+//Decoding Methods
+int sample_packing_decode(const uint8_t* pBuff, uint16_t length, uint8_t count, bool packed, int16_t* readings, uint16_t stride);
+int sample_packing_decode_fused(const uint8_t* pBuff, uint16_t length, uint8_t count, float* quaternions, float* linear_acceleration, bool* has_linear);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SAMPLE_PACKING_H__
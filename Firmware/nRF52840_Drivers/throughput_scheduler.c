@@ -0,0 +1,281 @@
+#include "throughput_scheduler.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#define THROUGHPUT_PACKET_OVERHEAD   14                                           /**< Preamble, access address, header, MIC and CRC of every radio packet */
+#define THROUGHPUT_EMPTY_PACKET      10                                           /**< The central's answer to each packet, no payload */
+#define THROUGHPUT_IFS_US            150                                          /**< Gap between packets */
+#define THROUGHPUT_L2CAP_ATT_HEADER  7                                            /**< 4 byte L2CAP header and 3 byte ATT notification header */
+#define THROUGHPUT_EVENT_GUARD_US    1250                                         /**< Time at the end of each interval that can't be used */
+
+static float packet_time_us(const throughput_link_t* link)
+{
+    //Air time of a full packet, the empty packet the central answers with and the gaps between them
+    float phy = (link->phy_mbps == 2) ? 2.0f : 1.0f;
+    return (link->data_length + THROUGHPUT_PACKET_OVERHEAD) * 8.0f / phy + THROUGHPUT_EMPTY_PACKET * 8.0f / phy + 2.0f * THROUGHPUT_IFS_US;
+}
+
+static uint16_t notification_payload(const throughput_link_t* link)
+{
+    //Sample bytes that fit into a single notification
+    uint16_t size = link->max_notification;
+    if (link->att_mtu > 3 && size > link->att_mtu - 3) size = link->att_mtu - 3;
+    return (size > link->header_size) ? size - link->header_size : 1;
+}
+
+static float data_sets_per_event(const throughput_link_t* link, uint8_t samples)
+{
+    return link->odr * link->interval_us / 1000000.0f / samples;
+}
+
+static float notifications_per_data_set(const throughput_link_t* link, uint8_t samples, float sample_size)
+{
+    float bytes = samples * sample_size;
+    uint16_t payload = notification_payload(link);
+    uint16_t notifications = (uint16_t)(bytes / payload);
+    if (bytes > notifications * payload) notifications++;
+    return (notifications > 0) ? notifications : 1;
+}
+
+float throughput_model_packets_per_event(const throughput_link_t* link)
+{
+    //Radio packets that fit into a single connection event. With connection event extension on the
+    //event can keep going until the next one is about to start.
+    uint32_t event_us = link->event_length_us;
+    if (event_us == 0 || event_us > link->interval_us) event_us = (link->interval_us > THROUGHPUT_EVENT_GUARD_US) ? link->interval_us - THROUGHPUT_EVENT_GUARD_US : link->interval_us;
+
+    float packets = (float)(uint32_t)(event_us / packet_time_us(link));
+    if (link->max_packets_per_event > 0 && packets > link->max_packets_per_event) packets = link->max_packets_per_event;
+    return (packets < 1.0f) ? 1.0f : packets;
+}
+
+float throughput_model_packets_per_data_set(const throughput_link_t* link, uint8_t samples, float sample_size)
+{
+    //Each notification gets the header, the ATT and L2CAP headers are added on, and the whole thing
+    //is split into as many packets as it takes. Only the last notification of a data set can be short.
+    uint16_t data_length = (link->data_length > 0) ? link->data_length : 27;
+    float notifications = notifications_per_data_set(link, samples, sample_size);
+    float bytes = samples * sample_size + notifications * (link->header_size + THROUGHPUT_L2CAP_ATT_HEADER);
+    float per_notification = bytes / notifications;
+
+    uint16_t packets = (uint16_t)(per_notification / data_length);
+    if (per_notification > packets * data_length) packets++;
+    return notifications * packets;
+}
+
+bool throughput_model_fits(const throughput_link_t* link, uint8_t samples, float sample_size, float packets_per_event)
+{
+    //Data sets of this size fit if they take up no more than the planned share of the link and don't
+    //need more than a quarter of the notification queue in a single connection event (the rest of the
+    //queue is left for swing bursts and for connection events the central skips)
+    if (samples == 0 || link->interval_us == 0) return false;
+
+    float sets = data_sets_per_event(link, samples);
+    if (sets * throughput_model_packets_per_data_set(link, samples, sample_size) > THROUGHPUT_SCHEDULER_UTILIZATION * packets_per_event) return false;
+    return sets * notifications_per_data_set(link, samples, sample_size) <= link->queue_size / 4.0f;
+}
+
+uint8_t throughput_model_samples(const throughput_link_t* link, float sample_size, float packets_per_event)
+{
+    //The smallest data set the link can carry, or the biggest one there is if none of them fit
+    for (uint8_t samples = 1; samples < link->max_samples; samples++)
+    {
+        if (throughput_model_fits(link, samples, sample_size, packets_per_event)) return samples;
+    }
+    return (link->max_samples > 0) ? link->max_samples : 1;
+}
+
+void throughput_model_preferred_interval(const throughput_link_t* link, uint16_t* min_interval_ms, uint16_t* max_interval_ms)
+{
+    //The connection interval to ask the central for. A sample can't get sent any sooner than the next
+    //connection event so the shortest interval that fits the stream is the best one, assuming the
+    //central only lets a few packets through in each event (it can always give us more).
+    throughput_link_t candidate = *link;
+    if (candidate.max_packets_per_event == 0 || candidate.max_packets_per_event > THROUGHPUT_SCHEDULER_ASSUMED_PACKETS) candidate.max_packets_per_event = THROUGHPUT_SCHEDULER_ASSUMED_PACKETS;
+
+    uint16_t interval = THROUGHPUT_SCHEDULER_MIN_INTERVAL_MS;
+    for (; interval < THROUGHPUT_SCHEDULER_MAX_INTERVAL_MS; interval += THROUGHPUT_SCHEDULER_MIN_INTERVAL_MS)
+    {
+        candidate.interval_us = 1000 * (uint32_t)interval;
+        float packets = throughput_model_packets_per_event(&candidate);
+        if (throughput_model_fits(&candidate, throughput_model_samples(&candidate, candidate.sample_size, packets), candidate.sample_size, packets)) break;
+    }
+
+    *min_interval_ms = interval;
+    *max_interval_ms = interval + THROUGHPUT_SCHEDULER_MIN_INTERVAL_MS;
+}
+
+static float starting_capacity(const throughput_link_t* link)
+{
+    //Until the link has been watched for a while the central is assumed to be stingy, the same way
+    //it is when picking a connection interval
+    float packets = throughput_model_packets_per_event(link);
+    if (link->max_packets_per_event == 0 && packets > THROUGHPUT_SCHEDULER_ASSUMED_PACKETS) packets = THROUGHPUT_SCHEDULER_ASSUMED_PACKETS;
+    return packets;
+}
+
+static void window_start(throughput_scheduler_t* scheduler, uint32_t time_stamp, uint32_t completed)
+{
+    scheduler->window_open = true;
+    scheduler->window_start = time_stamp;
+    scheduler->last_completed = completed;
+    scheduler->window_queued = 0;
+    scheduler->window_dropped = 0;
+    scheduler->window_depth = 0;
+    scheduler->window_bytes = 0;
+    scheduler->window_samples = 0;
+}
+
+static void samples_set(throughput_scheduler_t* scheduler, int samples)
+{
+    if (samples > scheduler->link.max_samples) samples = scheduler->link.max_samples;
+    if (samples < 1) samples = 1;
+    if (samples == scheduler->samples) return;
+
+    scheduler->samples = (uint8_t)samples;
+    scheduler->adjustments++;
+}
+
+void throughput_scheduler_init(throughput_scheduler_t* scheduler, const throughput_link_t* link)
+{
+    memset(scheduler, 0, sizeof(throughput_scheduler_t));
+    scheduler->link = *link;
+    scheduler->model_capacity = throughput_model_packets_per_event(link);
+    scheduler->capacity = starting_capacity(link);
+    scheduler->sample_size = link->sample_size;
+    scheduler->samples = throughput_model_samples(link, scheduler->sample_size, scheduler->capacity);
+}
+
+bool throughput_scheduler_link_set(throughput_scheduler_t* scheduler, const throughput_link_t* link)
+{
+    //Called whenever something about the link or the live stream changes (and each time a stream
+    //starts). The model's data set size takes over again, but what's been measured about the link is
+    //only thrown away if the link itself changed. Returns true if the data set size changed.
+    bool link_changed = scheduler->link.interval_us != link->interval_us || scheduler->link.att_mtu != link->att_mtu ||
+        scheduler->link.data_length != link->data_length || scheduler->link.phy_mbps != link->phy_mbps;
+    bool encoding_changed = scheduler->link.sample_size != link->sample_size || scheduler->link.max_samples != link->max_samples;
+
+    scheduler->link = *link;
+    scheduler->model_capacity = throughput_model_packets_per_event(link);
+    if (link_changed)
+    {
+        scheduler->capacity = starting_capacity(link);
+        scheduler->ceiling = 0.0f;
+    }
+    if (encoding_changed) scheduler->sample_size = link->sample_size;
+    scheduler->hold = 0;
+    scheduler->floor = 0;
+    scheduler->window_open = false;
+
+    uint8_t samples = scheduler->samples;
+    samples_set(scheduler, throughput_model_samples(link, scheduler->sample_size, scheduler->capacity));
+    return samples != scheduler->samples;
+}
+
+void throughput_scheduler_queued(throughput_scheduler_t* scheduler, uint8_t queue_depth, uint16_t length, uint8_t samples)
+{
+    //Called every time a live notification makes it into the queue, queue_depth being the number of
+    //notifications that were already waiting
+    scheduler->window_queued++;
+    scheduler->window_depth += queue_depth;
+    if (length > scheduler->link.header_size) scheduler->window_bytes += length - scheduler->link.header_size;
+    scheduler->window_samples += samples;
+}
+
+void throughput_scheduler_dropped(throughput_scheduler_t* scheduler)
+{
+    //Called when a live notification couldn't be queued
+    scheduler->window_dropped++;
+    scheduler->drops++;
+}
+
+bool throughput_scheduler_update(throughput_scheduler_t* scheduler, uint32_t time_stamp, uint32_t completed)
+{
+    //Called after every data set with the current time and the total number of notifications the
+    //SoftDevice has finished sending. Returns true when the data set size changes.
+    if (scheduler->link.interval_us == 0) return false;
+    if (!scheduler->window_open)
+    {
+        window_start(scheduler, time_stamp, completed);
+        return false;
+    }
+
+    uint32_t interval_ticks = (uint32_t)((uint64_t)scheduler->link.interval_us * THROUGHPUT_SCHEDULER_TICK_FREQUENCY / 1000000);
+    uint32_t elapsed = time_stamp - scheduler->window_start;
+    if (elapsed < THROUGHPUT_SCHEDULER_WINDOW_EVENTS * interval_ticks) return false;
+    if (scheduler->window_queued == 0 && scheduler->window_dropped == 0)
+    {
+        window_start(scheduler, time_stamp, completed);
+        return false;
+    }
+
+    //How big the samples in the current encoding really are (packed samples change size with the data)
+    if (scheduler->window_samples > 0)
+    {
+        float measured_size = (float)scheduler->window_bytes / scheduler->window_samples;
+        scheduler->sample_size += THROUGHPUT_SCHEDULER_CAPACITY_GAIN * (measured_size - scheduler->sample_size);
+    }
+
+    //The completed count covers every notification (swing bursts too), the packets they took are
+    //worked out from the size of the live ones. The measurement is only the link's capacity if the
+    //queue was busy the whole time, otherwise it's just how much there was to send.
+    float events = (float)elapsed / interval_ticks;
+    float packets_per_notification = 1.0f;
+    if (scheduler->window_queued > 0)
+    {
+        uint8_t average_samples = (uint8_t)(scheduler->window_samples / scheduler->window_queued);
+        packets_per_notification = throughput_model_packets_per_data_set(&scheduler->link, (average_samples > 0) ? average_samples : 1, scheduler->sample_size);
+    }
+    float measured = (completed - scheduler->last_completed) * packets_per_notification / events;
+
+    //When more than one notification goes in between two connection events they wait for each other
+    //even on a link that keeps up, so that part of the depth doesn't count. What's left is what got
+    //carried over from earlier events.
+    float arrivals = scheduler->window_queued / events;
+    float depth = (scheduler->window_queued > 0) ? (float)scheduler->window_depth / scheduler->window_queued : 0.0f;
+    depth -= (arrivals > 1.0f) ? (arrivals - 1.0f) / 2.0f : 0.0f;
+
+    //A busy link that moved less than expected is believed straight away, and the most a busy link
+    //has ever moved becomes the ceiling. A link that kept up the whole window could probably have
+    //done more, so the estimate creeps up a packet at a time until it reaches the ceiling (or what
+    //the link model says is possible if the link has never been busy).
+    bool busy = depth >= THROUGHPUT_SCHEDULER_TARGET_DEPTH || scheduler->window_dropped > 0;
+    if (busy)
+    {
+        if (scheduler->ceiling == 0.0f || measured > scheduler->ceiling) scheduler->ceiling = measured;
+        if (measured < scheduler->capacity) scheduler->capacity = measured;
+        else scheduler->capacity += THROUGHPUT_SCHEDULER_CAPACITY_GAIN * (measured - scheduler->capacity);
+    }
+    else scheduler->capacity = (measured > scheduler->capacity + 1.0f) ? measured : scheduler->capacity + 1.0f;
+
+    float ceiling = (scheduler->ceiling > 0.0f && scheduler->ceiling < scheduler->model_capacity) ? scheduler->ceiling : scheduler->model_capacity;
+    if (scheduler->capacity > ceiling) scheduler->capacity = ceiling;
+    if (scheduler->capacity < 1.0f) scheduler->capacity = 1.0f;
+
+    uint8_t samples = scheduler->samples;
+    if (scheduler->window_dropped > 0)
+    {
+        samples_set(scheduler, samples + ((samples / 4 > 1) ? samples / 4 : 1));
+        scheduler->hold = THROUGHPUT_SCHEDULER_HOLD_WINDOWS;
+        if (samples > scheduler->floor) scheduler->floor = samples;
+    }
+    else if (depth > THROUGHPUT_SCHEDULER_TARGET_DEPTH + 1.0f)
+    {
+        samples_set(scheduler, samples + 1);
+        if (scheduler->hold < 1) scheduler->hold = 1;
+    }
+    else if (scheduler->hold > 0) scheduler->hold--;
+    else if (depth <= THROUGHPUT_SCHEDULER_TARGET_DEPTH && samples - 1 > scheduler->floor && throughput_model_fits(&scheduler->link, samples - 1, scheduler->sample_size, scheduler->capacity))
+    {
+        samples_set(scheduler, samples - 1);
+    }
+
+    window_start(scheduler, time_stamp, completed);
+    return samples != scheduler->samples;
+}
+
+uint8_t throughput_scheduler_samples(const throughput_scheduler_t* scheduler)
+{
+    return scheduler->samples;
+}
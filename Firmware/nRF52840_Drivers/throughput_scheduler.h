@@ -0,0 +1,116 @@
+#ifndef THROUGHPUT_SCHEDULER_H__
+#define THROUGHPUT_SCHEDULER_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+The throughput_scheduler files pick how many samples go into each data set of the live
+stream, and which connection interval to ask the central for. The fewer samples in a data
+set the sooner its first sample gets sent, but every data set costs a notification, and
+if the link can't keep up the notification queue fills, sd_ble_gatts_hvx() returns
+NRF_ERROR_RESOURCES and whole data sets get dropped.
+
+A link model gives the starting point. Each radio packet carries up to data_length bytes
+and takes a fixed amount of air time (on the PHY in use, plus the empty packet the central
+answers with), so the connection interval says how many packets fit into a single
+connection event. The ATT MTU and the size of the samples in the current encoding then say
+how many packets a data set needs. The smallest data set that keeps the link below
+THROUGHPUT_SCHEDULER_UTILIZATION of its capacity wins.
+
+The model doesn't know how many packets the central actually lets through in each event,
+so it starts out assuming THROUGHPUT_SCHEDULER_ASSUMED_PACKETS and from then on the
+scheduler watches the link. The notifications the SoftDevice finishes (the counts from
+BLE_GATTS_EVT_HVN_TX_COMPLETE) while the queue was busy give the real capacity, a window
+where the queue kept up lets the estimate creep up a packet, and the depth of the queue
+whenever a data set goes in says whether the link is keeping up. Every
+THROUGHPUT_SCHEDULER_WINDOW_EVENTS connection events:
+
+    - a dropped data set makes data sets a quarter bigger, and they stay that way for a
+      few windows (and never go back down to the size that dropped until the link or the
+      stream changes)
+    - a queue that's deeper than the target makes data sets a sample bigger
+    - a queue at (or below) the target makes data sets a sample smaller, as long as the
+      measured capacity says the link can carry the extra notifications
+
+Nothing in here depends on the nRF SDK so the same files get built on a computer, where a
+simulated link is used to sweep ODRs and connection intervals (see
+Replay_Tool/throughput_sweep.cpp).
+*/
+
+#define THROUGHPUT_SCHEDULER_TARGET_DEPTH      1.0f                               /**< Notifications carried over from earlier connection events (on average) when a data set gets queued */
+#define THROUGHPUT_SCHEDULER_UTILIZATION       0.7f                               /**< Most of the link's capacity the live stream is planned to use, the rest is headroom */
+#define THROUGHPUT_SCHEDULER_WINDOW_EVENTS     16                                 /**< Connection events between adjustments */
+#define THROUGHPUT_SCHEDULER_HOLD_WINDOWS      8                                  /**< Windows after a drop before data sets can get smaller again */
+#define THROUGHPUT_SCHEDULER_CAPACITY_GAIN     0.25f                              /**< How quickly the capacity estimate follows what's measured */
+#define THROUGHPUT_SCHEDULER_MIN_INTERVAL_MS   15                                 /**< Shortest connection interval asked for, intervals are multiples of this */
+#define THROUGHPUT_SCHEDULER_MAX_INTERVAL_MS   75
+#define THROUGHPUT_SCHEDULER_ASSUMED_PACKETS   4                                  /**< Packets per connection event the central is assumed to allow until the link has been measured */
+#define THROUGHPUT_SCHEDULER_TICK_FREQUENCY    16000000                           /**< The data timer the time stamps come from */
+
+//Everything about the link and the live stream that the link model needs
+typedef struct
+{
+    float    odr;                                                                 /**< Samples per second going into the live stream */
+    uint32_t interval_us;                                                         /**< Connection interval, 0 before there's a connection */
+    uint16_t att_mtu;                                                             /**< A notification holds at most att_mtu - 3 bytes */
+    uint16_t data_length;                                                         /**< Payload bytes in a single radio packet (27 - 251) */
+    uint8_t  phy_mbps;                                                            /**< 1 or 2 */
+    uint32_t event_length_us;                                                     /**< Radio time in each connection event, 0 when connection event extension lets it use the whole interval */
+    uint8_t  max_packets_per_event;                                               /**< Packets the central allows in a single event, 0 if it isn't known */
+    uint8_t  queue_size;                                                          /**< Notifications the SoftDevice can hold (hvn_tx_queue_size) */
+    uint8_t  max_samples;                                                         /**< Biggest data set the current encoding allows */
+    uint16_t max_notification;                                                    /**< Size of the biggest data characteristic, header included */
+    uint16_t header_size;                                                         /**< Header at the front of every notification */
+    float    sample_size;                                                         /**< Bytes each sample takes up in a notification with the current encoding */
+} throughput_link_t;
+
+//Scheduler state
+typedef struct
+{
+    throughput_link_t link;
+    uint8_t  samples;                                                             /**< Samples per data set right now */
+    float    model_capacity;                                                      /**< Packets per connection event according to the link model */
+    float    capacity;                                                            /**< Packets per connection event, starts out cautious and follows what's measured */
+    float    ceiling;                                                             /**< Most packets per connection event measured while the queue was busy, 0 until it has been */
+    float    sample_size;                                                         /**< Measured bytes per sample, only differs from the link's for packed samples */
+    uint8_t  hold;                                                                /**< Windows left before data sets can get smaller again */
+    uint8_t  floor;                                                               /**< Biggest data set that's been dropped since the link last changed, data sets stay bigger than this */
+
+    bool     window_open;
+    uint32_t window_start;                                                        /**< Time stamp (in timer ticks) the window started at */
+    uint32_t last_completed;                                                      /**< Completed notification count at the start of the window */
+    uint16_t window_queued;                                                       /**< Live notifications queued in the window */
+    uint16_t window_dropped;
+    uint32_t window_depth;                                                        /**< Queue depth summed over every notification queued in the window */
+    uint32_t window_bytes;
+    uint32_t window_samples;
+
+    uint32_t adjustments;                                                         /**< Times the data set size has changed */
+    uint32_t drops;                                                               /**< Data sets dropped since the scheduler started */
+} throughput_scheduler_t;
+
+//Link Model Methods
+float throughput_model_packets_per_event(const throughput_link_t* link);
+float throughput_model_packets_per_data_set(const throughput_link_t* link, uint8_t samples, float sample_size);
+bool throughput_model_fits(const throughput_link_t* link, uint8_t samples, float sample_size, float packets_per_event);
+uint8_t throughput_model_samples(const throughput_link_t* link, float sample_size, float packets_per_event);
+void throughput_model_preferred_interval(const throughput_link_t* link, uint16_t* min_interval_ms, uint16_t* max_interval_ms);
+
+//Scheduler Methods
+void throughput_scheduler_init(throughput_scheduler_t* scheduler, const throughput_link_t* link);
+bool throughput_scheduler_link_set(throughput_scheduler_t* scheduler, const throughput_link_t* link);
+void throughput_scheduler_queued(throughput_scheduler_t* scheduler, uint8_t queue_depth, uint16_t length, uint8_t samples);
+void throughput_scheduler_dropped(throughput_scheduler_t* scheduler);
+bool throughput_scheduler_update(throughput_scheduler_t* scheduler, uint32_t time_stamp, uint32_t completed);
+uint8_t throughput_scheduler_samples(const throughput_scheduler_t* scheduler);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // THROUGHPUT_SCHEDULER_H__
@@ -0,0 +1,357 @@
+#include "ReplayEngine.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <utility>
+
+#include "../DirectXApp/constants.h"
+#include "../DirectXApp/Math/madgwick_batch.h"
+
+namespace
+{
+    const char* stage_names[REPLAY_STAGES] = { "read", "calibration", "fusion", "euler angles", "linear acceleration", "write" };
+
+    typedef std::chrono::steady_clock ReplayClock;
+
+    double secondsSince(ReplayClock::time_point& start)
+    {
+        //Returns the time since start and moves start up to now so consecutive stages can be timed back to back
+        ReplayClock::time_point now = ReplayClock::now();
+        double seconds = std::chrono::duration<double>(now - start).count();
+        start = now;
+        return seconds;
+    }
+}
+
+const char* replayStageName(int stage)
+{
+    return (stage >= 0 && stage < REPLAY_STAGES) ? stage_names[stage] : "";
+}
+
+bool loadReplayCalibration(std::string const& file_location, ReplayCalibration& calibration)
+{
+    //Calibration files hold 3 offsets followed by the 9 gains of the gain matrix (one row at a time). This works with
+    //both the files written by the Sensor class and the ones in Console_Application/Resources/Calibration_Files, which
+    //also have a few lines of text mixed in, by just skipping anything that isn't a number.
+    std::ifstream file(file_location);
+    if (!file.is_open()) return false;
+
+    float numbers[REPLAY_AXES + REPLAY_AXES * REPLAY_AXES];
+    int found = 0;
+    std::string word;
+    while (found < REPLAY_AXES + REPLAY_AXES * REPLAY_AXES && file >> word)
+    {
+        char* end = nullptr;
+        float value = strtof(word.c_str(), &end);
+        if (end != word.c_str() && *end == '\0') numbers[found++] = value;
+    }
+    if (found < REPLAY_AXES + REPLAY_AXES * REPLAY_AXES) return false;
+
+    for (int row = 0; row < REPLAY_AXES; row++)
+    {
+        calibration.offset[row] = numbers[row];
+        for (int column = 0; column < REPLAY_AXES; column++) calibration.gain[row][column] = numbers[REPLAY_AXES + REPLAY_AXES * row + column];
+    }
+
+    return true;
+}
+
+ReplaySettings::ReplaySettings()
+{
+    //Default to no calibration at all
+    for (int sensor = 0; sensor < REPLAY_SENSORS; sensor++)
+    {
+        for (int row = 0; row < REPLAY_AXES; row++)
+        {
+            calibration[sensor].offset[row] = 0.0f;
+            for (int column = 0; column < REPLAY_AXES; column++) calibration[sensor].gain[row][column] = (row == column) ? 1.0f : 0.0f;
+        }
+    }
+}
+
+void ReplayStats::add(ReplayStats const& other)
+{
+    samples += other.samples;
+    recordingSeconds += other.recordingSeconds;
+    for (int stage = 0; stage < REPLAY_STAGES; stage++) stageSeconds[stage] += other.stageSeconds[stage];
+    totalSeconds += other.totalSeconds;
+}
+
+ReplayEngine::ReplayEngine(ReplaySettings const& settings) :
+    m_settings(settings)
+{
+    if (m_settings.blockSize < 1) m_settings.blockSize = 1;
+    if (m_settings.blockSize > REPLAY_MAX_BLOCK_SIZE) m_settings.blockSize = REPLAY_MAX_BLOCK_SIZE;
+
+    const size_t block = (size_t)m_settings.blockSize;
+    m_time.resize(block);
+    m_quaternions.resize(4 * block);
+    for (int axis = 0; axis < REPLAY_AXES; axis++)
+    {
+        for (int sensor = 0; sensor < REPLAY_SENSORS; sensor++) m_data[sensor][axis].resize(block);
+        m_calibrated[axis].resize(block);
+        m_eulerAngles[axis].resize(block);
+        m_linearAcceleration[axis].resize(block);
+    }
+}
+
+bool ReplayEngine::replay(std::string const& file_location, ReplayStats& stats, FILE* output)
+{
+    FILE* file = fopen(file_location.c_str(), "r");
+    if (file == nullptr) return false;
+
+    //Reset the filters so every file starts from the same place
+    m_q[0] = 1.0f;
+    m_q[1] = m_q[2] = m_q[3] = 0.0f;
+    m_odr = m_settings.odr;
+    m_samplesRead = 0;
+    m_lastTimeStamp = 0.0f;
+    m_aligned = !m_settings.alignAttitude;
+    FusionAlignmentReset(&m_alignment);
+
+    if (m_settings.filter == ReplayFilter::FUSION)
+    {
+        //Same settings as the MadgwickTestMode
+        const unsigned int odr = (m_odr > 0.0f) ? (unsigned int)m_odr : 400;
+        FusionOffsetInitialise(&m_offset, odr);
+        FusionAhrsInitialise(&m_ahrs);
+
+        const FusionAhrsSettings fusion_settings = {
+            FusionConventionNwu,
+            m_settings.fusionGain,
+            2000.0f,
+            10.0f,
+            10.0f,
+            5 * odr, /* 5 seconds */
+        };
+        FusionAhrsSetSettings(&m_ahrs, &fusion_settings);
+    }
+
+    stats = ReplayStats();
+    float first_time_stamp = 0.0f;
+
+    ReplayClock::time_point replay_start = ReplayClock::now();
+    ReplayClock::time_point stage_start = replay_start;
+    while (true)
+    {
+        int samples = readBlock(file);
+        stats.stageSeconds[READ_STAGE] += secondsSince(stage_start);
+        if (samples == 0) break;
+
+        if (stats.samples == 0) first_time_stamp = m_time[0];
+
+        calibrate(samples);
+        stats.stageSeconds[CALIBRATION_STAGE] += secondsSince(stage_start);
+
+        fuse(samples);
+        stats.stageSeconds[FUSION_STAGE] += secondsSince(stage_start);
+
+        if (m_settings.eulerAngles)
+        {
+            calculateEulerAngles(samples);
+            stats.stageSeconds[EULER_ANGLE_STAGE] += secondsSince(stage_start);
+        }
+
+        if (m_settings.linearAcceleration)
+        {
+            calculateLinearAcceleration(samples);
+            stats.stageSeconds[LINEAR_ACCELERATION_STAGE] += secondsSince(stage_start);
+        }
+
+        if (output != nullptr)
+        {
+            writeBlock(output, samples);
+            stats.stageSeconds[WRITE_STAGE] += secondsSince(stage_start);
+        }
+
+        stats.samples += samples;
+    }
+    stats.totalSeconds = std::chrono::duration<double>(ReplayClock::now() - replay_start).count();
+
+    if (stats.samples > 0) stats.recordingSeconds = m_lastTimeStamp - first_time_stamp + ((m_odr > 0.0f) ? 1.0f / m_odr : 0.0f);
+
+    fclose(file);
+    return true;
+}
+
+int ReplayEngine::readBlock(FILE* file)
+{
+    //Reads up to a block of samples from the file, lines that don't hold a full sample are skipped
+    char line[512];
+    int samples = 0;
+
+    while (samples < m_settings.blockSize && fgets(line, sizeof(line), file) != nullptr)
+    {
+        float values[REPLAY_COLUMNS];
+        char* position = line;
+        int column = 0;
+        for (; column < REPLAY_COLUMNS; column++)
+        {
+            char* end = nullptr;
+            values[column] = strtof(position, &end);
+            if (end == position) break;
+            position = end;
+        }
+        if (column < REPLAY_COLUMNS) continue;
+
+        m_time[samples] = values[0];
+        for (int axis = 0; axis < REPLAY_AXES; axis++)
+        {
+            m_data[REPLAY_GYR][axis][samples] = values[1 + axis];
+            m_data[REPLAY_ACC][axis][samples] = values[4 + axis];
+            m_data[REPLAY_MAG][axis][samples] = values[7 + axis];
+        }
+        samples++;
+    }
+
+    return samples;
+}
+
+void ReplayEngine::calibrate(int samples)
+{
+    //calibrated = gain * (reading - offset) is done as gain * reading + bias so each output axis is a
+    //simple loop over the block that the compiler can vectorize
+    for (int sensor = 0; sensor < REPLAY_SENSORS; sensor++)
+    {
+        ReplayCalibration const& calibration = m_settings.calibration[sensor];
+        const float* x = m_data[sensor][0].data();
+        const float* y = m_data[sensor][1].data();
+        const float* z = m_data[sensor][2].data();
+
+        for (int row = 0; row < REPLAY_AXES; row++)
+        {
+            const float g0 = calibration.gain[row][0], g1 = calibration.gain[row][1], g2 = calibration.gain[row][2];
+            const float bias = -(g0 * calibration.offset[0] + g1 * calibration.offset[1] + g2 * calibration.offset[2]);
+            float* calibrated = m_calibrated[row].data();
+            for (int i = 0; i < samples; i++) calibrated[i] = g0 * x[i] + g1 * y[i] + g2 * z[i] + bias;
+        }
+
+        for (int axis = 0; axis < REPLAY_AXES; axis++) std::swap(m_data[sensor][axis], m_calibrated[axis]);
+    }
+}
+
+void ReplayEngine::align(int samples)
+{
+    //Same as PersonalCaddie::updateMadgwick(), gravity and the magnetic field averaged over the blocks give the
+    //starting orientation once there are REPLAY_ALIGNMENT_SAMPLES of them. If the sensor was moving too much the
+    //average starts over with the next block.
+    for (int i = 0; i < samples; i++)
+    {
+        FusionVector accelerometer = { m_data[REPLAY_ACC][0][i], m_data[REPLAY_ACC][1][i], m_data[REPLAY_ACC][2][i] };
+        FusionVector magnetometer = { m_data[REPLAY_MAG][0][i], m_data[REPLAY_MAG][1][i], m_data[REPLAY_MAG][2][i] };
+        FusionAlignmentAdd(&m_alignment, accelerometer, magnetometer);
+    }
+    if (FusionAlignmentGetSamples(&m_alignment) < REPLAY_ALIGNMENT_SAMPLES) return;
+
+    FusionQuaternion q;
+    bool aligned = FusionAlignmentQuaternion(&m_alignment, FusionConventionNwu, &q);
+    FusionAlignmentReset(&m_alignment);
+    if (!aligned) return;
+
+    for (int component = 0; component < 4; component++) m_q[component] = q.array[component];
+    if (m_settings.filter == ReplayFilter::FUSION) FusionAhrsSetInitialQuaternion(&m_ahrs, q);
+    m_aligned = true;
+}
+
+void ReplayEngine::fuse(int samples)
+{
+    //If no ODR was given then it comes from the spacing of the first two samples in the file
+    if (m_odr <= 0.0f && samples > 1 && m_time[1] > m_time[0]) m_odr = 1.0f / (m_time[1] - m_time[0]);
+    if (m_odr <= 0.0f) m_odr = 400.0f; //only a single sample in the file, there's nothing to base the rate on
+    if (!m_aligned) align(samples);
+
+    if (m_settings.filter == ReplayFilter::MADGWICK)
+    {
+        //Just like in PersonalCaddie::updateMadgwick(), if there was a gap in the data before this block then the first
+        //sample uses the actual time difference for its rate and the rest of the block uses the ODR
+        int first = 0;
+        if (m_samplesRead > 0)
+        {
+            float gap = m_time[0] - m_lastTimeStamp;
+            if (gap > 1.5f / m_odr)
+            {
+                MadgwickBatchInput input = { m_data[REPLAY_GYR][0].data(), m_data[REPLAY_GYR][1].data(), m_data[REPLAY_GYR][2].data(),
+                    m_data[REPLAY_ACC][0].data(), m_data[REPLAY_ACC][1].data(), m_data[REPLAY_ACC][2].data(),
+                    m_data[REPLAY_MAG][0].data(), m_data[REPLAY_MAG][1].data(), m_data[REPLAY_MAG][2].data() };
+                MadgwickAHRSupdateBatch(m_q, input, 1, 1.0f / gap, m_settings.beta, m_quaternions.data());
+                first = 1;
+            }
+        }
+
+        MadgwickBatchInput input = { m_data[REPLAY_GYR][0].data() + first, m_data[REPLAY_GYR][1].data() + first, m_data[REPLAY_GYR][2].data() + first,
+            m_data[REPLAY_ACC][0].data() + first, m_data[REPLAY_ACC][1].data() + first, m_data[REPLAY_ACC][2].data() + first,
+            m_data[REPLAY_MAG][0].data() + first, m_data[REPLAY_MAG][1].data() + first, m_data[REPLAY_MAG][2].data() + first };
+        MadgwickAHRSupdateBatch(m_q, input, samples - first, m_odr, m_settings.beta, m_quaternions.data() + 4 * first);
+    }
+    else
+    {
+        for (int i = 0; i < samples; i++)
+        {
+            float delta_t = (m_samplesRead + i == 0) ? 1.0f / m_odr : m_time[i] - ((i == 0) ? m_lastTimeStamp : m_time[i - 1]);
+
+            FusionVector gyroscope = { m_data[REPLAY_GYR][0][i], m_data[REPLAY_GYR][1][i], m_data[REPLAY_GYR][2][i] };
+            FusionVector accelerometer = { m_data[REPLAY_ACC][0][i], m_data[REPLAY_ACC][1][i], m_data[REPLAY_ACC][2][i] };
+            FusionVector magnetometer = { m_data[REPLAY_MAG][0][i], m_data[REPLAY_MAG][1][i], m_data[REPLAY_MAG][2][i] };
+
+            gyroscope = FusionOffsetUpdate(&m_offset, gyroscope);
+            FusionAhrsUpdate(&m_ahrs, gyroscope, accelerometer, magnetometer, delta_t);
+
+            FusionQuaternion q = FusionAhrsGetQuaternion(&m_ahrs);
+            for (int component = 0; component < 4; component++) m_quaternions[4 * i + component] = q.array[component];
+        }
+    }
+
+    m_lastTimeStamp = m_time[samples - 1];
+    m_samplesRead += samples;
+}
+
+void ReplayEngine::calculateEulerAngles(int samples)
+{
+    //Same as PersonalCaddie::updateEulerAngles() without the heading offset
+    for (int i = 0; i < samples; i++)
+    {
+        const float* q = &m_quaternions[4 * i];
+        float w = q[0], x = q[1], y = q[2], z = q[3];
+
+        float pitch = 2 * (w * y - x * z);
+        if (pitch > 1) pitch = 1; //clamp to avoid NaN results at +/- 90 degrees
+        else if (pitch < -1) pitch = -1;
+
+        m_eulerAngles[0][i] = atan2f(2 * (w * x + y * z), 1 - 2 * (x * x + y * y));
+        m_eulerAngles[1][i] = asinf(pitch);
+        m_eulerAngles[2][i] = atan2f(2 * (w * z + x * y), 1 - 2 * (y * y + z * z));
+    }
+}
+
+void ReplayEngine::calculateLinearAcceleration(int samples)
+{
+    //Same as PersonalCaddie::updateLinearAcceleration(), remove the gravity vector implied by the orientation from the acceleration
+    const float gravity = (float)GRAVITY;
+    for (int i = 0; i < samples; i++)
+    {
+        const float* q = &m_quaternions[4 * i];
+        float Gx = 2 * gravity * (q[1] * q[3] - q[0] * q[2]);
+        float Gy = 2 * gravity * (q[2] * q[3] + q[0] * q[1]);
+        float Gz = gravity * (q[0] * q[0] - q[1] * q[1] - q[2] * q[2] + q[3] * q[3]);
+
+        m_linearAcceleration[0][i] = m_data[REPLAY_ACC][0][i] - Gx;
+        m_linearAcceleration[1][i] = m_data[REPLAY_ACC][1][i] - Gy;
+        m_linearAcceleration[2][i] = m_data[REPLAY_ACC][2][i] - Gz;
+    }
+}
+
+void ReplayEngine::writeBlock(FILE* output, int samples)
+{
+    //One line per sample in the same whitespace separated style as the data sets:
+    //time    qw    qx    qy    qz    roll    pitch    yaw    lin_x    lin_y    lin_z
+    for (int i = 0; i < samples; i++)
+    {
+        const float* q = &m_quaternions[4 * i];
+        fprintf(output, "%g    %g    %g    %g    %g", m_time[i], q[0], q[1], q[2], q[3]);
+        if (m_settings.eulerAngles) fprintf(output, "    %g    %g    %g", m_eulerAngles[0][i], m_eulerAngles[1][i], m_eulerAngles[2][i]);
+        if (m_settings.linearAcceleration) fprintf(output, "    %g    %g    %g", m_linearAcceleration[0][i], m_linearAcceleration[1][i], m_linearAcceleration[2][i]);
+        fputc('\n', output);
+    }
+}
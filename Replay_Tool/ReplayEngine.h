@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "../DirectXApp/Math/SensorFusion/FusionAhrs.h"
+#include "../DirectXApp/Math/SensorFusion/FusionAlignment.h"
+#include "../DirectXApp/Math/SensorFusion/FusionOffset.h"
+
+//The replay engine reads recorded data sets (the layout used by the files in Console_Application/Resources/Data_Sets)
+//and pushes them through the same processing steps the Personal Caddie class uses for live data. Every line of a data
+//set holds a time stamp followed by the gyroscope (deg/s), accelerometer (m/s^2) and magnetometer readings:
+//
+//    time    gx    gy    gz    ax    ay    az    mx    my    mz
+//
+//Nothing in here depends on Windows so the engine can be built and run from the command line on any platform.
+#define REPLAY_COLUMNS            10
+#define REPLAY_SENSORS            3  //accelerometer, gyroscope and magnetometer in the same order as sensor_type_t
+#define REPLAY_AXES               3
+#define REPLAY_DEFAULT_BLOCK_SIZE 39 //the largest number of samples the Personal Caddie sends in a single BLE packet
+#define REPLAY_MAX_BLOCK_SIZE     4096
+#define REPLAY_ALIGNMENT_SAMPLES  39 //matches ATTITUDE_ALIGNMENT_SAMPLES in PersonalCaddie.h
+
+enum ReplaySensor
+{
+    REPLAY_ACC = 0,
+    REPLAY_GYR,
+    REPLAY_MAG
+};
+
+enum class ReplayFilter
+{
+    MADGWICK, //MadgwickAHRSupdate(), run through the batched kernel in madgwick_batch.h
+    FUSION    //FusionAhrsUpdate() with the gyroscope offset correction, set up the same way as in MadgwickTestMode
+};
+
+//Each block of samples goes through these stages in order, the time spent in each one gets recorded separately
+enum ReplayStage
+{
+    READ_STAGE = 0,
+    CALIBRATION_STAGE,
+    FUSION_STAGE,
+    EULER_ANGLE_STAGE,
+    LINEAR_ACCELERATION_STAGE,
+    WRITE_STAGE,
+    REPLAY_STAGES
+};
+
+const char* replayStageName(int stage);
+
+//Offset and gain calibration for a single sensor, calibrated = gain * (reading - offset)
+struct ReplayCalibration
+{
+    float offset[REPLAY_AXES];
+    float gain[REPLAY_AXES][REPLAY_AXES];
+};
+
+bool loadReplayCalibration(std::string const& file_location, ReplayCalibration& calibration);
+
+struct ReplaySettings
+{
+    ReplayFilter filter = ReplayFilter::MADGWICK;
+    float beta = 0.041f; //the standard Madgwick gain used by the training modes
+    float fusionGain = 0.5f;
+    float odr = 0.0f; //sample rate of the recording in Hz, when left at 0 it's worked out from the first two time stamps
+    int blockSize = REPLAY_DEFAULT_BLOCK_SIZE;
+    bool eulerAngles = true;
+    bool linearAcceleration = true;
+    bool alignAttitude = true; //seed the filter from the first samples like PersonalCaddie::updateMadgwick() instead of starting at no rotation
+    ReplayCalibration calibration[REPLAY_SENSORS];
+
+    ReplaySettings();
+};
+
+struct ReplayStats
+{
+    uint64_t samples = 0;
+    double recordingSeconds = 0.0; //time covered by the time stamps of the recording
+    double stageSeconds[REPLAY_STAGES] = {};
+    double totalSeconds = 0.0; //wall clock time for the whole replay
+
+    void add(ReplayStats const& other);
+    double samplesPerSecond() const { return (totalSeconds > 0.0) ? samples / totalSeconds : 0.0; }
+    double realTimeFactor() const { return (totalSeconds > 0.0) ? recordingSeconds / totalSeconds : 0.0; }
+};
+
+/*
+* Replays a single data set as fast as possible. The file is streamed in blocks of ReplaySettings::blockSize samples
+* so memory use doesn't depend on the length of the recording, and each block is processed the same way a BLE packet
+* is processed by the Personal Caddie class. If an output file is given then the time stamp, orientation quaternion,
+* Euler angles and linear acceleration of every sample get written to it.
+*/
+class ReplayEngine
+{
+public:
+    ReplayEngine(ReplaySettings const& settings);
+
+    bool replay(std::string const& file_location, ReplayStats& stats, FILE* output = nullptr);
+
+private:
+    int readBlock(FILE* file);
+    void calibrate(int samples);
+    void align(int samples);
+    void fuse(int samples);
+    void calculateEulerAngles(int samples);
+    void calculateLinearAcceleration(int samples);
+    void writeBlock(FILE* output, int samples);
+
+    ReplaySettings m_settings;
+
+    //One array per column of the data set (structure of arrays), each one holds a single block. These are
+    //allocated once when the engine is created so nothing gets allocated while a file is being replayed.
+    std::vector<float> m_time;
+    std::vector<float> m_data[REPLAY_SENSORS][REPLAY_AXES];
+    std::vector<float> m_calibrated[REPLAY_AXES]; //scratch space for the calibration stage
+    std::vector<float> m_quaternions; //[w, x, y, z] for each sample
+    std::vector<float> m_eulerAngles[REPLAY_AXES];
+    std::vector<float> m_linearAcceleration[REPLAY_AXES];
+
+    float m_q[4]; //orientation after the last sample of the previous block
+    float m_lastTimeStamp;
+    float m_odr;
+    uint64_t m_samplesRead;
+    bool m_aligned;
+    FusionAlignment m_alignment; //gravity and the magnetic field gathered so far, until there's enough to align with
+
+    FusionAhrs m_ahrs;
+    FusionOffset m_offset;
+};
@@ -0,0 +1,74 @@
+#include "allocation_counter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+    std::atomic<uint64_t> allocations(0);
+
+    void* allocate(size_t size)
+    {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        return malloc(size ? size : 1);
+    }
+
+#ifdef __cpp_aligned_new
+    void* allocateAligned(size_t size, std::align_val_t alignment)
+    {
+        //aligned_alloc() wants the size to be a multiple of the alignment
+        size_t align = static_cast<size_t>(alignment);
+        if (align < sizeof(void*)) align = sizeof(void*);
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        return aligned_alloc(align, ((size ? size : 1) + align - 1) / align * align);
+    }
+#endif
+}
+
+uint64_t allocationCount()
+{
+    return allocations.load(std::memory_order_relaxed);
+}
+
+void* operator new(size_t size)
+{
+    if (void* p = allocate(size)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](size_t size)
+{
+    if (void* p = allocate(size)) return p;
+    throw std::bad_alloc();
+}
+void* operator new(size_t size, std::nothrow_t const&) noexcept { return allocate(size); }
+void* operator new[](size_t size, std::nothrow_t const&) noexcept { return allocate(size); }
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+void operator delete(void* p, std::nothrow_t const&) noexcept { free(p); }
+void operator delete[](void* p, std::nothrow_t const&) noexcept { free(p); }
+
+#ifdef __cpp_aligned_new
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    if (void* p = allocateAligned(size, alignment)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+    if (void* p = allocateAligned(size, alignment)) return p;
+    throw std::bad_alloc();
+}
+void* operator new(size_t size, std::align_val_t alignment, std::nothrow_t const&) noexcept { return allocateAligned(size, alignment); }
+void* operator new[](size_t size, std::align_val_t alignment, std::nothrow_t const&) noexcept { return allocateAligned(size, alignment); }
+
+void operator delete(void* p, std::align_val_t) noexcept { free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { free(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { free(p); }
+void operator delete(void* p, std::align_val_t, std::nothrow_t const&) noexcept { free(p); }
+void operator delete[](void* p, std::align_val_t, std::nothrow_t const&) noexcept { free(p); }
+#endif
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <cstdint>
+
+//allocation_counter.cpp replaces every form of operator new and operator delete (plain and array, sized, nothrow and,
+//when the compiler has them, aligned) with versions that count each allocation. Linking it into a tool is all it takes,
+//allocationCount() then tells how many allocations the program has made so far. The replacements live in their own
+//source file so the compiler can't inline them into the code that calls new and delete.
+uint64_t allocationCount();
@@ -0,0 +1,406 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "../DirectXApp/Math/madgwick_batch.h"
+#include "../DirectXApp/Math/SensorFusion/FusionAhrs.h"
+#include "../DirectXApp/Math/SensorFusion/FusionAlignment.h"
+
+//Measures how long it takes from the first data set of a stream until the orientation can be used, the way the app used
+//to do it and with the initial alignment it does now. Every recorded data set (time, gyroscope, accelerometer and
+//magnetometer columns like the files in Console_Application/Resources/Data_Sets) is cut into data sets the size of a BLE
+//packet and run through each filter twice:
+//
+//  before: the filter starts at no rotation. The Madgwick filter runs with a beta of 2.5 until the convergence check the
+//          GraphMode and FreeSwingMode used to have passes, then drops back to 0.041. The Fusion AHRS runs through its
+//          own initialisation period.
+//  after:  the filter starts at the orientation FusionAlignment finds from the first data sets it can, with its normal gain
+//
+//The error of both is measured against a reference orientation that doesn't depend on either start. The filter runs
+//forwards over the whole recording with a high gain, then backwards (the samples in reverse order with the gyroscope
+//negated) from where it ended up, over and over until the orientation it finishes with at the start of the recording
+//stops changing. That orientation seeds a last forwards run with the normal gain which becomes the reference. See
+//readme.txt for how to build it.
+
+namespace
+{
+    const double PI = 3.14159265358979323846;
+    const float NORMAL_BETA = 0.041f; //the Madgwick gain the modes go back to once the orientation is known
+    const float CONVERGENCE_BETA = 2.5f; //the Madgwick gain the modes used while waiting for convergence
+    const float FUSION_GAIN = 0.5f;
+    const float FUSION_INITIAL_GAIN = 10.0f; //the gain the Fusion AHRS starts its initialisation period with
+    const int REFERENCE_PASSES = 20;
+    const unsigned int ALIGNMENT_SAMPLES = 39; //ATTITUDE_ALIGNMENT_SAMPLES in PersonalCaddie.h
+
+    enum class Filter
+    {
+        MADGWICK,
+        FUSION
+    };
+
+    //How the filter gets started and when the app starts trusting its output
+    enum class Start
+    {
+        IDENTITY_GRAPH_CHECK, //GraphMode::convergenceCheck() on every quaternion
+        IDENTITY_SWING_CHECK, //FreeSwingMode::convergenceCheck() on the first quaternion of each data set
+        IDENTITY_INITIALISATION, //the Fusion AHRS initialisation period
+        ALIGNED,
+        REFERENCE, //seeded with a known orientation, only used for the reference
+        REFERENCE_SEARCH //seeded with a known orientation and a high gain, only used to find the start of the reference
+    };
+
+    struct Recording
+    {
+        std::vector<float> time;
+        std::vector<float> values[9]; //gyr xyz, acc xyz, mag xyz in the units of the text file
+        float odr = 0.0f;
+
+        size_t size() const { return time.size(); }
+    };
+
+    struct Run
+    {
+        std::vector<float> quaternions; //w, x, y, z for every sample
+        long usableSample = -1; //last sample of the data set the app would start using the orientation after, -1 if never
+        float finalQuaternion[4];
+    };
+
+    struct Result
+    {
+        double usable = -1.0; //seconds from the start of the recording until the orientation gets used
+        double usableError = 0.0; //degrees from the reference at that point
+        double settled = -1.0; //seconds until the error stays under the tolerance for the rest of the recording
+        double meanError = 0.0; //degrees over the whole recording
+    };
+
+    bool loadRecording(const char* file_location, float odr, Recording& recording)
+    {
+        FILE* file = fopen(file_location, "r");
+        if (file == nullptr) return false;
+
+        char line[512];
+        while (fgets(line, sizeof(line), file) != nullptr)
+        {
+            float values[10];
+            char* position = line;
+            int column = 0;
+            for (; column < 10; column++)
+            {
+                char* end = nullptr;
+                values[column] = strtof(position, &end);
+                if (end == position) break;
+                position = end;
+            }
+            if (column < 10) continue;
+
+            recording.time.push_back(values[0]);
+            for (int channel = 0; channel < 9; channel++) recording.values[channel].push_back(values[1 + channel]);
+        }
+        fclose(file);
+
+        recording.odr = odr;
+        if (recording.odr <= 0.0f && recording.size() > 1 && recording.time[1] > recording.time[0]) recording.odr = 1.0f / (recording.time[1] - recording.time[0]);
+        if (recording.odr <= 0.0f) recording.odr = 400.0f;
+        return recording.size() > 0;
+    }
+
+    Recording reversed(Recording const& recording)
+    {
+        //Played backwards the sensor turns the other way, so the gyroscope readings change sign
+        Recording backwards = recording;
+        for (int channel = 0; channel < 9; channel++)
+        {
+            std::reverse(backwards.values[channel].begin(), backwards.values[channel].end());
+            if (channel < 3) for (float& value : backwards.values[channel]) value = -value;
+        }
+        return backwards;
+    }
+
+    bool convergenceCheck(std::vector<float> const& quaternions)
+    {
+        //The same check GraphMode and FreeSwingMode used, the newest quaternion has to be within 5% (component by
+        //component) of the average of the last 10
+        if (quaternions.size() < 40) return false;
+
+        const float* last = &quaternions[quaternions.size() - 4];
+        float average[4] = {};
+        for (size_t i = quaternions.size() - 40; i < quaternions.size(); i += 4)
+        {
+            for (int component = 0; component < 4; component++) average[component] += quaternions[i + component] / 10.0f;
+        }
+
+        const float error_threshold = 0.05f;
+        for (int component = 0; component < 4; component++)
+        {
+            float error = (average[component] - last[component]) / (average[component] + last[component]);
+            if (component == 0 && error >= 1.0f) error = 1.0f / error;
+            if (error > error_threshold || error < -error_threshold) return false;
+        }
+        return true;
+    }
+
+    bool align(Recording const& recording, size_t first, size_t samples, FusionAlignment& alignment, FusionQuaternion& quaternion)
+    {
+        //The same as PersonalCaddie, data sets get gathered up until there are enough samples and the alignment starts
+        //over if the sensor moved too much while they came in
+        for (size_t i = first; i < first + samples; i++)
+        {
+            FusionVector accelerometer = { recording.values[3][i], recording.values[4][i], recording.values[5][i] };
+            FusionVector magnetometer = { recording.values[6][i], recording.values[7][i], recording.values[8][i] };
+            FusionAlignmentAdd(&alignment, accelerometer, magnetometer);
+        }
+        if (FusionAlignmentGetSamples(&alignment) < ALIGNMENT_SAMPLES) return false;
+
+        bool aligned = FusionAlignmentQuaternion(&alignment, FusionConventionNwu, &quaternion);
+        FusionAlignmentReset(&alignment);
+        return aligned;
+    }
+
+    Run runFilter(Recording const& recording, Filter filter, Start start, int data_set_size, const float* seed = nullptr)
+    {
+        //Goes through the recording a data set at a time the same way the PersonalCaddie class does
+        Run run;
+        run.quaternions.resize(4 * recording.size());
+        float q[4] = { 1.0f, 0.0f, 0.0f, 0.0f };
+        if (seed != nullptr) std::copy(seed, seed + 4, q);
+
+        FusionAhrs ahrs;
+        FusionAhrsInitialise(&ahrs);
+        FusionAlignment alignment;
+        FusionAlignmentReset(&alignment);
+
+        //While searching for the reference nothing gets rejected, otherwise a heading that starts out far enough off
+        //would be stuck there until the recovery period runs out
+        const bool search = (start == Start::REFERENCE_SEARCH);
+        const FusionAhrsSettings settings = {
+            FusionConventionNwu,
+            search ? FUSION_INITIAL_GAIN : FUSION_GAIN,
+            2000.0f,
+            search ? 0.0f : 10.0f,
+            search ? 0.0f : 10.0f,
+            5 * (unsigned int)recording.odr, /* 5 seconds */
+        };
+        FusionAhrsSetSettings(&ahrs, &settings);
+        if (seed != nullptr)
+        {
+            FusionQuaternion initial = { { seed[0], seed[1], seed[2], seed[3] } };
+            FusionAhrsSetInitialQuaternion(&ahrs, initial);
+        }
+
+        bool usable = (start == Start::REFERENCE || start == Start::REFERENCE_SEARCH);
+        float beta = (start == Start::IDENTITY_GRAPH_CHECK || start == Start::IDENTITY_SWING_CHECK || start == Start::REFERENCE_SEARCH) ? CONVERGENCE_BETA : NORMAL_BETA;
+        std::vector<float> checked; //quaternions the convergence check looks at
+
+        for (size_t first = 0; first < recording.size(); first += data_set_size)
+        {
+            const size_t samples = std::min(recording.size() - first, (size_t)data_set_size);
+            bool aligned_now = false;
+            if (start == Start::ALIGNED && !usable)
+            {
+                FusionQuaternion initial;
+                if (align(recording, first, samples, alignment, initial))
+                {
+                    std::copy(initial.array, initial.array + 4, q);
+                    FusionAhrsSetInitialQuaternion(&ahrs, initial);
+                    aligned_now = true;
+                }
+            }
+
+            float* q_out = &run.quaternions[4 * first];
+            if (filter == Filter::MADGWICK)
+            {
+                const std::vector<float>* v = recording.values;
+                MadgwickBatchInput input = { &v[0][first], &v[1][first], &v[2][first], &v[3][first], &v[4][first], &v[5][first], &v[6][first], &v[7][first], &v[8][first] };
+                MadgwickAHRSupdateBatch(q, input, (int)samples, recording.odr, beta, q_out);
+            }
+            else
+            {
+                for (size_t i = first; i < first + samples; i++)
+                {
+                    FusionVector gyroscope = { recording.values[0][i], recording.values[1][i], recording.values[2][i] };
+                    FusionVector accelerometer = { recording.values[3][i], recording.values[4][i], recording.values[5][i] };
+                    FusionVector magnetometer = { recording.values[6][i], recording.values[7][i], recording.values[8][i] };
+                    FusionAhrsUpdate(&ahrs, gyroscope, accelerometer, magnetometer, 1.0f / recording.odr);
+
+                    FusionQuaternion fused = FusionAhrsGetQuaternion(&ahrs);
+                    std::copy(fused.array, fused.array + 4, &run.quaternions[4 * i]);
+                }
+            }
+
+            if (usable) continue;
+            if (start == Start::ALIGNED) usable = aligned_now;
+            else if (start == Start::IDENTITY_INITIALISATION) usable = !FusionAhrsGetFlags(&ahrs).initialising;
+            else
+            {
+                //GraphMode checked every quaternion of the data set, FreeSwingMode only the first one
+                size_t check_samples = (start == Start::IDENTITY_GRAPH_CHECK) ? samples : 1;
+                checked.insert(checked.end(), q_out, q_out + 4 * check_samples);
+                usable = convergenceCheck(checked);
+                if (usable) beta = NORMAL_BETA;
+            }
+            if (usable) run.usableSample = (long)(first + samples - 1);
+        }
+
+        std::copy(run.quaternions.end() - 4, run.quaternions.end(), run.finalQuaternion);
+        return run;
+    }
+
+    double angleDegrees(const float* a, const float* b);
+
+    Run reference(Recording const& recording, Filter filter, int data_set_size)
+    {
+        //Forwards and backwards with a high gain until the orientation at the start of the recording stops changing, so
+        //even a recording that's too short for the filter to converge in a single pass gets a reference
+        Recording backwards = reversed(recording);
+        float start[4] = { 1.0f, 0.0f, 0.0f, 0.0f };
+        for (int pass = 0; pass < REFERENCE_PASSES; pass++)
+        {
+            Run forwards = runFilter(recording, filter, Start::REFERENCE_SEARCH, data_set_size, start);
+            Run back = runFilter(backwards, filter, Start::REFERENCE_SEARCH, data_set_size, forwards.finalQuaternion);
+            double change = angleDegrees(start, back.finalQuaternion);
+            std::copy(back.finalQuaternion, back.finalQuaternion + 4, start);
+            if (change < 0.01) break;
+        }
+        return runFilter(recording, filter, Start::REFERENCE, data_set_size, start);
+    }
+
+    double angleDegrees(const float* a, const float* b)
+    {
+        //Angle of the rotation between two orientations, q and -q are the same orientation
+        double dot = 0.0, length_a = 0.0, length_b = 0.0;
+        for (int component = 0; component < 4; component++)
+        {
+            dot += (double)a[component] * b[component];
+            length_a += (double)a[component] * a[component];
+            length_b += (double)b[component] * b[component];
+        }
+        dot = std::fabs(dot) / std::sqrt(length_a * length_b);
+        return 2.0 * std::acos(std::min(dot, 1.0)) * 180.0 / PI;
+    }
+
+    Result measure(Recording const& recording, Run const& run, Run const& truth, double tolerance)
+    {
+        Result result;
+        long last_over = -1;
+        for (size_t i = 0; i < recording.size(); i++)
+        {
+            double error = angleDegrees(&run.quaternions[4 * i], &truth.quaternions[4 * i]);
+            result.meanError += error / recording.size();
+            if (error >= tolerance) last_over = (long)i;
+            if ((long)i == run.usableSample) result.usableError = error;
+        }
+
+        //Times are to the end of the sample, so a filter that's usable after the first data set of 39 samples at 400 Hz took 97.5 ms
+        const double period = 1.0 / recording.odr;
+        if (run.usableSample >= 0) result.usable = (run.usableSample + 1) * period;
+        if (last_over < (long)recording.size() - 1) result.settled = (last_over + 1) * period;
+        return result;
+    }
+
+    std::string number(double value, const char* format, bool valid = true)
+    {
+        if (!valid) return (value < 0.0) ? "never" : "-";
+        char text[32];
+        snprintf(text, sizeof(text), format, value);
+        return text;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int data_set_size = 39;
+    float odr = 0.0f;
+    double tolerance = 2.0;
+    std::vector<const char*> files;
+
+    const char* usage = "Usage: %s [--samples <samples per data set>] [--odr <hz>] [--tolerance <degrees>] <data set> [<data set> ...]\n";
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--samples" && i + 1 < argc) data_set_size = atoi(argv[++i]);
+        else if (argument == "--odr" && i + 1 < argc) odr = (float)atof(argv[++i]);
+        else if (argument == "--tolerance" && i + 1 < argc) tolerance = atof(argv[++i]);
+        else if (argument.size() > 1 && argument[0] == '-')
+        {
+            printf(usage, argv[0]);
+            return 1;
+        }
+        else files.push_back(argv[i]);
+    }
+    if (files.empty() || data_set_size < 1 || tolerance <= 0.0)
+    {
+        printf(usage, argv[0]);
+        return 1;
+    }
+
+    bool all_passed = true;
+    printf("%-22s %-9s %-26s %10s %10s %10s %10s\n", "data set", "filter", "start", "usable s", "error deg", "settled s", "mean deg");
+
+    for (const char* file : files)
+    {
+        Recording recording;
+        if (!loadRecording(file, odr, recording))
+        {
+            fprintf(stderr, "Couldn't read any samples from '%s'\n", file);
+            all_passed = false;
+            continue;
+        }
+
+        std::string name = file;
+        size_t slash = name.find_last_of("/\\");
+        if (slash != std::string::npos) name = name.substr(slash + 1);
+
+        struct Case { Filter filter; const char* filter_name; Start start; const char* start_name; };
+        const Case cases[] = {
+            { Filter::MADGWICK, "madgwick", Start::IDENTITY_GRAPH_CHECK, "before (graph check)" },
+            { Filter::MADGWICK, "madgwick", Start::IDENTITY_SWING_CHECK, "before (free swing check)" },
+            { Filter::MADGWICK, "madgwick", Start::ALIGNED, "after (aligned)" },
+            { Filter::FUSION, "fusion", Start::IDENTITY_INITIALISATION, "before (initialisation)" },
+            { Filter::FUSION, "fusion", Start::ALIGNED, "after (aligned)" }
+        };
+
+        Run truth[2] = { reference(recording, Filter::MADGWICK, data_set_size), reference(recording, Filter::FUSION, data_set_size) };
+        Result before[2]; //the quickest of the old ways for each filter
+        bool has_before[2] = { false, false };
+
+        for (Case const& c : cases)
+        {
+            const int f = static_cast<int>(c.filter);
+            Run run = runFilter(recording, c.filter, c.start, data_set_size);
+            Result result = measure(recording, run, truth[f], tolerance);
+
+            printf("%-22s %-9s %-26s %10s %10s %10s %10.2f\n", name.c_str(), c.filter_name, c.start_name, number(result.usable, "%.3f", result.usable >= 0.0).c_str(),
+                number(result.usableError, "%.2f", result.usable >= 0.0).c_str(), number(result.settled, "%.3f", result.settled >= 0.0).c_str(), result.meanError);
+
+            if (c.start != Start::ALIGNED)
+            {
+                if (!has_before[f] || (result.usable >= 0.0 && (before[f].usable < 0.0 || result.usable < before[f].usable))) before[f] = result;
+                has_before[f] = true;
+                continue;
+            }
+
+            //The alignment has to make the orientation usable sooner than any of the old ways did, it can't be any
+            //further off at that point than the old way was when it got there, and the error has to drop under the
+            //tolerance for good before the recording ends. That last part only holds when the old way manages it too.
+            //On a recording where the gyroscope and magnetometer don't agree (TestData.txt turns the magnetic field
+            //all the way around while the gyroscope reads about 1 deg/s) the reference is only a compromise between
+            //them, the filter with its normal gain never gets within a couple of degrees of it from any start, so there
+            //the aligned start only has to stay closer to it on average than the old start did.
+            bool faster = result.usable >= 0.0 && (before[f].usable < 0.0 || result.usable < before[f].usable);
+            bool accurate = result.usableError <= std::max(tolerance, before[f].usableError);
+            bool settles = (before[f].settled >= 0.0) ? result.settled >= 0.0 : result.meanError < before[f].meanError;
+            if (!faster || !accurate || !settles)
+            {
+                printf("    the aligned start is %s\n", !faster ? "no faster than the old one" : !accurate ? "further off than the old one" :
+                    (before[f].settled >= 0.0) ? "never within the tolerance of the reference for good" : "further off on average than the old one");
+                all_passed = false;
+            }
+        }
+    }
+
+    printf("\n%s\n", all_passed ? "The aligned start is usable sooner and ends up closer on every data set" : "FAILED");
+    return all_passed ? 0 : 1;
+}
@@ -0,0 +1,595 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "../Firmware/nRF52840_Drivers/bmi270_fifo.h"
+#include "../Firmware/MEMs_Drivers/Bosch/bmi2.h"
+
+//Checks the FIFO reads in bmi270_fifo.c against a simulated BMI270. The fake sensor has a register file and a 2 KB FIFO
+//that fills up one frame per tick of the sensor ODR the way the datasheet describes it: frames have a header or not
+//depending on FIFO_CONFIG_1, a frame can be half written when the length registers get read, a sensor without a new
+//sample puts a dummy value into its part of a headerless frame, header mode adds a skip frame after frames were lost
+//and a config frame after the sensor settings change, and in stream mode the oldest frames get thrown out once the
+//FIFO is full. The FIFO is set up with the same Bosch calls bmi270_fifo_mode_enable() makes and read the way
+//fifo_data_read() in main.c reads it. See readme.txt for how to build it.
+
+namespace
+{
+    const uint16_t FIFO_SIZE = 2048;
+    const uint16_t STRIDE = 18; //3 * SAMPLE_SIZE, the acc, gyr and mag reading of each sample in the composite characteristic
+    const uint8_t CONFIG_1_HEADER = 0x10, CONFIG_1_ACC = 0x40, CONFIG_1_GYR = 0x80;
+    const uint8_t HEADER_ACC = 0x84, HEADER_GYR = 0x88, HEADER_ACC_GYR = 0x8C;
+
+    //Every sample gets its own readings, so the sample a frame came from can be worked out from what's in it
+    int16_t accValue(uint32_t sample, int axis) { return (int16_t)((sample * 3 + axis * 1000) % 30000); }
+    int16_t gyrValue(uint32_t sample, int axis) { return (int16_t)(-(int32_t)((sample * 5 + axis * 700) % 30000)); }
+
+    void putAxis(std::vector<uint8_t>& frame, int16_t value)
+    {
+        frame.push_back((uint8_t)(value & 0xFF));
+        frame.push_back((uint8_t)((value >> 8) & 0xFF));
+    }
+
+    void putDummy(std::vector<uint8_t>& frame, uint8_t dummy_header)
+    {
+        uint8_t dummy[6] = { dummy_header, BMI2_FIFO_HEADERLESS_DUMMY_BYTE_1, BMI2_FIFO_HEADERLESS_DUMMY_BYTE_2, BMI2_FIFO_HEADERLESS_DUMMY_BYTE_3, 0, 0 };
+        frame.insert(frame.end(), dummy, dummy + 6);
+    }
+
+    struct FakeBmi270
+    {
+        uint8_t registers[256];
+        std::deque<uint8_t> fifo;
+        std::deque<uint16_t> frameLengths; //so whole frames can be thrown out when the FIFO overflows
+        std::vector<uint8_t> writing; //a frame the sensor is still writing, only the first writtenBytes of it are in the FIFO
+        uint16_t writtenBytes = 0;
+        uint32_t lostFrames = 0, pendingSkip = 0;
+        bool pendingConfig = false;
+        uint32_t overReads = 0, tornReads = 0;
+        bool failReads = false;
+
+        void reset()
+        {
+            memset(registers, 0, sizeof(registers));
+            registers[0x00] = 0x24; //BMI270_CHIP_ID
+            registers[BMI2_FIFO_CONFIG_0_ADDR] = 0x02; //reset values from the datasheet, sensor time on,
+            registers[BMI2_FIFO_CONFIG_1_ADDR] = CONFIG_1_HEADER; //header mode on and no sensors going into the FIFO
+            fifo.clear();
+            frameLengths.clear();
+            writing.clear();
+            writtenBytes = 0;
+            lostFrames = pendingSkip = overReads = tornReads = 0;
+            pendingConfig = failReads = false;
+        }
+
+        uint8_t config1() const { return registers[BMI2_FIFO_CONFIG_1_ADDR]; }
+        bool stopOnFull() const { return (registers[BMI2_FIFO_CONFIG_0_ADDR] & 0x01) != 0; }
+        uint16_t watermark() const { return (uint16_t)(registers[BMI2_FIFO_WTM_0_ADDR] | (registers[BMI2_FIFO_WTM_0_ADDR + 1] << 8)); }
+        uint16_t length() const { return (uint16_t)(fifo.size() + writtenBytes); }
+        bool watermarkReached() const { return watermark() > 0 && fifo.size() >= watermark(); } //the interrupt only counts whole frames
+
+        void pushFrame(std::vector<uint8_t> const& frame)
+        {
+            //In stream mode the oldest whole frames make room for the new one, in stop on full mode the new one is lost
+            while (fifo.size() + writtenBytes + frame.size() > FIFO_SIZE)
+            {
+                if (stopOnFull() || frameLengths.empty())
+                {
+                    lostFrames++;
+                    return;
+                }
+                for (uint16_t i = 0; i < frameLengths.front(); i++) fifo.pop_front();
+                frameLengths.pop_front();
+                lostFrames++;
+                pendingSkip++;
+            }
+            fifo.insert(fifo.end(), frame.begin(), frame.end());
+            frameLengths.push_back((uint16_t)frame.size());
+        }
+
+        std::vector<uint8_t> buildFrame(uint32_t sample, bool new_acc, bool new_gyr)
+        {
+            //Builds the frame for one tick of the sensor ODR, gyr before acc like the BMI270 orders them. In header mode
+            //any skip or config frame that's due goes into the FIFO first.
+            std::vector<uint8_t> frame;
+            bool acc_en = (config1() & CONFIG_1_ACC) != 0, gyr_en = (config1() & CONFIG_1_GYR) != 0;
+            if (!acc_en && !gyr_en) return frame;
+
+            if (config1() & CONFIG_1_HEADER)
+            {
+                if (pendingSkip > 0) pushFrame({ BMI2_FIFO_HEADER_SKIP_FRM, (uint8_t)(pendingSkip > 255 ? 255 : pendingSkip) });
+                if (pendingConfig) pushFrame({ BMI2_FIFO_HEADER_INPUT_CFG_FRM, 0x01 });
+                pendingSkip = 0;
+                pendingConfig = false;
+
+                new_acc = new_acc && acc_en;
+                new_gyr = new_gyr && gyr_en;
+                if (!new_acc && !new_gyr) return frame;
+                frame.push_back(new_acc && new_gyr ? HEADER_ACC_GYR : new_acc ? HEADER_ACC : HEADER_GYR);
+                if (new_gyr) for (int axis = 0; axis < 3; axis++) putAxis(frame, gyrValue(sample, axis));
+                if (new_acc) for (int axis = 0; axis < 3; axis++) putAxis(frame, accValue(sample, axis));
+                return frame;
+            }
+
+            //Nothing in a headerless FIFO says that frames were lost or that the settings changed
+            pendingSkip = 0;
+            pendingConfig = false;
+            if (gyr_en)
+            {
+                if (new_gyr) for (int axis = 0; axis < 3; axis++) putAxis(frame, gyrValue(sample, axis));
+                else putDummy(frame, BMI2_FIFO_HEADERLESS_DUMMY_GYR);
+            }
+            if (acc_en)
+            {
+                if (new_acc) for (int axis = 0; axis < 3; axis++) putAxis(frame, accValue(sample, axis));
+                else putDummy(frame, BMI2_FIFO_HEADERLESS_DUMMY_ACC);
+            }
+            return frame;
+        }
+
+        void finishFrame()
+        {
+            if (writing.empty()) return;
+            std::vector<uint8_t> frame;
+            frame.swap(writing);
+            writtenBytes = 0;
+            pushFrame(frame);
+        }
+
+        void addSample(uint32_t sample, bool new_acc = true, bool new_gyr = true)
+        {
+            finishFrame();
+            std::vector<uint8_t> frame = buildFrame(sample, new_acc, new_gyr);
+            if (!frame.empty()) pushFrame(frame);
+        }
+
+        void addPartialSample(uint32_t sample, uint16_t bytes)
+        {
+            //The first bytes of the next frame are counted by the length registers but the rest of it isn't there yet
+            finishFrame();
+            writing = buildFrame(sample, true, true);
+            writtenBytes = bytes;
+        }
+
+        void write(uint8_t reg, const uint8_t* data, uint32_t length)
+        {
+            for (uint32_t i = 0; i < length; i++)
+            {
+                uint8_t address = (uint8_t)(reg + i);
+                if (address == BMI2_CMD_REG_ADDR && data[i] == BMI2_FIFO_FLUSH_CMD)
+                {
+                    fifo.clear();
+                    frameLengths.clear();
+                    writing.clear();
+                    writtenBytes = 0;
+                    pendingSkip = 0;
+                    continue;
+                }
+                if (address >= 0x40 && address <= 0x43 && registers[address] != data[i]) pendingConfig = true; //ACC_CONF up to GYR_RANGE
+                registers[address] = data[i];
+            }
+        }
+
+        void read(uint8_t reg, uint8_t* data, uint32_t count)
+        {
+            if (reg == BMI2_FIFO_DATA_ADDR)
+            {
+                //The FIFO data register doesn't auto-increment, every byte read comes out of the FIFO. Reading into a frame
+                //that's still being written tears it, and reading past the end gives the over-read pattern.
+                for (uint32_t i = 0; i < count; i++)
+                {
+                    if (!fifo.empty())
+                    {
+                        data[i] = fifo.front();
+                        fifo.pop_front();
+                        if (--frameLengths.front() == 0) frameLengths.pop_front();
+                    }
+                    else if (writtenBytes > 0)
+                    {
+                        data[i] = writing.front();
+                        writing.erase(writing.begin());
+                        writtenBytes--;
+                        tornReads++;
+                    }
+                    else
+                    {
+                        data[i] = (i % 2 == 0) ? BMI2_FIFO_HEAD_OVER_READ_MSB : 0x00;
+                        overReads++;
+                    }
+                }
+                return;
+            }
+
+            registers[BMI2_FIFO_LENGTH_0_ADDR] = (uint8_t)(length() & 0xFF);
+            registers[BMI2_FIFO_LENGTH_0_ADDR + 1] = (uint8_t)(((length() >> 8) & 0x3F) | 0xC0); //the top two bits are reserved, not part of the length
+            for (uint32_t i = 0; i < count; i++) data[i] = registers[(uint8_t)(reg + i)];
+        }
+    };
+
+    FakeBmi270 g_bmi270;
+    struct bmi2_dev g_device;
+    bmi270_fifo_t g_fifo;
+
+    int8_t readRegister(uint8_t reg, uint8_t* data, uint32_t length, void*)
+    {
+        if (g_bmi270.failReads) return -1;
+        g_bmi270.read(reg, data, length);
+        return BMI2_INTF_RET_SUCCESS;
+    }
+
+    int8_t writeRegister(uint8_t reg, const uint8_t* data, uint32_t length, void*)
+    {
+        g_bmi270.write(reg, data, length);
+        return BMI2_INTF_RET_SUCCESS;
+    }
+
+    void delayUs(uint32_t, void*) {}
+
+    void report(bool& passed, bool condition, const char* description)
+    {
+        if (!condition)
+        {
+            printf("  FAILED: %s\n", description);
+            passed = false;
+        }
+    }
+
+    int8_t enableFifo(uint8_t samples, bool headerless = true)
+    {
+        //The Bosch calls bmi270_fifo_mode_enable() in bmi270_drv.c makes, minus the interrupt pin. Leaving out the first
+        //one keeps the FIFO in header mode, which is only done to show the fake sensor's header frames get noticed.
+        g_bmi270.reset();
+        memset(&g_device, 0, sizeof(g_device));
+        g_device.intf = BMI2_I2C_INTF;
+        g_device.read = readRegister;
+        g_device.write = writeRegister;
+        g_device.delay_us = delayUs;
+        g_device.read_write_len = 64;
+
+        int8_t rslt = BMI2_OK;
+        if (headerless) rslt = bmi2_set_fifo_config(BMI2_FIFO_ALL_EN | BMI2_FIFO_HEADER_EN | BMI2_FIFO_TIME_EN | BMI2_FIFO_STOP_ON_FULL, BMI2_DISABLE, &g_device);
+        if (rslt == BMI2_OK) rslt = bmi2_set_fifo_config(BMI2_FIFO_ACC_EN | BMI2_FIFO_GYR_EN, BMI2_ENABLE, &g_device);
+        if (rslt == BMI2_OK) rslt = bmi2_set_fifo_wm(bmi270_fifo_watermark(samples), &g_device);
+        if (rslt == BMI2_OK) rslt = bmi2_set_command_register(BMI2_FIFO_FLUSH_CMD, &g_device);
+        bmi270_fifo_init(&g_fifo, readRegister, NULL, 0);
+        return rslt;
+    }
+
+    //Follows the samples coming out of the FIFO and checks that each one holds the readings of a later sample than the
+    //last, counting any samples that were skipped over along the way
+    struct SampleChecker
+    {
+        int64_t first = -1, last = -1;
+        uint32_t samples = 0, gaps = 0, missing = 0, wrong = 0;
+
+        void check(const uint8_t* buffer, int count)
+        {
+            for (int i = 0; i < count; i++)
+            {
+                const uint8_t* sample = buffer + i * STRIDE;
+                int16_t acc_x = (int16_t)(sample[0] | (sample[1] << 8));
+                int64_t number = (acc_x >= 0) ? acc_x / 3 : -1; //accValue() for the x axis
+
+                bool matches = (number >= 0 && number > last);
+                for (int axis = 0; axis < 3 && matches; axis++)
+                {
+                    matches = (int16_t)(sample[2 * axis] | (sample[2 * axis + 1] << 8)) == accValue((uint32_t)number, axis) &&
+                        (int16_t)(sample[6 + 2 * axis] | (sample[7 + 2 * axis] << 8)) == gyrValue((uint32_t)number, axis);
+                }
+                samples++;
+                if (!matches)
+                {
+                    wrong++;
+                    continue;
+                }
+
+                if (last >= 0 && number > last + 1)
+                {
+                    gaps++;
+                    missing += (uint32_t)(number - last - 1);
+                }
+                if (first < 0) first = number;
+                last = number;
+            }
+        }
+    };
+
+    int drain(SampleChecker& checker, uint8_t samples, int* samples_out = nullptr)
+    {
+        //The loop in fifo_data_read(): read a characteristic worth of samples until there isn't a full one left
+        uint8_t buffer[BMI270_FIFO_MAX_BURST_FRAMES * STRIDE];
+        int reads = 0;
+        for (int i = 0; i < BMI270_FIFO_MAX_FRAMES; i++)
+        {
+            uint8_t samples_read = 0;
+            if (bmi270_fifo_read(&g_fifo, buffer, 0, STRIDE, samples, &samples_read) != BMI2_OK || samples_read == 0) break;
+            checker.check(buffer, samples_read);
+            if (samples_out != nullptr) *samples_out += samples_read;
+            reads++;
+        }
+        return reads;
+    }
+
+    uint16_t framesWaiting()
+    {
+        uint16_t frames = 0;
+        bmi270_fifo_frames_available(&g_fifo, &frames);
+        return frames;
+    }
+
+    bool configCheck()
+    {
+        bool passed = true;
+        report(passed, enableFifo(20) == BMI2_OK, "the Bosch driver couldn't set up the FIFO");
+        report(passed, g_bmi270.config1() == (CONFIG_1_ACC | CONFIG_1_GYR), "the FIFO isn't in headerless mode with just the acc and gyr");
+        report(passed, (g_bmi270.registers[BMI2_FIFO_CONFIG_0_ADDR] & 0x03) == 0, "the FIFO isn't in stream mode without sensor time");
+        report(passed, g_bmi270.watermark() == 20 * BMI270_FIFO_FRAME_SIZE, "the watermark isn't 20 frames");
+        report(passed, bmi270_fifo_watermark(BMI270_FIFO_MAX_BURST_FRAMES + 10) == BMI270_FIFO_MAX_BURST_FRAMES * BMI270_FIFO_FRAME_SIZE, "the watermark isn't limited to a single burst");
+
+        g_bmi270.failReads = true;
+        uint16_t frames = 99;
+        uint8_t buffer[STRIDE], samples_read = 99;
+        report(passed, bmi270_fifo_frames_available(&g_fifo, &frames) == BMI2_E_COM_FAIL && frames == 0, "a failed length read wasn't reported");
+        report(passed, bmi270_fifo_read(&g_fifo, buffer, 0, STRIDE, 1, &samples_read) == BMI2_E_COM_FAIL && samples_read == 0, "a failed FIFO read wasn't reported");
+        g_bmi270.failReads = false;
+
+        printf("config: headerless acc + gyr frames in stream mode, watermark of %u bytes for 20 samples\n", g_bmi270.watermark());
+        return passed;
+    }
+
+    bool watermarkCheck(uint8_t samples)
+    {
+        //The main loop reads as soon as the watermark interrupt goes off, so every read should get exactly a
+        //characteristic worth of samples with the frames that came in since left in the FIFO
+        bool passed = true;
+        report(passed, enableFifo(samples) == BMI2_OK, "the Bosch driver couldn't set up the FIFO");
+        uint8_t per_read = (samples > BMI270_FIFO_MAX_BURST_FRAMES) ? BMI270_FIFO_MAX_BURST_FRAMES : samples;
+
+        SampleChecker checker;
+        uint32_t generated = 10 * per_read + per_read / 2;
+        int reads = 0, read_samples = 0;
+        for (uint32_t sample = 0; sample < generated; sample++)
+        {
+            g_bmi270.addSample(sample);
+            if (g_bmi270.watermarkReached())
+            {
+                int now = drain(checker, samples, &read_samples);
+                report(passed, now == 1, "the watermark interrupt didn't lead to exactly one read");
+                reads += now;
+            }
+        }
+
+        report(passed, reads == 10 && read_samples == 10 * per_read, "not every read got a full characteristic worth of samples");
+        report(passed, framesWaiting() == generated - read_samples, "the frames after the last read aren't still in the FIFO");
+        report(passed, checker.wrong == 0 && checker.gaps == 0 && checker.first == 0, "samples came out wrong or out of order");
+        report(passed, g_bmi270.overReads == 0 && g_bmi270.tornReads == 0, "a read went past the frames in the FIFO");
+
+        printf("watermark %2u: %d reads of %u samples, %u samples left in the FIFO\n", samples, reads, per_read, framesWaiting());
+        return passed;
+    }
+
+    bool partialFrameCheck()
+    {
+        //A frame that's only partly written counts toward the length registers but mustn't be read
+        bool passed = true;
+        report(passed, enableFifo(8) == BMI2_OK, "the Bosch driver couldn't set up the FIFO");
+        SampleChecker checker;
+
+        for (uint32_t sample = 0; sample < 7; sample++) g_bmi270.addSample(sample);
+        g_bmi270.addPartialSample(7, 5);
+        report(passed, framesWaiting() == 7, "a partly written frame was counted as a whole one");
+        report(passed, drain(checker, 8) == 0, "a read went ahead without a full characteristic worth of whole frames");
+
+        g_bmi270.addSample(8); //finishes frame 7 first
+        g_bmi270.addPartialSample(9, 11);
+        report(passed, drain(checker, 8) == 1 && framesWaiting() == 1, "the whole frames weren't read around the partly written one");
+        g_bmi270.finishFrame();
+        for (uint32_t sample = 10; sample < 16; sample++) g_bmi270.addSample(sample);
+        report(passed, drain(checker, 8) == 1, "the frame that was partly written held up the next read");
+
+        //A buffer that stops part way through a frame only unpacks the whole frames
+        uint8_t frames[4 * BMI270_FIFO_FRAME_SIZE], out[4 * STRIDE];
+        for (int f = 0; f < 4; f++)
+        {
+            for (int axis = 0; axis < 3; axis++)
+            {
+                int16_t gyr = gyrValue(16 + f, axis), acc = accValue(16 + f, axis);
+                memcpy(frames + f * BMI270_FIFO_FRAME_SIZE + 2 * axis, &gyr, 2);
+                memcpy(frames + f * BMI270_FIFO_FRAME_SIZE + 6 + 2 * axis, &acc, 2);
+            }
+        }
+        report(passed, bmi270_fifo_unpack(frames, 3 * BMI270_FIFO_FRAME_SIZE + 7, out, 0, STRIDE, 4, 0) == 3, "part of a frame was unpacked as a whole one");
+        checker.check(out, 3);
+
+        report(passed, checker.wrong == 0 && checker.gaps == 0 && checker.samples == 19, "samples came out wrong or out of order");
+        report(passed, g_bmi270.tornReads == 0 && g_bmi270.overReads == 0, "a read tore a frame that was still being written");
+        printf("partial frames: never read, %u whole samples came out in order around them\n", checker.samples);
+        return passed;
+    }
+
+    bool dummyFrameCheck()
+    {
+        //With the gyr running at half the acc ODR every other frame has a dummy gyr reading, and with the acc at half the
+        //gyr ODR a dummy acc reading. Those frames get skipped, so each read hands back fewer samples than it read frames.
+        bool passed = true;
+        uint32_t generated = 80;
+        for (int dummy_sensor = 0; dummy_sensor < 2; dummy_sensor++)
+        {
+            report(passed, enableFifo(8) == BMI2_OK, "the Bosch driver couldn't set up the FIFO");
+            SampleChecker checker;
+            int read_samples = 0;
+            for (uint32_t sample = 0; sample < generated; sample++)
+            {
+                bool odd = (sample % 2) != 0;
+                g_bmi270.addSample(sample, !(odd && dummy_sensor == 1), !(odd && dummy_sensor == 0));
+                if (g_bmi270.watermarkReached()) drain(checker, 8, &read_samples);
+            }
+            report(passed, read_samples == (int)generated / 2 && checker.missing == generated / 2 - 1, "dummy frames weren't the only ones skipped");
+            report(passed, checker.wrong == 0, "a dummy frame came out as a sample");
+        }
+
+        //A real reading that's only close to the dummy pattern has to get through
+        uint8_t frame[BMI270_FIFO_FRAME_SIZE] = { BMI2_FIFO_HEADERLESS_DUMMY_GYR, BMI2_FIFO_HEADERLESS_DUMMY_BYTE_1, 0x01, BMI2_FIFO_HEADERLESS_DUMMY_BYTE_3, 0, 0, 1, 2, 3, 4, 5, 6 };
+        uint8_t out[STRIDE];
+        report(passed, bmi270_fifo_unpack(frame, sizeof(frame), out, 0, STRIDE, 1, 0) == 1, "a real reading that looks a bit like a dummy frame was thrown out");
+        frame[2] = BMI2_FIFO_HEADERLESS_DUMMY_BYTE_2;
+        report(passed, bmi270_fifo_unpack(frame, sizeof(frame), out, 0, STRIDE, 1, 0) == 0, "a dummy gyr frame was unpacked");
+
+        printf("dummy frames: skipped for both sensors, %u of %u frames made it out each time\n", generated / 2, generated);
+        return passed;
+    }
+
+    bool configChangeCheck()
+    {
+        //The ODR and the watermark change while frames are waiting (the throughput scheduler changing the data set size
+        //leads to fifo_watermark_update()). A headerless FIFO doesn't get a config frame so the frames stay lined up.
+        bool passed = true;
+        report(passed, enableFifo(8) == BMI2_OK, "the Bosch driver couldn't set up the FIFO");
+        SampleChecker checker;
+        int read_samples = 0;
+
+        for (uint32_t sample = 0; sample < 12; sample++) g_bmi270.addSample(sample);
+        uint8_t acc_conf = 0xAC;
+        report(passed, bmi2_set_regs(0x40, &acc_conf, 1, &g_device) == BMI2_OK, "couldn't change ACC_CONF");
+        report(passed, bmi2_set_fifo_wm(bmi270_fifo_watermark(16), &g_device) == BMI2_OK, "couldn't change the watermark");
+        for (uint32_t sample = 12; sample < 40; sample++)
+        {
+            g_bmi270.addSample(sample);
+            if (g_bmi270.watermarkReached()) drain(checker, 16, &read_samples);
+        }
+
+        report(passed, read_samples == 32 && checker.wrong == 0 && checker.gaps == 0, "frames got out of line after the settings changed");
+        printf("config change: %d samples read in order after the ODR and watermark changed\n", read_samples);
+        return passed;
+    }
+
+    bool overflowCheck()
+    {
+        //The main loop falls so far behind that the FIFO fills up. In stream mode the oldest frames are lost, what's left
+        //has to be the newest frames, whole and in order, and the read loop has to be able to empty all of it.
+        bool passed = true;
+        const uint32_t generated = 400;
+        const uint16_t capacity = FIFO_SIZE / BMI270_FIFO_FRAME_SIZE;
+        for (uint8_t samples : { (uint8_t)1, (uint8_t)BMI270_FIFO_MAX_BURST_FRAMES })
+        {
+            report(passed, enableFifo(samples) == BMI2_OK, "the Bosch driver couldn't set up the FIFO");
+            for (uint32_t sample = 0; sample < generated; sample++) g_bmi270.addSample(sample);
+            report(passed, framesWaiting() == capacity && g_bmi270.lostFrames == generated - capacity, "the full FIFO doesn't hold the newest frames");
+
+            SampleChecker checker;
+            int read_samples = 0;
+            drain(checker, samples, &read_samples);
+            report(passed, checker.first == generated - capacity && checker.wrong == 0 && checker.gaps == 0, "the frames left after the overflow came out wrong");
+            report(passed, read_samples == capacity - capacity % samples && framesWaiting() == capacity % samples, "the read loop didn't empty the FIFO down to the watermark");
+            report(passed, g_bmi270.overReads == 0 && g_bmi270.tornReads == 0, "a read went past the frames in the FIFO");
+            printf("overflow, watermark %2u: %u frames lost, %d of the %u left read in order\n", samples, g_bmi270.lostFrames, read_samples, capacity);
+        }
+        return passed;
+    }
+
+    bool headerModeControl()
+    {
+        //The same stream with the FIFO left in header mode, where skip and config frames show up. Reading it as
+        //headerless frames has to go wrong, otherwise the checks above couldn't tell if the FIFO was set up right.
+        bool passed = true;
+        report(passed, enableFifo(8, false) == BMI2_OK, "the Bosch driver couldn't set up the FIFO");
+        SampleChecker checker;
+        for (uint32_t sample = 0; sample < 200; sample++) g_bmi270.addSample(sample);
+        uint8_t acc_conf = 0xAC;
+        bmi2_set_regs(0x40, &acc_conf, 1, &g_device);
+        for (uint32_t sample = 200; sample < 210; sample++) g_bmi270.addSample(sample);
+        drain(checker, 8);
+
+        report(passed, checker.wrong > 0, "header, skip and config frames were read as samples without anything looking wrong");
+        printf("header mode control: %u of %u samples read from header, skip and config frames were wrong\n", checker.wrong, checker.samples);
+        return passed;
+    }
+
+    bool crossAxisCheck()
+    {
+        //The gyr x reading gets the same cross axis compensation the Bosch driver applies, saturating at the int16 limits,
+        //and each sample goes at offset + n * stride without touching the bytes in between
+        bool passed = true;
+        const int16_t cross = 100;
+        int16_t gyr[2][3] = { { 1000, -5, 20000 }, { 32000, 7, -20000 } };
+        int16_t expected_x[2] = { (int16_t)(1000 - (cross * 20000) / 512), 32767 };
+
+        uint8_t frames[2 * BMI270_FIFO_FRAME_SIZE];
+        for (int f = 0; f < 2; f++)
+        {
+            for (int axis = 0; axis < 3; axis++)
+            {
+                int16_t acc = accValue(f, axis);
+                memcpy(frames + f * BMI270_FIFO_FRAME_SIZE + 2 * axis, &gyr[f][axis], 2);
+                memcpy(frames + f * BMI270_FIFO_FRAME_SIZE + 6 + 2 * axis, &acc, 2);
+            }
+        }
+
+        const uint16_t offset = 4;
+        uint8_t out[offset + 2 * STRIDE];
+        memset(out, 0xEE, sizeof(out));
+        report(passed, bmi270_fifo_unpack(frames, sizeof(frames), out, offset, STRIDE, 2, cross) == 2, "the frames weren't unpacked");
+        for (int f = 0; f < 2; f++)
+        {
+            const uint8_t* sample = out + offset + f * STRIDE;
+            int16_t x = (int16_t)(sample[6] | (sample[7] << 8));
+            int16_t y = (int16_t)(sample[8] | (sample[9] << 8));
+            int16_t z = (int16_t)(sample[10] | (sample[11] << 8));
+            report(passed, x == expected_x[f] && y == gyr[f][1] && z == gyr[f][2], "the gyr reading wasn't compensated the way the Bosch driver does it");
+            report(passed, memcmp(sample, frames + f * BMI270_FIFO_FRAME_SIZE + 6, 6) == 0, "the acc reading didn't come first");
+            for (int i = 12; i < STRIDE; i++) report(passed, sample[i] == 0xEE, "bytes between samples were written");
+        }
+        for (int i = 0; i < offset; i++) report(passed, out[i] == 0xEE, "bytes before the offset were written");
+
+        printf("cross axis: gyr x compensated and saturated, samples placed at the offset and stride\n");
+        return passed;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<int> watermarks = { 1, 8, 20, 39, 50 };
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--watermarks" && i + 1 < argc)
+        {
+            watermarks.clear();
+            for (char* position = argv[++i]; *position != '\0';)
+            {
+                char* end = nullptr;
+                watermarks.push_back((int)strtol(position, &end, 10));
+                if (end == position) break;
+                position = (*end == ',') ? end + 1 : end;
+            }
+        }
+        else
+        {
+            printf("Usage: %s [--watermarks <samples per read, comma separated>]\n", argv[0]);
+            return 1;
+        }
+    }
+    for (int samples : watermarks)
+    {
+        if (samples < 1 || samples > 255)
+        {
+            printf("Usage: %s [--watermarks <samples per read between 1 and 255, comma separated>]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    bool passed = configCheck();
+    for (int samples : watermarks) passed = watermarkCheck((uint8_t)samples) && passed;
+    passed = partialFrameCheck() && passed;
+    passed = dummyFrameCheck() && passed;
+    passed = configChangeCheck() && passed;
+    passed = overflowCheck() && passed;
+    passed = headerModeControl() && passed;
+    passed = crossAxisCheck() && passed;
+
+    printf("\n%s\n", passed ? "The FIFO reads hold up against the simulated BMI270" : "The FIFO reads don't hold up against the simulated BMI270");
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,418 @@
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "../Firmware/nRF52840_Drivers/boot_cache.h"
+#include "../Firmware/nRF52840_Drivers/nRF_Implementations/pc_twi_queue.h"
+#include "../Firmware/MEMs_Drivers/Bosch/bmi270.h"
+
+extern "C" const uint8_t bmi270_config_file[];
+
+//Times the startup of the Personal Caddie from power up until the sensors are configured, the way the firmware used to
+//do it and the way it does it now. The TWI buses are simulated at 400 kHz underneath the real transfer queue, and the
+//BMI270 is a register file that the real Bosch driver uploads its config file to, so the configure stage is the actual
+//sequence of transfers the firmware makes. See readme.txt for how to build it.
+
+namespace
+{
+    const double BIT_US = 2.5; //400 kHz
+    const int BYTE_BITS = 9; //8 data bits and the ACK
+    const uint8_t BMI270_ADDRESS = 0x68;
+    const uint16_t BMI2_CONFIG_SIZE = 8192;
+
+    struct Options
+    {
+        double powerUpUs = 2000.0; //how long the sensors take to start answering once they have power
+        double overheadUs = 15.0; //CPU time around each transfer (starting EasyDMA, the interrupt and waking up from __WFE)
+        int burst = 1024; //BMI270_CONFIG_BURST_LENGTH
+        std::vector<uint8_t> internalSensors = { 0x10, 0x68 }; //BMM150 and BMI270
+        std::vector<uint8_t> externalSensors;
+    };
+
+    //Simulated time, everything that happens in the startup adds to it
+    double g_clockUs = 0.0;
+
+    //The fake BMI270. INIT_DATA writes go into the config image at the word address set through INIT_ADDR_0/1, which
+    //moves along with every write the way the sensor's does.
+    struct FakeBmi270
+    {
+        uint8_t registers[256];
+        std::vector<uint8_t> image;
+        uint32_t imageAddress = 0; //in bytes
+
+        void reset()
+        {
+            memset(registers, 0, sizeof(registers));
+            registers[0x00] = 0x24; //BMI270_CHIP_ID
+            registers[0x21] = 0x01; //internal status: initialization ok
+            image.assign(BMI2_CONFIG_SIZE, 0);
+            imageAddress = 0;
+        }
+
+        void write(uint8_t reg, const uint8_t* data, uint16_t length)
+        {
+            if (reg == BMI2_INIT_DATA_ADDR)
+            {
+                for (uint16_t i = 0; i < length; i++)
+                {
+                    if (imageAddress < image.size()) image[imageAddress] = data[i];
+                    imageAddress++;
+                }
+                return;
+            }
+
+            for (uint16_t i = 0; i < length; i++) registers[(uint8_t)(reg + i)] = data[i];
+            if (reg <= BMI2_INIT_ADDR_0 + 1 && reg + length > BMI2_INIT_ADDR_0)
+            {
+                imageAddress = 2 * ((registers[BMI2_INIT_ADDR_0] & 0x0F) | (registers[BMI2_INIT_ADDR_0 + 1] << 4));
+            }
+        }
+
+        void read(uint8_t reg, uint8_t* data, uint16_t length)
+        {
+            for (uint16_t i = 0; i < length; i++) data[i] = registers[(uint8_t)(reg + i)];
+        }
+    };
+
+    FakeBmi270 g_bmi270;
+
+    //The simulated TWI backend. A started transfer finishes immediately as far as the sensor is concerned but the
+    //completion only gets delivered when the caller "sleeps", the same way the firmware waits in wait_for_transfer().
+    struct BusStats
+    {
+        uint32_t transfers = 0;
+        uint64_t bytes = 0;
+    };
+
+    BusStats g_busStats;
+    bool g_pending[TWI_QUEUE_BUSES] = {};
+    double g_overheadUs = 15.0;
+
+    double transferUs(uint16_t writeBytes, uint16_t readBytes)
+    {
+        //Start, address byte, the written bytes, then a repeated start, the address again and the read bytes, and stop
+        double bits = 2.0 + BYTE_BITS * (1 + writeBytes);
+        if (readBytes > 0) bits += 1.0 + BYTE_BITS * (1 + readBytes);
+        return g_overheadUs + bits * BIT_US;
+    }
+
+    int32_t backendStart(uint8_t bus, twi_transfer_t const* transfer)
+    {
+        if (transfer->address != BMI270_ADDRESS) return -1;
+
+        const uint8_t* primary = transfer->p_primary_buf;
+        if (transfer->p_read_buf != NULL) g_bmi270.read(primary[0], transfer->p_read_buf, transfer->read_length);
+        else g_bmi270.write(primary[0], primary + 1, transfer->primary_length - 1);
+
+        g_clockUs += transferUs(transfer->primary_length, transfer->p_read_buf != NULL ? transfer->read_length : 0);
+        g_busStats.transfers++;
+        g_busStats.bytes += transfer->primary_length + (transfer->p_read_buf != NULL ? transfer->read_length : 0);
+        g_pending[bus] = true;
+        return TWI_QUEUE_SUCCESS;
+    }
+
+    uint32_t backendTime()
+    {
+        return (uint32_t)g_clockUs;
+    }
+
+    struct BlockingTransfer
+    {
+        volatile bool done = false;
+        int32_t result = 0;
+    };
+
+    void blockingTransferDone(int32_t result, void* p_context)
+    {
+        BlockingTransfer* p_transfer = (BlockingTransfer*)p_context;
+        p_transfer->result = result;
+        p_transfer->done = true;
+    }
+
+    int32_t waitForTransfer(int32_t queueResult, BlockingTransfer* p_transfer)
+    {
+        if (queueResult != TWI_QUEUE_SUCCESS) return queueResult;
+        while (!p_transfer->done)
+        {
+            //The TWI interrupt
+            for (uint8_t bus = 0; bus < TWI_QUEUE_BUSES; bus++)
+            {
+                if (!g_pending[bus]) continue;
+                g_pending[bus] = false;
+                twi_queue_transfer_complete(bus, TWI_QUEUE_SUCCESS);
+            }
+        }
+        return p_transfer->result;
+    }
+
+    //The register access methods the Bosch driver gets, the same as bmi270_read_register() and bmi270_write_register()
+    //in bmi270_drv.c going through sensor_read_register(), sensor_write_register() and sensor_write_burst() in pc_twi.c
+    bool g_useBursts = true;
+    uint8_t g_burstBuffer[1 + 4096];
+    int g_burstLength = 1024;
+
+    int8_t readRegister(uint8_t reg, uint8_t* data, uint32_t length, void*)
+    {
+        BlockingTransfer transfer;
+        return (int8_t)waitForTransfer(twi_queue_read(0, BMI270_ADDRESS, reg, data, (uint16_t)length, blockingTransferDone, &transfer, NULL), &transfer);
+    }
+
+    int8_t writeRegister(uint8_t reg, const uint8_t* data, uint32_t length, void*)
+    {
+        BlockingTransfer transfer;
+        if (length <= TWI_QUEUE_MAX_WRITE_LENGTH || !g_useBursts)
+        {
+            return (int8_t)waitForTransfer(twi_queue_write(0, BMI270_ADDRESS, reg, data, (uint16_t)length, blockingTransferDone, &transfer, NULL), &transfer);
+        }
+        if (length > (uint32_t)g_burstLength) return BMI2_E_COM_FAIL;
+
+        g_burstBuffer[0] = reg;
+        memcpy(g_burstBuffer + 1, data, length);
+        return (int8_t)waitForTransfer(twi_queue_write_burst(0, BMI270_ADDRESS, g_burstBuffer, (uint16_t)(length + 1), blockingTransferDone, &transfer, NULL), &transfer);
+    }
+
+    void delayUs(uint32_t period, void*)
+    {
+        g_clockUs += period;
+    }
+
+    struct ConfigureResult
+    {
+        int8_t result = 0;
+        double us = 0.0;
+        uint32_t transfers = 0;
+        uint64_t bytes = 0;
+        bool imageMatches = false;
+    };
+
+    ConfigureResult configureBmi270(bool bursts, int readWriteLength)
+    {
+        //Runs the Bosch driver's initialization (soft reset, config file upload, feature pages) against the fake sensor
+        twi_queue_backend_t backend = { backendStart, backendTime, NULL, NULL };
+        twi_queue_init(&backend);
+        g_bmi270.reset();
+        g_busStats = BusStats();
+        g_useBursts = bursts;
+        g_clockUs = 0.0;
+
+        struct bmi2_dev device;
+        memset(&device, 0, sizeof(device));
+        device.intf = BMI2_I2C_INTF;
+        device.read = readRegister;
+        device.write = writeRegister;
+        device.delay_us = delayUs;
+        device.read_write_len = (uint16_t)readWriteLength;
+
+        ConfigureResult result;
+        result.result = bmi270_init(&device);
+        result.us = g_clockUs;
+        result.transfers = g_busStats.transfers;
+        result.bytes = g_busStats.bytes;
+        result.imageMatches = (device.config_size == BMI2_CONFIG_SIZE) && memcmp(g_bmi270.image.data(), bmi270_config_file, BMI2_CONFIG_SIZE) == 0;
+        return result;
+    }
+
+    //A probe is a one byte read from an address with nothing in front of it, the sensors that are there ACK it and the
+    //rest NACK the address byte
+    double probeUs(bool present)
+    {
+        double bits = 2.0 + BYTE_BITS * (present ? 2 : 1);
+        return g_overheadUs + bits * BIT_US;
+    }
+
+    bool isPresent(const std::vector<uint8_t>& sensors, int address)
+    {
+        for (uint8_t sensor : sensors) if (sensor == address) return true;
+        return false;
+    }
+
+    double fullScanUs(const std::vector<uint8_t>& sensors)
+    {
+        double us = 0.0;
+        for (int address = 0; address < 128; address++) us += probeUs(isPresent(sensors, address));
+        return us;
+    }
+
+    double cachedCheckUs(const Options& options, int* rounds)
+    {
+        //Probes just the cached addresses on both buses at once, every BOOT_CACHE_PROBE_INTERVAL_US until they all
+        //answer. Nothing answers until the sensors have finished powering up.
+        double us = 0.0;
+        *rounds = 0;
+        for (;;)
+        {
+            bool answered = (us >= options.powerUpUs);
+            double internalUs = 0.0, externalUs = 0.0;
+            for (size_t i = 0; i < options.internalSensors.size(); i++) internalUs += probeUs(answered);
+            for (size_t i = 0; i < options.externalSensors.size(); i++) externalUs += probeUs(answered);
+            us += std::fmax(internalUs, externalUs);
+            (*rounds)++;
+
+            if (answered) return us;
+            if (us >= BOOT_CACHE_POWER_ON_TIMEOUT_US) return -1.0;
+            us += BOOT_CACHE_PROBE_INTERVAL_US;
+        }
+    }
+
+    bool checkCache(const Options& options)
+    {
+        //Makes sure a record survives being saved and read back, and that anything wrong with one gets it thrown away
+        bool ok = true;
+        uint8_t internalSensors[BOOT_CACHE_MAX_SENSORS], externalSensors[BOOT_CACHE_MAX_SENSORS];
+        uint8_t settings[BOOT_CACHE_SETTINGS_LENGTH];
+        for (size_t i = 0; i < options.internalSensors.size(); i++) internalSensors[i] = options.internalSensors[i];
+        for (size_t i = 0; i < options.externalSensors.size(); i++) externalSensors[i] = options.externalSensors[i];
+        for (int i = 0; i < BOOT_CACHE_SETTINGS_LENGTH; i++) settings[i] = (uint8_t)(i * 7);
+
+        uint8_t internalCount = (uint8_t)options.internalSensors.size(), externalCount = (uint8_t)options.externalSensors.size();
+        boot_cache_t cache, again;
+        boot_cache_build(&cache, internalSensors, internalCount, externalSensors, externalCount, settings);
+        boot_cache_build(&again, internalSensors, internalCount, externalSensors, externalCount, settings);
+
+        if (sizeof(boot_cache_t) % 4 != 0) { printf("boot_cache_t is %d bytes, flash records need a multiple of 4\n", (int)sizeof(boot_cache_t)); ok = false; }
+        if (!boot_cache_valid(&cache)) { printf("A freshly built record isn't valid\n"); ok = false; }
+        if (!boot_cache_equal(&cache, &again)) { printf("Two records of the same setup aren't equal\n"); ok = false; }
+        if (!boot_cache_confirmed(&cache, internalCount, externalCount)) { printf("A record isn't confirmed when all of its sensors answer\n"); ok = false; }
+        if (boot_cache_confirmed(&cache, internalCount > 0 ? internalCount - 1 : 0, externalCount) && internalCount > 0) { printf("A record is confirmed with a sensor missing\n"); ok = false; }
+
+        //Flip every bit of the record one at a time, none of them can get through
+        int accepted = 0;
+        for (size_t byte = 0; byte < sizeof(boot_cache_t); byte++)
+        {
+            if (byte >= offsetof(boot_cache_t, reserved)) continue; //the padding is covered by the CRC but changes nothing
+            for (int bit = 0; bit < 8; bit++)
+            {
+                boot_cache_t corrupt = cache;
+                ((uint8_t*)&corrupt)[byte] ^= (uint8_t)(1 << bit);
+                if (boot_cache_valid(&corrupt)) accepted++;
+            }
+        }
+        if (accepted > 0) { printf("%d single bit errors got through the record checks\n", accepted); ok = false; }
+
+        boot_cache_t empty;
+        boot_cache_invalidate(&empty);
+        if (boot_cache_valid(&empty)) { printf("An erased record is valid\n"); ok = false; }
+
+        //The boot timing has to come back out of the characteristic the same way it went in
+        boot_timing_t timing = { BOOT_DISCOVERY_CACHED, 123456, 2345, 67890, 4321 }, decoded;
+        uint8_t characteristic[BOOT_TIMING_OFFSET + BOOT_TIMING_SIZE];
+        boot_timing_encode(&timing, characteristic + BOOT_TIMING_OFFSET);
+        boot_timing_decode(characteristic + BOOT_TIMING_OFFSET, &decoded);
+        uint32_t total = characteristic[BOOT_TIMING_OFFSET + 17] | (characteristic[BOOT_TIMING_OFFSET + 18] << 8) |
+            (characteristic[BOOT_TIMING_OFFSET + 19] << 16) | ((uint32_t)characteristic[BOOT_TIMING_OFFSET + 20] << 24);
+        if (memcmp(&timing, &decoded, sizeof(timing)) != 0 || total != boot_timing_total_us(&timing))
+        {
+            printf("The boot timing doesn't survive the available sensors characteristic\n");
+            ok = false;
+        }
+
+        return ok;
+    }
+
+    std::vector<uint8_t> parseAddresses(const char* text)
+    {
+        std::vector<uint8_t> addresses;
+        std::string list = text;
+        size_t start = 0;
+        while (start < list.size())
+        {
+            size_t end = list.find(',', start);
+            if (end == std::string::npos) end = list.size();
+            if (end > start) addresses.push_back((uint8_t)strtol(list.substr(start, end - start).c_str(), NULL, 0));
+            start = end + 1;
+        }
+        return addresses;
+    }
+
+    void usage()
+    {
+        printf("Usage: boot_budget [options]\n");
+        printf("  --power-up us        time the sensors take to answer after being powered (default 2000)\n");
+        printf("  --overhead us        CPU time around each TWI transfer (default 15)\n");
+        printf("  --burst bytes        config file bytes per burst, even and at most 4096 (default 1024)\n");
+        printf("  --internal a,b,...   addresses on the internal bus (default 0x10,0x68)\n");
+        printf("  --external a,b,...   addresses on the external bus (default none)\n");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+        if (arg == "--power-up" && hasValue) options.powerUpUs = atof(argv[++i]);
+        else if (arg == "--overhead" && hasValue) options.overheadUs = atof(argv[++i]);
+        else if (arg == "--burst" && hasValue) options.burst = atoi(argv[++i]);
+        else if (arg == "--internal" && hasValue) options.internalSensors = parseAddresses(argv[++i]);
+        else if (arg == "--external" && hasValue) options.externalSensors = parseAddresses(argv[++i]);
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    if (options.burst < 2 || options.burst > 4096 || options.burst % 2 != 0 || options.internalSensors.size() > BOOT_CACHE_MAX_SENSORS ||
+        options.externalSensors.size() > BOOT_CACHE_MAX_SENSORS || options.internalSensors.empty())
+    {
+        usage();
+        return 1;
+    }
+    g_overheadUs = options.overheadUs;
+    g_burstLength = options.burst;
+
+    bool ok = checkCache(options);
+
+    //Configure stage: the Bosch driver left at 2 bytes a chunk, and the bursts the firmware uses now
+    ConfigureResult before = configureBmi270(false, 2);
+    ConfigureResult after = configureBmi270(true, options.burst);
+    if (before.result != BMI2_OK || after.result != BMI2_OK)
+    {
+        printf("bmi270_init() failed (%d before, %d after)\n", before.result, after.result);
+        ok = false;
+    }
+    if (!before.imageMatches || !after.imageMatches)
+    {
+        printf("The config image in the sensor doesn't match bmi270_config_file (%s)\n", !after.imageMatches ? "bursts" : "2 byte chunks");
+        ok = false;
+    }
+
+    //Discovery stage: a fixed wait and then each bus scanned in turn, both buses scanned at once, and the cached
+    //addresses checked until they answer
+    double scanBeforeUs = BOOT_CACHE_POWER_ON_TIMEOUT_US + fullScanUs(options.internalSensors) + fullScanUs(options.externalSensors);
+    double scanAfterUs = BOOT_CACHE_POWER_ON_TIMEOUT_US + std::fmax(fullScanUs(options.internalSensors), fullScanUs(options.externalSensors));
+    int rounds = 0;
+    double cachedUs = cachedCheckUs(options, &rounds);
+    if (cachedUs < 0.0)
+    {
+        printf("The cached sensors never answered, --power-up is longer than BOOT_CACHE_POWER_ON_TIMEOUT_US\n");
+        ok = false;
+        cachedUs = scanAfterUs;
+    }
+
+    printf("Sensors: %d internal, %d external, answering %.0f us after power up\n\n", (int)options.internalSensors.size(),
+        (int)options.externalSensors.size(), options.powerUpUs);
+    printf("%-34s %12s %12s %12s\n", "stage (ms)", "before", "scan", "cached");
+    printf("%-34s %12.2f %12.2f %12.2f\n", "find sensors", scanBeforeUs / 1000.0, scanAfterUs / 1000.0, cachedUs / 1000.0);
+    printf("%-34s %12.2f %12.2f %12.2f\n", "configure BMI270", before.us / 1000.0, after.us / 1000.0, after.us / 1000.0);
+    printf("%-34s %12.2f %12.2f %12.2f\n", "total", (scanBeforeUs + before.us) / 1000.0, (scanAfterUs + after.us) / 1000.0, (cachedUs + after.us) / 1000.0);
+    printf("\nConfigure: %u transfers (%llu bytes) in 2 byte chunks, %u transfers (%llu bytes) in %d byte bursts\n",
+        before.transfers, (unsigned long long)before.bytes, after.transfers, (unsigned long long)after.bytes, options.burst);
+    printf("Cached check: %d round%s of %d probe%s\n", rounds, rounds == 1 ? "" : "s",
+        (int)(options.internalSensors.size() + options.externalSensors.size()), (options.internalSensors.size() + options.externalSensors.size()) == 1 ? "" : "s");
+
+    if (after.us >= before.us || cachedUs >= scanBeforeUs)
+    {
+        printf("The new startup isn't faster than the old one\n");
+        ok = false;
+    }
+
+    printf("\n%s\n", ok ? "All checks passed" : "FAILED");
+    return ok ? 0 : 1;
+}
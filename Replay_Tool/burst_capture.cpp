@@ -0,0 +1,231 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../DirectXApp/Devices/VirtualPersonalCaddie.h"
+#include "../DirectXApp/Devices/SwingBurst.h"
+
+//Checks swing burst capture from end to end. A synthetic practice session is read at the full ODR the Personal Caddie
+//uses for bursts and every sample goes through the firmware's burst_capture code exactly like burst_fifo_data_read()
+//in main.c hands them over. Frozen windows get sent a notification at a time (at a limited rate, the way the live
+//stream leaves room in the notification queue) and put back together by the same BurstAssembler the app uses. Every
+//window that comes out the other end is compared sample for sample with what the sensors read.
+//See readme.txt for how to build it.
+
+namespace
+{
+    const double TICKS_PER_SECOND = BURST_CAPTURE_TICK_FREQUENCY;
+    const int DEFAULT_CAPACITY = 9 + 39 * 6; //BURST_DATA_CHARACTERISTIC_SIZE in ble_sensor_service.h
+    const int QUEUE_LIMIT = 6; //BURST_NOTIFICATION_QUEUE_LIMIT in main.c, burst notifications can't pile up past this
+
+    struct Options
+    {
+        double seconds = 60.0;
+        float threshold = 1000.0f; //deg/s
+        int preMs = BURST_CAPTURE_DEFAULT_PRE_MS;
+        int postMs = BURST_CAPTURE_DEFAULT_POST_MS;
+        int capacity = DEFAULT_CAPACITY;
+        double rate = 400.0; //burst notifications per second
+        double drop = 0.0; //chance of a burst notification going missing
+        uint32_t startTicks = 0xFFFFFFFF - 16000000; //the 32-bit time stamp wraps a second in
+    };
+
+    struct BurstCheck
+    {
+        int bursts = 0;
+        int mismatched = 0; //windows whose readings or time stamps don't match what the sensors read
+        int badTriggers = 0; //trigger samples that aren't the first sample over the threshold
+        int incomplete = 0;
+        uint64_t samples = 0;
+        double triggerSeconds = 0.0; //sum of how far into each swing cycle the trigger went off, for the average
+        double worstCalibratedError = 0.0; //deg/s, the gyroscope readings after going through the decoder
+    };
+
+    void usage(const char* name)
+    {
+        printf("Usage: %s [--seconds <session length>] [--threshold <deg/s>] [--pre <ms>] [--post <ms>] [--capacity <bytes per notification>] [--rate <burst notifications per second>] [--drop <fraction>]\n", name);
+    }
+
+    void writeSample(const int16_t* readings, uint8_t* sample)
+    {
+        for (int i = 0; i < SWING_BURST_CHANNELS; i++)
+        {
+            sample[2 * i] = (uint8_t)((uint16_t)readings[i] & 0xFF);
+            sample[2 * i + 1] = (uint8_t)((uint16_t)readings[i] >> 8);
+        }
+    }
+
+    double gyroscopeMagnitude(const int16_t* readings)
+    {
+        return std::sqrt((double)readings[3] * readings[3] + (double)readings[4] * readings[4] + (double)readings[5] * readings[5]);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--seconds" && i + 1 < argc) options.seconds = atof(argv[++i]);
+        else if (argument == "--threshold" && i + 1 < argc) options.threshold = (float)atof(argv[++i]);
+        else if (argument == "--pre" && i + 1 < argc) options.preMs = atoi(argv[++i]);
+        else if (argument == "--post" && i + 1 < argc) options.postMs = atoi(argv[++i]);
+        else if (argument == "--capacity" && i + 1 < argc) options.capacity = atoi(argv[++i]);
+        else if (argument == "--rate" && i + 1 < argc) options.rate = atof(argv[++i]);
+        else if (argument == "--drop" && i + 1 < argc) options.drop = atof(argv[++i]);
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (options.seconds <= 0.0 || options.threshold <= 0.0f || options.preMs < 0 || options.postMs < 0 || options.capacity <= BURST_CAPTURE_HEADER_SIZE ||
+        options.capacity > 1024 || options.rate <= 0.0 || options.drop < 0.0 || options.drop >= 1.0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    //Every reading the sensors put out is kept so the windows can be checked against them
+    const float odr = BURST_CAPTURE_ODR;
+    const uint64_t total_samples = (uint64_t)(options.seconds * odr);
+    SyntheticSwingSource source(odr);
+    std::vector<int16_t> readings(total_samples * SWING_BURST_CHANNELS);
+    for (uint64_t sample = 0; sample < total_samples; sample++) source.read(sample, &readings[sample * SWING_BURST_CHANNELS]);
+
+    const double ticks_per_sample = TICKS_PER_SECOND / odr;
+    uint16_t threshold_lsb = (uint16_t)std::min(options.threshold * VIRTUAL_GYR_LSB_PER_UNIT, 32767.0f);
+
+    burst_capture_t* burst = new burst_capture_t;
+    burst_capture_init(burst);
+    burst_capture_configure(burst, true, threshold_lsb, (uint16_t)options.preMs, (uint16_t)options.postMs);
+    burst_capture_start(burst, odr);
+
+    //The app's decoder with identity calibration, so the gyroscope should come out as the readings over the LSB per deg/s
+    CompositeDataDecoder decoder;
+    const int axis_swap[COMPOSITE_AXES] = { 0, 1, 2 }, axis_polarity[COMPOSITE_AXES] = { 1, 1, 1 };
+    const float offset[COMPOSITE_AXES] = { 0.0f, 0.0f, 0.0f };
+    const float gain_rows[COMPOSITE_AXES][COMPOSITE_AXES] = { { 1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f } };
+    const float* gain[COMPOSITE_AXES] = { gain_rows[0], gain_rows[1], gain_rows[2] };
+    for (int sensor = 0; sensor < COMPOSITE_SENSORS; sensor++)
+    {
+        decoder.setSensorTable(sensor, VirtualPersonalCaddie::defaultConversionRate(sensor), axis_swap, axis_polarity, offset, gain);
+    }
+    SwingBurst converted;
+
+    BurstCheck check;
+    BurstAssembler assembler([&](RawBurst const& raw)
+        {
+            //Work out which sample the window starts on from its time stamp, the same way the app lines bursts up with
+            //the live stream, then compare every sample that made it over with what the sensors read
+            check.bursts++;
+            check.samples += raw.header.window_samples;
+            if (raw.missingSamples() > 0) check.incomplete++;
+
+            double ticks_since_start = (double)(uint32_t)(raw.header.window_ticks - options.startTicks);
+            int64_t first_sample = (int64_t)std::llround(ticks_since_start / ticks_per_sample);
+            bool matched = std::fabs(raw.header.ticks_per_sample - ticks_per_sample) < 1.0 / 256.0;
+            for (int i = 0; i < raw.header.window_samples && matched; i++)
+            {
+                if (!raw.received[i]) continue;
+                int64_t sample = first_sample + i;
+                if (sample < 0 || (uint64_t)sample >= total_samples)
+                {
+                    matched = false;
+                    break;
+                }
+                for (int channel = 0; channel < SWING_BURST_CHANNELS; channel++)
+                {
+                    if (raw.readings[channel * BURST_CAPTURE_MAX_SAMPLES + i] != readings[sample * SWING_BURST_CHANNELS + channel]) matched = false;
+                }
+            }
+            if (!matched)
+            {
+                check.mismatched++;
+                return;
+            }
+
+            //The trigger has to be the first sample over the threshold after the gyroscope was last quiet
+            int64_t trigger = first_sample + raw.header.trigger_index;
+            bool good_trigger = gyroscopeMagnitude(&readings[trigger * SWING_BURST_CHANNELS]) >= threshold_lsb &&
+                (trigger == 0 || gyroscopeMagnitude(&readings[(trigger - 1) * SWING_BURST_CHANNELS]) < threshold_lsb);
+            if (!good_trigger) check.badTriggers++;
+            check.triggerSeconds += std::fmod(trigger / (double)odr, 6.25); //how long a synthetic swing cycle lasts
+
+            CompositeDecodeOutput output;
+            for (int channel = 0; channel < SWING_BURST_CHANNELS; channel++) output.calibrated[channel / COMPOSITE_AXES][channel % COMPOSITE_AXES] = converted.channels[channel].data();
+            int samples = decoder.convertReadings(raw.readings.data(), BURST_CAPTURE_MAX_SAMPLES, raw.header.window_samples, output);
+            for (int i = 0; i < samples; i++)
+            {
+                if (!raw.received[i]) continue;
+                for (int axis = 0; axis < COMPOSITE_AXES; axis++)
+                {
+                    double expected = readings[(first_sample + i) * SWING_BURST_CHANNELS + COMPOSITE_AXES + axis] / VIRTUAL_GYR_LSB_PER_UNIT;
+                    check.worstCalibratedError = std::max(check.worstCalibratedError, std::fabs(converted.at(1, axis, i) - expected));
+                }
+            }
+        });
+
+    //Samples go in one at a time, burst notifications go out whenever the rate allows. Nothing goes into the buffer
+    //while a window is waiting to be sent, which is how long the Personal Caddie is blind to a new swing.
+    std::mt19937 generator(7);
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+    std::vector<uint8_t> notification(options.capacity);
+    uint8_t sample_bytes[BURST_CAPTURE_SAMPLE_SIZE];
+    double credit = 0.0;
+    uint64_t notifications = 0, dropped = 0, bytes = 0, blind_samples = 0, frozen_at = 0;
+    double transfer_seconds = 0.0;
+
+    for (uint64_t sample = 0; sample < total_samples; sample++)
+    {
+        uint32_t time_stamp = options.startTicks + (uint32_t)std::llround(sample * ticks_per_sample);
+        writeSample(&readings[sample * SWING_BURST_CHANNELS], sample_bytes);
+        if (burst->state == BURST_CAPTURE_FROZEN) blind_samples++;
+        if (burst_capture_add(burst, sample_bytes, time_stamp)) frozen_at = sample;
+
+        credit = std::min(credit + options.rate / odr, (double)QUEUE_LIMIT);
+        while (credit >= 1.0 && burst_capture_pending(burst))
+        {
+            uint16_t length = 0;
+            uint8_t count = burst_capture_chunk(burst, notification.data(), (uint16_t)notification.size(), &length);
+            if (count == 0) break;
+
+            credit -= 1.0;
+            notifications++;
+            bytes += length;
+            if (chance(generator) < options.drop) dropped++;
+            else assembler.addPacket(notification.data(), length);
+
+            burst_capture_chunk_sent(burst, count);
+            if (!burst_capture_pending(burst)) transfer_seconds += (sample + 1 - frozen_at) / (double)odr;
+        }
+    }
+    assembler.flush();
+
+    BurstStats const& stats = assembler.stats();
+    printf("%.0f seconds at %.0f Hz, threshold %.0f deg/s (%u LSB), window %d + 1 + %d samples, %d byte notifications at up to %.0f per second\n",
+        options.seconds, odr, options.threshold, threshold_lsb, burst->pre_samples, burst->post_samples, options.capacity, options.rate);
+    printf("bursts: %d (%llu complete, %llu incomplete), %llu samples, %d mismatched, %d bad triggers\n", check.bursts,
+        (unsigned long long)stats.bursts_complete, (unsigned long long)stats.bursts_incomplete, (unsigned long long)check.samples, check.mismatched, check.badTriggers);
+    if (check.bursts > 0)
+    {
+        printf("per burst: %.1f notifications, %.0f bytes (%.1f bytes per sample), %.0f ms to send, trigger %.3f s into the swing cycle\n",
+            (double)notifications / check.bursts, (double)bytes / check.bursts, (double)bytes / std::max<uint64_t>(check.samples, 1),
+            1000.0 * transfer_seconds / check.bursts, check.triggerSeconds / check.bursts);
+    }
+    printf("notifications: %llu sent, %llu dropped, %llu ignored by the assembler, %llu samples missing\n", (unsigned long long)notifications,
+        (unsigned long long)dropped, (unsigned long long)stats.packets_ignored, (unsigned long long)stats.samples_missing);
+    printf("blind while sending: %.1f%% of samples, worst calibrated gyroscope error %.6f deg/s\n", 100.0 * blind_samples / total_samples, check.worstCalibratedError);
+
+    bool passed = check.bursts > 0 && check.mismatched == 0 && check.badTriggers == 0 && check.worstCalibratedError < 1e-3 &&
+        (options.drop > 0.0 || check.incomplete == 0);
+    printf("\n%s\n", passed ? "Every burst matched what the sensors read" : "Some bursts didn't match what the sensors read");
+    delete burst;
+    return passed ? 0 : 1;
+}
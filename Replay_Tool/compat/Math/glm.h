@@ -0,0 +1,32 @@
+#pragma once
+
+//Stand-in for DirectXApp/Math/glm.h so that sensor_fusion.cpp and quaternion_functions.cpp can be built and
+//benchmarked on platforms that don't have glm installed. It only has the parts of glm::quat and glm::vec3 those
+//two files use, laid out and constructed the same way as glm's (a quaternion is built from w, x, y, z). Nothing
+//else should include this, it comes before ../DirectXApp on the include path of the Linux tools that need it.
+
+namespace glm
+{
+	struct quat
+	{
+		float x, y, z, w;
+
+		quat() : x(0.0f), y(0.0f), z(0.0f), w(1.0f) {}
+		quat(float w_, float x_, float y_, float z_) : x(x_), y(y_), z(z_), w(w_) {}
+
+		quat& operator+=(quat const& q) { w += q.w; x += q.x; y += q.y; z += q.z; return *this; }
+		quat& operator*=(float s) { w *= s; x *= s; y *= s; z *= s; return *this; }
+	};
+
+	inline quat operator+(quat const& a, quat const& b) { return quat(a.w + b.w, a.x + b.x, a.y + b.y, a.z + b.z); }
+	inline quat operator*(quat const& q, float s) { return quat(q.w * s, q.x * s, q.y * s, q.z * s); }
+	inline quat operator*(float s, quat const& q) { return q * s; }
+
+	struct vec3
+	{
+		float x, y, z;
+
+		float operator[](int i) const { return (i == 0) ? x : (i == 1) ? y : z; }
+		float& operator[](int i) { return (i == 0) ? x : (i == 1) ? y : z; }
+	};
+}
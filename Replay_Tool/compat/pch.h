@@ -0,0 +1,5 @@
+#pragma once
+
+//Stand-in for DirectXApp/pch.h. The real precompiled header pulls in WinRT and Direct3D, none of which the files
+//in DirectXApp/Math that get built from here actually use. Only put this directory on the include path in front
+//of ../DirectXApp, see fusion_benchmark in readme.txt.
@@ -0,0 +1,394 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../DirectXApp/Devices/CompositeDataDecoder.h"
+
+//Turns recorded data sets (time, gyroscope, accelerometer and magnetometer columns like the files in
+//Console_Application/Resources/Data_Sets) into raw composite characteristic notifications holding 39 samples each
+//and decodes them two ways: with the single pass CompositeDataDecoder the app uses now, and with a copy of the
+//decode PersonalCaddie used to do (a DataReader style ReadInt16() per axis, the conversion rate and axis swap applied
+//while reading, then a second calibration pass through getDataPoint()/setDataPoint()). Checks that both give the same
+//numbers and reports how long each takes per sample (the fastest of a few rounds). See readme.txt for how to build it.
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    const int CHANNELS = COMPOSITE_SENSORS * COMPOSITE_AXES;
+
+    //LSB per unit of the text files (m/s^2, degrees/s and gauss) with the default Personal Caddie settings, see packing_benchmark.cpp
+    const float DEFAULT_LSB_PER_UNIT[COMPOSITE_SENSORS] = { 8192.0f / 9.80665f, 16.384f, 100.0f / 0.3f };
+
+    //Calibration numbers from Console_Application/Resources/Calibration_Files, and a magnetometer that's mounted with
+    //its x and y axes swapped and z flipped relative to the BMI270 (like the BMM150 on the Personal Caddie) so the
+    //axis swap gets exercised too
+    const float OFFSETS[COMPOSITE_SENSORS][COMPOSITE_AXES] = {
+        { 0.328807f, -0.208574f, -0.18676f },
+        { -0.875448f, 0.239054f, 0.94401f },
+        { 13.5726f, -0.141811f, 11.7927f } };
+    const float GAINS[COMPOSITE_SENSORS][COMPOSITE_AXES][COMPOSITE_AXES] = {
+        { { 1.00258f, 0.0293697f, 0.00179472f }, { 0.0313978f, 0.992218f, -0.0141609f }, { -0.0150812f, 0.00137732f, 1.00315f } },
+        { { 1.57718f, 0.0f, 0.0f }, { 0.0f, 1.55605f, 0.0f }, { 0.0f, 0.0f, 1.52758f } },
+        { { 0.961256f, 0.00366707f, 0.0153506f }, { 0.00366712f, 1.01872f, -0.0246212f }, { 0.0153506f, -0.0246214f, 1.01808f } } };
+    const int AXIS_SWAP[COMPOSITE_SENSORS][COMPOSITE_AXES] = { { 0, 1, 2 }, { 0, 1, 2 }, { 1, 0, 2 } };
+    const int AXIS_POLARITY[COMPOSITE_SENSORS][COMPOSITE_AXES] = { { 1, 1, 1 }, { 1, 1, 1 }, { 1, 1, -1 } };
+
+    struct Recording
+    {
+        std::vector<int16_t> readings[CHANNELS]; //acc xyz, gyr xyz, mag xyz to match the composite characteristic
+        float odr = 400.0f;
+    };
+
+    bool loadRecording(const char* file_location, Recording& recording)
+    {
+        FILE* file = fopen(file_location, "r");
+        if (file == nullptr) return false;
+
+        //The text files hold gyroscope readings before accelerometer readings, the composite characteristic is the other way around
+        const int column_order[CHANNELS] = { 3, 4, 5, 0, 1, 2, 6, 7, 8 };
+        std::vector<float> time;
+
+        char line[512];
+        while (fgets(line, sizeof(line), file) != nullptr)
+        {
+            float values[1 + CHANNELS];
+            char* position = line;
+            int column = 0;
+            for (; column < 1 + CHANNELS; column++)
+            {
+                char* end = nullptr;
+                values[column] = strtof(position, &end);
+                if (end == position) break;
+                position = end;
+            }
+            if (column < 1 + CHANNELS) continue;
+
+            time.push_back(values[0]);
+            for (int channel = 0; channel < CHANNELS; channel++)
+            {
+                //Turn the real units back into the readings the sensors would have sent with their default settings
+                long lsb = lrintf(values[1 + column_order[channel]] * DEFAULT_LSB_PER_UNIT[channel / COMPOSITE_AXES]);
+                recording.readings[channel].push_back((int16_t)((lsb > 32767) ? 32767 : ((lsb < -32768) ? -32768 : lsb)));
+            }
+        }
+        fclose(file);
+        if (time.empty()) return false;
+
+        if (time.size() > 1 && time[1] > time[0]) recording.odr = 1.0f / (time[1] - time[0]);
+        return true;
+    }
+
+    //Splits the recording into raw (unpacked) notifications of samples_per_notification samples each, laid out the
+    //way the firmware sends them
+    void buildNotifications(Recording const& recording, int samples_per_notification, std::vector<std::vector<uint8_t>>& notifications)
+    {
+        size_t total_samples = recording.readings[0].size();
+        uint32_t ticks_per_sample = (uint32_t)(16000000.0 / recording.odr);
+        uint16_t sequence = 0;
+
+        for (size_t first = 0; first + samples_per_notification <= total_samples; first += samples_per_notification)
+        {
+            std::vector<uint8_t> bytes(COMPOSITE_HEADER_SIZE + samples_per_notification * COMPOSITE_SAMPLE_SIZE);
+            uint32_t timer_ticks = (uint32_t)(first * ticks_per_sample);
+            for (int byte = 0; byte < 4; byte++) bytes[byte] = (uint8_t)(timer_ticks >> (8 * byte));
+            bytes[4] = (uint8_t)samples_per_notification;
+            bytes[5] = (uint8_t)(sequence & 0xFF);
+            bytes[6] = (uint8_t)(sequence >> 8);
+
+            for (int i = 0; i < samples_per_notification; i++)
+            {
+                for (int channel = 0; channel < CHANNELS; channel++)
+                {
+                    uint16_t reading = (uint16_t)recording.readings[channel][first + i];
+                    bytes[COMPOSITE_HEADER_SIZE + i * COMPOSITE_SAMPLE_SIZE + 2 * channel] = (uint8_t)(reading & 0xFF);
+                    bytes[COMPOSITE_HEADER_SIZE + i * COMPOSITE_SAMPLE_SIZE + 2 * channel + 1] = (uint8_t)(reading >> 8);
+                }
+            }
+
+            notifications.push_back(bytes);
+            sequence++;
+        }
+    }
+
+    //Stand-in for Windows::Storage::Streams::DataReader, which checks the remaining length and assembles every value
+    //from the buffer one call at a time
+    class ByteReader
+    {
+    public:
+        ByteReader(const uint8_t* buffer, size_t length) : m_buffer(buffer), m_length(length), m_position(0) {}
+
+        uint8_t ReadByte()
+        {
+            if (m_position >= m_length) throw std::out_of_range("read past the end of the buffer");
+            return m_buffer[m_position++];
+        }
+        int16_t ReadInt16()
+        {
+            uint16_t low = ReadByte();
+            return (int16_t)(low | (ReadByte() << 8));
+        }
+        uint32_t ReadUInt32()
+        {
+            uint32_t value = 0;
+            for (int byte = 0; byte < 4; byte++) value |= (uint32_t)ReadByte() << (8 * byte);
+            return value;
+        }
+
+    private:
+        const uint8_t* m_buffer;
+        size_t m_length, m_position;
+    };
+
+    //What PersonalCaddie::compositeDataCharacteristicEventHandler() and updateRawDataWithCalibrationNumbers() did
+    //before CompositeDataDecoder, kept as close to the original as possible so the comparison is fair
+    class PerAxisDecoder
+    {
+    public:
+        enum DataType { RAW_ACCELERATION, RAW_ROTATION, RAW_MAGNETIC, ACCELERATION, ROTATION, MAGNETIC, END };
+
+        PerAxisDecoder() : number_of_samples(0)
+        {
+            sensor_data.resize(END, std::vector<std::vector<float>>(COMPOSITE_AXES, std::vector<float>(COMPOSITE_MAX_SAMPLES, 0.0f)));
+            for (int sensor = 0; sensor < COMPOSITE_SENSORS; sensor++)
+            {
+                for (int row = 0; row < COMPOSITE_AXES; row++) gain_rows[sensor][row] = GAINS[sensor][row];
+            }
+        }
+
+        int decode(const uint8_t* buffer, size_t length, uint32_t& timer_ticks)
+        {
+            ByteReader read_buffer(buffer, length);
+            timer_ticks = read_buffer.ReadUInt32();
+            number_of_samples = read_buffer.ReadByte();
+            read_buffer.ReadByte(); read_buffer.ReadByte(); //sequence number
+            read_buffer.ReadByte(); read_buffer.ReadByte(); //dropped packets
+
+            for (int i = 0; i < number_of_samples; i++)
+            {
+                for (int sensor = 0; sensor < COMPOSITE_SENSORS; sensor++)
+                {
+                    for (int axis = 0; axis < COMPOSITE_AXES; axis++)
+                    {
+                        int16_t axis_reading = read_buffer.ReadInt16();
+                        sensor_data[RAW_ACCELERATION + sensor][AXIS_SWAP[sensor][axis]][i] = axis_reading * getConversionRate(sensor) * AXIS_POLARITY[sensor][axis];
+                    }
+                }
+            }
+
+            for (int sensor = 0; sensor < COMPOSITE_SENSORS; sensor++) updateRawDataWithCalibrationNumbers(RAW_ACCELERATION + sensor, ACCELERATION + sensor, OFFSETS[sensor], gain_rows[sensor]);
+            return number_of_samples;
+        }
+
+        float getDataPoint(int dt, int a, int sample_number) const
+        {
+            if (sensor_data[0].size() == 0) return 0;
+            return sensor_data[dt][a][sample_number];
+        }
+
+    private:
+        //The IMU class looks the rate up from the current sensor settings every time it's called
+        float getConversionRate(int sensor) const { return 1.0f / DEFAULT_LSB_PER_UNIT[sensor]; }
+
+        void setDataPoint(int dt, int a, int sample_number, float data)
+        {
+            if (sensor_data[0].size() != 0) sensor_data[dt][a][sample_number] = data;
+        }
+
+        void updateRawDataWithCalibrationNumbers(int rdt, int dt, const float* offset_cal, const float* const* gain_cal)
+        {
+            for (int i = 0; i < number_of_samples; i++)
+            {
+                float r_x = getDataPoint(rdt, 0, i), r_y = getDataPoint(rdt, 1, i), r_z = getDataPoint(rdt, 2, i);
+
+                setDataPoint(dt, 0, i, (gain_cal[0][0] * (r_x - offset_cal[0])) + (gain_cal[0][1] * (r_y - offset_cal[1])) + (gain_cal[0][2] * (r_z - offset_cal[2])));
+                setDataPoint(dt, 1, i, (gain_cal[1][0] * (r_x - offset_cal[0])) + (gain_cal[1][1] * (r_y - offset_cal[1])) + (gain_cal[1][2] * (r_z - offset_cal[2])));
+                setDataPoint(dt, 2, i, (gain_cal[2][0] * (r_x - offset_cal[0])) + (gain_cal[2][1] * (r_y - offset_cal[1])) + (gain_cal[2][2] * (r_z - offset_cal[2])));
+            }
+        }
+
+        std::vector<std::vector<std::vector<float>>> sensor_data;
+        const float* gain_rows[COMPOSITE_SENSORS][COMPOSITE_AXES];
+        int number_of_samples;
+    };
+
+    struct DecoderOutputs
+    {
+        std::vector<float> values[2][CHANNELS]; //raw then calibrated
+        CompositeDecodeOutput output;
+
+        DecoderOutputs()
+        {
+            for (int kind = 0; kind < 2; kind++)
+            {
+                for (int channel = 0; channel < CHANNELS; channel++)
+                {
+                    values[kind][channel].resize(COMPOSITE_MAX_SAMPLES);
+                    float*& destination = (kind == 0) ? output.raw[channel / COMPOSITE_AXES][channel % COMPOSITE_AXES] : output.calibrated[channel / COMPOSITE_AXES][channel % COMPOSITE_AXES];
+                    destination = values[kind][channel].data();
+                }
+            }
+        }
+    };
+
+    void setupDecoder(CompositeDataDecoder& decoder)
+    {
+        for (int sensor = 0; sensor < COMPOSITE_SENSORS; sensor++)
+        {
+            const float* gain[COMPOSITE_AXES] = { GAINS[sensor][0], GAINS[sensor][1], GAINS[sensor][2] };
+            decoder.setSensorTable(sensor, 1.0f / DEFAULT_LSB_PER_UNIT[sensor], AXIS_SWAP[sensor], AXIS_POLARITY[sensor], OFFSETS[sensor], gain);
+        }
+    }
+
+    //Largest difference between the two decoders relative to the size of the readings on each sensor, the single pass
+    //decoder folds the calibration into one matrix so the rounding isn't identical
+    double compareDecoders(std::vector<std::vector<uint8_t>> const& notifications)
+    {
+        CompositeDataDecoder decoder;
+        setupDecoder(decoder);
+        DecoderOutputs outputs;
+        PerAxisDecoder per_axis;
+        double worst = 0.0;
+
+        for (std::vector<uint8_t> const& notification : notifications)
+        {
+            uint32_t ticks = 0, per_axis_ticks = 0;
+            int samples = decoder.decode(notification.data(), notification.size(), ticks, outputs.output);
+            int per_axis_samples = per_axis.decode(notification.data(), notification.size(), per_axis_ticks);
+            if (samples != per_axis_samples || ticks != per_axis_ticks) return INFINITY;
+
+            for (int kind = 0; kind < 2; kind++)
+            {
+                for (int channel = 0; channel < CHANNELS; channel++)
+                {
+                    int sensor = channel / COMPOSITE_AXES;
+                    double scale = 32768.0 / DEFAULT_LSB_PER_UNIT[sensor] + std::fabs(OFFSETS[sensor][0]) + std::fabs(OFFSETS[sensor][1]) + std::fabs(OFFSETS[sensor][2]);
+                    for (int i = 0; i < samples; i++)
+                    {
+                        float expected = per_axis.getDataPoint(kind * COMPOSITE_SENSORS + sensor, channel % COMPOSITE_AXES, i);
+                        double difference = std::fabs(outputs.values[kind][channel][i] - expected) / scale;
+                        if (difference > worst) worst = difference;
+                    }
+                }
+            }
+        }
+        return worst;
+    }
+
+    double singlePassSeconds(std::vector<std::vector<uint8_t>> const& notifications, int repeat, double& checksum)
+    {
+        CompositeDataDecoder decoder;
+        setupDecoder(decoder);
+        DecoderOutputs outputs;
+
+        Clock::time_point start = Clock::now();
+        for (int pass = 0; pass < repeat; pass++)
+        {
+            for (std::vector<uint8_t> const& notification : notifications)
+            {
+                uint32_t timer_ticks = 0;
+                int samples = decoder.decode(notification.data(), notification.size(), timer_ticks, outputs.output);
+                if (samples > 0) checksum += outputs.values[1][0][samples - 1];
+            }
+        }
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    double perAxisSeconds(std::vector<std::vector<uint8_t>> const& notifications, int repeat, double& checksum)
+    {
+        PerAxisDecoder decoder;
+
+        Clock::time_point start = Clock::now();
+        for (int pass = 0; pass < repeat; pass++)
+        {
+            for (std::vector<uint8_t> const& notification : notifications)
+            {
+                uint32_t timer_ticks = 0;
+                int samples = decoder.decode(notification.data(), notification.size(), timer_ticks);
+                if (samples > 0) checksum += decoder.getDataPoint(PerAxisDecoder::ACCELERATION, 0, samples - 1);
+            }
+        }
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int samples_per_notification = COMPOSITE_MAX_SAMPLES, repeat = 200, rounds = 5;
+    double tolerance = 1e-6;
+    std::vector<const char*> files;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--samples" && i + 1 < argc) samples_per_notification = atoi(argv[++i]);
+        else if (argument == "--repeat" && i + 1 < argc) repeat = atoi(argv[++i]);
+        else if (argument == "--rounds" && i + 1 < argc) rounds = atoi(argv[++i]);
+        else if (argument == "--tolerance" && i + 1 < argc) tolerance = atof(argv[++i]);
+        else if (argument.size() > 1 && argument[0] == '-')
+        {
+            printf("Usage: %s [--samples <samples per notification, 1 - %d>] [--repeat <decode passes>] [--rounds <timed rounds>] [--tolerance <relative difference>] <data set> [<data set> ...]\n", argv[0], COMPOSITE_MAX_SAMPLES);
+            return 1;
+        }
+        else files.push_back(argv[i]);
+    }
+    if (files.empty() || samples_per_notification < 1 || samples_per_notification > COMPOSITE_MAX_SAMPLES || repeat < 1 || rounds < 1)
+    {
+        printf("Usage: %s [--samples <samples per notification, 1 - %d>] [--repeat <decode passes>] [--rounds <timed rounds>] [--tolerance <relative difference>] <data set> [<data set> ...]\n", argv[0], COMPOSITE_MAX_SAMPLES);
+        return 1;
+    }
+
+    bool all_passed = true;
+    double checksum = 0.0;
+    printf("%-28s %9s %13s %14s %14s %8s %12s\n", "data set", "samples", "notifications", "per axis ns", "single ns", "speedup", "difference");
+
+    for (const char* file : files)
+    {
+        Recording recording;
+        if (!loadRecording(file, recording))
+        {
+            fprintf(stderr, "Couldn't read any samples from '%s'\n", file);
+            all_passed = false;
+            continue;
+        }
+
+        std::vector<std::vector<uint8_t>> notifications;
+        buildNotifications(recording, samples_per_notification, notifications);
+        if (notifications.empty())
+        {
+            fprintf(stderr, "'%s' doesn't hold enough samples for a single notification\n", file);
+            all_passed = false;
+            continue;
+        }
+        double total_samples = (double)notifications.size() * samples_per_notification;
+
+        double difference = compareDecoders(notifications);
+        bool passed = difference <= tolerance;
+        all_passed = all_passed && passed;
+
+        //Anything else running on the machine only ever makes a round slower, so the decoders take turns and the
+        //fastest round of each is the one that gets compared
+        double per_axis_seconds = INFINITY, single_seconds = INFINITY;
+        for (int round = 0; round < rounds; round++)
+        {
+            per_axis_seconds = std::fmin(per_axis_seconds, perAxisSeconds(notifications, repeat, checksum));
+            single_seconds = std::fmin(single_seconds, singlePassSeconds(notifications, repeat, checksum));
+        }
+
+        std::string name = file;
+        size_t slash = name.find_last_of("/\\");
+        if (slash != std::string::npos) name = name.substr(slash + 1);
+
+        printf("%-28s %9.0f %13zu %14.2f %14.2f %7.2fx %12.2e%s\n", name.c_str(), total_samples, notifications.size(),
+            1e9 * per_axis_seconds / (repeat * total_samples), 1e9 * single_seconds / (repeat * total_samples),
+            (single_seconds > 0.0) ? per_axis_seconds / single_seconds : 0.0, difference, passed ? "" : "  DECODERS DISAGREE");
+    }
+
+    if (checksum == 12345.678) printf("\n"); //keeps the decode loops from being optimized away
+    printf("\n%s\n", all_passed ? "Both decoders gave the same readings" : "The decoders didn't agree on every reading");
+    return all_passed ? 0 : 1;
+}
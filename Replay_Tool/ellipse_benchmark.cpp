@@ -0,0 +1,189 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "../DirectXApp/Math/ellipse_math.h"
+
+//Compares the magnetometer calibration numbers and run time of the original fit used by CalibrationMode (min/max
+//centering followed by ellipseBestFit()), the streaming EllipsoidFitter, and the streaming fit refined with
+//ellipseGaussNewtonFit(). Reads a file with x, y and z magnetometer columns like old_data/matlabMag.txt. See
+//readme.txt for how to build it.
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    struct MagData
+    {
+        std::vector<float> x, y, z;
+    };
+
+    struct FitResult
+    {
+        float offset[3];
+        float gain[9];
+        bool solved;
+    };
+
+    bool loadMagData(const char* file_location, MagData& data)
+    {
+        FILE* file = fopen(file_location, "r");
+        if (file == nullptr) return false;
+
+        float x, y, z;
+        while (fscanf(file, "%f %f %f", &x, &y, &z) == 3)
+        {
+            data.x.push_back(x);
+            data.y.push_back(y);
+            data.z.push_back(z);
+        }
+
+        fclose(file);
+        return !data.x.empty();
+    }
+
+    FitResult originalFit(MagData const& data)
+    {
+        //The same steps CalibrationMode::calculateCalNumbers() took before the streaming fit was added
+        FitResult result;
+        std::vector<float> mx = data.x, my = data.y, mz = data.z;
+
+        float mag_min[3] = { mx[0], my[0], mz[0] }, mag_max[3] = { mx[0], my[0], mz[0] };
+        for (size_t i = 0; i < mx.size(); i++)
+        {
+            mag_min[0] = std::fmin(mag_min[0], mx[i]); mag_max[0] = std::fmax(mag_max[0], mx[i]);
+            mag_min[1] = std::fmin(mag_min[1], my[i]); mag_max[1] = std::fmax(mag_max[1], my[i]);
+            mag_min[2] = std::fmin(mag_min[2], mz[i]); mag_max[2] = std::fmax(mag_max[2], mz[i]);
+        }
+        for (int i = 0; i < 3; i++) result.offset[i] = (mag_max[i] + mag_min[i]) / 2.0f;
+
+        for (size_t i = 0; i < mx.size(); i++)
+        {
+            mx[i] -= result.offset[0];
+            my[i] -= result.offset[1];
+            mz[i] -= result.offset[2];
+        }
+
+        ellipseBestFit(mx, my, mz, result.offset, result.gain);
+        result.solved = true;
+        return result;
+    }
+
+    FitResult streamingFit(MagData const& data)
+    {
+        FitResult result;
+        EllipsoidFitter fitter;
+        for (size_t i = 0; i < data.x.size(); i++) fitter.addSample(data.x[i], data.y[i], data.z[i]);
+        result.solved = fitter.solve(result.offset, result.gain);
+        return result;
+    }
+
+    FitResult refinedFit(MagData const& data)
+    {
+        FitResult result;
+        EllipsoidFitter fitter;
+        for (size_t i = 0; i < data.x.size(); i++) fitter.addSample(data.x[i], data.y[i], data.z[i]);
+
+        Eigen::MatrixXf parameters;
+        result.solved = fitter.solve(result.offset, parameters);
+        if (!result.solved) return result;
+
+        std::vector<float> mx(data.x.size()), my(data.y.size()), mz(data.z.size());
+        for (size_t i = 0; i < mx.size(); i++)
+        {
+            mx[i] = data.x[i] - result.offset[0];
+            my[i] = data.y[i] - result.offset[1];
+            mz[i] = data.z[i] - result.offset[2];
+        }
+
+        ellipseGaussNewtonFit(mx, my, mz, parameters);
+        ellipseParametersToCalibration(parameters, result.offset, result.gain);
+        return result;
+    }
+
+    void printResult(const char* name, FitResult const& result, MagData const& data, double milliseconds)
+    {
+        //A good calibration puts every reading on a sphere, so the spread of the calibrated field strength
+        //(relative to its mean) is used as the accuracy measure
+        if (!result.solved)
+        {
+            printf("%-10s couldn't solve for an ellipsoid\n", name);
+            return;
+        }
+
+        double sum = 0.0, sum_squares = 0.0;
+        const size_t samples = data.x.size();
+        for (size_t i = 0; i < samples; i++)
+        {
+            double raw[3] = { data.x[i] - result.offset[0], data.y[i] - result.offset[1], data.z[i] - result.offset[2] };
+            double magnitude_squared = 0.0;
+            for (int row = 0; row < 3; row++)
+            {
+                double value = result.gain[3 * row] * raw[0] + result.gain[3 * row + 1] * raw[1] + result.gain[3 * row + 2] * raw[2];
+                magnitude_squared += value * value;
+            }
+
+            double magnitude = std::sqrt(magnitude_squared);
+            sum += magnitude;
+            sum_squares += magnitude * magnitude;
+        }
+
+        double mean = sum / samples;
+        double deviation = std::sqrt(std::fmax(0.0, sum_squares / samples - mean * mean));
+        printf("%-10s %9.3f ms  field %.4f +/- %.4f (%.3f%%)  offset [%.4f, %.4f, %.4f]\n", name, milliseconds, mean, deviation, 100.0 * deviation / mean,
+            result.offset[0], result.offset[1], result.offset[2]);
+        printf("           gain [[%.4f, %.4f, %.4f], [%.4f, %.4f, %.4f], [%.4f, %.4f, %.4f]]\n", result.gain[0], result.gain[1], result.gain[2],
+            result.gain[3], result.gain[4], result.gain[5], result.gain[6], result.gain[7], result.gain[8]);
+    }
+
+    template <typename Fit>
+    void benchmark(const char* name, Fit fit, MagData const& data, int repeat)
+    {
+        FitResult result;
+        Clock::time_point start = Clock::now();
+        for (int pass = 0; pass < repeat; pass++) result = fit(data);
+        double milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / repeat;
+        printResult(name, result, data, milliseconds);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int repeat = 10;
+    const char* file_location = nullptr;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--repeat" && i + 1 < argc) repeat = atoi(argv[++i]);
+        else if (argument.compare(0, 2, "--") != 0 && file_location == nullptr) file_location = argv[i];
+        else
+        {
+            printf("Usage: %s [--repeat <count>] <magnetometer data.txt>\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (file_location == nullptr)
+    {
+        printf("Usage: %s [--repeat <count>] <magnetometer data.txt>\n", argv[0]);
+        return 1;
+    }
+    if (repeat < 1) repeat = 1;
+
+    MagData data;
+    if (!loadMagData(file_location, data))
+    {
+        fprintf(stderr, "Couldn't read any readings from '%s'\n", file_location);
+        return 1;
+    }
+
+    printf("%zu readings, times averaged over %d runs\n", data.x.size(), repeat);
+    benchmark("original", originalFit, data, repeat);
+    benchmark("streaming", streamingFit, data, repeat);
+    benchmark("refined", refinedFit, data, repeat);
+    return 0;
+}
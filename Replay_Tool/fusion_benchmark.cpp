@@ -0,0 +1,571 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <Math/sensor_fusion.h>
+#include <Math/madgwick_batch.h>
+#include <Math/vector_math.h>
+#include <Math/SensorFusion/FusionAhrs.h>
+#include <Math/SensorFusion/FusionOffset.h>
+#include "allocation_counter.h"
+
+//Runs every orientation filter the app has over recorded data sets (time, gyroscope, accelerometer and magnetometer
+//columns like the files in Console_Application/Resources/Data_Sets) and measures how fast and how accurate each one
+//is. The filters are the six in sensor_fusion.cpp, the batched MadgwickAHRSupdate() from madgwick_batch.h and the
+//Fusion AHRS. For each one it prints the time per sample (the fastest of --repeat passes over the whole recording),
+//the heap allocations per pass and, when the data set comes with a reference (a file of time, w, x, y, z lines like
+//QuaternionData.txt), the mean and RMS angle from the reference and how long it takes for the error to drop under
+//--tolerance degrees for good. Every filter starts at no rotation, the same as the reference.
+//
+//The results can be written as comma separated text and checked against an earlier run with --baseline, in which
+//case the program exits with 1 if any filter got slower by more than --slack percent, allocates more, or got
+//further from the reference by more than --error-slack degrees. See readme.txt for how to build it.
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    const double PI = 3.14159265358979323846;
+
+    struct Recording
+    {
+        std::vector<float> time;
+        std::vector<float> values[9]; //gyr xyz, acc xyz, mag xyz in the units of the text file
+        std::vector<float> reference; //w, x, y, z for every sample, empty if there's no reference
+        std::vector<bool> hasReference; //not every sample of a recording has to have a reference quaternion
+        float odr = 0.0f;
+
+        size_t size() const { return time.size(); }
+    };
+
+    struct Settings
+    {
+        float beta = 0.041f; //the standard Madgwick gain used by the training modes
+        float fusionGain = 0.5f;
+        int repeat = 5;
+        double tolerance = 5.0;
+    };
+
+    //Each filter runs over the whole recording starting from no rotation and writes the quaternion after every
+    //sample to q_out (4 floats per sample)
+    typedef void (*FilterFunction)(Recording const& recording, Settings const& settings, float* q_out);
+
+    inline void store(glm::quat const& q, float* q_out)
+    {
+        q_out[0] = q.w;
+        q_out[1] = q.x;
+        q_out[2] = q.y;
+        q_out[3] = q.z;
+    }
+
+    void runMadgwick(Recording const& recording, Settings const& settings, float* q_out)
+    {
+        const float* v[9];
+        for (int channel = 0; channel < 9; channel++) v[channel] = recording.values[channel].data();
+        const float delta_t = 1.0f / recording.odr;
+
+        glm::quat q(1.0f, 0.0f, 0.0f, 0.0f);
+        for (size_t i = 0; i < recording.size(); i++)
+        {
+            q = Madgwick(q, v[0][i], v[1][i], v[2][i], v[3][i], v[4][i], v[5][i], v[6][i], v[7][i], v[8][i], delta_t, settings.beta);
+            store(q, q_out + 4 * i);
+        }
+    }
+
+    void runMadgwickModified(Recording const& recording, Settings const& settings, float* q_out)
+    {
+        //The Earth's magnetic field is fixed at the first magnetometer reading
+        const float* v[9];
+        for (int channel = 0; channel < 9; channel++) v[channel] = recording.values[channel].data();
+        const float delta_t = 1.0f / recording.odr;
+        const glm::quat h(0.0f, v[6][0], v[7][0], v[8][0]);
+
+        glm::quat q(1.0f, 0.0f, 0.0f, 0.0f);
+        for (size_t i = 0; i < recording.size(); i++)
+        {
+            q = MadgwickModified(q, v[0][i], v[1][i], v[2][i], v[3][i], v[4][i], v[5][i], v[6][i], v[7][i], v[8][i], h, delta_t, settings.beta);
+            store(q, q_out + 4 * i);
+        }
+    }
+
+    void runMadgwickVerticalY(Recording const& recording, Settings const& settings, float* q_out)
+    {
+        const float* v[9];
+        for (int channel = 0; channel < 9; channel++) v[channel] = recording.values[channel].data();
+        const float delta_t = 1.0f / recording.odr;
+
+        glm::quat q(1.0f, 0.0f, 0.0f, 0.0f);
+        for (size_t i = 0; i < recording.size(); i++)
+        {
+            q = MadgwickVerticalY(q, v[0][i], v[1][i], v[2][i], v[3][i], v[4][i], v[5][i], v[6][i], v[7][i], v[8][i], delta_t, settings.beta);
+            store(q, q_out + 4 * i);
+        }
+    }
+
+    void runMadgwickIMU(Recording const& recording, Settings const& settings, float* q_out)
+    {
+        const float* v[9];
+        for (int channel = 0; channel < 9; channel++) v[channel] = recording.values[channel].data();
+        const float delta_t = 1.0f / recording.odr;
+
+        glm::quat q(1.0f, 0.0f, 0.0f, 0.0f);
+        for (size_t i = 0; i < recording.size(); i++)
+        {
+            q = MadgwickIMU(q, v[0][i], v[1][i], v[2][i], v[3][i], v[4][i], v[5][i], delta_t, settings.beta);
+            store(q, q_out + 4 * i);
+        }
+    }
+
+    void runFloyd(Recording const& recording, Settings const& settings, float* q_out)
+    {
+        //Like MadgwickModified(), the magnetic field it measures the heading from is the first magnetometer reading
+        const float* v[9];
+        for (int channel = 0; channel < 9; channel++) v[channel] = recording.values[channel].data();
+        const float delta_t = 1.0f / recording.odr;
+
+        glm::quat q(1.0f, 0.0f, 0.0f, 0.0f);
+        for (size_t i = 0; i < recording.size(); i++)
+        {
+            q = Floyd(q, v[0][i], v[1][i], v[2][i], v[3][i], v[4][i], v[5][i], v[6][i], v[7][i], v[8][i], v[6][0], v[7][0], v[8][0], delta_t, settings.beta);
+            store(q, q_out + 4 * i);
+        }
+    }
+
+    void runMadgwickAHRSupdate(Recording const& recording, Settings const& settings, float* q_out)
+    {
+        const float* v[9];
+        for (int channel = 0; channel < 9; channel++) v[channel] = recording.values[channel].data();
+
+        glm::quat q(1.0f, 0.0f, 0.0f, 0.0f);
+        for (size_t i = 0; i < recording.size(); i++)
+        {
+            MadgwickAHRSupdate(q, q, v[0][i], v[1][i], v[2][i], v[3][i], v[4][i], v[5][i], v[6][i], v[7][i], v[8][i], recording.odr, settings.beta);
+            store(q, q_out + 4 * i);
+        }
+    }
+
+    void runMadgwickBatch(Recording const& recording, Settings const& settings, float* q_out)
+    {
+        MadgwickBatchInput input = {
+            recording.values[0].data(), recording.values[1].data(), recording.values[2].data(),
+            recording.values[3].data(), recording.values[4].data(), recording.values[5].data(),
+            recording.values[6].data(), recording.values[7].data(), recording.values[8].data()
+        };
+        float q[4] = { 1.0f, 0.0f, 0.0f, 0.0f };
+        MadgwickAHRSupdateBatch(q, input, (int)recording.size(), recording.odr, settings.beta, q_out);
+    }
+
+    void runFusion(Recording const& recording, Settings const& settings, float* q_out)
+    {
+        //Same settings as the MadgwickTestMode and the replay tool
+        const unsigned int odr = (unsigned int)recording.odr;
+        FusionOffset offset;
+        FusionOffsetInitialise(&offset, odr);
+        FusionAhrs ahrs;
+        FusionAhrsInitialise(&ahrs);
+        const FusionAhrsSettings fusion_settings = {
+            FusionConventionNwu,
+            settings.fusionGain,
+            2000.0f,
+            10.0f,
+            10.0f,
+            5 * odr, /* 5 seconds */
+        };
+        FusionAhrsSetSettings(&ahrs, &fusion_settings);
+
+        const float* v[9];
+        for (int channel = 0; channel < 9; channel++) v[channel] = recording.values[channel].data();
+        const float delta_t = 1.0f / recording.odr;
+        for (size_t i = 0; i < recording.size(); i++)
+        {
+            FusionVector gyroscope = { { v[0][i], v[1][i], v[2][i] } };
+            const FusionVector accelerometer = { { v[3][i], v[4][i], v[5][i] } };
+            const FusionVector magnetometer = { { v[6][i], v[7][i], v[8][i] } };
+            gyroscope = FusionOffsetUpdate(&offset, gyroscope);
+            FusionAhrsUpdate(&ahrs, gyroscope, accelerometer, magnetometer, delta_t);
+
+            const FusionQuaternion q = FusionAhrsGetQuaternion(&ahrs);
+            memcpy(q_out + 4 * i, q.array, 4 * sizeof(float));
+        }
+    }
+
+    struct Filter
+    {
+        const char* name;
+        FilterFunction run;
+        Quat frame; //takes the filter's Earth frame to the one the reference uses (x north, z up)
+    };
+
+    //MadgwickVerticalY() and Floyd() have y pointing up and z pointing east, a quarter turn about north takes that
+    //frame to the z up one everything else uses
+    const Quat Y_UP_TO_Z_UP = { 0.70710678f, 0.70710678f, 0.0f, 0.0f };
+
+    const Filter FILTERS[] = {
+        { "Madgwick", runMadgwick, Quat::identity() },
+        { "MadgwickModified", runMadgwickModified, Quat::identity() },
+        { "MadgwickVerticalY", runMadgwickVerticalY, Y_UP_TO_Z_UP },
+        { "MadgwickIMU", runMadgwickIMU, Quat::identity() },
+        { "Floyd", runFloyd, Y_UP_TO_Z_UP },
+        { "MadgwickAHRSupdate", runMadgwickAHRSupdate, Quat::identity() },
+        { "MadgwickAHRSupdateBatch", runMadgwickBatch, Quat::identity() },
+        { "FusionAhrs", runFusion, Quat::identity() }
+    };
+
+    struct Result
+    {
+        std::string dataSet;
+        std::string filter;
+        size_t samples = 0;
+        double nsPerSample = 0.0;
+        double allocationsPerPass = 0.0;
+        bool hasReference = false;
+        double meanError = 0.0; //degrees
+        double rmsError = 0.0; //degrees
+        double convergence = -1.0; //seconds until the error stays under the tolerance, -1 if it never does
+    };
+
+    bool readColumns(const char* line, float* values, int columns)
+    {
+        const char* position = line;
+        for (int column = 0; column < columns; column++)
+        {
+            char* end = nullptr;
+            values[column] = strtof(position, &end);
+            if (end == position) return false;
+            position = end;
+        }
+        return true;
+    }
+
+    bool loadRecording(const char* file_location, float odr, Recording& recording)
+    {
+        FILE* file = fopen(file_location, "r");
+        if (file == nullptr) return false;
+
+        char line[512];
+        while (fgets(line, sizeof(line), file) != nullptr)
+        {
+            float values[10];
+            if (!readColumns(line, values, 10)) continue;
+
+            recording.time.push_back(values[0]);
+            for (int channel = 0; channel < 9; channel++) recording.values[channel].push_back(values[1 + channel]);
+        }
+        fclose(file);
+
+        recording.odr = odr;
+        if (recording.odr <= 0.0f && recording.size() > 1 && recording.time[1] > recording.time[0]) recording.odr = 1.0f / (recording.time[1] - recording.time[0]);
+        if (recording.odr <= 0.0f) recording.odr = 400.0f;
+        return recording.size() > 0;
+    }
+
+    bool loadReference(const char* file_location, Recording& recording)
+    {
+        //Reference quaternions get matched to the sample with the same time stamp (to within half a sample), the
+        //reference doesn't have to cover the whole recording
+        FILE* file = fopen(file_location, "r");
+        if (file == nullptr) return false;
+
+        recording.reference.assign(4 * recording.size(), 0.0f);
+        recording.hasReference.assign(recording.size(), false);
+
+        const float half_sample = 0.5f / recording.odr;
+        size_t sample = 0, matched = 0;
+        char line[256];
+        while (fgets(line, sizeof(line), file) != nullptr && sample < recording.size())
+        {
+            float values[5];
+            if (!readColumns(line, values, 5)) continue;
+
+            while (sample < recording.size() && recording.time[sample] < values[0] - half_sample) sample++;
+            if (sample == recording.size() || recording.time[sample] > values[0] + half_sample) continue;
+
+            memcpy(&recording.reference[4 * sample], &values[1], 4 * sizeof(float));
+            recording.hasReference[sample] = true;
+            matched++;
+        }
+        fclose(file);
+
+        if (matched == 0)
+        {
+            recording.reference.clear();
+            recording.hasReference.clear();
+        }
+        return matched > 0;
+    }
+
+    double angleBetween(Quat const& a, Quat const& b)
+    {
+        //q and -q are the same orientation
+        double dot = fabs((double)Dot(Normalized(a), Normalized(b)));
+        if (!(dot == dot)) return 180.0; //a filter that blew up is as far off as it can be
+        return 2.0 * acos(std::min(dot, 1.0)) * 180.0 / PI;
+    }
+
+    Result benchmark(std::string const& name, Recording const& recording, Filter const& filter, Settings const& settings)
+    {
+        Result result;
+        result.dataSet = name;
+        result.filter = filter.name;
+        result.samples = recording.size();
+
+        std::vector<float> quaternions(4 * recording.size());
+
+        //Run once to warm up the caches, then time the fastest pass
+        filter.run(recording, settings, quaternions.data());
+
+        double fastest = 0.0;
+        uint64_t allocations_before = allocationCount();
+        for (int pass = 0; pass < settings.repeat; pass++)
+        {
+            Clock::time_point start = Clock::now();
+            filter.run(recording, settings, quaternions.data());
+            double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+            if (pass == 0 || seconds < fastest) fastest = seconds;
+        }
+        result.allocationsPerPass = (double)(allocationCount() - allocations_before) / settings.repeat;
+        result.nsPerSample = fastest * 1.0e9 / recording.size();
+
+        if (recording.reference.empty()) return result;
+
+        std::vector<double> errors;
+        std::vector<float> times;
+        for (size_t i = 0; i < recording.size(); i++)
+        {
+            if (!recording.hasReference[i]) continue;
+
+            const float* q = &quaternions[4 * i];
+            const float* r = &recording.reference[4 * i];
+            errors.push_back(angleBetween(filter.frame * Quat{ q[0], q[1], q[2], q[3] }, Quat{ r[0], r[1], r[2], r[3] }));
+            times.push_back(recording.time[i] - recording.time[0]);
+        }
+
+        double total = 0.0, total_squared = 0.0;
+        for (double error : errors)
+        {
+            total += error;
+            total_squared += error * error;
+        }
+        result.hasReference = true;
+        result.meanError = total / errors.size();
+        result.rmsError = sqrt(total_squared / errors.size());
+
+        //Converged at the first sample after which the error never goes over the tolerance again
+        size_t first = errors.size();
+        while (first > 0 && errors[first - 1] < settings.tolerance) first--;
+        if (first < errors.size()) result.convergence = times[first];
+
+        return result;
+    }
+
+    std::string number(double value, const char* format, bool valid = true)
+    {
+        if (!valid) return (value < 0.0) ? "never" : "-";
+        char text[32];
+        snprintf(text, sizeof(text), format, value);
+        return text;
+    }
+
+    std::string csvNumber(double value, const char* format, bool valid = true)
+    {
+        //Missing values are left empty so the column stays numeric for whatever reads it
+        return valid ? number(value, format) : "";
+    }
+
+    const char* CSV_HEADER = "data_set,filter,samples,ns_per_sample,allocations_per_pass,mean_error_deg,rms_error_deg,convergence_s";
+
+    bool writeCsv(FILE* file, std::vector<Result> const& results)
+    {
+        if (fprintf(file, "%s\n", CSV_HEADER) < 0) return false;
+        for (Result const& result : results)
+        {
+            int written = fprintf(file, "%s,%s,%zu,%s,%s,%s,%s,%s\n", result.dataSet.c_str(), result.filter.c_str(), result.samples,
+                number(result.nsPerSample, "%.2f").c_str(), number(result.allocationsPerPass, "%.1f").c_str(),
+                csvNumber(result.meanError, "%.3f", result.hasReference).c_str(), csvNumber(result.rmsError, "%.3f", result.hasReference).c_str(),
+                csvNumber(result.convergence, "%.4f", result.hasReference && result.convergence >= 0.0).c_str());
+            if (written < 0) return false;
+        }
+        return true;
+    }
+
+    struct BaselineEntry
+    {
+        double nsPerSample;
+        double allocationsPerPass;
+        double meanError; //negative if there wasn't a reference
+    };
+
+    bool loadBaseline(const char* file_location, std::map<std::string, BaselineEntry>& baseline)
+    {
+        FILE* file = fopen(file_location, "r");
+        if (file == nullptr) return false;
+
+        char line[512];
+        bool header = true;
+        while (fgets(line, sizeof(line), file) != nullptr)
+        {
+            if (header)
+            {
+                header = false;
+                if (strncmp(line, CSV_HEADER, strlen(CSV_HEADER)) != 0) break;
+                continue;
+            }
+
+            std::vector<std::string> fields(1);
+            for (const char* c = line; *c != '\0' && *c != '\n' && *c != '\r'; c++)
+            {
+                if (*c == ',') fields.emplace_back();
+                else fields.back() += *c;
+            }
+            if (fields.size() < 8) continue;
+
+            BaselineEntry entry;
+            entry.nsPerSample = atof(fields[3].c_str());
+            entry.allocationsPerPass = atof(fields[4].c_str());
+            entry.meanError = fields[5].empty() ? -1.0 : atof(fields[5].c_str());
+            baseline[fields[0] + "," + fields[1]] = entry;
+        }
+        fclose(file);
+        return !header && !baseline.empty();
+    }
+
+    void printUsage(const char* program)
+    {
+        printf("Usage: %s [options] <data set> [[--reference <file>] <data set> ...]\n\n", program);
+        printf("  --reference <file>     reference quaternions (time w x y z) for the data set after it\n");
+        printf("  --odr <Hz>             sample rate of the data sets (default: from the first two time stamps)\n");
+        printf("  --beta <gain>          Madgwick filter gain (default 0.041)\n");
+        printf("  --gain <gain>          Fusion AHRS gain (default 0.5)\n");
+        printf("  --repeat <count>       timed passes over each data set, the fastest one is reported (default 5)\n");
+        printf("  --tolerance <degrees>  error a filter has to stay under to count as converged (default 5)\n");
+        printf("  --csv <file>           write the results as comma separated text\n");
+        printf("  --baseline <file>      compare against the --csv output of an earlier run, exits with 1 on a regression\n");
+        printf("  --slack <percent>      how much slower than the baseline a filter can get (default 25)\n");
+        printf("  --error-slack <deg>    how much further from the reference than the baseline a filter can get (default 0.5)\n");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Settings settings;
+    float odr = 0.0f;
+    double slack = 25.0, error_slack = 0.5;
+    const char* csv_location = nullptr, * baseline_location = nullptr, * reference = nullptr;
+    std::vector<std::pair<const char*, const char*>> data_sets; //data set and its reference
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--reference" && i + 1 < argc) reference = argv[++i];
+        else if (argument == "--odr" && i + 1 < argc) odr = (float)atof(argv[++i]);
+        else if (argument == "--beta" && i + 1 < argc) settings.beta = (float)atof(argv[++i]);
+        else if (argument == "--gain" && i + 1 < argc) settings.fusionGain = (float)atof(argv[++i]);
+        else if (argument == "--repeat" && i + 1 < argc) settings.repeat = atoi(argv[++i]);
+        else if (argument == "--tolerance" && i + 1 < argc) settings.tolerance = atof(argv[++i]);
+        else if (argument == "--csv" && i + 1 < argc) csv_location = argv[++i];
+        else if (argument == "--baseline" && i + 1 < argc) baseline_location = argv[++i];
+        else if (argument == "--slack" && i + 1 < argc) slack = atof(argv[++i]);
+        else if (argument == "--error-slack" && i + 1 < argc) error_slack = atof(argv[++i]);
+        else if (argument.compare(0, 2, "--") != 0)
+        {
+            data_sets.emplace_back(argv[i], reference);
+            reference = nullptr;
+        }
+        else
+        {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (data_sets.empty() || reference != nullptr || settings.tolerance <= 0.0)
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+    if (settings.repeat < 1) settings.repeat = 1;
+
+    std::map<std::string, BaselineEntry> baseline;
+    if (baseline_location != nullptr && !loadBaseline(baseline_location, baseline))
+    {
+        fprintf(stderr, "Couldn't read the baseline '%s'\n", baseline_location);
+        return 1;
+    }
+
+    std::vector<Result> results;
+    printf("%-22s %-24s %8s %10s %8s %10s %10s %12s\n", "data set", "filter", "samples", "ns/sample", "allocs", "mean deg", "rms deg", "converged s");
+    for (auto const& data_set : data_sets)
+    {
+        Recording recording;
+        if (!loadRecording(data_set.first, odr, recording))
+        {
+            fprintf(stderr, "Couldn't read any samples from '%s'\n", data_set.first);
+            return 1;
+        }
+        if (data_set.second != nullptr && !loadReference(data_set.second, recording))
+        {
+            fprintf(stderr, "Couldn't match any reference quaternions from '%s' to '%s'\n", data_set.second, data_set.first);
+            return 1;
+        }
+
+        std::string name = data_set.first;
+        size_t slash = name.find_last_of("/\\");
+        if (slash != std::string::npos) name = name.substr(slash + 1);
+
+        for (Filter const& filter : FILTERS)
+        {
+            Result result = benchmark(name, recording, filter, settings);
+            printf("%-22s %-24s %8zu %10.2f %8.1f %10s %10s %12s\n", name.c_str(), result.filter.c_str(), result.samples, result.nsPerSample, result.allocationsPerPass,
+                number(result.meanError, "%.2f", result.hasReference).c_str(), number(result.rmsError, "%.2f", result.hasReference).c_str(),
+                number(result.hasReference ? result.convergence : 0.0, "%.3f", result.hasReference && result.convergence >= 0.0).c_str());
+            results.push_back(result);
+        }
+    }
+
+    if (csv_location != nullptr)
+    {
+        FILE* file = fopen(csv_location, "w");
+        bool written = file != nullptr && writeCsv(file, results);
+        if (file != nullptr) fclose(file);
+        if (!written)
+        {
+            fprintf(stderr, "Couldn't write the results to '%s'\n", csv_location);
+            return 1;
+        }
+    }
+
+    if (baseline_location == nullptr) return 0;
+
+    int regressions = 0, compared = 0;
+    printf("\n");
+    for (Result const& result : results)
+    {
+        auto entry = baseline.find(result.dataSet + "," + result.filter);
+        if (entry == baseline.end()) continue;
+        compared++;
+
+        BaselineEntry const& before = entry->second;
+        if (result.nsPerSample > before.nsPerSample * (1.0 + slack / 100.0))
+        {
+            printf("%s %s: %.2f ns/sample, was %.2f\n", result.dataSet.c_str(), result.filter.c_str(), result.nsPerSample, before.nsPerSample);
+            regressions++;
+        }
+        if (result.allocationsPerPass > before.allocationsPerPass)
+        {
+            printf("%s %s: %.1f allocations per pass, was %.1f\n", result.dataSet.c_str(), result.filter.c_str(), result.allocationsPerPass, before.allocationsPerPass);
+            regressions++;
+        }
+        if (result.hasReference && before.meanError >= 0.0 && result.meanError > before.meanError + error_slack)
+        {
+            printf("%s %s: %.3f degrees from the reference, was %.3f\n", result.dataSet.c_str(), result.filter.c_str(), result.meanError, before.meanError);
+            regressions++;
+        }
+    }
+    printf("%d of %zu results compared against the baseline, %d regression%s\n", compared, results.size(), regressions, (regressions == 1) ? "" : "s");
+    return (regressions == 0) ? 0 : 1;
+}
@@ -0,0 +1,318 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "../DirectXApp/Devices/CompositeDataDecoder.h"
+#include "../Firmware/nRF52840_Drivers/device_fusion.h"
+
+//Checks the on device sensor fusion of the Personal Caddie against the filter the app runs. Every recorded data set
+//(time, gyroscope, accelerometer and magnetometer columns like the files in Console_Application/Resources/Data_Sets)
+//goes through two paths:
+//
+//  host:   the readings as floats straight into FusionAhrs, set up the same way as the MadgwickTestMode and the
+//          replay tool and seeded from the first data set like the device, with linear acceleration worked out like
+//          PersonalCaddie::updateLinearAcceleration()
+//  device: the readings turned back into int16s with the default sensor settings, run through device_fusion_update()
+//          a data set at a time, sent as fused notifications and decoded with the same CompositeDataDecoder the app uses
+//
+//and the orientations and linear accelerations that come out the other end are compared. See readme.txt for how to build it.
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    const int CHANNELS = COMPOSITE_SENSORS * COMPOSITE_AXES;
+    const int NOTIFICATION_CAPACITY = (COMPOSITE_MAX_SAMPLES / 3) * COMPOSITE_SAMPLE_SIZE; //bytes after the header in the large characteristic
+    const double PI = 3.14159265358979323846;
+
+    //LSB per unit of the text files (m/s^2, degrees/s and gauss) with the default Personal Caddie settings, the same as packing_benchmark.cpp
+    const float DEFAULT_LSB_PER_UNIT[COMPOSITE_SENSORS] = { 8192.0f / 9.80665f, 16.384f, 100.0f / 0.3f };
+
+    struct Recording
+    {
+        std::vector<float> values[CHANNELS]; //acc xyz, gyr xyz, mag xyz in the units of the text file
+        std::vector<uint8_t> samples; //the same readings as raw composite characteristic samples
+        float odr = 400.0f;
+
+        size_t size() const { return values[0].size(); }
+    };
+
+    bool loadRecording(const char* file_location, Recording& recording)
+    {
+        FILE* file = fopen(file_location, "r");
+        if (file == nullptr) return false;
+
+        //The text files hold gyroscope readings before accelerometer readings, the composite characteristic is the other way around
+        const int column_order[CHANNELS] = { 3, 4, 5, 0, 1, 2, 6, 7, 8 };
+        std::vector<float> time;
+
+        char line[512];
+        while (fgets(line, sizeof(line), file) != nullptr)
+        {
+            float values[1 + CHANNELS];
+            char* position = line;
+            int column = 0;
+            for (; column < 1 + CHANNELS; column++)
+            {
+                char* end = nullptr;
+                values[column] = strtof(position, &end);
+                if (end == position) break;
+                position = end;
+            }
+            if (column < 1 + CHANNELS) continue;
+
+            time.push_back(values[0]);
+            for (int channel = 0; channel < CHANNELS; channel++) recording.values[channel].push_back(values[1 + column_order[channel]]);
+        }
+        fclose(file);
+        if (time.empty()) return false;
+        if (time.size() > 1 && time[1] > time[0]) recording.odr = 1.0f / (time[1] - time[0]);
+
+        recording.samples.resize(recording.size() * COMPOSITE_SAMPLE_SIZE);
+        for (size_t i = 0; i < recording.size(); i++)
+        {
+            for (int channel = 0; channel < CHANNELS; channel++)
+            {
+                long lsb = lrintf(recording.values[channel][i] * DEFAULT_LSB_PER_UNIT[channel / COMPOSITE_AXES]);
+                uint16_t reading = (uint16_t)(int16_t)((lsb > 32767) ? 32767 : ((lsb < -32768) ? -32768 : lsb));
+                recording.samples[i * COMPOSITE_SAMPLE_SIZE + 2 * channel] = (uint8_t)(reading & 0xFF);
+                recording.samples[i * COMPOSITE_SAMPLE_SIZE + 2 * channel + 1] = (uint8_t)(reading >> 8);
+            }
+        }
+
+        return true;
+    }
+
+    struct Output
+    {
+        std::vector<float> quaternions; //w, x, y, z for every sample
+        std::vector<float> linear; //x, y, z for every sample in m/s^2
+    };
+
+    void runHost(Recording const& recording, float gain, int samples_per_data_set, Output& output)
+    {
+        FusionOffset offset;
+        FusionAhrs ahrs;
+        const unsigned int odr = (unsigned int)(recording.odr + 0.5f);
+        FusionOffsetInitialise(&offset, odr);
+        FusionAhrsInitialise(&ahrs);
+
+        const FusionAhrsSettings settings = {
+            FusionConventionNwu,
+            gain,
+            2000.0f,
+            10.0f,
+            10.0f,
+            5 * odr, /* 5 seconds */
+        };
+        FusionAhrsSetSettings(&ahrs, &settings);
+
+        const float delta_time = 1.0f / recording.odr, gravity = COMPOSITE_GRAVITY;
+        output.quaternions.resize(4 * recording.size());
+        output.linear.resize(3 * recording.size());
+        bool aligned = false;
+        for (size_t i = 0; i < recording.size(); i++)
+        {
+            //Seeded from the first data set it can be, just like device_fusion_update()
+            if (!aligned && i % samples_per_data_set == 0)
+            {
+                FusionAlignment alignment;
+                FusionAlignmentReset(&alignment);
+                for (size_t j = i; j < std::min(recording.size(), i + samples_per_data_set); j++)
+                {
+                    FusionVector accelerometer = { recording.values[0][j], recording.values[1][j], recording.values[2][j] };
+                    FusionVector magnetometer = { recording.values[6][j], recording.values[7][j], recording.values[8][j] };
+                    FusionAlignmentAdd(&alignment, accelerometer, magnetometer);
+                }
+
+                FusionQuaternion initial;
+                aligned = FusionAlignmentQuaternion(&alignment, FusionConventionNwu, &initial);
+                if (aligned) FusionAhrsSetInitialQuaternion(&ahrs, initial);
+            }
+
+            FusionVector accelerometer = { recording.values[0][i], recording.values[1][i], recording.values[2][i] };
+            FusionVector gyroscope = { recording.values[3][i], recording.values[4][i], recording.values[5][i] };
+            FusionVector magnetometer = { recording.values[6][i], recording.values[7][i], recording.values[8][i] };
+
+            gyroscope = FusionOffsetUpdate(&offset, gyroscope);
+            FusionAhrsUpdate(&ahrs, gyroscope, accelerometer, magnetometer, delta_time);
+
+            FusionQuaternion q = FusionAhrsGetQuaternion(&ahrs);
+            float* quaternion = &output.quaternions[4 * i];
+            for (int component = 0; component < 4; component++) quaternion[component] = q.array[component];
+
+            float* linear = &output.linear[3 * i];
+            linear[0] = accelerometer.axis.x - 2 * gravity * (quaternion[1] * quaternion[3] - quaternion[0] * quaternion[2]);
+            linear[1] = accelerometer.axis.y - 2 * gravity * (quaternion[2] * quaternion[3] + quaternion[0] * quaternion[1]);
+            linear[2] = accelerometer.axis.z - gravity * (quaternion[0] * quaternion[0] - quaternion[1] * quaternion[1] - quaternion[2] * quaternion[2] + quaternion[3] * quaternion[3]);
+        }
+    }
+
+    double runDevice(Recording const& recording, int samples_per_data_set, bool linear_acceleration, Output& output, size_t& notifications, size_t& bytes)
+    {
+        //The fusion tables are what the app would send with identity calibration numbers and axis orientations
+        device_fusion_t fusion;
+        device_fusion_init(&fusion);
+        for (int sensor = 0; sensor < COMPOSITE_SENSORS; sensor++)
+        {
+            float values[DEVICE_FUSION_TABLE_VALUES] = {};
+            for (int axis = 0; axis < COMPOSITE_AXES; axis++) values[COMPOSITE_AXES * axis + axis] = 1.0f / DEFAULT_LSB_PER_UNIT[sensor];
+            device_fusion_set_table(&fusion, (uint8_t)sensor, values);
+        }
+        device_fusion_reset(&fusion, recording.odr);
+
+        CompositeDataDecoder decoder;
+        CompositeDecodeOutput decode_output;
+        float quaternions[4][COMPOSITE_MAX_SAMPLES], linear[COMPOSITE_AXES][COMPOSITE_MAX_SAMPLES];
+        for (int component = 0; component < 4; component++) decode_output.quaternion[component] = quaternions[component];
+        for (int axis = 0; axis < COMPOSITE_AXES; axis++) decode_output.linear[axis] = linear[axis];
+
+        output.quaternions.resize(4 * recording.size());
+        output.linear.resize(3 * recording.size());
+        notifications = bytes = 0;
+        double fusion_seconds = 0.0;
+
+        float fused_quaternions[4 * COMPOSITE_MAX_SAMPLES], fused_linear[3 * COMPOSITE_MAX_SAMPLES];
+        uint8_t notification[COMPOSITE_HEADER_SIZE + NOTIFICATION_CAPACITY] = {};
+        size_t next_sample = 0;
+
+        for (size_t first = 0; first < recording.size(); first += samples_per_data_set)
+        {
+            //Same steps as characteristic_update_and_notify_fused_characteristic() in the firmware
+            uint8_t samples = (uint8_t)std::min<size_t>(recording.size() - first, samples_per_data_set);
+            Clock::time_point start = Clock::now();
+            device_fusion_update(&fusion, &recording.samples[first * COMPOSITE_SAMPLE_SIZE], samples, fused_quaternions, linear_acceleration ? fused_linear : nullptr);
+            fusion_seconds += std::chrono::duration<double>(Clock::now() - start).count();
+
+            uint8_t sent = 0;
+            while (sent < samples)
+            {
+                uint16_t length = 0;
+                uint8_t count = sample_packing_encode_fused(fused_quaternions + 4 * sent, linear_acceleration ? fused_linear + 3 * sent : nullptr, samples - sent,
+                    notification + COMPOSITE_HEADER_SIZE, NOTIFICATION_CAPACITY, &length);
+                if (count == 0) return fusion_seconds;
+                notification[4] = count | SAMPLE_PACKING_FUSED_FLAG;
+
+                uint32_t timer_ticks = 0;
+                int decoded = decoder.decode(notification, COMPOSITE_HEADER_SIZE + length, timer_ticks, decode_output);
+                for (int i = 0; i < decoded; i++)
+                {
+                    for (int component = 0; component < 4; component++) output.quaternions[4 * (next_sample + i) + component] = quaternions[component][i];
+                    for (int axis = 0; axis < COMPOSITE_AXES; axis++) output.linear[3 * (next_sample + i) + axis] = linear[axis][i];
+                }
+
+                next_sample += decoded;
+                notifications++;
+                bytes += COMPOSITE_HEADER_SIZE + length;
+                sent += count;
+            }
+        }
+
+        return fusion_seconds;
+    }
+
+    double angleDegrees(const float* a, const float* b)
+    {
+        //Angle of the rotation between two orientations, q and -q are the same orientation. The AHRS
+        //quaternion can drift a touch away from unit length so both get normalised first.
+        double dot = 0.0, length_a = 0.0, length_b = 0.0;
+        for (int component = 0; component < 4; component++)
+        {
+            dot += (double)a[component] * b[component];
+            length_a += (double)a[component] * a[component];
+            length_b += (double)b[component] * b[component];
+        }
+        dot = std::fabs(dot) / std::sqrt(length_a * length_b);
+        return 2.0 * std::acos(std::min(dot, 1.0)) * 180.0 / PI;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int samples_per_data_set = 0;
+    float gain = 0.5f, tolerance = 0.5f;
+    bool linear_acceleration = true;
+    std::vector<const char*> files;
+
+    const char* usage = "Usage: %s [--samples <samples per data set, 1 - %d>] [--gain <AHRS gain>] [--tolerance <largest allowed difference in degrees>] [--no-linear] <data set> [<data set> ...]\n";
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--samples" && i + 1 < argc) samples_per_data_set = atoi(argv[++i]);
+        else if (argument == "--gain" && i + 1 < argc) gain = (float)atof(argv[++i]);
+        else if (argument == "--tolerance" && i + 1 < argc) tolerance = (float)atof(argv[++i]);
+        else if (argument == "--no-linear") linear_acceleration = false;
+        else if (argument.size() > 1 && argument[0] == '-')
+        {
+            printf(usage, argv[0], COMPOSITE_MAX_SAMPLES);
+            return 1;
+        }
+        else files.push_back(argv[i]);
+    }
+
+    //By default the data sets are as big as the firmware makes them, see max_data_set_samples() in main.c
+    if (samples_per_data_set == 0) samples_per_data_set = linear_acceleration ? NOTIFICATION_CAPACITY / (SAMPLE_PACKING_QUATERNION_SIZE + SAMPLE_PACKING_LINEAR_SIZE) : COMPOSITE_MAX_SAMPLES;
+    if (files.empty() || samples_per_data_set < 1 || samples_per_data_set > COMPOSITE_MAX_SAMPLES)
+    {
+        printf(usage, argv[0], COMPOSITE_MAX_SAMPLES);
+        return 1;
+    }
+
+    bool all_passed = true;
+    printf("%-28s %9s %10s %10s %10s %11s %11s %10s %10s\n", "data set", "samples", "mean deg", "p99 deg", "max deg", "mean lin", "max lin", "smp/notif", "us/smp");
+
+    for (const char* file : files)
+    {
+        Recording recording;
+        if (!loadRecording(file, recording))
+        {
+            fprintf(stderr, "Couldn't read any samples from '%s'\n", file);
+            all_passed = false;
+            continue;
+        }
+
+        //The device AHRS only differs from the host one by the int16 readings going in and the fixed point
+        //quaternions coming out, so the two should never end up more than a fraction of a degree apart
+        Output host, device;
+        size_t notifications = 0, bytes = 0;
+        runHost(recording, gain, samples_per_data_set, host);
+        double fusion_seconds = runDevice(recording, samples_per_data_set, linear_acceleration, device, notifications, bytes);
+
+        std::vector<double> angles(recording.size());
+        double angle_sum = 0.0, linear_sum = 0.0, linear_max = 0.0;
+        for (size_t i = 0; i < recording.size(); i++)
+        {
+            angles[i] = angleDegrees(&host.quaternions[4 * i], &device.quaternions[4 * i]);
+            angle_sum += angles[i];
+
+            if (!linear_acceleration) continue;
+            double difference = 0.0;
+            for (int axis = 0; axis < COMPOSITE_AXES; axis++) difference += std::pow((double)host.linear[3 * i + axis] - device.linear[3 * i + axis], 2);
+            difference = std::sqrt(difference);
+            linear_sum += difference;
+            linear_max = std::max(linear_max, difference);
+        }
+        std::vector<double> sorted = angles;
+        std::sort(sorted.begin(), sorted.end());
+        double p99 = sorted[(size_t)(0.99 * (sorted.size() - 1))], largest = sorted.back();
+
+        bool passed = largest <= tolerance;
+        all_passed = all_passed && passed;
+
+        std::string name = file;
+        size_t slash = name.find_last_of("/\\");
+        if (slash != std::string::npos) name = name.substr(slash + 1);
+
+        printf("%-28s %9zu %10.5f %10.5f %10.5f %11.4f %11.4f %10.1f %10.2f%s\n", name.c_str(), recording.size(), angle_sum / recording.size(), p99, largest,
+            linear_sum / recording.size(), linear_max, (double)recording.size() / notifications, 1e6 * fusion_seconds / recording.size(), passed ? "" : "  TOO FAR APART");
+        printf("%-28s %.0f Hz, %.1f bytes per sample (%d raw), %zu notifications of up to %d samples\n", "", recording.odr, (double)bytes / recording.size(),
+            COMPOSITE_SAMPLE_SIZE, notifications, samples_per_data_set);
+    }
+
+    printf("\n%s\n", all_passed ? "The device and host filters agree" : "The device and host filters don't agree");
+    return all_passed ? 0 : 1;
+}
@@ -0,0 +1,139 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../DirectXApp/Graphics/Objects/2D/Graph/DecimationPyramid.h"
+
+//Times how long the DecimationPyramid used by the graph mode takes to take in a long recording and to answer
+//the queries the Graph class makes when drawing and zooming, and checks that the points it hands back keep
+//the shape of the data (every pixel column shows the same min and max as the raw data would). See readme.txt
+//for how to build it.
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    double millisecondsSince(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    float sampleValue(size_t i, std::mt19937& generator)
+    {
+        //Something that looks like a recording of swings, a slow wave with noise on top of it and
+        //the occasional short spike
+        std::normal_distribution<float> noise(0.0f, 0.05f);
+        float value = std::sin(0.001f * i) + noise(generator);
+        if (i % 20000 == 10000) value += 8.0f;
+        return value;
+    }
+
+    bool envelopeMatches(DecimationPyramid const& pyramid, std::vector<DecimationPoint> const& points, float x_minimum, float x_maximum, size_t columns)
+    {
+        //Splits the range up into pixel columns and makes sure the highest and lowest point drawn in each column
+        //are the same as the highest and lowest raw data points in it. A pixel column needs at least one full
+        //bucket in it for this to be true, so only columns with the raw data's extremes are looked at.
+        float column_width = (x_maximum - x_minimum) / columns;
+        std::vector<float> raw_min(columns, 1e30f), raw_max(columns, -1e30f), drawn_min(columns, 1e30f), drawn_max(columns, -1e30f);
+
+        for (size_t i = 0; i < pyramid.size(); i++)
+        {
+            DecimationPoint const& point = pyramid.point(i);
+            if (point.x < x_minimum || point.x >= x_maximum) continue;
+            size_t column = (size_t)((point.x - x_minimum) / column_width);
+            if (column >= columns) column = columns - 1;
+            raw_min[column] = std::fmin(raw_min[column], point.y);
+            raw_max[column] = std::fmax(raw_max[column], point.y);
+        }
+
+        for (size_t i = 0; i < points.size(); i++)
+        {
+            if (points[i].x < x_minimum || points[i].x >= x_maximum) continue;
+            size_t column = (size_t)((points[i].x - x_minimum) / column_width);
+            if (column >= columns) column = columns - 1;
+            drawn_min[column] = std::fmin(drawn_min[column], points[i].y);
+            drawn_max[column] = std::fmax(drawn_max[column], points[i].y);
+        }
+
+        //Every raw extreme has to show up somewhere in the drawn points, and nothing drawn can go past them
+        float overall_raw_min = 1e30f, overall_raw_max = -1e30f, overall_drawn_min = 1e30f, overall_drawn_max = -1e30f;
+        for (size_t column = 0; column < columns; column++)
+        {
+            overall_raw_min = std::fmin(overall_raw_min, raw_min[column]);
+            overall_raw_max = std::fmax(overall_raw_max, raw_max[column]);
+            overall_drawn_min = std::fmin(overall_drawn_min, drawn_min[column]);
+            overall_drawn_max = std::fmax(overall_drawn_max, drawn_max[column]);
+            if (drawn_max[column] > raw_max[column] + 1e-6f && raw_max[column] > -1e30f) return false;
+            if (drawn_min[column] < raw_min[column] - 1e-6f && raw_min[column] < 1e30f) return false;
+        }
+
+        return overall_raw_min == overall_drawn_min && overall_raw_max == overall_drawn_max;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    size_t samples = 2000000, columns = 1600;
+    int zooms = 1000;
+    float odr = 400.0f;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--samples" && i + 1 < argc) samples = (size_t)atoll(argv[++i]);
+        else if (argument == "--columns" && i + 1 < argc) columns = (size_t)atoll(argv[++i]);
+        else if (argument == "--zooms" && i + 1 < argc) zooms = atoi(argv[++i]);
+        else
+        {
+            printf("Usage: %s [--samples <count>] [--columns <graph width in pixels>] [--zooms <count>]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (samples < 2 || columns < 2) return 1;
+
+    std::mt19937 generator(1);
+    std::vector<float> values(samples);
+    for (size_t i = 0; i < samples; i++) values[i] = sampleValue(i, generator);
+
+    DecimationPyramid pyramid;
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < samples; i++) pyramid.append(i / odr, values[i]);
+    double append_time = millisecondsSince(start);
+    printf("%zu samples (%.1f minutes at %.0f Hz), %d levels\n", samples, samples / odr / 60.0f, odr, pyramid.levels());
+    printf("append       %9.3f ms total, %.1f ns per sample\n", append_time, 1e6 * append_time / samples);
+
+    //The Graph asks for two points per pixel column
+    std::vector<DecimationPoint> points;
+    float x_end = (samples - 1) / odr;
+    start = Clock::now();
+    pyramid.query(0.0f, x_end, 2 * columns, points);
+    double full_time = millisecondsSince(start);
+    bool full_ok = envelopeMatches(pyramid, points, 0.0f, x_end, columns);
+    printf("full view    %9.3f ms, %zu lines instead of %zu, envelope %s\n", full_time, points.size() - 1, samples - 1, full_ok ? "ok" : "WRONG");
+
+    //Random zoom boxes anywhere from a few samples wide to most of the recording
+    std::uniform_real_distribution<float> position(0.0f, 1.0f);
+    size_t total_points = 0, failures = 0;
+    double zoom_time = 0.0;
+    for (int zoom = 0; zoom < zooms; zoom++)
+    {
+        float width = x_end * std::pow(10.0f, -5.0f * position(generator));
+        float x_minimum = (x_end - width) * position(generator);
+        float x_maximum = x_minimum + width;
+
+        start = Clock::now();
+        pyramid.query(x_minimum, x_maximum, 2 * columns, points);
+        zoom_time += millisecondsSince(start);
+
+        total_points += points.size();
+        if (points.size() > 2 * columns || !envelopeMatches(pyramid, points, x_minimum, x_maximum, columns)) failures++;
+    }
+    printf("zoom         %9.3f ms per query, %.0f points per query on average, %zu of %d envelopes wrong\n", zoom_time / zooms,
+        (double)total_points / zooms, failures, zooms);
+
+    return (full_ok && failures == 0) ? 0 : 1;
+}
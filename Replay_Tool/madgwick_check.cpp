@@ -0,0 +1,193 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <Math/sensor_fusion.h>
+#include <Math/madgwick_batch.h>
+
+//Checks that the batched Madgwick filters in madgwick_batch.h give the same orientation as MadgwickAHRSupdate() from
+//sensor_fusion.cpp, with and without the magnetometer, which is what MADGWICK_BATCH_TOLERANCE promises. Each data set (time,
+//gyroscope, accelerometer and magnetometer columns like the files in Console_Application/Resources/Data_Sets) is run
+//through the scalar functions one sample at a time, then through MadgwickAHRSupdateBatch() and through every lane of
+//MadgwickAHRSupdateStreams(). The streams are windows of the data set that start at different samples, and there are
+//enough of them that the last group of lanes is only partly filled. The largest difference in any quaternion
+//component after any sample has to stay within the tolerance. How many lanes get used (8 for AVX2, 4 for SSE2, 1 for
+//the plain loop) depends on the instruction set the program is built for, see readme.txt.
+
+namespace
+{
+    struct Recording
+    {
+        std::vector<float> values[9]; //gyr xyz, acc xyz, mag xyz in the units of the text file
+        float odr = 0.0f;
+
+        size_t size() const { return values[0].size(); }
+    };
+
+    bool loadRecording(const char* file_location, Recording& recording)
+    {
+        FILE* file = fopen(file_location, "r");
+        if (file == nullptr) return false;
+
+        std::vector<float> time;
+        char line[512];
+        while (fgets(line, sizeof(line), file) != nullptr)
+        {
+            float values[10];
+            char* position = line;
+            int column = 0;
+            for (; column < 10; column++)
+            {
+                char* end = nullptr;
+                values[column] = strtof(position, &end);
+                if (end == position) break;
+                position = end;
+            }
+            if (column < 10) continue;
+
+            time.push_back(values[0]);
+            for (int channel = 0; channel < 9; channel++) recording.values[channel].push_back(values[1 + channel]);
+        }
+        fclose(file);
+        if (time.size() < 2 || time[1] <= time[0]) return false;
+
+        recording.odr = 1.0f / (time[1] - time[0]);
+        return true;
+    }
+
+    MadgwickBatchInput inputFrom(Recording const& recording, size_t first, bool use_mag)
+    {
+        const float* v[9];
+        for (int channel = 0; channel < 9; channel++) v[channel] = recording.values[channel].data() + first;
+        return { v[0], v[1], v[2], v[3], v[4], v[5], use_mag ? v[6] : nullptr, use_mag ? v[7] : nullptr, use_mag ? v[8] : nullptr };
+    }
+
+    //The reference, one call of the original function per sample. Without the magnetometer it's called with zeros for
+    //the magnetometer reading, which makes it convert the gyroscope to rad/s and hand off to MadgwickAHRSupdateIMU().
+    void runScalar(Recording const& recording, size_t first, size_t samples, bool use_mag, float beta, std::vector<float>& q_out)
+    {
+        q_out.resize(4 * samples);
+        const float* v[9];
+        for (int channel = 0; channel < 9; channel++) v[channel] = recording.values[channel].data() + first;
+
+        glm::quat q(1.0f, 0.0f, 0.0f, 0.0f);
+        for (size_t i = 0; i < samples; i++)
+        {
+            float mx = use_mag ? v[6][i] : 0.0f, my = use_mag ? v[7][i] : 0.0f, mz = use_mag ? v[8][i] : 0.0f;
+            MadgwickAHRSupdate(q, q, v[0][i], v[1][i], v[2][i], v[3][i], v[4][i], v[5][i], mx, my, mz, recording.odr, beta);
+            q_out[4 * i + 0] = q.w;
+            q_out[4 * i + 1] = q.x;
+            q_out[4 * i + 2] = q.y;
+            q_out[4 * i + 3] = q.z;
+        }
+    }
+
+    float largestDifference(std::vector<float> const& a, std::vector<float> const& b)
+    {
+        float largest = 0.0f;
+        for (size_t i = 0; i < a.size() && i < b.size(); i++)
+        {
+            float difference = std::fabs(a[i] - b[i]);
+            if (!(difference <= largest)) largest = difference; //a NaN counts as the largest difference there is
+        }
+        return largest;
+    }
+
+    bool checkRecording(Recording const& recording, bool use_mag, float beta, const char* name)
+    {
+        //Batch over the whole recording
+        std::vector<float> scalar, batch(4 * recording.size());
+        runScalar(recording, 0, recording.size(), use_mag, beta, scalar);
+
+        float q[4] = { 1.0f, 0.0f, 0.0f, 0.0f };
+        MadgwickAHRSupdateBatch(q, inputFrom(recording, 0, use_mag), (int)recording.size(), recording.odr, beta, batch.data());
+        float batch_difference = largestDifference(scalar, batch);
+
+        //Two full groups of lanes and one that's only partly filled, each stream starting further into the recording
+        const int lanes = madgwickStreamLanes();
+        const int streams = 2 * lanes + 1;
+        const size_t offset_step = recording.size() / (4 * (size_t)streams);
+        const size_t samples = recording.size() - offset_step * (streams - 1);
+
+        std::vector<float> stream_q(4 * streams, 0.0f);
+        std::vector<MadgwickBatchInput> inputs;
+        std::vector<std::vector<float>> stream_out(streams, std::vector<float>(4 * samples));
+        std::vector<float*> stream_out_pointers;
+        for (int stream = 0; stream < streams; stream++)
+        {
+            stream_q[4 * stream] = 1.0f;
+            inputs.push_back(inputFrom(recording, stream * offset_step, use_mag));
+            stream_out_pointers.push_back(stream_out[stream].data());
+        }
+        MadgwickAHRSupdateStreams(stream_q.data(), inputs.data(), streams, (int)samples, recording.odr, beta, stream_out_pointers.data());
+
+        float stream_difference = 0.0f;
+        for (int stream = 0; stream < streams; stream++)
+        {
+            runScalar(recording, stream * offset_step, samples, use_mag, beta, scalar);
+            float difference = largestDifference(scalar, stream_out[stream]);
+            if (!(difference <= stream_difference)) stream_difference = difference;
+
+            //The final quaternion handed back has to be the last one written out
+            for (int component = 0; component < 4; component++)
+            {
+                if (stream_q[4 * stream + component] != stream_out[stream][4 * (samples - 1) + component]) stream_difference = INFINITY;
+            }
+        }
+
+        bool passed = batch_difference <= MADGWICK_BATCH_TOLERANCE && stream_difference <= MADGWICK_BATCH_TOLERANCE;
+        printf("%-28s %-5s %8zu %12.2e %8d %12.2e%s\n", name, use_mag ? "MARG" : "IMU", recording.size(), batch_difference, streams,
+            stream_difference, passed ? "" : "  OUTSIDE TOLERANCE");
+        return passed;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    float beta = 0.041f;
+    std::vector<const char*> files;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--beta" && i + 1 < argc) beta = (float)atof(argv[++i]);
+        else if (argument.size() > 1 && argument[0] == '-')
+        {
+            printf("Usage: %s [--beta <filter gain>] <data set> [<data set> ...]\n", argv[0]);
+            return 1;
+        }
+        else files.push_back(argv[i]);
+    }
+    if (files.empty())
+    {
+        printf("Usage: %s [--beta <filter gain>] <data set> [<data set> ...]\n", argv[0]);
+        return 1;
+    }
+
+    bool all_passed = true;
+    printf("%d lane%s per group, tolerance %.0e\n\n", madgwickStreamLanes(), (madgwickStreamLanes() == 1) ? "" : "s", MADGWICK_BATCH_TOLERANCE);
+    printf("%-28s %-5s %8s %12s %8s %12s\n", "data set", "mode", "samples", "batch diff", "streams", "stream diff");
+
+    for (const char* file : files)
+    {
+        Recording recording;
+        if (!loadRecording(file, recording))
+        {
+            fprintf(stderr, "Couldn't read any samples from '%s'\n", file);
+            all_passed = false;
+            continue;
+        }
+
+        std::string name = file;
+        size_t slash = name.find_last_of("/\\");
+        if (slash != std::string::npos) name = name.substr(slash + 1);
+
+        all_passed = checkRecording(recording, true, beta, name.c_str()) && all_passed;
+        all_passed = checkRecording(recording, false, beta, name.c_str()) && all_passed;
+    }
+
+    printf("\n%s\n", all_passed ? "The batched filters match the scalar ones" : "The batched filters don't match the scalar ones");
+    return all_passed ? 0 : 1;
+}
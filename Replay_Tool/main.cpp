@@ -0,0 +1,154 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "ReplayEngine.h"
+
+//Command line front end for the replay engine. Replays one or more recorded data sets through calibration, sensor
+//fusion, Euler angles and linear acceleration as fast as the CPU allows and reports the throughput of each stage.
+//See readme.txt for how to build it.
+
+namespace
+{
+    void printUsage(const char* program)
+    {
+        printf("Usage: %s [options] <data set> [<data set> ...]\n\n", program);
+        printf("Options:\n");
+        printf("  --filter <madgwick|fusion>  sensor fusion algorithm to use (default madgwick)\n");
+        printf("  --beta <value>              Madgwick filter gain (default 0.041)\n");
+        printf("  --gain <value>              Fusion AHRS gain (default 0.5)\n");
+        printf("  --odr <hz>                  sample rate of the data, by default it comes from the time stamps\n");
+        printf("  --block <samples>           samples processed at once (default %d, the size of a BLE packet)\n", REPLAY_DEFAULT_BLOCK_SIZE);
+        printf("  --acc-cal <file>            accelerometer calibration file\n");
+        printf("  --gyr-cal <file>            gyroscope calibration file\n");
+        printf("  --mag-cal <file>            magnetometer calibration file\n");
+        printf("  --no-euler                  skip the Euler angle stage\n");
+        printf("  --no-linear                 skip the linear acceleration stage\n");
+        printf("  --no-align                  start the filter at no rotation instead of the orientation found from the first samples\n");
+        printf("  --output-dir <directory>    write the processed data for each data set to <directory>/<name>.replay.txt\n");
+        printf("  --repeat <count>            replay the data sets this many times (useful for timing short recordings)\n");
+    }
+
+    std::string fileName(std::string const& path)
+    {
+        size_t slash = path.find_last_of("/\\");
+        std::string name = (slash == std::string::npos) ? path : path.substr(slash + 1);
+        size_t dot = name.find_last_of('.');
+        return (dot == std::string::npos) ? name : name.substr(0, dot);
+    }
+
+    void printStats(const char* label, ReplayStats const& stats)
+    {
+        printf("%s: %llu samples (%.2f s of data) in %.3f ms, %.0f samples/s, %.0fx real time\n", label, (unsigned long long)stats.samples,
+            stats.recordingSeconds, stats.totalSeconds * 1000.0, stats.samplesPerSecond(), stats.realTimeFactor());
+
+        for (int stage = 0; stage < REPLAY_STAGES; stage++)
+        {
+            if (stats.stageSeconds[stage] == 0.0) continue;
+            double per_sample = (stats.samples > 0) ? stats.stageSeconds[stage] * 1.0e9 / stats.samples : 0.0;
+            double percent = (stats.totalSeconds > 0.0) ? 100.0 * stats.stageSeconds[stage] / stats.totalSeconds : 0.0;
+            printf("    %-20s %10.3f ms %10.1f ns/sample %6.1f%%\n", replayStageName(stage), stats.stageSeconds[stage] * 1000.0, per_sample, percent);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    ReplaySettings settings;
+    std::vector<std::string> data_sets;
+    std::string output_directory;
+    int repeat = 1;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        bool has_value = (i + 1 < argc);
+
+        if (argument == "--filter" && has_value)
+        {
+            std::string filter = argv[++i];
+            if (filter == "madgwick") settings.filter = ReplayFilter::MADGWICK;
+            else if (filter == "fusion") settings.filter = ReplayFilter::FUSION;
+            else
+            {
+                fprintf(stderr, "Unknown filter '%s'\n", filter.c_str());
+                return 1;
+            }
+        }
+        else if (argument == "--beta" && has_value) settings.beta = strtof(argv[++i], nullptr);
+        else if (argument == "--gain" && has_value) settings.fusionGain = strtof(argv[++i], nullptr);
+        else if (argument == "--odr" && has_value) settings.odr = strtof(argv[++i], nullptr);
+        else if (argument == "--block" && has_value) settings.blockSize = atoi(argv[++i]);
+        else if (argument == "--repeat" && has_value) repeat = atoi(argv[++i]);
+        else if (argument == "--output-dir" && has_value) output_directory = argv[++i];
+        else if (argument == "--no-euler") settings.eulerAngles = false;
+        else if (argument == "--no-linear") settings.linearAcceleration = false;
+        else if (argument == "--no-align") settings.alignAttitude = false;
+        else if ((argument == "--acc-cal" || argument == "--gyr-cal" || argument == "--mag-cal") && has_value)
+        {
+            int sensor = (argument == "--acc-cal") ? REPLAY_ACC : (argument == "--gyr-cal") ? REPLAY_GYR : REPLAY_MAG;
+            if (!loadReplayCalibration(argv[++i], settings.calibration[sensor]))
+            {
+                fprintf(stderr, "Couldn't read calibration numbers from '%s'\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (argument == "--help" || argument == "-h")
+        {
+            printUsage(argv[0]);
+            return 0;
+        }
+        else if (argument.compare(0, 2, "--") == 0)
+        {
+            fprintf(stderr, "Unknown option '%s'\n\n", argument.c_str());
+            printUsage(argv[0]);
+            return 1;
+        }
+        else data_sets.push_back(argument);
+    }
+
+    if (data_sets.empty())
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+    if (repeat < 1) repeat = 1;
+
+    ReplayEngine engine(settings);
+    std::vector<ReplayStats> file_stats(data_sets.size());
+    ReplayStats total;
+
+    for (int pass = 0; pass < repeat; pass++)
+    {
+        for (size_t file = 0; file < data_sets.size(); file++)
+        {
+            //The processed data only needs to be written out once
+            FILE* output = nullptr;
+            if (pass == 0 && !output_directory.empty())
+            {
+                std::string output_location = output_directory + "/" + fileName(data_sets[file]) + ".replay.txt";
+                output = fopen(output_location.c_str(), "w");
+                if (output == nullptr) fprintf(stderr, "Couldn't create '%s', the processed data won't be saved\n", output_location.c_str());
+            }
+
+            ReplayStats stats;
+            bool replayed = engine.replay(data_sets[file], stats, output);
+            if (output != nullptr) fclose(output);
+
+            if (!replayed)
+            {
+                fprintf(stderr, "Couldn't open '%s'\n", data_sets[file].c_str());
+                return 1;
+            }
+
+            file_stats[file].add(stats);
+            total.add(stats);
+        }
+    }
+
+    for (size_t file = 0; file < data_sets.size(); file++) printStats(data_sets[file].c_str(), file_stats[file]);
+    if (data_sets.size() > 1) printStats("total", total);
+
+    return 0;
+}
@@ -0,0 +1,278 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "../DirectXApp/Devices/CompositeDataDecoder.h"
+
+//Packs recorded data sets (time, gyroscope, accelerometer and magnetometer columns like the files in
+//Console_Application/Resources/Data_Sets) into composite characteristic notifications the same way the
+//Personal Caddie does when packed samples are turned on, then unpacks them with the decoder the app uses and
+//checks that every reading comes back exactly. Reports how much smaller the notifications get and how fast
+//they decode. See readme.txt for how to build it.
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    const int CHANNELS = COMPOSITE_SENSORS * COMPOSITE_AXES;
+    const int RAW_SAMPLES_PER_NOTIFICATION = COMPOSITE_MAX_SAMPLES / 3; //what fits in the large characteristic without packing
+    const int NOTIFICATION_CAPACITY = RAW_SAMPLES_PER_NOTIFICATION * COMPOSITE_SAMPLE_SIZE; //bytes after the header in the large characteristic
+
+    //LSB per unit of the text files (m/s^2, degrees/s and gauss) with the default Personal Caddie settings: the BMI270
+    //at +/-4 g and +/-2000 degrees/s, and the BMM150 at 0.3 uT per LSB (see bmi_bmm_fsr_conversion())
+    const float DEFAULT_LSB_PER_UNIT[COMPOSITE_SENSORS] = { 8192.0f / 9.80665f, 16.384f, 100.0f / 0.3f };
+
+    struct Recording
+    {
+        std::vector<int16_t> readings[CHANNELS]; //acc xyz, gyr xyz, mag xyz to match the composite characteristic
+        float odr = 400.0f;
+    };
+
+    bool loadRecording(const char* file_location, bool full_range, Recording& recording)
+    {
+        FILE* file = fopen(file_location, "r");
+        if (file == nullptr) return false;
+
+        //The text files hold gyroscope readings before accelerometer readings, the composite characteristic is the other way around
+        const int column_order[CHANNELS] = { 3, 4, 5, 0, 1, 2, 6, 7, 8 };
+        std::vector<float> time, columns[CHANNELS];
+
+        char line[512];
+        while (fgets(line, sizeof(line), file) != nullptr)
+        {
+            float values[1 + CHANNELS];
+            char* position = line;
+            int column = 0;
+            for (; column < 1 + CHANNELS; column++)
+            {
+                char* end = nullptr;
+                values[column] = strtof(position, &end);
+                if (end == position) break;
+                position = end;
+            }
+            if (column < 1 + CHANNELS) continue;
+
+            time.push_back(values[0]);
+            for (int channel = 0; channel < CHANNELS; channel++) columns[channel].push_back(values[1 + column_order[channel]]);
+        }
+        fclose(file);
+        if (time.empty()) return false;
+
+        //The text files hold readings in real units, which get turned back into the readings the sensors would have
+        //sent with their default settings. With full_range each sensor instead gets a conversion rate that uses the
+        //full int16 range for its largest reading (like session_convert does). That's the worst case for packing since
+        //every bit of noise ends up in the differences.
+        for (int sensor = 0; sensor < COMPOSITE_SENSORS; sensor++)
+        {
+            float largest = 0.0f;
+            for (int axis = 0; axis < COMPOSITE_AXES; axis++)
+            {
+                for (float value : columns[sensor * COMPOSITE_AXES + axis]) largest = std::fmax(largest, std::fabs(value));
+            }
+            float conversion_rate = 1.0f / DEFAULT_LSB_PER_UNIT[sensor];
+            if (full_range) conversion_rate = (largest > 0.0f) ? largest / 32767.0f : 1.0f;
+
+            for (int axis = 0; axis < COMPOSITE_AXES; axis++)
+            {
+                std::vector<int16_t>& readings = recording.readings[sensor * COMPOSITE_AXES + axis];
+                for (float value : columns[sensor * COMPOSITE_AXES + axis])
+                {
+                    long lsb = lrintf(value / conversion_rate);
+                    readings.push_back((int16_t)((lsb > 32767) ? 32767 : ((lsb < -32768) ? -32768 : lsb)));
+                }
+            }
+        }
+        if (time.size() > 1 && time[1] > time[0]) recording.odr = 1.0f / (time[1] - time[0]);
+
+        return true;
+    }
+
+    struct Notification
+    {
+        std::vector<uint8_t> bytes;
+        size_t first_sample;
+    };
+
+    //Splits the recording into data sets and sends each one the way the firmware does: as many notifications as it
+    //takes, each one holding as many samples as sample_packing_encode() can fit
+    void packRecording(Recording const& recording, int samples_per_data_set, uint8_t encoding, std::vector<Notification>& notifications)
+    {
+        size_t total_samples = recording.readings[0].size();
+        uint32_t ticks_per_sample = (uint32_t)(16000000.0 / recording.odr);
+        uint16_t sequence = 0;
+        uint8_t data_set[COMPOSITE_MAX_SAMPLES * COMPOSITE_SAMPLE_SIZE];
+
+        for (size_t first = 0; first < total_samples; first += samples_per_data_set)
+        {
+            int samples = (int)((total_samples - first < (size_t)samples_per_data_set) ? total_samples - first : samples_per_data_set);
+            for (int i = 0; i < samples; i++)
+            {
+                for (int channel = 0; channel < CHANNELS; channel++)
+                {
+                    uint16_t reading = (uint16_t)recording.readings[channel][first + i];
+                    data_set[i * COMPOSITE_SAMPLE_SIZE + 2 * channel] = (uint8_t)(reading & 0xFF);
+                    data_set[i * COMPOSITE_SAMPLE_SIZE + 2 * channel + 1] = (uint8_t)(reading >> 8);
+                }
+            }
+
+            int sent = 0;
+            while (sent < samples)
+            {
+                Notification notification;
+                notification.first_sample = first + sent;
+                notification.bytes.resize(COMPOSITE_HEADER_SIZE + NOTIFICATION_CAPACITY);
+
+                uint16_t length = 0;
+                bool packed = false;
+                uint8_t count = sample_packing_encode(data_set + sent * COMPOSITE_SAMPLE_SIZE, (uint8_t)(samples - sent), encoding,
+                    notification.bytes.data() + COMPOSITE_HEADER_SIZE, NOTIFICATION_CAPACITY, &length, &packed);
+                if (count == 0) return;
+
+                uint32_t timer_ticks = (uint32_t)(notification.first_sample * ticks_per_sample);
+                for (int byte = 0; byte < 4; byte++) notification.bytes[byte] = (uint8_t)(timer_ticks >> (8 * byte));
+                notification.bytes[4] = packed ? (uint8_t)(count | SAMPLE_PACKING_PACKED_FLAG) : count;
+                notification.bytes[5] = (uint8_t)(sequence & 0xFF);
+                notification.bytes[6] = (uint8_t)(sequence >> 8);
+                notification.bytes[7] = notification.bytes[8] = 0;
+                notification.bytes.resize(COMPOSITE_HEADER_SIZE + length);
+
+                notifications.push_back(notification);
+                sequence++;
+                sent += count;
+            }
+        }
+    }
+
+    bool checkRoundTrip(Recording const& recording, std::vector<Notification> const& notifications, size_t& packed_notifications)
+    {
+        //Every reading has to come back exactly as it went in
+        size_t next_sample = 0;
+        int16_t readings[CHANNELS][COMPOSITE_MAX_SAMPLES];
+        packed_notifications = 0;
+
+        for (Notification const& notification : notifications)
+        {
+            CompositePacketHeader header;
+            CompositeDataDecoder::readHeader(notification.bytes.data(), notification.bytes.size(), header);
+            int samples = CompositeDataDecoder::readSamples(notification.bytes.data(), notification.bytes.size(), header, readings[0], COMPOSITE_MAX_SAMPLES);
+            if (samples <= 0 || notification.first_sample != next_sample) return false;
+            if (header.packed) packed_notifications++;
+
+            for (int i = 0; i < samples; i++)
+            {
+                for (int channel = 0; channel < CHANNELS; channel++)
+                {
+                    if (readings[channel][i] != recording.readings[channel][next_sample + i]) return false;
+                }
+            }
+            next_sample += samples;
+        }
+
+        return next_sample == recording.readings[0].size();
+    }
+
+    double decodeSeconds(std::vector<Notification> const& notifications, int repeat, double& checksum)
+    {
+        //Runs every notification through the full decode the app does (unpacking, calibration and conversion to floats)
+        CompositeDataDecoder decoder;
+        std::vector<float> outputs[CHANNELS];
+        CompositeDecodeOutput output;
+        for (int channel = 0; channel < CHANNELS; channel++)
+        {
+            outputs[channel].resize(COMPOSITE_MAX_SAMPLES);
+            output.calibrated[channel / COMPOSITE_AXES][channel % COMPOSITE_AXES] = outputs[channel].data();
+        }
+
+        Clock::time_point start = Clock::now();
+        for (int pass = 0; pass < repeat; pass++)
+        {
+            for (Notification const& notification : notifications)
+            {
+                uint32_t timer_ticks = 0;
+                int samples = decoder.decode(notification.bytes.data(), notification.bytes.size(), timer_ticks, output);
+                if (samples > 0) checksum += outputs[0][samples - 1];
+            }
+        }
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    size_t totalBytes(std::vector<Notification> const& notifications)
+    {
+        size_t bytes = 0;
+        for (Notification const& notification : notifications) bytes += notification.bytes.size();
+        return bytes;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int samples_per_data_set = COMPOSITE_MAX_SAMPLES, repeat = 100;
+    bool full_range = false;
+    std::vector<const char*> files;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--samples" && i + 1 < argc) samples_per_data_set = atoi(argv[++i]);
+        else if (argument == "--repeat" && i + 1 < argc) repeat = atoi(argv[++i]);
+        else if (argument == "--full-range") full_range = true;
+        else if (argument.size() > 1 && argument[0] == '-')
+        {
+            printf("Usage: %s [--samples <samples per data set, 1 - %d>] [--repeat <decode passes>] [--full-range] <data set> [<data set> ...]\n", argv[0], COMPOSITE_MAX_SAMPLES);
+            return 1;
+        }
+        else files.push_back(argv[i]);
+    }
+    if (files.empty() || samples_per_data_set < 1 || samples_per_data_set > COMPOSITE_MAX_SAMPLES || repeat < 1)
+    {
+        printf("Usage: %s [--samples <samples per data set, 1 - %d>] [--repeat <decode passes>] [--full-range] <data set> [<data set> ...]\n", argv[0], COMPOSITE_MAX_SAMPLES);
+        return 1;
+    }
+
+    bool all_passed = true;
+    double checksum = 0.0;
+    printf("%-28s %9s %9s %9s %7s %13s %13s %11s %11s\n", "data set", "samples", "raw B", "packed B", "ratio", "raw notif.", "packed notif.", "raw ns/smp", "pack ns/smp");
+
+    for (const char* file : files)
+    {
+        Recording recording;
+        if (!loadRecording(file, full_range, recording))
+        {
+            fprintf(stderr, "Couldn't read any samples from '%s'\n", file);
+            all_passed = false;
+            continue;
+        }
+        size_t total_samples = recording.readings[0].size();
+
+        //Raw notifications can't hold more than 13 samples so the raw data sets get capped at that
+        std::vector<Notification> raw, packed;
+        packRecording(recording, (samples_per_data_set < RAW_SAMPLES_PER_NOTIFICATION) ? samples_per_data_set : RAW_SAMPLES_PER_NOTIFICATION, SAMPLE_ENCODING_RAW, raw);
+        packRecording(recording, samples_per_data_set, SAMPLE_ENCODING_PACKED, packed);
+
+        size_t raw_packed_count = 0, packed_count = 0;
+        bool passed = checkRoundTrip(recording, raw, raw_packed_count) && checkRoundTrip(recording, packed, packed_count);
+        all_passed = all_passed && passed;
+
+        double raw_seconds = decodeSeconds(raw, repeat, checksum);
+        double packed_seconds = decodeSeconds(packed, repeat, checksum);
+        size_t raw_bytes = totalBytes(raw), packed_bytes = totalBytes(packed);
+
+        std::string name = file;
+        size_t slash = name.find_last_of("/\\");
+        if (slash != std::string::npos) name = name.substr(slash + 1);
+
+        printf("%-28s %9zu %9zu %9zu %6.2fx %13zu %13zu %11.1f %11.1f%s\n", name.c_str(), total_samples, raw_bytes, packed_bytes,
+            (packed_bytes > 0) ? (double)raw_bytes / packed_bytes : 0.0, raw.size(), packed.size(),
+            1e9 * raw_seconds / (repeat * (double)total_samples), 1e9 * packed_seconds / (repeat * (double)total_samples), passed ? "" : "  ROUND TRIP FAILED");
+        printf("%-28s %.1f samples per notification (%.1f raw), %.1f%% of notifications packed, packed decode %.0f MB/s\n", "",
+            (double)total_samples / packed.size(), (double)total_samples / raw.size(), 100.0 * packed_count / packed.size(),
+            (packed_seconds > 0.0) ? repeat * (double)packed_bytes / packed_seconds / 1e6 : 0.0);
+    }
+
+    if (checksum == 12345.678) printf("\n"); //keeps the decode loops from being optimized away
+    printf("\n%s\n", all_passed ? "Every reading round tripped exactly" : "Some readings didn't round trip");
+    return all_passed ? 0 : 1;
+}
@@ -0,0 +1,301 @@
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../DirectXApp/Devices/DeviceSession.h"
+#include "../DirectXApp/Devices/FakeTransport.h"
+
+//Times how long it takes to get from a BLE connection to the Personal Caddie to the point the app can use it, the way
+//PersonalCaddie::BLEDeviceHandler() used to do it and through the DeviceSession it uses now. Everything runs over the
+//simulated link in FakeTransport, so the numbers are connection intervals and ATT requests rather than anything about
+//a particular computer. See readme.txt for how to build it.
+
+namespace
+{
+    struct Options
+    {
+        std::vector<double> intervals = { 7.5, 15.0, 30.0, 50.0 };
+        FakeLinkSettings link;
+    };
+
+    struct Result
+    {
+        bool success = false;
+        double connected = 0.0; //ms until the app could say it was connected
+        double settled = 0.0; //ms until every request made during the startup had come back
+        int requests = 0;
+        SessionStartup startup;
+    };
+
+    std::vector<double> parseList(const char* text)
+    {
+        std::vector<double> values;
+        std::string list = text;
+        size_t start = 0;
+        while (start < list.size())
+        {
+            size_t comma = list.find(',', start);
+            if (comma == std::string::npos) comma = list.size();
+            values.push_back(atof(list.substr(start, comma - start).c_str()));
+            start = comma + 1;
+        }
+        return values;
+    }
+
+    //The old startup. The GATT table was walked with BluetoothCacheMode::Uncached on every connection, then three
+    //things ran side by side: the error CCCD was read and then written, the small data CCCD was read and the data
+    //CCCDs were written one after the other in nested callbacks, and the settings and available sensors characteristics
+    //were read with blocking .get() calls. CONNECTION_EVENT went out after the second blocking read. The CCCD reads
+    //are stood in for by reads of the characteristic itself, they take the same single request.
+    struct LegacyStartup
+    {
+        FakeTransport& transport;
+        std::promise<void> done;
+        std::mutex mutex;
+        int chains = 3;
+        bool success = true;
+        double connected = 0.0;
+        double settled = 0.0;
+        SessionStartup startup;
+
+        LegacyStartup(FakeTransport& t) : transport(t) {}
+
+        void chainDone(bool ok)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            success = success && ok;
+            if (--chains == 0)
+            {
+                settled = transport.now();
+                done.set_value();
+            }
+        }
+
+        void writeCccds(std::vector<GattAttribute> attributes, size_t next)
+        {
+            if (next == attributes.size())
+            {
+                chainDone(true);
+                return;
+            }
+            transport.writeCccd(attributes[next], false, [this, attributes, next](bool ok)
+                {
+                    if (ok) writeCccds(attributes, next + 1);
+                    else chainDone(false);
+                });
+        }
+
+        void run(bool burst)
+        {
+            transport.discover([this, burst](bool ok, GattHandleMap const& map)
+                {
+                    if (!ok)
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        chains = 1;
+                        chainDone(false);
+                        return;
+                    }
+                    startup.map = map;
+
+                    transport.read(GattAttribute::Error, [this](bool ok, std::vector<uint8_t> const&)
+                        {
+                            if (!ok) chainDone(false);
+                            else transport.writeCccd(GattAttribute::Error, true, [this](bool ok) { chainDone(ok); });
+                        });
+
+                    std::vector<GattAttribute> data = { GattAttribute::SmallData, GattAttribute::MediumData, GattAttribute::LargeData };
+                    if (burst) data.push_back(GattAttribute::BurstData);
+                    transport.read(GattAttribute::SmallData, [this, data](bool ok, std::vector<uint8_t> const&)
+                        {
+                            if (!ok) chainDone(false);
+                            else writeCccds(data, 0);
+                        });
+
+                    transport.read(GattAttribute::Settings, [this](bool ok, std::vector<uint8_t> const& settings)
+                        {
+                            startup.settings = settings;
+                            if (!ok)
+                            {
+                                chainDone(false);
+                                return;
+                            }
+                            transport.read(GattAttribute::AvailableSensors, [this](bool ok, std::vector<uint8_t> const& available)
+                                {
+                                    startup.availableSensors = available;
+                                    connected = transport.now();
+                                    chainDone(ok);
+                                });
+                        });
+                });
+        }
+    };
+
+    Result runLegacy(FakeDevice& device, FakeLinkSettings const& link)
+    {
+        FakeTransport transport(device, link);
+        LegacyStartup legacy(transport);
+        std::future<void> finished = legacy.done.get_future();
+
+        double start = transport.now();
+        legacy.run(device.map[GattAttribute::BurstData] != 0);
+        finished.wait();
+
+        Result result;
+        result.success = legacy.success;
+        result.connected = legacy.connected - start;
+        result.settled = legacy.settled - start;
+        result.requests = transport.requests();
+        result.startup = legacy.startup;
+        return result;
+    }
+
+    Result runSession(FakeDevice& device, FakeLinkSettings const& link, GattHandleCache& cache)
+    {
+        //Each run is a new connection, so it gets a new transport
+        FakeTransport transport(device, link);
+        DeviceSession session(transport, cache);
+        std::promise<Result> done;
+        std::future<Result> finished = done.get_future();
+
+        double start = transport.now();
+        session.start([&](SessionStartup const& startup)
+            {
+                Result result;
+                result.success = startup.success;
+                result.connected = transport.now() - start;
+                result.settled = result.connected; //nothing is left in flight once the session finishes
+                result.requests = transport.requests();
+                result.startup = startup;
+                done.set_value(result);
+            });
+        return finished.get();
+    }
+
+    bool matches(Result const& result, FakeDevice const& device)
+    {
+        //The app ends up with the right characteristic values and the device ends up notifying the way the app wants
+        bool ok = result.success && result.startup.settings == device.settings && result.startup.availableSensors == device.availableSensors;
+        ok = ok && device.notifying[static_cast<int>(GattAttribute::Error)];
+        for (GattAttribute data : { GattAttribute::SmallData, GattAttribute::MediumData, GattAttribute::LargeData, GattAttribute::BurstData })
+        {
+            ok = ok && !device.notifying[static_cast<int>(data)];
+        }
+        return ok;
+    }
+
+    void resetNotifications(FakeDevice& device)
+    {
+        //A Personal Caddie that was streaming when it lost its last connection
+        for (int i = 0; i < GATT_ATTRIBUTE_COUNT; i++) device.notifying[i] = (device.map.handles[i] != 0 && static_cast<GattAttribute>(i) != GattAttribute::Error);
+    }
+
+    void usage()
+    {
+        printf("Usage: session_benchmark [options]\n");
+        printf("  --intervals a,b,...      connection intervals in ms (default 7.5,15,30,50)\n");
+        printf("  --host-delay ms          time between asking for something and it being ready to send (default 1)\n");
+        printf("  --response-events n      connection events until a response comes back (default 1)\n");
+        printf("  --discovery-requests n   ATT requests it takes to walk the GATT table (default 12)\n");
+        printf("  --speedup x              run the link x times faster than real time (default 4)\n");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    options.link.speedup = 4.0;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+        if (arg == "--intervals" && hasValue) options.intervals = parseList(argv[++i]);
+        else if (arg == "--host-delay" && hasValue) options.link.hostDelay = atof(argv[++i]);
+        else if (arg == "--response-events" && hasValue) options.link.responseEvents = atoi(argv[++i]);
+        else if (arg == "--discovery-requests" && hasValue) options.link.discoveryRequests = atoi(argv[++i]);
+        else if (arg == "--speedup" && hasValue) options.link.speedup = atof(argv[++i]);
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    bool valid = !options.intervals.empty() && options.link.hostDelay >= 0.0 && options.link.responseEvents >= 1 &&
+        options.link.discoveryRequests >= 1 && options.link.speedup > 0.0;
+    for (double interval : options.intervals) valid = valid && interval > 0.0;
+    if (!valid)
+    {
+        usage();
+        return 1;
+    }
+
+    bool ok = true;
+    printf("Host delay %.1f ms, responses after %d connection event%s, %d requests to walk the GATT table\n\n", options.link.hostDelay,
+        options.link.responseEvents, options.link.responseEvents == 1 ? "" : "s", options.link.discoveryRequests);
+    printf("%-10s %-22s %12s %12s %10s %8s\n", "interval", "startup", "connected", "settled", "requests", "waits");
+
+    for (double interval : options.intervals)
+    {
+        FakeLinkSettings link = options.link;
+        link.connectionInterval = interval;
+        const uint64_t address = 0xC0FFEE000001ULL;
+
+        //The old startup, then the first connection to a device, reconnecting to it with its map cached and
+        //reconnecting after it got firmware without the burst data characteristic (so the cached map is stale)
+        FakeDevice device = FakeDevice::personalCaddie(address);
+        resetNotifications(device);
+        Result legacy = runLegacy(device, link);
+        bool legacyOk = matches(legacy, device);
+
+        GattHandleCache cache;
+        resetNotifications(device);
+        Result first = runSession(device, link, cache);
+        bool firstOk = matches(first, device) && !first.startup.usedCache && cache.size() == 1;
+
+        resetNotifications(device);
+        Result cached = runSession(device, link, cache);
+        bool cachedOk = matches(cached, device) && cached.startup.usedCache && !cached.startup.cacheWasStale;
+
+        FakeDevice reflashed = FakeDevice::personalCaddie(address, false);
+        resetNotifications(reflashed);
+        Result stale = runSession(reflashed, link, cache);
+        GattHandleMap stored;
+        bool staleOk = matches(stale, reflashed) && stale.startup.cacheWasStale && !stale.startup.usedCache &&
+            cache.find(address, stored) && stored == reflashed.map;
+
+        //The cache has to survive being written to a file and read back
+        GattHandleCache reloaded;
+        bool fileOk = reloaded.deserialize(cache.serialize()) && reloaded.find(address, stored) && stored == reflashed.map;
+
+        struct Row { const char* name; Result const& result; bool passed; } rows[] = {
+            { "before (uncached)", legacy, legacyOk },
+            { "first connection", first, firstOk },
+            { "reconnect (cached)", cached, cachedOk },
+            { "reconnect (stale)", stale, staleOk }
+        };
+        for (Row const& row : rows)
+        {
+            printf("%-10.1f %-22s %12.1f %12.1f %10d %8s%s\n", interval, row.name, row.result.connected, row.result.settled, row.result.requests,
+                (&row.result == &legacy) ? "-" : std::to_string(row.result.startup.stages).c_str(), row.passed ? "" : "  FAILED");
+            ok = ok && row.passed;
+        }
+        if (!fileOk)
+        {
+            printf("The handle cache didn't survive being saved and loaded\n");
+            ok = false;
+        }
+        if (cached.connected >= legacy.connected || first.settled >= legacy.settled)
+        {
+            printf("The session isn't faster than the old startup\n");
+            ok = false;
+        }
+        printf("\n");
+    }
+
+    printf("%s\n", ok ? "All checks passed" : "FAILED");
+    return ok ? 0 : 1;
+}
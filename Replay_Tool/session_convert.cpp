@@ -0,0 +1,231 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "../DirectXApp/Devices/CompositeDataDecoder.h"
+#include "../DirectXApp/Devices/SessionFile.h"
+
+//Converts text data sets (time, gyroscope, accelerometer and magnetometer columns like the files in
+//Console_Application/Resources/Data_Sets) into binary session files, and benchmarks how long it takes to load
+//the same data from each format. See readme.txt for how to build it.
+
+namespace
+{
+    struct TextDataSet
+    {
+        std::vector<float> time;
+        std::vector<float> columns[SESSION_FILE_CHANNELS]; //acc xyz, gyr xyz, mag xyz to match the composite characteristic
+    };
+
+    bool loadTextDataSet(const char* file_location, TextDataSet& data)
+    {
+        FILE* file = fopen(file_location, "r");
+        if (file == nullptr) return false;
+
+        //The text files hold gyroscope readings before accelerometer readings, the composite characteristic is the other way around
+        const int column_order[SESSION_FILE_CHANNELS] = { 3, 4, 5, 0, 1, 2, 6, 7, 8 };
+
+        char line[512];
+        while (fgets(line, sizeof(line), file) != nullptr)
+        {
+            float values[1 + SESSION_FILE_CHANNELS];
+            char* position = line;
+            int column = 0;
+            for (; column < 1 + SESSION_FILE_CHANNELS; column++)
+            {
+                char* end = nullptr;
+                values[column] = strtof(position, &end);
+                if (end == position) break;
+                position = end;
+            }
+            if (column < 1 + SESSION_FILE_CHANNELS) continue;
+
+            data.time.push_back(values[0]);
+            for (int channel = 0; channel < SESSION_FILE_CHANNELS; channel++) data.columns[channel].push_back(values[1 + column_order[channel]]);
+        }
+
+        fclose(file);
+        return true;
+    }
+
+    bool convert(const char* text_location, const char* session_location, int samples_per_packet)
+    {
+        TextDataSet data;
+        if (!loadTextDataSet(text_location, data) || data.time.empty())
+        {
+            fprintf(stderr, "Couldn't read any samples from '%s'\n", text_location);
+            return false;
+        }
+
+        //The text files hold readings in real units, so pick a conversion rate for each sensor that uses the
+        //full int16 range for the largest reading in the file. The axes and calibration are left as identity.
+        SessionFileHeader header;
+        initializeSessionFileHeader(header);
+        header.odr = (data.time.size() > 1 && data.time[1] > data.time[0]) ? 1.0f / (data.time[1] - data.time[0]) : 400.0f;
+        for (int sensor = 0; sensor < SESSION_FILE_SENSORS; sensor++)
+        {
+            float largest = 0.0f;
+            for (int axis = 0; axis < SESSION_FILE_AXES; axis++)
+            {
+                for (float value : data.columns[sensor * SESSION_FILE_AXES + axis]) largest = std::fmax(largest, std::fabs(value));
+            }
+            header.conversion_rates[sensor] = (largest > 0.0f) ? largest / 32767.0f : 1.0f;
+        }
+
+        SessionFileWriter writer;
+        if (!writer.open(session_location, header))
+        {
+            fprintf(stderr, "Couldn't create '%s'\n", session_location);
+            return false;
+        }
+
+        //Rebuild the notifications the Personal Caddie would have sent so the file goes through the same path as live data
+        uint8_t notification[COMPOSITE_HEADER_SIZE + COMPOSITE_MAX_SAMPLES * COMPOSITE_SAMPLE_SIZE];
+        const size_t total_samples = data.time.size();
+        uint16_t sequence = 0;
+        for (size_t first = 0; first < total_samples; first += samples_per_packet, sequence++)
+        {
+            int samples = (int)((total_samples - first < (size_t)samples_per_packet) ? total_samples - first : samples_per_packet);
+            uint32_t timer_ticks = (uint32_t)(uint64_t)llround(data.time[first] * SESSION_FILE_TICK_FREQUENCY);
+
+            for (int byte = 0; byte < 4; byte++) notification[byte] = (uint8_t)(timer_ticks >> (8 * byte));
+            notification[4] = (uint8_t)samples;
+            notification[5] = (uint8_t)(sequence & 0xFF);
+            notification[6] = (uint8_t)(sequence >> 8);
+            notification[7] = notification[8] = 0; //nothing gets dropped
+
+            uint8_t* reading = notification + COMPOSITE_HEADER_SIZE;
+            for (int i = 0; i < samples; i++)
+            {
+                for (int channel = 0; channel < SESSION_FILE_CHANNELS; channel++, reading += 2)
+                {
+                    long lsb = lrintf(data.columns[channel][first + i] / header.conversion_rates[channel / SESSION_FILE_AXES]);
+                    if (lsb > 32767) lsb = 32767;
+                    else if (lsb < -32768) lsb = -32768;
+                    reading[0] = (uint8_t)(lsb & 0xFF);
+                    reading[1] = (uint8_t)((lsb >> 8) & 0xFF);
+                }
+            }
+
+            writer.append(notification, COMPOSITE_HEADER_SIZE + samples * COMPOSITE_SAMPLE_SIZE);
+        }
+        writer.close();
+
+        printf("Converted %zu samples from '%s' into '%s'\n", total_samples, text_location, session_location);
+        return writer.droppedChunks() == 0;
+    }
+
+    long fileSize(const char* file_location)
+    {
+        FILE* file = fopen(file_location, "rb");
+        if (file == nullptr) return 0;
+        fseek(file, 0, SEEK_END);
+        long size = ftell(file);
+        fclose(file);
+        return size;
+    }
+
+    bool benchmark(const char* text_location, const char* session_location, int repeat)
+    {
+        //Compares loading every reading of a data set from text against opening the binary session file and
+        //reading every value out of the mapping. A checksum of the data is kept so nothing gets optimized away.
+        typedef std::chrono::steady_clock Clock;
+        double checksum = 0.0;
+        size_t text_samples = 0, binary_samples = 0;
+
+        Clock::time_point start = Clock::now();
+        for (int pass = 0; pass < repeat; pass++)
+        {
+            TextDataSet data;
+            if (!loadTextDataSet(text_location, data)) return false;
+            for (int channel = 0; channel < SESSION_FILE_CHANNELS; channel++)
+            {
+                for (float value : data.columns[channel]) checksum += value;
+            }
+            text_samples = data.time.size();
+        }
+        double text_seconds = std::chrono::duration<double>(Clock::now() - start).count() / repeat;
+
+        start = Clock::now();
+        for (int pass = 0; pass < repeat; pass++)
+        {
+            SessionFileReader reader;
+            if (!reader.open(session_location)) return false;
+
+            const float* conversion_rates = reader.header().conversion_rates;
+            for (size_t chunk = 0; chunk < reader.chunks(); chunk++)
+            {
+                SessionFileChunkView view = reader.chunk(chunk);
+                for (int channel = 0; channel < SESSION_FILE_CHANNELS; channel++)
+                {
+                    const float rate = conversion_rates[channel / SESSION_FILE_AXES];
+                    const int16_t* column = view.channel[channel];
+                    for (uint32_t i = 0; i < view.samples; i++) checksum += column[i] * rate;
+                }
+            }
+            binary_samples = (size_t)reader.samples();
+        }
+        double binary_seconds = std::chrono::duration<double>(Clock::now() - start).count() / repeat;
+
+        long text_size = fileSize(text_location), binary_size = fileSize(session_location);
+        printf("text:   %zu samples, %ld bytes, %.3f ms per load\n", text_samples, text_size, text_seconds * 1000.0);
+        printf("binary: %zu samples, %ld bytes, %.3f ms per load\n", binary_samples, binary_size, binary_seconds * 1000.0);
+        if (binary_size > 0 && binary_seconds > 0.0) printf("binary files are %.1fx smaller and load %.1fx faster (checksum %g)\n", (double)text_size / binary_size, text_seconds / binary_seconds, checksum);
+
+        return true;
+    }
+
+    void printUsage(const char* program)
+    {
+        printf("Usage: %s [--packet <samples>] <data set.txt> <session.pcs>\n", program);
+        printf("       %s --benchmark [--repeat <count>] <data set.txt> <session.pcs>\n\n", program);
+        printf("  --packet <samples>   samples per composite notification when converting (default %d)\n", COMPOSITE_MAX_SAMPLES);
+        printf("  --benchmark          compare the load time of the text and binary versions of a data set\n");
+        printf("  --repeat <count>     number of loads to average the benchmark over (default 10)\n");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bool run_benchmark = false;
+    int samples_per_packet = COMPOSITE_MAX_SAMPLES;
+    int repeat = 10;
+    std::vector<const char*> files;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--benchmark") run_benchmark = true;
+        else if (argument == "--packet" && i + 1 < argc) samples_per_packet = atoi(argv[++i]);
+        else if (argument == "--repeat" && i + 1 < argc) repeat = atoi(argv[++i]);
+        else if (argument.compare(0, 2, "--") == 0)
+        {
+            printUsage(argv[0]);
+            return 1;
+        }
+        else files.push_back(argv[i]);
+    }
+
+    if (files.size() != 2)
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+    if (samples_per_packet < 1 || samples_per_packet > COMPOSITE_MAX_SAMPLES) samples_per_packet = COMPOSITE_MAX_SAMPLES;
+    if (repeat < 1) repeat = 1;
+
+    if (run_benchmark)
+    {
+        if (!benchmark(files[0], files[1], repeat))
+        {
+            fprintf(stderr, "Couldn't load '%s' and '%s'\n", files[0], files[1]);
+            return 1;
+        }
+        return 0;
+    }
+
+    return convert(files[0], files[1], samples_per_packet) ? 0 : 1;
+}
@@ -0,0 +1,242 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../DirectXApp/Devices/SpscQueue.h"
+
+//Stress test for the single-producer/single-consumer queue that carries sample batches from the BLE thread to the
+//render thread (and bursts and session file chunks between their threads). One thread pushes batches as fast as it
+//can while another pops them, sometimes falling behind on purpose so the queue fills up. Every batch the consumer sees
+//has to be whole (no slot that's only partly written) and in order, and the overrun and high water counts the queue
+//keeps have to match what the producer and consumer actually saw. It's meant to be built with ThreadSanitizer so any
+//missing ordering between the two threads gets reported as well. See readme.txt for how to build it.
+
+namespace
+{
+    const size_t PAYLOAD_VALUES = 1024; //about as many values as a SampleBatch holds, so filling a slot takes a while
+    const size_t QUEUE_SIZE = 16; //matches SAMPLE_BATCH_QUEUE_SIZE in PersonalCaddie.h
+    const size_t SMALL_QUEUE_SIZE = 2; //matches RAW_BURST_QUEUE_SIZE in PersonalCaddie.h
+
+    //Set up with initializeSlots() the same way the app sizes the vectors in each SampleBatch
+    struct Batch
+    {
+        uint64_t sequence;
+        std::vector<uint32_t> values;
+        uint32_t checksum;
+    };
+
+    uint32_t valueFor(uint64_t sequence, size_t i)
+    {
+        uint32_t x = (uint32_t)(sequence * 2654435761u) ^ (uint32_t)(i * 40503u);
+        x ^= x >> 15;
+        return x * 2246822519u;
+    }
+
+    void fillBatch(Batch& batch, uint64_t sequence)
+    {
+        //The sequence number goes in first and the checksum last so a consumer that could see a slot before the
+        //producer was done with it would find values that don't belong to the sequence number or checksum
+        batch.sequence = sequence;
+        uint32_t checksum = 0;
+        for (size_t i = 0; i < batch.values.size(); i++)
+        {
+            batch.values[i] = valueFor(sequence, i);
+            checksum += batch.values[i];
+        }
+        batch.checksum = checksum;
+    }
+
+    bool batchIsWhole(Batch const& batch)
+    {
+        uint32_t checksum = 0;
+        for (size_t i = 0; i < batch.values.size(); i++)
+        {
+            if (batch.values[i] != valueFor(batch.sequence, i)) return false;
+            checksum += batch.values[i];
+        }
+        return checksum == batch.checksum;
+    }
+
+    struct Options
+    {
+        uint64_t batches = 100000;
+        int stallEvery = 500; //the consumer stops for a moment after this many batches so the queue fills up
+        int stallMicroseconds = 600;
+    };
+
+    struct Result
+    {
+        uint64_t attempts = 0, pushed = 0, failedPushes = 0;
+        uint64_t received = 0, gaps = 0, brokenBatches = 0, outOfOrder = 0;
+        size_t largestSeen = 0;
+        bool passed = true;
+    };
+
+    void report(bool& passed, bool condition, const char* description)
+    {
+        if (!condition)
+        {
+            printf("  FAILED: %s\n", description);
+            passed = false;
+        }
+    }
+
+    //Checks the counters with nothing running at the same time, where the exact numbers are known
+    template <size_t Capacity>
+    bool singleThreadedCheck()
+    {
+        SpscQueue<Batch, Capacity> queue;
+        queue.initializeSlots([](Batch& batch) { batch.values.resize(PAYLOAD_VALUES); });
+        bool passed = true;
+
+        for (size_t i = 0; i < Capacity; i++)
+        {
+            Batch* slot = queue.beginPush();
+            report(passed, slot != nullptr, "a push into a queue that isn't full was refused");
+            if (slot == nullptr) return false;
+            fillBatch(*slot, i);
+            queue.endPush();
+        }
+        report(passed, queue.beginPush() == nullptr, "a push into a full queue was accepted");
+        report(passed, queue.beginPush() == nullptr, "a second push into a full queue was accepted");
+        report(passed, queue.overruns() == 2, "the overrun count doesn't match the refused pushes");
+        report(passed, queue.highWaterMark() == Capacity, "the high water mark of a full queue isn't its capacity");
+        report(passed, queue.size() == Capacity, "the size of a full queue isn't its capacity");
+
+        for (size_t i = 0; i < Capacity / 2; i++)
+        {
+            Batch* slot = queue.front();
+            report(passed, slot != nullptr && slot->sequence == i && batchIsWhole(*slot), "a batch didn't come back out whole and in order");
+            queue.pop();
+        }
+
+        //Wrap around the end of the slots a few times without ever filling the queue again
+        uint64_t next_push = Capacity, next_pop = Capacity / 2;
+        for (int round = 0; round < 10 * (int)Capacity; round++)
+        {
+            Batch* slot = queue.beginPush();
+            if (slot != nullptr)
+            {
+                fillBatch(*slot, next_push++);
+                queue.endPush();
+            }
+            slot = queue.front();
+            report(passed, slot != nullptr && slot->sequence == next_pop && batchIsWhole(*slot), "a batch didn't come back out whole after wrapping around");
+            queue.pop();
+            next_pop++;
+        }
+        report(passed, queue.overruns() == 2, "pushes into a queue with room counted as overruns");
+        report(passed, queue.highWaterMark() == Capacity, "the high water mark went down");
+        report(passed, queue.pushed() == next_push && queue.popped() == next_pop, "the pushed and popped totals are wrong");
+
+        while (queue.front() != nullptr) queue.pop();
+        report(passed, queue.size() == 0 && queue.front() == nullptr, "the queue isn't empty after popping everything");
+        return passed;
+    }
+
+    template <size_t Capacity>
+    Result threadedCheck(Options const& options)
+    {
+        SpscQueue<Batch, Capacity> queue;
+        queue.initializeSlots([](Batch& batch) { batch.values.resize(PAYLOAD_VALUES); });
+        Result result;
+
+        //Like the BLE thread the producer never waits on the consumer, a batch that doesn't fit is dropped. It does give
+        //up the rest of its time slice after each batch though, the way the BLE thread sits idle between notifications.
+        std::thread producer([&queue, &result, &options]()
+            {
+                for (uint64_t sequence = 0; sequence < options.batches; sequence++)
+                {
+                    result.attempts++;
+                    Batch* slot = queue.beginPush();
+                    if (slot == nullptr) result.failedPushes++;
+                    else
+                    {
+                        fillBatch(*slot, sequence);
+                        queue.endPush();
+                        result.pushed++;
+                    }
+                    std::this_thread::yield();
+                }
+            });
+
+        //Like the render thread the consumer takes everything that's waiting each time it comes around
+        bool producer_done = false;
+        uint64_t last_sequence = 0;
+        while (true)
+        {
+            size_t waiting = queue.size();
+            if (waiting > result.largestSeen) result.largestSeen = waiting;
+
+            Batch* slot = queue.front();
+            if (slot == nullptr)
+            {
+                //Only stop once the producer has finished and everything it pushed has been popped
+                if (producer_done) break;
+                if (queue.pushed() + queue.overruns() == options.batches) producer_done = true;
+                std::this_thread::yield();
+                continue;
+            }
+
+            if (!batchIsWhole(*slot)) result.brokenBatches++;
+            if (result.received > 0 && slot->sequence <= last_sequence) result.outOfOrder++;
+            if (result.received > 0 && slot->sequence > last_sequence + 1) result.gaps += slot->sequence - last_sequence - 1;
+            if (result.received == 0) result.gaps += slot->sequence;
+            last_sequence = slot->sequence;
+            queue.pop();
+            result.received++;
+
+            if (options.stallEvery > 0 && result.received % options.stallEvery == 0) std::this_thread::sleep_for(std::chrono::microseconds(options.stallMicroseconds));
+        }
+        producer.join();
+        if (result.received > 0) result.gaps += options.batches - 1 - last_sequence;
+
+        printf("queue of %zu: %llu batches, %llu popped, %llu dropped (queue says %llu), high water mark %zu (largest seen %zu)\n", Capacity,
+            (unsigned long long)options.batches, (unsigned long long)result.received, (unsigned long long)result.failedPushes,
+            (unsigned long long)queue.overruns(), queue.highWaterMark(), result.largestSeen);
+
+        report(result.passed, result.brokenBatches == 0, "the consumer saw batches that were only partly written");
+        report(result.passed, result.outOfOrder == 0, "batches came out of order");
+        report(result.passed, result.received == result.pushed, "not every pushed batch was popped");
+        report(result.passed, result.gaps == result.failedPushes, "the batches missing on the consumer side aren't the dropped ones");
+        report(result.passed, queue.overruns() == result.failedPushes, "the overrun count doesn't match the refused pushes");
+        report(result.passed, queue.pushed() == result.pushed && queue.popped() == result.received, "the pushed and popped totals are wrong");
+        report(result.passed, queue.highWaterMark() <= Capacity, "the high water mark is larger than the queue");
+        report(result.passed, queue.highWaterMark() >= result.largestSeen, "the consumer saw more batches waiting than the high water mark");
+        report(result.passed, result.failedPushes == 0 || queue.highWaterMark() == Capacity, "the queue overran without the high water mark reaching its capacity");
+        return result;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--batches" && i + 1 < argc) options.batches = strtoull(argv[++i], nullptr, 10);
+        else if (argument == "--stall-every" && i + 1 < argc) options.stallEvery = atoi(argv[++i]);
+        else if (argument == "--stall-us" && i + 1 < argc) options.stallMicroseconds = atoi(argv[++i]);
+        else
+        {
+            printf("Usage: %s [--batches <batches per queue>] [--stall-every <batches, 0 for never>] [--stall-us <microseconds>]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (options.batches == 0)
+    {
+        printf("Usage: %s [--batches <batches per queue>] [--stall-every <batches, 0 for never>] [--stall-us <microseconds>]\n", argv[0]);
+        return 1;
+    }
+
+    bool passed = singleThreadedCheck<QUEUE_SIZE>();
+    passed = singleThreadedCheck<SMALL_QUEUE_SIZE>() && passed;
+    passed = threadedCheck<QUEUE_SIZE>(options).passed && passed;
+    passed = threadedCheck<SMALL_QUEUE_SIZE>(options).passed && passed;
+
+    printf("\n%s\n", passed ? "Every batch arrived whole and the queue counters match" : "The queue didn't behave");
+    return passed ? 0 : 1;
+}
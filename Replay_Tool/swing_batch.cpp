@@ -0,0 +1,465 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "../DirectXApp/Devices/CompositeDataDecoder.h"
+#include "../DirectXApp/Devices/SessionFile.h"
+#include "../DirectXApp/Golf/SwingAnalytics.h"
+
+//Re-analyzes every session file (.pcs) in a directory with the SwingAnalyzer, spreading the sessions across a
+//work-stealing thread pool, and writes the metrics for every swing found to a single table. The same batch can be
+//run with different numbers of threads to see how well it scales. If there aren't any recorded sessions handy, a
+//directory full of synthetic ones can be made first. See readme.txt for how to build it.
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    const float PI = 3.14159265f;
+    const float ADDRESS_PITCH = 45.0f * DEGREES_TO_RADIANS;
+    const float ADDRESS_ROLL = 90.0f * DEGREES_TO_RADIANS;
+    const Vec3 EARTH_FIELD = { 22.0f, 0.0f, -42.0f }; //uT, points north and down into the ground
+    const Vec3 GRAVITY = { 0.0f, 0.0f, COMPOSITE_GRAVITY };
+    const float CONVERSION_RATES[SESSION_FILE_SENSORS] = { 4.0f * COMPOSITE_GRAVITY / 32768.0f, 2000.0f / 32768.0f, 0.1f }; //+/-4 g, +/-2000 dps, 0.1 uT per LSB
+
+    struct SessionEntry
+    {
+        std::string location;
+        long size;
+    };
+
+    //The sessions waiting to be analyzed by one worker. The worker takes sessions from the front of its own queue
+    //and, once it runs dry, steals from the back of the other queues. Sessions take milliseconds each so a plain
+    //mutex per queue costs nothing next to the work, and it's never contended unless somebody is stealing.
+    struct WorkQueue
+    {
+        std::mutex mutex;
+        std::deque<uint32_t> sessions;
+    };
+
+    class WorkStealingPool
+    {
+    public:
+        WorkStealingPool(int workers) : m_queues(workers) {}
+
+        void deal(std::vector<uint32_t> const& sessions)
+        {
+            //Sessions are dealt out round robin, so if they come in largest first every worker starts with a fair share
+            for (size_t i = 0; i < sessions.size(); i++) m_queues[i % m_queues.size()].sessions.push_back(sessions[i]);
+        }
+
+        bool next(int worker, uint32_t& session, bool& stolen)
+        {
+            {
+                WorkQueue& own = m_queues[worker];
+                std::lock_guard<std::mutex> lock(own.mutex);
+                if (!own.sessions.empty())
+                {
+                    session = own.sessions.front();
+                    own.sessions.pop_front();
+                    stolen = false;
+                    return true;
+                }
+            }
+
+            //Nothing left in our own queue, go around the others starting with the next worker over
+            for (size_t offset = 1; offset < m_queues.size(); offset++)
+            {
+                WorkQueue& victim = m_queues[(worker + offset) % m_queues.size()];
+                std::lock_guard<std::mutex> lock(victim.mutex);
+                if (!victim.sessions.empty())
+                {
+                    session = victim.sessions.back();
+                    victim.sessions.pop_back();
+                    stolen = true;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+    private:
+        std::vector<WorkQueue> m_queues;
+    };
+
+    struct BatchResult
+    {
+        double seconds = 0.0;
+        SwingMetricsTable table;
+        SwingAnalyticsStats stats;
+        uint32_t failed = 0;
+        uint32_t stolen = 0;
+    };
+
+    BatchResult runBatch(std::vector<SessionEntry> const& sessions, int threads, SwingAnalyticsSettings const& settings)
+    {
+        //Every session gets its own table so the merged table comes out in the same order no matter which thread
+        //analyzed what
+        BatchResult result;
+        std::vector<SwingMetricsTable> tables(sessions.size());
+        std::vector<SwingAnalyticsStats> stats(threads);
+        std::atomic<uint32_t> failed(0), stolen(0);
+
+        std::vector<uint32_t> order(sessions.size());
+        for (uint32_t i = 0; i < order.size(); i++) order[i] = i;
+        std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return sessions[a].size > sessions[b].size; });
+
+        WorkStealingPool pool(threads);
+        pool.deal(order);
+
+        Clock::time_point start = Clock::now();
+        auto worker = [&](int id)
+        {
+            SwingAnalyzer analyzer(settings);
+            uint32_t session;
+            bool was_stolen;
+            while (pool.next(id, session, was_stolen))
+            {
+                SessionFileReader reader;
+                if (!reader.open(sessions[session].location.c_str()) || !analyzer.analyze(reader, session, tables[session], &stats[id])) failed++;
+                if (was_stolen) stolen++;
+            }
+        };
+
+        std::vector<std::thread> workers;
+        for (int id = 1; id < threads; id++) workers.emplace_back(worker, id);
+        worker(0);
+        for (std::thread& t : workers) t.join();
+
+        for (SwingMetricsTable const& table : tables) result.table.append(table);
+        result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        for (SwingAnalyticsStats const& s : stats)
+        {
+            result.stats.samples += s.samples;
+            result.stats.recordingSeconds += s.recordingSeconds;
+            result.stats.swings += s.swings;
+            result.stats.abandonedSwings += s.abandonedSwings;
+        }
+        result.failed = failed;
+        result.stolen = stolen;
+        return result;
+    }
+
+    bool sameTable(SwingMetricsTable const& a, SwingMetricsTable const& b)
+    {
+        if (a.rows() != b.rows()) return false;
+        for (int column = 0; column < SwingMetricsTable::Columns; column++)
+        {
+            std::vector<float> const& x = a.column(static_cast<SwingMetric>(column)), & y = b.column(static_cast<SwingMetric>(column));
+            if (!x.empty() && memcmp(x.data(), y.data(), x.size() * sizeof(float)) != 0) return false;
+        }
+        return true;
+    }
+
+    bool listSessions(const char* directory, std::vector<SessionEntry>& sessions)
+    {
+        DIR* dir = opendir(directory);
+        if (dir == nullptr) return false;
+
+        while (dirent* entry = readdir(dir))
+        {
+            std::string name = entry->d_name;
+            if (name.size() < 4 || name.compare(name.size() - 4, 4, ".pcs") != 0) continue;
+
+            std::string location = std::string(directory) + "/" + name;
+            struct stat info;
+            if (stat(location.c_str(), &info) != 0 || !S_ISREG(info.st_mode)) continue;
+            sessions.push_back({ location, (long)info.st_size });
+        }
+        closedir(dir);
+
+        std::sort(sessions.begin(), sessions.end(), [](SessionEntry const& a, SessionEntry const& b) { return a.location < b.location; });
+        return true;
+    }
+
+    Quat eulerToQuaternion(float roll, float pitch, float yaw)
+    {
+        //Z-Y-X order, the same order the Euler angles in the app are worked out in
+        float cr = cosf(roll / 2.0f), sr = sinf(roll / 2.0f);
+        float cp = cosf(pitch / 2.0f), sp = sinf(pitch / 2.0f);
+        float cy = cosf(yaw / 2.0f), sy = sinf(yaw / 2.0f);
+        return { cr * cp * cy + sr * sp * sy, sr * cp * cy - cr * sp * sy, cr * sp * cy + sr * cp * sy, cr * cp * sy - sr * sp * cy };
+    }
+
+    //One piece of a swing where the yaw angle moves smoothly from start_yaw to end_yaw (a half cosine, so the
+    //angular velocity starts and ends at 0), the same shape swing_benchmark.cpp uses
+    struct SwingSegment
+    {
+        float duration;
+        float start_yaw, end_yaw;
+    };
+
+    bool generateSession(const char* location, int swings, float odr, uint32_t seed)
+    {
+        //Makes the readings a sensor on the club would record during a practice session: a second of the club lying
+        //still, then for each swing the club sits at address, gets swung and rests. Every swing has a slightly
+        //different length and tempo. The readings are built from the orientation so the filter has something real to
+        //track, and go through the same notification path as live data.
+        std::mt19937 generator(seed);
+        std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+        std::normal_distribution<float> noise(0.0f, 1.0f);
+
+        std::vector<SwingSegment> segments;
+        segments.push_back({ 1.0f, 0.0f, 0.0f });
+        for (int swing = 0; swing < swings; swing++)
+        {
+            float top = 1.6f + 0.6f * uniform(generator), finish = -1.6f - 0.6f * uniform(generator);
+            float backswing = 0.7f + 0.3f * uniform(generator), downswing = 0.25f + 0.1f * uniform(generator);
+            segments.push_back({ 3.0f, 0.0f, 0.0f });
+            segments.push_back({ backswing, 0.0f, top });
+            segments.push_back({ 0.05f + 0.1f * uniform(generator), top, top });
+            segments.push_back({ downswing * 2.0f, top, finish }); //the club is back over the ball half way through
+            segments.push_back({ 1.0f, finish, 0.0f });
+            segments.push_back({ 1.0f, 0.0f, 0.0f });
+        }
+
+        SessionFileHeader header;
+        initializeSessionFileHeader(header);
+        header.odr = odr;
+        for (int sensor = 0; sensor < SESSION_FILE_SENSORS; sensor++) header.conversion_rates[sensor] = CONVERSION_RATES[sensor];
+
+        SessionFileWriter writer;
+        if (!writer.open(location, header)) return false;
+
+        uint8_t notification[COMPOSITE_HEADER_SIZE + COMPOSITE_MAX_SAMPLES * COMPOSITE_SAMPLE_SIZE];
+        int packet_samples = 0;
+        uint16_t sequence = 0;
+        uint64_t sample_number = 0;
+        Quat q = eulerToQuaternion(ADDRESS_ROLL, ADDRESS_PITCH, 0.0f);
+        for (SwingSegment const& s : segments)
+        {
+            int segment_samples = (int)(s.duration * odr);
+            for (int i = 0; i < segment_samples; i++, sample_number++)
+            {
+                float fraction = (float)(i + 1) / segment_samples;
+                Quat next_q = eulerToQuaternion(ADDRESS_ROLL, ADDRESS_PITCH, s.start_yaw + (s.end_yaw - s.start_yaw) * (1.0f - cosf(PI * fraction)) / 2.0f);
+
+                //The accelerometer and magnetometer read the earth frame vectors rotated into the sensor frame, and
+                //the gyroscope reads the rotation from this orientation to the next one (also in the sensor frame)
+                Quat delta = Conjugate(q) * next_q;
+                Vec3 acc = Rotate(Conjugate(q), GRAVITY), mag = Rotate(Conjugate(q), EARTH_FIELD);
+                Vec3 gyr = delta.vector() * (2.0f * odr / DEGREES_TO_RADIANS * ((delta.w < 0.0f) ? -1.0f : 1.0f));
+
+                float readings[SESSION_FILE_CHANNELS] = { acc.x, acc.y, acc.z, gyr.x, gyr.y, gyr.z, mag.x, mag.y, mag.z };
+                for (int channel = 0; channel < SESSION_FILE_CHANNELS; channel++) readings[channel] += noise(generator) * ((channel < 3) ? 0.05f : 0.3f);
+
+                if (packet_samples == 0)
+                {
+                    uint32_t timer_ticks = (uint32_t)(uint64_t)llround(sample_number / (double)odr * SESSION_FILE_TICK_FREQUENCY);
+                    for (int byte = 0; byte < 4; byte++) notification[byte] = (uint8_t)(timer_ticks >> (8 * byte));
+                    notification[5] = (uint8_t)(sequence & 0xFF);
+                    notification[6] = (uint8_t)(sequence >> 8);
+                    notification[7] = notification[8] = 0;
+                }
+
+                uint8_t* reading = notification + COMPOSITE_HEADER_SIZE + packet_samples * COMPOSITE_SAMPLE_SIZE;
+                for (int channel = 0; channel < SESSION_FILE_CHANNELS; channel++, reading += 2)
+                {
+                    long lsb = lrintf(readings[channel] / CONVERSION_RATES[channel / SESSION_FILE_AXES]);
+                    if (lsb > 32767) lsb = 32767;
+                    else if (lsb < -32768) lsb = -32768;
+                    reading[0] = (uint8_t)(lsb & 0xFF);
+                    reading[1] = (uint8_t)((lsb >> 8) & 0xFF);
+                }
+
+                if (++packet_samples == COMPOSITE_MAX_SAMPLES)
+                {
+                    notification[4] = (uint8_t)packet_samples;
+                    writer.append(notification, COMPOSITE_HEADER_SIZE + packet_samples * COMPOSITE_SAMPLE_SIZE);
+                    packet_samples = 0;
+                    sequence++;
+                }
+                q = next_q;
+            }
+        }
+        if (packet_samples > 0)
+        {
+            notification[4] = (uint8_t)packet_samples;
+            writer.append(notification, COMPOSITE_HEADER_SIZE + packet_samples * COMPOSITE_SAMPLE_SIZE);
+        }
+        writer.close();
+        return writer.droppedChunks() == 0;
+    }
+
+    std::vector<int> parseList(const char* text)
+    {
+        std::vector<int> values;
+        for (const char* position = text; *position != '\0';)
+        {
+            char* end = nullptr;
+            long value = strtol(position, &end, 10);
+            if (end == position) break;
+            if (value > 0) values.push_back((int)value);
+            position = (*end == ',') ? end + 1 : end;
+        }
+        return values;
+    }
+
+    void printUsage(const char* program)
+    {
+        printf("Usage: %s [options] <session directory>\n\n", program);
+        printf("  --threads <list>     comma separated thread counts to run the batch with (default: every core)\n");
+        printf("  --repeat <count>     runs of each thread count, the fastest one is reported (default 3)\n");
+        printf("  --csv <file>         write the swing metrics as comma separated text\n");
+        printf("  --columns <file>     write the swing metrics as binary columns (see SwingMetricsTable::writeColumns())\n");
+        printf("  --beta <gain>        Madgwick filter gain (default %.3f)\n", SWING_ANALYTICS_BETA);
+        printf("  --club <meters>      club radius for the club head speed estimate (default %.2f)\n", SWING_ANALYTICS_CLUB_RADIUS);
+        printf("  --generate <count>   first fill the directory with this many synthetic sessions\n");
+        printf("  --swings <count>     swings in each synthetic session (default 20)\n");
+        printf("  --odr <Hz>           sample rate of the synthetic sessions (default 400)\n");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<int> thread_counts;
+    int repeat = 3, generate = 0, swings = 20;
+    float odr = 400.0f;
+    const char* csv_location = nullptr, * columns_location = nullptr, * directory = nullptr;
+    SwingAnalyticsSettings settings;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--threads" && i + 1 < argc) thread_counts = parseList(argv[++i]);
+        else if (argument == "--repeat" && i + 1 < argc) repeat = atoi(argv[++i]);
+        else if (argument == "--csv" && i + 1 < argc) csv_location = argv[++i];
+        else if (argument == "--columns" && i + 1 < argc) columns_location = argv[++i];
+        else if (argument == "--beta" && i + 1 < argc) settings.beta = (float)atof(argv[++i]);
+        else if (argument == "--club" && i + 1 < argc) settings.clubRadius = (float)atof(argv[++i]);
+        else if (argument == "--generate" && i + 1 < argc) generate = atoi(argv[++i]);
+        else if (argument == "--swings" && i + 1 < argc) swings = atoi(argv[++i]);
+        else if (argument == "--odr" && i + 1 < argc) odr = (float)atof(argv[++i]);
+        else if (argument.compare(0, 2, "--") != 0 && directory == nullptr) directory = argv[i];
+        else
+        {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (directory == nullptr || odr <= 0.0f || swings < 1)
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+    if (repeat < 1) repeat = 1;
+    if (thread_counts.empty()) thread_counts.push_back(std::max(1, (int)std::thread::hardware_concurrency()));
+
+    if (generate > 0)
+    {
+        //Synthetic sessions are written in parallel too, otherwise making a big batch takes longer than analyzing it
+        mkdir(directory, 0755);
+        std::atomic<int> next(0), failed(0);
+        auto writer = [&]()
+        {
+            for (int session = next++; session < generate; session = next++)
+            {
+                char location[512];
+                snprintf(location, sizeof(location), "%s/synthetic_%04d.pcs", directory, session);
+                if (!generateSession(location, swings, odr, (uint32_t)session + 1)) failed++;
+            }
+        };
+        std::vector<std::thread> writers;
+        for (int i = 0; i < std::max(1, (int)std::thread::hardware_concurrency()); i++) writers.emplace_back(writer);
+        for (std::thread& t : writers) t.join();
+
+        if (failed > 0)
+        {
+            fprintf(stderr, "Couldn't write %d of the synthetic sessions into '%s'\n", (int)failed, directory);
+            return 1;
+        }
+        printf("Wrote %d synthetic sessions with %d swings each into '%s'\n\n", generate, swings, directory);
+    }
+
+    std::vector<SessionEntry> sessions;
+    if (!listSessions(directory, sessions) || sessions.empty())
+    {
+        fprintf(stderr, "Couldn't find any session files in '%s'\n", directory);
+        return 1;
+    }
+
+    printf("threads   seconds   sessions/s   swings/s   x real time   speedup   efficiency   stolen\n");
+    BatchResult reference;
+    double single_thread_seconds = 0.0;
+    bool consistent = true;
+    for (size_t run = 0; run < thread_counts.size(); run++)
+    {
+        int threads = thread_counts[run];
+        BatchResult best;
+        for (int pass = 0; pass < repeat; pass++)
+        {
+            BatchResult result = runBatch(sessions, threads, settings);
+            if (pass == 0 || result.seconds < best.seconds) best = std::move(result);
+        }
+
+        //The speed up is measured against the single threaded run if there was one, otherwise against the first
+        //run scaled by its thread count (as if it had scaled perfectly)
+        if (run == 0) single_thread_seconds = best.seconds * threads;
+        if (threads == 1) single_thread_seconds = best.seconds;
+        double speedup = single_thread_seconds / best.seconds;
+
+        printf("%7d   %7.3f   %10.1f   %8.0f   %11.0f   %7.2f   %9.0f%%   %6u\n", threads, best.seconds, sessions.size() / best.seconds,
+            best.stats.swings / best.seconds, best.stats.recordingSeconds / best.seconds, speedup, 100.0 * speedup / threads, best.stolen);
+
+        if (run == 0) reference = std::move(best);
+        else if (!sameTable(reference.table, best.table)) consistent = false;
+    }
+
+    SwingMetricsTable const& table = reference.table;
+    printf("\n%zu sessions (%.1f hours, %llu samples), %u swings found, %u abandoned backswings, %u sessions couldn't be read\n", sessions.size(),
+        reference.stats.recordingSeconds / 3600.0, (unsigned long long)reference.stats.samples, reference.stats.swings, reference.stats.abandonedSwings, reference.failed);
+    if (!consistent) printf("The swing metrics changed with the number of threads!\n");
+
+    if (table.rows() > 0)
+    {
+        printf("\nmetric                        mean        min        max\n");
+        for (int column = static_cast<int>(SwingMetric::BACKSWING_DURATION); column < SwingMetricsTable::Columns; column++)
+        {
+            std::vector<float> const& values = table.column(static_cast<SwingMetric>(column));
+            double total = 0.0;
+            float low = values[0], high = values[0];
+            for (float value : values)
+            {
+                total += value;
+                low = std::min(low, value);
+                high = std::max(high, value);
+            }
+            printf("%-24s %10.3f %10.3f %10.3f\n", SwingMetricsTable::columnName(static_cast<SwingMetric>(column)), total / values.size(), low, high);
+        }
+    }
+
+    bool written = true;
+    if (csv_location != nullptr)
+    {
+        FILE* file = fopen(csv_location, "w");
+        written = file != nullptr && table.writeCsv(file) && written;
+        if (file != nullptr) fclose(file);
+    }
+    if (columns_location != nullptr)
+    {
+        FILE* file = fopen(columns_location, "wb");
+        written = file != nullptr && table.writeColumns(file) && written;
+        if (file != nullptr) fclose(file);
+    }
+    if (!written)
+    {
+        fprintf(stderr, "Couldn't write the swing metrics table\n");
+        return 1;
+    }
+
+    return (consistent && reference.failed == 0) ? 0 : 1;
+}
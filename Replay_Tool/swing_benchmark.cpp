@@ -0,0 +1,199 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../DirectXApp/Golf/SwingPhaseDetector.h"
+
+//Runs a long synthetic practice session (the club sits at address, gets swung and then rests before the next
+//swing) through the SwingPhaseDetector used by the free swing mode. Every sample goes through the detector the
+//same way it does in the app, and the phases found are compared against the swing the data was made from. See
+//readme.txt for how to build it.
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    const float PI = 3.14159265f;
+    const float ADDRESS_PITCH = 45.0f * DEGREES_TO_RADIANS;
+    const float ADDRESS_ROLL = 90.0f * DEGREES_TO_RADIANS;
+
+    //One piece of a swing where the yaw angle moves smoothly from start_yaw to end_yaw (a half cosine,
+    //so the angular velocity starts and ends at 0)
+    struct SwingSegment
+    {
+        float duration;
+        float start_yaw, end_yaw;
+    };
+
+    //Address, backswing, a short pause at the top, the downswing and follow through, and then a rest
+    //before the next swing. The club passes back over the ball (yaw = 0) half way through the downswing.
+    const SwingSegment swing_segments[] = {
+        { 3.0f, 0.0f, 0.0f },
+        { 0.9f, 0.0f, 2.0f },
+        { 0.1f, 2.0f, 2.0f },
+        { 0.4f, 2.0f, -2.0f },
+        { 1.0f, -2.0f, 0.0f },
+        { 1.0f, 0.0f, 0.0f }
+    };
+    const int swing_segment_count = sizeof(swing_segments) / sizeof(SwingSegment);
+    const int impact_segment = 3;
+
+    Quat eulerToQuaternion(float roll, float pitch, float yaw)
+    {
+        //Z-Y-X order, the same order the Euler angles in the app are worked out in
+        float cr = cosf(roll / 2.0f), sr = sinf(roll / 2.0f);
+        float cp = cosf(pitch / 2.0f), sp = sinf(pitch / 2.0f);
+        float cy = cosf(yaw / 2.0f), sy = sinf(yaw / 2.0f);
+        return { cr * cp * cy + sr * sp * sy, sr * cp * cy - cr * sp * sy, cr * sp * cy + sr * cp * sy, cr * cp * sy - sr * sp * cy };
+    }
+
+    //Fills in the samples for the given number of swings. The time stamp of every impact (where the club
+    //is pointing straight back at the ball) and how fast the club is turning there are saved so the detected
+    //impacts can be checked against them.
+    void makeSession(int swings, float odr, float noise, std::vector<SwingSample>& samples, std::vector<float>& impact_times, float& impact_speed)
+    {
+        std::mt19937 generator(1);
+        std::normal_distribution<float> gyro_noise(0.0f, noise);
+        uint64_t sample_number = 0;
+
+        for (int swing = 0; swing < swings; swing++)
+        {
+            for (int segment = 0; segment < swing_segment_count; segment++)
+            {
+                SwingSegment const& s = swing_segments[segment];
+                int segment_samples = (int)(s.duration * odr);
+                if (segment == impact_segment)
+                {
+                    impact_times.push_back(sample_number / odr + s.duration / 2.0f);
+                    impact_speed = fabsf(s.end_yaw - s.start_yaw) * PI / (2.0f * s.duration); //the yaw rate peaks half way through
+                }
+
+                for (int i = 0; i < segment_samples; i++)
+                {
+                    float fraction = (float)i / segment_samples;
+                    float yaw = s.start_yaw + (s.end_yaw - s.start_yaw) * (1.0f - cosf(PI * fraction)) / 2.0f;
+                    float yaw_rate = (s.end_yaw - s.start_yaw) * PI / (2.0f * s.duration) * sinf(PI * fraction);
+
+                    SwingSample sample;
+                    sample.time = sample_number++ / odr;
+                    sample.angles = { ADDRESS_ROLL, ADDRESS_PITCH, yaw };
+                    sample.quaternion = eulerToQuaternion(ADDRESS_ROLL, ADDRESS_PITCH, yaw);
+                    sample.pitch_rate = yaw_rate + gyro_noise(generator);
+                    sample.yaw_rate = yaw_rate + gyro_noise(generator);
+                    samples.push_back(sample);
+                }
+            }
+        }
+    }
+
+    const char* phaseName(SwingPhase phase)
+    {
+        switch (phase)
+        {
+        case SwingPhase::START: return "start";
+        case SwingPhase::PRE_ADDRESS: return "pre-address";
+        case SwingPhase::ADDRESS: return "address";
+        case SwingPhase::BACKSWING: return "backswing";
+        case SwingPhase::TRANSITION: return "transition";
+        case SwingPhase::DOWNSWING: return "downswing";
+        case SwingPhase::IMPACT: return "impact";
+        case SwingPhase::FOLLOW_THROUGH: return "follow through";
+        case SwingPhase::END: return "end";
+        }
+        return "unknown";
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int swings = 1000;
+    float odr = 400.0f, noise = 0.0f;
+    bool verbose = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--swings" && i + 1 < argc) swings = atoi(argv[++i]);
+        else if (argument == "--odr" && i + 1 < argc) odr = (float)atof(argv[++i]);
+        else if (argument == "--noise" && i + 1 < argc) noise = (float)atof(argv[++i]);
+        else if (argument == "--verbose") verbose = true;
+        else
+        {
+            printf("Usage: %s [--swings <count>] [--odr <Hz>] [--noise <gyroscope noise in rad/s>] [--verbose]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (swings < 1 || odr <= 0.0f) return 1;
+
+    std::vector<SwingSample> samples;
+    std::vector<float> impact_times;
+    float impact_speed = 0.0f;
+    makeSession(swings, odr, noise, samples, impact_times, impact_speed);
+
+    SwingPhaseDetector detector;
+    SwingPhaseEvent event;
+    std::vector<SwingPhaseEvent> impacts;
+    std::vector<SwingImpact> located_impacts;
+
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        if (!detector.addSample(samples[i], event)) continue;
+        if (event.phase == SwingPhase::IMPACT) impacts.push_back(event);
+        else if (event.phase == SwingPhase::FOLLOW_THROUGH && detector.impact().found) located_impacts.push_back(detector.impact());
+        if (verbose) printf("%-15s sample %8llu  t = %9.4f s  detected at sample %8llu\n", phaseName(event.phase),
+            (unsigned long long)event.sample, event.time, (unsigned long long)event.detected_sample);
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    double recording_seconds = samples.size() / odr;
+
+    printf("%zu samples (%d swings, %.1f minutes at %.0f Hz)\n", samples.size(), swings, recording_seconds / 60.0, odr);
+    printf("detector     %9.3f ms total, %.1f ns per sample, %.0fx real time\n", 1000.0 * seconds, 1e9 * seconds / samples.size(),
+        (seconds > 0.0) ? recording_seconds / seconds : 0.0);
+
+    printf("\nphase           count   latency (samples, average / max)\n");
+    for (int phase = static_cast<int>(SwingPhase::PRE_ADDRESS); phase <= static_cast<int>(SwingPhase::END); phase++)
+    {
+        SwingPhaseLatency const& latency = detector.latency(static_cast<SwingPhase>(phase));
+        printf("%-15s %5u   %8.2f / %llu\n", phaseName(static_cast<SwingPhase>(phase)), latency.count, latency.average(),
+            (unsigned long long)latency.max_samples);
+    }
+
+    //Every impact should be found, and it should start a little before the club points straight back at the ball
+    double total_error = 0.0, max_error = 0.0;
+    size_t matched = (impacts.size() < impact_times.size()) ? impacts.size() : impact_times.size();
+    for (size_t i = 0; i < matched; i++)
+    {
+        double error = fabs(impacts[i].time - impact_times[i]);
+        total_error += error;
+        if (error > max_error) max_error = error;
+    }
+    printf("\n%zu of %zu impacts found, impact starts %.2f ms (max %.2f ms) from the club passing over the ball\n", impacts.size(),
+        impact_times.size(), (matched > 0) ? 1000.0 * total_error / matched : 0.0, 1000.0 * max_error);
+
+    //The impact found between samples should be much closer than the sample spacing, as should the speed
+    double total_speed_error = 0.0, max_speed_error = 0.0;
+    total_error = max_error = 0.0;
+    matched = (located_impacts.size() < impact_times.size()) ? located_impacts.size() : impact_times.size();
+    for (size_t i = 0; i < matched; i++)
+    {
+        double error = fabs(located_impacts[i].time - impact_times[i]);
+        total_error += error;
+        if (error > max_error) max_error = error;
+
+        double speed_error = fabs(located_impacts[i].angular_speed - impact_speed) / impact_speed;
+        total_speed_error += speed_error;
+        if (speed_error > max_speed_error) max_speed_error = speed_error;
+    }
+    printf("%zu impacts located between samples, %.3f ms (max %.3f ms) from the club passing over the ball, samples are %.3f ms apart\n",
+        located_impacts.size(), (matched > 0) ? 1000.0 * total_error / matched : 0.0, 1000.0 * max_error, 1000.0 / odr);
+    printf("angular speed at impact %.2f%% (max %.2f%%) from the true %.1f deg/s\n", (matched > 0) ? 100.0 * total_speed_error / matched : 0.0,
+        100.0 * max_speed_error, impact_speed / DEGREES_TO_RADIANS);
+
+    bool located = located_impacts.size() == impact_times.size() && max_error < 0.5 / odr;
+    return (impacts.size() == impact_times.size() && located) ? 0 : 1;
+}
@@ -0,0 +1,361 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../Firmware/nRF52840_Drivers/throughput_scheduler.h"
+
+//Sweeps sensor ODRs and connection intervals through a simulated BLE link to see how many samples the live stream puts
+//in each data set, how long samples take to reach the app and how many data sets get dropped. The same data set sizes
+//get run through the link twice: once picked by the throughput_scheduler the firmware uses now, and once by the fixed
+//rule it used before (as many samples as fit into a connection interval, split 2 - 5 ways if that doesn't fit into a
+//single characteristic). See readme.txt for how to build it.
+
+namespace
+{
+    const int QUEUE_SIZE = 12; //hvn_tx_queue_size in pc_ble.c
+    const int HEADER_SIZE = 9; //DATA_CHARACTERISTIC_HEADER_SIZE in ble_sensor_service.h
+    const int LARGE_CHARACTERISTIC_SIZE = HEADER_SIZE + 39 * 6;
+    const int RAW_MAX_SAMPLES = 13;
+    const int MAX_SAMPLES = 39;
+
+    enum class Policy { Scheduler, Legacy };
+
+    struct Options
+    {
+        std::vector<float> odrs = { 25.0f, 50.0f, 100.0f, 200.0f, 400.0f, 800.0f, 1600.0f };
+        std::vector<float> intervals = { 7.5f, 15.0f, 30.0f, 45.0f, 60.0f, 75.0f }; //ms
+        std::string encoding = "raw";
+        double seconds = 60.0;
+        int mtu = 247;
+        int dataLength = 251;
+        int phy = 1;
+        int centralPackets = 6; //what the central lets through in each event, the scheduler doesn't get told this
+        double packetErrorRate = 0.01; //each failed packet gets sent again in the same event if there's room
+        double skipRate = 0.02; //connection events the central skips
+        uint32_t seed = 1;
+    };
+
+    struct Notification
+    {
+        double readyTime;
+        double firstSampleTime;
+        double lastSampleTime;
+        int samples;
+        int packetsLeft;
+    };
+
+    struct Result
+    {
+        int firstSamples = 0;
+        int lastSamples = 0;
+        int minSamples = 1000, maxSamples = 0;
+        uint64_t samplesSent = 0, samplesDropped = 0;
+        uint64_t notifications = 0;
+        double latencySum = 0.0; //over every sample
+        std::vector<double> worstLatencies; //the first sample of every notification
+        double depthSum = 0.0;
+        uint64_t depthCount = 0;
+        uint32_t adjustments = 0;
+    };
+
+    double percentile(std::vector<double>& values, double fraction)
+    {
+        if (values.empty()) return 0.0;
+        size_t index = (size_t)(fraction * (values.size() - 1));
+        std::nth_element(values.begin(), values.begin() + index, values.end());
+        return values[index];
+    }
+
+    std::vector<float> parseList(const char* text)
+    {
+        std::vector<float> values;
+        std::string list = text;
+        size_t start = 0;
+        while (start < list.size())
+        {
+            size_t comma = list.find(',', start);
+            if (comma == std::string::npos) comma = list.size();
+            values.push_back((float)atof(list.substr(start, comma - start).c_str()));
+            start = comma + 1;
+        }
+        return values;
+    }
+
+    int legacySamples(float odr, float interval_ms, int max_samples)
+    {
+        //set_sensor_samples() in main.c before the scheduler took over
+        int interval = (int)interval_ms; //the firmware only ever had the interval in whole milliseconds
+        int samples = (int)(odr * interval / 1000.0f);
+        if ((float)samples == odr * interval / 1000.0f) samples--;
+        if (samples > max_samples)
+        {
+            bool found = false;
+            for (int i = 2; i <= 5; i++)
+            {
+                if (samples % i == 0)
+                {
+                    samples /= i;
+                    found = true;
+                    break;
+                }
+            }
+            if (!found) samples = max_samples;
+        }
+        return std::max(samples, 1);
+    }
+
+    class LinkSimulation
+    {
+    public:
+        LinkSimulation(Options const& options, float odr, float interval_ms, Policy policy) :
+            m_options(options), m_odr(odr), m_interval(interval_ms / 1000.0), m_policy(policy), m_generator(options.seed), m_uniform(0.0, 1.0)
+        {
+            m_link.odr = odr;
+            m_link.interval_us = (uint32_t)std::lround(interval_ms * 1000.0f);
+            m_link.att_mtu = (uint16_t)options.mtu;
+            m_link.data_length = (uint16_t)options.dataLength;
+            m_link.phy_mbps = (uint8_t)options.phy;
+            m_link.event_length_us = 0;
+            m_link.max_packets_per_event = 0;
+            m_link.queue_size = QUEUE_SIZE;
+            m_link.max_notification = LARGE_CHARACTERISTIC_SIZE;
+            m_link.header_size = HEADER_SIZE;
+            if (options.encoding == "packed")
+            {
+                m_link.max_samples = MAX_SAMPLES;
+                m_link.sample_size = 10.0f;
+            }
+            else if (options.encoding == "fused")
+            {
+                m_link.max_samples = MAX_SAMPLES;
+                m_link.sample_size = 6.0f;
+            }
+            else
+            {
+                m_link.max_samples = RAW_MAX_SAMPLES;
+                m_link.sample_size = 18.0f;
+            }
+            throughput_scheduler_init(&m_scheduler, &m_link);
+
+            //Air time of a single packet, the same numbers the model uses
+            double phy = (options.phy == 2) ? 2.0 : 1.0;
+            m_packetTime = ((options.dataLength + 14) * 8.0 + 80.0) / phy / 1e6 + 300e-6;
+        }
+
+        Result run()
+        {
+            Result result;
+            int samples = (m_policy == Policy::Scheduler) ? throughput_scheduler_samples(&m_scheduler) : legacySamples(m_odr, (float)(m_interval * 1000.0), m_link.max_samples);
+            result.firstSamples = samples;
+
+            uint64_t total_samples = (uint64_t)(m_options.seconds * m_odr);
+            uint64_t sample = 0;
+            m_nextEvent = m_interval * m_uniform(m_generator);
+            while (sample < total_samples)
+            {
+                int count = (int)std::min<uint64_t>(samples, total_samples - sample);
+                double first_time = sample / (double)m_odr, last_time = (sample + count - 1) / (double)m_odr;
+                runEvents(last_time, result);
+                queueDataSet(first_time, last_time, count, result);
+                sample += count;
+
+                result.minSamples = std::min(result.minSamples, samples);
+                result.maxSamples = std::max(result.maxSamples, samples);
+                if (m_policy == Policy::Scheduler)
+                {
+                    uint32_t time_stamp = (uint32_t)(uint64_t)std::llround(last_time * THROUGHPUT_SCHEDULER_TICK_FREQUENCY);
+                    if (throughput_scheduler_update(&m_scheduler, time_stamp, m_completed)) samples = throughput_scheduler_samples(&m_scheduler);
+                }
+            }
+            while (!m_queue.empty()) runEvents(m_nextEvent, result);
+
+            result.lastSamples = samples;
+            result.adjustments = m_scheduler.adjustments;
+            return result;
+        }
+
+    private:
+        void queueDataSet(double first_time, double last_time, int samples, Result& result)
+        {
+            //The data set goes into as many notifications as it takes, packed samples change size with the data
+            float sample_size = m_link.sample_size;
+            if (m_options.encoding == "packed") sample_size = (float)(8.0 + 4.0 * m_uniform(m_generator));
+            int payload = std::min(m_link.max_notification, (uint16_t)(m_link.att_mtu - 3)) - HEADER_SIZE;
+            int per_notification = std::max(1, std::min(samples, (int)(payload / sample_size)));
+
+            for (int sent = 0; sent < samples; sent += per_notification)
+            {
+                int count = std::min(per_notification, samples - sent);
+                int length = HEADER_SIZE + (int)std::ceil(count * sample_size);
+                if (m_options.encoding == "raw") length = (count < 5) ? 9 + 4 * 18 : ((count < 9) ? 9 + 8 * 18 : LARGE_CHARACTERISTIC_SIZE); //small, medium or large characteristic
+
+                if ((int)m_queue.size() >= QUEUE_SIZE)
+                {
+                    result.samplesDropped += count;
+                    throughput_scheduler_dropped(&m_scheduler);
+                    continue;
+                }
+
+                result.depthSum += m_queue.size();
+                result.depthCount++;
+                throughput_scheduler_queued(&m_scheduler, (uint8_t)m_queue.size(), (uint16_t)length, (uint8_t)count);
+
+                Notification notification;
+                notification.readyTime = last_time;
+                notification.firstSampleTime = first_time + sent / (double)m_odr;
+                notification.lastSampleTime = first_time + (sent + count - 1) / (double)m_odr;
+                notification.samples = count;
+                notification.packetsLeft = (length + 7 + m_options.dataLength - 1) / m_options.dataLength;
+                m_queue.push_back(notification);
+            }
+        }
+
+        void runEvents(double until, Result& result)
+        {
+            //Every connection event sends as many packets as fit into the interval (and as the central allows),
+            //packets that fail get sent again
+            while (m_nextEvent <= until)
+            {
+                double event = m_nextEvent;
+                m_nextEvent += m_interval;
+                if (m_queue.empty() || m_uniform(m_generator) < m_options.skipRate) continue;
+
+                int budget = std::min(m_options.centralPackets, (int)((m_interval - 1.25e-3) / m_packetTime));
+                int used = 0;
+                while (used < budget && !m_queue.empty())
+                {
+                    used++;
+                    if (m_uniform(m_generator) < m_options.packetErrorRate) continue;
+
+                    Notification& notification = m_queue.front();
+                    if (--notification.packetsLeft > 0) continue;
+
+                    //The notification has made it over
+                    double arrival = event + used * m_packetTime;
+                    double mean_time = (notification.firstSampleTime + notification.lastSampleTime) / 2.0;
+                    result.latencySum += (arrival - mean_time) * notification.samples;
+                    result.worstLatencies.push_back(arrival - notification.firstSampleTime);
+                    result.samplesSent += notification.samples;
+                    result.notifications++;
+                    m_completed++;
+                    m_queue.pop_front();
+                }
+            }
+        }
+
+        Options const& m_options;
+        float m_odr;
+        double m_interval;
+        Policy m_policy;
+        throughput_link_t m_link;
+        throughput_scheduler_t m_scheduler;
+        double m_packetTime;
+
+        std::deque<Notification> m_queue;
+        double m_nextEvent = 0.0;
+        uint32_t m_completed = 0;
+        std::mt19937 m_generator;
+        std::uniform_real_distribution<double> m_uniform;
+    };
+
+    void usage(const char* name)
+    {
+        printf("Usage: %s [--odr <list>] [--interval <list of ms>] [--encoding raw|packed|fused] [--seconds <s>] [--mtu <bytes>] [--data-length <bytes>] [--phy 1|2]\n"
+            "       [--central-packets <packets per event>] [--per <packet error rate>] [--skip <fraction of events skipped>] [--seed <n>]\n", name);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--odr" && i + 1 < argc) options.odrs = parseList(argv[++i]);
+        else if (argument == "--interval" && i + 1 < argc) options.intervals = parseList(argv[++i]);
+        else if (argument == "--encoding" && i + 1 < argc) options.encoding = argv[++i];
+        else if (argument == "--seconds" && i + 1 < argc) options.seconds = atof(argv[++i]);
+        else if (argument == "--mtu" && i + 1 < argc) options.mtu = atoi(argv[++i]);
+        else if (argument == "--data-length" && i + 1 < argc) options.dataLength = atoi(argv[++i]);
+        else if (argument == "--phy" && i + 1 < argc) options.phy = atoi(argv[++i]);
+        else if (argument == "--central-packets" && i + 1 < argc) options.centralPackets = atoi(argv[++i]);
+        else if (argument == "--per" && i + 1 < argc) options.packetErrorRate = atof(argv[++i]);
+        else if (argument == "--skip" && i + 1 < argc) options.skipRate = atof(argv[++i]);
+        else if (argument == "--seed" && i + 1 < argc) options.seed = (uint32_t)atoi(argv[++i]);
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (options.odrs.empty() || options.intervals.empty() || options.seconds <= 0.0 || options.mtu < 23 || options.dataLength < 27 || options.dataLength > 251 ||
+        (options.phy != 1 && options.phy != 2) || options.centralPackets < 1 || (options.encoding != "raw" && options.encoding != "packed" && options.encoding != "fused"))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    printf("%s samples, MTU %d, data length %d, %d Mbps PHY, central allows %d packets per event, %.1f%% packet errors, %.1f%% events skipped\n\n",
+        options.encoding.c_str(), options.mtu, options.dataLength, options.phy, options.centralPackets, 100.0 * options.packetErrorRate, 100.0 * options.skipRate);
+    printf("%7s %8s %9s | %-28s | %-28s\n", "", "", "", "          scheduler", "            fixed");
+    printf("%7s %8s %9s | %7s %7s %6s %6s | %7s %7s %6s %6s\n", "ODR", "interval", "asks for", "samples", "mean ms", "p99 ms", "drop%", "samples", "mean ms", "p99 ms", "drop%");
+
+    int worse = 0, runs = 0;
+    for (float odr : options.odrs)
+    {
+        for (float interval : options.intervals)
+        {
+            Result results[2];
+            Policy policies[2] = { Policy::Scheduler, Policy::Legacy };
+            for (int p = 0; p < 2; p++)
+            {
+                LinkSimulation simulation(options, odr, interval, policies[p]);
+                results[p] = simulation.run();
+            }
+
+            //The interval the scheduler would ask the central for at this ODR
+            throughput_link_t link = {};
+            link.odr = odr;
+            link.att_mtu = (uint16_t)options.mtu;
+            link.data_length = (uint16_t)options.dataLength;
+            link.phy_mbps = (uint8_t)options.phy;
+            link.queue_size = QUEUE_SIZE;
+            link.max_samples = (options.encoding == "raw") ? RAW_MAX_SAMPLES : MAX_SAMPLES;
+            link.max_notification = LARGE_CHARACTERISTIC_SIZE;
+            link.header_size = HEADER_SIZE;
+            link.sample_size = (options.encoding == "raw") ? 18.0f : ((options.encoding == "packed") ? 10.0f : 6.0f);
+            uint16_t min_interval = 0, max_interval = 0;
+            throughput_model_preferred_interval(&link, &min_interval, &max_interval);
+
+            char asks[32];
+            snprintf(asks, sizeof(asks), "%u-%u", min_interval, max_interval);
+            printf("%7.1f %8.1f %9s |", odr, interval, asks);
+            double drop_rates[2], means[2];
+            for (int p = 0; p < 2; p++)
+            {
+                Result& result = results[p];
+                uint64_t total = result.samplesSent + result.samplesDropped;
+                drop_rates[p] = (total > 0) ? 100.0 * result.samplesDropped / total : 0.0;
+                means[p] = (result.samplesSent > 0) ? 1000.0 * result.latencySum / result.samplesSent : 0.0;
+                char samples[16];
+                if (result.minSamples == result.maxSamples) snprintf(samples, sizeof(samples), "%d", result.lastSamples);
+                else snprintf(samples, sizeof(samples), "%d-%d", result.minSamples, result.maxSamples);
+                printf(" %7s %7.1f %6.1f %6.2f |", samples, means[p], 1000.0 * percentile(result.worstLatencies, 0.99), drop_rates[p]);
+            }
+            printf("\n");
+
+            //The scheduler should never drop noticeably more than the fixed rule, or be noticeably slower without dropping less.
+            //Being a couple of milliseconds slower is allowed, that's the headroom it keeps on links that are close to full.
+            runs++;
+            if (drop_rates[0] > drop_rates[1] + 0.1 || (means[0] > 1.1 * means[1] && means[0] > means[1] + 2.0 && drop_rates[0] >= drop_rates[1])) worse++;
+        }
+    }
+
+    printf("\nThe scheduler did worse than the fixed rule in %d of %d runs\n", worse, runs);
+    return (worse == 0) ? 0 : 1;
+}
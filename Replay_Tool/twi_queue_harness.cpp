@@ -0,0 +1,442 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "../Firmware/nRF52840_Drivers/nRF_Implementations/pc_twi_queue.h"
+
+//Runs the TWI transfer queue from pc_twi_queue.c against a fake TWI backend and measures how deep the queues get and how
+//long it takes from queueing a sample's reads until its group callback goes off. Both buses are simulated at 400 kHz
+//with their own clock running alongside each other, and the sensors are register files that reads and writes really go
+//to. Every sample is read the way the firmware does it now (all of its reads queued in one group that goes out on both
+//buses at once) and the way it used to (one blocking transfer after another). It also checks that the queue turns away
+//transfers once it's full, hands errors back to the right callbacks and keeps stats that match what actually happened.
+//See readme.txt for how to build it.
+
+namespace
+{
+    const double BIT_US = 2.5; //400 kHz
+    const int BYTE_BITS = 9; //8 data bits and the ACK
+    const int32_t NACK = 1; //any result other than TWI_QUEUE_SUCCESS is an error to the queue
+
+    struct Options
+    {
+        int samples = 2000;
+        double overheadUs = 15.0; //CPU time around each transfer (starting EasyDMA and the interrupt)
+        std::vector<double> odrs = { 100.0, 400.0, 1600.0 };
+    };
+
+    //One register file per TWI address on each bus, an address without a sensor NACKs
+    struct FakeBus
+    {
+        std::vector<std::vector<uint8_t>> sensors = std::vector<std::vector<uint8_t>>(128);
+
+        bool busy = false;
+        double doneUs = 0.0; //when the transfer on the bus finishes
+        twi_transfer_t const* p_transfer = nullptr;
+        bool failNextStart = false; //makes the next start fail, like nrf_drv_twi_xfer() returning NRF_ERROR_BUSY
+        uint32_t started = 0, failedStarts = 0;
+    };
+
+    FakeBus g_buses[TWI_QUEUE_BUSES];
+    double g_clockUs = 0.0;
+    double g_overheadUs = 15.0;
+
+    uint8_t registerValue(uint8_t bus, uint8_t address, uint8_t reg)
+    {
+        return (uint8_t)(bus * 131 + address * 7 + reg * 13);
+    }
+
+    void addSensor(uint8_t bus, uint8_t address)
+    {
+        std::vector<uint8_t>& registers = g_buses[bus].sensors[address];
+        registers.resize(256);
+        for (int reg = 0; reg < 256; reg++) registers[reg] = registerValue(bus, address, (uint8_t)reg);
+    }
+
+    double transferUs(twi_transfer_t const* transfer)
+    {
+        //Start, address byte, the written bytes, then a repeated start, the address again and the read bytes, and stop
+        double bits = 2.0 + BYTE_BITS * (1 + transfer->primary_length);
+        if (transfer->p_read_buf != NULL) bits += 1.0 + BYTE_BITS * (1 + transfer->read_length);
+        return g_overheadUs + bits * BIT_US;
+    }
+
+    int32_t backendStart(uint8_t bus, twi_transfer_t const* transfer)
+    {
+        FakeBus& fake = g_buses[bus];
+        if (fake.busy)
+        {
+            printf("  FAILED: the queue started a transfer on bus %d while the last one was still going\n", bus);
+            exit(1);
+        }
+        if (fake.failNextStart)
+        {
+            fake.failNextStart = false;
+            fake.failedStarts++;
+            return NACK;
+        }
+
+        fake.busy = true;
+        fake.doneUs = g_clockUs + transferUs(transfer);
+        fake.p_transfer = transfer;
+        fake.started++;
+        return TWI_QUEUE_SUCCESS;
+    }
+
+    uint32_t backendTime()
+    {
+        return (uint32_t)g_clockUs;
+    }
+
+    void finishTransfer(uint8_t bus)
+    {
+        //The transfer reaches the sensor when the bus is done with it, then the TWI interrupt hands it back to the queue
+        FakeBus& fake = g_buses[bus];
+        twi_transfer_t const* transfer = fake.p_transfer;
+        fake.busy = false;
+        g_clockUs = fake.doneUs;
+
+        std::vector<uint8_t>& registers = fake.sensors[transfer->address & 0x7F];
+        int32_t result = TWI_QUEUE_SUCCESS;
+        if (registers.empty()) result = NACK;
+        else if (transfer->p_read_buf != NULL)
+        {
+            uint8_t reg = transfer->p_primary_buf[0];
+            for (uint16_t i = 0; i < transfer->read_length; i++) transfer->p_read_buf[i] = registers[(uint8_t)(reg + i)];
+        }
+        else
+        {
+            uint8_t reg = transfer->p_primary_buf[0];
+            for (uint16_t i = 1; i < transfer->primary_length; i++) registers[(uint8_t)(reg + i - 1)] = transfer->p_primary_buf[i];
+        }
+
+        twi_queue_transfer_complete(bus, result);
+    }
+
+    void runUntil(double us)
+    {
+        //Plays out every transfer that finishes before the given time, in the order they finish across both buses
+        for (;;)
+        {
+            int next = -1;
+            for (int bus = 0; bus < TWI_QUEUE_BUSES; bus++)
+            {
+                if (g_buses[bus].busy && g_buses[bus].doneUs <= us && (next < 0 || g_buses[bus].doneUs < g_buses[next].doneUs)) next = bus;
+            }
+            if (next < 0) break;
+            finishTransfer((uint8_t)next);
+        }
+        if (us > g_clockUs) g_clockUs = us;
+    }
+
+    void runUntilIdle()
+    {
+        for (;;)
+        {
+            double next = -1.0;
+            for (int bus = 0; bus < TWI_QUEUE_BUSES; bus++)
+            {
+                if (g_buses[bus].busy && (next < 0.0 || g_buses[bus].doneUs < next)) next = g_buses[bus].doneUs;
+            }
+            if (next < 0.0) return;
+            runUntil(next);
+        }
+    }
+
+    void resetBackend()
+    {
+        twi_queue_backend_t backend = { backendStart, backendTime, NULL, NULL };
+        twi_queue_init(&backend);
+        for (int bus = 0; bus < TWI_QUEUE_BUSES; bus++) g_buses[bus] = FakeBus();
+        g_clockUs = 0.0;
+    }
+
+    void report(bool& passed, bool condition, const char* description)
+    {
+        if (!condition)
+        {
+            printf("  FAILED: %s\n", description);
+            passed = false;
+        }
+    }
+
+    //The reads that make up one sample, the BMI270 acc and gyr registers and a magnetometer
+    struct SensorRead
+    {
+        uint8_t bus, address, reg;
+        uint16_t length;
+    };
+
+    struct Layout
+    {
+        const char* name;
+        std::vector<SensorRead> reads;
+    };
+
+    const Layout LAYOUTS[] =
+    {
+        { "internal", { { 0, 0x68, 0x0C, 6 }, { 0, 0x68, 0x12, 6 }, { 0, 0x10, 0x42, 8 } } }, //BMI270 and BMM150 on the internal bus
+        { "split",    { { 0, 0x68, 0x0C, 6 }, { 0, 0x68, 0x12, 6 }, { 1, 0x1E, 0x68, 6 } } }  //magnetometer on the external bus
+    };
+
+    struct Sample
+    {
+        twi_transfer_group_t group;
+        uint8_t data[3][8];
+        double queuedUs = 0.0, doneUs = -1.0;
+        int callbacks = 0;
+        int32_t result = 0;
+        bool turnedAway = false; //one of its reads didn't fit in the queue
+    };
+
+    void sampleDone(int32_t result, void* p_context)
+    {
+        Sample* sample = (Sample*)p_context;
+        sample->callbacks++;
+        sample->result = result;
+        sample->doneUs = g_clockUs;
+    }
+
+    void blockingDone(int32_t result, void* p_context)
+    {
+        *(int32_t*)p_context = result;
+    }
+
+    struct RunResult
+    {
+        double meanLatencyUs = 0.0, maxLatencyUs = 0.0;
+        uint16_t maxDepth[TWI_QUEUE_BUSES] = {};
+        double meanTransferLatencyUs[TWI_QUEUE_BUSES] = {};
+        uint32_t rejected = 0;
+        int droppedSamples = 0;
+    };
+
+    RunResult runSamples(Layout const& layout, double odr, bool queued, Options const& options, bool& passed)
+    {
+        //A new sample is due every 1 / ODR seconds. Queued, all of its reads go into the queue at once and the bus
+        //does the rest. Blocking, each read has to finish before the next one is queued and a sample can't start
+        //until the last one is done, the same way sensor_read_register() used to busy-wait.
+        resetBackend();
+        for (SensorRead const& read : layout.reads) addSensor(read.bus, read.address);
+
+        std::vector<Sample> samples(options.samples);
+        double period = 1000000.0 / odr;
+        double cpuFreeUs = 0.0; //blocking reads keep the CPU until they're done
+        RunResult result;
+
+        for (int s = 0; s < options.samples; s++)
+        {
+            Sample& sample = samples[s];
+            sample.queuedUs = s * period;
+            runUntil(sample.queuedUs > cpuFreeUs ? sample.queuedUs : cpuFreeUs);
+
+            if (queued)
+            {
+                twi_group_begin(&sample.group, sampleDone, &sample);
+                for (size_t r = 0; r < layout.reads.size(); r++)
+                {
+                    SensorRead const& read = layout.reads[r];
+                    if (twi_queue_read(read.bus, read.address, read.reg, sample.data[r], read.length, NULL, NULL, &sample.group) != TWI_QUEUE_SUCCESS) sample.turnedAway = true;
+                }
+                twi_group_end(&sample.group);
+            }
+            else
+            {
+                int32_t sample_result = TWI_QUEUE_SUCCESS;
+                for (size_t r = 0; r < layout.reads.size(); r++)
+                {
+                    SensorRead const& read = layout.reads[r];
+                    int32_t read_result = TWI_QUEUE_SUCCESS;
+                    if (twi_queue_read(read.bus, read.address, read.reg, sample.data[r], read.length, blockingDone, &read_result, NULL) != TWI_QUEUE_SUCCESS) read_result = TWI_QUEUE_ERROR_FULL;
+                    runUntilIdle();
+                    if (read_result != TWI_QUEUE_SUCCESS && sample_result == TWI_QUEUE_SUCCESS) sample_result = read_result;
+                }
+                sample.turnedAway = (sample_result == TWI_QUEUE_ERROR_FULL);
+                sampleDone(sample_result, &sample);
+                cpuFreeUs = g_clockUs;
+            }
+        }
+        runUntilIdle();
+
+        //Every sample has to have been called back exactly once. The ones that made it have to hold what's in the
+        //sensors' registers, the rest can only have failed because the queue was full.
+        double totalLatency = 0.0;
+        int good = 0;
+        for (Sample const& sample : samples)
+        {
+            report(passed, sample.callbacks == 1, "a sample wasn't called back exactly once");
+            if (sample.turnedAway)
+            {
+                result.droppedSamples++;
+                continue;
+            }
+            report(passed, sample.result == TWI_QUEUE_SUCCESS, "a sample whose reads all fit in the queue failed");
+
+            for (size_t r = 0; r < layout.reads.size(); r++)
+            {
+                SensorRead const& read = layout.reads[r];
+                bool matches = true;
+                for (uint16_t i = 0; i < read.length; i++) matches = matches && sample.data[r][i] == registerValue(read.bus, read.address, (uint8_t)(read.reg + i));
+                report(passed, matches, "a sample holds data that isn't in the sensor's registers");
+            }
+
+            double latency = sample.doneUs - sample.queuedUs;
+            totalLatency += latency;
+            if (latency > result.maxLatencyUs) result.maxLatencyUs = latency;
+            good++;
+        }
+        result.meanLatencyUs = (good > 0) ? totalLatency / good : 0.0;
+
+        for (uint8_t bus = 0; bus < TWI_QUEUE_BUSES; bus++)
+        {
+            twi_queue_stats_t stats;
+            twi_queue_get_stats(bus, &stats);
+            result.maxDepth[bus] = stats.max_depth;
+            result.meanTransferLatencyUs[bus] = (stats.transfers > 0) ? (double)stats.total_latency / stats.transfers : 0.0;
+            result.rejected += stats.rejected;
+
+            report(passed, stats.transfers == g_buses[bus].started, "the queue's transfer count doesn't match the transfers the bus did");
+            report(passed, stats.errors == 0 && stats.depth == 0, "the queue has errors or transfers left over");
+            report(passed, stats.max_depth <= TWI_QUEUE_LENGTH, "the queue got deeper than it has descriptors for");
+            report(passed, twi_queue_idle(bus), "the queue isn't idle after the last transfer finished");
+        }
+        return result;
+    }
+
+    bool fullQueueCheck()
+    {
+        //Nothing finishes while the writes are being queued, so exactly TWI_QUEUE_LENGTH of them fit and the rest get
+        //turned away. The ones that fit have to reach the sensor in the order they were queued.
+        resetBackend();
+        addSensor(0, 0x68);
+        bool passed = true;
+
+        const int writes = TWI_QUEUE_LENGTH + 4;
+        std::vector<int32_t> results(writes, 99);
+        int accepted = 0, rejected = 0;
+        for (int i = 0; i < writes; i++)
+        {
+            uint8_t value = (uint8_t)i;
+            int32_t queue_result = twi_queue_write(0, 0x68, 0x40, &value, 1, blockingDone, &results[i], NULL);
+            if (queue_result == TWI_QUEUE_SUCCESS) accepted++;
+            else if (queue_result == TWI_QUEUE_ERROR_FULL) rejected++;
+        }
+        report(passed, accepted == TWI_QUEUE_LENGTH && rejected == writes - TWI_QUEUE_LENGTH, "the queue didn't take exactly TWI_QUEUE_LENGTH transfers");
+
+        twi_queue_stats_t stats;
+        twi_queue_get_stats(0, &stats);
+        report(passed, stats.depth == TWI_QUEUE_LENGTH && stats.max_depth == TWI_QUEUE_LENGTH, "the depth of a full queue isn't TWI_QUEUE_LENGTH");
+        report(passed, stats.rejected == (uint32_t)rejected, "the rejected count doesn't match the refused transfers");
+
+        uint8_t too_long[TWI_QUEUE_MAX_WRITE_LENGTH + 1] = {};
+        report(passed, twi_queue_write(0, 0x68, 0x40, too_long, sizeof(too_long), NULL, NULL, NULL) == TWI_QUEUE_ERROR_PARAM, "a write that's too long was accepted");
+        report(passed, twi_queue_read(TWI_QUEUE_BUSES, 0x68, 0x40, too_long, 1, NULL, NULL, NULL) == TWI_QUEUE_ERROR_PARAM, "a read on a bus that doesn't exist was accepted");
+
+        runUntilIdle();
+        bool called_back = true;
+        for (int i = 0; i < accepted; i++) called_back = called_back && results[i] == TWI_QUEUE_SUCCESS;
+        report(passed, called_back, "a queued write wasn't called back with success");
+        report(passed, g_buses[0].sensors[0x68][0x40] == accepted - 1, "the last write to reach the sensor isn't the last one queued");
+
+        twi_queue_get_stats(0, &stats);
+        report(passed, stats.transfers == (uint32_t)accepted && stats.depth == 0, "the stats don't add up after the queue emptied");
+
+        twi_queue_reset_stats(0);
+        twi_queue_get_stats(0, &stats);
+        report(passed, stats.transfers == 0 && stats.rejected == 0 && stats.max_depth == 0 && stats.max_latency == 0, "resetting the stats didn't clear them");
+
+        printf("full queue: %d of %d writes queued, %d turned away, all %d reached the sensor in order\n", accepted, writes, rejected, accepted);
+        return passed;
+    }
+
+    bool errorCheck()
+    {
+        //A group with a read from an address nothing answers on, and a transfer the backend refuses to start. The errors
+        //have to reach the group and the transfers behind them still have to go out.
+        resetBackend();
+        addSensor(0, 0x68);
+        addSensor(1, 0x1E);
+        bool passed = true;
+
+        Sample sample;
+        twi_group_begin(&sample.group, sampleDone, &sample);
+        twi_queue_read(0, 0x68, 0x0C, sample.data[0], 6, NULL, NULL, &sample.group);
+        twi_queue_read(0, 0x10, 0x42, sample.data[1], 8, NULL, NULL, &sample.group); //no BMM150 on this bus
+        twi_queue_read(1, 0x1E, 0x68, sample.data[2], 6, NULL, NULL, &sample.group);
+        report(passed, sample.callbacks == 0, "the group called back before it was closed");
+        twi_group_end(&sample.group);
+        runUntilIdle();
+        report(passed, sample.callbacks == 1 && sample.result == NACK, "a group with a NACKed read wasn't called back once with the error");
+
+        g_buses[1].failNextStart = true;
+        int32_t first = 99, second = 99;
+        uint8_t data[2][6];
+        twi_queue_read(1, 0x1E, 0x68, data[0], 6, blockingDone, &first, NULL);
+        twi_queue_read(1, 0x1E, 0x68, data[1], 6, blockingDone, &second, NULL);
+        runUntilIdle();
+        report(passed, first == NACK && second == TWI_QUEUE_SUCCESS, "a transfer that couldn't be started held up the one behind it");
+        report(passed, data[1][0] == registerValue(1, 0x1E, 0x68), "the transfer behind the one that couldn't be started didn't read the sensor");
+
+        twi_queue_stats_t stats[TWI_QUEUE_BUSES];
+        for (uint8_t bus = 0; bus < TWI_QUEUE_BUSES; bus++) twi_queue_get_stats(bus, &stats[bus]);
+        report(passed, stats[0].errors == 1 && stats[0].transfers == 2, "the internal bus stats don't show the NACK");
+        report(passed, stats[1].errors == 1 && stats[1].transfers == 3, "the external bus stats don't show the failed start");
+
+        printf("errors: NACK and failed start reported to their callbacks, the transfers behind them still went out\n");
+        return passed;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--samples" && i + 1 < argc) options.samples = atoi(argv[++i]);
+        else if (argument == "--overhead" && i + 1 < argc) options.overheadUs = atof(argv[++i]);
+        else if (argument == "--odr" && i + 1 < argc) options.odrs = { atof(argv[++i]) };
+        else
+        {
+            printf("Usage: %s [--samples <samples per run>] [--overhead <us per transfer>] [--odr <Hz>]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (options.samples <= 0 || options.odrs[0] <= 0.0)
+    {
+        printf("Usage: %s [--samples <samples per run>] [--overhead <us per transfer>] [--odr <Hz>]\n", argv[0]);
+        return 1;
+    }
+    g_overheadUs = options.overheadUs;
+
+    bool passed = fullQueueCheck();
+    passed = errorCheck() && passed;
+
+    printf("\n%-9s %-9s %7s %12s %12s %10s %14s %9s %8s\n", "layout", "reads", "odr", "mean us", "max us", "max depth", "transfer us", "rejected", "dropped");
+    for (Layout const& layout : LAYOUTS)
+    {
+        for (double odr : options.odrs)
+        {
+            RunResult results[2];
+            for (int queued = 1; queued >= 0; queued--)
+            {
+                RunResult& result = results[queued];
+                result = runSamples(layout, odr, queued == 1, options, passed);
+                printf("%-9s %-9s %7.0f %12.1f %12.1f %5u/%-4u %7.1f/%-6.1f %9u %8d\n", layout.name, queued ? "queued" : "blocking", odr,
+                    result.meanLatencyUs, result.maxLatencyUs, result.maxDepth[0], result.maxDepth[1], result.meanTransferLatencyUs[0],
+                    result.meanTransferLatencyUs[1], result.rejected, result.droppedSamples);
+            }
+
+            //Splitting the sensors over both buses only pays off if the queue really runs them at the same time
+            if (layout.reads.back().bus != layout.reads.front().bus && results[0].droppedSamples == 0 && results[1].droppedSamples == 0)
+            {
+                report(passed, results[1].meanLatencyUs < results[0].meanLatencyUs, "queued reads on both buses weren't faster than blocking ones");
+            }
+        }
+    }
+
+    printf("\n%s\n", passed ? "The queue kept its data, callbacks and stats straight" : "The queue didn't behave");
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,234 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../DirectXApp/Golf/SwingPhaseDetector.h"
+#include "../DirectXApp/Math/madgwick_batch.h"
+#include "../DirectXApp/Math/vector_math.h"
+#include "allocation_counter.h"
+
+//Compares the fixed size Vec3/Quat math from vector_math.h against the std::vector<float> versions of the same
+//functions that quaternion_functions.h and SwingPhaseDetection.cpp used to have, and checks that running a fused
+//sample all the way through the per-sample path (filter, Euler angles, swing phase detector, club vector) never
+//touches the heap. Every allocation in the program gets counted by allocation_counter.cpp. See readme.txt for how to
+//build it.
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    //The answers only depend on the types, so these get checked by the compiler
+    static_assert(Cross(Vec3{ 1.0f, 0.0f, 0.0f }, Vec3{ 0.0f, 1.0f, 0.0f }) == Vec3{ 0.0f, 0.0f, 1.0f }, "x cross y should be z");
+    static_assert(Quat{ 0.0f, 1.0f, 0.0f, 0.0f } * Quat{ 0.0f, 1.0f, 0.0f, 0.0f } == Quat{ -1.0f, 0.0f, 0.0f, 0.0f }, "i * i should be -1");
+    static_assert(Rotate(Quat{ 0.0f, 0.0f, 0.0f, 1.0f }, Vec3{ 1.0f, 0.0f, 0.0f }) == Vec3{ -1.0f, 0.0f, 0.0f }, "half a turn about z should flip x");
+
+    //The std::vector<float> versions, written the way they used to be (quaternions are [w, x, y, z] arrays here
+    //instead of glm::quat so this builds without glm)
+    namespace old_math
+    {
+        float DotProduct(std::vector<float> vec1, std::vector<float> vec2)
+        {
+            float answer = 0;
+            for (size_t i = 0; i < vec1.size(); i++) answer += vec1[i] * vec2[i];
+            return answer;
+        }
+        std::vector<float> CrossProduct(std::vector<float> vec1, std::vector<float> vec2)
+        {
+            std::vector<float> answer;
+            answer.push_back(vec1[1] * vec2[2] - vec1[2] * vec2[1]);
+            answer.push_back(vec1[2] * vec2[0] - vec1[0] * vec2[2]);
+            answer.push_back(vec1[0] * vec2[1] - vec1[1] * vec2[0]);
+            return answer;
+        }
+        float Magnitude(std::vector<float> vec)
+        {
+            float answer = 0;
+            for (size_t i = 0; i < vec.size(); i++) answer += vec[i] * vec[i];
+            return sqrt(answer);
+        }
+        void QuatRotate(const float* q, std::vector<float>& data)
+        {
+            double w = 0, x = data[0], y = data[1], z = data[2];
+            double temp[4];
+            temp[0] = q[0] * w - q[1] * x - q[2] * y - q[3] * z;
+            temp[1] = q[0] * x + q[1] * w + q[2] * z - q[3] * y;
+            temp[2] = q[0] * y - q[1] * z + q[2] * w + q[3] * x;
+            temp[3] = q[0] * z + q[1] * y - q[2] * x + q[3] * w;
+            w = temp[0]; x = temp[1]; y = temp[2]; z = temp[3];
+            data[0] = (float)(w * -q[1] + x * q[0] + y * -q[3] - z * -q[2]);
+            data[1] = (float)(w * -q[2] - x * -q[3] + y * q[0] + z * -q[1]);
+            data[2] = (float)(w * -q[3] + x * -q[2] - y * -q[1] + z * q[0]);
+        }
+        void GetRotationQuaternion(std::vector<float> vec1, std::vector<float> vec2, float* q)
+        {
+            std::vector<float> cross = CrossProduct(vec1, vec2);
+            q[0] = sqrt(Magnitude(vec1) * Magnitude(vec1) * Magnitude(vec2) * Magnitude(vec2)) + DotProduct(vec1, vec2);
+            q[1] = cross[0];
+            q[2] = cross[1];
+            q[3] = cross[2];
+            float mag = Magnitude({ q[0], q[1], q[2], q[3] });
+            for (int i = 0; i < 4; i++) q[i] /= mag;
+        }
+        bool detectImpact(std::vector<float> const& ball_location, const float* quaternion)
+        {
+            std::vector<float> club_vector = { 1.0f, 0.0f, 0.0f };
+            QuatRotate(quaternion, club_vector);
+            float x_distance = club_vector[0] - ball_location[0];
+            float y_distance = club_vector[1] - ball_location[1];
+            float z_distance = club_vector[2] - ball_location[2];
+            return sqrt(x_distance * x_distance + y_distance * y_distance + z_distance * z_distance) <= IMPACT_DISTANCE_THRESHOLD;
+        }
+    }
+
+    bool detectImpact(Vec3 const& ball_location, Quat const& quaternion)
+    {
+        return Distance(Rotate(quaternion, { 1.0f, 0.0f, 0.0f }), ball_location) <= IMPACT_DISTANCE_THRESHOLD;
+    }
+
+    struct Result
+    {
+        double nanoseconds; //per call
+        double allocations; //per call
+        double checksum;
+    };
+
+    template <typename Function>
+    Result measure(int calls, Function const& function)
+    {
+        double checksum = 0.0;
+        uint64_t allocations_before = allocationCount();
+        Clock::time_point start = Clock::now();
+        for (int i = 0; i < calls; i++) checksum += function(i);
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        return { 1e9 * seconds / calls, (double)(allocationCount() - allocations_before) / calls, checksum };
+    }
+
+    void printResult(const char* name, Result const& before, Result const& after)
+    {
+        printf("%-26s %9.2f ns %6.2f allocs   %9.2f ns %6.2f allocs   %6.1fx\n", name, before.nanoseconds, before.allocations,
+            after.nanoseconds, after.allocations, (after.nanoseconds > 0.0) ? before.nanoseconds / after.nanoseconds : 0.0);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int calls = 1000000;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--calls" && i + 1 < argc) calls = atoi(argv[++i]);
+        else
+        {
+            printf("Usage: %s [--calls <count>]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (calls < 1) return 1;
+
+    //A table of random unit quaternions and vectors to work through so nothing gets folded away
+    const int TABLE_SIZE = 1024;
+    std::mt19937 generator(1);
+    std::normal_distribution<float> normal(0.0f, 1.0f);
+    std::vector<Quat> quaternions(TABLE_SIZE);
+    std::vector<Vec3> vectors(TABLE_SIZE);
+    for (int i = 0; i < TABLE_SIZE; i++)
+    {
+        quaternions[i] = Normalized(Quat{ normal(generator), normal(generator), normal(generator), normal(generator) });
+        vectors[i] = { normal(generator), normal(generator), normal(generator) };
+    }
+
+    printf("%-26s %26s   %26s   %7s\n", "", "std::vector<float>", "Vec3 / Quat", "speedup");
+    double worst_error = 0.0, new_allocations = 0.0;
+
+    Result before = measure(calls, [&](int i) {
+        Vec3 const& a = vectors[i % TABLE_SIZE], & b = vectors[(i + 1) % TABLE_SIZE];
+        return old_math::CrossProduct({ a.x, a.y, a.z }, { b.x, b.y, b.z })[2] + old_math::DotProduct({ a.x, a.y, a.z }, { b.x, b.y, b.z });
+    });
+    Result after = measure(calls, [&](int i) {
+        Vec3 const& a = vectors[i % TABLE_SIZE], & b = vectors[(i + 1) % TABLE_SIZE];
+        return Cross(a, b).z + Dot(a, b);
+    });
+    printResult("CrossProduct + DotProduct", before, after);
+    new_allocations += after.allocations;
+    worst_error = fmax(worst_error, fabs(before.checksum - after.checksum) / calls);
+
+    before = measure(calls, [&](int i) {
+        Quat const& q = quaternions[i % TABLE_SIZE];
+        Vec3 const& v = vectors[i % TABLE_SIZE];
+        std::vector<float> data = { v.x, v.y, v.z };
+        old_math::QuatRotate(&q.w, data);
+        return data[0] + data[1] + data[2];
+    });
+    after = measure(calls, [&](int i) {
+        Vec3 rotated = Rotate(quaternions[i % TABLE_SIZE], vectors[i % TABLE_SIZE]);
+        return rotated.x + rotated.y + rotated.z;
+    });
+    printResult("QuatRotate", before, after);
+    new_allocations += after.allocations;
+    worst_error = fmax(worst_error, fabs(before.checksum - after.checksum) / calls);
+
+    before = measure(calls, [&](int i) {
+        Vec3 const& a = vectors[i % TABLE_SIZE], & b = vectors[(i + 1) % TABLE_SIZE];
+        float q[4];
+        old_math::GetRotationQuaternion({ a.x, a.y, a.z }, { b.x, b.y, b.z }, q);
+        return q[0] + q[1] + q[2] + q[3];
+    });
+    after = measure(calls, [&](int i) {
+        Quat q = RotationBetween(vectors[i % TABLE_SIZE], vectors[(i + 1) % TABLE_SIZE]);
+        return q.w + q.x + q.y + q.z;
+    });
+    printResult("GetRotationQuaternion", before, after);
+    new_allocations += after.allocations;
+    worst_error = fmax(worst_error, fabs(before.checksum - after.checksum) / calls);
+
+    std::vector<float> old_ball = { 1.0f, 0.0f, 0.0f };
+    Vec3 ball = { 1.0f, 0.0f, 0.0f };
+    before = measure(calls, [&](int i) { return old_math::detectImpact(old_ball, &quaternions[i % TABLE_SIZE].w) ? 1.0 : 0.0; });
+    after = measure(calls, [&](int i) { return detectImpact(ball, quaternions[i % TABLE_SIZE]) ? 1.0 : 0.0; });
+    printResult("detectImpact", before, after);
+    new_allocations += after.allocations;
+    bool impacts_match = before.checksum == after.checksum;
+
+    //A whole fused sample: one step of the Madgwick filter, the Euler angles, the swing phase detector (which
+    //works out the club shaft vector) and the swing path point the free swing mode saves during impact
+    const float odr = 400.0f;
+    std::vector<float> readings(9 * TABLE_SIZE);
+    for (int i = 0; i < TABLE_SIZE; i++)
+    {
+        Vec3 acc = Rotate(Conjugate(quaternions[i]), { 0.0f, 0.0f, 9.80665f }), mag = Rotate(Conjugate(quaternions[i]), { 22.0f, 0.0f, -42.0f });
+        float sample[9] = { normal(generator), normal(generator), normal(generator), acc.x, acc.y, acc.z, mag.x, mag.y, mag.z };
+        for (int channel = 0; channel < 9; channel++) readings[9 * i + channel] = sample[channel];
+    }
+
+    SwingPhaseDetector detector;
+    Quat heading_offset = AxisAngle({ 0.0f, 0.0f, 1.0f }, 0.3f);
+    float q[4] = { 1.0f, 0.0f, 0.0f, 0.0f };
+    Result fused = measure(calls, [&](int i) {
+        const float* r = &readings[9 * (i % TABLE_SIZE)];
+        MadgwickBatchInput input = { r, r + 1, r + 2, r + 3, r + 4, r + 5, r + 6, r + 7, r + 8 };
+        float q_out[4];
+        MadgwickAHRSupdateBatch(q, input, 1, odr, 0.041f, q_out);
+
+        Quat adjusted = heading_offset * Quat{ q_out[0], q_out[1], q_out[2], q_out[3] };
+        float sin_pitch = fmaxf(-1.0f, fminf(1.0f, 2.0f * (adjusted.w * adjusted.y - adjusted.x * adjusted.z)));
+        SwingSample sample = { i / odr, adjusted,
+            { atan2f(2.0f * (adjusted.w * adjusted.x + adjusted.y * adjusted.z), 1.0f - 2.0f * (adjusted.x * adjusted.x + adjusted.y * adjusted.y)), asinf(sin_pitch),
+              atan2f(2.0f * (adjusted.w * adjusted.z + adjusted.x * adjusted.y), 1.0f - 2.0f * (adjusted.y * adjusted.y + adjusted.z * adjusted.z)) },
+            r[1], r[2] };
+
+        SwingPhaseEvent event;
+        detector.addSample(sample, event);
+        Vec3 path = detector.clubVector() - detector.ballLocation();
+        return (double)(path.x + path.y);
+    });
+
+    printf("\nfused sample               %9.2f ns %6.2f allocs per sample\n", fused.nanoseconds, fused.allocations);
+    printf("largest difference from the std::vector<float> versions: %g, impacts %s\n", worst_error, impacts_match ? "match" : "DON'T match");
+
+    //The per-sample path must never allocate, and the new versions have to give the same answers as the old ones
+    return (fused.allocations == 0.0 && new_allocations == 0.0 && impacts_match && worst_error < 1e-4) ? 0 : 1;
+}
@@ -0,0 +1,483 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../DirectXApp/Devices/VirtualPersonalCaddie.h"
+#include "../DirectXApp/Devices/DeviceClock.h"
+#include "../DirectXApp/Devices/PacketReassembler.h"
+#include "../DirectXApp/Devices/SessionDataStore.h"
+#include "../DirectXApp/Devices/SpscQueue.h"
+#include "../DirectXApp/Math/madgwick_batch.h"
+#include "../DirectXApp/Math/SensorFusion/FusionAlignment.h"
+
+//Load test for everything downstream of BLE. A VirtualPersonalCaddie builds composite data notifications exactly like
+//the firmware does (from a recording or a synthetic practice session, at any ODR and with whatever link problems are
+//asked for) and they go through the same steps PersonalCaddie::compositeDataCharacteristicEventHandler() and
+//PersonalCaddie::dataUpdate() take: sequence numbers -> decode and calibrate -> device clock -> sensor fusion ->
+//session data store -> sample batch queue. A second thread stands in for the render thread and empties the queue.
+//See readme.txt for how to build it.
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    const int MAX_SAMPLES = COMPOSITE_MAX_SAMPLES;
+    const int BATCH_QUEUE_SIZE = 16; //matches SAMPLE_BATCH_QUEUE_SIZE in PersonalCaddie.h
+    const unsigned int ALIGNMENT_SAMPLES = 39; //matches ATTITUDE_ALIGNMENT_SAMPLES in PersonalCaddie.h
+
+    //The data types that get filled in here, in the same order as the DataType enum in PersonalCaddie.h
+    enum PipelineDataType
+    {
+        ACCELERATION = 0,
+        ROTATION,
+        MAGNETIC,
+        RAW_ACCELERATION,
+        RAW_ROTATION,
+        RAW_MAGNETIC,
+        LINEAR_ACCELERATION
+    };
+
+    //A processed data set on its way to the render thread, the same as SampleBatch in PersonalCaddie.h
+    struct Batch
+    {
+        float sensorData[SESSION_DATA_TYPES][COMPOSITE_AXES][MAX_SAMPLES];
+        float quaternions[MAX_SAMPLES][4];
+        int numberOfSamples = 0;
+        float sensorODR = 0.0f;
+        uint64_t firstSessionSample = 0;
+
+        Clock::time_point handled; //when the notification was handed to the pipeline
+        double lastSampleTime = 0.0; //when the virtual Personal Caddie read the last sample, seconds after the test started
+    };
+    typedef SpscQueue<Batch, BATCH_QUEUE_SIZE> BatchQueue;
+
+    double seconds(Clock::duration duration)
+    {
+        return std::chrono::duration<double>(duration).count();
+    }
+
+    double percentile(std::vector<double>& values, double fraction)
+    {
+        if (values.empty()) return 0.0;
+        size_t index = (size_t)(fraction * (values.size() - 1));
+        std::nth_element(values.begin(), values.begin() + index, values.end());
+        return values[index];
+    }
+
+    class HostPipeline
+    {
+    public:
+        HostPipeline(float nominal_odr, float beta, BatchQueue& queue) :
+            m_nominalOdr(nominal_odr), m_beta(beta), m_queue(queue), m_sessionData(SESSION_DEFAULT_MEMORY_BUDGET)
+        {
+            //Identity calibration and axis orientations with the default conversion rates of the sensors
+            const int axis_swap[COMPOSITE_AXES] = { 0, 1, 2 }, axis_polarity[COMPOSITE_AXES] = { 1, 1, 1 };
+            const float offset[COMPOSITE_AXES] = { 0.0f, 0.0f, 0.0f };
+            const float gain_rows[COMPOSITE_AXES][COMPOSITE_AXES] = { { 1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f } };
+            const float* gain[COMPOSITE_AXES] = { gain_rows[0], gain_rows[1], gain_rows[2] };
+            for (int sensor = 0; sensor < COMPOSITE_SENSORS; sensor++)
+            {
+                m_decoder.setSensorTable(sensor, VirtualPersonalCaddie::defaultConversionRate(sensor), axis_swap, axis_polarity, offset, gain);
+            }
+
+            for (int dt = 0; dt < SESSION_DATA_TYPES; dt++)
+            {
+                for (int axis = 0; axis < COMPOSITE_AXES; axis++)
+                {
+                    for (int i = 0; i < MAX_SAMPLES; i++) m_sensorData[dt][axis][i] = 0.0f;
+                }
+            }
+            for (int sensor = 0; sensor < COMPOSITE_SENSORS; sensor++)
+            {
+                for (int axis = 0; axis < COMPOSITE_AXES; axis++)
+                {
+                    m_decodeOutput.raw[sensor][axis] = m_sensorData[RAW_ACCELERATION + sensor][axis];
+                    m_decodeOutput.calibrated[sensor][axis] = m_sensorData[ACCELERATION + sensor][axis];
+                }
+            }
+            for (int component = 0; component < 4; component++) m_decodeOutput.quaternion[component] = m_fusedQuaternions[component];
+            for (int axis = 0; axis < COMPOSITE_AXES; axis++) m_decodeOutput.linear[axis] = m_sensorData[LINEAR_ACCELERATION][axis];
+
+            m_packetReassembler.reset();
+            m_deviceClock.reset();
+            m_deviceClock.setNominalOdr(m_nominalOdr);
+            FusionAlignmentReset(&m_alignment);
+            m_lastProcessedTime = -1.0 / m_nominalOdr;
+        }
+
+        //Everything that happens to a single notification, returns false if it was thrown away
+        bool handle(const uint8_t* data, size_t length, double arrival_time, double last_sample_time)
+        {
+            Clock::time_point handled = Clock::now();
+
+            CompositePacketHeader header;
+            if (CompositeDataDecoder::readHeader(data, length, header) <= 0) return false;
+            m_packetReassembler.setTicksPerSample(m_deviceClock.ticksPerSample());
+            if (!m_packetReassembler.addPacket(header, arrival_time, m_lastPacket)) return false;
+
+            uint32_t timer_ticks = 0;
+            m_samples = m_decoder.decode(data, length, timer_ticks, m_decodeOutput, MAX_SAMPLES);
+            if (m_samples <= 0) return false;
+
+            m_deviceClock.addPacket(m_deviceClock.unwrap(header.timer_ticks), m_lastPacket.first_sample, m_samples, arrival_time);
+            m_deviceClock.sampleTimes(m_lastPacket.first_sample, m_samples, m_sampleTimes);
+
+            if (header.fused)
+            {
+                for (int i = 0; i < m_samples; i++)
+                {
+                    for (int component = 0; component < 4; component++) m_quaternions[i][component] = m_fusedQuaternions[component][i];
+                }
+            }
+            else
+            {
+                updateMadgwick();
+                updateLinearAcceleration();
+            }
+            m_lastProcessedTime = m_sampleTimes[m_samples - 1];
+
+            appendToSessionData();
+            pushBatch(handled, last_sample_time);
+            return true;
+        }
+
+        LinkQualityStats const& linkQuality() const { return m_packetReassembler.stats(); }
+        DeviceClock const& deviceClock() const { return m_deviceClock; }
+        uint64_t sessionSamples() const { return m_sessionData.newestSample(); }
+
+    private:
+        void updateMadgwick()
+        {
+            //The first sample builds on the last quaternion of the previous data set using the real time between them (so lost
+            //packets are stepped over), the rest are spaced out by the measured ODR. See PersonalCaddie::updateMadgwick().
+            const float(*acc)[MAX_SAMPLES] = m_sensorData[ACCELERATION], (*gyr)[MAX_SAMPLES] = m_sensorData[ROTATION], (*mag)[MAX_SAMPLES] = m_sensorData[MAGNETIC];
+            MadgwickBatchInput input = { gyr[0], gyr[1], gyr[2], acc[0], acc[1], acc[2], mag[0], mag[1], mag[2] };
+
+            //The filter starts from the orientation gravity and the magnetic field give once enough samples have come in
+            if (!m_aligned)
+            {
+                for (int i = 0; i < m_samples; i++)
+                {
+                    FusionVector accelerometer = { acc[0][i], acc[1][i], acc[2][i] };
+                    FusionVector magnetometer = { mag[0][i], mag[1][i], mag[2][i] };
+                    FusionAlignmentAdd(&m_alignment, accelerometer, magnetometer);
+                }
+
+                if (FusionAlignmentGetSamples(&m_alignment) >= ALIGNMENT_SAMPLES)
+                {
+                    FusionQuaternion initial;
+                    m_aligned = FusionAlignmentQuaternion(&m_alignment, FusionConventionNwu, &initial);
+                    if (m_aligned) for (int component = 0; component < 4; component++) m_q[component] = initial.array[component];
+                    FusionAlignmentReset(&m_alignment);
+                }
+            }
+
+            float gap = (float)(m_sampleTimes[0] - m_lastProcessedTime);
+            float first_rate = (gap > 0.0f) ? 1.0f / gap : m_nominalOdr;
+            MadgwickAHRSupdateBatch(m_q, input, 1, first_rate, m_beta, m_quaternions[0]);
+
+            if (m_samples > 1)
+            {
+                MadgwickBatchInput rest = { gyr[0] + 1, gyr[1] + 1, gyr[2] + 1, acc[0] + 1, acc[1] + 1, acc[2] + 1, mag[0] + 1, mag[1] + 1, mag[2] + 1 };
+                MadgwickAHRSupdateBatch(m_q, rest, m_samples - 1, (float)m_deviceClock.odr(), m_beta, m_quaternions[1]);
+            }
+        }
+
+        void updateLinearAcceleration()
+        {
+            for (int i = 0; i < m_samples; i++)
+            {
+                const float* q = m_quaternions[i];
+                float gravity[COMPOSITE_AXES] = {
+                    2 * COMPOSITE_GRAVITY * (q[1] * q[3] - q[0] * q[2]),
+                    2 * COMPOSITE_GRAVITY * (q[2] * q[3] + q[0] * q[1]),
+                    COMPOSITE_GRAVITY * (q[0] * q[0] - q[1] * q[1] - q[2] * q[2] + q[3] * q[3])
+                };
+                for (int axis = 0; axis < COMPOSITE_AXES; axis++) m_sensorData[LINEAR_ACCELERATION][axis][i] = m_sensorData[ACCELERATION][axis][i] - gravity[axis];
+            }
+        }
+
+        void appendToSessionData()
+        {
+            const float* channels[SESSION_CHANNELS];
+            for (int dt = 0; dt < SESSION_DATA_TYPES; dt++)
+            {
+                for (int axis = 0; axis < COMPOSITE_AXES; axis++) channels[sessionChannel(dt, axis)] = m_sensorData[dt][axis];
+            }
+
+            float quaternion_components[4][MAX_SAMPLES];
+            for (int i = 0; i < m_samples; i++)
+            {
+                for (int component = 0; component < 4; component++) quaternion_components[component][i] = m_quaternions[i][component];
+            }
+            for (int component = 0; component < 4; component++) channels[SESSION_QUATERNION_CHANNEL + component] = quaternion_components[component];
+
+            m_latestSessionSample = m_sessionData.append(channels, m_sampleTimes, m_samples);
+        }
+
+        void pushBatch(Clock::time_point handled, double last_sample_time)
+        {
+            Batch* batch = m_queue.beginPush();
+            if (batch == nullptr) return;
+
+            for (int dt = 0; dt < SESSION_DATA_TYPES; dt++)
+            {
+                for (int axis = 0; axis < COMPOSITE_AXES; axis++) std::copy(m_sensorData[dt][axis], m_sensorData[dt][axis] + m_samples, batch->sensorData[dt][axis]);
+            }
+            std::copy(&m_quaternions[0][0], &m_quaternions[0][0] + 4 * m_samples, &batch->quaternions[0][0]);
+
+            batch->numberOfSamples = m_samples;
+            batch->sensorODR = (float)m_deviceClock.odr();
+            batch->firstSessionSample = m_latestSessionSample;
+            batch->handled = handled;
+            batch->lastSampleTime = last_sample_time;
+
+            m_queue.endPush();
+        }
+
+        float m_nominalOdr;
+        float m_beta;
+        BatchQueue& m_queue;
+
+        CompositeDataDecoder m_decoder;
+        CompositeDecodeOutput m_decodeOutput;
+        PacketReassembler m_packetReassembler;
+        ReassembledPacket m_lastPacket;
+        DeviceClock m_deviceClock;
+        SessionDataStore m_sessionData;
+        uint64_t m_latestSessionSample = 0;
+
+        int m_samples = 0;
+        float m_sensorData[SESSION_DATA_TYPES][COMPOSITE_AXES][MAX_SAMPLES];
+        float m_fusedQuaternions[4][MAX_SAMPLES];
+        float m_quaternions[MAX_SAMPLES][4];
+        double m_sampleTimes[MAX_SAMPLES];
+        float m_q[4] = { 1.0f, 0.0f, 0.0f, 0.0f };
+        bool m_aligned = false;
+        FusionAlignment m_alignment = {};
+        double m_lastProcessedTime;
+    };
+
+    bool parseEncoding(std::string const& name, uint8_t& encoding)
+    {
+        const char* names[SAMPLE_ENCODING_END] = { "raw", "packed", "fused", "fused-linear" };
+        for (int i = 0; i < SAMPLE_ENCODING_END; i++)
+        {
+            if (name == names[i])
+            {
+                encoding = (uint8_t)i;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool endsWith(std::string const& text, std::string const& ending)
+    {
+        return text.size() >= ending.size() && text.compare(text.size() - ending.size(), ending.size(), ending) == 0;
+    }
+
+    void printUsage(const char* program)
+    {
+        printf("Usage: %s [options] [<data set or .pcs session file>]\n\n", program);
+        printf("With no file a synthetic practice session is sent. Options:\n");
+        printf("  --odr <Hz>                 sensor ODR, defaults to the rate of the recording (400 Hz for synthetic data)\n");
+        printf("  --samples <n>              samples per data set, capped at what the encoding fits (default 13)\n");
+        printf("  --encoding <name>          raw, packed, fused or fused-linear (default raw)\n");
+        printf("  --seconds <s>              seconds of data to send, recordings loop until then (default 10, 0 = the recording once)\n");
+        printf("  --interval <ms>            connection interval, 0 sends notifications as soon as they're ready (default 0)\n");
+        printf("  --per-event <n>            notifications per connection event (default 6)\n");
+        printf("  --queue <n>                notification queue size on the Personal Caddie (default 8)\n");
+        printf("  --jitter <ms>              random extra delay on each notification (default 0)\n");
+        printf("  --loss <fraction>          notifications lost on the way over (default 0)\n");
+        printf("  --drop <fraction>          notifications dropped by the Personal Caddie (default 0)\n");
+        printf("  --reorder <fraction>       notifications that arrive after the next one (default 0)\n");
+        printf("  --odr-error <ppm>          sensor oscillator error (default 0)\n");
+        printf("  --drift <ppm>              Personal Caddie clock drift (default 0)\n");
+        printf("  --drift-tolerance <ppm>    how far the measured drift can be from --drift once it's known (default %.0f)\n", DEVICE_CLOCK_DRIFT_RESOLUTION);
+        printf("  --beta <gain>              Madgwick gain (default 0.041)\n");
+        printf("  --realtime                 hand notifications over at the time they'd arrive instead of as fast as possible\n");
+        printf("  --seed <n>                 random seed (default 1)\n");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    VirtualDeviceSettings settings;
+    settings.odr = 0.0f;
+    float beta = 0.041f;
+    double drift_tolerance = DEVICE_CLOCK_DRIFT_RESOLUTION;
+    bool realtime = false;
+    const char* file = nullptr;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        bool has_value = i + 1 < argc;
+        if (argument == "--odr" && has_value) settings.odr = (float)atof(argv[++i]);
+        else if (argument == "--samples" && has_value) settings.samplesPerPacket = atoi(argv[++i]);
+        else if (argument == "--encoding" && has_value)
+        {
+            if (!parseEncoding(argv[++i], settings.encoding))
+            {
+                printf("Unknown encoding '%s'\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (argument == "--seconds" && has_value) settings.duration = atof(argv[++i]);
+        else if (argument == "--interval" && has_value) settings.connectionInterval = atof(argv[++i]) / 1000.0;
+        else if (argument == "--per-event" && has_value) settings.notificationsPerEvent = atoi(argv[++i]);
+        else if (argument == "--queue" && has_value) settings.queueSize = atoi(argv[++i]);
+        else if (argument == "--jitter" && has_value) settings.jitter = atof(argv[++i]) / 1000.0;
+        else if (argument == "--loss" && has_value) settings.lossRate = atof(argv[++i]);
+        else if (argument == "--drop" && has_value) settings.dropRate = atof(argv[++i]);
+        else if (argument == "--reorder" && has_value) settings.reorderRate = atof(argv[++i]);
+        else if (argument == "--odr-error" && has_value) settings.odrErrorPpm = atof(argv[++i]);
+        else if (argument == "--drift" && has_value) settings.clockDriftPpm = atof(argv[++i]);
+        else if (argument == "--drift-tolerance" && has_value) drift_tolerance = atof(argv[++i]);
+        else if (argument == "--beta" && has_value) beta = (float)atof(argv[++i]);
+        else if (argument == "--seed" && has_value) settings.seed = (uint32_t)strtoul(argv[++i], nullptr, 10);
+        else if (argument == "--realtime") realtime = true;
+        else if (argument == "--help" || argument[0] == '-')
+        {
+            printUsage(argv[0]);
+            return argument == "--help" ? 0 : 1;
+        }
+        else file = argv[i];
+    }
+
+    //Pick the source of the samples
+    std::unique_ptr<VirtualSampleSource> source;
+    if (file == nullptr)
+    {
+        source.reset(new SyntheticSwingSource((settings.odr > 0.0f) ? settings.odr : 400.0f, 2.0f, settings.seed));
+    }
+    else
+    {
+        std::unique_ptr<RecordedSampleSource> recording(new RecordedSampleSource());
+        bool loaded = endsWith(file, ".pcs") ? recording->loadSessionFile(file) : recording->loadDataSet(file);
+        if (!loaded)
+        {
+            printf("Couldn't read any samples from '%s'\n", file);
+            return 1;
+        }
+        source = std::move(recording);
+    }
+
+    VirtualPersonalCaddie device(settings, std::move(source));
+    BatchQueue queue;
+    HostPipeline pipeline(device.odr(), beta, queue);
+
+    //The render thread stand in. It pulls batches off the queue as soon as they show up and reads through the
+    //quaternions (like a mode's addData() would) so the data really has to cross between the two threads.
+    std::atomic<bool> producing(true);
+    std::vector<double> latencies;
+    latencies.reserve(1 << 16);
+    double quaternion_sum = 0.0;
+    Clock::time_point start = Clock::now();
+
+    std::thread consumer([&]()
+    {
+        while (true)
+        {
+            bool done = !producing.load(std::memory_order_acquire);
+            Batch* batch = queue.front();
+            if (batch == nullptr)
+            {
+                if (done) break;
+                std::this_thread::yield();
+                continue;
+            }
+
+            for (int i = 0; i < batch->numberOfSamples; i++) quaternion_sum += batch->quaternions[i][0];
+
+            //In real time the latency is from the moment the last sample was read on the Personal Caddie, otherwise it's
+            //only the time spent on this computer
+            Clock::time_point now = Clock::now();
+            latencies.push_back(realtime ? seconds(now - start) - batch->lastSampleTime : seconds(now - batch->handled));
+            queue.pop();
+        }
+    });
+
+    std::vector<double> handler_times;
+    handler_times.reserve(1 << 16);
+    VirtualNotification notification;
+    uint64_t ignored = 0;
+    double handler_seconds = 0.0;
+
+    while (device.nextNotification(notification))
+    {
+        double arrival_time = notification.arrivalTime;
+        if (realtime)
+        {
+            std::this_thread::sleep_until(start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(notification.arrivalTime)));
+            arrival_time = seconds(Clock::now() - start);
+        }
+        else
+        {
+            //As fast as possible would just overrun the batch queue (the app drops batches rather than wait), so
+            //give the render thread stand in a chance to keep up and the throughput covers the whole path
+            while (queue.size() >= queue.capacity()) std::this_thread::yield();
+        }
+
+        Clock::time_point handler_start = Clock::now();
+        if (!pipeline.handle(notification.data, notification.length, arrival_time, notification.lastSampleTime)) ignored++;
+        double handler_time = seconds(Clock::now() - handler_start);
+        handler_seconds += handler_time;
+        handler_times.push_back(handler_time);
+    }
+    double total_seconds = seconds(Clock::now() - start);
+
+    producing.store(false, std::memory_order_release);
+    consumer.join();
+
+    //Results
+    VirtualDeviceStats const& sent = device.stats();
+    LinkQualityStats const& link = pipeline.linkQuality();
+    const char* encodings[SAMPLE_ENCODING_END] = { "raw", "packed", "fused", "fused-linear" };
+
+    printf("Virtual Personal Caddie: %s, %.1f Hz, %d samples per data set, %s encoding\n", (file != nullptr) ? file : "synthetic swings", device.odr(),
+        device.samplesPerPacket(), encodings[settings.encoding]);
+    printf("  sent       %llu samples in %llu data sets, %llu notifications (%.1f bytes per sample delivered)\n", (unsigned long long)sent.samples,
+        (unsigned long long)sent.dataSets, (unsigned long long)sent.notifications, sent.samplesDelivered > 0 ? (double)sent.bytesDelivered / sent.samplesDelivered : 0.0);
+    printf("  link       %llu delivered, %llu dropped by the device (largest queue %u), %llu lost, %llu reordered\n", (unsigned long long)sent.notificationsDelivered,
+        (unsigned long long)sent.notificationsDropped, sent.maxQueueDepth, (unsigned long long)sent.notificationsLost, (unsigned long long)sent.notificationsReordered);
+    printf("  app saw    %llu received, %llu lost (%llu dropped by the device), %llu out of order, %llu samples lost, %llu restarts\n",
+        (unsigned long long)link.packets_received, (unsigned long long)link.packets_lost, (unsigned long long)link.packets_dropped_by_device,
+        (unsigned long long)link.packets_out_of_order, (unsigned long long)link.samples_lost, (unsigned long long)link.stream_restarts);
+    DeviceClock const& clock = pipeline.deviceClock();
+    char drift[32] = "not known yet";
+    if (clock.driftKnown()) snprintf(drift, sizeof(drift), "%.1f ppm", clock.driftPpm());
+    printf("  clock      measured ODR %.3f Hz (sensor runs at %.3f Hz), drift %s (set to %.1f ppm), +/- %.1f ppm from %d sync windows, %d rejected\n", clock.odr(),
+        device.odr() * (1.0 + settings.odrErrorPpm * 1.0e-6), drift, settings.clockDriftPpm, clock.driftUncertaintyPpm(), clock.syncWindows(), clock.rejectedSyncWindows());
+
+    //Every notification the app didn't get (or threw away for being late) has to be accounted for
+    uint64_t missing = sent.notificationsDropped + sent.notificationsLost + link.packets_out_of_order;
+    bool accounted = link.packets_lost == missing && link.packets_dropped_by_device == sent.notificationsDropped;
+    printf("  accounting %s\n", accounted ? "matches the virtual device" : "DOESN'T match the virtual device");
+
+    //A drift the clock hasn't settled on yet isn't used for anything, once it has it's applied to every time stamp
+    bool drift_correct = !clock.driftKnown() || std::fabs(clock.driftPpm() - settings.clockDriftPpm) <= drift_tolerance;
+    if (!drift_correct) printf("  drift      OFF by more than %.1f ppm\n", drift_tolerance);
+
+    std::vector<double> latency_copy = latencies;
+    printf("\n  throughput %.0f samples/s (%.0fx real time), %.0f notifications/s, handler %.2f us per notification (p99 %.2f us)\n",
+        sent.samplesDelivered / total_seconds, realtime ? 1.0 : (sent.samples / device.odr()) / total_seconds, sent.notificationsDelivered / total_seconds,
+        1.0e6 * handler_seconds / std::max<size_t>(handler_times.size(), 1), 1.0e6 * percentile(handler_times, 0.99));
+    printf("  latency    %s: median %.3f ms, p99 %.3f ms, max %.3f ms over %zu batches\n", realtime ? "last sample read to render thread" : "notification to render thread",
+        1000.0 * percentile(latency_copy, 0.5), 1000.0 * percentile(latency_copy, 0.99), latency_copy.empty() ? 0.0 : 1000.0 * *std::max_element(latency_copy.begin(), latency_copy.end()),
+        latencies.size());
+    printf("  queue      %llu batch overruns, high water mark %zu of %zu, %llu samples in the session store, %llu notifications ignored\n",
+        (unsigned long long)queue.overruns(), queue.highWaterMark(), queue.capacity(), (unsigned long long)pipeline.sessionSamples(), (unsigned long long)ignored);
+    if (quaternion_sum == 0.0) printf("(no quaternions made it to the render thread)\n");
+
+    return (accounted && drift_correct) ? 0 : 1;
+}